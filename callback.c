@@ -6,15 +6,42 @@
 #include <stddef.h>
 
 #include "putty.h"
+#include "tree234.h"
+
+struct cbbucket;
 
 struct callback {
-    struct callback *next;
+    /* Links in the global FIFO of pending callbacks. */
+    struct callback *next, *prev;
+
+    /*
+     * Links in the per-context bucket this callback belongs to, so
+     * that delete_callbacks_for_context can find all the callbacks
+     * for one context without scanning the whole queue. Order within
+     * a bucket doesn't matter (the global list preserves run order),
+     * so new callbacks just go on the head.
+     */
+    struct callback *cnext, *cprev;
+    struct cbbucket *bucket;
 
     toplevel_callback_fn_t fn;
     void *ctx;
 };
 
+struct cbbucket {
+    void *ctx;
+    struct callback *head;
+};
+
 static struct callback *cbcurr = NULL, *cbhead = NULL, *cbtail = NULL;
+static tree234 *cbbuckets = NULL;
+
+/*
+ * Callbacks with a null context can't be looked up in the tree (null
+ * isn't a valid search key for find234), so they share this one
+ * statically allocated bucket instead.
+ */
+static struct cbbucket nullbucket = { NULL, NULL };
 
 static toplevel_callback_notify_fn_t notify_frontend = NULL;
 static void *notify_ctx = NULL;
@@ -41,37 +68,102 @@ void queue_idempotent_callback(struct IdempotentCallback *ic)
     queue_toplevel_callback(run_idempotent_callback, ic);
 }
 
+static int cbbucket_cmp(void *av, void *bv)
+{
+    struct cbbucket *a = (struct cbbucket *)av;
+    struct cbbucket *b = (struct cbbucket *)bv;
+    if (a->ctx < b->ctx)
+        return -1;
+    else if (a->ctx > b->ctx)
+        return +1;
+    return 0;
+}
+
+static int cbbucket_find(void *av, void *bv)
+{
+    void *a = av;
+    struct cbbucket *b = (struct cbbucket *)bv;
+    if (a < b->ctx)
+        return -1;
+    else if (a > b->ctx)
+        return +1;
+    return 0;
+}
+
+/*
+ * The context a callback is filed under for the benefit of
+ * delete_callbacks_for_context. For an idempotent callback, the
+ * context passed to queue_toplevel_callback is the IdempotentCallback
+ * structure itself, and the context its owner would delete by is the
+ * one stored inside that structure.
+ */
+static void *callback_context_key(toplevel_callback_fn_t fn, void *ctx)
+{
+    if (fn == run_idempotent_callback)
+        return ((struct IdempotentCallback *)ctx)->ctx;
+    return ctx;
+}
+
+static void unlink_from_bucket(struct callback *cb)
+{
+    struct cbbucket *bucket = cb->bucket;
+
+    if (cb->cprev)
+        cb->cprev->cnext = cb->cnext;
+    else
+        bucket->head = cb->cnext;
+    if (cb->cnext)
+        cb->cnext->cprev = cb->cprev;
+
+    if (!bucket->head && bucket != &nullbucket) {
+        del234(cbbuckets, bucket);
+        sfree(bucket);
+    }
+}
+
 void delete_callbacks_for_context(void *ctx)
 {
-    struct callback *newhead, *newtail;
+    struct cbbucket *bucket;
 
-    newhead = newtail = NULL;
-    while (cbhead) {
-        struct callback *cb = cbhead;
-        cbhead = cbhead->next;
-        if (cb->ctx == ctx ||
-            (cb->fn == run_idempotent_callback &&
-             ((struct IdempotentCallback *)cb->ctx)->ctx == ctx)) {
-            sfree(cb);
-        } else {
-            if (!newhead)
-                newhead = cb;
-            else
-                newtail->next = cb;
+    if (!ctx)
+        bucket = &nullbucket;
+    else if (!cbbuckets ||
+             (bucket = find234(cbbuckets, ctx, cbbucket_find)) == NULL)
+        return;
 
-            newtail = cb;
-        }
+    /*
+     * Free every callback in this context's bucket, unlinking each
+     * one from the global queue as we go. Callbacks for other
+     * contexts are never touched, so this costs time proportional to
+     * the number of callbacks actually deleted.
+     */
+    while (bucket->head) {
+        struct callback *cb = bucket->head;
+        bucket->head = cb->cnext;
+
+        if (cb->prev)
+            cb->prev->next = cb->next;
+        else
+            cbhead = cb->next;
+        if (cb->next)
+            cb->next->prev = cb->prev;
+        else
+            cbtail = cb->prev;
+
+        sfree(cb);
     }
 
-    cbhead = newhead;
-    cbtail = newtail;
-    if (newtail)
-        newtail->next = NULL;
+    if (bucket != &nullbucket) {
+        del234(cbbuckets, bucket);
+        sfree(bucket);
+    }
 }
 
 void queue_toplevel_callback(toplevel_callback_fn_t fn, void *ctx)
 {
     struct callback *cb;
+    struct cbbucket *bucket;
+    void *key;
 
     cb = snew(struct callback);
     cb->fn = fn;
@@ -91,6 +183,29 @@ void queue_toplevel_callback(toplevel_callback_fn_t fn, void *ctx)
     if (notify_frontend && !cbhead && !cbcurr)
         notify_frontend(notify_ctx);
 
+    key = callback_context_key(fn, ctx);
+    if (!key) {
+        bucket = &nullbucket;
+    } else {
+        if (!cbbuckets)
+            cbbuckets = newtree234(cbbucket_cmp);
+        bucket = find234(cbbuckets, key, cbbucket_find);
+        if (!bucket) {
+            bucket = snew(struct cbbucket);
+            bucket->ctx = key;
+            bucket->head = NULL;
+            add234(cbbuckets, bucket);
+        }
+    }
+
+    cb->bucket = bucket;
+    cb->cprev = NULL;
+    cb->cnext = bucket->head;
+    if (bucket->head)
+        bucket->head->cprev = cb;
+    bucket->head = cb;
+
+    cb->prev = cbtail;
     if (cbtail)
         cbtail->next = cb;
     else
@@ -112,13 +227,32 @@ bool run_toplevel_callbacks(void)
          */
         cbcurr = cbhead;
         cbhead = cbhead->next;
-        if (!cbhead)
+        if (cbhead)
+            cbhead->prev = NULL;
+        else
             cbtail = NULL;
+        unlink_from_bucket(cbcurr);
 
         /*
          * Now run the callback, and then clear it out of cbcurr.
          */
-        cbcurr->fn(cbcurr->ctx);
+        if (loopstats_active()) {
+            /*
+             * Attribute the time to the function that will actually
+             * do the work, which for an idempotent callback is the
+             * one inside the IdempotentCallback structure rather than
+             * our own trampoline.
+             */
+            toplevel_callback_fn_t fn = cbcurr->fn;
+            uintptr_t id = (uintptr_t)fn;
+            if (fn == run_idempotent_callback)
+                id = (uintptr_t)((struct IdempotentCallback *)cbcurr->ctx)->fn;
+            uint64_t start = loopstats_now_us();
+            fn(cbcurr->ctx);
+            loopstats_record("callback", id, start, false);
+        } else {
+            cbcurr->fn(cbcurr->ctx);
+        }
         sfree(cbcurr);
         cbcurr = NULL;
 
@@ -54,13 +54,10 @@ int charset_from_unicode(const wchar_t **input, int *inlen,
     param.stopped = 0;
 
     /*
-     * charset_emit will expect a valid errstr.
+     * A null errstr (with errlen 0) means unencodable characters are
+     * simply dropped; charset_emit, and the fast paths below, then
+     * copy nothing for an error.
      */
-    if (!errstr) {
-        /* *shrug* this is good enough, and consistent across all SBCS... */
-        param.errstr = ".";
-        param.errlen = 1;
-    }
     param.errstr = errstr;
     param.errlen = errlen;
 
@@ -71,6 +68,84 @@ int charset_from_unicode(const wchar_t **input, int *inlen,
     }
     state = &localstate;
 
+    /*
+     * Fast path for single-byte character sets: they are stateless,
+     * so we can run the reverse lookup over the whole span directly,
+     * without an indirect call and an emit callback per character.
+     */
+    if (spec->write == write_sbcs) {
+        const struct sbcs_data *sd = spec->data;
+        while (*inlen > 0) {
+            int c = sbcs_from_unicode(sd, **input);
+            if (c >= 0) {
+                if (param.outlen < 1)
+                    break;
+                *param.output++ = c;
+                param.outlen--;
+            } else {
+                const char *p = param.errstr;
+                int n = param.errlen;
+                if (param.outlen < n)
+                    break;
+                while (n-- > 0) {
+                    *param.output++ = *p++;
+                    param.outlen--;
+                }
+            }
+            (*input)++;
+            (*inlen)--;
+        }
+        return param.output - output;
+    }
+
+    /*
+     * Similarly for UTF-8, which is stateless when writing: encode
+     * each character straight into the output buffer.
+     */
+    if (spec->charset == CS_UTF8) {
+        while (*inlen > 0) {
+            long int u = **input;
+            char buf[6];
+            const char *p;
+            int n = 0;
+
+            if (u == 0xFFFE || u == 0xFFFF ||
+                (u >= 0xD800 && u < 0xE000)) {
+                p = param.errstr;
+                n = param.errlen;
+            } else {
+                if (u < 0x80) {
+                    buf[n++] = u;
+                } else {
+                    int continuations, shift;
+                    if (u < 0x800)
+                        continuations = 1, buf[n++] = 0xC0 | (u >> 6);
+                    else if (u < 0x10000)
+                        continuations = 2, buf[n++] = 0xE0 | (u >> 12);
+                    else if (u < 0x200000)
+                        continuations = 3, buf[n++] = 0xF0 | (u >> 18);
+                    else if (u < 0x4000000)
+                        continuations = 4, buf[n++] = 0xF8 | (u >> 24);
+                    else
+                        continuations = 5, buf[n++] = 0xFC | (u >> 30);
+                    for (shift = 6 * (continuations-1); shift >= 0;
+                         shift -= 6)
+                        buf[n++] = 0x80 | (0x3F & (u >> shift));
+                }
+                p = buf;
+            }
+            if (param.outlen < n)
+                break;
+            while (n-- > 0) {
+                *param.output++ = *p++;
+                param.outlen--;
+            }
+            (*input)++;
+            (*inlen)--;
+        }
+        return param.output - output;
+    }
+
     while (*inlen > 0) {
         int lenbefore = param.output - output;
         spec->write(spec, **input, &localstate, charset_emit, &param);
@@ -73,6 +73,7 @@ struct sbcs_data {
  * Prototypes for internal library functions.
  */
 charset_spec const *charset_find_spec(int charset);
+int sbcs_from_unicode(const struct sbcs_data *sd, long int input_chr);
 void read_sbcs(charset_spec const *charset, long int input_chr,
                charset_state *state,
                void (*emit)(void *ctx, long int output), void *emitctx);
@@ -23,15 +23,10 @@ void read_sbcs(charset_spec const *charset, long int input_chr,
     emit(emitctx, sd->sbcs2ucs[input_chr]);
 }
 
-void write_sbcs(charset_spec const *charset, long int input_chr,
-                charset_state *state,
-                void (*emit)(void *ctx, long int output), void *emitctx)
+int sbcs_from_unicode(const struct sbcs_data *sd, long int input_chr)
 {
-    const struct sbcs_data *sd = charset->data;
     int i, j, k, c;
 
-    UNUSEDARG(state);
-
     /*
      * Binary-search in the ucs2sbcs table.
      */
@@ -44,10 +39,21 @@ void write_sbcs(charset_spec const *charset, long int input_chr,
             j = k;
         else if (input_chr > sd->sbcs2ucs[c])
             i = k;
-        else {
-            emit(emitctx, c);
-            return;
-        }
+        else
+            return c;
     }
-    emit(emitctx, ERROR);
+    return -1;
+}
+
+void write_sbcs(charset_spec const *charset, long int input_chr,
+                charset_state *state,
+                void (*emit)(void *ctx, long int output), void *emitctx)
+{
+    const struct sbcs_data *sd = charset->data;
+    int c;
+
+    UNUSEDARG(state);
+
+    c = sbcs_from_unicode(sd, input_chr);
+    emit(emitctx, c >= 0 ? c : ERROR);
 }
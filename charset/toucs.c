@@ -67,8 +67,68 @@ int charset_to_unicode(const char **input, int *inlen,
         localstate = *state;           /* structure copy */
     }
 
+    /*
+     * Fast path for single-byte character sets: their data is a flat
+     * 256-entry table built at library compile time, and they keep no
+     * decoder state, so we can translate the whole span with one
+     * array load per byte instead of two indirect function calls per
+     * character.
+     */
+    if (spec->read == read_sbcs) {
+        const struct sbcs_data *sd = spec->data;
+        while (*inlen > 0) {
+            unsigned long wc = sd->sbcs2ucs[(unsigned char)**input];
+            if (wc == ERROR) {
+                wchar_t outval;
+                const wchar_t *p;
+                int n;
+                if (param.errstr) {
+                    p = param.errstr;
+                    n = param.errlen;
+                } else {
+                    outval = 0xFFFD;   /* U+FFFD REPLACEMENT CHARACTER */
+                    p = &outval;
+                    n = 1;
+                }
+                if (param.outlen < n)
+                    break;
+                while (n-- > 0) {
+                    *param.output++ = *p++;
+                    param.outlen--;
+                }
+            } else {
+                if (param.outlen < 1)
+                    break;
+                *param.output++ = wc;
+                param.outlen--;
+            }
+            (*input)++;
+            (*inlen)--;
+        }
+        return param.output - output;
+    }
+
     while (*inlen > 0) {
-        int lenbefore = param.output - output;
+        int lenbefore;
+
+        /*
+         * Fast path for runs of ASCII in UTF-8: while the decoder is
+         * in its ground state, bytes below 0x80 pass straight through
+         * to the output.
+         */
+        if (spec->charset == CS_UTF8 && localstate.s0 == 0) {
+            while (*inlen > 0 && param.outlen > 0 &&
+                   (unsigned char)**input < 0x80) {
+                *param.output++ = (unsigned char)**input;
+                param.outlen--;
+                (*input)++;
+                (*inlen)--;
+            }
+            if (*inlen == 0)
+                break;
+        }
+
+        lenbefore = param.output - output;
         spec->read(spec, (unsigned char)**input, &localstate,
                    unicode_emit, &param);
         if (param.stopped) {
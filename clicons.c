@@ -3,12 +3,49 @@
  * console.c and cmdline.c.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "putty.h"
 
+/*
+ * Optional machine-readable event stream for the console tools: if
+ * the environment variable PUTTY_STRUCTURED_LOG names a file,
+ * structured events are appended to it as JSON lines, one object per
+ * event. Tooling wrapped around plink/pscp/psftp can then watch for
+ * key exchanges and authentication outcomes without scraping the
+ * human-readable Event Log text. Only a handful of events are emitted
+ * per connection, so probing the environment lazily here (rather than
+ * refusing to attach the consumer at all) costs nothing measurable.
+ */
+static void console_cli_structured_event(
+    LogPolicy *lp, int type, const char *const *keys,
+    const char *const *values, size_t nfields)
+{
+    static FILE *fp = NULL;
+    static bool tried_opening = false;
+
+    if (!tried_opening) {
+        const char *path = getenv("PUTTY_STRUCTURED_LOG");
+        tried_opening = true;
+        if (path && *path)
+            fp = fopen(path, "a");
+    }
+    if (!fp)
+        return;
+
+    strbuf *sb = strbuf_new();
+    log_structured_event_json(sb, type, keys, values, nfields);
+    fprintf(fp, "%s\n", sb->s);
+    fflush(fp);
+    strbuf_free(sb);
+}
+
 static const LogPolicyVtable console_cli_logpolicy_vt = {
     .eventlog = console_eventlog,
     .askappend = console_askappend,
     .logging_error = console_logging_error,
     .verbose = cmdline_lp_verbose,
+    .structured_event = console_cli_structured_event,
 };
 LogPolicy console_cli_logpolicy[1] = {{ &console_cli_logpolicy_vt }};
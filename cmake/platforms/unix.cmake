@@ -21,6 +21,7 @@ check_include_file(glob.h HAVE_GLOB_H)
 check_include_file(utmp.h HAVE_UTMP_H)
 
 check_symbol_exists(futimes "sys/time.h" HAVE_FUTIMES)
+check_symbol_exists(epoll_create1 "sys/epoll.h" HAVE_EPOLL)
 check_symbol_exists(getaddrinfo "sys/types.h;sys/socket.h;netdb.h"
   HAVE_GETADDRINFO)
 check_symbol_exists(posix_openpt "stdlib.h;fcntl.h" HAVE_POSIX_OPENPT)
@@ -38,6 +39,7 @@ check_symbol_exists(elf_aux_info "sys/auxv.h" HAVE_ELF_AUX_INFO)
 check_symbol_exists(sysctlbyname "sys/types.h;sys/sysctl.h" HAVE_SYSCTLBYNAME)
 check_symbol_exists(CLOCK_MONOTONIC "time.h" HAVE_CLOCK_MONOTONIC)
 check_symbol_exists(clock_gettime "time.h" HAVE_CLOCK_GETTIME)
+check_symbol_exists(getrandom "sys/random.h" HAVE_GETRANDOM)
 
 check_c_source_compiles("
 #define _GNU_SOURCE
@@ -50,6 +52,16 @@ int main(int argc, char **argv) {
            cr.pid + cr.uid + cr.gid;
 }" HAVE_SO_PEERCRED)
 
+# POSIX threads, used by run_in_parallel() to spread work such as
+# Argon2's lanes across multiple CPUs. If they're not available, that
+# function falls back to running its jobs sequentially.
+set(THREADS_PREFER_PTHREAD_FLAG ON)
+find_package(Threads)
+if(CMAKE_USE_PTHREADS_INIT)
+  set(HAVE_PTHREAD ON)
+  link_libraries(Threads::Threads)
+endif()
+
 if(HAVE_GETADDRINFO AND PUTTY_IPV6)
   set(NO_IPV6 OFF)
 else()
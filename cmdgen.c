@@ -43,8 +43,10 @@ static void cmdgen_progress_start_phase(ProgressReceiver *prog,
 static void cmdgen_progress_report(ProgressReceiver *prog, double p)
 {
     unsigned new_col = p * 64 + 0.5;
-    for (; last_progress_col < new_col; last_progress_col++)
-        fputc('+', progress_fp);
+    if (progress_fp) {
+        for (; last_progress_col < new_col; last_progress_col++)
+            fputc('+', progress_fp);
+    }
 }
 static void cmdgen_progress_report_attempt(ProgressReceiver *prog)
 {
@@ -150,6 +152,8 @@ void help(void)
            "        proven         numbers that have been proven to be prime\n"
            "        proven-even    also try harder for an even distribution\n"
            "  --strong-rsa         use \"strong\" primes as RSA key factors\n"
+           "  --batch spec-file    generate many keys in one run; each line\n"
+           "        of the spec file is `<type> <bits> <outfile> [comment]'\n"
            "  --ppk-param <key>=<value>[,<key>=<value>,...]\n"
            "        specify parameters when writing PuTTY private key file "
            "format:\n"
@@ -217,6 +221,174 @@ static char *readpassphrase(const char *filename)
 /* For Unix in particular, but harmless if this main() is reused elsewhere */
 const bool buildinfo_gtk_relevant = false;
 
+/*
+ * Batch key generation mode: read a spec file describing many keys
+ * and generate them all in one process, so that entropy gathering,
+ * PRNG seeding and crypto table initialisation happen once per run
+ * rather than once per key.
+ *
+ * Each non-blank line of the spec file (use '-' to read the spec from
+ * standard input) describes one key:
+ *
+ *     <type> <bits> <outfile> [comment]
+ *
+ * where <type> is rsa, dsa, ecdsa or ed25519. Lines beginning with
+ * '#' are ignored. Keys are written unencrypted in PPK format, each
+ * file being saved as soon as its key is ready, so a provisioning
+ * pipeline can start consuming keys while later ones are still being
+ * generated. Global options such as --primes and --strong-rsa apply
+ * to every key in the batch.
+ */
+static int cmdgen_batch(const char *specfile, const char *random_device,
+                        const PrimeGenerationPolicy *primegen,
+                        bool strong_rsa, const ppk_save_parameters *params)
+{
+    FILE *spec;
+    if (!strcmp(specfile, "-")) {
+        spec = stdin;
+    } else {
+        spec = fopen(specfile, "r");
+        if (!spec) {
+            fprintf(stderr, "puttygen: unable to open batch spec `%s'\n",
+                    specfile);
+            return 1;
+        }
+    }
+
+    /*
+     * Seed the PRNG once for the whole batch. 64 bytes of device
+     * entropy is comfortably more than the PRNG's internal state, and
+     * it reseeds itself from its own output thereafter.
+     */
+    char *entropy = get_random_data(64, random_device);
+    if (!entropy) {
+        fprintf(stderr, "puttygen: failed to collect entropy, "
+                "could not generate keys\n");
+        if (spec != stdin)
+            fclose(spec);
+        return 1;
+    }
+    random_setup_special();
+    random_reseed(make_ptrlen(entropy, 64));
+    smemclr(entropy, 64);
+    sfree(entropy);
+
+    PrimeGenerationContext *pgc = primegen_new_context(primegen);
+
+    char line[4096];
+    unsigned lineno = 0, ngenerated = 0;
+    int status = 0;
+    while (fgets(line, sizeof(line), spec)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p || *p == '#')
+            continue;
+
+        char *fields[3];
+        size_t nfields = 0;
+        while (nfields < 3 && *p) {
+            fields[nfields++] = p;
+            while (*p && *p != ' ' && *p != '\t')
+                p++;
+            while (*p == ' ' || *p == '\t')
+                *p++ = '\0';
+        }
+        const char *comment = (nfields == 3 && *p) ? p : NULL;
+
+        if (nfields < 3) {
+            fprintf(stderr, "puttygen: %s:%u: expected "
+                    "<type> <bits> <outfile> [comment]\n", specfile, lineno);
+            status = 1;
+            continue;
+        }
+
+        int bits = atoi(fields[1]);
+        ssh_key *generated = NULL;
+        char default_comment[80];
+
+        if (!strcmp(fields[0], "rsa") || !strcmp(fields[0], "dsa")) {
+            bool is_dsa = (fields[0][0] == 'd');
+            if (bits < 256) {
+                fprintf(stderr, "puttygen: %s:%u: cannot generate %s keys "
+                        "shorter than 256 bits\n", specfile, lineno,
+                        is_dsa ? "DSA" : "RSA");
+                status = 1;
+                continue;
+            }
+            if (is_dsa) {
+                struct dsa_key *dk = snew(struct dsa_key);
+                dsa_generate(dk, bits, pgc, &cmdgen_progress);
+                generated = &dk->sshk;
+            } else {
+                RSAKey *rk = snew(RSAKey);
+                rsa_generate(rk, bits, strong_rsa, pgc, &cmdgen_progress);
+                rk->comment = NULL;
+                generated = &rk->sshk;
+            }
+            sprintf(default_comment, "%s-key-batch-%u",
+                    is_dsa ? "dsa" : "rsa", lineno);
+        } else if (!strcmp(fields[0], "ecdsa")) {
+            const struct ec_curve *curve;
+            const ssh_keyalg *alg;
+            if (!ec_nist_alg_and_curve_by_bits(bits, &curve, &alg)) {
+                fprintf(stderr, "puttygen: %s:%u: invalid bits for "
+                        "ECDSA\n", specfile, lineno);
+                status = 1;
+                continue;
+            }
+            struct ecdsa_key *ek = snew(struct ecdsa_key);
+            ecdsa_generate(ek, bits);
+            generated = &ek->sshk;
+            sprintf(default_comment, "ecdsa-key-batch-%u", lineno);
+        } else if (!strcmp(fields[0], "ed25519")) {
+            struct eddsa_key *ek = snew(struct eddsa_key);
+            eddsa_generate(ek, 255);
+            generated = &ek->sshk;
+            sprintf(default_comment, "ed25519-key-batch-%u", lineno);
+        } else {
+            fprintf(stderr, "puttygen: %s:%u: unknown key type `%s'\n",
+                    specfile, lineno, fields[0]);
+            status = 1;
+            continue;
+        }
+
+        ssh2_userkey *key = snew(ssh2_userkey);
+        key->key = generated;
+        key->comment = dupstr(comment ? comment : default_comment);
+
+        Filename *outfn = filename_from_str(fields[2]);
+        bool saved = ppk_save_f(outfn, key, NULL, params);
+        filename_free(outfn);
+        if (!saved) {
+            fprintf(stderr, "puttygen: %s:%u: unable to save `%s'\n",
+                    specfile, lineno, fields[2]);
+            status = 1;
+        } else {
+            ngenerated++;
+            if (progress_fp) {
+                fprintf(progress_fp, "puttygen: wrote %s\n", fields[2]);
+                fflush(progress_fp);
+            }
+        }
+
+        sfree(key->comment);
+        ssh_key_free(key->key);
+        sfree(key);
+    }
+
+    primegen_free_context(pgc);
+    if (spec != stdin)
+        fclose(spec);
+    if (progress_fp)
+        fprintf(progress_fp, "puttygen: batch complete, %u key%s generated\n",
+                ngenerated, ngenerated == 1 ? "" : "s");
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     char *infile = NULL;
@@ -244,6 +416,7 @@ int main(int argc, char **argv)
     int exit_status = 0;
     const PrimeGenerationPolicy *primegen = &primegen_probabilistic;
     bool strong_rsa = false;
+    const char *batchfile = NULL;
     ppk_save_parameters params = ppk_save_default_parameters;
     FingerprintType fptype = SSH_FPTYPE_DEFAULT;
 
@@ -381,6 +554,16 @@ int main(int argc, char **argv)
                             fprintf(stderr, "puttygen: unrecognised prime-"
                                     "generation mode `%s'\n", val);
                         }
+                    } else if (!strcmp(opt, "-batch")) {
+                        if (!val && argc > 1)
+                            --argc, val = *++argv;
+                        if (!val) {
+                            errs = true;
+                            fprintf(stderr, "puttygen: option `-%s'"
+                                    " expects an argument\n", opt);
+                        } else {
+                            batchfile = val;
+                        }
                     } else if (!strcmp(opt, "-strong-rsa")) {
                         strong_rsa = true;
                     } else if (!strcmp(opt, "-reencrypt")) {
@@ -677,6 +860,16 @@ int main(int argc, char **argv)
     if (nogo)
         RETURN(0);
 
+    if (batchfile) {
+        if (infile || keytype != NOKEYGEN) {
+            fprintf(stderr, "puttygen: --batch cannot be combined with "
+                    "loading or generating a single key\n");
+            RETURN(1);
+        }
+        RETURN(cmdgen_batch(batchfile, random_device, primegen,
+                            strong_rsa, &params));
+    }
+
     /*
      * If run with at least one argument _but_ not the required
      * ones, print the usage message and return failure.
@@ -828,7 +828,8 @@ int cmdline_process_param(const char *p, char *value,
     }
 
     if (!strcmp(p, "-sshlog") ||
-        !strcmp(p, "-sshrawlog")) {
+        !strcmp(p, "-sshrawlog") ||
+        !strcmp(p, "-sshbinlog")) {
         Filename *fn;
         RETURN(2);
         UNAVAILABLE_IN(TOOLTYPE_NONNETWORK);
@@ -837,7 +838,8 @@ int cmdline_process_param(const char *p, char *value,
         conf_set_filename(conf, CONF_logfilename, fn);
         conf_set_int(conf, CONF_logtype,
                      !strcmp(p, "-sshlog") ? LGTYP_PACKETS :
-                     /* !strcmp(p, "-sshrawlog") ? */ LGTYP_SSHRAW);
+                     !strcmp(p, "-sshrawlog") ? LGTYP_SSHRAW :
+                     /* !strcmp(p, "-sshbinlog") ? */ LGTYP_SSHBIN);
         filename_free(fn);
     }
 
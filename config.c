@@ -1893,14 +1893,16 @@ void setup_config_box(struct controlbox *b, bool midsession,
      * logging can sensibly be available.
      */
     {
-        const char *sshlogname, *sshrawlogname;
+        const char *sshlogname, *sshrawlogname, *sshbinlogname;
         if ((midsession && protocol == PROT_SSH) ||
             (!midsession && backend_vt_from_proto(PROT_SSH))) {
             sshlogname = "SSH packets";
             sshrawlogname = "SSH packets and raw data";
+            sshbinlogname = "SSH packets (binary format)";
         } else {
-            sshlogname = NULL;         /* this will disable both buttons */
-            sshrawlogname = NULL;      /* this will just placate optimisers */
+            sshlogname = NULL;         /* this will disable all three */
+            sshrawlogname = NULL;      /* these two will just */
+            sshbinlogname = NULL;      /*   placate optimisers */
         }
         ctrl_radiobuttons(s, "Session logging:", NO_SHORTCUT, 2,
                           HELPCTX(logging_main),
@@ -1911,6 +1913,7 @@ void setup_config_box(struct controlbox *b, bool midsession,
                           "All session output", 'l', I(LGTYP_DEBUG),
                           sshlogname, 's', I(LGTYP_PACKETS),
                           sshrawlogname, 'r', I(LGTYP_SSHRAW),
+                          sshbinlogname, 'b', I(LGTYP_SSHBIN),
                           NULL);
     }
     ctrl_filesel(s, "Log file name:", 'f',
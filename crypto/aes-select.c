@@ -27,6 +27,12 @@ static ssh_cipher *aes_select(const ssh_cipheralg *alg)
     unreachable("aes_select ran off the end of its list");
 }
 
+#if HAVE_AES_VAES
+#define IF_VAES(...) __VA_ARGS__
+#else
+#define IF_VAES(...)
+#endif
+
 #if HAVE_AES_NI
 #define IF_NI(...) __VA_ARGS__
 #else
@@ -42,6 +48,7 @@ static ssh_cipher *aes_select(const ssh_cipheralg *alg)
 #define AES_SELECTOR_VTABLE(mode_c, mode_protocol, mode_display, bits)  \
     static const ssh_cipheralg *                                        \
     ssh_aes ## bits ## _ ## mode_c ## _impls[] = {                      \
+        IF_VAES(&ssh_aes ## bits ## _ ## mode_c ## _vaes,)              \
         IF_NI(&ssh_aes ## bits ## _ ## mode_c ## _ni,)                  \
         IF_NEON(&ssh_aes ## bits ## _ ## mode_c ## _neon,)              \
         &ssh_aes ## bits ## _ ## mode_c ## _sw,                         \
@@ -78,11 +85,13 @@ static const ssh_cipheralg ssh_rijndael_lysator = {
 
 static const ssh_cipheralg *const aes_list[] = {
     &ssh_aes256_sdctr,
+    &ssh_aes256_gcm,
     &ssh_aes256_cbc,
     &ssh_rijndael_lysator,
     &ssh_aes192_sdctr,
     &ssh_aes192_cbc,
     &ssh_aes128_sdctr,
+    &ssh_aes128_gcm,
     &ssh_aes128_cbc,
 };
 
@@ -0,0 +1,424 @@
+/*
+ * Hardware-accelerated implementation of AES using the x86 VAES
+ * extension, which provides EVEX-encoded versions of the AES-NI
+ * instructions operating on four 128-bit lanes of a 512-bit vector
+ * register at once.
+ *
+ * The parallelisable cipher modes - SDCTR, and the decrypt direction
+ * of CBC - process four blocks per instruction sequence, which is
+ * where the speedup over plain AES-NI comes from. CBC encryption is
+ * inherently serial (each block's cipher input depends on the
+ * previous block's output), so for that, and for trailing partial
+ * groups of blocks in the other modes, we fall back to one-block-at-
+ * a-time code just like aes-ni.c's.
+ */
+
+#include "ssh.h"
+#include "aes.h"
+
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
+
+#if defined(__clang__) || defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+static bool aes_vaes_available(void)
+{
+    /*
+     * Determine if VAES is available on this CPU, by checking for the
+     * VAES and AVX-512F CPUID feature bits, plus the features our
+     * single-block fallback code needs (AES itself and SSE4.1), plus
+     * OS support for saving and restoring the AVX-512 register state,
+     * via the OSXSAVE bit and XGETBV.
+     */
+    unsigned eax, ebx, ecx, edx;
+
+#if defined(__clang__) || defined(__GNUC__)
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+#else
+    {
+        int info[4];
+        __cpuid(info, 1);
+        eax = info[0]; ebx = info[1]; ecx = info[2]; edx = info[3];
+    }
+#endif
+    if (!((ecx & (1 << 25)) &&  /* AES-NI */
+          (ecx & (1 << 19)) &&  /* SSE4.1 */
+          (ecx & (1 << 27))))   /* OSXSAVE */
+        return false;
+
+#if defined(__clang__) || defined(__GNUC__)
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+#else
+    {
+        int info[4];
+        __cpuidex(info, 7, 0);
+        eax = info[0]; ebx = info[1]; ecx = info[2]; edx = info[3];
+    }
+#endif
+    if (!((ebx & (1 << 16)) &&  /* AVX-512F */
+          (ecx & (1 << 9))))    /* VAES */
+        return false;
+
+    /*
+     * XCR0 must indicate that the OS preserves the XMM, YMM and all
+     * three ZMM state components across context switches.
+     */
+    {
+        uint64_t xcr0;
+#if defined(__clang__) || defined(__GNUC__)
+        uint32_t lo, hi;
+        __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+        xcr0 = ((uint64_t)hi << 32) | lo;
+#else
+        xcr0 = _xgetbv(0);
+#endif
+        if ((xcr0 & 0xE6) != 0xE6)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Core encrypt/decrypt functions, one per length and direction, in
+ * both the four-block 512-bit form and the single-block 128-bit form
+ * used for serial modes and trailing blocks.
+ */
+
+#define VAES_CIPHER(len, dir, dirlong, repmacro)                        \
+    static inline __m512i aes_vaes_##len##_##dir##_x4(                  \
+        __m512i v, const __m512i *keysched)                             \
+    {                                                                   \
+        v = _mm512_xor_si512(v, *keysched++);                           \
+        repmacro(v = _mm512_aes##dirlong##_epi128(v, *keysched++););    \
+        return _mm512_aes##dirlong##last_epi128(v, *keysched);          \
+    }                                                                   \
+    static inline __m128i aes_vaes_##len##_##dir##_x1(                  \
+        __m128i v, const __m512i *keysched)                             \
+    {                                                                   \
+        v = _mm_xor_si128(v, _mm512_castsi512_si128(*keysched++));      \
+        repmacro(v = _mm_aes##dirlong##_si128(                          \
+                     v, _mm512_castsi512_si128(*keysched++)););         \
+        return _mm_aes##dirlong##last_si128(                            \
+            v, _mm512_castsi512_si128(*keysched));                      \
+    }
+
+VAES_CIPHER(128, e, enc, REP9)
+VAES_CIPHER(128, d, dec, REP9)
+VAES_CIPHER(192, e, enc, REP11)
+VAES_CIPHER(192, d, dec, REP11)
+VAES_CIPHER(256, e, enc, REP13)
+VAES_CIPHER(256, d, dec, REP13)
+
+/*
+ * The main key expansion, identical to aes-ni.c's except that at the
+ * end each round key is broadcast into all four lanes of a 512-bit
+ * vector, so that the same schedule serves both the four-block and
+ * single-block cipher cores above.
+ */
+static void aes_vaes_key_expand(
+    const unsigned char *key, size_t key_words,
+    __m512i *keysched_e, __m512i *keysched_d)
+{
+    size_t rounds = key_words + 6;
+    size_t sched_words = (rounds + 1) * 4;
+
+    /*
+     * Store the key schedule as 32-bit integers during expansion, so
+     * that it's easy to refer back to individual previous words. We
+     * collect them into the final vector form at the end.
+     */
+    uint32_t sched[MAXROUNDKEYS * 4];
+
+    unsigned rconpos = 0;
+
+    for (size_t i = 0; i < sched_words; i++) {
+        if (i < key_words) {
+            sched[i] = GET_32BIT_LSB_FIRST(key + 4 * i);
+        } else {
+            uint32_t temp = sched[i - 1];
+
+            bool rotate_and_round_constant = (i % key_words == 0);
+            bool only_sub = (key_words == 8 && i % 8 == 4);
+
+            if (rotate_and_round_constant) {
+                __m128i v = _mm_setr_epi32(0,temp,0,0);
+                v = _mm_aeskeygenassist_si128(v, 0);
+                temp = _mm_extract_epi32(v, 1);
+
+                assert(rconpos < lenof(aes_key_setup_round_constants));
+                temp ^= aes_key_setup_round_constants[rconpos++];
+            } else if (only_sub) {
+                __m128i v = _mm_setr_epi32(0,temp,0,0);
+                v = _mm_aeskeygenassist_si128(v, 0);
+                temp = _mm_extract_epi32(v, 0);
+            }
+
+            sched[i] = sched[i - key_words] ^ temp;
+        }
+    }
+
+    /*
+     * Combine the key schedule words into __m128i round keys,
+     * broadcast each one across a __m512i, and store them in the
+     * output context.
+     */
+    for (size_t round = 0; round <= rounds; round++) {
+        __m128i rkey = _mm_setr_epi32(
+            sched[4*round  ], sched[4*round+1],
+            sched[4*round+2], sched[4*round+3]);
+        keysched_e[round] = _mm512_broadcast_i32x4(rkey);
+    }
+
+    smemclr(sched, sizeof(sched));
+
+    /*
+     * Now prepare the modified keys for the inverse cipher.
+     */
+    for (size_t eround = 0; eround <= rounds; eround++) {
+        size_t dround = rounds - eround;
+        __m128i rkey = _mm512_castsi512_si128(keysched_e[eround]);
+        if (eround && dround)      /* neither first nor last */
+            rkey = _mm_aesimc_si128(rkey);
+        keysched_d[dround] = _mm512_broadcast_i32x4(rkey);
+    }
+}
+
+/*
+ * Auxiliary routine to increment the 128-bit counter used in SDCTR
+ * mode, kept in its little-endian form as in aes-ni.c.
+ */
+static inline __m128i aes_vaes_sdctr_increment(__m128i v)
+{
+    const __m128i ONE  = _mm_setr_epi32(1,0,0,0);
+    const __m128i ZERO = _mm_setzero_si128();
+
+    /* Increment the low-order 64 bits of v */
+    v  = _mm_add_epi64(v, ONE);
+    /* Check if they've become zero */
+    __m128i cmp = _mm_cmpeq_epi64(v, ZERO);
+    /* If so, the low half of cmp is all 1s. Pack that into the high
+     * half of addend with zero in the low half. */
+    __m128i addend = _mm_unpacklo_epi64(ZERO, cmp);
+    /* And subtract that from v, which increments the high 64 bits iff
+     * the low 64 wrapped round. */
+    v = _mm_sub_epi64(v, addend);
+
+    return v;
+}
+
+/*
+ * Auxiliary routine to reverse the byte order of a vector, so that
+ * the SDCTR IV can be made big-endian for feeding to the cipher.
+ */
+static inline __m128i aes_vaes_sdctr_reverse(__m128i v)
+{
+    v = _mm_shuffle_epi8(
+        v, _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0));
+    return v;
+}
+
+/*
+ * Assemble four 128-bit blocks into one 512-bit vector.
+ */
+static inline __m512i aes_vaes_gather(
+    __m128i b0, __m128i b1, __m128i b2, __m128i b3)
+{
+    __m512i v = _mm512_castsi128_si512(b0);
+    v = _mm512_inserti32x4(v, b1, 1);
+    v = _mm512_inserti32x4(v, b2, 2);
+    v = _mm512_inserti32x4(v, b3, 3);
+    return v;
+}
+
+/*
+ * The SSH interface and the cipher modes.
+ */
+
+typedef struct aes_vaes_context aes_vaes_context;
+struct aes_vaes_context {
+    __m512i keysched_e[MAXROUNDKEYS], keysched_d[MAXROUNDKEYS];
+    __m128i iv;
+
+    void *pointer_to_free;
+    ssh_cipher ciph;
+};
+
+static ssh_cipher *aes_vaes_new(const ssh_cipheralg *alg)
+{
+    const struct aes_extra *extra = (const struct aes_extra *)alg->extra;
+    if (!check_availability(extra))
+        return NULL;
+
+    /*
+     * The __m512i variables in the context structure need to be
+     * 64-byte aligned, which no malloc implementation this code has
+     * to work with will guarantee. So we over-allocate, manually
+     * realign the pointer ourselves, and store the original one
+     * inside the context so we know how to free it later.
+     */
+    void *allocation = smalloc(sizeof(aes_vaes_context) + 63);
+    uintptr_t alloc_address = (uintptr_t)allocation;
+    uintptr_t aligned_address = (alloc_address + 63) & ~(uintptr_t)63;
+    aes_vaes_context *ctx = (aes_vaes_context *)aligned_address;
+
+    ctx->ciph.vt = alg;
+    ctx->pointer_to_free = allocation;
+    return &ctx->ciph;
+}
+
+static void aes_vaes_free(ssh_cipher *ciph)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    void *allocation = ctx->pointer_to_free;
+    smemclr(ctx, sizeof(*ctx));
+    sfree(allocation);
+}
+
+static void aes_vaes_setkey(ssh_cipher *ciph, const void *vkey)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    const unsigned char *key = (const unsigned char *)vkey;
+
+    aes_vaes_key_expand(key, ctx->ciph.vt->real_keybits / 32,
+                        ctx->keysched_e, ctx->keysched_d);
+}
+
+static void aes_vaes_setiv_cbc(ssh_cipher *ciph, const void *iv)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    ctx->iv = _mm_loadu_si128(iv);
+}
+
+static void aes_vaes_setiv_sdctr(ssh_cipher *ciph, const void *iv)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    __m128i counter = _mm_loadu_si128(iv);
+    ctx->iv = aes_vaes_sdctr_reverse(counter);
+}
+
+typedef __m512i (*aes_vaes_fn_x4)(__m512i v, const __m512i *keysched);
+typedef __m128i (*aes_vaes_fn_x1)(__m128i v, const __m512i *keysched);
+
+static inline void aes_cbc_vaes_encrypt(
+    ssh_cipher *ciph, void *vblk, int blklen, aes_vaes_fn_x1 encrypt)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+
+    /*
+     * CBC encryption is an unavoidably serial chain, so there's
+     * nothing useful the four-block cipher core can do here.
+     */
+    for (uint8_t *blk = (uint8_t *)vblk, *finish = blk + blklen;
+         blk < finish; blk += 16) {
+        __m128i plaintext = _mm_loadu_si128((const __m128i *)blk);
+        __m128i cipher_input = _mm_xor_si128(plaintext, ctx->iv);
+        __m128i ciphertext = encrypt(cipher_input, ctx->keysched_e);
+        _mm_storeu_si128((__m128i *)blk, ciphertext);
+        ctx->iv = ciphertext;
+    }
+}
+
+static inline void aes_cbc_vaes_decrypt(
+    ssh_cipher *ciph, void *vblk, int blklen,
+    aes_vaes_fn_x4 decrypt_x4, aes_vaes_fn_x1 decrypt_x1)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    uint8_t *blk = (uint8_t *)vblk, *finish = blk + blklen;
+
+    /*
+     * Decrypt four blocks at a time: all the block-cipher inputs are
+     * just successive ciphertext blocks, so only the final XOR has a
+     * chain dependency, and that's on the previous _ciphertext_,
+     * which we already have.
+     */
+    while (finish - blk >= 64) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *)(blk     ));
+        __m128i c1 = _mm_loadu_si128((const __m128i *)(blk + 16));
+        __m128i c2 = _mm_loadu_si128((const __m128i *)(blk + 32));
+        __m128i c3 = _mm_loadu_si128((const __m128i *)(blk + 48));
+        __m512i decrypted = decrypt_x4(
+            aes_vaes_gather(c0, c1, c2, c3), ctx->keysched_d);
+        __m512i chain = aes_vaes_gather(ctx->iv, c0, c1, c2);
+        _mm512_storeu_si512((__m512i *)blk,
+                            _mm512_xor_si512(decrypted, chain));
+        ctx->iv = c3;
+        blk += 64;
+    }
+
+    while (blk < finish) {
+        __m128i ciphertext = _mm_loadu_si128((const __m128i *)blk);
+        __m128i decrypted = decrypt_x1(ciphertext, ctx->keysched_d);
+        __m128i plaintext = _mm_xor_si128(decrypted, ctx->iv);
+        _mm_storeu_si128((__m128i *)blk, plaintext);
+        ctx->iv = ciphertext;
+        blk += 16;
+    }
+}
+
+static inline void aes_sdctr_vaes(
+    ssh_cipher *ciph, void *vblk, int blklen,
+    aes_vaes_fn_x4 encrypt_x4, aes_vaes_fn_x1 encrypt_x1)
+{
+    aes_vaes_context *ctx = container_of(ciph, aes_vaes_context, ciph);
+    uint8_t *blk = (uint8_t *)vblk, *finish = blk + blklen;
+
+    /*
+     * Counter mode has no chain dependency at all, so we generate
+     * four successive counter values and compute their keystream
+     * blocks in parallel.
+     */
+    while (finish - blk >= 64) {
+        __m128i iv0 = ctx->iv;
+        __m128i iv1 = aes_vaes_sdctr_increment(iv0);
+        __m128i iv2 = aes_vaes_sdctr_increment(iv1);
+        __m128i iv3 = aes_vaes_sdctr_increment(iv2);
+        __m512i counters = aes_vaes_gather(
+            aes_vaes_sdctr_reverse(iv0), aes_vaes_sdctr_reverse(iv1),
+            aes_vaes_sdctr_reverse(iv2), aes_vaes_sdctr_reverse(iv3));
+        __m512i keystream = encrypt_x4(counters, ctx->keysched_e);
+        __m512i input = _mm512_loadu_si512((const __m512i *)blk);
+        _mm512_storeu_si512((__m512i *)blk,
+                            _mm512_xor_si512(input, keystream));
+        ctx->iv = aes_vaes_sdctr_increment(iv3);
+        blk += 64;
+    }
+
+    while (blk < finish) {
+        __m128i counter = aes_vaes_sdctr_reverse(ctx->iv);
+        __m128i keystream = encrypt_x1(counter, ctx->keysched_e);
+        __m128i input = _mm_loadu_si128((const __m128i *)blk);
+        __m128i output = _mm_xor_si128(input, keystream);
+        _mm_storeu_si128((__m128i *)blk, output);
+        ctx->iv = aes_vaes_sdctr_increment(ctx->iv);
+        blk += 16;
+    }
+}
+
+#define VAES_ENC_DEC(len)                                               \
+    static void aes##len##_vaes_cbc_encrypt(                            \
+        ssh_cipher *ciph, void *vblk, int blklen)                       \
+    { aes_cbc_vaes_encrypt(ciph, vblk, blklen,                          \
+                           aes_vaes_##len##_e_x1); }                    \
+    static void aes##len##_vaes_cbc_decrypt(                            \
+        ssh_cipher *ciph, void *vblk, int blklen)                       \
+    { aes_cbc_vaes_decrypt(ciph, vblk, blklen,                          \
+                           aes_vaes_##len##_d_x4,                       \
+                           aes_vaes_##len##_d_x1); }                    \
+    static void aes##len##_vaes_sdctr(                                  \
+        ssh_cipher *ciph, void *vblk, int blklen)                       \
+    { aes_sdctr_vaes(ciph, vblk, blklen,                                \
+                     aes_vaes_##len##_e_x4,                             \
+                     aes_vaes_##len##_e_x1); }                          \
+
+VAES_ENC_DEC(128)
+VAES_ENC_DEC(192)
+VAES_ENC_DEC(256)
+
+AES_EXTRA(_vaes);
+AES_ALL_VTABLES(_vaes, "VAES accelerated");
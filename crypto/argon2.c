@@ -181,6 +181,222 @@ static void G_xor(uint8_t *out, const uint8_t *X, const uint8_t *Y)
  * The main Argon2 function.
  */
 
+/* The memory is processed in 1Kb blocks */
+struct blk { uint8_t data[1024]; };
+
+/*
+ * Parameters shared between all the segments of one slice, for the
+ * per-segment function below. The segments within a slice are
+ * independent of each other by design - the spec's block-selection
+ * rules exist precisely so that they can be processed concurrently -
+ * so we farm them out via run_in_parallel(), one job per segment.
+ */
+struct argon2_slice_job {
+    struct blk *B;
+    uint32_t p, t, y;
+    size_t q, SL, mprime;
+    size_t pass;
+    unsigned slice;
+    size_t jstart;
+    bool d_mode;
+};
+
+static void argon2_process_segment(void *vjob, size_t i)
+{
+    struct argon2_slice_job *job = (struct argon2_slice_job *)vjob;
+    struct blk *B = job->B;
+    uint32_t p = job->p, t = job->t, y = job->y;
+    size_t q = job->q, SL = job->SL, mprime = job->mprime;
+    size_t pass = job->pass, jstart = job->jstart;
+    unsigned slice = job->slice;
+    bool d_mode = job->d_mode;
+
+    /* Scratch blocks for the data-independent mode's hashing. These
+     * must be private to each segment, because each segment's
+     * pseudorandom stream is generated separately (and we may be
+     * running on a separate thread). */
+    struct blk out2i, tmp2i, in2i;
+
+    /* Process the blocks of this segment from left to right, starting
+     * at 'jstart' (usually 0, but 2 in the first slice of the first
+     * pass). */
+    for (size_t jpre = jstart; jpre < SL; jpre++) {
+
+        /* j is the x-coordinate of each block we process, made up
+         * of the slice number and the index 'jpre' within the
+         * segment. */
+        size_t j = slice * SL + jpre;
+
+        /* jm1 is j-1 (mod q) */
+        uint32_t jm1 = (j == 0 ? q-1 : j-1);
+
+        /*
+         * Construct two 32-bit pseudorandom integers J1 and J2.
+         * This is the part of the algorithm that varies between
+         * the data-dependent and independent modes.
+         */
+        uint32_t J1, J2;
+        if (d_mode) {
+            /*
+             * Data-dependent: grab the first 64 bits of the block
+             * to the left of this one.
+             */
+            J1 = GET_32BIT_LSB_FIRST(B[i + p * jm1].data);
+            J2 = GET_32BIT_LSB_FIRST(B[i + p * jm1].data + 4);
+        } else {
+            /*
+             * Data-independent: generate pseudorandom data by
+             * hashing a sequence of preimage blocks that include
+             * all our input parameters, plus the coordinates of
+             * this point in the algorithm (array position and
+             * pass number) to make all the hash outputs distinct.
+             *
+             * The hash we use is G itself, applied twice. So we
+             * generate 1Kb of data at a time, which is enough for
+             * 128 (J1,J2) pairs. Hence we only need to do the
+             * hashing if our index within the segment is a
+             * multiple of 128, or if we're at the very start of
+             * the algorithm (in which case we started at 2 rather
+             * than 0). After that we can just keep picking data
+             * out of our most recent hash output.
+             */
+            if (jpre == jstart || jpre % 128 == 0) {
+                /*
+                 * Hash preimage is mostly zeroes, with a
+                 * collection of assorted integer values we had
+                 * anyway.
+                 */
+                memset(in2i.data, 0, sizeof(in2i.data));
+                PUT_64BIT_LSB_FIRST(in2i.data +  0, pass);
+                PUT_64BIT_LSB_FIRST(in2i.data +  8, i);
+                PUT_64BIT_LSB_FIRST(in2i.data + 16, slice);
+                PUT_64BIT_LSB_FIRST(in2i.data + 24, mprime);
+                PUT_64BIT_LSB_FIRST(in2i.data + 32, t);
+                PUT_64BIT_LSB_FIRST(in2i.data + 40, y);
+                PUT_64BIT_LSB_FIRST(in2i.data + 48, jpre / 128 + 1);
+
+                /*
+                 * Now apply G twice to generate the hash output
+                 * in out2i.
+                 */
+                memset(tmp2i.data, 0, sizeof(tmp2i.data));
+                G_xor(tmp2i.data, tmp2i.data, in2i.data);
+                memset(out2i.data, 0, sizeof(out2i.data));
+                G_xor(out2i.data, out2i.data, tmp2i.data);
+            }
+
+            /*
+             * Extract J1 and J2 from the most recent hash output
+             * (whether we've just computed it or not).
+             */
+            J1 = GET_32BIT_LSB_FIRST(
+                out2i.data + 8 * (jpre % 128));
+            J2 = GET_32BIT_LSB_FIRST(
+                out2i.data + 8 * (jpre % 128) + 4);
+        }
+
+        /*
+         * Now convert J1 and J2 into the index of an existing
+         * block of the array to use as input to this step. This
+         * is fairly fiddly.
+         *
+         * The easy part: the y-coordinate of the input block is
+         * obtained by reducing J2 mod p, except that at the very
+         * start of the algorithm (processing the first slice on
+         * the first pass) we simply use the same y-coordinate as
+         * our output block.
+         *
+         * Note that it's safe to use the ordinary % operator
+         * here, without any concern for timing side channels: in
+         * data-independent mode J2 is not correlated to any
+         * secrets, and in data-dependent mode we're going to be
+         * giving away side-channel data _anyway_ when we use it
+         * as an array index (and by assumption we don't care,
+         * because it's already massively randomised from the real
+         * inputs).
+         */
+        uint32_t index_l = (pass == 0 && slice == 0) ? i : J2 % p;
+
+        /*
+         * The hard part: which block in this array row do we use?
+         *
+         * First, we decide what the possible candidates are. This
+         * requires some case analysis, and depends on whether the
+         * array row is the same one we're writing into or not.
+         *
+         * If it's not the same row: we can't use any block from
+         * the current slice (because the segments within a slice
+         * have to be processable in parallel, so in a concurrent
+         * implementation those blocks are potentially in the
+         * process of being overwritten by other threads). But the
+         * other three slices are fair game, except that in the
+         * first pass, slices to the right of us won't have had
+         * any values written into them yet at all.
+         *
+         * If it is the same row, we _are_ allowed to use blocks
+         * from the current slice, but only the ones before our
+         * current position.
+         *
+         * In both cases, we also exclude the individual _column_
+         * just to the left of the current one. (The block
+         * immediately to our left is going to be the _other_
+         * input to G, but the spec also says that we avoid that
+         * column even in a different row.)
+         *
+         * All of this means that we end up choosing from a
+         * cyclically contiguous interval of blocks within this
+         * lane, but the start and end points require some thought
+         * to get them right.
+         */
+
+        /* Start position is the beginning of the _next_ slice
+         * (containing data from the previous pass), unless we're
+         * on pass 0, where the start position has to be 0. */
+        uint32_t Wstart = (pass == 0 ? 0 : (slice + 1) % 4 * SL);
+
+        /* End position splits up by cases. */
+        uint32_t Wend;
+        if (index_l == i) {
+            /* Same lane as output: we can use anything up to (but
+             * not including) the block immediately left of us. */
+            Wend = jm1;
+        } else {
+            /* Different lane from output: we can use anything up
+             * to the previous slice boundary, or one less than
+             * that if we're at the very left edge of our slice
+             * right now. */
+            Wend = SL * slice;
+            if (jpre == 0)
+                Wend = (Wend + q-1) % q;
+        }
+
+        /* Total number of blocks available to choose from */
+        uint32_t Wsize = (Wend + q - Wstart) % q;
+
+        /* Fiddly computation from the spec that chooses from the
+         * available blocks, in a deliberately non-uniform
+         * fashion, using J1 as pseudorandom input data. Output is
+         * zz which is the index within our contiguous interval. */
+        uint32_t x = ((uint64_t)J1 * J1) >> 32;
+        uint32_t y = ((uint64_t)Wsize * x) >> 32;
+        uint32_t zz = Wsize - 1 - y;
+
+        /* And index_z is the actual x coordinate of the block we
+         * want. */
+        uint32_t index_z = (Wstart + zz) % q;
+
+        /* Phew! Combine that block with the one immediately to
+         * our left, and XOR over the top of whatever is already
+         * in our current output block. */
+        G_xor(B[i + p * j].data, B[i + p * jm1].data,
+              B[index_l + p * index_z].data);
+    }
+
+    smemclr(out2i.data, sizeof(out2i.data));
+    smemclr(tmp2i.data, sizeof(tmp2i.data));
+    smemclr(in2i.data, sizeof(in2i.data));
+}
+
 static void argon2_internal(uint32_t p, uint32_t T, uint32_t m, uint32_t t,
                             uint32_t y, ptrlen P, ptrlen S, ptrlen K, ptrlen X,
                             uint8_t *out)
@@ -210,8 +426,6 @@ static void argon2_internal(uint32_t p, uint32_t T, uint32_t m, uint32_t t,
         ssh_hash_final(h, h0);
     }
 
-    struct blk { uint8_t data[1024]; };
-
     /*
      * Array of 1Kb blocks. The total size is (approximately) m, the
      * caller-specified parameter for how much memory to use; the blocks are
@@ -276,7 +490,15 @@ static void argon2_internal(uint32_t p, uint32_t T, uint32_t m, uint32_t t,
      */
     size_t jstart = 2;
     bool d_mode = (y == 0);
-    struct blk out2i, tmp2i, in2i;
+
+    struct argon2_slice_job job;
+    job.B = B;
+    job.p = p;
+    job.t = t;
+    job.y = y;
+    job.q = q;
+    job.SL = SL;
+    job.mprime = mprime;
 
     /* Outermost loop: t whole passes from left to right over the array */
     for (size_t pass = 0; pass < t; pass++) {
@@ -289,185 +511,15 @@ static void argon2_internal(uint32_t p, uint32_t T, uint32_t m, uint32_t t,
             if (pass == 0 && slice == 2 && y == 2)
                 d_mode = true;
 
-            /* Loop over every segment in the slice (i.e. every row). So i is
-             * the y-coordinate of each block we process. */
-            for (size_t i = 0; i < p; i++) {
-
-                /* And within that segment, process the blocks from left to
-                 * right, starting at 'jstart' (usually 0, but 2 in the first
-                 * slice). */
-                for (size_t jpre = jstart; jpre < SL; jpre++) {
-
-                    /* j is the x-coordinate of each block we process, made up
-                     * of the slice number and the index 'jpre' within the
-                     * segment. */
-                    size_t j = slice * SL + jpre;
-
-                    /* jm1 is j-1 (mod q) */
-                    uint32_t jm1 = (j == 0 ? q-1 : j-1);
-
-                    /*
-                     * Construct two 32-bit pseudorandom integers J1 and J2.
-                     * This is the part of the algorithm that varies between
-                     * the data-dependent and independent modes.
-                     */
-                    uint32_t J1, J2;
-                    if (d_mode) {
-                        /*
-                         * Data-dependent: grab the first 64 bits of the block
-                         * to the left of this one.
-                         */
-                        J1 = GET_32BIT_LSB_FIRST(B[i + p * jm1].data);
-                        J2 = GET_32BIT_LSB_FIRST(B[i + p * jm1].data + 4);
-                    } else {
-                        /*
-                         * Data-independent: generate pseudorandom data by
-                         * hashing a sequence of preimage blocks that include
-                         * all our input parameters, plus the coordinates of
-                         * this point in the algorithm (array position and
-                         * pass number) to make all the hash outputs distinct.
-                         *
-                         * The hash we use is G itself, applied twice. So we
-                         * generate 1Kb of data at a time, which is enough for
-                         * 128 (J1,J2) pairs. Hence we only need to do the
-                         * hashing if our index within the segment is a
-                         * multiple of 128, or if we're at the very start of
-                         * the algorithm (in which case we started at 2 rather
-                         * than 0). After that we can just keep picking data
-                         * out of our most recent hash output.
-                         */
-                        if (jpre == jstart || jpre % 128 == 0) {
-                            /*
-                             * Hash preimage is mostly zeroes, with a
-                             * collection of assorted integer values we had
-                             * anyway.
-                             */
-                            memset(in2i.data, 0, sizeof(in2i.data));
-                            PUT_64BIT_LSB_FIRST(in2i.data +  0, pass);
-                            PUT_64BIT_LSB_FIRST(in2i.data +  8, i);
-                            PUT_64BIT_LSB_FIRST(in2i.data + 16, slice);
-                            PUT_64BIT_LSB_FIRST(in2i.data + 24, mprime);
-                            PUT_64BIT_LSB_FIRST(in2i.data + 32, t);
-                            PUT_64BIT_LSB_FIRST(in2i.data + 40, y);
-                            PUT_64BIT_LSB_FIRST(in2i.data + 48, jpre / 128 + 1);
-
-                            /*
-                             * Now apply G twice to generate the hash output
-                             * in out2i.
-                             */
-                            memset(tmp2i.data, 0, sizeof(tmp2i.data));
-                            G_xor(tmp2i.data, tmp2i.data, in2i.data);
-                            memset(out2i.data, 0, sizeof(out2i.data));
-                            G_xor(out2i.data, out2i.data, tmp2i.data);
-                        }
-
-                        /*
-                         * Extract J1 and J2 from the most recent hash output
-                         * (whether we've just computed it or not).
-                         */
-                        J1 = GET_32BIT_LSB_FIRST(
-                            out2i.data + 8 * (jpre % 128));
-                        J2 = GET_32BIT_LSB_FIRST(
-                            out2i.data + 8 * (jpre % 128) + 4);
-                    }
-
-                    /*
-                     * Now convert J1 and J2 into the index of an existing
-                     * block of the array to use as input to this step. This
-                     * is fairly fiddly.
-                     *
-                     * The easy part: the y-coordinate of the input block is
-                     * obtained by reducing J2 mod p, except that at the very
-                     * start of the algorithm (processing the first slice on
-                     * the first pass) we simply use the same y-coordinate as
-                     * our output block.
-                     *
-                     * Note that it's safe to use the ordinary % operator
-                     * here, without any concern for timing side channels: in
-                     * data-independent mode J2 is not correlated to any
-                     * secrets, and in data-dependent mode we're going to be
-                     * giving away side-channel data _anyway_ when we use it
-                     * as an array index (and by assumption we don't care,
-                     * because it's already massively randomised from the real
-                     * inputs).
-                     */
-                    uint32_t index_l = (pass == 0 && slice == 0) ? i : J2 % p;
-
-                    /*
-                     * The hard part: which block in this array row do we use?
-                     *
-                     * First, we decide what the possible candidates are. This
-                     * requires some case analysis, and depends on whether the
-                     * array row is the same one we're writing into or not.
-                     *
-                     * If it's not the same row: we can't use any block from
-                     * the current slice (because the segments within a slice
-                     * have to be processable in parallel, so in a concurrent
-                     * implementation those blocks are potentially in the
-                     * process of being overwritten by other threads). But the
-                     * other three slices are fair game, except that in the
-                     * first pass, slices to the right of us won't have had
-                     * any values written into them yet at all.
-                     *
-                     * If it is the same row, we _are_ allowed to use blocks
-                     * from the current slice, but only the ones before our
-                     * current position.
-                     *
-                     * In both cases, we also exclude the individual _column_
-                     * just to the left of the current one. (The block
-                     * immediately to our left is going to be the _other_
-                     * input to G, but the spec also says that we avoid that
-                     * column even in a different row.)
-                     *
-                     * All of this means that we end up choosing from a
-                     * cyclically contiguous interval of blocks within this
-                     * lane, but the start and end points require some thought
-                     * to get them right.
-                     */
-
-                    /* Start position is the beginning of the _next_ slice
-                     * (containing data from the previous pass), unless we're
-                     * on pass 0, where the start position has to be 0. */
-                    uint32_t Wstart = (pass == 0 ? 0 : (slice + 1) % 4 * SL);
-
-                    /* End position splits up by cases. */
-                    uint32_t Wend;
-                    if (index_l == i) {
-                        /* Same lane as output: we can use anything up to (but
-                         * not including) the block immediately left of us. */
-                        Wend = jm1;
-                    } else {
-                        /* Different lane from output: we can use anything up
-                         * to the previous slice boundary, or one less than
-                         * that if we're at the very left edge of our slice
-                         * right now. */
-                        Wend = SL * slice;
-                        if (jpre == 0)
-                            Wend = (Wend + q-1) % q;
-                    }
-
-                    /* Total number of blocks available to choose from */
-                    uint32_t Wsize = (Wend + q - Wstart) % q;
-
-                    /* Fiddly computation from the spec that chooses from the
-                     * available blocks, in a deliberately non-uniform
-                     * fashion, using J1 as pseudorandom input data. Output is
-                     * zz which is the index within our contiguous interval. */
-                    uint32_t x = ((uint64_t)J1 * J1) >> 32;
-                    uint32_t y = ((uint64_t)Wsize * x) >> 32;
-                    uint32_t zz = Wsize - 1 - y;
-
-                    /* And index_z is the actual x coordinate of the block we
-                     * want. */
-                    uint32_t index_z = (Wstart + zz) % q;
-
-                    /* Phew! Combine that block with the one immediately to
-                     * our left, and XOR over the top of whatever is already
-                     * in our current output block. */
-                    G_xor(B[i + p * j].data, B[i + p * jm1].data,
-                          B[index_l + p * index_z].data);
-                }
-            }
+            /* Process every segment in the slice (i.e. every row). These
+             * are independent of each other, so they're run as separate
+             * jobs which run_in_parallel() can distribute across threads
+             * if the platform allows. */
+            job.pass = pass;
+            job.slice = slice;
+            job.jstart = jstart;
+            job.d_mode = d_mode;
+            run_in_parallel(p, argon2_process_segment, &job);
 
             /* We've finished processing a slice. Reset jstart to 0. It will
              * onily _not_ have been 0 if this was pass 0 slice 0, in which
@@ -497,9 +549,6 @@ static void argon2_internal(uint32_t p, uint32_t T, uint32_t m, uint32_t t,
     /*
      * Clean up.
      */
-    smemclr(out2i.data, sizeof(out2i.data));
-    smemclr(tmp2i.data, sizeof(tmp2i.data));
-    smemclr(in2i.data, sizeof(in2i.data));
     smemclr(C.data, sizeof(C.data));
     smemclr(B, mprime * sizeof(struct blk));
     sfree(B);
@@ -0,0 +1,112 @@
+/*
+ * Hardware-accelerated implementation of CRC-32 using the x86
+ * carry-less multiplication extension.
+ *
+ * The SSE4.2 'crc32' instruction is no use for this: it implements
+ * the Castagnoli polynomial 0x1EDC6F41, not the one SSH-1 uses. But
+ * PCLMULQDQ lets us implement the folding technique from Intel's
+ * white paper 'Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ', which works for our polynomial too. Like the software
+ * version in crc32.c, this code has no data-dependent control flow or
+ * memory access, so it's no worse a place to put secret data.
+ */
+
+#include <wmmintrin.h>
+
+#include "ssh.h"
+#include "crc32.h"
+
+#if defined(__clang__) || defined(__GNUC__)
+#include <cpuid.h>
+#define GET_CPU_ID(out) __cpuid(1, (out)[0], (out)[1], (out)[2], (out)[3])
+#else
+#define GET_CPU_ID(out) __cpuid(out, 1)
+#endif
+
+bool crc32_hw_available(void)
+{
+    /*
+     * Determine if PCLMULQDQ is available on this CPU (and SSE2,
+     * which we also use, but that's a given on any CPU new enough to
+     * have carry-less multiplication).
+     */
+    unsigned int CPUInfo[4];
+    GET_CPU_ID(CPUInfo);
+    return (CPUInfo[2] & (1 << 1)) && (CPUInfo[3] & (1 << 26));
+}
+
+/*
+ * The folding constants. Recall from the comment in crc32.c that we
+ * represent polynomials bit-reversed, so that the x^0 coefficient of
+ * the CRC state lives in the bit with place value 2^31. The bytes of
+ * the input data are in effect a polynomial in the same
+ * representation, with earlier bytes holding higher-degree
+ * coefficients; so when we load 16 bytes of data into an XMM register
+ * little-endian, the register holds the bit-reversal of a
+ * polynomial of degree < 128, with the first (highest-degree) 64
+ * coefficients in its low half.
+ *
+ * Multiplying a 16-byte block by x^128 mod P and XORing the product
+ * into the next block leaves the overall CRC of the data stream
+ * unchanged, and shortens the stream by 16 bytes; that's the fold
+ * step. Splitting the block into 64-bit halves y_hi,y_lo (in the
+ * high-/low-degree sense, i.e. the low and high register halves
+ * respectively), we want y_hi * (x^192 mod P) + y_lo * (x^128 mod P),
+ * each product having degree < 95.
+ *
+ * PCLMULQDQ multiplies the bit-reversals of two 64-bit polynomials
+ * and delivers the product aligned so that the coefficient of x^d
+ * appears in the bit with place value 2^(126-d). To land the products
+ * in our convention for 128-bit registers - coefficient of x^d at
+ * place value 2^(127-d) - the constants below are the bit-reversals
+ * of (x^(192-32) mod P) and (x^(128-32) mod P), shifted left one bit:
+ * dropping the multiplier by x^32 and reversing 32 rather than 64
+ * bits makes up the 33-bit alignment difference, and the final shift
+ * the last bit.
+ */
+#define CRC32_FOLD_HI 0x00000000ccaa009eULL /* from x^(128-32) mod P */
+#define CRC32_FOLD_LO 0x00000001751997d0ULL /* from x^(192-32) mod P */
+
+uint32_t crc32_update_hw(uint32_t crc, ptrlen data)
+{
+    const uint8_t *p = (const uint8_t *)data.ptr;
+    size_t len = data.len;
+
+    if (len >= 32) {
+        const __m128i K = _mm_set_epi64x(CRC32_FOLD_HI, CRC32_FOLD_LO);
+
+        /*
+         * XORing the current CRC state into the first four data bytes
+         * is equivalent to starting the CRC of this data from that
+         * state, by linearity.
+         */
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p),
+                                  _mm_cvtsi32_si128(crc));
+        p += 16;
+        len -= 16;
+
+        while (len >= 16) {
+            x = _mm_xor_si128(
+                _mm_xor_si128(_mm_clmulepi64_si128(x, K, 0x00),
+                              _mm_clmulepi64_si128(x, K, 0x11)),
+                _mm_loadu_si128((const __m128i *)p));
+            p += 16;
+            len -= 16;
+        }
+
+        /*
+         * Now the whole data stream is CRC-equivalent to the 16 bytes
+         * in x followed by the unprocessed tail. Rather than
+         * implementing the full Barrett reduction from the white
+         * paper, just feed those 16 bytes back through the software
+         * update function: it's a fixed small cost, and reuses code
+         * we know gets the fiddly final reduction right.
+         */
+        uint8_t remainder[16];
+        _mm_storeu_si128((__m128i *)remainder, x);
+        crc = crc32_update_sw(0, make_ptrlen(remainder, 16));
+        smemclr(remainder, sizeof(remainder));
+    }
+
+    return crc32_update_sw(crc, make_ptrlen(p, len));
+}
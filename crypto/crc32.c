@@ -41,6 +41,7 @@
 #include <stdlib.h>
 
 #include "ssh.h"
+#include "crc32.h"
 
 /*
  * Multiply a CRC value by x^4. This implementation strategy avoids
@@ -84,9 +85,11 @@ static inline uint32_t crc32_shift_8(uint32_t v)
 }
 
 /*
- * Update an existing hash value with extra bytes of data.
+ * The portable implementation of the update function, exposed to the
+ * hardware-accelerated implementations via crc32.h so that they can
+ * use it for odd-sized leftovers.
  */
-uint32_t crc32_update(uint32_t crc, ptrlen data)
+uint32_t crc32_update_sw(uint32_t crc, ptrlen data)
 {
     const uint8_t *p = (const uint8_t *)data.ptr;
     for (size_t len = data.len; len-- > 0 ;)
@@ -94,6 +97,28 @@ uint32_t crc32_update(uint32_t crc, ptrlen data)
     return crc;
 }
 
+/*
+ * Update an existing hash value with extra bytes of data, dispatching
+ * to a hardware-accelerated implementation if the build contains one
+ * and the CPU supports it. (Both of those implementations are as
+ * careful about side channels as the code above, so the choice can
+ * safely depend on nothing but the CPU type.)
+ */
+uint32_t crc32_update(uint32_t crc, ptrlen data)
+{
+#if HAVE_CRC32_CLMUL || HAVE_CRC32_ARM
+    static bool checked_availability = false;
+    static bool hw_available;
+    if (!checked_availability) {
+        hw_available = crc32_hw_available();
+        checked_availability = true;
+    }
+    if (hw_available)
+        return crc32_update_hw(crc, data);
+#endif
+    return crc32_update_sw(crc, data);
+}
+
 /*
  * The SSH-1 variant of CRC-32.
  */
@@ -0,0 +1,25 @@
+/*
+ * Definitions shared between the portable CRC-32 implementation in
+ * crc32.c and the hardware-accelerated versions elsewhere in this
+ * directory.
+ */
+
+/*
+ * The always-available software implementation of the update
+ * function, which the dispatcher in crc32.c falls back to if no
+ * hardware version exists, and which the hardware versions use to
+ * deal with odd-sized leftovers.
+ */
+uint32_t crc32_update_sw(uint32_t crc, ptrlen data);
+
+/*
+ * The hardware-accelerated implementation, if any. At most one of
+ * these can exist in any given build, because the x86 and Arm
+ * versions can't both compile, so they can share a pair of function
+ * names. Implementations must cope with data of any length and
+ * alignment, and - since SSH-1 applies this CRC to decrypted session
+ * data - must take the same care over side channels as the software
+ * version does.
+ */
+bool crc32_hw_available(void);
+uint32_t crc32_update_hw(uint32_t crc, ptrlen data);
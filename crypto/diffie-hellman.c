@@ -8,31 +8,54 @@
 #include "misc.h"
 #include "mpint.h"
 
+/*
+ * Shared per-group precomputation: the prime modulus and q = (p-1)/2
+ * (used as the range limit when inventing x). These depend only on
+ * the group, not on any per-connection secret, and mp_ints are never
+ * mutated once constructed, so entries are kept in a small
+ * process-wide cache keyed by p and shared between all live dh_ctxs
+ * using the same group.
+ *
+ * A Montgomery context is deliberately _not_ shared here, even
+ * though it too depends only on p: it contains scratch space that
+ * every monty_* call scribbles on, and the kex offload machinery in
+ * kex2-client.c runs our modpows on a worker thread, so a context
+ * shared between connections would be a data race whenever two key
+ * exchanges overlap. Each dh_ctx therefore carries its own.
+ */
+struct dh_group {
+    mp_int *p, *q;
+    int refcount;                      /* number of live dh_ctxs using us */
+    struct dh_group *next;
+};
+
 struct dh_ctx {
-    mp_int *x, *e, *p, *q, *g;
+    struct dh_group *group;
+    MontyContext *mc;
+    mp_int *g, *x, *e;
 };
 
 struct dh_extra {
     bool gex;
-    void (*construct)(dh_ctx *ctx);
+    void (*construct)(mp_int **p, mp_int **g);
 };
 
-static void dh_group1_construct(dh_ctx *ctx)
+static void dh_group1_construct(mp_int **p, mp_int **g)
 {
     /* Command to recompute, from the expression in RFC 2412 section E.2:
 spigot -B16 '2^1024 - 2^960 - 1 + 2^64 * ( floor(2^894 pi) + 129093 )'
      */
-    ctx->p = MP_LITERAL(0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7EDEE386BFB5A899FA5AE9F24117C4B1FE649286651ECE65381FFFFFFFFFFFFFFFF);
-    ctx->g = mp_from_integer(2);
+    *p = MP_LITERAL(0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7EDEE386BFB5A899FA5AE9F24117C4B1FE649286651ECE65381FFFFFFFFFFFFFFFF);
+    *g = mp_from_integer(2);
 }
 
-static void dh_group14_construct(dh_ctx *ctx)
+static void dh_group14_construct(mp_int **p, mp_int **g)
 {
     /* Command to recompute, from the expression in RFC 3526 section 3:
 spigot -B16 '2^2048 - 2^1984 - 1 + 2^64 * ( floor(2^1918 pi) + 124476 )'
      */
-    ctx->p = MP_LITERAL(0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7EDEE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF0598DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3BE39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF6955817183995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFFFFFFFFFF);
-    ctx->g = mp_from_integer(2);
+    *p = MP_LITERAL(0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7EDEE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF0598DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3BE39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF6955817183995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFFFFFFFFFF);
+    *g = mp_from_integer(2);
 }
 
 static const struct dh_extra extra_group1 = {
@@ -132,12 +155,70 @@ const ssh_kexes ssh_gssk5_sha1_kex = {
 };
 
 /*
- * Common DH initialisation.
+ * The cache of shared per-group state. Entries are kept in
+ * most-recently-used order; the standard groups and whatever primes a
+ * gex server habitually hands out stay near the front, and when a gex
+ * server generates fresh primes every time, old unreferenced entries
+ * are trimmed from the tail so the cache can't grow without bound.
  */
-static void dh_init(dh_ctx *ctx)
+#define MAX_CACHED_GROUPS 8
+static struct dh_group *dh_group_cache = NULL;
+static int n_cached_groups = 0;
+
+static struct dh_group *dh_group_get(mp_int *p)
 {
-    ctx->q = mp_rshift_fixed(ctx->p, 1);
-    ctx->x = ctx->e = NULL;
+    struct dh_group **grpp, *grp;
+
+    for (grpp = &dh_group_cache; (grp = *grpp) != NULL;
+         grpp = &grp->next) {
+        if (mp_cmp_eq(grp->p, p)) {
+            /* Move to the front, to keep the list in MRU order */
+            *grpp = grp->next;
+            grp->next = dh_group_cache;
+            dh_group_cache = grp;
+            grp->refcount++;
+            return grp;
+        }
+    }
+
+    /* Montgomery arithmetic needs an odd modulus, as mp_modpow used
+     * to assert when it did this setup itself. Any sensible DH group
+     * prime is odd, of course. */
+    assert(mp_get_bit(p, 0) == 1);
+
+    grp = snew(struct dh_group);
+    grp->p = mp_copy(p);
+    grp->q = mp_rshift_fixed(p, 1);
+    grp->refcount = 1;
+    grp->next = dh_group_cache;
+    dh_group_cache = grp;
+    n_cached_groups++;
+    return grp;
+}
+
+static void dh_group_put(struct dh_group *grp)
+{
+    struct dh_group **grpp;
+    int pos = 0;
+
+    grp->refcount--;
+
+    /*
+     * Trim unreferenced entries beyond the size limit, oldest first.
+     */
+    grpp = &dh_group_cache;
+    while ((grp = *grpp) != NULL) {
+        if (pos >= MAX_CACHED_GROUPS && grp->refcount == 0) {
+            *grpp = grp->next;
+            mp_free(grp->p);
+            mp_free(grp->q);
+            sfree(grp);
+            n_cached_groups--;
+        } else {
+            grpp = &grp->next;
+            pos++;
+        }
+    }
 }
 
 bool dh_is_gex(const ssh_kex *kex)
@@ -154,8 +235,13 @@ dh_ctx *dh_setup_group(const ssh_kex *kex)
     const struct dh_extra *extra = (const struct dh_extra *)kex->extra;
     assert(!extra->gex);
     dh_ctx *ctx = snew(dh_ctx);
-    extra->construct(ctx);
-    dh_init(ctx);
+    mp_int *p, *g;
+    extra->construct(&p, &g);
+    ctx->group = dh_group_get(p);
+    ctx->mc = monty_new(p);
+    mp_free(p);
+    ctx->g = g;
+    ctx->x = ctx->e = NULL;
     return ctx;
 }
 
@@ -165,9 +251,10 @@ dh_ctx *dh_setup_group(const ssh_kex *kex)
 dh_ctx *dh_setup_gex(mp_int *pval, mp_int *gval)
 {
     dh_ctx *ctx = snew(dh_ctx);
-    ctx->p = mp_copy(pval);
+    ctx->group = dh_group_get(pval);
+    ctx->mc = monty_new(pval);
     ctx->g = mp_copy(gval);
-    dh_init(ctx);
+    ctx->x = ctx->e = NULL;
     return ctx;
 }
 
@@ -176,7 +263,7 @@ dh_ctx *dh_setup_gex(mp_int *pval, mp_int *gval)
  */
 int dh_modulus_bit_size(const dh_ctx *ctx)
 {
-    return mp_get_nbits(ctx->p);
+    return mp_get_nbits(ctx->group->p);
 }
 
 /*
@@ -188,12 +275,10 @@ void dh_cleanup(dh_ctx *ctx)
         mp_free(ctx->x);
     if (ctx->e)
         mp_free(ctx->e);
-    if (ctx->p)
-        mp_free(ctx->p);
     if (ctx->g)
         mp_free(ctx->g);
-    if (ctx->q)
-        mp_free(ctx->q);
+    monty_free(ctx->mc);
+    dh_group_put(ctx->group);
     sfree(ctx);
 }
 
@@ -212,7 +297,7 @@ void dh_cleanup(dh_ctx *ctx)
  * Advances in Cryptology: Proceedings of Eurocrypt '96
  * Springer-Verlag, May 1996.
  */
-mp_int *dh_create_e(dh_ctx *ctx, int nbits)
+void dh_invent_x(dh_ctx *ctx, int nbits)
 {
     /*
      * Lower limit is just 2.
@@ -222,7 +307,7 @@ mp_int *dh_create_e(dh_ctx *ctx, int nbits)
     /*
      * Upper limit.
      */
-    mp_int *hi = mp_copy(ctx->q);
+    mp_int *hi = mp_copy(ctx->group->q);
     mp_sub_integer_into(hi, hi, 1);
     if (nbits) {
         mp_int *pow2 = mp_power_2(nbits+1);
@@ -237,15 +322,29 @@ mp_int *dh_create_e(dh_ctx *ctx, int nbits)
     ctx->x = mp_random_in_range(lo, hi);
     mp_free(lo);
     mp_free(hi);
+}
 
+mp_int *dh_compute_e(dh_ctx *ctx)
+{
     /*
-     * Now compute e = g^x mod p.
+     * Compute e = g^x mod p, using our own Montgomery context rather
+     * than letting mp_modpow construct a fresh one for each call.
      */
-    ctx->e = mp_modpow(ctx->g, ctx->x, ctx->p);
+    mp_int *m_g = monty_import(ctx->mc, ctx->g);
+    mp_int *m_e = monty_pow(ctx->mc, m_g, ctx->x);
+    ctx->e = monty_export(ctx->mc, m_e);
+    mp_free(m_g);
+    mp_free(m_e);
 
     return ctx->e;
 }
 
+mp_int *dh_create_e(dh_ctx *ctx, int nbits)
+{
+    dh_invent_x(ctx, nbits);
+    return dh_compute_e(ctx);
+}
+
 /*
  * DH stage 2-epsilon: given a number f, validate it to ensure it's in
  * range. (RFC 4253 section 8: "Values of 'e' or 'f' that are not in
@@ -259,7 +358,7 @@ const char *dh_validate_f(dh_ctx *ctx, mp_int *f)
     if (!mp_hs_integer(f, 2)) {
         return "f value received is too small";
     } else {
-        mp_int *pm1 = mp_copy(ctx->p);
+        mp_int *pm1 = mp_copy(ctx->group->p);
         mp_sub_integer_into(pm1, pm1, 1);
         unsigned cmp = mp_cmp_hs(f, pm1);
         mp_free(pm1);
@@ -274,5 +373,10 @@ const char *dh_validate_f(dh_ctx *ctx, mp_int *f)
  */
 mp_int *dh_find_K(dh_ctx *ctx, mp_int *f)
 {
-    return mp_modpow(f, ctx->x, ctx->p);
+    mp_int *m_f = monty_import(ctx->mc, f);
+    mp_int *m_K = monty_pow(ctx->mc, m_f, ctx->x);
+    mp_int *K = monty_export(ctx->mc, m_K);
+    mp_free(m_f);
+    mp_free(m_K);
+    return K;
 }
@@ -472,6 +472,120 @@ WeierstrassPoint *ecc_weierstrass_multiply(WeierstrassPoint *B, mp_int *n)
     return k_B;
 }
 
+/*
+ * Fixed-base multiplication, using the 'comb' technique: given a base
+ * point B that we expect to multiply by lots of different exponents
+ * (e.g. a curve's standard generator), precompute a table containing
+ * every sum of the form e_0 B + e_1 2^s B + ... + e_{t-1} 2^{(t-1)s} B
+ * with each e_i either 0 or 1, where s is about 1/t of the maximum
+ * exponent length. Then you can process the exponent in s iterations
+ * instead of its full bit count, each one doubling the accumulator and
+ * adding a table entry indexed by t bits of the exponent spaced s
+ * apart, like the teeth of a comb.
+ *
+ * t = 4 gives a table of 16 points, and reduces the per-exponent work
+ * for a 256-bit curve to 64 doublings and 64 general additions.
+ */
+#define WCOMB_TEETH 4
+#define WCOMB_ENTRIES (1 << WCOMB_TEETH)
+
+struct WeierstrassFixedBase {
+    WeierstrassCurve *wc;
+    size_t spacing;                    /* bit distance between comb teeth */
+    WeierstrassPoint *table[WCOMB_ENTRIES];
+};
+
+WeierstrassFixedBase *ecc_weierstrass_fixed_base_new(
+    WeierstrassPoint *B, size_t bits)
+{
+    WeierstrassFixedBase *fb = snew(WeierstrassFixedBase);
+    fb->wc = B->wc;
+    fb->spacing = (bits + WCOMB_TEETH - 1) / WCOMB_TEETH;
+
+    /*
+     * table[j], where j has bits j_0,...,j_{t-1}, holds the point
+     * sum of j_i 2^{i*spacing} B. Fill in the powers of 2 by repeated
+     * doubling of B, and every other entry by adding together the two
+     * smaller entries that partition its set bits. None of this is
+     * secret data, but add_general is used anyway, because some of
+     * these sums can hit its special cases and it's a one-time cost.
+     */
+    fb->table[0] = ecc_weierstrass_point_new_identity(fb->wc);
+    fb->table[1] = ecc_weierstrass_point_copy(B);
+    for (size_t i = 1; i < WCOMB_TEETH; i++) {
+        WeierstrassPoint *p = ecc_weierstrass_point_copy(
+            fb->table[(size_t)1 << (i-1)]);
+        for (size_t j = 0; j < fb->spacing; j++) {
+            WeierstrassPoint *p2 = ecc_weierstrass_double(p);
+            ecc_weierstrass_point_free(p);
+            p = p2;
+        }
+        fb->table[(size_t)1 << i] = p;
+    }
+    for (size_t j = 3; j < WCOMB_ENTRIES; j++) {
+        if (j & (j-1))                 /* skip powers of 2, done above */
+            fb->table[j] = ecc_weierstrass_add_general(
+                fb->table[j & (j-1)], fb->table[j & -j]);
+    }
+
+    return fb;
+}
+
+void ecc_weierstrass_fixed_base_free(WeierstrassFixedBase *fb)
+{
+    for (size_t j = 0; j < WCOMB_ENTRIES; j++)
+        ecc_weierstrass_point_free(fb->table[j]);
+    sfree(fb);
+}
+
+WeierstrassPoint *ecc_weierstrass_fixed_base_multiply(
+    WeierstrassFixedBase *fb, mp_int *n)
+{
+    WeierstrassPoint *acc = ecc_weierstrass_point_new_identity(fb->wc);
+    WeierstrassPoint *entry = ecc_weierstrass_point_new_identity(fb->wc);
+    size_t nbits = mp_max_bits(n);
+
+    for (size_t column = fb->spacing; column-- > 0 ;) {
+        /*
+         * The accumulator starts off as the identity, which the
+         * doubling formula happens to map to itself (every output
+         * coordinate comes out zero), so there's no need for the
+         * not-started-yet treatment the ladder above requires.
+         */
+        if (column != fb->spacing - 1) {
+            WeierstrassPoint *doubled = ecc_weierstrass_double(acc);
+            ecc_weierstrass_point_free(acc);
+            acc = doubled;
+        }
+
+        unsigned digit = 0;
+        for (size_t tooth = 0; tooth < WCOMB_TEETH; tooth++) {
+            size_t bit = tooth * fb->spacing + column;
+            if (bit < nbits)
+                digit |= mp_get_bit(n, bit) << tooth;
+        }
+
+        /*
+         * Constant-time table lookup: scan every entry, and derive
+         * each selection mask by bit twiddling so that neither the
+         * control flow nor the memory access pattern depends on the
+         * exponent.
+         */
+        for (unsigned j = 0; j < WCOMB_ENTRIES; j++) {
+            unsigned diff = j ^ digit;
+            unsigned match = (diff - 1) >> (CHAR_BIT * sizeof(diff) - 1);
+            ecc_weierstrass_select_into(entry, entry, fb->table[j], match);
+        }
+
+        WeierstrassPoint *sum = ecc_weierstrass_add_general(acc, entry);
+        ecc_weierstrass_point_free(acc);
+        acc = sum;
+    }
+
+    ecc_weierstrass_point_free(entry);
+    return acc;
+}
+
 unsigned ecc_weierstrass_is_identity(WeierstrassPoint *wp)
 {
     return mp_eq_integer(wp->Z, 0);
@@ -1025,6 +1139,30 @@ static void ecc_edwards_cond_swap(
     mp_cond_swap(P->T, Q->T, swap);
 }
 
+static inline void ecc_edwards_select_into(
+    EdwardsPoint *dest, EdwardsPoint *P, EdwardsPoint *Q, unsigned choose_Q)
+{
+    mp_select_into(dest->X, P->X, Q->X, choose_Q);
+    mp_select_into(dest->Y, P->Y, Q->Y, choose_Q);
+    mp_select_into(dest->Z, P->Z, Q->Z, choose_Q);
+    mp_select_into(dest->T, P->T, Q->T, choose_Q);
+}
+
+/* The identity of an Edwards curve has affine coordinates (0,1), so
+ * no separate constructor for it is exposed in ecc.h. But it's
+ * convenient internally to be able to make one without going via
+ * monty_import. */
+static EdwardsPoint *ecc_edwards_point_new_identity(EdwardsCurve *ec)
+{
+    EdwardsPoint *ep = ecc_edwards_point_new_empty(ec);
+    size_t bits = mp_max_bits(ec->p);
+    ep->X = mp_new(bits);
+    ep->Y = mp_copy(monty_identity(ec->mc));
+    ep->Z = mp_copy(monty_identity(ec->mc));
+    ep->T = mp_new(bits);
+    return ep;
+}
+
 EdwardsPoint *ecc_edwards_add(EdwardsPoint *P, EdwardsPoint *Q)
 {
     EdwardsCurve *ec = P->ec;
@@ -1133,6 +1271,92 @@ EdwardsPoint *ecc_edwards_multiply(EdwardsPoint *B, mp_int *n)
     return k_B;
 }
 
+/*
+ * Fixed-base multiplication via a comb table, just as for Weierstrass
+ * curves above. It's even simpler here, because the Edwards addition
+ * formula is unified: the same ecc_edwards_add does everything,
+ * including doubling the accumulator and absorbing identity table
+ * entries, with no special cases to worry about.
+ */
+#define ECOMB_TEETH 4
+#define ECOMB_ENTRIES (1 << ECOMB_TEETH)
+
+struct EdwardsFixedBase {
+    EdwardsCurve *ec;
+    size_t spacing;                    /* bit distance between comb teeth */
+    EdwardsPoint *table[ECOMB_ENTRIES];
+};
+
+EdwardsFixedBase *ecc_edwards_fixed_base_new(EdwardsPoint *B, size_t bits)
+{
+    EdwardsFixedBase *fb = snew(EdwardsFixedBase);
+    fb->ec = B->ec;
+    fb->spacing = (bits + ECOMB_TEETH - 1) / ECOMB_TEETH;
+
+    fb->table[0] = ecc_edwards_point_new_identity(fb->ec);
+    fb->table[1] = ecc_edwards_point_copy(B);
+    for (size_t i = 1; i < ECOMB_TEETH; i++) {
+        EdwardsPoint *p = ecc_edwards_point_copy(
+            fb->table[(size_t)1 << (i-1)]);
+        for (size_t j = 0; j < fb->spacing; j++) {
+            EdwardsPoint *p2 = ecc_edwards_add(p, p);
+            ecc_edwards_point_free(p);
+            p = p2;
+        }
+        fb->table[(size_t)1 << i] = p;
+    }
+    for (size_t j = 3; j < ECOMB_ENTRIES; j++) {
+        if (j & (j-1))                 /* skip powers of 2, done above */
+            fb->table[j] = ecc_edwards_add(
+                fb->table[j & (j-1)], fb->table[j & -j]);
+    }
+
+    return fb;
+}
+
+void ecc_edwards_fixed_base_free(EdwardsFixedBase *fb)
+{
+    for (size_t j = 0; j < ECOMB_ENTRIES; j++)
+        ecc_edwards_point_free(fb->table[j]);
+    sfree(fb);
+}
+
+EdwardsPoint *ecc_edwards_fixed_base_multiply(EdwardsFixedBase *fb, mp_int *n)
+{
+    EdwardsPoint *acc = ecc_edwards_point_new_identity(fb->ec);
+    EdwardsPoint *entry = ecc_edwards_point_new_identity(fb->ec);
+    size_t nbits = mp_max_bits(n);
+
+    for (size_t column = fb->spacing; column-- > 0 ;) {
+        if (column != fb->spacing - 1) {
+            EdwardsPoint *doubled = ecc_edwards_add(acc, acc);
+            ecc_edwards_point_free(acc);
+            acc = doubled;
+        }
+
+        unsigned digit = 0;
+        for (size_t tooth = 0; tooth < ECOMB_TEETH; tooth++) {
+            size_t bit = tooth * fb->spacing + column;
+            if (bit < nbits)
+                digit |= mp_get_bit(n, bit) << tooth;
+        }
+
+        /* Constant-time table scan, as in the Weierstrass version */
+        for (unsigned j = 0; j < ECOMB_ENTRIES; j++) {
+            unsigned diff = j ^ digit;
+            unsigned match = (diff - 1) >> (CHAR_BIT * sizeof(diff) - 1);
+            ecc_edwards_select_into(entry, entry, fb->table[j], match);
+        }
+
+        EdwardsPoint *sum = ecc_edwards_add(acc, entry);
+        ecc_edwards_point_free(acc);
+        acc = sum;
+    }
+
+    ecc_edwards_point_free(entry);
+    return acc;
+}
+
 /*
  * Helper routine to determine whether two values each given as a pair
  * of projective coordinates represent the same affine value.
@@ -55,6 +55,12 @@ static void initialise_wcurve(
 
     curve->w.G = ecc_weierstrass_point_new(curve->w.wc, G_x, G_y);
     curve->w.G_order = mp_copy(G_order);
+
+    /* Precompute a fixed-base comb table for the generator, sized to
+     * cover any exponent reduced mod p or mod the group order (the
+     * two have the same bit count on all the curves we use). */
+    curve->w.Gfb = ecc_weierstrass_fixed_base_new(
+        curve->w.G, mp_get_nbits(p));
 }
 
 static void initialise_mcurve(
@@ -83,6 +89,13 @@ static void initialise_ecurve(
 
     curve->e.G = ecc_edwards_point_new(curve->e.ec, G_x, G_y);
     curve->e.G_order = mp_copy(G_order);
+
+    /* Precompute a fixed-base comb table for the generator. EdDSA
+     * verification multiplies G by an exponent taken unreduced from
+     * the wire, so the table has to cover a full fieldBytes-sized
+     * integer, not just the group order. */
+    curve->e.Gfb = ecc_edwards_fixed_base_new(
+        curve->e.G, curve->fieldBytes * 8);
 }
 
 static struct ec_curve *ec_p256(void)
@@ -338,8 +351,8 @@ WeierstrassPoint *ecdsa_public(mp_int *private_key, const ssh_keyalg *alg)
     assert(curve->type == EC_WEIERSTRASS);
 
     mp_int *priv_reduced = mp_mod(private_key, curve->p);
-    WeierstrassPoint *toret = ecc_weierstrass_multiply(
-        curve->w.G, priv_reduced);
+    WeierstrassPoint *toret = ecc_weierstrass_fixed_base_multiply(
+        curve->w.Gfb, priv_reduced);
     mp_free(priv_reduced);
     return toret;
 }
@@ -386,7 +399,8 @@ EdwardsPoint *eddsa_public(mp_int *private_key, const ssh_keyalg *alg)
     mp_int *exponent = eddsa_exponent_from_hash(
         make_ptrlen(hash, extra->hash->hlen), curve);
 
-    EdwardsPoint *toret = ecc_edwards_multiply(curve->e.G, exponent);
+    EdwardsPoint *toret = ecc_edwards_fixed_base_multiply(
+        curve->e.Gfb, exponent);
     mp_free(exponent);
 
     return toret;
@@ -614,6 +628,12 @@ static void eddsa_freekey(ssh_key *key)
         ecc_edwards_point_free(ek->publicKey);
     if (ek->privateKey)
         mp_free(ek->privateKey);
+    if (ek->pkfb)
+        ecc_edwards_fixed_base_free(ek->pkfb);
+    if (ek->sign_exponent)
+        mp_free(ek->sign_exponent);
+    if (ek->sign_nonce_seed)
+        strbuf_free(ek->sign_nonce_seed);
     sfree(ek);
 }
 
@@ -668,6 +688,9 @@ static ssh_key *eddsa_new_pub(const ssh_keyalg *alg, ptrlen data)
     ek->sshk.vt = alg;
     ek->curve = curve;
     ek->privateKey = NULL;
+    ek->pkfb = NULL;
+    ek->sign_exponent = NULL;
+    ek->sign_nonce_seed = NULL;
 
     ek->publicKey = get_epoint(src, curve);
     if (!ek->publicKey) {
@@ -862,6 +885,9 @@ static ssh_key *eddsa_new_priv_openssh(
     ek->sshk.vt = alg;
     ek->curve = curve;
     ek->privateKey = NULL;
+    ek->pkfb = NULL;
+    ek->sign_exponent = NULL;
+    ek->sign_nonce_seed = NULL;
 
     ek->publicKey = eddsa_decode(pubkey_pl, curve);
     if (!ek->publicKey) {
@@ -1013,7 +1039,8 @@ static bool ecdsa_verify(ssh_key *key, ptrlen sig, ptrlen data)
     mp_free(z);
     mp_int *u2 = mp_modmul(r, w, ek->curve->w.G_order);
     mp_free(w);
-    WeierstrassPoint *u1G = ecc_weierstrass_multiply(ek->curve->w.G, u1);
+    WeierstrassPoint *u1G = ecc_weierstrass_fixed_base_multiply(
+        ek->curve->w.Gfb, u1);
     mp_free(u1);
     WeierstrassPoint *u2P = ecc_weierstrass_multiply(ek->publicKey, u2);
     mp_free(u2);
@@ -1087,9 +1114,22 @@ static bool eddsa_verify(ssh_key *key, ptrlen sig, ptrlen data)
     mp_int *H = eddsa_signing_exponent_from_data(ek, extra, rstr, data);
 
     /* Verify that s*G == r + H*publicKey */
-    EdwardsPoint *lhs = ecc_edwards_multiply(ek->curve->e.G, s);
+    EdwardsPoint *lhs = ecc_edwards_fixed_base_multiply(ek->curve->e.Gfb, s);
     mp_free(s);
-    EdwardsPoint *hpk = ecc_edwards_multiply(ek->publicKey, H);
+
+    /*
+     * Multiplying the public key by H is the expensive part of
+     * verification, and H is a full unreduced hash output (we don't
+     * reduce it mod the group order, which could change the result
+     * for a point with a cofactor component), so the comb table has
+     * to cover the hash length. Building the table pays for itself
+     * within the very first verification, relative to the generic
+     * Montgomery-ladder multiply.
+     */
+    if (!ek->pkfb)
+        ek->pkfb = ecc_edwards_fixed_base_new(
+            ek->publicKey, extra->hash->hlen * 8);
+    EdwardsPoint *hpk = ecc_edwards_fixed_base_multiply(ek->pkfb, H);
     mp_free(H);
     EdwardsPoint *rhs = ecc_edwards_add(r, hpk);
     ecc_edwards_point_free(hpk);
@@ -1122,7 +1162,8 @@ static void ecdsa_sign(ssh_key *key, ptrlen data,
             ek->privateKey, digest, sizeof(digest));
     }
 
-    WeierstrassPoint *kG = ecc_weierstrass_multiply(ek->curve->w.G, k);
+    WeierstrassPoint *kG = ecc_weierstrass_fixed_base_multiply(
+        ek->curve->w.Gfb, k);
     mp_int *x;
     ecc_weierstrass_get_affine(kG, &x, NULL);
     ecc_weierstrass_point_free(kG);
@@ -1173,38 +1214,45 @@ static void eddsa_sign(ssh_key *key, ptrlen data,
      */
 
     /*
-     * First, we hash the private key integer (bare, little-endian)
-     * into a hash generating 2*fieldBytes of output.
+     * First, we need the expansion of the private key: the hash of
+     * the private key integer (bare, little-endian), generating
+     * 2*fieldBytes of output, whose first half is converted into an
+     * integer a by the standard EdDSA transformation and whose
+     * second half seeds the signature nonces. Both halves depend
+     * only on the key, so we compute them the first time we sign
+     * with this key and cache them in the key structure after that.
      */
     unsigned char hash[MAX_HASH_LEN];
-    ssh_hash *h = ssh_hash_new(extra->hash);
-    for (size_t i = 0; i < ek->curve->fieldBytes; ++i)
-        put_byte(h, mp_get_byte(ek->privateKey, i));
-    ssh_hash_final(h, hash);
-
-    /*
-     * The first half of the output hash is converted into an
-     * integer a, by the standard EdDSA transformation.
-     */
-    mp_int *a = eddsa_exponent_from_hash(
-        make_ptrlen(hash, ek->curve->fieldBytes), ek->curve);
+    if (!ek->sign_exponent) {
+        ssh_hash *h = ssh_hash_new(extra->hash);
+        for (size_t i = 0; i < ek->curve->fieldBytes; ++i)
+            put_byte(h, mp_get_byte(ek->privateKey, i));
+        ssh_hash_final(h, hash);
+
+        ek->sign_exponent = eddsa_exponent_from_hash(
+            make_ptrlen(hash, ek->curve->fieldBytes), ek->curve);
+        ek->sign_nonce_seed = strbuf_new_nm();
+        put_data(ek->sign_nonce_seed, hash + ek->curve->fieldBytes,
+                 extra->hash->hlen - ek->curve->fieldBytes);
+    }
+    mp_int *a = ek->sign_exponent;
 
     /*
      * The second half of the hash of the private key is hashed again
      * with the message to be signed, and used as an exponent to
      * generate the signature point r.
      */
-    h = ssh_hash_new(extra->hash);
+    ssh_hash *h = ssh_hash_new(extra->hash);
     put_datapl(h, extra->hash_prefix);
-    put_data(h, hash + ek->curve->fieldBytes,
-             extra->hash->hlen - ek->curve->fieldBytes);
+    put_datapl(h, ptrlen_from_strbuf(ek->sign_nonce_seed));
     put_datapl(h, data);
     ssh_hash_final(h, hash);
     mp_int *log_r_unreduced = mp_from_bytes_le(
         make_ptrlen(hash, extra->hash->hlen));
     mp_int *log_r = mp_mod(log_r_unreduced, ek->curve->e.G_order);
     mp_free(log_r_unreduced);
-    EdwardsPoint *r = ecc_edwards_multiply(ek->curve->e.G, log_r);
+    EdwardsPoint *r = ecc_edwards_fixed_base_multiply(
+        ek->curve->e.Gfb, log_r);
 
     /*
      * Encode r now, because we'll need its encoding for the next
@@ -1225,7 +1273,6 @@ static void eddsa_sign(ssh_key *key, ptrlen data,
     mp_int *Ha = mp_modmul(H, a, ek->curve->e.G_order);
     mp_int *s = mp_modadd(log_r, Ha, ek->curve->e.G_order);
     mp_free(H);
-    mp_free(a);
     mp_free(Ha);
     mp_free(log_r);
 
@@ -1401,10 +1448,11 @@ static void ssh_ecdhkex_w_setup(ecdh_key *dh)
     dh->private = mp_random_in_range(one, dh->curve->w.G_order);
     mp_free(one);
 
-    dh->w_public = ecc_weierstrass_multiply(dh->curve->w.G, dh->private);
+    dh->w_public = ecc_weierstrass_fixed_base_multiply(
+        dh->curve->w.Gfb, dh->private);
 }
 
-static void ssh_ecdhkex_m_setup(ecdh_key *dh)
+static void ssh_ecdhkex_m_generate_private(ecdh_key *dh)
 {
     strbuf *bytes = strbuf_new_nm();
     random_read(strbuf_append(bytes, dh->curve->fieldBytes),
@@ -1422,10 +1470,52 @@ static void ssh_ecdhkex_m_setup(ecdh_key *dh)
         mp_set_bit(dh->private, bit, 0);
 
     strbuf_free(bytes);
+}
 
+static void ssh_ecdhkex_m_setup(ecdh_key *dh)
+{
+    ssh_ecdhkex_m_generate_private(dh);
     dh->m_public = ecc_montgomery_multiply(dh->curve->m.G, dh->private);
 }
 
+static void ssh_ecdhkex_m25519_setup(ecdh_key *dh)
+{
+    ssh_ecdhkex_m_generate_private(dh);
+
+    /*
+     * Curve25519 is birationally equivalent to Ed25519 over the same
+     * field, via the map u = (1+y)/(1-y) which takes the Ed25519
+     * generator to the point u=9 that Curve25519 uses as its base.
+     * The x-only Montgomery representation has no addition operation,
+     * so it can't use a fixed-base comb table directly; instead, we
+     * compute our public value by multiplying the Ed25519 generator
+     * using _its_ precomputed table, and map the answer back.
+     *
+     * The map is undefined only at the identity and the order-2 point
+     * y = -1, and a clamped private key can't be a multiple of either
+     * the group order or its double, so neither can occur here.
+     */
+    struct ec_curve *ed = ec_ed25519();
+    EdwardsPoint *p = ecc_edwards_fixed_base_multiply(ed->e.Gfb, dh->private);
+    mp_int *y;
+    ecc_edwards_get_affine(p, NULL, &y);
+    ecc_edwards_point_free(p);
+
+    mp_int *one = mp_from_integer(1);
+    mp_int *num = mp_modadd(one, y, dh->curve->p);
+    mp_int *denom = mp_modsub(one, y, dh->curve->p);
+    mp_free(one);
+    mp_free(y);
+    mp_int *recip = mp_invert(denom, dh->curve->p);
+    mp_free(denom);
+    mp_int *u = mp_modmul(num, recip, dh->curve->p);
+    mp_free(num);
+    mp_free(recip);
+
+    dh->m_public = ecc_montgomery_point_new(dh->curve->m.mc, u);
+    mp_free(u);
+}
+
 ecdh_key *ssh_ecdhkex_newkey(const ssh_kex *kex)
 {
     const struct eckex_extra *extra = (const struct eckex_extra *)kex->extra;
@@ -1557,7 +1647,7 @@ void ssh_ecdhkex_freekey(ecdh_key *dh)
 
 static const struct eckex_extra kex_extra_curve25519 = {
     ec_curve25519,
-    ssh_ecdhkex_m_setup,
+    ssh_ecdhkex_m25519_setup,
     ssh_ecdhkex_m_cleanup,
     ssh_ecdhkex_m_getpublic,
     ssh_ecdhkex_m_getkey,
@@ -96,6 +96,22 @@ WeierstrassPoint *ecc_weierstrass_double(WeierstrassPoint *);
  */
 WeierstrassPoint *ecc_weierstrass_multiply(WeierstrassPoint *, mp_int *);
 
+/*
+ * Precomputation for computing many integer multiples of the _same_
+ * base point, e.g. a curve's standard generator. The constructor
+ * builds a table of multiples of B, which fixed_base_multiply then
+ * combines to make n*B much faster than the general multiply routine
+ * would. 'bits' is the maximum bit count of any exponent that will be
+ * passed to fixed_base_multiply; the exponent is still subject to the
+ * same restriction as in ecc_weierstrass_multiply (it must be less
+ * than the order of B in the group).
+ */
+WeierstrassFixedBase *ecc_weierstrass_fixed_base_new(
+    WeierstrassPoint *B, size_t bits);
+void ecc_weierstrass_fixed_base_free(WeierstrassFixedBase *fb);
+WeierstrassPoint *ecc_weierstrass_fixed_base_multiply(
+    WeierstrassFixedBase *fb, mp_int *n);
+
 /*
  * Query functions to get the value of a point back out. is_identity
  * tells you whether the point is the identity; if it isn't, then
@@ -233,6 +249,15 @@ void ecc_edwards_point_free(EdwardsPoint *point);
 EdwardsPoint *ecc_edwards_add(EdwardsPoint *, EdwardsPoint *);
 EdwardsPoint *ecc_edwards_multiply(EdwardsPoint *, mp_int *);
 
+/*
+ * Precomputation for repeated multiplication of a fixed base point,
+ * exactly as for Weierstrass curves above, except that there's no
+ * restriction on the exponent: any value less than 2^bits works.
+ */
+EdwardsFixedBase *ecc_edwards_fixed_base_new(EdwardsPoint *B, size_t bits);
+void ecc_edwards_fixed_base_free(EdwardsFixedBase *fb);
+EdwardsPoint *ecc_edwards_fixed_base_multiply(EdwardsFixedBase *fb, mp_int *n);
+
 /*
  * Query functions: compare two points for equality, and return the
  * affine coordinates of a point.
@@ -4,13 +4,26 @@
  */
 
 #include "ssh.h"
+#include "sha256.h"
 
 struct hmac {
     const ssh_hashalg *hashalg;
-    ssh_hash *h_outer, *h_inner, *h_live;
+    /* h_outer and h_inner hold the hash states just after absorbing
+     * the outer and inner padded key blocks; they're set up once per
+     * key, and each MAC computation starts by cloning them instead of
+     * re-absorbing the key. h_live accumulates the current message,
+     * and h_scratch is reused for the finalisations in
+     * hmac_genresult, so that generating a MAC allocates nothing. */
+    ssh_hash *h_outer, *h_inner, *h_live, *h_scratch;
     uint8_t *digest;
     strbuf *text_name;
     ssh2_mac mac;
+
+    /* For hmac_multiverify below: raw SHA-256 states after absorbing
+     * the inner and outer padded key blocks, if the underlying hash
+     * is SHA-256 (mb_keyed says whether it is) */
+    bool mb_keyed;
+    uint32_t mb_core_inner[8], mb_core_outer[8];
 };
 
 struct hmac_extra {
@@ -29,6 +42,7 @@ static ssh2_mac *hmac_new(const ssh2_macalg *alg, ssh_cipher *cipher)
     ctx->hashalg = ssh_hash_alg(ctx->h_outer);
     ctx->h_inner = ssh_hash_new(ctx->hashalg);
     ctx->h_live = ssh_hash_new(ctx->hashalg);
+    ctx->h_scratch = ssh_hash_new(ctx->hashalg);
 
     /*
      * HMAC is not well defined as a wrapper on an absolutely general
@@ -40,6 +54,7 @@ static ssh2_mac *hmac_new(const ssh2_macalg *alg, ssh_cipher *cipher)
     assert(ctx->hashalg->blocklen);
 
     ctx->digest = snewn(ctx->hashalg->hlen, uint8_t);
+    ctx->mb_keyed = false;
 
     ctx->text_name = strbuf_new();
     strbuf_catf(ctx->text_name, "HMAC-%s%s",
@@ -71,6 +86,7 @@ static void hmac_free(ssh2_mac *mac)
     ssh_hash_free(ctx->h_outer);
     ssh_hash_free(ctx->h_inner);
     ssh_hash_free(ctx->h_live);
+    ssh_hash_free(ctx->h_scratch);
     smemclr(ctx->digest, ctx->hashalg->hlen);
     sfree(ctx->digest);
     strbuf_free(ctx->text_name);
@@ -121,6 +137,43 @@ static void hmac_key(ssh2_mac *mac, ptrlen key)
     for (size_t i = klen; i < ctx->hashalg->blocklen; i++)
         put_byte(ctx->h_inner, PAD_INNER);
 
+    /*
+     * If the underlying hash is SHA-256, also precompute the raw
+     * compression-function states resulting from the inner and outer
+     * key blocks, for hmac_multiverify below to start its
+     * multi-buffer hashes from. We detect SHA-256 by the selector
+     * vtable the algorithm was defined with, rather than whichever
+     * concrete implementation it selected.
+     */
+    {
+        const struct hmac_extra *extra =
+            (const struct hmac_extra *)ctx->mac.vt->extra;
+        ctx->mb_keyed = false;
+        if (extra->hashalg_base == &ssh_sha256) {
+            uint8_t blocks[2][64];
+            const uint8_t *ptrs[2];
+            size_t nblocks[2];
+            uint32_t cores[2][8];
+
+            for (size_t i = 0; i < 64; i++) {
+                uint8_t kbyte = i < klen ? kp[i] : 0;
+                blocks[0][i] = PAD_INNER ^ kbyte;
+                blocks[1][i] = PAD_OUTER ^ kbyte;
+            }
+            memcpy(cores[0], sha256_initial_state, sizeof(cores[0]));
+            memcpy(cores[1], sha256_initial_state, sizeof(cores[1]));
+            ptrs[0] = blocks[0];
+            ptrs[1] = blocks[1];
+            nblocks[0] = nblocks[1] = 1;
+            sha256_mb_blocks(cores, ptrs, nblocks, 2);
+            memcpy(ctx->mb_core_inner, cores[0], sizeof(ctx->mb_core_inner));
+            memcpy(ctx->mb_core_outer, cores[1], sizeof(ctx->mb_core_outer));
+            smemclr(blocks, sizeof(blocks));
+            smemclr(cores, sizeof(cores));
+            ctx->mb_keyed = true;
+        }
+    }
+
     if (sb)
         strbuf_free(sb);
 }
@@ -134,16 +187,18 @@ static void hmac_start(ssh2_mac *mac)
 static void hmac_genresult(ssh2_mac *mac, unsigned char *output)
 {
     struct hmac *ctx = container_of(mac, struct hmac, mac);
-    ssh_hash *htmp;
 
     /* Leave h_live and h_outer in place, so that the SSH-2 BPP can
      * continue regenerating test results from different-length
-     * prefixes of the packet */
-    ssh_hash_digest_nondestructive(ctx->h_live, ctx->digest);
+     * prefixes of the packet. Both finalisations go via h_scratch,
+     * rather than ssh_hash_copy, to avoid allocating and freeing a
+     * hash state per MAC generated. */
+    ssh_hash_copyfrom(ctx->h_scratch, ctx->h_live);
+    ssh_hash_digest(ctx->h_scratch, ctx->digest);
 
-    htmp = ssh_hash_copy(ctx->h_outer);
-    put_data(htmp, ctx->digest, ctx->hashalg->hlen);
-    ssh_hash_final(htmp, ctx->digest);
+    ssh_hash_copyfrom(ctx->h_scratch, ctx->h_outer);
+    put_data(ctx->h_scratch, ctx->digest, ctx->hashalg->hlen);
+    ssh_hash_digest(ctx->h_scratch, ctx->digest);
 
     /*
      * Some instances of HMAC truncate the output hash, so instead of
@@ -160,6 +215,102 @@ static const char *hmac_text_name(ssh2_mac *mac)
     return ctx->text_name->s;
 }
 
+/*
+ * Verify the MACs on a batch of SSH-2 packets in one pass over the
+ * multi-buffer SHA-256 engine. As in ssh2_mac_verify, each pkts[i]
+ * describes the data the MAC covers, and the received MAC is
+ * expected to follow it immediately in memory. Returns false with
+ * 'results' untouched if the underlying hash turns out not to be
+ * SHA-256, so that a caller can fall back to one-at-a-time
+ * verification.
+ */
+static bool hmac_multiverify(
+    ssh2_mac *mac, size_t npkts, const ptrlen *pkts,
+    const unsigned long *seqs, bool *results)
+{
+    struct hmac *ctx = container_of(mac, struct hmac, mac);
+
+    if (!ctx->mb_keyed)
+        return false;
+
+    for (size_t done = 0; done < npkts; done += SHA256_MB_LANES) {
+        size_t n = npkts - done;
+        if (n > SHA256_MB_LANES)
+            n = SHA256_MB_LANES;
+
+        uint32_t cores[SHA256_MB_LANES][8];
+        const uint8_t *ptrs[SHA256_MB_LANES];
+        size_t nblocks[SHA256_MB_LANES];
+        size_t offsets[SHA256_MB_LANES];
+        uint8_t outer[SHA256_MB_LANES][64];
+
+        /*
+         * Lay out the inner hashes' messages: each is the packet's
+         * sequence number followed by the MACed data, padded in the
+         * usual SHA-256 way, bearing in mind that the already
+         * absorbed key block counts towards the hashed length.
+         */
+        size_t bufsize = 0;
+        for (size_t i = 0; i < n; i++) {
+            offsets[i] = bufsize;
+            bufsize += (4 + pkts[done+i].len + 9 + 63) & ~(size_t)63;
+        }
+        uint8_t *buf = snewn(bufsize, uint8_t);
+        for (size_t i = 0; i < n; i++) {
+            ptrlen pkt = pkts[done+i];
+            uint8_t *q = buf + offsets[i];
+            size_t msglen = 4 + pkt.len;
+            size_t padded = (msglen + 9 + 63) & ~(size_t)63;
+
+            PUT_32BIT_MSB_FIRST(q, seqs[done+i]);
+            memcpy(q + 4, pkt.ptr, pkt.len);
+            q[msglen] = 0x80;
+            memset(q + msglen + 1, 0, padded - msglen - 9);
+            PUT_64BIT_MSB_FIRST(q + padded - 8, (uint64_t)(64 + msglen) << 3);
+
+            ptrs[i] = q;
+            nblocks[i] = padded / 64;
+            memcpy(cores[i], ctx->mb_core_inner, sizeof(cores[i]));
+        }
+        sha256_mb_blocks(cores, ptrs, nblocks, n);
+
+        /*
+         * The outer hashes are all exactly one block: the inner
+         * digest plus fixed padding.
+         */
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < 8; j++)
+                PUT_32BIT_MSB_FIRST(outer[i] + 4*j, cores[i][j]);
+            outer[i][32] = 0x80;
+            memset(outer[i] + 33, 0, 64 - 33 - 8);
+            PUT_64BIT_MSB_FIRST(outer[i] + 56, (uint64_t)(64 + 32) << 3);
+
+            ptrs[i] = outer[i];
+            nblocks[i] = 1;
+            memcpy(cores[i], ctx->mb_core_outer, sizeof(cores[i]));
+        }
+        sha256_mb_blocks(cores, ptrs, nblocks, n);
+
+        for (size_t i = 0; i < n; i++) {
+            uint8_t digest[32];
+            ptrlen pkt = pkts[done+i];
+
+            for (size_t j = 0; j < 8; j++)
+                PUT_32BIT_MSB_FIRST(digest + 4*j, cores[i][j]);
+            results[done+i] = smemeq(
+                digest, (const uint8_t *)pkt.ptr + pkt.len, mac->vt->len);
+            smemclr(digest, sizeof(digest));
+        }
+
+        smemclr(cores, sizeof(cores));
+        smemclr(outer, sizeof(outer));
+        smemclr(buf, bufsize);
+        sfree(buf);
+    }
+
+    return true;
+}
+
 static const struct hmac_extra ssh_hmac_sha256_extra = { &ssh_sha256, "" };
 const ssh2_macalg ssh_hmac_sha256 = {
     .new = hmac_new,
@@ -167,6 +318,7 @@ const ssh2_macalg ssh_hmac_sha256 = {
     .setkey = hmac_key,
     .start = hmac_start,
     .genresult = hmac_genresult,
+    .multiverify = hmac_multiverify,
     .text_name = hmac_text_name,
     .name = "hmac-sha2-256",
     .etm_name = "hmac-sha2-256-etm@openssh.com",
@@ -31,13 +31,21 @@ static void ssh2_mac_prepare(ssh2_mac *mac, const void *blk, int len,
 
 void ssh2_mac_generate(ssh2_mac *mac, void *blk, int len, unsigned long seq)
 {
+    uint64_t t = cryptoprof_active() ? cryptoprof_ticks() : 0;
     ssh2_mac_prepare(mac, blk, len, seq);
     ssh2_mac_genresult(mac, (unsigned char *)blk + len);
+    if (cryptoprof_active())
+        cryptoprof_record("mac-generate", ssh2_mac_text_name(mac), t, len);
 }
 
 bool ssh2_mac_verify(
     ssh2_mac *mac, const void *blk, int len, unsigned long seq)
 {
+    uint64_t t = cryptoprof_active() ? cryptoprof_ticks() : 0;
+    bool toret;
     ssh2_mac_prepare(mac, blk, len, seq);
-    return ssh2_mac_verresult(mac, (const unsigned char *)blk + len);
+    toret = ssh2_mac_verresult(mac, (const unsigned char *)blk + len);
+    if (cryptoprof_active())
+        cryptoprof_record("mac-verify", ssh2_mac_text_name(mac), t, len);
+    return toret;
 }
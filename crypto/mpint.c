@@ -66,10 +66,54 @@ static uintmax_t shift_left_by_one_word(uintmax_t n)
         n << (shift_too_big ? 0 : BIGNUM_INT_BITS);
 }
 
+/*
+ * Pool of recently freed mp_int allocations, bucketed by exact word
+ * count. Nearly every mpint operation allocates temporaries, and
+ * during a key exchange or public-key operation the same few sizes
+ * recur over and over, so the malloc/free pair per temporary is a
+ * large constant cost; recycling the allocations removes it. The
+ * words of a pooled mp_int were wiped by mp_clear at the moment it
+ * was freed, so the wipe guarantee is exactly as before and the pool
+ * retains no secret data; the header's w field is reused as the
+ * free-list link while the entry is pooled. Like the rest of this
+ * code, the pool assumes it's only used from one thread: callers that
+ * spread mp operations across threads suspend it around the threaded
+ * section (see mp_pool_suspend in mpint.h).
+ */
+#define MP_FREELIST_MAX_NW 1024        /* don't pool above 1024 words */
+#define MP_FREELIST_DEPTH 8            /* at most 8 entries per bucket */
+static mp_int *mp_freelist[MP_FREELIST_MAX_NW + 1];
+static unsigned char mp_freelist_depth[MP_FREELIST_MAX_NW + 1];
+static int mp_pool_suspensions = 0;
+
+void mp_pool_suspend(void)
+{
+    mp_pool_suspensions++;
+}
+
+void mp_pool_resume(void)
+{
+    assert(mp_pool_suspensions > 0);
+    mp_pool_suspensions--;
+}
+
 mp_int *mp_make_sized(size_t nw)
 {
-    mp_int *x = snew_plus(mp_int, nw * sizeof(BignumInt));
+    mp_int *x;
+
     assert(nw);                   /* we outlaw the zero-word mp_int */
+
+    if (!mp_pool_suspensions && nw <= MP_FREELIST_MAX_NW && mp_freelist[nw]) {
+        x = mp_freelist[nw];
+        mp_freelist[nw] = (mp_int *)x->w;
+        mp_freelist_depth[nw]--;
+        x->nw = nw;
+        x->w = snew_plus_get_aux(x);
+        /* words were wiped when the previous owner freed this entry */
+        return x;
+    }
+
+    x = snew_plus(mp_int, nw * sizeof(BignumInt));
     x->nw = nw;
     x->w = snew_plus_get_aux(x);
     mp_clear(x);
@@ -104,6 +148,16 @@ size_t mp_max_bits(mp_int *x)
 void mp_free(mp_int *x)
 {
     mp_clear(x);
+
+    if (!mp_pool_suspensions && x->nw <= MP_FREELIST_MAX_NW &&
+        mp_freelist_depth[x->nw] < MP_FREELIST_DEPTH) {
+        size_t nw = x->nw;
+        x->w = (BignumInt *)mp_freelist[nw];
+        mp_freelist[nw] = x;
+        mp_freelist_depth[nw]++;
+        return;
+    }
+
     smemclr(x, sizeof(*x));
     sfree(x);
 }
@@ -961,10 +1015,36 @@ static void mp_mul_add_simple(mp_int *r, mp_int *a, mp_int *b)
     }
 }
 
+/*
+ * Internal routine for squaring: accumulate just the 'triangle' of
+ * cross terms, r <- r + sum of a_i a_j B^{i+j} over all i < j. The
+ * caller doubles the result and adds in the diagonal terms a_i^2
+ * itself, which is how squaring gets away with barely more than half
+ * the word multiplications of a general product.
+ */
+static void mp_sqr_add_triangle(mp_int *r, mp_int *a)
+{
+    BignumInt *rend = r->w + r->nw;
+
+    for (size_t i = 0; i + 1 < a->nw && 2*i + 1 < r->nw; i++) {
+        BignumInt adata = a->w[i], carry = 0, *rq = r->w + 2*i + 1;
+
+        for (size_t j = i + 1; j < a->nw && rq < rend; j++, rq++)
+            BignumMULADD2(carry, *rq, adata, a->w[j], *rq, carry);
+
+        for (; rq < rend; rq++)
+            BignumADC(*rq, carry, carry, *rq, 0);
+    }
+}
+
 #ifndef KARATSUBA_THRESHOLD      /* allow redefinition via -D for testing */
 #define KARATSUBA_THRESHOLD 24
 #endif
 
+#ifndef TOOM3_THRESHOLD          /* allow redefinition via -D for testing */
+#define TOOM3_THRESHOLD 100
+#endif
+
 static inline size_t mp_mul_scratchspace_unary(size_t n)
 {
     /*
@@ -991,6 +1071,15 @@ static inline size_t mp_mul_scratchspace_unary(size_t n)
      *
      * So I claim that 6n words of scratch space will suffice, and I
      * check that by assertion at every stage of the recursion.
+     *
+     * The Toom-3 branch fits in the same budget: at the top level it
+     * allocates two evaluation values of about n/3 words each, three
+     * product values and one temporary of about 2n/3 words each,
+     * which comes to 10n/3 plus a few words, and then recurses on
+     * multiplications of size about n/3, needing 2n plus a few more.
+     * 10n/3 + 2n is comfortably less than 6n, with plenty of slack
+     * for the 'few words' by the time n is as big as
+     * TOOM3_THRESHOLD.
      */
     return n * 6;
 }
@@ -1001,11 +1090,273 @@ static size_t mp_mul_scratchspace(size_t rw, size_t aw, size_t bw)
     return mp_mul_scratchspace_unary(inlen);
 }
 
+static void mp_mul_internal(mp_int *r, mp_int *a, mp_int *b, mp_int scratch);
+
+/*
+ * Internal routine used in the Toom-3 interpolation below: divide
+ * exactly by a small odd constant d, on the assumption that the input
+ * really is an exact multiple of d. This works low word upwards, in
+ * the usual way for exact division: multiply each word of the running
+ * remainder by d's multiplicative inverse mod the word base to get a
+ * word of the quotient, and propagate upwards the borrow arising from
+ * subtracting that quotient word times d back off. Data-independent
+ * control flow throughout, so it's as constant-time as the rest of
+ * this file.
+ */
+static void mp_divexact_integer_into(mp_int *r, mp_int *a, uint8_t d)
+{
+    /* Newton-Raphson iteration to find d's inverse mod the word base:
+     * each step doubles the number of correct low-order bits, and we
+     * start with at least 3, so five steps cover up to 96 bits. */
+    BignumInt dinv = d;
+    for (unsigned i = 0; i < 5; i++)
+        dinv *= 2 - (BignumInt)d * dinv;
+
+    BignumInt borrow = 0;
+    for (size_t i = 0; i < r->nw; i++) {
+        BignumInt aword = mp_word(a, i);
+        BignumInt underflow = aword < borrow;
+        BignumInt q = (aword - borrow) * dinv;
+        r->w[i] = q;
+
+        BignumInt hi, lo;
+        BignumMUL(hi, lo, q, (BignumInt)d);
+        borrow = hi + underflow;
+    }
+}
+
+/*
+ * Toom-3 (i.e. 3-way Toom-Cook) multiplication, used above a size
+ * threshold of its own as a tier on top of the Karatsuba code below.
+ * Requires r to have room for the full product.
+ *
+ * The inputs are cut into three big 'digits' in a giant base D, so
+ * that a = a_2 D^2 + a_1 D + a_0 and similarly for b, i.e. each is
+ * regarded as a quadratic polynomial in D. The degree-4 product
+ * polynomial has five coefficients, which we pin down by evaluating
+ * both inputs at five points and doing a multiplication of one third
+ * the size at each point, where the Karatsuba approach would use
+ * three multiplications of half the size for an analogous job. We
+ * use the evaluation points 0, 1, 2, 3 and infinity, rather than the
+ * more usual 0, 1, -1, 2, infinity: the evaluated values are a
+ * couple of bits bigger than with the balanced scheme, but every
+ * intermediate value in the interpolation is non-negative, which
+ * suits this module's unsigned representation much better than
+ * tracking signs out of band.
+ */
+static void mp_mul_toom3(mp_int *r, mp_int *a, mp_int *b, mp_int scratch)
+{
+    size_t inlen = size_t_min(r->nw, size_t_max(a->nw, b->nw));
+
+    /* Break up the inputs as botlen + botlen + toplen, with
+     * botlen >= toplen. The base D is 2^{botlen * BIGNUM_INT_BITS}. */
+    size_t botlen = (inlen + 2) / 3;
+    size_t toplen = inlen - 2*botlen;
+
+    mp_int a0 = mp_make_alias(a, 0, botlen);
+    mp_int a1 = mp_make_alias(a, botlen, botlen);
+    mp_int a2 = mp_make_alias(a, 2*botlen, toplen);
+    mp_int b0 = mp_make_alias(b, 0, botlen);
+    mp_int b1 = mp_make_alias(b, botlen, botlen);
+    mp_int b2 = mp_make_alias(b, 2*botlen, toplen);
+
+    /*
+     * The two outermost coefficients of the product polynomial are
+     * just a_0 b_0 and a_2 b_2, which go into the output at positions
+     * that can't overlap, the same way as the Karatsuba code's outer
+     * products. These serve as the evaluations at 0 and infinity.
+     */
+    mp_int w0 = mp_make_alias(r, 0, 2*botlen);
+    mp_int w4 = mp_make_alias(r, 4*botlen, 2*toplen);
+    mp_mul_internal(&w0, &a0, &b0, scratch);
+    mp_mul_internal(&w4, &a2, &b2, scratch);
+
+    /*
+     * Evaluate at 1, 2 and 3, and multiply the pairs of evaluated
+     * values. Each evaluation a_2 x^2 + a_1 x + a_0 is at most 13
+     * times the giant base, so one extra word is plenty.
+     */
+    mp_int ea = mp_alloc_from_scratch(&scratch, botlen+1);
+    mp_int eb = mp_alloc_from_scratch(&scratch, botlen+1);
+    mp_int w1 = mp_alloc_from_scratch(&scratch, 2*botlen+2);
+    mp_int w2 = mp_alloc_from_scratch(&scratch, 2*botlen+2);
+    mp_int w3 = mp_alloc_from_scratch(&scratch, 2*botlen+2);
+    mp_int t = mp_alloc_from_scratch(&scratch, 2*botlen+2);
+
+    /* If we're really squaring, there's no need to evaluate the same
+     * polynomial twice, and passing &ea as both factors lets the
+     * recursive multiplications spot that they're squarings too. */
+    bool squaring = (a->w == b->w && a->nw == b->nw);
+
+    mp_int *const ws[3] = { &w1, &w2, &w3 };
+    for (unsigned x = 1; x <= 3; x++) {
+        /* Horner evaluation of both polynomials at D = x */
+        mp_copy_into(&ea, &a2);
+        mp_mul_integer_into(&ea, &ea, x);
+        mp_add_into(&ea, &ea, &a1);
+        mp_mul_integer_into(&ea, &ea, x);
+        mp_add_into(&ea, &ea, &a0);
+
+        if (!squaring) {
+            mp_copy_into(&eb, &b2);
+            mp_mul_integer_into(&eb, &eb, x);
+            mp_add_into(&eb, &eb, &b1);
+            mp_mul_integer_into(&eb, &eb, x);
+            mp_add_into(&eb, &eb, &b0);
+        }
+
+        mp_mul_internal(ws[x-1], &ea, squaring ? &ea : &eb, scratch);
+    }
+
+    /*
+     * Interpolate. Writing c_i for the coefficients of the product
+     * polynomial, the evaluations gave us
+     *
+     *   w1 = c_4 + c_3 + c_2 + c_1 + c_0
+     *   w2 = 16 c_4 + 8 c_3 + 4 c_2 + 2 c_1 + c_0
+     *   w3 = 81 c_4 + 27 c_3 + 9 c_2 + 3 c_1 + c_0
+     *
+     * and we already know c_0 = w0 and c_4 = w4. Gaussian
+     * elimination, in an order chosen so that every intermediate
+     * value is a non-negative combination of the c_i:
+     *
+     *   w1 <- w1 - c_0 - c_4        =  c_3 +   c_2 + c_1
+     *   w2 <- w2 - c_0 - 16 c_4 - 2 w1
+     *                               = 6 c_3 + 2 c_2
+     *   w3 <- w3 - c_0 - 81 c_4 - 3 w1 - 3 w2
+     *                               = 6 c_3
+     *
+     * after which back-substitution gives c_3, c_2, c_1 in turn.
+     */
+    mp_sub_into(&w1, &w1, &w0);
+    mp_sub_into(&w1, &w1, &w4);
+
+    mp_sub_into(&w2, &w2, &w0);
+    mp_mul_integer_into(&t, &w4, 16);
+    mp_sub_into(&w2, &w2, &t);
+    mp_mul_integer_into(&t, &w1, 2);
+    mp_sub_into(&w2, &w2, &t);
+
+    mp_sub_into(&w3, &w3, &w0);
+    mp_mul_integer_into(&t, &w4, 81);
+    mp_sub_into(&w3, &w3, &t);
+    mp_mul_integer_into(&t, &w1, 3);
+    mp_sub_into(&w3, &w3, &t);
+    mp_mul_integer_into(&t, &w2, 3);
+    mp_sub_into(&w3, &w3, &t);
+
+    /* c_3 = w3 / 6 */
+    mp_rshift_fixed_into(&w3, &w3, 1);
+    mp_divexact_integer_into(&w3, &w3, 3);
+
+    /* c_2 = (w2 - 6 c_3) / 2 */
+    mp_mul_integer_into(&t, &w3, 6);
+    mp_sub_into(&w2, &w2, &t);
+    mp_rshift_fixed_into(&w2, &w2, 1);
+
+    /* c_1 = w1 - c_3 - c_2 */
+    mp_sub_into(&w1, &w1, &w3);
+    mp_sub_into(&w1, &w1, &w2);
+
+    /* Add the three middle coefficients into the output, at offsets
+     * where they overlap each other and the outer two, letting the
+     * carries propagate to the top of r. */
+    for (unsigned i = 1; i <= 3; i++) {
+        mp_int ri = mp_make_alias(r, i*botlen, r->nw);
+        mp_add_into(&ri, &ri, ws[i-1]);
+    }
+}
+
+/*
+ * Squaring, split off from the general multiply code because it can
+ * be done in a bit over half the work: of the cross products a_i a_j,
+ * each pair with i != j need only be computed once and doubled. Both
+ * divide-and-conquer tiers preserve the saving, because every
+ * recursive product they generate is itself a square. Callers don't
+ * use this directly: mp_mul_internal spots multiplications of a
+ * number by itself and redirects here.
+ */
+static void mp_sqr_internal(mp_int *r, mp_int *a, mp_int scratch)
+{
+    size_t inlen = a->nw;
+    assert(r->nw >= inlen*2);
+
+    if (inlen >= TOOM3_THRESHOLD) {
+        mp_clear(r);
+        mp_mul_toom3(r, a, a, scratch);
+        return;
+    }
+
+    if (inlen < KARATSUBA_THRESHOLD) {
+        /*
+         * Small enough to square directly: accumulate the triangle of
+         * cross terms, double it with a one-bit shift, and add the
+         * diagonal terms a_i^2 back in along with the carries off
+         * each one. The doubled triangle can't overflow the top of r,
+         * because it's bounded above by the full square, which fits.
+         */
+        mp_clear(r);
+        mp_sqr_add_triangle(r, a);
+        mp_lshift_fixed_into(r, r, 1);
+
+        BignumInt carry = 0;
+        for (size_t i = 0; i < inlen; i++) {
+            BignumInt hi, lo;
+            BignumMUL(hi, lo, a->w[i], a->w[i]);
+            BignumADC(r->w[2*i], carry, r->w[2*i], lo, carry);
+            BignumADC(r->w[2*i+1], carry, r->w[2*i+1], hi, carry);
+        }
+        for (BignumInt *rq = r->w + 2*inlen, *rend = r->w + r->nw;
+             rq < rend; rq++)
+            BignumADC(*rq, carry, carry, *rq, 0);
+        return;
+    }
+
+    /*
+     * In between, the same shape as the Karatsuba branch of
+     * mp_mul_internal below, with both halves squared:
+     *
+     *   a^2 = a_1^2 D^2 + ((a_0 + a_1)^2 - a_1^2 - a_0^2) D + a_0^2
+     */
+    size_t toplen = inlen / 2;
+    size_t botlen = inlen - toplen;
+
+    mp_int a0 = mp_make_alias(a, 0, botlen);
+    mp_int a1 = mp_make_alias(a, botlen, toplen);
+    mp_int r0 = mp_make_alias(r, 0, botlen*2);
+    mp_int r1 = mp_make_alias(r, botlen, r->nw);
+    mp_int r2 = mp_make_alias(r, botlen*2, r->nw);
+
+    mp_sqr_internal(&r0, &a0, scratch);
+    mp_sqr_internal(&r2, &a1, scratch);
+
+    mp_int asum = mp_alloc_from_scratch(&scratch, botlen+1);
+    mp_add_into(&asum, &a0, &a1);
+
+    mp_int product = mp_alloc_from_scratch(&scratch, 2*botlen+2);
+    mp_sqr_internal(&product, &asum, scratch);
+
+    mp_sub_into(&product, &product, &r0);
+    mp_sub_into(&product, &product, &r2);
+
+    mp_add_into(&r1, &r1, &product);
+}
+
 static void mp_mul_internal(mp_int *r, mp_int *a, mp_int *b, mp_int scratch)
 {
     size_t inlen = size_t_min(r->nw, size_t_max(a->nw, b->nw));
     assert(scratch.nw >= mp_mul_scratchspace_unary(inlen));
 
+    if (a->w == b->w && a->nw == b->nw && r->nw >= a->nw * 2) {
+        /*
+         * Multiplying a number by itself: divert to the specialised
+         * squaring code, provided the output has room for the full
+         * square.
+         */
+        mp_sqr_internal(r, a, scratch);
+        return;
+    }
+
     mp_clear(r);
 
     if (inlen < KARATSUBA_THRESHOLD || a->nw == 0 || b->nw == 0) {
@@ -1017,6 +1368,18 @@ static void mp_mul_internal(mp_int *r, mp_int *a, mp_int *b, mp_int scratch)
         return;
     }
 
+    if (inlen >= TOOM3_THRESHOLD && r->nw >= inlen*2) {
+        /*
+         * Large enough inputs go to the 3-way Toom-Cook code above,
+         * provided the output buffer wants the whole product: the
+         * interpolation step doesn't adapt gracefully to truncated
+         * outputs, so those stay on the Karatsuba path below,
+         * which handles them specially.
+         */
+        mp_mul_toom3(r, a, b, scratch);
+        return;
+    }
+
     /*
      * Karatsuba divide-and-conquer algorithm. We cut each input in
      * half, so that it's expressed as two big 'digits' in a giant
@@ -1546,50 +1909,143 @@ static void monty_reduce(MontyContext *mc, mp_int *x)
     mp_clear(mc->scratch);
 }
 
+/*
+ * Window size for monty_pow. Each window costs MONTY_POW_WINDOW
+ * squarings plus one multiplication plus a scan over the whole
+ * 2^MONTY_POW_WINDOW-entry table (we must touch every entry to keep
+ * the exponent out of the memory-access pattern), so making the
+ * window bigger trades a smaller share of multiplications against a
+ * table scan that doubles each time; 5 is about the crossover for
+ * the exponent sizes we care about.
+ */
+#ifndef MONTY_POW_WINDOW         /* allow redefinition via -D for testing */
+#define MONTY_POW_WINDOW 5
+#endif
+
 mp_int *monty_pow(MontyContext *mc, mp_int *base, mp_int *exponent)
 {
-    /* square builds up powers of the form base^{2^i}. */
-    mp_int *square = mp_copy(base);
-    size_t i = 0;
+    /*
+     * Fixed-window exponentiation: precompute all the powers base^0,
+     * ..., base^{2^w-1}, then consume the exponent w bits at a time
+     * from the top, doing w squarings and one table multiplication
+     * per window. Everything data-dependent is done in constant
+     * time: the only secret quantity is each window's bit pattern,
+     * which is used solely as the comparison value in a masked scan
+     * of the whole table. The number of windows depends only on the
+     * exponent's storage size.
+     */
+    mp_int *table[1 << MONTY_POW_WINDOW];
+    table[0] = mp_copy(mc->powers_of_r_mod_m[0]);   /* Montgomery 1 */
+    for (size_t j = 1; j < lenof(table); j++)
+        table[j] = monty_mul(mc, table[j-1], base);
 
-    /* out accumulates the output value. Starts at 1 (in Montgomery
-     * representation) and we multiply in each base^{2^i}. */
+    /* out accumulates the output value, starting at 1 (in Montgomery
+     * representation). */
     mp_int *out = mp_copy(mc->powers_of_r_mod_m[0]);
 
-    /* tmp holds each product we compute and reduce. */
+    /* tmp holds each product we compute and reduce; val holds each
+     * table entry once we've selected it. */
     mp_int *tmp = mp_make_sized(mc->rw * 2);
+    mp_int *val = mp_make_sized(mc->rw);
+
+    size_t nbits = exponent->nw * BIGNUM_INT_BITS;
+    size_t nwindows = (nbits + MONTY_POW_WINDOW - 1) / MONTY_POW_WINDOW;
+
+    for (size_t win = nwindows; win-- > 0 ;) {
+        /* No point squaring while the accumulator is still 1 */
+        if (win != nwindows - 1) {
+            for (unsigned t = 0; t < MONTY_POW_WINDOW; t++) {
+                mp_mul_into(tmp, out, out);
+                monty_reduce(mc, tmp);
+                mp_copy_into(out, tmp);
+            }
+        }
 
-    while (true) {
-        mp_mul_into(tmp, out, square);
-        monty_reduce(mc, tmp);
-        mp_select_into(out, out, tmp, mp_get_bit(exponent, i));
+        /* Extract this window's bits of the exponent (the topmost
+         * window may be partial) */
+        BignumInt digit = 0;
+        for (unsigned t = 0; t < MONTY_POW_WINDOW; t++) {
+            size_t bit = win * MONTY_POW_WINDOW + t;
+            if (bit < nbits)
+                digit |= (BignumInt)mp_get_bit(exponent, bit) << t;
+        }
 
-        if (++i >= exponent->nw * BIGNUM_INT_BITS)
-            break;
+        /* Constant-time selection of table[digit] */
+        for (size_t j = 0; j < lenof(table); j++)
+            mp_select_into(val, val, table[j],
+                           1 ^ normalise_to_1(j ^ digit));
 
-        mp_mul_into(tmp, square, square);
+        mp_mul_into(tmp, out, val);
         monty_reduce(mc, tmp);
-        mp_copy_into(square, tmp);
+        mp_copy_into(out, tmp);
     }
 
-    mp_free(square);
+    for (size_t j = 0; j < lenof(table); j++)
+        mp_free(table[j]);
     mp_free(tmp);
+    mp_free(val);
     mp_clear(mc->scratch);
     return out;
 }
 
+/*
+ * Cache of MontyContexts for moduli recently used with mp_modpow, in
+ * most-recently-used order. Callers of mp_modpow tend to use the same
+ * modulus over and over - a DSA signature or verification does all
+ * its exponentiations mod the same group prime, and successive
+ * operations against the same key repeat it again - so keeping the
+ * contexts alive between calls skips recomputing n' and the powers of
+ * r mod n each time. (Long-lived users of Montgomery arithmetic such
+ * as the DH and ECC group structures hold their own context
+ * directly; this cache is for the one-shot mp_modpow interface.)
+ */
+#define MAX_CACHED_MONTY 4
+static struct cached_monty {
+    MontyContext *mc;
+    struct cached_monty *next;
+} *monty_cache = NULL;
+
+static MontyContext *monty_get_cached(mp_int *modulus)
+{
+    struct cached_monty **cmp, *cm;
+    int pos = 0;
+
+    for (cmp = &monty_cache; (cm = *cmp) != NULL; cmp = &cm->next, pos++) {
+        if (mp_cmp_eq(cm->mc->m, modulus)) {
+            /* Move to the front, to keep the list in MRU order */
+            *cmp = cm->next;
+            cm->next = monty_cache;
+            monty_cache = cm;
+            return cm->mc;
+        }
+        if (pos >= MAX_CACHED_MONTY - 1 && !cm->next) {
+            /* We're at the size limit and about to add an entry, so
+             * evict the least recently used one. */
+            *cmp = NULL;
+            monty_free(cm->mc);
+            sfree(cm);
+            break;
+        }
+    }
+
+    cm = snew(struct cached_monty);
+    cm->mc = monty_new(modulus);
+    cm->next = monty_cache;
+    monty_cache = cm;
+    return cm->mc;
+}
+
 mp_int *mp_modpow(mp_int *base, mp_int *exponent, mp_int *modulus)
 {
     assert(modulus->nw > 0);
     assert(modulus->w[0] & 1);
 
-    MontyContext *mc = monty_new(modulus);
+    MontyContext *mc = monty_get_cached(modulus);
     mp_int *m_base = monty_import(mc, base);
     mp_int *m_out = monty_pow(mc, m_base, exponent);
     mp_int *out = monty_export(mc, m_out);
     mp_free(m_base);
     mp_free(m_out);
-    monty_free(mc);
     return out;
 }
 
@@ -2336,9 +2792,15 @@ uint32_t mp_mod_known_integer(mp_int *x, uint32_t m)
      * quot is at most A/m, so quot*m <= A < 2^64. []
      */
 
-    uint32_t result = accumulator;
-    uint32_t reduced = result - m;
-    uint32_t select = -(reduced >> 31);
+    /*
+     * The final accumulator value is in [0,2m), which can exceed
+     * UINT32_MAX if m is large, so the conditional subtraction has to
+     * be done in 64-bit arithmetic, using the top bit of the
+     * subtraction output as the borrow flag.
+     */
+    uint64_t result = accumulator;
+    uint64_t reduced = result - m;
+    uint64_t select = -(reduced >> 63);
     result = reduced ^ ((result ^ reduced) & select);
     assert(result < m);
     return result;
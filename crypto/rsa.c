@@ -137,6 +137,128 @@ bool rsa_ssh1_encrypt(unsigned char *data, int length, RSAKey *key)
     return true;
 }
 
+/*
+ * Process-wide cache of per-prime precomputation for the CRT private
+ * key operation below: the Montgomery context for arithmetic mod the
+ * prime, and the private exponent reduced mod (prime-1). Pageant in
+ * particular performs many signatures with the same few keys, and
+ * without this every one of them repeated the Montgomery setup and
+ * exponent reduction for both primes from scratch inside mp_modpow.
+ * Entries are kept in MRU order and trimmed from the tail beyond a
+ * small limit.
+ *
+ * All the numbers cached here are secret, so the cache must not
+ * outlive the keys they came from: freersapriv evicts any entry for a
+ * prime belonging to the key being freed, so that (for example) a key
+ * deleted from Pageant doesn't leave its CRT precomputation lying
+ * around in memory. mp_free and monty_free wipe the entry's contents
+ * on eviction, as with any other secret value.
+ */
+struct rsa_prime_ctx {
+    mp_int *prime, *pm1;
+    MontyContext *mc;
+    mp_int *exp, *exp_reduced;     /* exp, and exp mod (prime-1) */
+    struct rsa_prime_ctx *next;
+};
+
+#define MAX_CACHED_PRIMES 8        /* four keys' worth */
+static struct rsa_prime_ctx *rsa_prime_cache = NULL;
+
+static void rsa_prime_ctx_free(struct rsa_prime_ctx *ctx)
+{
+    mp_free(ctx->prime);
+    mp_free(ctx->pm1);
+    monty_free(ctx->mc);
+    if (ctx->exp) {
+        mp_free(ctx->exp);
+        mp_free(ctx->exp_reduced);
+    }
+    sfree(ctx);
+}
+
+/*
+ * Remove and wipe the cache entry for a given prime, if one exists.
+ * Called when the key owning that prime is being freed.
+ */
+static void rsa_prime_cache_evict(mp_int *prime)
+{
+    struct rsa_prime_ctx **ctxp, *ctx;
+
+    for (ctxp = &rsa_prime_cache; (ctx = *ctxp) != NULL; ctxp = &ctx->next) {
+        if (mp_cmp_eq(ctx->prime, prime)) {
+            *ctxp = ctx->next;
+            rsa_prime_ctx_free(ctx);
+            return;
+        }
+    }
+}
+
+static struct rsa_prime_ctx *rsa_prime_ctx_get(mp_int *prime)
+{
+    struct rsa_prime_ctx **ctxp, *ctx;
+    int pos = 0;
+
+    for (ctxp = &rsa_prime_cache; (ctx = *ctxp) != NULL;
+         ctxp = &ctx->next, pos++) {
+        if (mp_cmp_eq(ctx->prime, prime)) {
+            /* Move to the front, to keep the list in MRU order */
+            *ctxp = ctx->next;
+            ctx->next = rsa_prime_cache;
+            rsa_prime_cache = ctx;
+            return ctx;
+        }
+        if (pos >= MAX_CACHED_PRIMES - 1 && !ctx->next) {
+            /* We're at the size limit and about to add an entry, so
+             * evict the least recently used one. */
+            *ctxp = NULL;
+            rsa_prime_ctx_free(ctx);
+            break;
+        }
+    }
+
+    ctx = snew(struct rsa_prime_ctx);
+    ctx->prime = mp_copy(prime);
+    ctx->pm1 = mp_copy(prime);
+    mp_sub_integer_into(ctx->pm1, ctx->pm1, 1);
+    ctx->mc = monty_new(prime);
+    ctx->exp = ctx->exp_reduced = NULL;
+    ctx->next = rsa_prime_cache;
+    rsa_prime_cache = ctx;
+    return ctx;
+}
+
+/*
+ * One half of the CRT operation: compute base ^ exp mod prime, using
+ * (and if necessary filling in) the cached per-prime state.
+ */
+static mp_int *crt_modpow_half(mp_int *base, mp_int *exp, mp_int *prime)
+{
+    struct rsa_prime_ctx *ctx = rsa_prime_ctx_get(prime);
+
+    /*
+     * Reduce the exponent mod phi(prime) == prime-1, to save time
+     * when exponentiating, unless the cache already holds the
+     * reduction of this same exponent.
+     */
+    if (!ctx->exp || !mp_cmp_eq(ctx->exp, exp)) {
+        if (ctx->exp) {
+            mp_free(ctx->exp);
+            mp_free(ctx->exp_reduced);
+        }
+        ctx->exp = mp_copy(exp);
+        ctx->exp_reduced = mp_mod(exp, ctx->pm1);
+    }
+
+    mp_int *base_reduced = mp_mod(base, prime);
+    mp_int *m_base = monty_import(ctx->mc, base_reduced);
+    mp_int *m_result = monty_pow(ctx->mc, m_base, ctx->exp_reduced);
+    mp_int *result = monty_export(ctx->mc, m_result);
+    mp_free(base_reduced);
+    mp_free(m_base);
+    mp_free(m_result);
+    return result;
+}
+
 /*
  * Compute (base ^ exp) % mod, provided mod == p * q, with p,q
  * distinct primes, and iqmp is the multiplicative inverse of q mod p.
@@ -146,30 +268,14 @@ bool rsa_ssh1_encrypt(unsigned char *data, int length, RSAKey *key)
 static mp_int *crt_modpow(mp_int *base, mp_int *exp, mp_int *mod,
                           mp_int *p, mp_int *q, mp_int *iqmp)
 {
-    mp_int *pm1, *qm1, *pexp, *qexp, *presult, *qresult;
+    mp_int *presult, *qresult;
     mp_int *diff, *multiplier, *ret0, *ret;
 
-    /*
-     * Reduce the exponent mod phi(p) and phi(q), to save time when
-     * exponentiating mod p and mod q respectively. Of course, since p
-     * and q are prime, phi(p) == p-1 and similarly for q.
-     */
-    pm1 = mp_copy(p);
-    mp_sub_integer_into(pm1, pm1, 1);
-    qm1 = mp_copy(q);
-    mp_sub_integer_into(qm1, qm1, 1);
-    pexp = mp_mod(exp, pm1);
-    qexp = mp_mod(exp, qm1);
-
     /*
      * Do the two modpows.
      */
-    mp_int *base_mod_p = mp_mod(base, p);
-    presult = mp_modpow(base_mod_p, pexp, p);
-    mp_free(base_mod_p);
-    mp_int *base_mod_q = mp_mod(base, q);
-    qresult = mp_modpow(base_mod_q, qexp, q);
-    mp_free(base_mod_q);
+    presult = crt_modpow_half(base, exp, p);
+    qresult = crt_modpow_half(base, exp, q);
 
     /*
      * Recombine the results. We want a value which is congruent to
@@ -199,10 +305,6 @@ static mp_int *crt_modpow(mp_int *base, mp_int *exp, mp_int *mod,
     /*
      * Free all the intermediate results before returning.
      */
-    mp_free(pm1);
-    mp_free(qm1);
-    mp_free(pexp);
-    mp_free(qexp);
     mp_free(presult);
     mp_free(qresult);
     mp_free(diff);
@@ -438,10 +540,12 @@ void freersapriv(RSAKey *key)
         key->private_exponent = NULL;
     }
     if (key->p) {
+        rsa_prime_cache_evict(key->p);
         mp_free(key->p);
         key->p = NULL;
     }
     if (key->q) {
+        rsa_prime_cache_evict(key->q);
         mp_free(key->q);
         key->q = NULL;
     }
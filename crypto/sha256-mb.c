@@ -0,0 +1,235 @@
+/*
+ * Multi-buffer SHA-256: the compression function applied to up to
+ * four independent message streams in lockstep, used by hmac.c to
+ * verify the MACs on a batch of SSH-2 packets in one pass.
+ *
+ * This is not an implementation of the ssh_hashalg API. The streams
+ * here are whole pre-padded messages rather than incrementally
+ * written hash objects: each lane provides its own starting state (so
+ * a caller can begin from a precomputed mid-hash state, as HMAC does
+ * after absorbing the key block) and a message which must be a whole
+ * number of 64-byte blocks, with any SHA-256 padding already in
+ * place.
+ *
+ * As with the ChaCha20 kernel in chacha20-poly1305.c, the vector
+ * forms of this code rely only on SSE2 / NEON, which are baseline
+ * features of our 64-bit x86 and Arm targets respectively, so they
+ * are selected at compile time with no runtime dispatch. The four
+ * lanes are kept in 'vertical' form: vector register i holds word i
+ * of the hash state for all four lanes, so the round function
+ * vectorizes directly. On other platforms a scalar loop over the
+ * lanes does the same job.
+ */
+
+#include "ssh.h"
+#include "sha256.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+#define SHA256_MB_VECTOR
+typedef __m128i sha256_mb_vec;
+#define VADD _mm_add_epi32
+#define VXOR _mm_xor_si128
+#define VAND _mm_and_si128
+#define VOR _mm_or_si128
+#define VSHR(v, n) _mm_srli_epi32(v, n)
+#define VROTR(v, n) _mm_or_si128(_mm_srli_epi32(v, n), \
+                                 _mm_slli_epi32(v, 32-(n)))
+#define VSPLAT _mm_set1_epi32
+#define VSETR4 _mm_setr_epi32
+#define VSTORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define SHA256_MB_VECTOR
+typedef uint32x4_t sha256_mb_vec;
+#define VADD vaddq_u32
+#define VXOR veorq_u32
+#define VAND vandq_u32
+#define VOR vorrq_u32
+#define VSHR(v, n) vshrq_n_u32(v, n)
+#define VROTR(v, n) vorrq_u32(vshrq_n_u32(v, n), vshlq_n_u32(v, 32-(n)))
+#define VSPLAT vdupq_n_u32
+static inline uint32x4_t sha256_mb_vsetr4(
+    uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    uint32_t lanes[4];
+    lanes[0] = a; lanes[1] = b; lanes[2] = c; lanes[3] = d;
+    return vld1q_u32(lanes);
+}
+#define VSETR4 sha256_mb_vsetr4
+#define VSTORE(p, v) vst1q_u32(p, v)
+
+#endif
+
+#ifdef SHA256_MB_VECTOR
+
+/* The same elementary functions as sha256-sw.c's, acting on all four
+ * lanes at once. These have to be macros rather than inline
+ * functions, because NEON's immediate-shift intrinsics insist on
+ * compile-time constant shift counts. */
+#define MB_CH(e, f, g) VXOR(g, VAND(e, VXOR(f, g)))
+#define MB_MAJ(x, y, z) VOR(VAND(x, y), VAND(z, VOR(x, y)))
+#define MB_SIGMA_0(x) VXOR(VXOR(VROTR(x, 2), VROTR(x, 13)), VROTR(x, 22))
+#define MB_SIGMA_1(x) VXOR(VXOR(VROTR(x, 6), VROTR(x, 11)), VROTR(x, 25))
+#define MB_sigma_0(x) VXOR(VXOR(VROTR(x, 7), VROTR(x, 18)), VSHR(x, 3))
+#define MB_sigma_1(x) VXOR(VXOR(VROTR(x, 17), VROTR(x, 19)), VSHR(x, 10))
+
+static void sha256_mb_block_x4(
+    uint32_t (*cores)[8], const uint8_t *const *blocks)
+{
+    sha256_mb_vec w[16], s[8];
+    sha256_mb_vec a, b, c, d, e, f, g, h;
+
+    for (size_t t = 0; t < 16; t++)
+        w[t] = VSETR4(GET_32BIT_MSB_FIRST(blocks[0] + 4*t),
+                      GET_32BIT_MSB_FIRST(blocks[1] + 4*t),
+                      GET_32BIT_MSB_FIRST(blocks[2] + 4*t),
+                      GET_32BIT_MSB_FIRST(blocks[3] + 4*t));
+
+    for (size_t i = 0; i < 8; i++)
+        s[i] = VSETR4(cores[0][i], cores[1][i], cores[2][i], cores[3][i]);
+
+    a = s[0]; b = s[1]; c = s[2]; d = s[3];
+    e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+    for (unsigned t = 0; t < SHA256_ROUNDS; t++) {
+        sha256_mb_vec wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            /* Extend the message schedule in place, treating w[] as a
+             * ring buffer of the last 16 words */
+            wt = VADD(VADD(MB_sigma_1(w[(t-2) & 15]), w[(t-7) & 15]),
+                      VADD(MB_sigma_0(w[(t-15) & 15]), w[(t-16) & 15]));
+            w[t & 15] = wt;
+        }
+
+        sha256_mb_vec t1 = VADD(
+            VADD(h, MB_SIGMA_1(e)),
+            VADD(MB_CH(e, f, g),
+                 VADD(VSPLAT(sha256_round_constants[t]), wt)));
+        sha256_mb_vec t2 = VADD(MB_SIGMA_0(a), MB_MAJ(a, b, c));
+        h = g; g = f; f = e; e = VADD(d, t1);
+        d = c; c = b; b = a; a = VADD(t1, t2);
+    }
+
+    {
+        sha256_mb_vec out[8];
+        uint32_t lanes[4];
+
+        out[0] = a; out[1] = b; out[2] = c; out[3] = d;
+        out[4] = e; out[5] = f; out[6] = g; out[7] = h;
+
+        for (size_t i = 0; i < 8; i++) {
+            VSTORE(lanes, VADD(out[i], s[i]));
+            for (size_t j = 0; j < 4; j++)
+                cores[j][i] = lanes[j];
+        }
+
+        smemclr(lanes, sizeof(lanes));
+    }
+
+    smemclr(w, sizeof(w));
+}
+
+#endif /* SHA256_MB_VECTOR */
+
+/*
+ * Scalar form of the block function, for platforms with no vector
+ * unit and for 'straggler' lanes once the batch's shorter messages
+ * have run out of blocks.
+ */
+
+static inline uint32_t ror(uint32_t x, unsigned y)
+{
+    return (x << (31 & -y)) | (x >> (31 & y));
+}
+
+static void sha256_mb_block_1(uint32_t *core, const uint8_t *block)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    for (size_t t = 0; t < 16; t++)
+        w[t] = GET_32BIT_MSB_FIRST(block + 4*t);
+
+    a = core[0]; b = core[1]; c = core[2]; d = core[3];
+    e = core[4]; f = core[5]; g = core[6]; h = core[7];
+
+    for (unsigned t = 0; t < SHA256_ROUNDS; t++) {
+        uint32_t wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            uint32_t s0 = ror(w[(t-15) & 15], 7) ^ ror(w[(t-15) & 15], 18) ^
+                (w[(t-15) & 15] >> 3);
+            uint32_t s1 = ror(w[(t-2) & 15], 17) ^ ror(w[(t-2) & 15], 19) ^
+                (w[(t-2) & 15] >> 10);
+            wt = w[(t-16) & 15] + s0 + w[(t-7) & 15] + s1;
+            w[t & 15] = wt;
+        }
+
+        uint32_t t1 = h + (ror(e,6) ^ ror(e,11) ^ ror(e,25)) +
+            (g ^ (e & (f ^ g))) + sha256_round_constants[t] + wt;
+        uint32_t t2 = (ror(a,2) ^ ror(a,13) ^ ror(a,22)) +
+            ((a & b) | (c & (a | b)));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    core[0] += a; core[1] += b; core[2] += c; core[3] += d;
+    core[4] += e; core[5] += f; core[6] += g; core[7] += h;
+
+    smemclr(w, sizeof(w));
+}
+
+void sha256_mb_blocks(uint32_t (*cores)[8], const uint8_t *const *data,
+                      const size_t *nblocks, size_t nlanes)
+{
+    const uint8_t *p[SHA256_MB_LANES];
+    size_t left[SHA256_MB_LANES];
+
+    assert(nlanes <= SHA256_MB_LANES);
+    for (size_t i = 0; i < nlanes; i++) {
+        p[i] = data[i];
+        left[i] = nblocks[i];
+    }
+
+    for (;;) {
+        size_t nact = 0;
+        for (size_t i = 0; i < nlanes; i++)
+            if (left[i])
+                nact++;
+        if (!nact)
+            break;
+
+#ifdef SHA256_MB_VECTOR
+        if (nact == SHA256_MB_LANES) {
+            /* All four lanes still have input: run them in lockstep.
+             * (nact == SHA256_MB_LANES implies nlanes does too.) */
+            sha256_mb_block_x4(cores, p);
+            for (size_t i = 0; i < nlanes; i++) {
+                p[i] += 64;
+                left[i]--;
+            }
+            continue;
+        }
+#endif
+
+        /* Fewer than a full set of live lanes (or no vector unit):
+         * process one block from each remaining lane in turn. */
+        for (size_t i = 0; i < nlanes; i++) {
+            if (left[i]) {
+                sha256_mb_block_1(cores[i], p[i]);
+                p[i] += 64;
+                left[i]--;
+            }
+        }
+    }
+}
@@ -55,6 +55,18 @@ static inline bool check_availability(const struct sha256_extra *extra)
 extern const uint32_t sha256_initial_state[8];
 extern const uint32_t sha256_round_constants[64];
 
+/*
+ * Multi-buffer SHA-256 (sha256-mb.c): run the compression function
+ * over up to SHA256_MB_LANES independent message streams in lockstep.
+ * Each lane has its own state, in the form of the 8 words of the
+ * central hash state, and its own message, which must be a whole
+ * number of 64-byte blocks with any padding already in place. Lanes
+ * whose messages are shorter than the longest simply finish early.
+ */
+#define SHA256_MB_LANES 4
+void sha256_mb_blocks(uint32_t (*cores)[8], const uint8_t *const *data,
+                      const size_t *nblocks, size_t nlanes);
+
 #define SHA256_ROUNDS 64
 
 typedef struct sha256_block sha256_block;
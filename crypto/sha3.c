@@ -24,44 +24,131 @@ static inline uint64_t rol(uint64_t x, unsigned shift)
 typedef uint64_t keccak_core_state[5][5];
 #define NROUNDS 24               /* would differ for other word sizes */
 static const uint64_t round_constants[NROUNDS];
-static const unsigned rotation_counts[5][5];
 
 /*
  * Core Keccak transform: just squodge the state around internally,
  * without adding or extracting any data from it.
- */
+ *
+ * The round function is fully unrolled, with the rho-step rotation
+ * counts as immediate operands, so that the whole state lives in
+ * local variables for the duration instead of being repeatedly
+ * loaded and stored through the 5x5 indexing arithmetic. The
+ * unrolled body below was generated by the following piece of
+ * Python, whose rot[] matrix of rotation counts is derived from the
+ * formula in the Keccak reference (see the comment further down
+ * where the derivation used to live as a run-time table):
+
+rot = [[0, 36, 3, 41, 18], [1, 44, 10, 45, 2], [62, 6, 43, 15, 61],
+       [28, 55, 25, 21, 56], [27, 20, 39, 8, 14]]
+
+print("        /" "* theta step *" "/")
+for x in range(5):
+    print("        uint64_t c%d = %s;" % (
+        x, " ^ ".join("a%d%d" % (x, y) for y in range(5))))
+for x in range(5):
+    print("        uint64_t d%d = rol(c%d, 1) ^ c%d;" % (
+        x, (x+1) % 5, (x+4) % 5))
+for x in range(5):
+    print("        " + " ".join(
+        "a%d%d ^= d%d;" % (x, y, x) for y in range(5)))
+print()
+print("        /" "* rho and pi steps *" "/")
+for x in range(5):
+    for y in range(5):
+        bx, by = y, (2*x + 3*y) % 5
+        if rot[x][y] == 0:
+            print("        uint64_t b%d%d = a%d%d;" % (bx, by, x, y))
+        else:
+            print("        uint64_t b%d%d = rol(a%d%d, %d);" % (
+                bx, by, x, y, rot[x][y]))
+print()
+print("        /" "* chi step *" "/")
+stmts = ["a%d%d = b%d%d ^ (b%d%d & ~b%d%d);" % (
+    x, y, x, y, (x+2) % 5, y, (x+1) % 5, y)
+    for x in range(5) for y in range(5)]
+for i in range(0, 25, 2):
+    print("        " + " ".join(stmts[i:i+2]))
+
+*/
 static void keccak_transform(keccak_core_state A)
 {
-    union {
-        uint64_t C[5];
-        uint64_t B[5][5];
-    } u;
+    uint64_t a00 = A[0][0], a01 = A[0][1], a02 = A[0][2], a03 = A[0][3];
+    uint64_t a04 = A[0][4], a10 = A[1][0], a11 = A[1][1], a12 = A[1][2];
+    uint64_t a13 = A[1][3], a14 = A[1][4], a20 = A[2][0], a21 = A[2][1];
+    uint64_t a22 = A[2][2], a23 = A[2][3], a24 = A[2][4], a30 = A[3][0];
+    uint64_t a31 = A[3][1], a32 = A[3][2], a33 = A[3][3], a34 = A[3][4];
+    uint64_t a40 = A[4][0], a41 = A[4][1], a42 = A[4][2], a43 = A[4][3];
+    uint64_t a44 = A[4][4];
 
     for (unsigned round = 0; round < NROUNDS; round++) {
         /* theta step */
-        for (unsigned x = 0; x < 5; x++)
-            u.C[x] = A[x][0] ^ A[x][1] ^ A[x][2] ^ A[x][3] ^ A[x][4];
-        for (unsigned x = 0; x < 5; x++) {
-            uint64_t D = rol(u.C[(x+1) % 5], 1) ^ u.C[(x+4) % 5];
-            for (unsigned y = 0; y < 5; y++)
-                A[x][y] ^= D;
-        }
+        uint64_t c0 = a00 ^ a01 ^ a02 ^ a03 ^ a04;
+        uint64_t c1 = a10 ^ a11 ^ a12 ^ a13 ^ a14;
+        uint64_t c2 = a20 ^ a21 ^ a22 ^ a23 ^ a24;
+        uint64_t c3 = a30 ^ a31 ^ a32 ^ a33 ^ a34;
+        uint64_t c4 = a40 ^ a41 ^ a42 ^ a43 ^ a44;
+        uint64_t d0 = rol(c1, 1) ^ c4;
+        uint64_t d1 = rol(c2, 1) ^ c0;
+        uint64_t d2 = rol(c3, 1) ^ c1;
+        uint64_t d3 = rol(c4, 1) ^ c2;
+        uint64_t d4 = rol(c0, 1) ^ c3;
+        a00 ^= d0; a01 ^= d0; a02 ^= d0; a03 ^= d0; a04 ^= d0;
+        a10 ^= d1; a11 ^= d1; a12 ^= d1; a13 ^= d1; a14 ^= d1;
+        a20 ^= d2; a21 ^= d2; a22 ^= d2; a23 ^= d2; a24 ^= d2;
+        a30 ^= d3; a31 ^= d3; a32 ^= d3; a33 ^= d3; a34 ^= d3;
+        a40 ^= d4; a41 ^= d4; a42 ^= d4; a43 ^= d4; a44 ^= d4;
 
         /* rho and pi steps */
-        for (unsigned x = 0; x < 5; x++)
-            for (unsigned y = 0; y < 5; y++)
-                u.B[y][(2*x+3*y) % 5] = rol(A[x][y], rotation_counts[x][y]);
+        uint64_t b00 = a00;
+        uint64_t b13 = rol(a01, 36);
+        uint64_t b21 = rol(a02, 3);
+        uint64_t b34 = rol(a03, 41);
+        uint64_t b42 = rol(a04, 18);
+        uint64_t b02 = rol(a10, 1);
+        uint64_t b10 = rol(a11, 44);
+        uint64_t b23 = rol(a12, 10);
+        uint64_t b31 = rol(a13, 45);
+        uint64_t b44 = rol(a14, 2);
+        uint64_t b04 = rol(a20, 62);
+        uint64_t b12 = rol(a21, 6);
+        uint64_t b20 = rol(a22, 43);
+        uint64_t b33 = rol(a23, 15);
+        uint64_t b41 = rol(a24, 61);
+        uint64_t b01 = rol(a30, 28);
+        uint64_t b14 = rol(a31, 55);
+        uint64_t b22 = rol(a32, 25);
+        uint64_t b30 = rol(a33, 21);
+        uint64_t b43 = rol(a34, 56);
+        uint64_t b03 = rol(a40, 27);
+        uint64_t b11 = rol(a41, 20);
+        uint64_t b24 = rol(a42, 39);
+        uint64_t b32 = rol(a43, 8);
+        uint64_t b40 = rol(a44, 14);
 
         /* chi step */
-        for (unsigned x = 0; x < 5; x++)
-            for (unsigned y = 0; y < 5; y++)
-                A[x][y] = u.B[x][y] ^ (u.B[(x+2)%5][y] & ~u.B[(x+1)%5][y]);
+        a00 = b00 ^ (b20 & ~b10); a01 = b01 ^ (b21 & ~b11);
+        a02 = b02 ^ (b22 & ~b12); a03 = b03 ^ (b23 & ~b13);
+        a04 = b04 ^ (b24 & ~b14); a10 = b10 ^ (b30 & ~b20);
+        a11 = b11 ^ (b31 & ~b21); a12 = b12 ^ (b32 & ~b22);
+        a13 = b13 ^ (b33 & ~b23); a14 = b14 ^ (b34 & ~b24);
+        a20 = b20 ^ (b40 & ~b30); a21 = b21 ^ (b41 & ~b31);
+        a22 = b22 ^ (b42 & ~b32); a23 = b23 ^ (b43 & ~b33);
+        a24 = b24 ^ (b44 & ~b34); a30 = b30 ^ (b00 & ~b40);
+        a31 = b31 ^ (b01 & ~b41); a32 = b32 ^ (b02 & ~b42);
+        a33 = b33 ^ (b03 & ~b43); a34 = b34 ^ (b04 & ~b44);
+        a40 = b40 ^ (b10 & ~b00); a41 = b41 ^ (b11 & ~b01);
+        a42 = b42 ^ (b12 & ~b02); a43 = b43 ^ (b13 & ~b03);
+        a44 = b44 ^ (b14 & ~b04);
 
         /* iota step */
-        A[0][0] ^= round_constants[round];
+        a00 ^= round_constants[round];
     }
 
-    smemclr(&u, sizeof(u));
+    A[0][0] = a00; A[0][1] = a01; A[0][2] = a02; A[0][3] = a03; A[0][4] = a04;
+    A[1][0] = a10; A[1][1] = a11; A[1][2] = a12; A[1][3] = a13; A[1][4] = a14;
+    A[2][0] = a20; A[2][1] = a21; A[2][2] = a22; A[2][3] = a23; A[2][4] = a24;
+    A[3][0] = a30; A[3][1] = a31; A[3][2] = a32; A[3][3] = a33; A[3][4] = a34;
+    A[4][0] = a40; A[4][1] = a41; A[4][2] = a42; A[4][3] = a43; A[4][4] = a44;
 }
 
 typedef struct {
@@ -104,6 +191,23 @@ static void keccak_accumulate(keccak_state *s, const void *vdata, size_t len)
     s->bytes_got += len;
 }
 
+/*
+ * Keccak padding function: add the message padding, which causes
+ * keccak_accumulate to fill the final block and run the transform on
+ * it, so that afterwards the state is ready to extract output from.
+ */
+static void keccak_pad(keccak_state *s)
+{
+    unsigned char padding[25*8];
+    size_t len = s->bytes_wanted - s->bytes_got;
+    if (len == 0)
+        len = s->bytes_wanted;
+    memset(padding, 0, len);
+    padding[0] |= s->first_pad_byte;
+    padding[len-1] |= 0x80;
+    keccak_accumulate(s, padding, len);
+}
+
 /*
  * Keccak output function.
  */
@@ -111,19 +215,7 @@ static void keccak_output(keccak_state *s, void *voutput)
 {
     unsigned char *output = (unsigned char *)voutput;
 
-    /*
-     * Add message padding.
-     */
-    {
-        unsigned char padding[25*8];
-        size_t len = s->bytes_wanted - s->bytes_got;
-        if (len == 0)
-            len = s->bytes_wanted;
-        memset(padding, 0, len);
-        padding[0] |= s->first_pad_byte;
-        padding[len-1] |= 0x80;
-        keccak_accumulate(s, padding, len);
-    }
+    keccak_pad(s);
 
     size_t n = 0;
     for (unsigned y = 0; y < 5; y++) {
@@ -206,7 +298,11 @@ static const uint64_t round_constants[24] = {
 
 /*
  * Keccak per-element rotation counts, generated from the matrix
- * formula in the Keccak reference by the following piece of Python:
+ * formula in the Keccak reference by the following piece of Python.
+ * These no longer appear as a run-time table, because
+ * keccak_transform's unrolled round body has them baked in as
+ * immediate operands, but this is where its generator's rot[]
+ * matrix comes from:
 
 coords = [1, 0]
 while len(coords) < 26:
@@ -218,17 +314,10 @@ matrix[0,0] = -1
 f = lambda t: (t+1) * (t+2) // 2 % 64
 
 for y in range(5):
-    print("    {{{}}},".format(", ".join("{:2d}".format(f(matrix[y,x]))
-                                         for x in range(5))))
+    print("rot[{}] = [{}]".format(y, ", ".join(
+        "{:2d}".format(f(matrix[y,x])) for x in range(5))))
 
 */
-static const unsigned rotation_counts[5][5] = {
-    { 0, 36,  3, 41, 18},
-    { 1, 44, 10, 45,  2},
-    {62,  6, 43, 15, 61},
-    {28, 55, 25, 21, 56},
-    {27, 20, 39,  8, 14},
-};
 
 /*
  * The PuTTY ssh_hashalg abstraction.
@@ -327,3 +416,62 @@ static void shake256_reset(ssh_hash *hash)
     }
 
 DEFINE_SHAKE(256, 114);
+
+/*
+ * Incremental SHAKE squeezing. The ssh_hashalg wrappers above can
+ * only deliver a fixed amount of output chosen when the vtable is
+ * defined, which is fine for Ed448 but not for uses of SHAKE as a
+ * general extendable-output function, where a caller wants to keep
+ * drawing key material until it has enough. This API absorbs the
+ * whole input up front and then lets the caller squeeze output in
+ * pieces of whatever size it likes, running the Keccak transform
+ * again each time the rate block is used up.
+ */
+struct ShakeXOF {
+    keccak_state state;
+    size_t next_output_byte;
+};
+
+static ShakeXOF *shake_xof_from_input(unsigned parambits, ptrlen data)
+{
+    ShakeXOF *sx = snew(ShakeXOF);
+    /* hashbits=0 because the hash_bytes field is only used by
+     * keccak_output, which this API never calls */
+    keccak_shake_init(&sx->state, parambits, 0);
+    keccak_accumulate(&sx->state, data.ptr, data.len);
+    keccak_pad(&sx->state);
+    sx->next_output_byte = 0;
+    return sx;
+}
+
+ShakeXOF *shake256_xof_from_input(ptrlen data)
+{
+    return shake_xof_from_input(256, data);
+}
+
+void shake_xof_read(ShakeXOF *sx, void *voutput, size_t size)
+{
+    unsigned char *output = (unsigned char *)voutput;
+    keccak_state *s = &sx->state;
+
+    while (size > 0) {
+        if (sx->next_output_byte == s->bytes_wanted) {
+            keccak_transform(s->A);
+            sx->next_output_byte = 0;
+        }
+
+        /* The lanes are extracted in the same order as
+         * keccak_output's loops: A[0][0], A[1][0], ..., A[0][1] */
+        size_t lane = sx->next_output_byte / 8;
+        uint64_t word = s->A[lane % 5][lane / 5];
+        *output++ = 0xFF & (word >> (8 * (sx->next_output_byte % 8)));
+        sx->next_output_byte++;
+        size--;
+    }
+}
+
+void shake_xof_free(ShakeXOF *sx)
+{
+    smemclr(sx, sizeof(*sx));
+    sfree(sx);
+}
@@ -0,0 +1,557 @@
+/*
+ * UMAC message authentication (RFC 4418), in the umac-64@openssh.com
+ * and umac-128@openssh.com flavours.
+ *
+ * UMAC is a Wegman-Carter MAC: the message is compressed by a
+ * universal hash function keyed from the MAC key, and the short
+ * result is encrypted with a pad derived (via AES) from the MAC key
+ * and a nonce. The universal hash has three layers:
+ *
+ *  - L1 'NH' hashing, which compresses each 1024-byte block of
+ *    message to 8 bytes using only 32-bit adds and 32x32->64-bit
+ *    multiplies. This layer touches every message byte and is where
+ *    nearly all the time goes; it vectorizes nicely, for which see
+ *    umac_nh() below.
+ *
+ *  - L2 polynomial hashing mod p64 = 2^64-59, which compresses the
+ *    stream of L1 outputs to a single 64-bit value. Only a 64th of
+ *    the message size passes through this layer.
+ *
+ *  - L3 inner-product hashing mod p36 = 2^36-5, which mixes the
+ *    result down to a 4-byte output.
+ *
+ * A tag wider than 4 bytes is made by running 'streams' instances of
+ * that hash in parallel with (partially) independent keys, so
+ * umac-64 runs two streams and umac-128 four.
+ *
+ * The nonce, in the OpenSSH instantiation of UMAC, is the packet
+ * sequence number as a 64-bit integer, which for us means four zero
+ * bytes followed by the 32-bit sequence number that the SSH-2 MAC
+ * convention writes as the first four bytes of each MAC'd string.
+ *
+ * One deliberate simplification, copied from OpenSSH's
+ * implementation: RFC 4418's L2 layer switches to a second
+ * polynomial mod 2^128-159 once a single message exceeds 16 Mb. SSH
+ * packets are five hundred times smaller than that limit, so like
+ * OpenSSH we don't implement the 128-bit stage at all.
+ */
+
+#include <assert.h>
+
+#include "ssh.h"
+
+#define UMAC_KEY_LEN 16          /* both flavours use an AES-128 key */
+#define L1_KEY_BYTES 1024        /* size of an NH block */
+#define L1_KEY_WORDS (L1_KEY_BYTES / 4)
+#define MAX_STREAMS 4            /* umac-128 runs four parallel hashes */
+
+#define P36 (((uint64_t)1 << 36) - 5)
+#define P64 ((uint64_t)0 - 59)
+
+struct umac_extra {
+    unsigned streams;            /* tag length / 4 */
+    const char *text_name;
+};
+
+typedef struct umac {
+    unsigned streams;
+
+    ssh_cipher *pdf_aes;         /* AES-128 keyed with KDF(K,0), for pads */
+
+    /*
+     * Derived hashing key material. The NH keys for the individual
+     * streams overlap, each stream's key starting 4 words after the
+     * previous one's (the 'Toeplitz' construction from RFC 4418).
+     */
+    uint32_t nh_key[L1_KEY_WORDS + 4 * (MAX_STREAMS-1)];
+    uint64_t poly_key[MAX_STREAMS];
+    uint64_t ip_key[MAX_STREAMS][4];
+    uint32_t ip_xor[MAX_STREAMS];
+
+    /*
+     * Cache of the most recent AES pad computation. Consecutive
+     * packet sequence numbers often map to the same AES input block
+     * (always, for umac-64, across each aligned pair of sequence
+     * numbers), so this halves the AES cost per packet.
+     */
+    bool pad_cache_valid;
+    unsigned char pad_cached_nonce[16];
+    unsigned char pad_cache[16];
+
+    /* Evolving state of one MAC computation. */
+    unsigned nonce_got;          /* how much of the 4-byte seq we've seen */
+    unsigned char nonce[16];
+    uint64_t msg_len;            /* total message bytes so far */
+    unsigned char block[L1_KEY_BYTES];
+    size_t block_used;
+    uint64_t poly_acc[MAX_STREAMS];
+
+    ssh2_mac mac;
+    BinarySink_IMPLEMENTATION;
+} umac;
+
+/*
+ * The key derivation function: AES in counter mode, with the counter
+ * block holding an 8-byte big-endian 'index' identifying which piece
+ * of key material is being generated, and an 8-byte block counter
+ * starting from 1.
+ *
+ * We have no single-block ECB interface to the ssh_cipher vtables,
+ * but CBC encryption of a single block with a zero IV is the same
+ * thing.
+ */
+static void umac_kdf(ssh_cipher *aes, unsigned index, void *vout, size_t len)
+{
+    static const unsigned char zero_iv[16] = {0};
+    unsigned char block[16];
+    unsigned char *out = (unsigned char *)vout;
+    uint64_t counter = 1;
+
+    while (len > 0) {
+        memset(block, 0, 16);
+        block[7] = index;
+        PUT_64BIT_MSB_FIRST(block + 8, counter);
+        counter++;
+
+        ssh_cipher_setiv(aes, zero_iv);
+        ssh_cipher_encrypt(aes, block, 16);
+
+        size_t chunk = len < 16 ? len : 16;
+        memcpy(out, block, chunk);
+        out += chunk;
+        len -= chunk;
+    }
+
+    smemclr(block, sizeof(block));
+}
+
+/*
+ * The L1 'NH' compression function for one stream: hash nbytes of
+ * message (a positive multiple of 32) with the key words starting at
+ * 'key'. Message bytes are interpreted as little-endian 32-bit
+ * words (the key words, by contrast, are big-endian: RFC 4418's
+ * L1-HASH endian-swaps the message but not the key, and the two
+ * swaps cancel on a little-endian machine); each group of eight
+ * words contributes four products
+ * (m[i]+k[i]) * (m[i+4]+k[i+4]), with 32-bit wraparound addition
+ * inside the products and 64-bit wraparound accumulation outside.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+static uint64_t umac_nh(const uint32_t *key, const unsigned char *m,
+                        size_t nbytes)
+{
+    /*
+     * Vector form: raw 128-bit loads give us four little-endian
+     * words per register (x86 is little-endian), and _mm_mul_epu32
+     * multiplies lanes 0 and 2 of each operand into two 64-bit
+     * products, so one shift-by-32 of both operands picks up the odd
+     * lanes and two accumulators take two products each.
+     */
+    __m128i acc_even = _mm_setzero_si128(), acc_odd = _mm_setzero_si128();
+
+    for (size_t i = 0; i < nbytes; i += 32) {
+        __m128i a = _mm_add_epi32(
+            _mm_loadu_si128((const __m128i *)(m + i)),
+            _mm_loadu_si128((const __m128i *)(key + i/4)));
+        __m128i b = _mm_add_epi32(
+            _mm_loadu_si128((const __m128i *)(m + i + 16)),
+            _mm_loadu_si128((const __m128i *)(key + i/4 + 4)));
+        acc_even = _mm_add_epi64(acc_even, _mm_mul_epu32(a, b));
+        acc_odd = _mm_add_epi64(
+            acc_odd, _mm_mul_epu32(_mm_srli_epi64(a, 32),
+                                   _mm_srli_epi64(b, 32)));
+    }
+
+    __m128i acc = _mm_add_epi64(acc_even, acc_odd);
+    union { __m128i v; uint64_t u[2]; } u;
+    u.v = acc;
+    uint64_t y = u.u[0] + u.u[1];
+    smemclr(&u, sizeof(u));
+    return y;
+}
+
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && \
+    !defined(__ARM_BIG_ENDIAN)
+
+#include <arm_neon.h>
+
+static uint64_t umac_nh(const uint32_t *key, const unsigned char *m,
+                        size_t nbytes)
+{
+    /*
+     * NEON form, on the same plan as the x86 one: vmull_u32 widens
+     * and multiplies a pair of 2x32 halves at a time.
+     */
+    uint64x2_t acc = vdupq_n_u64(0);
+
+    for (size_t i = 0; i < nbytes; i += 32) {
+        uint32x4_t a = vaddq_u32(
+            vreinterpretq_u32_u8(vld1q_u8(m + i)), vld1q_u32(key + i/4));
+        uint32x4_t b = vaddq_u32(
+            vreinterpretq_u32_u8(vld1q_u8(m + i + 16)),
+            vld1q_u32(key + i/4 + 4));
+        acc = vaddq_u64(acc, vmull_u32(vget_low_u32(a), vget_low_u32(b)));
+        acc = vaddq_u64(acc, vmull_u32(vget_high_u32(a), vget_high_u32(b)));
+    }
+
+    return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+}
+
+#else
+
+static uint64_t umac_nh(const uint32_t *key, const unsigned char *m,
+                        size_t nbytes)
+{
+    uint64_t y = 0;
+
+    for (size_t i = 0; i < nbytes; i += 32) {
+        for (unsigned j = 0; j < 4; j++) {
+            uint32_t lo = GET_32BIT_LSB_FIRST(m + i + 4*j) + key[i/4 + j];
+            uint32_t hi = GET_32BIT_LSB_FIRST(m + i + 16 + 4*j) +
+                key[i/4 + 4 + j];
+            y += (uint64_t)lo * hi;
+        }
+    }
+
+    return y;
+}
+
+#endif
+
+/*
+ * One step of the L2 polynomial hash: return key*acc + data mod p64,
+ * modulo a possible deferred multiple of 2^64 (i.e. the return value
+ * is only guaranteed congruent to the true residue, and in [0,2^64);
+ * the caller fully reduces at the end). The key is masked to 25 bits
+ * per 32-bit half, which is what keeps the partial products below
+ * from overflowing.
+ */
+static uint64_t umac_poly64_step(uint64_t acc, uint64_t key, uint64_t data)
+{
+    uint32_t key_hi = key >> 32, key_lo = key;
+    uint32_t acc_hi = acc >> 32, acc_lo = acc;
+
+    uint64_t cross = (uint64_t)key_hi * acc_lo + (uint64_t)acc_hi * key_lo;
+    uint32_t cross_hi = cross >> 32, cross_lo = cross;
+
+    /* 2^64 == 59 mod p64, so fold the high partial products down */
+    uint64_t y = ((uint64_t)key_hi * acc_hi + cross_hi) * 59 +
+        (uint64_t)key_lo * acc_lo;
+
+    uint64_t t = (uint64_t)cross_lo << 32;
+    y += t;
+    if (y < t)
+        y += 59;
+
+    y += data;
+    if (y < data)
+        y += 59;
+
+    return y;
+}
+
+/*
+ * Absorb one 64-bit L1 output into a stream's polynomial
+ * accumulator. Data words at or above 2^64 - 2^32 are outside the
+ * polynomial's permitted word range and are encoded as two words, a
+ * marker followed by the offending word reduced mod p64.
+ */
+static void umac_poly64_word(umac *ctx, unsigned stream, uint64_t data)
+{
+    if (data >= (uint64_t)0 - ((uint64_t)1 << 32)) {
+        ctx->poly_acc[stream] = umac_poly64_step(
+            ctx->poly_acc[stream], ctx->poly_key[stream], P64 - 1);
+        data -= 59;
+    }
+    ctx->poly_acc[stream] = umac_poly64_step(
+        ctx->poly_acc[stream], ctx->poly_key[stream], data);
+}
+
+/*
+ * The L3 layer for one stream: compress a 64-bit value to 32 bits
+ * via an inner product with four key words mod p36, then XOR with a
+ * last piece of key material.
+ */
+static uint32_t umac_l3(const umac *ctx, unsigned stream, uint64_t value)
+{
+    uint64_t y = 0;
+    for (unsigned i = 0; i < 4; i++)
+        y += (uint64_t)(uint16_t)(value >> (48 - 16*i)) *
+            ctx->ip_key[stream][i];
+
+    /* y < 4 * 2^16 * p36 < 2^54, so one fold brings it under 2*p36 */
+    y = (y & (((uint64_t)1 << 36) - 1)) + 5 * (y >> 36);
+    if (y >= P36)
+        y -= P36;
+
+    return (uint32_t)y ^ ctx->ip_xor[stream];
+}
+
+/*
+ * Hash one complete or padded NH block through L1 into the L2
+ * accumulators. 'used' is the number of real message bytes in the
+ * block, which the NH output has added to it (as a bit count); the
+ * caller has already zero-padded the block to 'padded' bytes, a
+ * multiple of 32.
+ */
+static void umac_hash_block(umac *ctx, size_t used, size_t padded)
+{
+    for (unsigned i = 0; i < ctx->streams; i++) {
+        uint64_t y = umac_nh(ctx->nh_key + 4*i, ctx->block, padded) +
+            8 * (uint64_t)used;
+        umac_poly64_word(ctx, i, y);
+    }
+}
+
+static void umac_bs_write(BinarySink *bs, const void *vp, size_t len);
+
+static ssh2_mac *umac_new(const ssh2_macalg *alg, ssh_cipher *cipher)
+{
+    const struct umac_extra *extra = (const struct umac_extra *)alg->extra;
+    umac *ctx = snew(umac);
+    memset(ctx, 0, sizeof(umac));
+
+    ctx->streams = extra->streams;
+    ctx->pdf_aes = ssh_cipher_new(&ssh_aes128_cbc);
+    ctx->mac.vt = alg;
+    BinarySink_INIT(ctx, umac_bs_write);
+    BinarySink_DELEGATE_INIT(&ctx->mac, ctx);
+    return &ctx->mac;
+}
+
+static void umac_free(ssh2_mac *mac)
+{
+    umac *ctx = container_of(mac, umac, mac);
+    ssh_cipher_free(ctx->pdf_aes);
+    smemclr(ctx, sizeof(umac));
+    sfree(ctx);
+}
+
+static void umac_setkey(ssh2_mac *mac, ptrlen key)
+{
+    umac *ctx = container_of(mac, umac, mac);
+    unsigned char keymaterial[MAX_STREAMS * 64];
+
+    assert(key.len == UMAC_KEY_LEN);
+
+    /* A temporary AES instance keyed with the MAC key itself, used
+     * only to run the KDF during this function */
+    ssh_cipher *kdf_aes = ssh_cipher_new(&ssh_aes128_cbc);
+    ssh_cipher_setkey(kdf_aes, key.ptr);
+
+    /* Index 0: the pad derivation key, which we keep in AES-expanded
+     * form for the lifetime of the MAC */
+    umac_kdf(kdf_aes, 0, keymaterial, 16);
+    ssh_cipher_setkey(ctx->pdf_aes, keymaterial);
+    ctx->pad_cache_valid = false;
+
+    /* Index 1: the NH keys, as big-endian words (see umac_nh) */
+    {
+        unsigned char nh[sizeof(ctx->nh_key)];
+        umac_kdf(kdf_aes, 1, nh, L1_KEY_BYTES + 16 * (ctx->streams-1));
+        for (size_t i = 0; i < L1_KEY_WORDS + 4 * (ctx->streams-1); i++)
+            ctx->nh_key[i] = GET_32BIT_MSB_FIRST(nh + 4*i);
+        smemclr(nh, sizeof(nh));
+    }
+
+    /* Index 2: the polynomial keys, masked so that
+     * umac_poly64_step's partial products can't overflow. Each
+     * stream's 24 bytes of key material also include 16 bytes for
+     * the 128-bit polynomial stage we don't implement. */
+    umac_kdf(kdf_aes, 2, keymaterial, ctx->streams * 24);
+    for (unsigned i = 0; i < ctx->streams; i++)
+        ctx->poly_key[i] = GET_64BIT_MSB_FIRST(keymaterial + 24*i) &
+            UINT64_C(0x01ffffff01ffffff);
+
+    /* Index 3: the L3 inner-product keys, mod p36. RFC 4418 derives
+     * eight words per stream, but the first four are only ever
+     * multiplied by the output of the absent 128-bit polynomial
+     * stage, so we keep just the last four. */
+    umac_kdf(kdf_aes, 3, keymaterial, ctx->streams * 64);
+    for (unsigned i = 0; i < ctx->streams; i++)
+        for (unsigned j = 0; j < 4; j++)
+            ctx->ip_key[i][j] =
+                GET_64BIT_MSB_FIRST(keymaterial + 64*i + 8*(4+j)) % P36;
+
+    /* Index 4: the final XOR masks */
+    umac_kdf(kdf_aes, 4, keymaterial, ctx->streams * 4);
+    for (unsigned i = 0; i < ctx->streams; i++)
+        ctx->ip_xor[i] = GET_32BIT_MSB_FIRST(keymaterial + 4*i);
+
+    ssh_cipher_free(kdf_aes);
+    smemclr(keymaterial, sizeof(keymaterial));
+}
+
+static void umac_start(ssh2_mac *mac)
+{
+    umac *ctx = container_of(mac, umac, mac);
+
+    ctx->nonce_got = 0;
+    ctx->msg_len = 0;
+    ctx->block_used = 0;
+    for (unsigned i = 0; i < ctx->streams; i++)
+        ctx->poly_acc[i] = 1;          /* polynomial evaluation starts at 1 */
+}
+
+static void umac_bs_write(BinarySink *bs, const void *vp, size_t len)
+{
+    umac *ctx = BinarySink_DOWNCAST(bs, umac);
+    const unsigned char *p = (const unsigned char *)vp;
+
+    /*
+     * The SSH-2 MAC convention writes the packet sequence number as
+     * the first four bytes of each MAC'd string. For UMAC that isn't
+     * part of the message at all: it becomes the low half of the
+     * 64-bit nonce.
+     */
+    while (ctx->nonce_got < 4 && len > 0) {
+        ctx->nonce[4 + ctx->nonce_got++] = *p++;
+        len--;
+    }
+
+    while (len > 0) {
+        if (ctx->block_used == L1_KEY_BYTES) {
+            /* Flush a full block, now that we know it isn't the
+             * final one */
+            umac_hash_block(ctx, L1_KEY_BYTES, L1_KEY_BYTES);
+            ctx->block_used = 0;
+        }
+
+        size_t chunk = L1_KEY_BYTES - ctx->block_used;
+        if (chunk > len)
+            chunk = len;
+        memcpy(ctx->block + ctx->block_used, p, chunk);
+        ctx->block_used += chunk;
+        ctx->msg_len += chunk;
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+static void umac_genresult(ssh2_mac *mac, unsigned char *out)
+{
+    umac *ctx = container_of(mac, umac, mac);
+    unsigned taglen = 4 * ctx->streams;
+    unsigned char nonce[16], pad[16];
+
+    /*
+     * Generating a result must leave the state reusable, because the
+     * CBC wait-for-a-valid-MAC defence in ssh2_bpp_handle_input
+     * checks the MAC repeatedly over a growing prefix of the packet.
+     * So all the finalisation here works on copies.
+     */
+    uint64_t hashed[MAX_STREAMS];
+
+    if (ctx->msg_len <= L1_KEY_BYTES) {
+        /*
+         * Short messages never reach the polynomial layer: the
+         * single (possibly partial, possibly empty) block's NH
+         * output goes straight to L3. An empty message still hashes
+         * one 32-byte group of zeroes, but with zero added length.
+         */
+        size_t padded = (ctx->block_used + 31) & ~(size_t)31;
+        if (padded == 0)
+            padded = 32;
+        memset(ctx->block + ctx->block_used, 0, padded - ctx->block_used);
+        for (unsigned i = 0; i < ctx->streams; i++)
+            hashed[i] = umac_nh(ctx->nh_key + 4*i, ctx->block, padded) +
+                8 * ctx->msg_len;
+    } else {
+        /*
+         * Long messages: absorb the final block (between 1 and 1024
+         * bytes, since blocks are only flushed when more data
+         * follows them) into copies of the polynomial accumulators,
+         * and fully reduce mod p64.
+         */
+        uint64_t poly_save[MAX_STREAMS];
+        memcpy(poly_save, ctx->poly_acc, sizeof(poly_save));
+        size_t used = ctx->block_used;
+        size_t padded = (used + 31) & ~(size_t)31;
+        memset(ctx->block + used, 0, padded - used);
+        umac_hash_block(ctx, used, padded);
+        for (unsigned i = 0; i < ctx->streams; i++) {
+            hashed[i] = ctx->poly_acc[i];
+            if (hashed[i] >= P64)
+                hashed[i] -= P64;
+        }
+        memcpy(ctx->poly_acc, poly_save, sizeof(poly_save));
+        ctx->block_used = used;
+        smemclr(poly_save, sizeof(poly_save));
+    }
+
+    /*
+     * Derive the pad from the nonce. The high bits of the nonce
+     * select a slice of the AES output block, and are masked off
+     * before encryption, so that (for umac-64) adjacent sequence
+     * numbers reuse one AES computation via the cache.
+     */
+    memset(nonce, 0, sizeof(nonce));
+    memcpy(nonce, ctx->nonce, 8);
+    unsigned slice = 0;
+    if (taglen < 16) {
+        slice = nonce[7] % (16 / taglen);
+        nonce[7] -= slice;
+    }
+
+    if (!ctx->pad_cache_valid ||
+        memcmp(nonce, ctx->pad_cached_nonce, 16) != 0) {
+        static const unsigned char zero_iv[16] = {0};
+        memcpy(ctx->pad_cache, nonce, 16);
+        ssh_cipher_setiv(ctx->pdf_aes, zero_iv);
+        ssh_cipher_encrypt(ctx->pdf_aes, ctx->pad_cache, 16);
+        memcpy(ctx->pad_cached_nonce, nonce, 16);
+        ctx->pad_cache_valid = true;
+    }
+    memcpy(pad, ctx->pad_cache + slice * taglen, taglen);
+
+    for (unsigned i = 0; i < ctx->streams; i++)
+        PUT_32BIT_MSB_FIRST(out + 4*i,
+                            umac_l3(ctx, i, hashed[i]) ^
+                            GET_32BIT_MSB_FIRST(pad + 4*i));
+
+    smemclr(hashed, sizeof(hashed));
+    smemclr(nonce, sizeof(nonce));
+    smemclr(pad, sizeof(pad));
+}
+
+static const char *umac_text_name(ssh2_mac *mac)
+{
+    const struct umac_extra *extra =
+        (const struct umac_extra *)mac->vt->extra;
+    return extra->text_name;
+}
+
+static const struct umac_extra ssh2_umac64_extra = { 2, "UMAC-64" };
+const ssh2_macalg ssh2_umac64 = {
+    .new = umac_new,
+    .free = umac_free,
+    .setkey = umac_setkey,
+    .start = umac_start,
+    .genresult = umac_genresult,
+    .text_name = umac_text_name,
+    .name = "umac-64@openssh.com",
+    .etm_name = "umac-64-etm@openssh.com",
+    .len = 8,
+    .keylen = 16,
+    .extra = &ssh2_umac64_extra,
+};
+
+static const struct umac_extra ssh2_umac128_extra = { 4, "UMAC-128" };
+const ssh2_macalg ssh2_umac128 = {
+    .new = umac_new,
+    .free = umac_free,
+    .setkey = umac_setkey,
+    .start = umac_start,
+    .genresult = umac_genresult,
+    .text_name = umac_text_name,
+    .name = "umac-128@openssh.com",
+    .etm_name = "umac-128-etm@openssh.com",
+    .len = 16,
+    .keylen = 16,
+    .extra = &ssh2_umac128_extra,
+};
@@ -0,0 +1,564 @@
+/*
+ * cryptobench.c: measure the speed of PuTTY's crypto primitives.
+ *
+ * Times every cipher, MAC, hash and kex primitive we ship, across a
+ * range of message sizes, and prints the results in a fixed column
+ * layout so that runs on different machines (or different builds on
+ * the same machine) can be diffed or fed to a script. The hardware
+ * and software implementations are listed separately as well as via
+ * their runtime-selecting top-level vtables, so this also checks
+ * that the selectors are picking the fastest backend available on
+ * the machine under test.
+ *
+ * testcrypt.c answers 'is it right?' and testsc.c answers 'is it
+ * constant-time?'; this program answers 'is it fast?'.
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "putty.h"
+#include "ssh.h"
+#include "mpint.h"
+
+/* stub needed to link sshpubk.c; we never load old-format key files */
+void old_keyfile_warning(void) {}
+
+void modalfatalbox(const char *p, ...)
+{
+    va_list ap;
+    fprintf(stderr, "FATAL ERROR: ");
+    va_start(ap, p);
+    vfprintf(stderr, p, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Deterministic substitute for the real random number generator, in
+ * the same style as testsc.c: key and input data are derived from a
+ * hash of a fixed seed, so that every run benchmarks exactly the
+ * same computation. This also satisfies mp_random_bits() and
+ * friends, which the DH and ECDH key generation paths call.
+ */
+static uint64_t random_counter = 0;
+static const char *random_seedstr = "cryptobench";
+static uint8_t random_buf[MAX_HASH_LEN];
+static size_t random_buf_limit = 0;
+static ssh_hash *random_hash;
+
+void random_read(void *vbuf, size_t size)
+{
+    uint8_t *buf = (uint8_t *)vbuf;
+    while (size-- > 0) {
+        if (random_buf_limit == 0) {
+            ssh_hash_reset(random_hash);
+            put_asciz(random_hash, random_seedstr);
+            put_uint64(random_hash, random_counter);
+            random_counter++;
+            random_buf_limit = ssh_hash_alg(random_hash)->hlen;
+            ssh_hash_digest(random_hash, random_buf);
+        }
+        *buf++ = random_buf[random_buf_limit--];
+    }
+}
+
+/*
+ * Core timing loop: run the operation repeatedly, doubling the
+ * iteration count until one batch takes long enough to time
+ * reliably, and return the cost of a single operation in seconds.
+ */
+static double time_op(void (*op)(void *ctx), void *ctx)
+{
+    unsigned iters = 1;
+    while (1) {
+        double t0 = now();
+        for (unsigned i = 0; i < iters; i++)
+            op(ctx);
+        double elapsed = now() - t0;
+        if (elapsed > 0.1)
+            return elapsed / iters;
+        iters *= 2;
+    }
+}
+
+/*
+ * Result lines. Throughput benchmarks print both MB/s (decimal
+ * megabytes, for easy comparison with link speeds) and ops/s;
+ * latency benchmarks like kex just print ops/s.
+ */
+static void report_throughput(const char *class, const char *name,
+                              const char *direction, size_t msgsize,
+                              double secs_per_op)
+{
+    printf("%-7s %-28s %-4s %6"SIZEu" B %10.2f MB/s %12.0f ops/s\n",
+           class, name, direction, msgsize,
+           msgsize / secs_per_op / 1e6, 1.0 / secs_per_op);
+}
+
+static void report_latency(const char *class, const char *name,
+                           double secs_per_op)
+{
+    printf("%-7s %-28s %31.2f ms/op %8.1f ops/s\n",
+           class, name, secs_per_op * 1e3, 1.0 / secs_per_op);
+}
+
+static void report_skipped(const char *class, const char *name)
+{
+    printf("%-7s %-28s skipped (not supported on this machine)\n",
+           class, name);
+}
+
+static const size_t msgsizes[] = { 16, 256, 4096, 65536 };
+#define MAX_MSGSIZE 65536
+
+/* ----------------------------------------------------------------------
+ * Ciphers. Where a cipher demands a particular MAC (ChaCha20-Poly1305,
+ * AES-GCM), the MAC is created alongside it as the BPP would, so its
+ * keystream setup is included; its per-message cost shows up in the
+ * MAC benchmarks below.
+ */
+
+struct cipher_ctx {
+    ssh_cipher *c;
+    uint8_t *data;
+    size_t len;
+    bool decrypt;
+};
+
+static void cipher_op(void *vctx)
+{
+    struct cipher_ctx *ctx = (struct cipher_ctx *)vctx;
+    if (ctx->decrypt)
+        ssh_cipher_decrypt(ctx->c, ctx->data, ctx->len);
+    else
+        ssh_cipher_encrypt(ctx->c, ctx->data, ctx->len);
+}
+
+static void bench_cipher(const ssh_cipheralg *calg, const char *name)
+{
+    ssh_cipher *c = ssh_cipher_new(calg);
+    if (!c) {
+        report_skipped("cipher", name);
+        return;
+    }
+
+    ssh2_mac *m = NULL;
+    if (calg->required_mac) {
+        m = ssh2_mac_new(calg->required_mac, c);
+        if (!m) {
+            ssh_cipher_free(c);
+            report_skipped("cipher", name);
+            return;
+        }
+    }
+
+    struct cipher_ctx ctx;
+    uint8_t *key = snewn(calg->padded_keybytes, uint8_t);
+    uint8_t *iv = snewn(calg->blksize ? calg->blksize : 8, uint8_t);
+    ctx.c = c;
+    ctx.data = snewn(MAX_MSGSIZE, uint8_t);
+
+    random_read(key, calg->padded_keybytes);
+    random_read(ctx.data, MAX_MSGSIZE);
+    ssh_cipher_setkey(c, key);
+    if (calg->blksize) {
+        random_read(iv, calg->blksize);
+        ssh_cipher_setiv(c, iv);
+    }
+
+    for (size_t i = 0; i < lenof(msgsizes); i++) {
+        ctx.len = msgsizes[i];
+        ctx.decrypt = false;
+        report_throughput("cipher", name, "enc", ctx.len,
+                          time_op(cipher_op, &ctx));
+        ctx.decrypt = true;
+        report_throughput("cipher", name, "dec", ctx.len,
+                          time_op(cipher_op, &ctx));
+    }
+
+    if (m)
+        ssh2_mac_free(m);
+    ssh_cipher_free(c);
+    sfree(ctx.data);
+    sfree(key);
+    sfree(iv);
+}
+
+/* ----------------------------------------------------------------------
+ * MACs. The HMAC family works standalone; Poly1305 and the GCM MAC
+ * are keyed from their cipher's keystream, so those are benchmarked
+ * attached to a cipher instance.
+ */
+
+struct mac_ctx {
+    ssh2_mac *m;
+    uint8_t *data;
+    size_t len;
+    unsigned long seq;
+};
+
+static void mac_op(void *vctx)
+{
+    struct mac_ctx *ctx = (struct mac_ctx *)vctx;
+    ssh2_mac_generate(ctx->m, ctx->data, ctx->len, ctx->seq++);
+}
+
+static void bench_mac_instance(ssh2_mac *m, const ssh2_macalg *malg,
+                               const char *name)
+{
+    struct mac_ctx ctx;
+    ctx.m = m;
+    ctx.data = snewn(MAX_MSGSIZE + malg->len, uint8_t);
+    ctx.seq = 0;
+    random_read(ctx.data, MAX_MSGSIZE);
+
+    if (malg->keylen) {
+        uint8_t *key = snewn(malg->keylen, uint8_t);
+        random_read(key, malg->keylen);
+        ssh2_mac_setkey(m, make_ptrlen(key, malg->keylen));
+        sfree(key);
+    }
+
+    for (size_t i = 0; i < lenof(msgsizes); i++) {
+        ctx.len = msgsizes[i];
+        report_throughput("mac", name, "gen", ctx.len,
+                          time_op(mac_op, &ctx));
+    }
+
+    sfree(ctx.data);
+}
+
+static void bench_mac(const ssh2_macalg *malg, const char *name)
+{
+    ssh2_mac *m = ssh2_mac_new(malg, NULL);
+    if (!m) {
+        report_skipped("mac", name);
+        return;
+    }
+    bench_mac_instance(m, malg, name);
+    ssh2_mac_free(m);
+}
+
+static void bench_mac_with_cipher(const ssh2_macalg *malg,
+                                  const ssh_cipheralg *calg,
+                                  const char *name)
+{
+    ssh_cipher *c = ssh_cipher_new(calg);
+    if (!c) {
+        report_skipped("mac", name);
+        return;
+    }
+    ssh2_mac *m = ssh2_mac_new(malg, c);
+    if (!m) {
+        ssh_cipher_free(c);
+        report_skipped("mac", name);
+        return;
+    }
+
+    uint8_t *key = snewn(calg->padded_keybytes, uint8_t);
+    uint8_t *iv = snewn(calg->blksize ? calg->blksize : 8, uint8_t);
+    random_read(key, calg->padded_keybytes);
+    ssh_cipher_setkey(c, key);
+    if (calg->blksize) {
+        random_read(iv, calg->blksize);
+        ssh_cipher_setiv(c, iv);
+    }
+
+    bench_mac_instance(m, malg, name);
+
+    ssh2_mac_free(m);
+    ssh_cipher_free(c);
+    sfree(key);
+    sfree(iv);
+}
+
+/* ----------------------------------------------------------------------
+ * Hashes. Each operation is a full reset + data + digest cycle, i.e.
+ * what one exchange-hash or MAC-key computation costs.
+ */
+
+struct hash_ctx {
+    ssh_hash *h;
+    uint8_t *data;
+    size_t len;
+    unsigned char digest[MAX_HASH_LEN];
+};
+
+static void hash_op(void *vctx)
+{
+    struct hash_ctx *ctx = (struct hash_ctx *)vctx;
+    ssh_hash_reset(ctx->h);
+    put_data(ctx->h, ctx->data, ctx->len);
+    ssh_hash_digest(ctx->h, ctx->digest);
+}
+
+static void bench_hash(const ssh_hashalg *halg, const char *name)
+{
+    ssh_hash *h = ssh_hash_new(halg);
+    if (!h) {
+        report_skipped("hash", name);
+        return;
+    }
+
+    struct hash_ctx ctx;
+    ctx.h = h;
+    ctx.data = snewn(MAX_MSGSIZE, uint8_t);
+    random_read(ctx.data, MAX_MSGSIZE);
+
+    for (size_t i = 0; i < lenof(msgsizes); i++) {
+        ctx.len = msgsizes[i];
+        report_throughput("hash", name, "hash", ctx.len,
+                          time_op(hash_op, &ctx));
+    }
+
+    ssh_hash_free(h);
+    sfree(ctx.data);
+}
+
+/* ----------------------------------------------------------------------
+ * Key exchange. Each operation is the whole client-side asymmetric
+ * part of one exchange: for DH, generating x and e and computing the
+ * shared secret; for ECDH, generating a key pair and multiplying the
+ * peer's public point by our scalar. RSA kex and GEX are omitted,
+ * since their cost is dominated by the server's key or group
+ * generation rather than anything we compute.
+ */
+
+struct dh_kex_ctx {
+    const ssh_kex *kex;
+};
+
+static void dh_kex_op(void *vctx)
+{
+    struct dh_kex_ctx *ctx = (struct dh_kex_ctx *)vctx;
+    dh_ctx *dh = dh_setup_group(ctx->kex);
+    mp_int *e = dh_create_e(dh, 512);
+    mp_int *K = dh_find_K(dh, e);
+    mp_free(K);
+    dh_cleanup(dh);
+}
+
+struct ecdh_kex_ctx {
+    const ssh_kex *kex;
+    ptrlen remote_pub;
+};
+
+static void ecdh_kex_op(void *vctx)
+{
+    struct ecdh_kex_ctx *ctx = (struct ecdh_kex_ctx *)vctx;
+    ecdh_key *key = ssh_ecdhkex_newkey(ctx->kex);
+    mp_int *K = ssh_ecdhkex_getkey(key, ctx->remote_pub);
+    mp_free(K);
+    ssh_ecdhkex_freekey(key);
+}
+
+static void bench_kex(const ssh_kex *kex)
+{
+    if (kex->main_type == KEXTYPE_DH) {
+        if (dh_is_gex(kex))
+            return;
+        struct dh_kex_ctx ctx;
+        ctx.kex = kex;
+        report_latency("kex", kex->name, time_op(dh_kex_op, &ctx));
+    } else if (kex->main_type == KEXTYPE_ECDH) {
+        /* Make a 'peer' public value for the shared-secret step */
+        struct ecdh_kex_ctx ctx;
+        ecdh_key *peer = ssh_ecdhkex_newkey(kex);
+        strbuf *pub = strbuf_new();
+        ssh_ecdhkex_getpublic(peer, BinarySink_UPCAST(pub));
+        ctx.kex = kex;
+        ctx.remote_pub = ptrlen_from_strbuf(pub);
+        report_latency("kex", kex->name, time_op(ecdh_kex_op, &ctx));
+        strbuf_free(pub);
+        ssh_ecdhkex_freekey(peer);
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Tables of things to benchmark, in the same X-macro style as
+ * testsc.c, so that hardware-specific implementations appear only in
+ * builds that compiled them in. The selector vtables (e.g. plain
+ * ssh_aes256_sdctr) are included alongside their _sw/_ni/_neon
+ * backends: the selector's numbers should match its fastest backend.
+ */
+
+#if HAVE_AES_NI
+#define CIPHERS_AES_NI(X)                       \
+    X(ssh_aes256_sdctr_ni)                      \
+    X(ssh_aes256_cbc_ni)                        \
+    X(ssh_aes128_sdctr_ni)                      \
+    X(ssh_aes128_cbc_ni)                        \
+    /* end of list */
+#else
+#define CIPHERS_AES_NI(X)
+#endif
+#if HAVE_AES_VAES
+#define CIPHERS_AES_VAES(X)                     \
+    X(ssh_aes256_sdctr_vaes)                    \
+    X(ssh_aes128_sdctr_vaes)                    \
+    /* end of list */
+#else
+#define CIPHERS_AES_VAES(X)
+#endif
+#if HAVE_NEON_CRYPTO
+#define CIPHERS_AES_NEON(X)                     \
+    X(ssh_aes256_sdctr_neon)                    \
+    X(ssh_aes256_cbc_neon)                      \
+    X(ssh_aes128_sdctr_neon)                    \
+    X(ssh_aes128_cbc_neon)                      \
+    /* end of list */
+#else
+#define CIPHERS_AES_NEON(X)
+#endif
+
+#define CIPHERS(X)                              \
+    X(ssh_aes256_sdctr)                         \
+    X(ssh_aes256_cbc)                           \
+    X(ssh_aes128_sdctr)                         \
+    X(ssh_aes128_cbc)                           \
+    X(ssh_aes256_sdctr_sw)                      \
+    X(ssh_aes256_cbc_sw)                        \
+    X(ssh_aes128_sdctr_sw)                      \
+    X(ssh_aes128_cbc_sw)                        \
+    CIPHERS_AES_NI(X)                           \
+    CIPHERS_AES_VAES(X)                         \
+    CIPHERS_AES_NEON(X)                         \
+    X(ssh_aes256_gcm)                           \
+    X(ssh_aes128_gcm)                           \
+    X(ssh2_chacha20_poly1305)                   \
+    X(ssh_3des_ssh2_ctr)                        \
+    X(ssh_3des_ssh2)                            \
+    X(ssh_blowfish_ssh2_ctr)                    \
+    X(ssh_blowfish_ssh2)                        \
+    X(ssh_arcfour256_ssh2)                      \
+    X(ssh_arcfour128_ssh2)                      \
+    /* end of list */
+
+#define MACS(X)                                 \
+    X(ssh_hmac_md5)                             \
+    X(ssh_hmac_sha1)                            \
+    X(ssh_hmac_sha1_96)                         \
+    X(ssh_hmac_sha256)                          \
+    /* end of list */
+
+#if HAVE_SHA_NI
+#define HASHES_SHA_NI(X) X(ssh_sha256_ni) X(ssh_sha1_ni)
+#else
+#define HASHES_SHA_NI(X)
+#endif
+#if HAVE_NEON_CRYPTO
+#define HASHES_SHA_NEON(X) X(ssh_sha256_neon) X(ssh_sha1_neon)
+#else
+#define HASHES_SHA_NEON(X)
+#endif
+#if HAVE_NEON_SHA512
+#define HASHES_SHA512_NEON(X) X(ssh_sha384_neon) X(ssh_sha512_neon)
+#else
+#define HASHES_SHA512_NEON(X)
+#endif
+#if HAVE_SHA512_AVX2
+#define HASHES_SHA512_AVX2(X) X(ssh_sha384_avx2) X(ssh_sha512_avx2)
+#else
+#define HASHES_SHA512_AVX2(X)
+#endif
+
+#define HASHES(X)                               \
+    X(ssh_md5)                                  \
+    X(ssh_sha1)                                 \
+    X(ssh_sha1_sw)                              \
+    X(ssh_sha256)                               \
+    X(ssh_sha256_sw)                            \
+    X(ssh_sha384)                               \
+    X(ssh_sha512)                               \
+    X(ssh_sha384_sw)                            \
+    X(ssh_sha512_sw)                            \
+    HASHES_SHA_NI(X)                            \
+    HASHES_SHA_NEON(X)                          \
+    HASHES_SHA512_NEON(X)                       \
+    HASHES_SHA512_AVX2(X)                       \
+    X(ssh_sha3_256)                             \
+    X(ssh_sha3_512)                             \
+    X(ssh_blake2b)                              \
+    /* end of list */
+
+static const ssh_kexes *const kex_families[] = {
+    &ssh_ecdh_kex,
+    &ssh_diffiehellman_group14,
+    &ssh_diffiehellman_group1,
+};
+
+/* ---------------------------------------------------------------------- */
+
+static bool selected(int nfilters, char **filters, const char *name)
+{
+    if (nfilters == 0)
+        return true;
+    for (int i = 0; i < nfilters; i++)
+        if (strstr(name, filters[i]))
+            return true;
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int nfilters = argc - 1;
+    char **filters = argv + 1;
+
+    if (nfilters == 1 && (!strcmp(filters[0], "--help") ||
+                          !strcmp(filters[0], "-h"))) {
+        printf("usage: cryptobench [NAME-SUBSTRING...]\n"
+               "Benchmarks every primitive whose name contains any of the\n"
+               "given substrings, or everything if none are given.\n");
+        return 0;
+    }
+
+    random_hash = ssh_hash_new(&ssh_sha256);
+
+    #define BENCH_CIPHER(alg)                                   \
+        if (selected(nfilters, filters, #alg))                  \
+            bench_cipher(&alg, #alg);
+    CIPHERS(BENCH_CIPHER)
+    #undef BENCH_CIPHER
+
+    #define BENCH_MAC(alg)                                      \
+        if (selected(nfilters, filters, #alg))                  \
+            bench_mac(&alg, #alg);
+    MACS(BENCH_MAC)
+    #undef BENCH_MAC
+
+    if (selected(nfilters, filters, "ssh2_poly1305"))
+        bench_mac_with_cipher(&ssh2_poly1305, &ssh2_chacha20_poly1305,
+                              "ssh2_poly1305");
+    if (selected(nfilters, filters, "ssh2_aesgcm_mac"))
+        bench_mac_with_cipher(&ssh2_aesgcm_mac, &ssh_aes256_gcm,
+                              "ssh2_aesgcm_mac");
+
+    #define BENCH_HASH(alg)                                     \
+        if (selected(nfilters, filters, #alg))                  \
+            bench_hash(&alg, #alg);
+    HASHES(BENCH_HASH)
+    #undef BENCH_HASH
+
+    for (size_t i = 0; i < lenof(kex_families); i++) {
+        const ssh_kexes *family = kex_families[i];
+        for (size_t j = 0; j < family->nkexes; j++)
+            if (selected(nfilters, filters, family->list[j]->name))
+                bench_kex(family->list[j]);
+    }
+
+    ssh_hash_free(random_hash);
+    return 0;
+}
@@ -120,10 +120,13 @@ typedef struct MontyContext MontyContext;
 
 typedef struct WeierstrassCurve WeierstrassCurve;
 typedef struct WeierstrassPoint WeierstrassPoint;
+typedef struct WeierstrassFixedBase WeierstrassFixedBase;
 typedef struct MontgomeryCurve MontgomeryCurve;
 typedef struct MontgomeryPoint MontgomeryPoint;
 typedef struct EdwardsCurve EdwardsCurve;
 typedef struct EdwardsPoint EdwardsPoint;
+typedef struct EdwardsFixedBase EdwardsFixedBase;
+typedef struct ShakeXOF ShakeXOF;
 
 typedef struct SshServerConfig SshServerConfig;
 typedef struct SftpServer SftpServer;
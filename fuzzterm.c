@@ -76,6 +76,8 @@ static void fuzz_set_cursor_pos(TermWin *tw, int x, int y) {}
 static void fuzz_set_raw_mouse_mode(TermWin *tw, bool enable) {}
 static void fuzz_set_scrollbar(TermWin *tw, int total, int start, int page) {}
 static void fuzz_bell(TermWin *tw, int mode) {}
+static bool fuzz_draw_scroll(
+    TermWin *tw, int topline, int botline, int lines) { return false; }
 static void fuzz_clip_write(
     TermWin *tw, int clipboard, wchar_t *text, int *attrs,
     truecolour *colours, int len, bool must_deselect) {}
@@ -97,6 +99,7 @@ static const TermWinVtable fuzz_termwin_vt = {
     .draw_text = fuzz_draw_text,
     .draw_cursor = fuzz_draw_cursor,
     .draw_trust_sigil = fuzz_draw_trust_sigil,
+    .draw_scroll = fuzz_draw_scroll,
     .char_width = fuzz_char_width,
     .free_draw_ctx = fuzz_free_draw_ctx,
     .set_cursor_pos = fuzz_set_cursor_pos,
@@ -119,6 +122,7 @@ static const TermWinVtable fuzz_termwin_vt = {
 
 void ldisc_send(Ldisc *ldisc, const void *buf, int len, bool interactive) {}
 void ldisc_echoedit_update(Ldisc *ldisc) {}
+size_t ldisc_sendbuffer(Ldisc *ldisc) { return 0; }
 bool ldisc_has_input_buffered(Ldisc *ldisc) { return false; }
 LdiscInputToken ldisc_get_input_token(Ldisc *ldisc)
 { unreachable("This fake ldisc never has any buffered input"); }
@@ -32,6 +32,9 @@ int eddsa_generate(struct eddsa_key *ek, int bits)
     ek->privateKey = mp_random_bits(bits);
 
     ek->publicKey = eddsa_public(ek->privateKey, ek->sshk.vt);
+    ek->pkfb = NULL;
+    ek->sign_exponent = NULL;
+    ek->sign_nonce_seed = NULL;
 
     return 1;
 }
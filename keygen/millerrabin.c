@@ -137,16 +137,29 @@ void miller_rabin_free(MillerRabin *mr)
 }
 
 /*
- * The main internal function that implements a single M-R test.
+ * The main internal function that implements the M-R test, for any
+ * number of witnesses at once against the same candidate.
  *
- * Expects the witness integer to be in Montgomery representation.
+ * All the witnesses' exponentiation ladders use the same exponent
+ * p-1, so running them together through a single pass over its bits
+ * shares the per-bit bookkeeping between them, and adjacent ladders'
+ * multiplications are independent of each other, which gives the CPU
+ * some instruction-level parallelism that a single strictly serial
+ * square-and-multiply chain can't.
+ *
+ * Expects the witness integers to be in Montgomery representation.
  * (Since in live use witnesses are invented at random, this imposes
  * no extra cost on the callers, and saves effort in here.)
  */
-static struct mr_result miller_rabin_test_inner(MillerRabin *mr, mp_int *mw)
+static void miller_rabin_test_inner_multi(
+    MillerRabin *mr, mp_int **mw, size_t nw, struct mr_result *results)
 {
-    mp_int *acc = mp_copy(monty_identity(mr->mc));
-    mp_int *spare = mp_new(mp_max_bits(mr->pm1));
+    mp_int **acc = snewn(nw, mp_int *);
+    mp_int **spare = snewn(nw, mp_int *);
+    for (size_t j = 0; j < nw; j++) {
+        acc[j] = mp_copy(monty_identity(mr->mc));
+        spare[j] = mp_new(mp_max_bits(mr->pm1));
+    }
     size_t bit = mp_max_bits(mr->pm1);
 
     /*
@@ -179,8 +192,8 @@ static struct mr_result miller_rabin_test_inner(MillerRabin *mr, mp_int *mw)
 
     unsigned active = 0;
 
-    struct mr_result result;
-    result.passed = result.potential_primitive_root = 0;
+    for (size_t j = 0; j < nw; j++)
+        results[j].passed = results[j].potential_primitive_root = 0;
 
     while (bit-- > 1) {
         /*
@@ -189,9 +202,13 @@ static struct mr_result miller_rabin_test_inner(MillerRabin *mr, mp_int *mw)
          * the value we had already, and then optionally multiply in
          * another copy of w depending on the next bit of the exponent.
          */
-        monty_mul_into(mr->mc, acc, acc, acc);
-        monty_mul_into(mr->mc, spare, acc, mw);
-        mp_select_into(acc, acc, spare, mp_get_bit(mr->pm1, bit));
+        unsigned expbit = mp_get_bit(mr->pm1, bit);
+        for (size_t j = 0; j < nw; j++)
+            monty_mul_into(mr->mc, acc[j], acc[j], acc[j]);
+        for (size_t j = 0; j < nw; j++)
+            monty_mul_into(mr->mc, spare[j], acc[j], mw[j]);
+        for (size_t j = 0; j < nw; j++)
+            mp_select_into(acc[j], acc[j], spare[j], expbit);
 
         /*
          * mr->lowbit is a number with only one bit set, corresponding
@@ -204,35 +221,52 @@ static struct mr_result miller_rabin_test_inner(MillerRabin *mr, mp_int *mw)
         unsigned first_iter = mp_get_bit(mr->lowbit, bit);
         active |= first_iter;
 
-        /*
-         * Check the intermediate result against both +1 and -1.
-         */
-        unsigned is_plus_1 = mp_cmp_eq(acc, monty_identity(mr->mc));
-        unsigned is_minus_1 = mp_cmp_eq(acc, mr->m_pm1);
+        for (size_t j = 0; j < nw; j++) {
+            /*
+             * Check the intermediate result against both +1 and -1.
+             */
+            unsigned is_plus_1 = mp_cmp_eq(acc[j], monty_identity(mr->mc));
+            unsigned is_minus_1 = mp_cmp_eq(acc[j], mr->m_pm1);
 
-        /*
-         * M-R must report success iff either: the first of the useful
-         * intermediate results (which is w^q) is 1, or _any_ of them
-         * (from w^q all the way up to w^((p-1)/2)) is -1.
-         *
-         * So we want to pass the test if is_plus_1 is set on the
-         * first iteration, or if is_minus_1 is set on any iteration.
-         */
-        result.passed |= (first_iter & is_plus_1);
-        result.passed |= (active & is_minus_1);
+            /*
+             * M-R must report success iff either: the first of the
+             * useful intermediate results (which is w^q) is 1, or
+             * _any_ of them (from w^q all the way up to w^((p-1)/2))
+             * is -1.
+             *
+             * So we want to pass the test if is_plus_1 is set on the
+             * first iteration, or if is_minus_1 is set on any
+             * iteration.
+             */
+            results[j].passed |= (first_iter & is_plus_1);
+            results[j].passed |= (active & is_minus_1);
 
-        /*
-         * In the final iteration, is_minus_1 is also used to set the
-         * 'potential primitive root' flag, because we haven't found
-         * any exponent smaller than p-1 for which w^(that) == 1.
-         */
-        if (bit == 1)
-            result.potential_primitive_root = is_minus_1;
+            /*
+             * In the final iteration, is_minus_1 is also used to set
+             * the 'potential primitive root' flag, because we haven't
+             * found any exponent smaller than p-1 for which w^(that)
+             * == 1.
+             */
+            if (bit == 1)
+                results[j].potential_primitive_root = is_minus_1;
+        }
     }
 
-    mp_free(acc);
-    mp_free(spare);
+    for (size_t j = 0; j < nw; j++) {
+        mp_free(acc[j]);
+        mp_free(spare[j]);
+    }
+    sfree(acc);
+    sfree(spare);
+}
 
+/*
+ * Convenience wrapper for testing a single witness.
+ */
+static struct mr_result miller_rabin_test_inner(MillerRabin *mr, mp_int *mw)
+{
+    struct mr_result result;
+    miller_rabin_test_inner_multi(mr, &mw, 1, &result);
     return result;
 }
 
@@ -257,6 +291,27 @@ bool miller_rabin_test_random(MillerRabin *mr)
     return result.passed;
 }
 
+bool miller_rabin_test_random_batch(MillerRabin *mr, unsigned nwitnesses)
+{
+    mp_int **mw = snewn(nwitnesses, mp_int *);
+    struct mr_result *results = snewn(nwitnesses, struct mr_result);
+
+    for (unsigned j = 0; j < nwitnesses; j++)
+        mw[j] = mp_random_in_range(mr->two, mr->pm1);
+
+    miller_rabin_test_inner_multi(mr, mw, nwitnesses, results);
+
+    bool passed = true;
+    for (unsigned j = 0; j < nwitnesses; j++) {
+        passed &= (bool)results[j].passed;
+        mp_free(mw[j]);
+    }
+
+    sfree(mw);
+    sfree(results);
+    return passed;
+}
+
 mp_int *miller_rabin_find_potential_primitive_root(MillerRabin *mr)
 {
     while (true) {
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include "putty.h"
 #include "ssh.h"
 #include "sshkeygen.h"
 #include "mpint.h"
@@ -128,12 +129,41 @@ PockleStatus pockle_add_small_prime(Pockle *pockle, mp_int *p)
     return pockle_insert(pockle, p, NULL, 0, NULL);
 }
 
+/*
+ * The modular exponentiations that dominate the cost of verifying one
+ * Pocklington certificate - the Fermat check w^{p-1}, and w^{(p-1)/q}
+ * for each factor q - are independent of each other, so we evaluate
+ * them as parallel jobs via run_in_parallel(). Each job builds its
+ * own MontyContext from p rather than sharing one, since a
+ * MontyContext's scratch space doesn't support concurrent use; the
+ * context setup is a few multiplications, noise next to the modexp
+ * itself. The main thread then applies the (cheap) success criteria
+ * to the results in order, so the status returned is the same one the
+ * sequential loop would have produced.
+ */
+struct pockle_modexp_jobs {
+    mp_int *p, *witness;
+    mp_int **exponents;                /* one per job */
+    mp_int **results;                  /* w^{exponents[i]} mod p */
+};
+
+static void pockle_modexp_job(void *vctx, size_t index)
+{
+    struct pockle_modexp_jobs *ctx = (struct pockle_modexp_jobs *)vctx;
+    MontyContext *mc = monty_new(ctx->p);
+    mp_int *w = monty_import(mc, ctx->witness);
+    mp_int *power = monty_pow(mc, w, ctx->exponents[index]);
+    ctx->results[index] = monty_export(mc, power);
+    mp_free(power);
+    mp_free(w);
+    monty_free(mc);
+}
+
 PockleStatus pockle_add_prime(Pockle *pockle, mp_int *p,
                               mp_int **factors, size_t nfactors,
                               mp_int *witness)
 {
-    MontyContext *mc = NULL;
-    mp_int *x = NULL, *f = NULL, *w = NULL;
+    mp_int *x = NULL, *f = NULL;
     PockleStatus status;
 
     /*
@@ -312,64 +342,79 @@ PockleStatus pockle_add_prime(Pockle *pockle, mp_int *p,
     /*
      * Now we've done all the checks that are cheaper than a modpow,
      * so we've ruled out as many things as possible before having to
-     * do any hard work. But there's nothing for it now: make a
-     * MontyContext.
-     */
-    mc = monty_new(p);
-    w = monty_import(mc, witness);
-
-    /*
-     * The initial Fermat check: is w^{p-1} itself congruent to 1 mod
-     * p?
+     * do any hard work. But there's nothing for it now: do the
+     * exponentiations, as parallel jobs. Job 0 is the Fermat check
+     * w^{p-1}; job i+1 computes w^{(p-1)/q} for factors[i]. The mpint
+     * allocation pool has to be suspended while other threads are
+     * doing mp arithmetic.
      */
     {
+        size_t njobs = nfactors + 1;
+        struct pockle_modexp_jobs job;
+        job.p = p;
+        job.witness = witness;
+        job.exponents = snewn(njobs, mp_int *);
+        job.results = snewn(njobs, mp_int *);
+
         mp_int *pm1 = mp_copy(p);
         mp_sub_integer_into(pm1, pm1, 1);
-        mp_int *power = monty_pow(mc, w, pm1);
-        unsigned fermat_pass = mp_cmp_eq(power, monty_identity(mc));
-        mp_free(power);
-        mp_free(pm1);
+        job.exponents[0] = pm1;
+        for (size_t i = 0; i < nfactors; i++)
+            job.exponents[i+1] = mp_unsafe_shrink(mp_div(p, factors[i]));
+
+        mp_pool_suspend();
+        run_in_parallel(njobs, pockle_modexp_job, &job);
+        mp_pool_resume();
+
+        for (size_t i = 0; i < njobs; i++)
+            mp_free(job.exponents[i]);
+        sfree(job.exponents);
+
+        /*
+         * The initial Fermat check: is w^{p-1} itself congruent to 1
+         * mod p?
+         */
+        unsigned fermat_pass = mp_eq_integer(job.results[0], 1);
+
+        /*
+         * And for each factor q, is w^{(p-1)/q}-1 coprime to p?
+         */
+        status = POCKLE_OK;
+        for (size_t i = 0; fermat_pass && i < nfactors; i++) {
+            mp_int *power_extracted = job.results[i+1];
+            mp_sub_integer_into(power_extracted, power_extracted, 1);
+
+            unsigned coprime = mp_coprime(power_extracted, p);
+            if (!coprime) {
+                /*
+                 * If w^{(p-1)/q}-1 is not coprime to p, the test has
+                 * failed. But it makes a difference why. If the power
+                 * of w turned out to be 1, so that we took gcd(1-1,p)
+                 * = gcd(0,p) = p, that's like an inconclusive Fermat
+                 * or M-R test: it might just mean you picked a
+                 * witness integer that wasn't a primitive root. But
+                 * if the power is any _other_ value mod p that is not
+                 * coprime to p, it means we've detected that the
+                 * number is *actually not prime*!
+                 */
+                if (mp_eq_integer(power_extracted, 0))
+                    status = POCKLE_WITNESS_POWER_IS_1;
+                else
+                    status = POCKLE_WITNESS_POWER_NOT_COPRIME;
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < njobs; i++)
+            mp_free(job.results[i]);
+        sfree(job.results);
 
         if (!fermat_pass) {
             status = POCKLE_FERMAT_TEST_FAILED;
             goto out;
         }
-    }
-
-    /*
-     * And now, for each factor q, is w^{(p-1)/q}-1 coprime to p?
-     */
-    for (size_t i = 0; i < nfactors; i++) {
-        mp_int *q = factors[i];
-        mp_int *exponent = mp_unsafe_shrink(mp_div(p, q));
-        mp_int *power = monty_pow(mc, w, exponent);
-        mp_int *power_extracted = monty_export(mc, power);
-        mp_sub_integer_into(power_extracted, power_extracted, 1);
-
-        unsigned coprime = mp_coprime(power_extracted, p);
-        if (!coprime) {
-            /*
-             * If w^{(p-1)/q}-1 is not coprime to p, the test has
-             * failed. But it makes a difference why. If the power of
-             * w turned out to be 1, so that we took gcd(1-1,p) =
-             * gcd(0,p) = p, that's like an inconclusive Fermat or M-R
-             * test: it might just mean you picked a witness integer
-             * that wasn't a primitive root. But if the power is any
-             * _other_ value mod p that is not coprime to p, it means
-             * we've detected that the number is *actually not prime*!
-             */
-            if (mp_eq_integer(power_extracted, 0))
-                status = POCKLE_WITNESS_POWER_IS_1;
-            else
-                status = POCKLE_WITNESS_POWER_NOT_COPRIME;
-        }
-
-        mp_free(exponent);
-        mp_free(power);
-        mp_free(power_extracted);
-
-        if (!coprime)
-            goto out; /* with the status we set up above */
+        if (status != POCKLE_OK)
+            goto out;
     }
 
     /*
@@ -384,10 +429,6 @@ PockleStatus pockle_add_prime(Pockle *pockle, mp_int *p,
         mp_free(x);
     if (f)
         mp_free(f);
-    if (w)
-        mp_free(w);
-    if (mc)
-        monty_free(mc);
     return status;
 }
 
@@ -80,15 +80,17 @@ static mp_int *probprime_generate(
             return NULL;
         }
 
+        /*
+         * Run the first Miller-Rabin test on its own, because nearly
+         * every sieve survivor is still composite and one witness is
+         * almost certain to say so; then confirm the rare survivors
+         * of that with the remaining tests in a single batched pass.
+         */
         MillerRabin *mr = miller_rabin_new(p);
-        bool known_bad = false;
         unsigned nchecks = miller_rabin_checks_needed(mp_get_nbits(p));
-        for (unsigned check = 0; check < nchecks; check++) {
-            if (!miller_rabin_test_random(mr)) {
-                known_bad = true;
-                break;
-            }
-        }
+        bool known_bad = !miller_rabin_test_random(mr);
+        if (!known_bad && nchecks > 1)
+            known_bad = !miller_rabin_test_random_batch(mr, nchecks - 1);
         miller_rabin_free(mr);
 
         if (!known_bad) {
@@ -13,6 +13,12 @@ struct avoid {
     unsigned mod, res;
 };
 
+struct avoid_pack {
+    uint32_t product;          /* product of the distinct moduli in
+                                * avoids[start],...,avoids[end-1] */
+    size_t start, end;
+};
+
 struct PrimeCandidateSource {
     unsigned bits;
     bool ready, try_sophie_germain;
@@ -34,6 +40,21 @@ struct PrimeCandidateSource {
     struct avoid *avoids;
     size_t navoids, avoidsize;
 
+    /* Consecutive runs of 'avoids' whose moduli are small enough to
+     * multiply together, so that one reduction of a candidate mod the
+     * product can stand in for a separate reduction mod each one. */
+    struct avoid_pack *packs;
+    size_t npacks, packsize;
+
+    /* Segmented sieve state: a window of consecutive x values
+     * starting at win_base, sieved against the avoid list in one go,
+     * whose surviving offsets are handed out one per pcs_generate
+     * call. See pcs_new_window. */
+    mp_int *win_base;
+    uint64_t *win_bitmap;
+    uint32_t *win_survivors;
+    size_t win_nsurvivors;
+
     /* List of known primes that our number will be congruent to 1 modulo */
     mp_int **kps;
     size_t nkps, kpsize;
@@ -58,6 +79,14 @@ PrimeCandidateSource *pcs_new_with_firstbits(unsigned bits,
     s->avoids = NULL;
     s->navoids = s->avoidsize = 0;
 
+    s->packs = NULL;
+    s->npacks = s->packsize = 0;
+
+    s->win_base = NULL;
+    s->win_bitmap = NULL;
+    s->win_survivors = NULL;
+    s->win_nsurvivors = 0;
+
     /* Make the number that's the lower limit of our range */
     mp_int *firstmp = mp_from_integer(first);
     mp_int *base = mp_lshift_fixed(firstmp, bits - nfirst);
@@ -96,7 +125,12 @@ void pcs_free(PrimeCandidateSource *s)
     mp_free(s->addend);
     for (size_t i = 0; i < s->nkps; i++)
         mp_free(s->kps[i]);
+    if (s->win_base)
+        mp_free(s->win_base);
+    sfree(s->win_bitmap);
+    sfree(s->win_survivors);
     sfree(s->avoids);
+    sfree(s->packs);
     sfree(s->kps);
     sfree(s);
 }
@@ -362,54 +396,209 @@ void pcs_ready(PrimeCandidateSource *s)
 
     s->navoids = out;
 
+    /*
+     * Group the avoid list into runs of consecutive entries whose
+     * distinct moduli have product less than 2^32. Scanning the whole
+     * of a large candidate number with mp_mod_known_integer is by far
+     * the dominant cost of testing it against this list, so during
+     * generation we do one scan per _pack_, reducing the candidate
+     * mod the pack's product, and then recover its residue mod each
+     * individual modulus from that by native integer arithmetic.
+     *
+     * This pays off best at the head of the sorted list, where the
+     * moduli are tiny (the first pack holds the product of about the
+     * first ten odd primes) and where most candidates are rejected
+     * anyway; but even out in the tail, any two 16-bit moduli still
+     * fit in one pack, so the number of expensive scans is at least
+     * halved everywhere.
+     */
+    for (size_t i = 0; i < s->navoids ;) {
+        sgrowarray(s->packs, s->packsize, s->npacks);
+        struct avoid_pack *pack = &s->packs[s->npacks++];
+        pack->start = i;
+
+        uint64_t product = 1;
+        uint32_t last_mod = 0;
+        while (i < s->navoids) {
+            uint32_t mod = s->avoids[i].mod;
+            if (mod != last_mod) {
+                if (product * mod > UINT32_MAX)
+                    break;
+                product *= mod;
+                last_mod = mod;
+            }
+            i++;
+        }
+
+        pack->product = product;
+        pack->end = i;
+    }
+
     s->ready = true;
 }
 
-mp_int *pcs_generate(PrimeCandidateSource *s)
+/*
+ * Number of consecutive x values sieved as one window. 16k bits is a
+ * 2kB bitmap, and large enough that even mod the biggest 16-bit
+ * avoids, each modulus knocks out at least a couple of dozen offsets
+ * per scan of the candidate.
+ */
+#define PCS_WINDOW 16384
+
+/*
+ * Test a single candidate x against the avoid list, one
+ * mp_mod_known_integer scan per pack. This is the fallback for
+ * one-shot sources and for ranges too small to sieve a window over.
+ */
+static bool pcs_check_single(PrimeCandidateSource *s, mp_int *x)
 {
-    assert(s->ready);
-    if (s->one_shot) {
-        if (s->thrown_away_my_shot)
-            return NULL;
-        s->thrown_away_my_shot = true;
+    for (size_t pi = 0; pi < s->npacks; pi++) {
+        const struct avoid_pack *pack = &s->packs[pi];
+        uint32_t pack_res = mp_mod_known_integer(x, pack->product);
+
+        uint32_t x_res = 0, last_mod = 0;
+        for (size_t i = pack->start; i < pack->end; i++) {
+            uint32_t mod = s->avoids[i].mod;
+
+            if (mod != last_mod) {
+                last_mod = mod;
+                x_res = pack_res % mod;
+            }
+
+            if (x_res == s->avoids[i].res)
+                return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Segmented sieve: pick a random window base, and strike out of a
+ * bitmap every offset j for which base+j hits one of the avoided
+ * residues, by stepping through the bitmap at intervals of each
+ * modulus. This costs one scan of the (large) base per distinct
+ * modulus per _window_, instead of one per pack per _candidate_ as
+ * the single-candidate path does, and amortises to almost nothing per
+ * surviving candidate.
+ *
+ * The surviving offsets are then handed out in random order, so a
+ * prime's chance of selection depends only mildly on the population
+ * of the window it happens to fall in; the candidates are no longer
+ * fully independent samples the way the single-candidate path's are,
+ * but each window base is, which keeps the output well distributed
+ * across the whole range.
+ */
+static void pcs_new_window(PrimeCandidateSource *s)
+{
+    if (!s->win_bitmap) {
+        s->win_bitmap = snewn(PCS_WINDOW / 64, uint64_t);
+        s->win_survivors = snewn(PCS_WINDOW, uint32_t);
     }
 
     while (true) {
-        mp_int *x = mp_random_upto(s->limit);
+        mp_int *base = mp_random_upto(s->limit);
+
+        /* Exclude offsets that would take us past the limit, in the
+         * rare case that base lands within a window of it. */
+        size_t maxj = PCS_WINDOW;
+        mp_int *headroom = mp_sub(s->limit, base);
+        if (!mp_hs_integer(headroom, PCS_WINDOW))
+            maxj = mp_get_integer(headroom);
+        mp_free(headroom);
+
+        memset(s->win_bitmap, 0, (PCS_WINDOW / 64) * sizeof(uint64_t));
+
+        for (size_t pi = 0; pi < s->npacks; pi++) {
+            const struct avoid_pack *pack = &s->packs[pi];
+            uint32_t pack_res = mp_mod_known_integer(base, pack->product);
+
+            uint32_t base_res = 0, last_mod = 0;
+            for (size_t i = pack->start; i < pack->end; i++) {
+                uint32_t mod = s->avoids[i].mod;
+
+                if (mod != last_mod) {
+                    last_mod = mod;
+                    base_res = pack_res % mod;
+                }
+
+                /* base+j == res (mod mod)  =>  j == res - base (mod mod) */
+                uint32_t j = (s->avoids[i].res + mod - base_res) % mod;
+                for (; j < maxj; j += mod)
+                    s->win_bitmap[j / 64] |= (uint64_t)1 << (j % 64);
+            }
+        }
 
-        int64_t x_res = 0, last_mod = 0;
-        bool ok = true;
+        s->win_nsurvivors = 0;
+        for (size_t w = 0; w * 64 < maxj; w++) {
+            uint64_t clear = ~s->win_bitmap[w];
+            for (unsigned b = 0; b < 64 && clear; b++, clear >>= 1) {
+                if (clear & 1) {
+                    uint32_t j = w * 64 + b;
+                    if (j < maxj)
+                        s->win_survivors[s->win_nsurvivors++] = j;
+                }
+            }
+        }
 
-        for (size_t i = 0; i < s->navoids; i++) {
-            int64_t mod = s->avoids[i].mod, avoid_res = s->avoids[i].res;
+        if (s->win_nsurvivors) {
+            if (s->win_base)
+                mp_free(s->win_base);
+            s->win_base = base;
+            return;
+        }
 
-            if (mod != last_mod) {
-                last_mod = mod;
-                x_res = mp_mod_known_integer(x, mod);
+        mp_free(base);   /* everything was composite; try another window */
+    }
+}
+
+mp_int *pcs_generate(PrimeCandidateSource *s)
+{
+    assert(s->ready);
+    if (s->one_shot || !mp_hs_integer(s->limit, 2 * PCS_WINDOW)) {
+        /* Single independent candidates: either we're only allowed
+         * one attempt anyway, or the range is too small to be worth
+         * sieving a window over. */
+        while (true) {
+            if (s->one_shot) {
+                if (s->thrown_away_my_shot)
+                    return NULL;
+                s->thrown_away_my_shot = true;
             }
 
-            if (x_res == avoid_res) {
-                ok = false;
-                break;
+            mp_int *x = mp_random_upto(s->limit);
+            if (!pcs_check_single(s, x)) {
+                mp_free(x);
+                if (s->one_shot)
+                    return NULL;
+                continue; /* try a new x */
             }
-        }
 
-        if (!ok) {
+            mp_int *toret = mp_new(s->bits);
+            mp_mul_into(toret, x, s->factor);
+            mp_add_into(toret, toret, s->addend);
             mp_free(x);
-            if (s->one_shot)
-                return NULL;
-            continue; /* try a new x */
+            return toret;
         }
-
-        /*
-         * We've found a viable x. Make the final output value.
-         */
-        mp_int *toret = mp_new(s->bits);
-        mp_mul_into(toret, x, s->factor);
-        mp_add_into(toret, toret, s->addend);
-        mp_free(x);
-        return toret;
     }
+
+    if (!s->win_nsurvivors)
+        pcs_new_window(s);
+
+    /* Pick a random survivor, and remove it from the list */
+    unsigned char randbuf[4];
+    random_read(randbuf, 4);
+    size_t idx = GET_32BIT_MSB_FIRST(randbuf) % s->win_nsurvivors;
+    uint32_t j = s->win_survivors[idx];
+    s->win_survivors[idx] = s->win_survivors[--s->win_nsurvivors];
+
+    mp_int *x = mp_copy(s->win_base);
+    mp_add_integer_into(x, x, j);
+
+    mp_int *toret = mp_new(s->bits);
+    mp_mul_into(toret, x, s->factor);
+    mp_add_into(toret, toret, s->addend);
+    mp_free(x);
+    return toret;
 }
 
 void pcs_inspect(PrimeCandidateSource *pcs, mp_int **limit_out,
@@ -57,6 +57,23 @@ struct Ldisc_tag {
     IdempotentCallback input_queue_callback;
     prompts_t *prompts;
 
+    /*
+     * Raw output bytes waiting to go to the backend, and local echo
+     * waiting to go to the terminal. Rather than calling
+     * backend_send() for every keystroke or every line of a paste, we
+     * accumulate raw data here and flush it with a single
+     * backend_send() in a toplevel callback, so that everything sent
+     * during one event cycle ends up in as few packets as possible.
+     * Session specials can't be stored in this buffer, so anything
+     * pending is flushed before one of those is sent, to keep the
+     * data in order. Echo is simpler: it's accumulated and flushed
+     * within each ldisc_send() call, turning per-character
+     * seat_stdout() calls into one per call.
+     */
+    strbuf *pending_send;
+    IdempotentCallback pending_send_callback;
+    strbuf *pending_echo;
+
     /*
      * Values cached out of conf.
      */
@@ -77,7 +94,16 @@ struct Ldisc_tag {
 
 static void c_write(Ldisc *ldisc, const void *buf, int len)
 {
-    seat_stdout(ldisc->seat, buf, len);
+    put_data(ldisc->pending_echo, buf, len);
+}
+
+static void ldisc_flush_echo(Ldisc *ldisc)
+{
+    if (ldisc->pending_echo->len) {
+        seat_stdout(ldisc->seat, ldisc->pending_echo->s,
+                    ldisc->pending_echo->len);
+        strbuf_clear(ldisc->pending_echo);
+    }
 }
 
 static int plen(Ldisc *ldisc, unsigned char c)
@@ -128,6 +154,8 @@ static void bsb(Ldisc *ldisc, int n)
 }
 
 static void ldisc_input_queue_callback(void *ctx);
+static void ldisc_pending_send_callback(void *ctx);
+static void ldisc_flush_pending_send(Ldisc *ldisc);
 
 #define CTRL(x) (x^'@')
 #define KCTRL(x) ((x^'@') | 0x100)
@@ -153,6 +181,12 @@ Ldisc *ldisc_create(Conf *conf, Terminal *term, Backend *backend, Seat *seat)
     ldisc->input_queue_callback.queued = false;
     bufchain_set_callback(&ldisc->input_queue, &ldisc->input_queue_callback);
 
+    ldisc->pending_send = strbuf_new_nm();
+    ldisc->pending_send_callback.fn = ldisc_pending_send_callback;
+    ldisc->pending_send_callback.ctx = ldisc;
+    ldisc->pending_send_callback.queued = false;
+    ldisc->pending_echo = strbuf_new_nm();
+
     ldisc_configure(ldisc, conf);
 
     /* Link ourselves into the backend and the terminal */
@@ -175,6 +209,10 @@ void ldisc_configure(Ldisc *ldisc, Conf *conf)
 
 void ldisc_free(Ldisc *ldisc)
 {
+    if (ldisc->backend)
+        ldisc_flush_pending_send(ldisc);
+    strbuf_free(ldisc->pending_send);
+    strbuf_free(ldisc->pending_echo);
     bufchain_clear(&ldisc->input_queue);
     if (ldisc->term)
         ldisc->term->ldisc = NULL;
@@ -231,30 +269,55 @@ static void ldisc_input_queue_callback(void *ctx)
     }
 }
 
+static void ldisc_input_queue_add_raw(
+    Ldisc *ldisc, const void *vbuf, size_t len)
+{
+    const char *buf = (const char *)vbuf;
+    while (len > 0) {
+        /*
+         * Encode raw data in input_queue, by storing large chunks
+         * as long as they don't include 0xFF, and pausing every
+         * time they do to escape it.
+         */
+        const char *ff = memchr(buf, '\xFF', len);
+        size_t this_len = ff ? ff - buf : len;
+        if (this_len > 0) {
+            bufchain_add(&ldisc->input_queue, buf, this_len);
+        } else {
+            bufchain_add(&ldisc->input_queue, "\xFF\xFF", 2);
+            this_len = 1;
+        }
+        buf += this_len;
+        len -= this_len;
+    }
+}
+
+static void ldisc_flush_pending_send(Ldisc *ldisc)
+{
+    if (ldisc->pending_send->len) {
+        if (backend_sendok(ldisc->backend))
+            backend_send(ldisc->backend, ldisc->pending_send->s,
+                         ldisc->pending_send->len);
+        else
+            ldisc_input_queue_add_raw(ldisc, ldisc->pending_send->s,
+                                      ldisc->pending_send->len);
+        strbuf_clear(ldisc->pending_send);
+    }
+}
+
+static void ldisc_pending_send_callback(void *ctx)
+{
+    ldisc_flush_pending_send((Ldisc *)ctx);
+}
+
 static void ldisc_to_backend_raw(
     Ldisc *ldisc, const void *vbuf, size_t len)
 {
     if (backend_sendok(ldisc->backend)) {
-        backend_send(ldisc->backend, vbuf, len);
+        put_data(ldisc->pending_send, vbuf, len);
+        queue_idempotent_callback(&ldisc->pending_send_callback);
     } else {
-        const char *buf = (const char *)vbuf;
-        while (len > 0) {
-            /*
-             * Encode raw data in input_queue, by storing large chunks
-             * as long as they don't include 0xFF, and pausing every
-             * time they do to escape it.
-             */
-            const char *ff = memchr(buf, '\xFF', len);
-            size_t this_len = ff ? ff - buf : len;
-            if (this_len > 0) {
-                bufchain_add(&ldisc->input_queue, buf, len);
-            } else {
-                bufchain_add(&ldisc->input_queue, "\xFF\xFF", 2);
-                this_len = 1;
-            }
-            buf += this_len;
-            len -= this_len;
-        }
+        ldisc_input_queue_add_raw(ldisc, vbuf, len);
     }
 }
 
@@ -262,6 +325,11 @@ static void ldisc_to_backend_special(
     Ldisc *ldisc, SessionSpecialCode code, int arg)
 {
     if (backend_sendok(ldisc->backend)) {
+        /*
+         * Specials can't be represented in pending_send, so flush any
+         * buffered raw data first to keep everything in order.
+         */
+        ldisc_flush_pending_send(ldisc);
         backend_special(ldisc->backend, code, arg);
     } else {
         /*
@@ -277,6 +345,22 @@ static void ldisc_to_backend_special(
     }
 }
 
+/*
+ * Report how much data is buffered between here and the network: both
+ * our own pending output and whatever the backend is still holding.
+ * Used by the terminal to pace large pastes against the speed the
+ * connection is actually draining.
+ */
+size_t ldisc_sendbuffer(Ldisc *ldisc)
+{
+    size_t buffered = ldisc->pending_send->len;
+    if (backend_sendok(ldisc->backend))
+        buffered += backend_sendbuffer(ldisc->backend);
+    else
+        buffered += bufchain_size(&ldisc->input_queue);
+    return buffered;
+}
+
 bool ldisc_has_input_buffered(Ldisc *ldisc)
 {
     return bufchain_size(&ldisc->input_queue) > 0;
@@ -575,4 +659,6 @@ void ldisc_send(Ldisc *ldisc, const void *vbuf, int len, bool interactive)
                 ldisc_to_backend_raw(ldisc, buf, len);
         }
     }
+
+    ldisc_flush_echo(ldisc);
 }
@@ -20,6 +20,11 @@ struct LogContext {
     LogPolicy *lp;
     Conf *conf;
     int logtype;                       /* cached out of conf */
+    bool flush_frequently;             /* cached out of conf */
+    bool flush_pending;
+    bool startup_prof_started;
+    unsigned long startup_prof_base, startup_prof_prev;
+    strbuf *printf_scratch;            /* reused by logprintf */
 };
 
 static Filename *xlatlognam(Filename *s, char *hostname, int port,
@@ -61,14 +66,29 @@ static void logwrite(LogContext *ctx, ptrlen data)
 static PRINTF_LIKE(2, 3) void logprintf(LogContext *ctx, const char *fmt, ...)
 {
     va_list ap;
-    char *data;
 
+    /*
+     * logwrite() will open the log file if it isn't already open. But
+     * opening it can involve writing a header line, which comes back
+     * through this function and would scribble on the scratch buffer
+     * under us. So make sure any lazy open happens before we format
+     * our own output.
+     */
+    if (ctx->state == L_CLOSED)
+        logfopen(ctx);
+
+    /*
+     * Format into a scratch buffer retained in the LogContext, so
+     * that in the steady state of packet logging - which comes
+     * through here several times per packet - we're not allocating
+     * and freeing a buffer per call.
+     */
+    strbuf_clear(ctx->printf_scratch);
     va_start(ap, fmt);
-    data = dupvprintf(fmt, ap);
+    strbuf_catfv(ctx->printf_scratch, fmt, ap);
     va_end(ap);
 
-    logwrite(ctx, ptrlen_from_asciz(data));
-    sfree(data);
+    logwrite(ctx, ptrlen_from_strbuf(ctx->printf_scratch));
 }
 
 /*
@@ -81,6 +101,32 @@ void logflush(LogContext *ctx)
             fflush(ctx->lgfp);
 }
 
+static void logflush_callback(void *vctx)
+{
+    LogContext *ctx = (LogContext *)vctx;
+    ctx->flush_pending = false;
+    logflush(ctx);
+}
+
+/*
+ * Request a flush of the log file, deferred to a toplevel callback.
+ * A burst of packets logged within one run of the event loop thereby
+ * costs a single fflush, rather than one per packet, which makes a
+ * real difference to bulk transfer with packet logging enabled. If
+ * the user has turned off 'flush log file frequently', we don't
+ * flush at all and leave it to stdio buffering, matching what the
+ * terminal's session logging does with that option.
+ */
+static void logflush_soon(LogContext *ctx)
+{
+    if (!ctx->flush_frequently)
+        return;
+    if (!ctx->flush_pending) {
+        ctx->flush_pending = true;
+        queue_toplevel_callback(logflush_callback, ctx);
+    }
+}
+
 LogPolicy *log_get_policy(LogContext *ctx)
 {
     return ctx->lp;
@@ -100,6 +146,12 @@ static void logfopen_callback(void *vctx, int mode)
         fmode = (mode == 1 ? "ab" : "wb");
         ctx->lgfp = f_open(ctx->currlogfilename, fmode, false);
         if (ctx->lgfp) {
+            /*
+             * Give the log file a generous stdio buffer, so that
+             * logging a packet normally costs the session code no
+             * more than a memcpy into the staging buffer.
+             */
+            setvbuf(ctx->lgfp, NULL, _IOFBF, 65536);
             ctx->state = L_OPEN;
         } else {
             ctx->state = L_ERROR;
@@ -107,7 +159,17 @@ static void logfopen_callback(void *vctx, int mode)
         }
     }
 
-    if (ctx->state == L_OPEN && conf_get_bool(ctx->conf, CONF_logheader)) {
+    if (ctx->state == L_OPEN && ctx->logtype == LGTYP_SSHBIN) {
+        /*
+         * Binary log files always begin with the magic string, so
+         * that readers can identify the format; the textual header
+         * line is never written, whatever CONF_logheader says. (If
+         * we're appending, the magic recurs mid-file, and readers
+         * accept it at any record boundary.)
+         */
+        logwrite(ctx, PTRLEN_LITERAL(BINLOG_MAGIC));
+    } else if (ctx->state == L_OPEN &&
+               conf_get_bool(ctx->conf, CONF_logheader)) {
         /* Write header line into log file. */
         tm = ltime();
         strftime(buf, 24, "%Y.%m.%d %H:%M:%S", &tm);
@@ -123,6 +185,7 @@ static void logfopen_callback(void *vctx, int mode)
                        ctx->logtype == LGTYP_DEBUG ? "raw" :
                        ctx->logtype == LGTYP_PACKETS ? "SSH packets" :
                        ctx->logtype == LGTYP_SSHRAW ? "SSH raw data" :
+                       ctx->logtype == LGTYP_SSHBIN ? "binary SSH packets" :
                        "unknown"),
                       filename_to_str(ctx->currlogfilename));
     lp_eventlog(ctx->lp, event);
@@ -212,11 +275,129 @@ void logtraffic(LogContext *ctx, unsigned char c, int logmode)
     }
 }
 
+/*
+ * Binary packet log format (LGTYP_SSHBIN).
+ *
+ * The file begins with the 16-byte magic string BINLOG_MAGIC, which
+ * recurs whenever a log is appended to an existing file. After that
+ * it's a sequence of records, each consisting of a 4-byte big-endian
+ * length (not counting itself) followed by that many bytes:
+ *
+ *   byte      record type (one of the BINLOG_REC_* constants)
+ *   uint64    time the record was made, as a Unix time_t
+ *
+ * followed, for packet records, by
+ *
+ *   uint32    sequence number (0 if the protocol doesn't have one)
+ *   byte      packet type
+ *   string    packet type name, as it would appear in a text log
+ *   uint32    id of the connection-sharing downstream (0 if none)
+ *   string    additional log text for that downstream (maybe empty)
+ *
+ * and then a sequence of spans covering the packet body in order:
+ *
+ *   byte      one of the BINLOG_SPAN_* constants
+ *   uint32    number of packet bytes covered
+ *   [data]    the bytes themselves, for BINLOG_SPAN_DATA only
+ *
+ * Blanked and omitted spans correspond to the bytes a text log would
+ * have shown as XX or summarised as '(n bytes omitted)'; their
+ * contents are never written to the file. An Event Log record
+ * contains just the message text after the time field. 'string'
+ * means a uint32 length followed by that many bytes, as usual.
+ *
+ * The length prefix on every record means a reader can skip through
+ * a multi-gigabyte log without parsing the record bodies; there's
+ * deliberately no index footer, because a crashed or killed session
+ * would never get to write it. The sshlogdump utility renders this
+ * format back into the textual one.
+ */
+
+static strbuf *logbinary_record_new(int rectype)
+{
+    strbuf *body = strbuf_new_nm();
+    put_byte(body, rectype);
+    put_uint64(body, time(NULL));
+    return body;
+}
+
+static void logbinary_record_write(LogContext *ctx, strbuf *body)
+{
+    unsigned char lenbuf[4];
+    PUT_32BIT_MSB_FIRST(lenbuf, body->len);
+    logwrite(ctx, make_ptrlen(lenbuf, 4));
+    logwrite(ctx, ptrlen_from_strbuf(body));
+    strbuf_free(body);
+}
+
+static void logbinary_event(LogContext *ctx, const char *event)
+{
+    strbuf *body = logbinary_record_new(BINLOG_REC_EVENT);
+    put_datapl(body, ptrlen_from_asciz(event));
+    logbinary_record_write(ctx, body);
+}
+
+static void logbinary_packet(LogContext *ctx, int direction, int type,
+                             const char *texttype, const void *data,
+                             size_t len, int n_blanks,
+                             const struct logblank_t *blanks,
+                             const unsigned long *seq,
+                             unsigned downstream_id,
+                             const char *additional_log_text)
+{
+    strbuf *body = logbinary_record_new(
+        direction == PKT_INCOMING ?
+        BINLOG_REC_PKT_INCOMING : BINLOG_REC_PKT_OUTGOING);
+    size_t p = 0, b = 0;
+
+    put_uint32(body, seq ? *seq : 0);
+    put_byte(body, type);
+    put_stringpl(body, ptrlen_from_asciz(texttype));
+    put_uint32(body, downstream_id);
+    put_stringpl(body, ptrlen_from_asciz(
+                     additional_log_text ? additional_log_text : ""));
+
+    while (p < len) {
+        int blktype = PKTLOG_EMIT;
+        size_t end = len;
+
+        /* Move to a current entry in the blanking array, as in the
+         * text dump below - except that here we can deal with a whole
+         * span of bytes sharing one blanking type at a time. */
+        while (b < n_blanks && p >= blanks[b].offset + blanks[b].len)
+            b++;
+        if (b < n_blanks) {
+            if (p >= blanks[b].offset) {
+                blktype = blanks[b].type;
+                end = blanks[b].offset + blanks[b].len;
+            } else {
+                end = blanks[b].offset;
+            }
+            if (end > len)
+                end = len;
+        }
+
+        put_byte(body, blktype == PKTLOG_BLANK ? BINLOG_SPAN_BLANKED :
+                 blktype == PKTLOG_OMIT ? BINLOG_SPAN_OMITTED :
+                 BINLOG_SPAN_DATA);
+        put_uint32(body, end - p);
+        if (blktype != PKTLOG_BLANK && blktype != PKTLOG_OMIT)
+            put_data(body, (const unsigned char *)data + p, end - p);
+        p = end;
+    }
+
+    logbinary_record_write(ctx, body);
+    logflush_soon(ctx);
+}
+
 static void logevent_internal(LogContext *ctx, const char *event)
 {
     if (ctx->logtype == LGTYP_PACKETS || ctx->logtype == LGTYP_SSHRAW) {
         logprintf(ctx, "Event Log: %s\r\n", event);
-        logflush(ctx);
+        logflush_soon(ctx);
+    } else if (ctx->logtype == LGTYP_SSHBIN) {
+        logbinary_event(ctx, event);
+        logflush_soon(ctx);
     }
     lp_eventlog(ctx->lp, event);
 }
@@ -273,6 +454,145 @@ void logeventf(LogContext *ctx, const char *fmt, ...)
     va_end(ap);
 }
 
+/*
+ * Structured events. The builder object only exists at all when the
+ * LogPolicy has a structured_event consumer attached: otherwise
+ * logevent_structured_start returns NULL and the other two functions
+ * return without formatting anything, so that instrumented call
+ * sites cost no more than a pointer test in the common case.
+ */
+struct LogStructuredEvent {
+    LogPolicy *lp;
+    int type;
+    char **keys, **values;
+    size_t nfields, fieldsize;
+};
+
+LogStructuredEvent *logevent_structured_start(LogContext *ctx, int type)
+{
+    LogStructuredEvent *le;
+
+    if (!ctx || !ctx->lp->vt->structured_event)
+        return NULL;
+
+    le = snew(LogStructuredEvent);
+    le->lp = ctx->lp;
+    le->type = type;
+    le->keys = le->values = NULL;
+    le->nfields = le->fieldsize = 0;
+    return le;
+}
+
+void logevent_structured_field(LogStructuredEvent *le, const char *key,
+                               const char *fmt, ...)
+{
+    va_list ap;
+
+    if (!le)
+        return;
+
+    if (le->nfields >= le->fieldsize) {
+        le->fieldsize = le->nfields * 5 / 4 + 4;
+        le->keys = sresize(le->keys, le->fieldsize, char *);
+        le->values = sresize(le->values, le->fieldsize, char *);
+    }
+    le->keys[le->nfields] = dupstr(key);
+    va_start(ap, fmt);
+    le->values[le->nfields] = dupvprintf(fmt, ap);
+    va_end(ap);
+    le->nfields++;
+}
+
+void logevent_structured_emit(LogStructuredEvent *le)
+{
+    size_t i;
+
+    if (!le)
+        return;
+
+    le->lp->vt->structured_event(
+        le->lp, le->type, (const char *const *)le->keys,
+        (const char *const *)le->values, le->nfields);
+
+    for (i = 0; i < le->nfields; i++) {
+        sfree(le->keys[i]);
+        sfree(le->values[i]);
+    }
+    sfree(le->keys);
+    sfree(le->values);
+    sfree(le);
+}
+
+static void log_structured_json_string(strbuf *out, const char *s)
+{
+    put_byte(out, '"');
+    while (*s) {
+        unsigned char c = *s++;
+        if (c == '"' || c == '\\')
+            strbuf_catf(out, "\\%c", c);
+        else if (c < 0x20)
+            strbuf_catf(out, "\\u%04x", c);
+        else
+            put_byte(out, c);
+    }
+    put_byte(out, '"');
+}
+
+void log_structured_event_json(strbuf *out, int type,
+                               const char *const *keys,
+                               const char *const *values, size_t nfields)
+{
+    static const char *const type_names[] = {
+        /* indexed by the LOGEV_* enumeration in putty.h */
+        "kex", "auth-success", "auth-failure",
+    };
+    size_t i;
+
+    put_data(out, "{\"event\":", 9);
+    if (type >= 0 && type < (int)lenof(type_names))
+        log_structured_json_string(out, type_names[type]);
+    else
+        strbuf_catf(out, "%d", type);
+    for (i = 0; i < nfields; i++) {
+        put_byte(out, ',');
+        log_structured_json_string(out, keys[i]);
+        put_byte(out, ':');
+        log_structured_json_string(out, values[i]);
+    }
+    put_byte(out, '}');
+}
+
+/*
+ * Record that session startup has reached a named phase, and emit an
+ * Event Log line giving the time since the first phase mark and the
+ * time spent in the phase just finished. The lines all share the
+ * fixed prefix "Startup phase:" and field layout, so that a script
+ * reading an event log or packet log can extract a complete startup
+ * profile of a connection and attribute the total connect time to
+ * the individual protocol layers.
+ *
+ * The first call (made by the backend when it begins setting up its
+ * network connection) establishes the time base; nothing interesting
+ * can have happened before that, because the LogContext is created
+ * just beforehand.
+ */
+void log_startup_phase(LogContext *ctx, const char *phase)
+{
+    unsigned long now;
+
+    if (!ctx)
+        return;
+
+    now = GETTICKCOUNT();
+    if (!ctx->startup_prof_started) {
+        ctx->startup_prof_started = true;
+        ctx->startup_prof_base = ctx->startup_prof_prev = now;
+    }
+    logeventf(ctx, "Startup phase: %s (t+%lu ms, phase %lu ms)", phase,
+              now - ctx->startup_prof_base, now - ctx->startup_prof_prev);
+    ctx->startup_prof_prev = now;
+}
+
 /*
  * Log an SSH packet.
  * If n_blanks != 0, blank or omit some parts.
@@ -289,8 +609,16 @@ void log_packet(LogContext *ctx, int direction, int type,
     int output_pos = 0; /* NZ if pending output in dumpdata */
 
     if (!(ctx->logtype == LGTYP_SSHRAW ||
-          (ctx->logtype == LGTYP_PACKETS && texttype)))
+          ((ctx->logtype == LGTYP_PACKETS ||
+            ctx->logtype == LGTYP_SSHBIN) && texttype)))
+        return;
+
+    if (ctx->logtype == LGTYP_SSHBIN) {
+        logbinary_packet(ctx, direction, type, texttype, data, len,
+                         n_blanks, blanks, seq, downstream_id,
+                         additional_log_text);
         return;
+    }
 
     /* Packet header. */
     if (texttype) {
@@ -395,7 +723,7 @@ void log_packet(LogContext *ctx, int direction, int type,
     if (omitted)
         logprintf(ctx, "  (%"SIZEu" byte%s omitted)\r\n",
                   omitted, (omitted==1?"":"s"));
-    logflush(ctx);
+    logflush_soon(ctx);
 }
 
 LogContext *log_init(LogPolicy *lp, Conf *conf)
@@ -406,7 +734,11 @@ LogContext *log_init(LogPolicy *lp, Conf *conf)
     ctx->lp = lp;
     ctx->conf = conf_copy(conf);
     ctx->logtype = conf_get_int(ctx->conf, CONF_logtype);
+    ctx->flush_frequently = conf_get_bool(ctx->conf, CONF_logflush);
+    ctx->flush_pending = false;
     ctx->currlogfilename = NULL;
+    ctx->startup_prof_started = false;
+    ctx->printf_scratch = strbuf_new();
     bufchain_init(&ctx->queue);
     return ctx;
 }
@@ -418,6 +750,8 @@ void log_free(LogContext *ctx)
     if (ctx->currlogfilename)
         filename_free(ctx->currlogfilename);
     conf_free(ctx->conf);
+    strbuf_free(ctx->printf_scratch);
+    delete_callbacks_for_context(ctx);
     sfree(ctx);
 }
 
@@ -440,6 +774,7 @@ void log_reconfig(LogContext *ctx, Conf *conf)
     ctx->conf = conf_copy(conf);
 
     ctx->logtype = conf_get_int(ctx->conf, CONF_logtype);
+    ctx->flush_frequently = conf_get_bool(ctx->conf, CONF_logflush);
 
     if (reset_logging)
         logfopen(ctx);
@@ -0,0 +1,166 @@
+/*
+ * Optional instrumentation for the top-level event loop.
+ *
+ * When enabled (by setting PUTTY_LOOPSTATS in the environment), this
+ * module accumulates a log2 histogram of execution time for each
+ * distinct piece of work the event loop dispatches - each toplevel
+ * callback function, each timer function, and the loop's own dwell
+ * time waiting for events - and counts 'stalls', i.e. single
+ * dispatches that overran a threshold (100ms by default, overridable
+ * via PUTTY_LOOPSTATS_STALL_MS), printing a diagnostic at the moment
+ * each stall happens. The accumulated statistics can be dumped to
+ * standard error at any time by sending the process SIGUSR1 (on
+ * platforms with signals), which is how you find out where the time
+ * went in a session whose keystroke latency is misbehaving.
+ *
+ * When the environment variable is unset, the only cost is one
+ * well-predicted branch per dispatch, so the hooks can stay in the
+ * release builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "putty.h"
+#include "tree234.h"
+
+#if HAVE_CLOCK_GETTIME && HAVE_CLOCK_MONOTONIC
+#include <time.h>
+#endif
+
+/*
+ * Number of log2 buckets. Bucket i counts dispatches taking at least
+ * 2^i and less than 2^(i+1) microseconds, except that the last bucket
+ * has no upper limit; 26 buckets reach dispatches over a minute long.
+ */
+#define LOOPSTATS_BUCKETS 26
+
+struct loopstat {
+    const char *category;              /* static string: "callback" etc */
+    uintptr_t id;                      /* distinguishes sources within it */
+    uint64_t count, stalls;
+    uint64_t total_us, max_us;
+    uint64_t buckets[LOOPSTATS_BUCKETS];
+};
+
+static tree234 *loopstats = NULL;
+static int loopstats_enabled = -1;     /* -1 = not yet looked up */
+static uint64_t stall_threshold_us;
+static volatile int loopstats_dump_flag = 0;
+
+bool loopstats_active(void)
+{
+    if (loopstats_enabled < 0) {
+        loopstats_enabled = (getenv("PUTTY_LOOPSTATS") != NULL);
+        if (loopstats_enabled) {
+            const char *e = getenv("PUTTY_LOOPSTATS_STALL_MS");
+            stall_threshold_us = (e ? strtoul(e, NULL, 10) : 100) * 1000;
+        }
+    }
+    return loopstats_enabled > 0;
+}
+
+uint64_t loopstats_now_us(void)
+{
+#if HAVE_CLOCK_GETTIME && HAVE_CLOCK_MONOTONIC
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    /* Fallback for systems with no monotonic microsecond clock: the
+     * millisecond tick counter, which loses sub-ms resolution but
+     * keeps the histograms usable. */
+    return (uint64_t)GETTICKCOUNT() * 1000;
+}
+
+static int loopstat_cmp(void *av, void *bv)
+{
+    struct loopstat *a = (struct loopstat *)av;
+    struct loopstat *b = (struct loopstat *)bv;
+    int c = strcmp(a->category, b->category);
+    if (c)
+        return c;
+    if (a->id < b->id)
+        return -1;
+    else if (a->id > b->id)
+        return +1;
+    return 0;
+}
+
+void loopstats_record(const char *category, uintptr_t id, uint64_t start_us,
+                      bool blocking)
+{
+    uint64_t us = loopstats_now_us() - start_us;
+    struct loopstat search, *ls;
+    int bucket;
+
+    search.category = category;
+    search.id = id;
+
+    if (!loopstats)
+        loopstats = newtree234(loopstat_cmp);
+    ls = find234(loopstats, &search, NULL);
+    if (!ls) {
+        ls = snew(struct loopstat);
+        memset(ls, 0, sizeof(*ls));
+        ls->category = category;
+        ls->id = id;
+        add234(loopstats, ls);
+    }
+
+    ls->count++;
+    ls->total_us += us;
+    if (us > ls->max_us)
+        ls->max_us = us;
+
+    for (bucket = 0; bucket < LOOPSTATS_BUCKETS - 1; bucket++)
+        if (us < ((uint64_t)1 << (bucket + 1)))
+            break;
+    ls->buckets[bucket]++;
+
+    if (us >= stall_threshold_us && stall_threshold_us && !blocking) {
+        ls->stalls++;
+        fprintf(stderr, "loopstats: stall: %s %#zx ran for %"PRIu64".%03u"
+                "ms\n", category, (size_t)id,
+                us / 1000, (unsigned)(us % 1000));
+    }
+}
+
+/*
+ * Called (e.g. from a signal handler) to request a dump; only sets a
+ * flag, so it's async-signal-safe. The event loop polls the flag via
+ * loopstats_maybe_dump once per iteration.
+ */
+void loopstats_request_dump(void)
+{
+    loopstats_dump_flag = 1;
+}
+
+void loopstats_maybe_dump(void)
+{
+    struct loopstat *ls;
+    int i;
+
+    if (!loopstats_dump_flag)
+        return;
+    loopstats_dump_flag = 0;
+
+    fprintf(stderr, "loopstats: ---- dump begins ----\n");
+    for (i = 0; loopstats && (ls = index234(loopstats, i)) != NULL; i++) {
+        int bucket;
+
+        fprintf(stderr, "loopstats: %s %#zx: n=%"PRIu64
+                " total=%"PRIu64"us mean=%"PRIu64"us max=%"PRIu64"us"
+                " stalls=%"PRIu64"\n  histogram(us):",
+                ls->category, (size_t)ls->id, ls->count, ls->total_us,
+                ls->total_us / ls->count, ls->max_us, ls->stalls);
+        for (bucket = 0; bucket < LOOPSTATS_BUCKETS; bucket++)
+            if (ls->buckets[bucket])
+                fprintf(stderr, " %"PRIu64"+:%"PRIu64,
+                        bucket ? (uint64_t)1 << bucket : 0,
+                        ls->buckets[bucket]);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "loopstats: ---- dump ends ----\n");
+}
@@ -12,6 +12,17 @@
  */
 struct BinarySink {
     void (*write)(BinarySink *sink, const void *data, size_t len);
+
+    /*
+     * Optional method: sinks which accumulate their output in a
+     * contiguous memory buffer can provide this, and then clients may
+     * use put_reserve to obtain a writable span inside the buffer
+     * instead of marshalling into temporary storage and copying. Left
+     * null by the ordinary BinarySink_INIT, for sinks which write
+     * their data irrecoverably (hashes, files, networks).
+     */
+    void *(*reserve)(BinarySink *sink, size_t len);
+
     BinarySink *binarysink_;
 };
 
@@ -25,6 +36,16 @@ struct BinarySink {
 #define BinarySink_IMPLEMENTATION BinarySink binarysink_[1]
 #define BinarySink_INIT(obj, writefn) \
     ((obj)->binarysink_->write = (writefn), \
+     (obj)->binarysink_->reserve = NULL, \
+     (obj)->binarysink_->binarysink_ = (obj)->binarysink_)
+
+/*
+ * Variant initialisation macro for sinks that can also provide the
+ * optional reserve() method.
+ */
+#define BinarySink_INIT_RESERVABLE(obj, writefn, reservefn) \
+    ((obj)->binarysink_->write = (writefn), \
+     (obj)->binarysink_->reserve = (reservefn), \
      (obj)->binarysink_->binarysink_ = (obj)->binarysink_)
 
 /*
@@ -139,6 +160,23 @@ struct BinarySink {
 #define put_datapl(bs, pl) \
     BinarySink_put_datapl(BinarySink_UPCAST(bs), pl)
 
+/* Vectored form of put_data: append a sequence of ptrlen views in one
+ * call, without first having to concatenate them into a temporary
+ * buffer. */
+#define put_datav(bs, views, nviews) \
+    BinarySink_put_datav(BinarySink_UPCAST(bs), views, nviews)
+
+/* Advance the sink's output position by len bytes and return a
+ * writable pointer to the skipped-over span, so the caller can fill
+ * it in directly (or come back and fill it in later, e.g. a length
+ * field only known once the rest of the data is written). Returns
+ * NULL if the sink doesn't store its output in a form that makes this
+ * possible; the contents of the span are undefined until the caller
+ * writes them, and the pointer is invalidated by the next put_* call
+ * on the same sink. */
+#define put_reserve(bs, len) \
+    BinarySink_put_reserve(BinarySink_UPCAST(bs), len)
+
 /*
  * The underlying real C functions that implement most of those
  * macros. Generally you won't want to call these directly, because
@@ -151,6 +189,8 @@ struct BinarySink {
  */
 void BinarySink_put_data(BinarySink *, const void *data, size_t len);
 void BinarySink_put_datapl(BinarySink *, ptrlen);
+void BinarySink_put_datav(BinarySink *, const ptrlen *views, size_t nviews);
+void *BinarySink_put_reserve(BinarySink *, size_t len);
 void BinarySink_put_padding(BinarySink *, size_t len, unsigned char padbyte);
 void BinarySink_put_byte(BinarySink *, unsigned char);
 void BinarySink_put_bool(BinarySink *, bool);
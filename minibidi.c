@@ -354,7 +354,7 @@ perl -ne 'split ";"; $num = hex $_[0]; $type = $_[4];' \
     UnicodeData.txt
 
  */
-static unsigned char getType(int ch)
+static unsigned char getType_uncached(int ch)
 {
     static const struct {
         int first, last, type;
@@ -1005,6 +1005,36 @@ static unsigned char getType(int ch)
     return ON;
 }
 
+/*
+ * Two-level (page/offset) lookup table in front of the interval data
+ * above, in the same style as the one in wcwidth.c: bidi class
+ * lookup is the innermost operation of the analysis loops below, and
+ * an O(1) array index beats a binary search per character. Pages of
+ * 256 classes are built on demand from the interval table, which
+ * remains the single source of Unicode truth; only the handful of
+ * pages a session actually uses get built.
+ */
+#define BIDI_TYPE_NPAGES (0x110000 / 256)
+
+static unsigned char getType(int ch)
+{
+    static unsigned char *pages[BIDI_TYPE_NPAGES];
+    unsigned char *page;
+
+    if (ch < 0 || ch >= 0x110000)
+        return getType_uncached(ch);
+
+    page = pages[ch >> 8];
+    if (!page) {
+        int base = ch & ~0xFF, i;
+        page = snewn(256, unsigned char);
+        for (i = 0; i < 256; i++)
+            page[i] = getType_uncached(base + i);
+        pages[ch >> 8] = page;
+    }
+    return page[ch & 0xFF];
+}
+
 /*
  * Function exported to front ends to allow them to identify
  * bidi-active characters (in case, for example, the platform's
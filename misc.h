@@ -106,9 +106,25 @@ bool strendswith(const char *s, const char *t);
 void base64_encode_atom(const unsigned char *data, int n, char *out);
 int base64_decode_atom(const char *atom, unsigned char *out);
 
+/*
+ * Whole-buffer base64 codec, for things the size of key file blobs.
+ * Encoding emits a newline after every cpl characters and a final
+ * one, or no newlines at all if cpl <= 0. Decoding treats the input
+ * as a sequence of 4-character atoms with the same acceptance rules
+ * as base64_decode_atom, and returns failure (false, or NULL) if the
+ * length is not a multiple of 4 or any atom is invalid.
+ */
+void base64_encode_bs(BinarySink *bs, ptrlen input, int cpl);
+void base64_encode(FILE *fp, const unsigned char *data, int datalen, int cpl);
+bool base64_decode_bs(BinarySink *bs, ptrlen input);
+strbuf *base64_decode_sb(ptrlen input);
+
 struct bufchain_granule;
 struct bufchain_tag {
     struct bufchain_granule *head, *tail;
+    struct bufchain_granule *spare;    /* free list of reusable granules */
+    size_t nspare;
+    size_t granule_size;     /* allocation size of a standard granule */
     size_t buffersize;           /* current amount of buffered data */
 
     void (*queue_idempotent_callback)(IdempotentCallback *ic);
@@ -118,8 +134,14 @@ struct bufchain_tag {
 void bufchain_init(bufchain *ch);
 void bufchain_clear(bufchain *ch);
 size_t bufchain_size(bufchain *ch);
+void bufchain_set_granule_size(bufchain *ch, size_t size);
 void bufchain_add(bufchain *ch, const void *data, size_t len);
 ptrlen bufchain_prefix(bufchain *ch);
+/* Fill in up to maxprefixes (pointer,length) pairs covering the
+ * initial data in the chain, one per granule, and return how many
+ * were filled in. Useful for gathering several granules into one
+ * writev-style system call. */
+size_t bufchain_prefixes(bufchain *ch, ptrlen *prefixes, size_t maxprefixes);
 void bufchain_consume(bufchain *ch, size_t len);
 void bufchain_fetch(bufchain *ch, void *data, size_t len);
 void bufchain_fetch_consume(bufchain *ch, void *data, size_t len);
@@ -265,6 +287,21 @@ void debug_memdump(const void *buf, int len, bool L);
 #define lenof(x) ( (sizeof((x))) / (sizeof(*(x))))
 #endif
 
+/*
+ * Optional self-profiling of the bulk crypto primitives, in
+ * utils/cryptoprof.c. Enabled by setting PUTTY_CRYPTOPROF in the
+ * environment; when disabled, cryptoprof_active() returns false and
+ * the dispatch wrappers in ssh.h skip the rest. Timed dispatches
+ * bracket the work with cryptoprof_ticks() (the CPU cycle counter
+ * where available) and cryptoprof_record(), identified by a category
+ * string and the algorithm implementation's text name; accumulated
+ * per-algorithm totals are dumped to stderr at exit.
+ */
+bool cryptoprof_active(void);
+uint64_t cryptoprof_ticks(void);
+void cryptoprof_record(const char *category, const char *name,
+                       uint64_t start_ticks, size_t bytes);
+
 #ifndef min
 #define min(x,y) ( (x) < (y) ? (x) : (y) )
 #endif
@@ -42,6 +42,19 @@ mp_int *mp_new(size_t maxbits);
 void mp_free(mp_int *);
 void mp_clear(mp_int *x);
 
+/*
+ * mp_new and mp_free recycle allocations through an internal pool,
+ * which is not thread-safe. Code that's about to run mp functions on
+ * more than one thread at once (e.g. via run_in_parallel or
+ * run_in_worker_thread) must bracket the threaded section with these
+ * calls, which suspend the pool so that every allocation goes to the
+ * ordinary heap. The suspend must happen before the extra threads are
+ * created and the resume after they're joined, so that the flag
+ * change is properly synchronised. Calls may nest.
+ */
+void mp_pool_suspend(void);
+void mp_pool_resume(void);
+
 /*
  * Create mp_ints from various sources: little- and big-endian binary
  * data, an ordinary C unsigned integer type, a decimal or hex string
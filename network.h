@@ -33,6 +33,10 @@ struct SocketVtable {
     void (*write_eof) (Socket *s);
     void (*set_frozen) (Socket *s, bool is_frozen);
     /* ignored by tcp, but vital for ssl */
+    void (*set_buffer_sizes) (Socket *s, int sndbuf, int rcvbuf);
+    /* may be NULL, for socket types with no kernel buffers to adjust */
+    void (*set_corked) (Socket *s, bool corked);
+    /* may be NULL; see sk_set_corked below */
     const char *(*socket_error) (Socket *s);
     SocketPeerInfo *(*peer_info) (Socket *s);
 };
@@ -177,6 +181,24 @@ void sk_cleanup(void);                 /* called just before program exit */
 
 SockAddr *sk_namelookup(const char *host, char **canonicalname, int address_family);
 SockAddr *sk_nonamelookup(const char *host);
+
+/*
+ * Asynchronous version of sk_namelookup, for callers that can't
+ * afford to stall their event loop for the duration of a slow DNS
+ * query. The lookup happens without blocking (on Unix, in a forked
+ * subprocess), and 'callback' is called from the top level once the
+ * answer is known, passing the resulting SockAddr and canonical name,
+ * both of which the callback takes ownership of. The returned handle
+ * can be used to cancel the lookup at any time before the callback
+ * has happened.
+ */
+typedef void (*sk_namelookup_fn_t)(
+    SockAddr *addr, char *canonicalname, void *vctx);
+typedef struct pending_lookup pending_lookup;
+pending_lookup *sk_namelookup_async(
+    const char *host, int address_family,
+    sk_namelookup_fn_t callback, void *vctx);
+void sk_namelookup_cancel(pending_lookup *pl);
 void sk_getaddr(SockAddr *addr, char *buf, int buflen);
 bool sk_addr_needs_port(SockAddr *addr);
 bool sk_hostname_is_local(const char *name);
@@ -253,6 +275,46 @@ static inline const char *sk_socket_error(Socket *s)
 static inline void sk_set_frozen(Socket *s, bool is_frozen)
 { s->vt->set_frozen(s, is_frozen); }
 
+/*
+ * Request particular sizes, in bytes, for the kernel's send and
+ * receive buffers on a socket. Either size can be 0, meaning to leave
+ * that buffer at the OS's default size (and hence, on platforms that
+ * do such a thing, under the kernel's own autotuning). This is a
+ * best-effort request: the kernel may clamp or round the sizes, and
+ * socket types with no underlying kernel socket (e.g. the error
+ * socket, or an SSH jump-host connection) will ignore it entirely.
+ *
+ * The intended use is for high-bandwidth-delay-product links, where
+ * the OS's default buffer limits the usable window, and conversely
+ * for users running very large numbers of mostly idle connections,
+ * who would rather not pay the default buffer size per socket.
+ */
+static inline void sk_set_buffer_sizes(Socket *s, int sndbuf, int rcvbuf)
+{
+    if (s->vt->set_buffer_sizes)
+        s->vt->set_buffer_sizes(s, sndbuf, rcvbuf);
+}
+
+/*
+ * Cork or uncork a socket. While a socket is corked, small writes are
+ * held back and coalesced by the kernel, so a caller that knows it's
+ * about to make several writes in quick succession (e.g. a burst of
+ * small protocol packets generated in one pass round the event loop)
+ * can cork beforehand and uncork afterwards, and have the whole burst
+ * leave as a minimal number of TCP segments. Uncorking pushes out
+ * anything still held.
+ *
+ * This is a best-effort hint: socket types with no way to implement
+ * it ignore it, and even kernels with real cork support impose a time
+ * limit, so forgetting to uncork costs latency rather than
+ * correctness. Calls needn't be balanced or in any particular order.
+ */
+static inline void sk_set_corked(Socket *s, bool corked)
+{
+    if (s->vt->set_corked)
+        s->vt->set_corked(s, corked);
+}
+
 /*
  * Return a structure giving some information about the other end of
  * the socket. May be NULL, if nothing is available at all. If it is
@@ -514,8 +514,41 @@ static void do_telnet_read(Telnet *telnet, const char *buf, size_t len)
 {
     strbuf *outbuf = strbuf_new_nm();
 
-    while (len--) {
-        int c = (unsigned char) *buf++;
+    while (len > 0) {
+        int c;
+
+        if (telnet->state == TOP_LEVEL && !telnet->in_synch) {
+            /*
+             * Fast path: in the ordinary data state, the only bytes
+             * that need the state machine at all are IAC, and CR if
+             * we have to watch for the CR NUL encoding (i.e. when
+             * the other side isn't in binary mode). Scan ahead for
+             * the first byte of interest and forward everything
+             * before it wholesale.
+             */
+            const char *stop = memchr(buf, (char)IAC, len);
+            if (telnet->opt_states[o_they_bin.index] != ACTIVE) {
+                const char *cr = memchr(buf, CR, stop ? stop - buf : len);
+                if (cr)
+                    stop = cr;
+            }
+
+            size_t n = stop ? stop - buf : len;
+            if (n) {
+                put_data(outbuf, buf, n);
+                buf += n;
+                len -= n;
+                if (outbuf->len >= 4096) {
+                    c_write(telnet, outbuf->u, outbuf->len);
+                    strbuf_clear(outbuf);
+                }
+                if (!len)
+                    break;
+            }
+        }
+
+        c = (unsigned char) *buf++;
+        len--;
 
         switch (telnet->state) {
           case TOP_LEVEL:
@@ -105,6 +105,10 @@ struct PageantKey {
     };
     strbuf *encrypted_key_file;
     bool decryption_prompt_active;
+    /* Usage statistics: how many signing operations this key has
+     * performed, and a sequence number recording when the last one
+     * was, so that key lists can present recently used keys first. */
+    uint64_t nsignatures, last_used;
     PageantKeyRequestNode blocked_requests;
     PageantClientDialogId dlgid;
 };
@@ -125,6 +129,15 @@ struct PageantSignOp {
  * progress */
 static bool gui_request_in_progress = false;
 
+/* List of sign requests that are waiting for that lock, so that they
+ * can be woken back up when it's released. These are requests for
+ * keys _other_ than the one the current GUI prompt is about (those
+ * block on the per-key list in PageantKey instead), so they needn't
+ * wait for each other once the lock is free. */
+static PageantKeyRequestNode gui_blocked_requests = {
+    &gui_blocked_requests, &gui_blocked_requests
+};
+
 static void failure(PageantClient *pc, PageantClientRequestId *reqid,
                     strbuf *sb, unsigned char type, const char *fmt, ...);
 static void fail_requests_for_key(PageantKey *pk, const char *reason);
@@ -159,6 +172,16 @@ static int cmpkeys(void *av, void *bv)
         return ptrlen_strcmp(a->public_blob, b->public_blob);
 }
 
+/* Monotonic counter whose current value is stamped into a key's
+ * last_used field each time the key is used for signing */
+static uint64_t key_usage_counter = 0;
+
+static void pk_mark_used(PageantKey *pk)
+{
+    pk->nsignatures++;
+    pk->last_used = ++key_usage_counter;
+}
+
 static inline PageantKeySort keysort(int version, ptrlen blob)
 {
     PageantKeySort sort;
@@ -276,16 +299,41 @@ static void remove_all_keys(int ssh_version)
     }
 }
 
+/*
+ * qsort comparison routine used when constructing a key list: most
+ * recently used keys first, with never-used keys after those in the
+ * key tree's own order. Clients such as OpenSSH try the identities
+ * we offer in order, so with many keys loaded this gets the key
+ * that's actually being used for authentication tried sooner.
+ */
+static int keyusagecmp(const void *av, const void *bv)
+{
+    PageantKey *a = *(PageantKey *const *)av;
+    PageantKey *b = *(PageantKey *const *)bv;
+
+    if (a->last_used != b->last_used)
+        return a->last_used > b->last_used ? -1 : +1;
+    return cmpkeys(&a->sort, &b->sort);
+}
+
 static void list_keys(BinarySink *bs, int ssh_version, bool extended)
 {
-    int i;
-    PageantKey *pk;
+    int i, first, nkeys;
+    PageantKey *pk, **keylist;
 
-    put_uint32(bs, count_keys(ssh_version));
-    for (i = find_first_key_for_version(ssh_version);
-         NULL != (pk = index234(keytree, i)); i++) {
-        if (pk->sort.ssh_version != ssh_version)
-            break;
+    first = find_first_key_for_version(ssh_version);
+    nkeys = count_keys(ssh_version);
+    put_uint32(bs, nkeys);
+
+    keylist = snewn(nkeys, PageantKey *);
+    for (i = 0; i < nkeys; i++) {
+        keylist[i] = index234(keytree, first + i);
+        assert(keylist[i]->sort.ssh_version == ssh_version);
+    }
+    qsort(keylist, nkeys, sizeof(*keylist), keyusagecmp);
+
+    for (i = 0; i < nkeys; i++) {
+        pk = keylist[i];
 
         if (ssh_version > 1)
             put_stringpl(bs, pk->sort.public_blob);
@@ -315,6 +363,8 @@ static void list_keys(BinarySink *bs, int ssh_version, bool extended)
             put_stringsb(bs, sb);
         }
     }
+
+    sfree(keylist);
 }
 
 void pageant_make_keylist1(BinarySink *bs) { list_keys(bs, 1, false); }
@@ -359,13 +409,13 @@ static PRINTF_LIKE(5, 6) void failure(
     }
 }
 
-static void signop_link(PageantSignOp *so)
+static void signop_link(PageantKeyRequestNode *list, PageantSignOp *so)
 {
     assert(!so->pkr.prev);
     assert(!so->pkr.next);
 
-    so->pkr.prev = so->pk->blocked_requests.prev;
-    so->pkr.next = &so->pk->blocked_requests;
+    so->pkr.prev = list->prev;
+    so->pkr.next = list;
     so->pkr.prev->next = &so->pkr;
     so->pkr.next->prev = &so->pkr;
 }
@@ -376,6 +426,7 @@ static void signop_unlink(PageantSignOp *so)
         assert(so->pkr.prev);
         so->pkr.next->prev = so->pkr.prev;
         so->pkr.prev->next = so->pkr.next;
+        so->pkr.prev = so->pkr.next = NULL;
     } else {
         assert(!so->pkr.prev);
     }
@@ -384,6 +435,9 @@ static void signop_unlink(PageantSignOp *so)
 static void signop_free(PageantAsyncOp *pao)
 {
     PageantSignOp *so = container_of(pao, PageantSignOp, pao);
+    /* If we're freed while still blocked on a key's request list (or
+     * the GUI lock's), take ourselves off it first. */
+    signop_unlink(so);
     strbuf_free(so->data_to_sign);
     sfree(so);
 }
@@ -413,8 +467,18 @@ static void signop_coroutine(PageantAsyncOp *pao)
 
     crBegin(so->crLine);
 
-    while (!so->pk->skey && gui_request_in_progress)
+    /*
+     * If we need this key decrypted but some other key's passphrase
+     * prompt currently holds the GUI lock, wait on the lock's queue
+     * until it's released. Requests for already-decrypted keys don't
+     * come through here at all, so they're never stalled by another
+     * key's prompt.
+     */
+    while (!so->pk->skey && gui_request_in_progress) {
+        signop_link(&gui_blocked_requests, so);
         crReturnV;
+        signop_unlink(so);
+    }
 
     if (!so->pk->skey) {
         assert(so->pk->encrypted_key_file);
@@ -427,7 +491,7 @@ static void signop_coroutine(PageantAsyncOp *pao)
             goto respond;
         }
 
-        signop_link(so);
+        signop_link(&so->pk->blocked_requests, so);
         crReturnV;
         signop_unlink(so);
     }
@@ -454,6 +518,8 @@ static void signop_coroutine(PageantAsyncOp *pao)
         goto respond;
     }
 
+    pk_mark_used(so->pk);
+
     strbuf *signature = strbuf_new();
     ssh_key_sign(so->pk->skey->key, ptrlen_from_strbuf(so->data_to_sign),
                  so->flags, BinarySink_UPCAST(signature));
@@ -492,16 +558,20 @@ static void fail_requests_for_key(PageantKey *pk, const char *reason)
     }
 }
 
-static void unblock_requests_for_key(PageantKey *pk)
+static void unblock_requests_on_list(PageantKeyRequestNode *list)
 {
-    for (PageantKeyRequestNode *pkr = pk->blocked_requests.next;
-         pkr != &pk->blocked_requests; pkr = pkr->next) {
-        PageantSignOp *so = container_of(pk->blocked_requests.next,
-                                         PageantSignOp, pkr);
+    for (PageantKeyRequestNode *pkr = list->next; pkr != list;
+         pkr = pkr->next) {
+        PageantSignOp *so = container_of(pkr, PageantSignOp, pkr);
         queue_toplevel_callback(pageant_async_op_callback, &so->pao);
     }
 }
 
+static void unblock_requests_for_key(PageantKey *pk)
+{
+    unblock_requests_on_list(&pk->blocked_requests);
+}
+
 void pageant_passphrase_request_success(PageantClientDialogId *dlgid,
                                         ptrlen passphrase)
 {
@@ -511,6 +581,15 @@ void pageant_passphrase_request_success(PageantClientDialogId *dlgid,
     gui_request_in_progress = false;
     pk->decryption_prompt_active = false;
 
+    /*
+     * Now the GUI lock is free, wake up any sign requests for other
+     * keys that were waiting for it, so that they can put up their
+     * own decryption prompts in turn. (If we retake the lock below
+     * for another attempt at this key, they'll just re-queue
+     * themselves behind it.)
+     */
+    unblock_requests_on_list(&gui_blocked_requests);
+
     if (!pk->skey) {
         const char *error;
 
@@ -570,6 +649,8 @@ void pageant_passphrase_request_refused(PageantClientDialogId *dlgid)
     gui_request_in_progress = false;
     pk->decryption_prompt_active = false;
 
+    unblock_requests_on_list(&gui_blocked_requests);
+
     fail_requests_for_key(pk, "user refused to supply passphrase");
 }
 
@@ -757,6 +838,7 @@ static PageantAsyncOp *pageant_make_op(
             fail("key not found");
             goto challenge1_cleanup;
         }
+        pk_mark_used(pk);
         response = rsa_ssh1_decrypt(challenge, pk->rkey);
 
         {
@@ -25,17 +25,43 @@ static void pinger_timer(void *ctx, unsigned long now)
     }
 }
 
+/*
+ * To avoid a host full of mostly-idle sessions waking the CPU at
+ * hundreds of individually staggered moments, we round each ping's
+ * deadline down to a multiple of a shared quantum, derived from the
+ * ping interval but capped at PINGER_MAX_SLACK. All pings due within
+ * the same quantum then land on the same tick, and are sent in a
+ * single run_timers pass; and since the tick count derives from a
+ * system-wide monotonic clock on most platforms, separate processes
+ * land on the same boundaries too. Rounding down means a ping can go
+ * out early - never late - by at most the quantum, i.e. by at most
+ * an eighth of the interval.
+ */
+#define PINGER_MAX_SLACK (30 * TICKSPERSEC)
+
 static void pinger_schedule(Pinger *pinger)
 {
-    unsigned long next;
+    unsigned long ticks, slack, next;
 
     if (!pinger->interval) {
         pinger->pending = false;       /* cancel any pending ping */
         return;
     }
 
-    next = schedule_timer(pinger->interval * TICKSPERSEC,
-                          pinger_timer, pinger);
+    ticks = pinger->interval * TICKSPERSEC;
+
+    slack = ticks / 8;
+    if (slack > PINGER_MAX_SLACK)
+        slack = PINGER_MAX_SLACK;
+    slack -= slack % TICKSPERSEC;      /* whole seconds only */
+    if (slack) {
+        unsigned long now = GETTICKCOUNT();
+        unsigned long when = now + ticks;
+        when -= when % slack;
+        ticks = when - now;
+    }
+
+    next = schedule_timer(ticks, pinger_timer, pinger);
     if (!pinger->pending ||
         (next - pinger->when_set) < (pinger->next - pinger->when_set)) {
         pinger->next = next;
@@ -85,7 +85,10 @@ static void sk_proxy_close (Socket *s)
 {
     ProxySocket *ps = container_of(s, ProxySocket, sock);
 
-    sk_close(ps->sub_socket);
+    if (ps->lookup)
+        sk_namelookup_cancel(ps->lookup);
+    if (ps->sub_socket)
+        sk_close(ps->sub_socket);
     sk_addr_free(ps->remote_addr);
     sfree(ps);
 }
@@ -162,6 +165,29 @@ static void sk_proxy_set_frozen (Socket *s, bool is_frozen)
     sk_set_frozen(ps->sub_socket, is_frozen);
 }
 
+static void sk_proxy_set_buffer_sizes(Socket *s, int sndbuf, int rcvbuf)
+{
+    ProxySocket *ps = container_of(s, ProxySocket, sock);
+    ps->sndbuf = sndbuf;
+    ps->rcvbuf = rcvbuf;
+    /* If the underlying socket isn't created yet (e.g. we're still
+     * looking up the proxy host's name), the sizes are applied when
+     * it is, in proxy_lookup_done. */
+    if (ps->sub_socket)
+        sk_set_buffer_sizes(ps->sub_socket, sndbuf, rcvbuf);
+}
+
+static void sk_proxy_set_corked(Socket *s, bool corked)
+{
+    ProxySocket *ps = container_of(s, ProxySocket, sock);
+    /* Cork state is a transient per-burst hint, so there's no point
+     * remembering it for a sub-socket that doesn't exist yet: any
+     * writes made before then are buffered in this structure and will
+     * go out in one go when the proxy negotiation finishes anyway. */
+    if (ps->sub_socket)
+        sk_set_corked(ps->sub_socket, corked);
+}
+
 static const char * sk_proxy_socket_error (Socket *s)
 {
     ProxySocket *ps = container_of(s, ProxySocket, sock);
@@ -240,6 +266,68 @@ static int plug_proxy_accepting(Plug *p,
     return plug_accepting(ps->plug, constructor, ctx);
 }
 
+/*
+ * The compiled form of the proxy exclude list, kept process-wide so
+ * that it's built once per configuration rather than re-parsed for
+ * every connection (which includes every port-forwarded socket in a
+ * session). We remember the source string it was compiled from, so
+ * that a mid-session configuration change just triggers a rebuild.
+ */
+static char *proxy_exclude_str = NULL;
+static WCPatternSet *proxy_exclude_set = NULL;
+
+static WCPatternSet *proxy_exclude_patterns(Conf *conf)
+{
+    const char *exclude_list = conf_get_str(conf, CONF_proxy_exclude_list);
+    int s = 0, e;
+
+    if (proxy_exclude_str && !strcmp(proxy_exclude_str, exclude_list))
+        return proxy_exclude_set;
+
+    sfree(proxy_exclude_str);
+    wc_pattern_set_free(proxy_exclude_set);
+    proxy_exclude_str = dupstr(exclude_list);
+    proxy_exclude_set = wc_pattern_set_new();
+
+    while (exclude_list[s]) {
+        while (exclude_list[s] &&
+               (isspace((unsigned char)exclude_list[s]) ||
+                exclude_list[s] == ',')) s++;
+
+        if (!exclude_list[s]) break;
+
+        e = s;
+
+        while (exclude_list[e] &&
+               (isalnum((unsigned char)exclude_list[e]) ||
+                exclude_list[e] == '-' ||
+                exclude_list[e] == '.' ||
+                exclude_list[e] == '*')) e++;
+
+        {
+            /* Host names match caselessly, so fold the entry to
+             * lower case before compiling it; queries are folded the
+             * same way. */
+            char *entry = snewn(e - s + 1, char);
+            int i;
+            for (i = 0; i < e - s; i++)
+                entry[i] = tolower((unsigned char)exclude_list[s + i]);
+            entry[e - s] = '\0';
+            wc_pattern_set_add(proxy_exclude_set, entry);
+            sfree(entry);
+        }
+
+        s = e;
+
+        /* Make sure we really have reached the next comma or end-of-string */
+        while (exclude_list[s] &&
+               !isspace((unsigned char)exclude_list[s]) &&
+               exclude_list[s] != ',') s++;
+    }
+
+    return proxy_exclude_set;
+}
+
 /*
  * This function can accept a NULL pointer as `addr', in which case
  * it will only check the host name.
@@ -247,10 +335,10 @@ static int plug_proxy_accepting(Plug *p,
 static bool proxy_for_destination(SockAddr *addr, const char *hostname,
                                   int port, Conf *conf)
 {
-    int s = 0, e = 0;
     char hostip[64];
-    int hostip_len, hostname_len;
-    const char *exclude_list;
+    WCPatternSet *excludes;
+    char *hostname_lc, *p;
+    bool excluded;
 
     /*
      * Special local connections such as Unix-domain sockets
@@ -270,72 +358,29 @@ static bool proxy_for_destination(SockAddr *addr, const char *hostname,
          (addr && sk_address_is_local(addr))))
         return false;                  /* do not proxy */
 
-    /* we want a string representation of the IP address for comparisons */
-    if (addr) {
-        sk_getaddr(addr, hostip, 64);
-        hostip_len = strlen(hostip);
-    } else
-        hostip_len = 0;                /* placate gcc; shouldn't be required */
-
-    hostname_len = strlen(hostname);
-
-    exclude_list = conf_get_str(conf, CONF_proxy_exclude_list);
-
-    /* now parse the exclude list, and see if either our IP
+    /* now check the exclude list, and see if either our IP
      * or hostname matches anything in it.
      */
 
-    while (exclude_list[s]) {
-        while (exclude_list[s] &&
-               (isspace((unsigned char)exclude_list[s]) ||
-                exclude_list[s] == ',')) s++;
-
-        if (!exclude_list[s]) break;
-
-        e = s;
-
-        while (exclude_list[e] &&
-               (isalnum((unsigned char)exclude_list[e]) ||
-                exclude_list[e] == '-' ||
-                exclude_list[e] == '.' ||
-                exclude_list[e] == '*')) e++;
-
-        if (exclude_list[s] == '*') {
-            /* wildcard at beginning of entry */
-
-            if ((addr && strnicmp(hostip + hostip_len - (e - s - 1),
-                                  exclude_list + s + 1, e - s - 1) == 0) ||
-                strnicmp(hostname + hostname_len - (e - s - 1),
-                         exclude_list + s + 1, e - s - 1) == 0) {
-                /* IP/hostname range excluded. do not use proxy. */
-                return false;
-            }
-        } else if (exclude_list[e-1] == '*') {
-            /* wildcard at end of entry */
+    excludes = proxy_exclude_patterns(conf);
 
-            if ((addr && strnicmp(hostip, exclude_list + s, e - s - 1) == 0) ||
-                strnicmp(hostname, exclude_list + s, e - s - 1) == 0) {
-                /* IP/hostname range excluded. do not use proxy. */
-                return false;
-            }
-        } else {
-            /* no wildcard at either end, so let's try an absolute
-             * match (ie. a specific IP)
-             */
+    /* we want a string representation of the IP address for comparisons */
+    if (addr) {
+        sk_getaddr(addr, hostip, 64);
+        for (p = hostip; *p; p++)
+            *p = tolower((unsigned char)*p);
+    }
 
-            if (addr && strnicmp(hostip, exclude_list + s, e - s) == 0)
-                return false; /* IP/hostname excluded. do not use proxy. */
-            if (strnicmp(hostname, exclude_list + s, e - s) == 0)
-                return false; /* IP/hostname excluded. do not use proxy. */
-        }
+    hostname_lc = dupstr(hostname);
+    for (p = hostname_lc; *p; p++)
+        *p = tolower((unsigned char)*p);
 
-        s = e;
+    excluded = ((addr && wc_pattern_set_match(excludes, hostip)) ||
+                wc_pattern_set_match(excludes, hostname_lc));
+    sfree(hostname_lc);
 
-        /* Make sure we really have reached the next comma or end-of-string */
-        while (exclude_list[s] &&
-               !isspace((unsigned char)exclude_list[s]) &&
-               exclude_list[s] != ',') s++;
-    }
+    if (excluded)
+        return false;     /* IP/hostname excluded. do not use proxy. */
 
     /* no matches in the exclude list, so use the proxy */
     return true;
@@ -380,6 +425,8 @@ static const SocketVtable ProxySocket_sockvt = {
     .write_oob = sk_proxy_write_oob,
     .write_eof = sk_proxy_write_eof,
     .set_frozen = sk_proxy_set_frozen,
+    .set_buffer_sizes = sk_proxy_set_buffer_sizes,
+    .set_corked = sk_proxy_set_corked,
     .socket_error = sk_proxy_socket_error,
     .peer_info = NULL,
 };
@@ -392,6 +439,52 @@ static const PlugVtable ProxySocket_plugvt = {
     .accepting = plug_proxy_accepting
 };
 
+static void proxy_lookup_done(SockAddr *proxy_addr, char *canonicalname,
+                              void *vctx)
+{
+    ProxySocket *ret = (ProxySocket *)vctx;
+    ret->lookup = NULL;
+    sfree(canonicalname);
+
+    if (sk_addr_error(proxy_addr) != NULL) {
+        ret->error = "Proxy error: Unable to resolve proxy host name";
+        sk_addr_free(proxy_addr);
+        plug_closing(ret->plug, ret->error, PROXY_ERROR_GENERAL, false);
+        return;
+    }
+
+    {
+        char addrbuf[256], *logmsg;
+        sk_getaddr(proxy_addr, addrbuf, lenof(addrbuf));
+        logmsg = dupprintf("Connecting to %s proxy at %s port %d",
+                           ret->proxy_type_name, addrbuf,
+                           conf_get_int(ret->conf, CONF_proxy_port));
+        plug_log(ret->plug, PLUGLOG_PROXY_MSG, NULL, 0, logmsg, 0);
+        sfree(logmsg);
+    }
+
+    /* create the actual socket we will be using,
+     * connected to our proxy server and port.
+     */
+    ret->sub_socket = sk_new(proxy_addr,
+                             conf_get_int(ret->conf, CONF_proxy_port),
+                             ret->conn_privport, ret->conn_oobinline,
+                             ret->conn_nodelay, ret->conn_keepalive,
+                             &ret->plugimpl);
+    if (sk_socket_error(ret->sub_socket) != NULL) {
+        plug_closing(ret->plug, sk_socket_error(ret->sub_socket),
+                     PROXY_ERROR_GENERAL, false);
+        return;
+    }
+
+    if (ret->sndbuf || ret->rcvbuf)
+        sk_set_buffer_sizes(ret->sub_socket, ret->sndbuf, ret->rcvbuf);
+
+    /* start the proxy negotiation process... */
+    sk_set_frozen(ret->sub_socket, false);
+    ret->negotiate(ret, PROXY_CHANGE_NEW);
+}
+
 Socket *new_connection(SockAddr *addr, const char *hostname,
                        int port, bool privport,
                        bool oobinline, bool nodelay, bool keepalive,
@@ -403,8 +496,6 @@ Socket *new_connection(SockAddr *addr, const char *hostname,
         proxy_for_destination(addr, hostname, port, conf))
     {
         ProxySocket *ret;
-        SockAddr *proxy_addr;
-        char *proxy_canonical_name;
         const char *proxy_type;
         Socket *sret;
 
@@ -430,12 +521,14 @@ Socket *new_connection(SockAddr *addr, const char *hostname,
         ret->error = NULL;
         ret->pending_eof = false;
         ret->freeze = false;
+        ret->sndbuf = ret->rcvbuf = 0;
 
         bufchain_init(&ret->pending_input_data);
         bufchain_init(&ret->pending_output_data);
         bufchain_init(&ret->pending_oob_output_data);
 
         ret->sub_socket = NULL;
+        ret->lookup = NULL;
         ret->state = PROXY_STATE_NEW;
         ret->negotiate = NULL;
 
@@ -474,40 +567,23 @@ Socket *new_connection(SockAddr *addr, const char *hostname,
             sfree(logmsg);
         }
 
-        /* look-up proxy */
-        proxy_addr = sk_namelookup(conf_get_str(conf, CONF_proxy_host),
-                                   &proxy_canonical_name,
-                                   conf_get_int(conf, CONF_addressfamily));
-        if (sk_addr_error(proxy_addr) != NULL) {
-            ret->error = "Proxy error: Unable to resolve proxy host name";
-            sk_addr_free(proxy_addr);
-            return &ret->sock;
-        }
-        sfree(proxy_canonical_name);
-
-        {
-            char addrbuf[256], *logmsg;
-            sk_getaddr(proxy_addr, addrbuf, lenof(addrbuf));
-            logmsg = dupprintf("Connecting to %s proxy at %s port %d",
-                               proxy_type, addrbuf,
-                               conf_get_int(conf, CONF_proxy_port));
-            plug_log(plug, PLUGLOG_PROXY_MSG, NULL, 0, logmsg, 0);
-            sfree(logmsg);
-        }
-
-        /* create the actual socket we will be using,
-         * connected to our proxy server and port.
+        /*
+         * Look up the proxy host, asynchronously: the name lookup
+         * overlaps the rest of the connection setup instead of
+         * stalling the event loop, and proxy_lookup_done will make
+         * the real socket and kick off negotiation when the answer
+         * arrives. Until then, writes accumulate in our pending
+         * bufchains just as they do during proxy negotiation.
          */
-        ret->sub_socket = sk_new(proxy_addr,
-                                 conf_get_int(conf, CONF_proxy_port),
-                                 privport, oobinline,
-                                 nodelay, keepalive, &ret->plugimpl);
-        if (sk_socket_error(ret->sub_socket) != NULL)
-            return &ret->sock;
-
-        /* start the proxy negotiation process... */
-        sk_set_frozen(ret->sub_socket, false);
-        ret->negotiate(ret, PROXY_CHANGE_NEW);
+        ret->proxy_type_name = proxy_type;
+        ret->conn_privport = privport;
+        ret->conn_oobinline = oobinline;
+        ret->conn_nodelay = nodelay;
+        ret->conn_keepalive = keepalive;
+        ret->lookup = sk_namelookup_async(
+            conf_get_str(conf, CONF_proxy_host),
+            conf_get_int(conf, CONF_addressfamily),
+            proxy_lookup_done, ret);
 
         return &ret->sock;
     }
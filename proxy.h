@@ -23,6 +23,18 @@ struct ProxySocket {
     SockAddr *remote_addr;
     int remote_port;
 
+    /* While the proxy host's name is being resolved asynchronously,
+     * this holds the lookup in progress, and the fields after it save
+     * the connection parameters that sk_new will need afterwards. */
+    pending_lookup *lookup;
+    const char *proxy_type_name;
+    bool conn_privport, conn_oobinline, conn_nodelay, conn_keepalive;
+
+    /* Requested kernel buffer sizes (0 = OS default), remembered here
+     * so they can be applied to sub_socket even if it doesn't exist
+     * yet when our client calls sk_set_buffer_sizes. */
+    int sndbuf, rcvbuf;
+
     bufchain pending_output_data;
     bufchain pending_oob_output_data;
     bufchain pending_input_data;
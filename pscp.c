@@ -40,6 +40,7 @@ static bool main_cmd_is_sftp = false;
 static bool fallback_cmd_is_sftp = false;
 static bool using_sftp = false;
 static bool uploading = false;
+static int stripe_count = 1;
 
 static Backend *backend;
 static Conf *conf;
@@ -692,6 +693,7 @@ static struct scp_sftp_dirstack {
     int namepos, namelen;
     char *dirpath;
     char *wildcard;
+    WCPattern *wcpat;           /* compiled form of wildcard */
     bool matched_something;     /* wildcard match set was non-empty */
 } *scp_sftp_dirstack_head;
 static char *scp_sftp_remotepath, *scp_sftp_currentname;
@@ -1148,9 +1150,10 @@ int scp_get_sink_action(struct scp_sink_action *act)
             struct scp_sftp_dirstack *head = scp_sftp_dirstack_head;
             while (head->namepos < head->namelen &&
                    (is_dots(head->names[head->namepos].filename) ||
-                    (head->wildcard &&
-                     !wc_match(head->wildcard,
-                               head->names[head->namepos].filename))))
+                    (head->wcpat &&
+                     !wc_match_compiled(
+                         head->wcpat,
+                         head->names[head->namepos].filename))))
                 head->namepos++;       /* skip . and .. */
             if (head->namepos < head->namelen) {
                 head->matched_something = true;
@@ -1171,6 +1174,7 @@ int scp_get_sink_action(struct scp_sink_action *act)
                         errs++;
                     }
                     sfree(head->wildcard);
+                    wc_pattern_free(head->wcpat);
 
                 } else {
                     act->action = SCP_SINK_ENDDIR;
@@ -1321,11 +1325,19 @@ int scp_get_sink_action(struct scp_sink_action *act)
             else
                 newitem->dirpath = dupstr(fname);
             if (scp_sftp_wildcard) {
+                int wc_err;
                 newitem->wildcard = scp_sftp_wildcard;
+                newitem->wcpat = wc_compile(newitem->wildcard, &wc_err);
+                if (!newitem->wcpat) {
+                    tell_user(stderr, "pscp: wildcard '%s': %s",
+                              newitem->wildcard, wc_error(wc_err));
+                    errs++;
+                }
                 newitem->matched_something = false;
                 scp_sftp_wildcard = NULL;
             } else {
                 newitem->wildcard = NULL;
+                newitem->wcpat = NULL;
             }
             scp_sftp_dirstack_head = newitem;
 
@@ -1662,20 +1674,33 @@ static void source(const char *src)
     stat_bytes = 0;
     stat_starttime = time(NULL);
     stat_lasttime = 0;
+    sftpstats_file_begin(last, size, true);
+    XferVerify *xv = xfer_verify_new();
 
 #define PSCP_SEND_BLOCK 4096
     for (i = 0; i < size; i += PSCP_SEND_BLOCK) {
         char transbuf[PSCP_SEND_BLOCK];
+        const void *vdata;
         int j, k = PSCP_SEND_BLOCK;
 
         if (i + k > size)
             k = size - i;
-        if ((j = read_from_file(f, transbuf, k)) != k) {
+        /* Feed a mapped span of the file straight into the outgoing
+         * packet where the platform supports it, saving a copy. */
+        j = map_from_file(f, &vdata, k);
+        if (j < 0) {
+            j = read_from_file(f, transbuf, k);
+            vdata = transbuf;
+        }
+        if (j != k) {
             bump("%s: Read error", src);
         }
-        if (scp_send_filedata(transbuf, k))
+        if (scp_send_filedata((char *)vdata, k))
             bump("%s: Network error occurred", src);
 
+        sftpstats_file_data(k);
+        xfer_verify_data(xv, vdata, k);
+
         if (statistics) {
             stat_bytes += k;
             if (time(NULL) != stat_lasttime || i + k == size) {
@@ -1688,6 +1713,8 @@ static void source(const char *src)
     }
     close_rfile(f);
 
+    sftpstats_file_end(true);
+    xfer_verify_report(xv, last, NULL);
     (void) scp_send_finish();
 }
 
@@ -1905,6 +1932,8 @@ static void sink(const char *targ, const char *src)
         stat_lasttime = 0;
         stat_name = stripctrl_string(
             string_scc, stripslashes(destfname, true));
+        sftpstats_file_begin(stat_name, act.size, false);
+        XferVerify *xv = xfer_verify_new();
 
         received = 0;
         while (received < act.size) {
@@ -1940,6 +1969,8 @@ static void sink(const char *targ, const char *src)
                                 stat_starttime, stat_lasttime);
                 }
             }
+            sftpstats_file_data(read);
+            xfer_verify_data(xv, transbuf, read);
             received += read;
         }
         if (act.settime) {
@@ -1947,6 +1978,11 @@ static void sink(const char *targ, const char *src)
         }
 
         close_wfile(f);
+        sftpstats_file_end(!wrerror);
+        if (wrerror)
+            xfer_verify_free(xv);
+        else
+            xfer_verify_report(xv, stat_name, NULL);
         if (wrerror) {
             with_stripctrl(san, destfname)
                 run_err("%s: Write error", san);
@@ -2111,6 +2147,253 @@ static void tolocal(int argc, char *argv[])
     sink(targ, src);
 }
 
+/*
+ * Striped download (the -stripe option): fetch a single remote file
+ * over several parallel SSH connections, each one transferring a
+ * contiguous byte range and writing it into the shared target file at
+ * the right offset.
+ *
+ * PSCP's connection state is all in globals - the backend, the Conf,
+ * the SFTP request tree - so rather than try to multiplex N
+ * connections within one process, we run one worker subprocess per
+ * connection. Each worker is spawned before any connection setup or
+ * in-place argument parsing has mutated the process state, so it can
+ * run the ordinary do_cmd path from scratch; the parent just creates
+ * the target file and waits for the workers.
+ */
+
+#define STRIPE_READ_SIZE 32768         /* bytes per read request */
+#define STRIPE_MAX_REQS 16             /* read requests in flight per worker */
+
+struct stripe_worker_ctx {
+    char *source;                      /* [user@]host:path, unmodified */
+    const char *targ;                  /* local file to write into */
+};
+
+struct stripe_read {
+    uint64_t offset;
+    int len;
+};
+
+static int stripe_worker(void *vctx, int index)
+{
+    struct stripe_worker_ctx *ctx = (struct stripe_worker_ctx *)vctx;
+    char *wsrc, *host, *user, *cmd;
+    const char *src;
+    struct sftp_packet *pktin;
+    struct sftp_request *req, *rreq;
+    struct fxp_handle *fh;
+    struct fxp_attrs attrs;
+    uint64_t size, per, extra, start, end, sendoff;
+    int inflight = 0;
+    WFile *f;
+    char buffer[STRIPE_READ_SIZE];
+    bool ok = true;
+
+    /* The workers mustn't fight over the progress display. */
+    statistics = false;
+
+    /*
+     * Separate host and filename, exactly as tolocal() does. This
+     * mutates the string in place, but it's our subprocess's own copy.
+     */
+    host = ctx->source;
+    wsrc = colon(host);
+    *wsrc++ = '\0';
+    src = wsrc;
+
+    user = host;
+    host = strrchr(host, '@');
+    if (host == NULL) {
+        host = user;
+        user = NULL;
+    } else {
+        *host++ = '\0';
+        if (*user == '\0')
+            user = NULL;
+    }
+
+    cmd = dupprintf("scp -f %s", src);
+    do_cmd(host, user, cmd);
+    sfree(cmd);
+
+    if (!using_sftp) {
+        tell_user(stderr, "pscp: -stripe requires an SFTP server");
+        return 1;
+    }
+
+    req = fxp_open_send(src, SSH_FXF_READ, NULL);
+    pktin = sftp_wait_for_reply(req);
+    fh = fxp_open_recv(pktin, req);
+    if (!fh) {
+        tell_user(stderr, "%s: open for read: %s", src, fxp_error());
+        return 1;
+    }
+
+    req = fxp_fstat_send(fh);
+    pktin = sftp_wait_for_reply(req);
+    if (!fxp_fstat_recv(pktin, req, &attrs) ||
+        !(attrs.flags & SSH_FILEXFER_ATTR_SIZE)) {
+        tell_user(stderr, "%s: unable to read file size", src);
+        return 1;
+    }
+    size = attrs.size;
+
+    /*
+     * Divide the file as evenly as possible: everybody gets size/N
+     * bytes, and the first (size%N) workers get one byte extra.
+     */
+    per = size / (unsigned)stripe_count;
+    extra = size % (unsigned)stripe_count;
+    start = per * index + ((uint64_t)index < extra ? (uint64_t)index : extra);
+    end = start + per + ((uint64_t)index < extra ? 1 : 0);
+
+    if (verbose)
+        tell_user(stderr, "stripe %d: bytes %"PRIu64" - %"PRIu64,
+                  index, start, end);
+
+    f = open_wfile_for_update(ctx->targ);
+    if (!f) {
+        tell_user(stderr, "%s: unable to open local file", ctx->targ);
+        return 1;
+    }
+
+    /*
+     * Keep a bounded window of read requests in flight over our byte
+     * range. (We can't use the fxp_xfer wrapper, which always reads
+     * to EOF.) Replies can come back out of order, so each reply
+     * carries its file offset and we seek before every write; the
+     * region is ours alone, so nobody else's writes interleave.
+     */
+    sendoff = start;
+    while (inflight > 0 || (ok && sendoff < end)) {
+        while (ok && inflight < STRIPE_MAX_REQS && sendoff < end) {
+            struct stripe_read *sr = snew(struct stripe_read);
+            sr->offset = sendoff;
+            sr->len = (end - sendoff < STRIPE_READ_SIZE ?
+                       (int)(end - sendoff) : STRIPE_READ_SIZE);
+            req = fxp_read_send(fh, sr->offset, sr->len);
+            fxp_set_userdata(req, sr);
+            sftp_register(req);
+            sendoff += sr->len;
+            inflight++;
+        }
+
+        pktin = sftp_recv();
+        if (pktin == NULL)
+            seat_connection_fatal(
+                pscp_seat, "did not receive SFTP response packet from server");
+        rreq = sftp_find_request(pktin);
+        if (rreq == NULL)
+            seat_connection_fatal(
+                pscp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+
+        struct stripe_read *sr = (struct stripe_read *)fxp_get_userdata(rreq);
+        int retd = fxp_read_recv(pktin, rreq, buffer, sr->len);
+        inflight--;
+
+        if (ok) {
+            if (retd < 0) {
+                tell_user(stderr, "%s: read: %s", src, fxp_error());
+                ok = false;
+            } else if (retd == 0) {
+                tell_user(stderr, "%s: file shrank during transfer", src);
+                ok = false;
+            } else if (seek_file(f, sr->offset, FROM_START) < 0 ||
+                       write_to_file(f, buffer, retd) != retd) {
+                tell_user(stderr, "%s: local write error", ctx->targ);
+                ok = false;
+            } else if (retd < sr->len) {
+                /* Short but successful read: re-request the rest. */
+                struct stripe_read *sr2 = snew(struct stripe_read);
+                sr2->offset = sr->offset + retd;
+                sr2->len = sr->len - retd;
+                req = fxp_read_send(fh, sr2->offset, sr2->len);
+                fxp_set_userdata(req, sr2);
+                sftp_register(req);
+                inflight++;
+            }
+        }
+        sfree(sr);
+    }
+
+    close_wfile(f);
+
+    req = fxp_close_send(fh);
+    pktin = sftp_wait_for_reply(req);
+    fxp_close_recv(pktin, req);
+
+    if (backend && backend_connected(backend)) {
+        char ch;
+        backend_special(backend, SS_EOF, 0);
+        sent_eof = true;
+        ssh_scp_recv(&ch, 1);
+    }
+
+    return ok ? 0 : 1;
+}
+
+static void tolocal_striped(int argc, char *argv[])
+{
+    struct stripe_worker_ctx ctx;
+    char *wsrc, *targ_alloc = NULL;
+    int nfailed;
+
+    uploading = false;
+
+    if (argc != 2)
+        bump("More than one remote source not supported");
+    if (recursive)
+        bump("-stripe cannot be combined with -r");
+    if (preserve)
+        bump("-stripe cannot be combined with -p");
+    if (!try_sftp)
+        bump("-stripe requires the SFTP protocol");
+
+    /*
+     * Work out the local filename to create. We mustn't modify
+     * argv[0] here: the workers each parse their own copy.
+     */
+    ctx.source = argv[0];
+    wsrc = colon(argv[0]);
+    if (wsrc == NULL)
+        bump("Local to local copy not supported");
+    wsrc++;
+    if (*wsrc == '\0' || wsrc[strlen(wsrc) - 1] == '/')
+        bump("-stripe needs a single remote file name");
+
+    if (file_type(argv[1]) == FILE_TYPE_DIRECTORY) {
+        targ_alloc = dir_file_cat(argv[1], stripslashes(wsrc, false));
+        ctx.targ = targ_alloc;
+    } else {
+        ctx.targ = argv[1];
+    }
+
+    /*
+     * Create (or truncate) the target file up front, so that every
+     * worker can open the same existing file and seek within it.
+     */
+    {
+        WFile *f = open_new_file(ctx.targ, 0666);
+        if (!f)
+            bump("%s: unable to create file", ctx.targ);
+        close_wfile(f);
+    }
+
+    nfailed = psftp_run_subprocess_workers(stripe_count, stripe_worker, &ctx);
+    if (nfailed < 0)
+        bump("-stripe is not supported on this platform");
+    if (nfailed > 0) {
+        tell_user(stderr, "pscp: %d stripe worker%s failed",
+                  nfailed, nfailed == 1 ? "" : "s");
+        errs++;
+    }
+
+    sfree(targ_alloc);
+}
+
 /*
  *  We will issue a list command to get a remote directory.
  */
@@ -2217,6 +2500,11 @@ static void usage(void)
     printf("  -batch    disable all interactive prompts\n");
     printf("  -no-sanitise-stderr  don't strip control chars from"
            " standard error\n");
+    printf("  -stats-json  emit machine-readable transfer statistics"
+           " on standard error\n");
+    printf("  -verify   report SHA-256 of transferred data, and compare"
+           " with the server\n");
+    printf("  -stripe N download a single file over N parallel connections\n");
     printf("  -proxycmd command\n");
     printf("            use 'command' as local proxy\n");
     printf("  -unsafe   allow server-side wildcards (DANGEROUS)\n");
@@ -2314,6 +2602,16 @@ int psftp_main(int argc, char *argv[])
             try_scp = true; try_sftp = false;
         } else if (strcmp(argv[i], "-sanitise-stderr") == 0) {
             sanitise_stderr = true;
+        } else if (strcmp(argv[i], "-stats-json") == 0) {
+            sftpstats_enable();
+        } else if (strcmp(argv[i], "-verify") == 0) {
+            xfer_verify_enable();
+        } else if (strcmp(argv[i], "-stripe") == 0) {
+            if (i + 1 >= argc)
+                cmdline_error("option \"-stripe\" requires an argument");
+            stripe_count = atoi(argv[++i]);
+            if (stripe_count < 1 || stripe_count > 64)
+                cmdline_error("-stripe count must be between 1 and 64");
         } else if (strcmp(argv[i], "-no-sanitise-stderr") == 0) {
             sanitise_stderr = false;
         } else if (strcmp(argv[i], "--") == 0) {
@@ -2348,10 +2646,15 @@ int psftp_main(int argc, char *argv[])
         if (argc > 2)
             targetshouldbedirectory = true;
 
-        if (colon(argv[argc - 1]) != NULL)
+        if (colon(argv[argc - 1]) != NULL) {
+            if (stripe_count > 1)
+                bump("-stripe is only supported when downloading");
             toremote(argc, argv);
-        else
+        } else if (stripe_count > 1) {
+            tolocal_striped(argc, argv);
+        } else {
             tolocal(argc, argv);
+        }
     }
 
     if (backend && backend_connected(backend)) {
@@ -107,6 +107,110 @@ struct sftp_packet *sftp_wait_for_reply(struct sftp_request *req)
     return pktin;
 }
 
+/* ----------------------------------------------------------------------
+ * Client-side cache of FXP_REALPATH and FXP_STAT results.
+ *
+ * Scripted sessions (psftp -b) operating on deep directory trees
+ * otherwise pay a full round trip per path canonification per
+ * command, which dominates the run time on high-latency links. The
+ * cache is keyed by the absolute path string we'd have sent to the
+ * server, so it survives 'cd' (which only changes how we _construct_
+ * those strings), and it's flushed wholesale by any command that
+ * mutates the remote namespace or file attributes - correctness is
+ * cheap at the price of re-resolving after a write, which scripted
+ * batches do rarely compared with reading.
+ */
+
+struct sftp_cache_entry {
+    char *path;                  /* absolute path, as sent to the server */
+    char *canon;                 /* canonical name, or NULL if unknown */
+    bool have_attrs;
+    struct fxp_attrs attrs;
+};
+
+static tree234 *sftp_cache = NULL;
+
+static int sftp_cache_cmp(void *av, void *bv)
+{
+    return strcmp(((struct sftp_cache_entry *)av)->path,
+                  ((struct sftp_cache_entry *)bv)->path);
+}
+
+static struct sftp_cache_entry *sftp_cache_lookup(const char *path)
+{
+    struct sftp_cache_entry search;
+
+    if (!sftp_cache)
+        return NULL;
+    search.path = (char *)path;    /* logically const */
+    return find234(sftp_cache, &search, NULL);
+}
+
+/* Find or create the cache entry for a path. */
+static struct sftp_cache_entry *sftp_cache_entry(const char *path)
+{
+    struct sftp_cache_entry *e;
+
+    if (!sftp_cache)
+        sftp_cache = newtree234(sftp_cache_cmp);
+    e = sftp_cache_lookup(path);
+    if (!e) {
+        e = snew(struct sftp_cache_entry);
+        e->path = dupstr(path);
+        e->canon = NULL;
+        e->have_attrs = false;
+        add234(sftp_cache, e);
+    }
+    return e;
+}
+
+static void sftp_cache_flush(void)
+{
+    struct sftp_cache_entry *e;
+
+    if (!sftp_cache)
+        return;
+    while ((e = delpos234(sftp_cache, 0)) != NULL) {
+        sfree(e->path);
+        sfree(e->canon);
+        sfree(e);
+    }
+    freetree234(sftp_cache);
+    sftp_cache = NULL;
+}
+
+/*
+ * Cached wrapper on FXP_STAT, for commands that only want to ask a
+ * question about a file (is it a directory, what are its
+ * permissions?) rather than to transfer its data. Only successful
+ * stats are cached: a failure might just mean the file doesn't exist
+ * _yet_, and negative results going stale are more confusing than an
+ * occasional redundant round trip.
+ */
+static bool sftp_cached_stat(const char *fname, struct fxp_attrs *attrs)
+{
+    struct sftp_cache_entry *e = sftp_cache_lookup(fname);
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    bool result;
+
+    if (e && e->have_attrs) {
+        *attrs = e->attrs;
+        return true;
+    }
+
+    req = fxp_stat_send(fname);
+    pktin = sftp_wait_for_reply(req);
+    result = fxp_stat_recv(pktin, req, attrs);
+
+    if (result) {
+        e = sftp_cache_entry(fname);
+        e->attrs = *attrs;
+        e->have_attrs = true;
+    }
+    return result;
+}
+
 /* ----------------------------------------------------------------------
  * Higher-level helper functions used in commands.
  */
@@ -133,11 +237,21 @@ char *canonify(const char *name)
         fullname = dupcat(pwd, slash, name);
     }
 
+    {
+        struct sftp_cache_entry *e = sftp_cache_lookup(fullname);
+        if (e && e->canon) {
+            canonname = dupstr(e->canon);
+            sfree(fullname);
+            return canonname;
+        }
+    }
+
     req = fxp_realpath_send(fullname);
     pktin = sftp_wait_for_reply(req);
     canonname = fxp_realpath_recv(pktin, req);
 
     if (canonname) {
+        sftp_cache_entry(fullname)->canon = dupstr(canonname);
         sfree(fullname);
         return canonname;
     } else {
@@ -232,6 +346,17 @@ static void not_connected(void)
 /* ----------------------------------------------------------------------
  * The meat of the `get' and `put' commands.
  */
+
+/*
+ * A list entry for the pipelined multiple-file download engine below.
+ */
+struct sftp_transfer_pair {
+    char *fname, *outfname;
+};
+
+static bool sftp_get_files(struct sftp_transfer_pair *pairs, size_t npairs,
+                           bool recurse, bool restart);
+
 bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
 {
     struct fxp_handle *fh;
@@ -251,9 +376,7 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
     if (recurse) {
         bool result;
 
-        req = fxp_stat_send(fname);
-        pktin = sftp_wait_for_reply(req);
-        result = fxp_stat_recv(pktin, req, &attrs);
+        result = sftp_cached_stat(fname, &attrs);
 
         if (result &&
             (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
@@ -373,22 +496,56 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
             }
 
             /*
-             * Now we're ready to recurse. Starting at ournames[i]
-             * and continuing on to the end of the list, we
-             * construct a new source and target file name, and
-             * call sftp_get_file again.
+             * If we're restarting, the file we might have to reget
+             * needs the careful handling in sftp_get_file, so
+             * transfer it on its own first.
              */
-            for (; i < nnames; i++) {
+            if (restart && i < nnames) {
                 char *nextfname, *nextoutfname;
                 bool retd;
 
                 nextfname = dupcat(fname, "/", ournames[i]->filename);
                 nextoutfname = dir_file_cat(outfname, ournames[i]->filename);
-                retd = sftp_get_file(
-                    nextfname, nextoutfname, recurse, restart);
-                restart = false;       /* after first partial file, do full */
+                retd = sftp_get_file(nextfname, nextoutfname, recurse, true);
                 sfree(nextoutfname);
                 sfree(nextfname);
+                i++;
+                if (!retd) {
+                    for (i = 0; i < nnames; i++) {
+                        fxp_free_name(ournames[i]);
+                    }
+                    sfree(ournames);
+                    return false;
+                }
+            }
+
+            /*
+             * Now we're ready to transfer. Starting at ournames[i]
+             * and continuing on to the end of the list, we construct
+             * a new source and target file name for each entry, and
+             * hand the whole list to the pipelined engine; it walks
+             * any subdirectories itself.
+             */
+            {
+                struct sftp_transfer_pair *pairs;
+                size_t npairs, j;
+                bool retd;
+
+                pairs = snewn(nnames - i + 1, struct sftp_transfer_pair);
+                npairs = 0;
+                for (; i < nnames; i++) {
+                    pairs[npairs].fname =
+                        dupcat(fname, "/", ournames[i]->filename);
+                    pairs[npairs].outfname =
+                        dir_file_cat(outfname, ournames[i]->filename);
+                    npairs++;
+                }
+                retd = sftp_get_files(pairs, npairs, recurse, false);
+                for (j = 0; j < npairs; j++) {
+                    sfree(pairs[j].fname);
+                    sfree(pairs[j].outfname);
+                }
+                sfree(pairs);
                 if (!retd) {
                     for (i = 0; i < nnames; i++) {
                         fxp_free_name(ournames[i]);
@@ -469,6 +626,12 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
      * FIXME: we can use FXP_FSTAT here to get the file size, and
      * thus put up a progress bar.
      */
+    sftpstats_file_begin(outfname, 0, false);
+
+    /* Verification only makes sense when transferring the whole file
+     * from the start, not in restart mode. */
+    XferVerify *xv = (offset == 0) ? xfer_verify_new() : NULL;
+
     toret = true;
     xfer = xfer_download_init(fh, offset);
     while (!xfer_done(xfer)) {
@@ -492,6 +655,8 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
         while (xfer_download_data(xfer, &vbuf, &len)) {
             unsigned char *buf = (unsigned char *)vbuf;
 
+            sftpstats_file_data(len);
+            xfer_verify_data(xv, buf, len);
             wpos = 0;
             while (wpos < len) {
                 wlen = write_to_file(file, buf + wpos, len - wpos);
@@ -514,8 +679,15 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
 
     xfer_cleanup(xfer);
 
+    sftpstats_file_end(toret);
+
     close_wfile(file);
 
+    if (toret)
+        toret = xfer_verify_report(xv, outfname, fh);
+    else
+        xfer_verify_free(xv);
+
     req = fxp_close_send(fh);
     pktin = sftp_wait_for_reply(req);
     fxp_close_recv(pktin, req);
@@ -523,6 +695,15 @@ bool sftp_get_file(char *fname, char *outfname, bool recurse, bool restart)
     return toret;
 }
 
+/*
+ * Parameters for delta mode in reput: the block size whose hashes we
+ * compare, and how many blocks we cover with each check-file request
+ * (bounded by the 1MB cap sftp_recv imposes on reply packets, and by
+ * the server's own limit on blocks per request).
+ */
+#define DELTA_BLOCKSIZE 32768
+#define DELTA_BLOCKS_PER_REQ 4096
+
 bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
 {
     struct fxp_handle *fh;
@@ -534,6 +715,11 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
     bool err = false, eof;
     struct fxp_attrs attrs;
     long permissions;
+    bool delta = false;
+    strbuf *remote_hashes = NULL;
+    char *blockbuf = NULL;
+    uint64_t remote_len = 0, local_pos = 0, resent = 0;
+    XferVerify *xv = NULL;
 
     /*
      * In recursive mode, see if we're dealing with a directory.
@@ -664,9 +850,14 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
     attrs.flags = 0;
     PUT_PERMISSIONS(attrs, permissions);
     if (restart) {
-        req = fxp_open_send(outfname, SSH_FXF_WRITE, &attrs);
+        /* Ask for read access too, so that the server can hash the
+         * existing file contents for a delta transfer. */
+        req = fxp_open_send(outfname, SSH_FXF_READ | SSH_FXF_WRITE, &attrs);
     } else {
+        /* When verifying, ask for read access too, so that the server
+         * can hash what it wrote for the check-file comparison. */
         req = fxp_open_send(outfname,
+                            (xfer_verify_active() ? SSH_FXF_READ : 0) |
                             SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC,
                             &attrs);
     }
@@ -698,10 +889,49 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
             goto cleanup;
         }
         offset = attrs.size;
-        printf("reput: restarting at file position %"PRIu64"\n", offset);
 
-        if (seek_file((WFile *)file, offset, FROM_START) != 0)
-            seek_file((WFile *)file, 0, FROM_END);    /* *shrug* */
+        if (fxp_has_check_file() && offset > 0) {
+            /*
+             * The server can hash file blocks for us, so instead of
+             * blindly appending from the current remote length, fetch
+             * block hashes of what it already has and re-send only
+             * the blocks that differ from our local copy. An
+             * interrupted transfer resumes just as before, and a
+             * _changed_ source file is brought up to date without
+             * re-sending the unchanged parts.
+             */
+            uint64_t o;
+
+            remote_hashes = strbuf_new();
+            delta = true;
+            for (o = 0; o < offset && delta; ) {
+                uint64_t span = offset - o;
+                if (span > (uint64_t)DELTA_BLOCKSIZE * DELTA_BLOCKS_PER_REQ)
+                    span = (uint64_t)DELTA_BLOCKSIZE * DELTA_BLOCKS_PER_REQ;
+                req = fxp_check_file_send(fh, o, span, DELTA_BLOCKSIZE);
+                pktin = sftp_wait_for_reply(req);
+                if (!fxp_check_file_recv(pktin, req, remote_hashes))
+                    delta = false; /* fall back to plain append */
+                o += span;
+            }
+            if (delta) {
+                printf("reput: delta transfer, re-sending changed blocks\n");
+            } else {
+                strbuf_free(remote_hashes);
+                remote_hashes = NULL;
+            }
+        }
+
+        if (delta) {
+            remote_len = offset;
+            offset = 0;
+            blockbuf = snewn(DELTA_BLOCKSIZE, char);
+        } else {
+            printf("reput: restarting at file position %"PRIu64"\n", offset);
+
+            if (seek_file((WFile *)file, offset, FROM_START) != 0)
+                seek_file((WFile *)file, 0, FROM_END);    /* *shrug* */
+        }
     } else {
         offset = 0;
     }
@@ -712,6 +942,13 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
      * FIXME: we can use FXP_FSTAT here to get the file size, and
      * thus put up a progress bar.
      */
+    sftpstats_file_begin(outfname, 0, true);
+
+    /* Verification only makes sense when uploading the whole file
+     * from the start, not in restart or delta mode. */
+    if (!restart)
+        xv = xfer_verify_new();
+
     xfer = xfer_upload_init(fh, offset);
     eof = false;
     while ((!err && !eof) || !xfer_done(xfer)) {
@@ -719,14 +956,73 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
         int len, ret;
 
         while (xfer_upload_ready(xfer) && !err && !eof) {
-            len = read_from_file(file, buffer, sizeof(buffer));
-            if (len == -1) {
-                printf("error while reading local file\n");
-                err = true;
-            } else if (len == 0) {
-                eof = true;
+            if (delta) {
+                int blklen = 0;
+                size_t blkidx;
+                bool matched = false;
+
+                while (blklen < DELTA_BLOCKSIZE) {
+                    len = read_from_file(file, blockbuf + blklen,
+                                         DELTA_BLOCKSIZE - blklen);
+                    if (len == -1) {
+                        printf("error while reading local file\n");
+                        err = true;
+                        break;
+                    }
+                    if (len == 0)
+                        break;
+                    blklen += len;
+                }
+                if (err)
+                    break;
+                if (blklen == 0) {
+                    eof = true;
+                    break;
+                }
+
+                /*
+                 * Re-send this block, unless the server's hash of the
+                 * same range matches ours. (A length mismatch in the
+                 * final block shows up as a hash mismatch, so it
+                 * needs no special handling.)
+                 */
+                blkidx = local_pos / DELTA_BLOCKSIZE;
+                if (remote_hashes->len / 32 > blkidx) {
+                    unsigned char digest[32];
+                    hash_simple(&ssh_sha256,
+                                make_ptrlen(blockbuf, blklen), digest);
+                    matched = !memcmp(remote_hashes->u + 32 * blkidx,
+                                      digest, 32);
+                }
+                if (!matched) {
+                    xfer_upload_seek(xfer, local_pos);
+                    xfer_upload_data(xfer, blockbuf, blklen);
+                    sftpstats_file_data(blklen);
+                    resent += blklen;
+                }
+                local_pos += blklen;
+                if (blklen < DELTA_BLOCKSIZE)
+                    eof = true;
             } else {
-                xfer_upload_data(xfer, buffer, len);
+                const void *vdata;
+                /* Feed a mapped span of the file straight into the
+                 * outgoing packet where the platform supports it,
+                 * saving a copy. */
+                len = map_from_file(file, &vdata, sizeof(buffer));
+                if (len < 0) {
+                    len = read_from_file(file, buffer, sizeof(buffer));
+                    vdata = buffer;
+                }
+                if (len == -1) {
+                    printf("error while reading local file\n");
+                    err = true;
+                } else if (len == 0) {
+                    eof = true;
+                } else {
+                    xfer_upload_data(xfer, (char *)vdata, len);
+                    sftpstats_file_data(len);
+                    xfer_verify_data(xv, vdata, len);
+                }
             }
         }
 
@@ -756,6 +1052,32 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
 
     xfer_cleanup(xfer);
 
+    if (delta && !err) {
+        if (local_pos < remote_len) {
+            /*
+             * The local file is shorter than the copy the server
+             * already had, so truncate the remote file to match.
+             */
+            struct fxp_attrs newattrs;
+            newattrs.flags = SSH_FILEXFER_ATTR_SIZE;
+            newattrs.size = local_pos;
+            req = fxp_fsetstat_send(fh, newattrs);
+            pktin = sftp_wait_for_reply(req);
+            if (!fxp_fsetstat_recv(pktin, req)) {
+                printf("unable to truncate %s: %s\n", outfname, fxp_error());
+                err = true;
+            }
+        }
+        printf("reput: re-sent %"PRIu64" of %"PRIu64" bytes\n",
+               resent, local_pos);
+    }
+
+    if (!err && xv) {
+        if (!xfer_verify_report(xv, outfname, fh))
+            err = true;
+        xv = NULL;
+    }
+
   cleanup:
     req = fxp_close_send(fh);
     pktin = sftp_wait_for_reply(req);
@@ -768,9 +1090,447 @@ bool sftp_put_file(char *fname, char *outfname, bool recurse, bool restart)
 
     close_rfile(file);
 
+    sftpstats_file_end(!err);
+
+    if (remote_hashes)
+        strbuf_free(remote_hashes);
+    sfree(blockbuf);
+    xfer_verify_free(xv);
+
     return !err;
 }
 
+/* ----------------------------------------------------------------------
+ * Pipelined download of a list of files.
+ *
+ * sftp_get_file transfers one file at a time, paying a round trip
+ * each for the stat, open and close of every file, which dominates
+ * the cost of fetching a lot of small files on a long-latency link.
+ * This engine keeps several files in flight at once over the same
+ * SFTP channel: while one file's data is arriving we can already be
+ * statting and opening the next few, and closes are collected as
+ * their replies come back rather than waited for.
+ *
+ * In recursive mode, directories go through the same pipeline: a list
+ * entry that turns out to be a directory is walked with a chain of
+ * READDIR requests, and the entries it yields are appended to the
+ * work queue. So the walk of a deep tree proceeds across the whole
+ * recursion frontier at once, sharing the connection with the file
+ * transfers already in flight, rather than paying serialised round
+ * trips per directory.
+ */
+
+typedef enum ParfileState {
+    PARFILE_STATTING,     /* waiting for reply to FXP_STAT */
+    PARFILE_OPENING,      /* waiting for reply to FXP_OPEN */
+    PARFILE_TRANSFERRING, /* read requests in flight, owned by an fxp_xfer */
+    PARFILE_VERIFYING,    /* waiting for reply to a check-file request */
+    PARFILE_CLOSING,      /* waiting for reply to FXP_CLOSE */
+    PARFILE_DIR_OPENING,  /* waiting for reply to FXP_OPENDIR */
+    PARFILE_DIR_READING,  /* waiting for reply to FXP_READDIR */
+    PARFILE_DIR_CLOSING   /* waiting for FXP_CLOSE of the directory handle */
+} ParfileState;
+
+struct parfile {
+    char *fname, *outfname;            /* borrowed from the work queue */
+    ParfileState state;
+    struct sftp_request *metareq;  /* outstanding request, if any, other
+                                    * than reads owned by 'xfer' */
+    struct fxp_attrs attrs;
+    struct fxp_handle *fh;             /* file or directory handle */
+    WFile *file;
+    struct fxp_xfer *xfer;
+    XferVerify *xv;
+    struct fxp_name **names;       /* entries collected from a directory */
+    size_t nnames, namesize;
+    bool ok, shown_err;
+};
+
+/*
+ * The work queue. Strings appended to it are owned by the queue, and
+ * stay valid until the whole queue is freed at the end of
+ * sftp_get_files, since active transfers borrow them.
+ */
+struct sftp_transfer_queue {
+    struct sftp_transfer_pair *pairs;
+    size_t npairs, pairsize;
+};
+
+static void transfer_queue_append(struct sftp_transfer_queue *q,
+                                  char *fname, char *outfname)
+{
+    sgrowarray(q->pairs, q->pairsize, q->npairs);
+    q->pairs[q->npairs].fname = fname;
+    q->pairs[q->npairs].outfname = outfname;
+    q->npairs++;
+}
+
+/* Remove active[i] from the list, fold its success status into
+ * *allok, and free it. */
+static void parfile_retire(struct parfile **active, size_t *nactive,
+                           size_t i, bool *allok)
+{
+    struct parfile *pf = active[i];
+    if (!pf->ok)
+        *allok = false;
+    active[i] = active[--*nactive];
+    xfer_verify_free(pf->xv);
+    sfree(pf);
+}
+
+static bool sftp_get_files(struct sftp_transfer_pair *pairs, size_t npairs,
+                           bool recurse, bool restart)
+{
+    struct parfile **active;
+    struct sftp_transfer_queue q = { NULL, 0, 0 };
+    size_t nactive = 0, next = 0, i;
+    int concurrency = conf_get_int(conf, CONF_sftp_concurrency);
+    bool allok = true;
+
+    /*
+     * Restart mode needs the careful one-at-a-time handling in
+     * sftp_get_file (and is almost always a single file anyway), and
+     * a concurrency limit of 1 means the user has asked for the old
+     * behaviour; in both cases just transfer serially.
+     */
+    if (restart || concurrency <= 1) {
+        for (i = 0; i < npairs; i++)
+            if (!sftp_get_file(pairs[i].fname, pairs[i].outfname,
+                               recurse, restart))
+                return false;
+        return true;
+    }
+
+    for (i = 0; i < npairs; i++)
+        transfer_queue_append(&q, dupstr(pairs[i].fname),
+                              dupstr(pairs[i].outfname));
+
+    active = snewn(concurrency, struct parfile *);
+
+    while (next < q.npairs || nactive > 0) {
+        struct parfile *pf;
+        struct sftp_packet *pktin;
+        struct sftp_request *rreq;
+
+        /*
+         * Start on new files whenever we have spare capacity, unless
+         * an earlier file has already failed.
+         */
+        while (nactive < (size_t)concurrency && next < q.npairs && allok) {
+            pf = snew(struct parfile);
+            pf->fname = q.pairs[next].fname;
+            pf->outfname = q.pairs[next].outfname;
+            pf->state = PARFILE_STATTING;
+            pf->fh = NULL;
+            pf->file = NULL;
+            pf->xfer = NULL;
+            pf->xv = NULL;
+            pf->names = NULL;
+            pf->nnames = pf->namesize = 0;
+            pf->ok = true;
+            pf->shown_err = false;
+            pf->metareq = fxp_stat_send(pf->fname);
+            sftp_register(pf->metareq);
+            active[nactive++] = pf;
+            next++;
+        }
+
+        if (nactive == 0)
+            break;             /* a failure stopped us starting any more */
+
+        /* Keep the transferring files' request windows topped up. */
+        for (i = 0; i < nactive; i++)
+            if (active[i]->state == PARFILE_TRANSFERRING)
+                xfer_download_queue(active[i]->xfer);
+
+        pktin = sftp_recv();
+        if (pktin == NULL) {
+            seat_connection_fatal(
+                psftp_seat,
+                "did not receive SFTP response packet from server");
+        }
+        rreq = sftp_find_request(pktin);
+        if (!rreq) {
+            seat_connection_fatal(
+                psftp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+        }
+
+        /*
+         * See if this reply is to one of our own stat/open/close
+         * requests; anything else must be a read request belonging to
+         * one of the transfers in progress.
+         */
+        for (i = 0; i < nactive; i++)
+            if (active[i]->metareq == rreq)
+                break;
+
+        if (i < nactive) {
+            pf = active[i];
+            pf->metareq = NULL;
+
+            switch (pf->state) {
+              case PARFILE_STATTING:
+                if (!fxp_stat_recv(pktin, rreq, &pf->attrs))
+                    pf->attrs.flags = 0;
+                if (recurse &&
+                    (pf->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
+                    (pf->attrs.permissions & 0040000)) {
+                    /*
+                     * A directory. Create its local counterpart,
+                     * unless that already exists, and start reading
+                     * its contents.
+                     */
+                    if (file_type(pf->outfname) != FILE_TYPE_DIRECTORY &&
+                        !create_directory(pf->outfname)) {
+                        with_stripctrl(san, pf->outfname)
+                            printf("%s: Cannot create directory\n", san);
+                        pf->ok = false;
+                        parfile_retire(active, &nactive, i, &allok);
+                        break;
+                    }
+                    pf->metareq = fxp_opendir_send(pf->fname);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_DIR_OPENING;
+                } else {
+                    pf->metareq = fxp_open_send(pf->fname, SSH_FXF_READ,
+                                                NULL);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_OPENING;
+                }
+                break;
+
+              case PARFILE_OPENING:
+                pf->fh = fxp_open_recv(pktin, rreq);
+                if (!pf->fh) {
+                    with_stripctrl(san, pf->fname)
+                        printf("%s: open for read: %s\n", san, fxp_error());
+                    pf->ok = false;
+                    parfile_retire(active, &nactive, i, &allok);
+                    break;
+                }
+                pf->file = open_new_file(pf->outfname,
+                                         GET_PERMISSIONS(pf->attrs, -1));
+                if (!pf->file) {
+                    with_stripctrl(san, pf->outfname)
+                        printf("local: unable to open %s\n", san);
+                    pf->ok = false;
+                    pf->metareq = fxp_close_send(pf->fh);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_CLOSING;
+                    break;
+                }
+                with_stripctrl(san, pf->fname) {
+                    with_stripctrl(sano, pf->outfname)
+                        printf("remote:%s => local:%s\n", san, sano);
+                }
+                sftpstats_file_begin(
+                    pf->outfname,
+                    (pf->attrs.flags & SSH_FILEXFER_ATTR_SIZE) ?
+                    pf->attrs.size : 0, false);
+                pf->xv = xfer_verify_new();
+                pf->xfer = xfer_download_init(pf->fh, 0);
+                pf->state = PARFILE_TRANSFERRING;
+                break;
+
+              case PARFILE_VERIFYING:
+                if (xfer_verify_check_recv(pf->xv, pktin, rreq) &&
+                    !xfer_verify_check_complete(pf->xv)) {
+                    /* More of the file still to hash. */
+                    pf->metareq = xfer_verify_check_send(pf->xv, pf->fh);
+                    sftp_register(pf->metareq);
+                } else {
+                    pf->ok = xfer_verify_report(pf->xv, pf->outfname, NULL);
+                    pf->xv = NULL;
+                    pf->metareq = fxp_close_send(pf->fh);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_CLOSING;
+                }
+                break;
+
+              case PARFILE_CLOSING:
+                fxp_close_recv(pktin, rreq);
+                parfile_retire(active, &nactive, i, &allok);
+                break;
+
+              case PARFILE_DIR_OPENING:
+                pf->fh = fxp_opendir_recv(pktin, rreq);
+                if (!pf->fh) {
+                    with_stripctrl(san, pf->fname)
+                        printf("%s: unable to open directory: %s\n",
+                               san, fxp_error());
+                    pf->ok = false;
+                    parfile_retire(active, &nactive, i, &allok);
+                    break;
+                }
+                pf->metareq = fxp_readdir_send(pf->fh);
+                sftp_register(pf->metareq);
+                pf->state = PARFILE_DIR_READING;
+                break;
+
+              case PARFILE_DIR_READING: {
+                struct fxp_names *names;
+                size_t j;
+
+                names = fxp_readdir_recv(pktin, rreq);
+                if (names == NULL || names->nnames == 0) {
+                    if (names) {
+                        fxp_free_names(names);
+                    } else if (fxp_error_type() != SSH_FX_EOF) {
+                        with_stripctrl(san, pf->fname)
+                            printf("%s: reading directory: %s\n",
+                                   san, fxp_error());
+                        pf->ok = false;
+                    }
+                    /* End of directory (or failure): close the handle. */
+                    pf->metareq = fxp_close_send(pf->fh);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_DIR_CLOSING;
+                    break;
+                }
+                sgrowarrayn(pf->names, pf->namesize, pf->nnames,
+                            names->nnames);
+                for (j = 0; j < (size_t)names->nnames; j++)
+                    if (strcmp(names->names[j].filename, ".") &&
+                        strcmp(names->names[j].filename, "..")) {
+                        if (!vet_filename(names->names[j].filename)) {
+                            with_stripctrl(san, names->names[j].filename)
+                                printf("ignoring potentially dangerous "
+                                       "server-supplied filename '%s'\n", san);
+                        } else {
+                            pf->names[pf->nnames++] =
+                                fxp_dup_name(&names->names[j]);
+                        }
+                    }
+                fxp_free_names(names);
+                pf->metareq = fxp_readdir_send(pf->fh);
+                sftp_register(pf->metareq);
+                break;
+              }
+
+              case PARFILE_DIR_CLOSING: {
+                size_t j;
+
+                fxp_close_recv(pktin, rreq);
+
+                /*
+                 * Sort the entries, for the same predictability
+                 * reasons as in sftp_get_file, and append them to the
+                 * work queue.
+                 */
+                if (pf->ok && pf->nnames) {
+                    qsort(pf->names, pf->nnames, sizeof(*pf->names),
+                          sftp_name_compare);
+                    for (j = 0; j < pf->nnames; j++)
+                        transfer_queue_append(
+                            &q,
+                            dupcat(pf->fname, "/", pf->names[j]->filename),
+                            dir_file_cat(pf->outfname,
+                                         pf->names[j]->filename));
+                }
+                for (j = 0; j < pf->nnames; j++)
+                    fxp_free_name(pf->names[j]);
+                sfree(pf->names);
+                parfile_retire(active, &nactive, i, &allok);
+                break;
+              }
+
+              default:
+                unreachable("bad parfile state");
+            }
+        } else {
+            struct fxp_xfer *xf = xfer_find(rreq);
+            void *vbuf;
+            int retd, len;
+
+            for (i = 0; i < nactive; i++)
+                if (xf && active[i]->xfer == xf)
+                    break;
+            if (i == nactive) {
+                printf("error: SFTP reply is not part of any current "
+                       "download\n");
+                sfree(pktin);
+                allok = false;
+                continue;
+            }
+            pf = active[i];
+
+            retd = xfer_download_gotreply(pktin, rreq);
+            if (retd <= 0) {
+                if (!pf->shown_err) {
+                    with_stripctrl(san, pf->fname)
+                        printf("%s: error while reading: %s\n",
+                               san, fxp_error());
+                    pf->shown_err = true;
+                }
+                if (retd == INT_MIN)   /* pktin not even freed */
+                    sfree(pktin);
+                pf->ok = false;
+            }
+
+            while (xfer_download_data(pf->xfer, &vbuf, &len)) {
+                unsigned char *buf = (unsigned char *)vbuf;
+                int wpos, wlen;
+
+                wpos = 0;
+                while (wpos < len) {
+                    wlen = write_to_file(pf->file, buf + wpos, len - wpos);
+                    if (wlen <= 0) {
+                        printf("error while writing local file\n");
+                        pf->ok = false;
+                        xfer_set_error(pf->xfer);
+                        break;
+                    }
+                    wpos += wlen;
+                }
+                if (wpos < len) {      /* we had an error */
+                    pf->ok = false;
+                    xfer_set_error(pf->xfer);
+                }
+
+                sftpstats_file_data(len);
+                xfer_verify_data(pf->xv, buf, len);
+                sfree(vbuf);
+            }
+
+            if (xfer_done(pf->xfer)) {
+                xfer_cleanup(pf->xfer);
+                pf->xfer = NULL;
+                close_wfile(pf->file);
+                pf->file = NULL;
+                sftpstats_file_end(pf->ok);
+                if (pf->ok && xfer_verify_check_needed(pf->xv)) {
+                    /* Compare against the server's hashes before we
+                     * give up the file handle. */
+                    pf->metareq = xfer_verify_check_send(pf->xv, pf->fh);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_VERIFYING;
+                } else {
+                    if (pf->ok && pf->xv) {
+                        pf->ok = xfer_verify_report(pf->xv, pf->outfname,
+                                                    NULL);
+                        pf->xv = NULL;
+                    }
+                    pf->metareq = fxp_close_send(pf->fh);
+                    sftp_register(pf->metareq);
+                    pf->state = PARFILE_CLOSING;
+                }
+            }
+        }
+    }
+
+    sfree(active);
+
+    for (i = 0; i < q.npairs; i++) {
+        sfree(q.pairs[i].fname);
+        sfree(q.pairs[i].outfname);
+    }
+    sfree(q.pairs);
+
+    return allok;
+}
+
 /* ----------------------------------------------------------------------
  * A remote wildcard matcher, providing a similar interface to the
  * local one in psftp.h.
@@ -780,7 +1540,8 @@ typedef struct SftpWildcardMatcher {
     struct fxp_handle *dirh;
     struct fxp_names *names;
     int namepos;
-    char *wildcard, *prefix;
+    WCPattern *wcpat;
+    char *prefix;
 } SftpWildcardMatcher;
 
 SftpWildcardMatcher *sftp_begin_wildcard_matching(char *name)
@@ -791,6 +1552,8 @@ SftpWildcardMatcher *sftp_begin_wildcard_matching(char *name)
     char *unwcdir, *tmpdir, *cdir;
     int len;
     bool check;
+    int wc_err;
+    WCPattern *wcpat;
     SftpWildcardMatcher *swcm;
     struct fxp_handle *dirh;
 
@@ -816,6 +1579,19 @@ SftpWildcardMatcher *sftp_begin_wildcard_matching(char *name)
         return NULL;
     }
 
+    /*
+     * Compile the wildcard once up front, so that the directory scan
+     * doesn't have to reparse it for every filename (and so that a
+     * syntax error in it is reported here, rather than silently
+     * matching nothing).
+     */
+    wcpat = wc_compile(wildcard, &wc_err);
+    if (!wcpat) {
+        printf("%s: %s\n", wildcard, wc_error(wc_err));
+        sfree(unwcdir);
+        return NULL;
+    }
+
     cdir = canonify(unwcdir);
 
     req = fxp_opendir_send(cdir);
@@ -826,11 +1602,12 @@ SftpWildcardMatcher *sftp_begin_wildcard_matching(char *name)
         swcm = snew(SftpWildcardMatcher);
         swcm->dirh = dirh;
         swcm->names = NULL;
-        swcm->wildcard = dupstr(wildcard);
+        swcm->wcpat = wcpat;
         swcm->prefix = unwcdir;
     } else {
         printf("Unable to open %s: %s\n", cdir, fxp_error());
         swcm = NULL;
+        wc_pattern_free(wcpat);
         sfree(unwcdir);
     }
 
@@ -892,7 +1669,7 @@ char *sftp_wildcard_get_filename(SftpWildcardMatcher *swcm)
             continue;                  /* unexpected bad filename */
         }
 
-        if (!wc_match(swcm->wildcard, name->filename))
+        if (!wc_match_compiled(swcm->wcpat, name->filename))
             continue;                  /* doesn't match the wildcard */
 
         /*
@@ -919,7 +1696,7 @@ void sftp_finish_wildcard_matching(SftpWildcardMatcher *swcm)
         fxp_free_names(swcm->names);
 
     sfree(swcm->prefix);
-    sfree(swcm->wildcard);
+    wc_pattern_free(swcm->wcpat);
 
     sfree(swcm);
 }
@@ -1047,6 +1824,7 @@ int sftp_cmd_ls(struct sftp_command *cmd)
     struct fxp_names *names;
     const char *dir;
     char *cdir, *unwcdir, *wildcard;
+    WCPattern *wcpat;
     struct sftp_packet *pktin;
     struct sftp_request *req;
 
@@ -1063,10 +1841,10 @@ int sftp_cmd_ls(struct sftp_command *cmd)
     unwcdir = snewn(1 + strlen(dir), char);
     if (wc_unescape(unwcdir, dir)) {
         dir = unwcdir;
-        wildcard = NULL;
+        wcpat = NULL;
     } else {
         char *tmpdir;
-        int len;
+        int len, wc_err;
         bool check;
 
         sfree(unwcdir);
@@ -1084,6 +1862,12 @@ int sftp_cmd_ls(struct sftp_command *cmd)
             sfree(unwcdir);
             return 0;
         }
+        wcpat = wc_compile(wildcard, &wc_err);
+        if (!wcpat) {
+            printf("%s: %s\n", wildcard, wc_error(wc_err));
+            sfree(unwcdir);
+            return 0;
+        }
         dir = unwcdir;
     }
 
@@ -1100,6 +1884,7 @@ int sftp_cmd_ls(struct sftp_command *cmd)
         printf("Unable to open %s: %s\n", dir, fxp_error());
         sfree(cdir);
         sfree(unwcdir);
+        wc_pattern_free(wcpat);
         return 0;
     } else {
         struct list_directory_from_sftp_ctx *ctx =
@@ -1123,7 +1908,8 @@ int sftp_cmd_ls(struct sftp_command *cmd)
             }
 
             for (size_t i = 0; i < names->nnames; i++)
-                if (!wildcard || wc_match(wildcard, names->names[i].filename))
+                if (!wcpat ||
+                    wc_match_compiled(wcpat, names->names[i].filename))
                     list_directory_from_sftp_feed(ctx, &names->names[i]);
 
             fxp_free_names(names);
@@ -1139,6 +1925,7 @@ int sftp_cmd_ls(struct sftp_command *cmd)
 
     sfree(cdir);
     sfree(unwcdir);
+    wc_pattern_free(wcpat);
 
     return 1;
 }
@@ -1214,9 +2001,11 @@ int sftp_cmd_pwd(struct sftp_command *cmd)
  */
 int sftp_general_get(struct sftp_command *cmd, bool restart, bool multiple)
 {
-    char *fname, *unwcfname, *origfname, *origwfname, *outfname;
+    char *unwcfname, *origfname, *origwfname, *outfname;
     int i, toret;
     bool recurse = false;
+    struct sftp_transfer_pair *pairs = NULL;
+    size_t npairs = 0, pairsize = 0, j;
 
     if (!backend) {
         not_connected();
@@ -1269,17 +2058,21 @@ int sftp_general_get(struct sftp_command *cmd, bool restart, bool multiple)
             swcm = NULL;
         }
 
+        /*
+         * Collect the full list of transfers before starting any of
+         * them, so that the pipelined engine can keep several in
+         * flight at once.
+         */
         while (origwfname) {
-            fname = canonify(origwfname);
+            sgrowarray(pairs, pairsize, npairs);
+            pairs[npairs].fname = canonify(origwfname);
 
             if (!multiple && i < cmd->nwords)
                 outfname = cmd->words[i++];
             else
                 outfname = stripslashes(origwfname, false);
-
-            toret = sftp_get_file(fname, outfname, recurse, restart);
-
-            sfree(fname);
+            pairs[npairs].outfname = dupstr(outfname);
+            npairs++;
 
             if (swcm) {
                 sfree(origwfname);
@@ -1291,11 +2084,17 @@ int sftp_general_get(struct sftp_command *cmd, bool restart, bool multiple)
         sfree(unwcfname);
         if (swcm)
             sftp_finish_wildcard_matching(swcm);
-        if (!toret)
-            return toret;
 
     } while (multiple && i < cmd->nwords);
 
+    toret = sftp_get_files(pairs, npairs, recurse, restart);
+
+    for (j = 0; j < npairs; j++) {
+        sfree(pairs[j].fname);
+        sfree(pairs[j].outfname);
+    }
+    sfree(pairs);
+
     return toret;
 }
 int sftp_cmd_get(struct sftp_command *cmd)
@@ -1392,11 +2191,14 @@ int sftp_general_put(struct sftp_command *cmd, bool restart, bool multiple)
         if (wcm)
             finish_wildcard_matching(wcm);
 
-        if (!toret)
+        if (!toret) {
+            sftp_cache_flush();
             return toret;
+        }
 
     } while (multiple && i < cmd->nwords);
 
+    sftp_cache_flush();
     return toret;
 }
 int sftp_cmd_put(struct sftp_command *cmd)
@@ -1449,6 +2251,7 @@ int sftp_cmd_mkdir(struct sftp_command *cmd)
         sfree(dir);
     }
 
+    sftp_cache_flush();
     return ret;
 }
 
@@ -1490,6 +2293,7 @@ int sftp_cmd_rmdir(struct sftp_command *cmd)
     for (i = 1; i < cmd->nwords; i++)
         ret &= wildcard_iterate(cmd->words[i], sftp_action_rmdir, NULL);
 
+    sftp_cache_flush();
     return ret;
 }
 
@@ -1531,19 +2335,16 @@ int sftp_cmd_rm(struct sftp_command *cmd)
     for (i = 1; i < cmd->nwords; i++)
         ret &= wildcard_iterate(cmd->words[i], sftp_action_rm, NULL);
 
+    sftp_cache_flush();
     return ret;
 }
 
 static bool check_is_dir(char *dstfname)
 {
-    struct sftp_packet *pktin;
-    struct sftp_request *req;
     struct fxp_attrs attrs;
     bool result;
 
-    req = fxp_stat_send(dstfname);
-    pktin = sftp_wait_for_reply(req);
-    result = fxp_stat_recv(pktin, req, &attrs);
+    result = sftp_cached_stat(dstfname, &attrs);
 
     if (result &&
         (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
@@ -1639,6 +2440,7 @@ int sftp_cmd_mv(struct sftp_command *cmd)
     for (i = 1; i < cmd->nwords-1; i++)
         ret &= wildcard_iterate(cmd->words[i], sftp_action_mv, ctx);
 
+    sftp_cache_flush();
     sfree(ctx->dstfname);
     return ret;
 }
@@ -1656,9 +2458,7 @@ static bool sftp_action_chmod(void *vctx, char *fname)
     unsigned oldperms, newperms;
     struct sftp_context_chmod *ctx = (struct sftp_context_chmod *)vctx;
 
-    req = fxp_stat_send(fname);
-    pktin = sftp_wait_for_reply(req);
-    result = fxp_stat_recv(pktin, req, &attrs);
+    result = sftp_cached_stat(fname, &attrs);
 
     if (!result || !(attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS)) {
         printf("get attrs for %s: %s\n", fname,
@@ -1814,6 +2614,7 @@ int sftp_cmd_chmod(struct sftp_command *cmd)
     for (i = 2; i < cmd->nwords; i++)
         ret &= wildcard_iterate(cmd->words[i], sftp_action_chmod, ctx);
 
+    sftp_cache_flush();
     return ret;
 }
 
@@ -2369,6 +3170,7 @@ static int do_sftp_init(void)
 static void do_sftp_cleanup(void)
 {
     char ch;
+    sftp_cache_flush();
     if (backend) {
         backend_special(backend, SS_EOF, 0);
         sent_eof = true;
@@ -2551,6 +3353,10 @@ static void usage(void)
     printf("  -batch    disable all interactive prompts\n");
     printf("  -no-sanitise-stderr  don't strip control chars from"
            " standard error\n");
+    printf("  -stats-json  emit machine-readable transfer statistics"
+           " on standard error\n");
+    printf("  -verify   report SHA-256 of transferred data, and compare"
+           " with the server\n");
     printf("  -proxycmd command\n");
     printf("            use 'command' as local proxy\n");
     printf("  -sshlog file\n");
@@ -2844,6 +3650,10 @@ int psftp_main(int argc, char *argv[])
             modeflags = modeflags | 2;
         } else if (strcmp(argv[i], "-sanitise-stderr") == 0) {
             sanitise_stderr = true;
+        } else if (strcmp(argv[i], "-stats-json") == 0) {
+            sftpstats_enable();
+        } else if (strcmp(argv[i], "-verify") == 0) {
+            xfer_verify_enable();
         } else if (strcmp(argv[i], "-no-sanitise-stderr") == 0) {
             sanitise_stderr = false;
         } else if (strcmp(argv[i], "--") == 0) {
@@ -57,6 +57,22 @@ void platform_psftp_pre_conn_setup(LogPolicy *lp);
  */
 int psftp_main(int argc, char *argv[]);
 
+/*
+ * Run 'count' parallel worker subprocesses, each executing fn(ctx,
+ * index) for one index in 0..count-1 and using fn's return value as
+ * its process exit status. The parent waits for them all to finish,
+ * and returns the number that failed (or could not be started), or a
+ * negative number if this platform cannot run subprocess workers at
+ * all.
+ *
+ * This exists for PSCP's -stripe mode, in which each worker makes its
+ * own SSH connection. The workers must therefore be spawned from a
+ * pristine copy of the process state, before any connection setup has
+ * happened in the parent.
+ */
+int psftp_run_subprocess_workers(int count, int (*fn)(void *ctx, int index),
+                                 void *ctx);
+
 /*
  * These functions are used by PSCP to transmit progress updates
  * and error information to a GUI window managing it. This will
@@ -95,8 +111,24 @@ RFile *open_existing_file(const char *name, uint64_t *size,
                           unsigned long *mtime, unsigned long *atime,
                           long *perms);
 WFile *open_existing_wfile(const char *name, uint64_t *size);
+/* Like open_existing_wfile, but without append semantics: writes land
+ * wherever the file pointer was last seeked to, which is what a
+ * writer updating arbitrary regions of the file (e.g. one of pscp's
+ * -stripe workers) needs. */
+WFile *open_wfile_for_update(const char *name);
 /* Returns <0 on error, 0 on eof, or number of bytes read, as usual */
 int read_from_file(RFile *f, void *buffer, int length);
+/*
+ * Like read_from_file, but instead of copying into a caller-supplied
+ * buffer, points *data at (up to) the next 'length' bytes of the file
+ * in a read-only memory mapping, letting the caller feed file data
+ * straight into an outgoing packet without an intermediate copy. The
+ * span stays valid until the next map_from_file or close_rfile call.
+ * Returns -1 if mapped access isn't available for this file (or on
+ * this platform), in which case the caller should fall back to
+ * read_from_file for the rest of the transfer and not mix the two.
+ */
+int map_from_file(RFile *f, const void **data, int length);
 /* Closes and frees the RFile */
 void close_rfile(RFile *f);
 WFile *open_new_file(const char *name, long perms);
@@ -224,4 +256,38 @@ void list_directory_from_sftp_free(struct list_directory_from_sftp_ctx *ctx);
 void list_directory_from_sftp_warn_unsorted(void);
 void list_directory_from_sftp_print(struct fxp_name *name);
 
+/*
+ * Inline integrity verification of file transfers (the -verify
+ * option). An XferVerify object hashes file data as it flows through
+ * the transfer engine; at the end of the transfer the whole-file
+ * SHA-256 is reported, and if the server supports the check-file
+ * extension, per-block hashes are compared against the server's copy.
+ * xfer_verify_new returns NULL unless verification was enabled, and
+ * the other functions all accept NULL quietly.
+ */
+struct fxp_handle;                     /* in sftp.h */
+struct sftp_packet;
+struct sftp_request;
+typedef struct XferVerify XferVerify;
+void xfer_verify_enable(void);
+bool xfer_verify_active(void);
+XferVerify *xfer_verify_new(void);
+void xfer_verify_data(XferVerify *xv, const void *data, size_t len);
+bool xfer_verify_report(XferVerify *xv, const char *fname,
+                        struct fxp_handle *fh);
+void xfer_verify_free(XferVerify *xv);
+/* Piecewise interface to the server comparison, for transfer engines
+ * that can't block: send the next request, process its reply, ask
+ * whether any more are needed. */
+bool xfer_verify_check_needed(XferVerify *xv);
+struct sftp_request *xfer_verify_check_send(XferVerify *xv,
+                                            struct fxp_handle *fh);
+bool xfer_verify_check_recv(XferVerify *xv, struct sftp_packet *pktin,
+                            struct sftp_request *req);
+bool xfer_verify_check_complete(XferVerify *xv);
+
+/* Provided by each tool's front end: send an SFTP request and wait
+ * for its reply. */
+struct sftp_packet *sftp_wait_for_reply(struct sftp_request *req);
+
 #endif /* PUTTY_PSFTP_H */
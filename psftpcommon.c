@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "putty.h"
+#include "ssh.h"
 #include "ssh/sftp.h"
 #include "psftp.h"
 
@@ -100,3 +101,223 @@ void list_directory_from_sftp_finish(struct list_directory_from_sftp_ctx *ctx)
             list_directory_from_sftp_print(ctx->names[i]);
     }
 }
+
+/* ----------------------------------------------------------------------
+ * Inline integrity verification of file transfers (the -verify option
+ * in both tools).
+ *
+ * An XferVerify object hashes the file data as it flows through the
+ * transfer engine, so verification costs no extra pass over the file
+ * on either side's disk. We keep two digests going: a whole-file
+ * SHA-256 which is always reported to the user, and a hash per
+ * 32K block, because the check-file protocol extension (if the server
+ * supports it) returns the _server's_ hashes block by block, letting
+ * us confirm end to end that what we transferred matches what the
+ * server's filesystem holds.
+ */
+
+/*
+ * The block size whose hashes we compare, and how many blocks each
+ * check-file request covers (bounded by the 1MB cap sftp_recv imposes
+ * on reply packets, and by the server's own limit on blocks per
+ * request).
+ */
+#define XFER_VERIFY_BLOCKSIZE 32768
+#define XFER_VERIFY_BLOCKS_PER_REQ 4096
+
+static bool xfer_verify_enabled = false;
+
+void xfer_verify_enable(void)
+{
+    xfer_verify_enabled = true;
+}
+
+bool xfer_verify_active(void)
+{
+    return xfer_verify_enabled;
+}
+
+struct XferVerify {
+    ssh_hash *whole;            /* whole-file hash, reported to the user */
+    ssh_hash *block;            /* hash of the current partial block */
+    size_t blockfill;
+    strbuf *blockhashes;        /* 32 bytes per completed block */
+    uint64_t length;
+    unsigned char digest[32];
+    bool finalised;
+
+    /* Progress of comparison against the server's check-file replies. */
+    uint64_t check_offset, check_span;
+    size_t check_hashpos;
+    bool mismatch;
+};
+
+XferVerify *xfer_verify_new(void)
+{
+    XferVerify *xv;
+
+    if (!xfer_verify_enabled)
+        return NULL;
+
+    xv = snew(XferVerify);
+    memset(xv, 0, sizeof(*xv));
+    xv->whole = ssh_hash_new(&ssh_sha256);
+    xv->block = ssh_hash_new(&ssh_sha256);
+    xv->blockhashes = strbuf_new();
+    return xv;
+}
+
+void xfer_verify_data(XferVerify *xv, const void *vdata, size_t len)
+{
+    const unsigned char *data = (const unsigned char *)vdata;
+
+    if (!xv)
+        return;
+
+    put_data(xv->whole, data, len);
+    xv->length += len;
+
+    while (len > 0) {
+        size_t chunk = XFER_VERIFY_BLOCKSIZE - xv->blockfill;
+        if (chunk > len)
+            chunk = len;
+        put_data(xv->block, data, chunk);
+        xv->blockfill += chunk;
+        data += chunk;
+        len -= chunk;
+        if (xv->blockfill == XFER_VERIFY_BLOCKSIZE) {
+            ssh_hash_final(xv->block, strbuf_append(xv->blockhashes, 32));
+            xv->block = ssh_hash_new(&ssh_sha256);
+            xv->blockfill = 0;
+        }
+    }
+}
+
+static void xfer_verify_finalise(XferVerify *xv)
+{
+    if (xv->finalised)
+        return;
+    if (xv->blockfill > 0) {
+        ssh_hash_final(xv->block, strbuf_append(xv->blockhashes, 32));
+        xv->block = NULL;
+    }
+    ssh_hash_final(xv->whole, xv->digest);
+    xv->whole = NULL;
+    xv->finalised = true;
+}
+
+/*
+ * Whether a comparison against the server is both wanted and
+ * possible. (An empty file has nothing to compare; the check-file
+ * request machinery below assumes at least one block.)
+ */
+bool xfer_verify_check_needed(XferVerify *xv)
+{
+    return xv && fxp_has_check_file() && xv->length > 0;
+}
+
+/*
+ * Send the next span of check-file requests for the given handle, and
+ * process the reply. A multi-gigabyte file needs several requests,
+ * because of the server-side cap on blocks hashed per request; the
+ * object keeps track of how far through the file we've got. The
+ * send/recv halves are separate so that psftp's pipelined download
+ * engine can interleave them with other requests.
+ */
+struct sftp_request *xfer_verify_check_send(XferVerify *xv,
+                                            struct fxp_handle *fh)
+{
+    uint64_t span = xv->length - xv->check_offset;
+    uint64_t max = (uint64_t)XFER_VERIFY_BLOCKS_PER_REQ * XFER_VERIFY_BLOCKSIZE;
+
+    xfer_verify_finalise(xv);
+    if (span > max)
+        span = max;
+    xv->check_span = span;
+    return fxp_check_file_send(fh, xv->check_offset, span,
+                               XFER_VERIFY_BLOCKSIZE);
+}
+
+bool xfer_verify_check_recv(XferVerify *xv, struct sftp_packet *pktin,
+                            struct sftp_request *req)
+{
+    strbuf *remote = strbuf_new();
+    bool ok = fxp_check_file_recv(pktin, req, remote);
+
+    if (ok) {
+        size_t nblocks = (xv->check_span + XFER_VERIFY_BLOCKSIZE - 1) /
+            XFER_VERIFY_BLOCKSIZE;
+        if (remote->len != nblocks * 32 ||
+            memcmp(remote->s, xv->blockhashes->s + xv->check_hashpos,
+                   remote->len) != 0)
+            xv->mismatch = true;
+        xv->check_hashpos += nblocks * 32;
+        xv->check_offset += xv->check_span;
+    } else {
+        xv->mismatch = true;  /* couldn't get hashes: count as a failure */
+    }
+    strbuf_free(remote);
+    return ok && !xv->mismatch;
+}
+
+bool xfer_verify_check_complete(XferVerify *xv)
+{
+    return xv->mismatch || xv->check_offset >= xv->length;
+}
+
+/*
+ * Print the results of verification, and free the object. If 'fh' is
+ * non-NULL and the server supports check-file, runs the comparison
+ * synchronously first. Returns false if the comparison was attempted
+ * and failed.
+ */
+bool xfer_verify_report(XferVerify *xv, const char *fname,
+                        struct fxp_handle *fh)
+{
+    bool ok = true;
+    char hex[65];
+    int i;
+
+    if (!xv)
+        return true;
+    xfer_verify_finalise(xv);
+
+    for (i = 0; i < 32; i++)
+        sprintf(hex + 2*i, "%02x", xv->digest[i]);
+    printf("%s: sha256 %s\n", fname, hex);
+
+    if (fh && xfer_verify_check_needed(xv)) {
+        while (!xfer_verify_check_complete(xv)) {
+            struct sftp_request *req = xfer_verify_check_send(xv, fh);
+            struct sftp_packet *pktin = sftp_wait_for_reply(req);
+            if (!xfer_verify_check_recv(xv, pktin, req))
+                break;
+        }
+    }
+
+    /* Report the verdict if a comparison happened, whether we ran it
+     * just now or a pipelined caller fed us the replies already. */
+    if (xv->mismatch || xv->check_offset > 0) {
+        ok = !xv->mismatch;
+        if (ok)
+            printf("%s: verified against server's copy\n", fname);
+        else
+            printf("%s: VERIFY FAILED: server's hashes do not match\n",
+                   fname);
+    }
+
+    xfer_verify_free(xv);
+    return ok;
+}
+
+void xfer_verify_free(XferVerify *xv)
+{
+    if (!xv)
+        return;
+    if (xv->whole)
+        ssh_hash_free(xv->whole);
+    if (xv->block)
+        ssh_hash_free(xv->block);
+    strbuf_free(xv->blockhashes);
+    sfree(xv);
+}
@@ -42,6 +42,7 @@ typedef enum RecordDestination {
 struct psocks_state {
     const PsocksPlatform *platform;
     int listen_port;
+    int nworkers;
     bool acceptall;
     PortFwdManager *portfwdmgr;
     uint64_t next_conn_index;
@@ -59,6 +60,7 @@ struct psocks_connection {
     Channel *chan;
     char *host, *realhost;
     int port;
+    pending_lookup *lookup;
     SockAddr *addr;
     Socket *socket;
     bool connecting, eof_pfmgr_to_socket, eof_socket_to_pfmgr;
@@ -237,6 +239,8 @@ static void psocks_conn_free(psocks_connection *conn)
 
     sfree(conn->host);
     sfree(conn->realhost);
+    if (conn->lookup)
+        sk_namelookup_cancel(conn->lookup);
     if (conn->socket)
         sk_close(conn->socket);
     if (conn->chan)
@@ -247,14 +251,13 @@ static void psocks_conn_free(psocks_connection *conn)
     sfree(conn);
 }
 
-static void psocks_connection_establish(void *vctx)
+static void psocks_lookup_done(SockAddr *addr, char *canonicalname,
+                               void *vctx)
 {
     psocks_connection *conn = (psocks_connection *)vctx;
-
-    /*
-     * Look up destination host name.
-     */
-    conn->addr = sk_namelookup(conn->host, &conn->realhost, ADDRTYPE_UNSPEC);
+    conn->lookup = NULL;
+    conn->addr = addr;
+    conn->realhost = canonicalname;
 
     const char *err = sk_addr_error(conn->addr);
     if (err) {
@@ -262,6 +265,8 @@ static void psocks_connection_establish(void *vctx)
         chan_open_failed(conn->chan, msg);
         sfree(msg);
 
+        sk_addr_free(conn->addr);
+        conn->addr = NULL;
         psocks_conn_free(conn);
         return;
     }
@@ -274,6 +279,20 @@ static void psocks_connection_establish(void *vctx)
                           &conn->plug);
 }
 
+static void psocks_connection_establish(void *vctx)
+{
+    psocks_connection *conn = (psocks_connection *)vctx;
+
+    /*
+     * Start looking up the destination host name. This happens
+     * asynchronously, so that a slow DNS answer for one connection
+     * doesn't stall the whole event loop and every other connection
+     * with it.
+     */
+    conn->lookup = sk_namelookup_async(conn->host, ADDRTYPE_UNSPEC,
+                                       psocks_lookup_done, conn);
+}
+
 static size_t psocks_sc_write(SshChannel *sc, bool is_stderr,
                               const void *data, size_t len)
 {
@@ -398,6 +417,7 @@ psocks_state *psocks_new(const PsocksPlatform *platform)
     memset(ps, 0, sizeof(*ps));
 
     ps->listen_port = 1080;
+    ps->nworkers = 1;
     ps->acceptall = false;
 
     ps->cl.vt = &psocks_clvt;
@@ -451,6 +471,23 @@ void psocks_cmdline(psocks_state *ps, int argc, char **argv)
 		    exit(1);
 		}
 		ps->rec_dest = REC_PIPE;
+            } else if (!strcmp(p, "-w")) {
+                if (!ps->platform->start_workers) {
+		    fprintf(stderr, "psocks: '-w' is not supported on this "
+                            "platform\n");
+		    exit(1);
+                }
+		if (--argc > 0) {
+		    ps->nworkers = atoi(*++argv);
+                    if (ps->nworkers < 1) {
+                        fprintf(stderr, "psocks: expected a positive "
+                                "number of workers\n");
+                        exit(1);
+                    }
+		} else {
+		    fprintf(stderr, "psocks: expected an argument to '-w'\n");
+		    exit(1);
+		}
 	    } else if (!strcmp(p, "--exec")) {
                 if (!ps->platform->start_subcommand) {
 		    fprintf(stderr, "psocks: running a subcommand is not "
@@ -476,6 +513,9 @@ void psocks_cmdline(psocks_state *ps, int argc, char **argv)
                            " to 'pipe-cmd [in|out] N'\n");
                 printf("       -g           accept connections from anywhere,"
                        " not just localhost\n");
+                if (ps->platform->start_workers)
+                    printf("       -w workers   accept connections in this "
+                           "many worker processes\n");
                 if (ps->platform->start_subcommand)
                     printf("       --exec subcmd [args...]   run command, and "
                            "terminate when it exits\n");
@@ -513,7 +553,18 @@ void psocks_start(psocks_state *ps)
 
     portfwdmgr_config(ps->portfwdmgr, conf);
 
-    if (ps->subcmd->len)
+    unsigned worker = 0;
+    if (ps->nworkers > 1 && ps->platform->start_workers) {
+        worker = ps->platform->start_workers(ps->nworkers);
+        /* Give each worker its own space of connection indices, so
+         * that recording filenames can't collide between workers. */
+        ps->next_conn_index = (uint64_t)worker << 32;
+    }
+
+    /* Only the original process runs the subcommand; workers find out
+     * about its termination by watching for the original process
+     * going away. */
+    if (ps->subcmd->len && worker == 0)
         ps->platform->start_subcommand(ps->subcmd);
 
     conf_free(conf);
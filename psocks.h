@@ -20,6 +20,14 @@ struct PsocksPlatform {
         const char *cmd, const char *const *direction_args,
         const char *index_arg, char **err);
     void (*start_subcommand)(strbuf *args);
+    /*
+     * Split into a team of identical worker processes which all
+     * accept connections from the already-created listening socket,
+     * each running its own event loop. Called once the listener
+     * exists; returns this process's worker index (0 for the
+     * original process). NULL if the platform can't do this.
+     */
+    unsigned (*start_workers)(int nworkers);
 };
 
 psocks_state *psocks_new(const PsocksPlatform *);
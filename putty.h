@@ -286,6 +286,20 @@ struct unicode_data {
 #define LGTYP_DEBUG 2                  /* logmode: all chars of traffic */
 #define LGTYP_PACKETS 3                /* logmode: SSH data packets */
 #define LGTYP_SSHRAW 4                 /* logmode: SSH raw data */
+#define LGTYP_SSHBIN 5                 /* logmode: SSH packets, binary format */
+
+/*
+ * Constants for the binary packet log format written by LGTYP_SSHBIN
+ * and read back by sshlogdump. The full record layout is documented
+ * in logging.c.
+ */
+#define BINLOG_MAGIC "PuTTYPacketLog1\n"
+#define BINLOG_REC_PKT_INCOMING 1
+#define BINLOG_REC_PKT_OUTGOING 2
+#define BINLOG_REC_EVENT 3
+#define BINLOG_SPAN_DATA 0
+#define BINLOG_SPAN_BLANKED 1
+#define BINLOG_SPAN_OMITTED 2
 
 /*
  * Enumeration of 'special commands' that can be sent during a
@@ -1389,6 +1403,14 @@ struct TermWinVtable {
      * PuTTY itself rather than the far end (defence against end-of-
      * authentication spoofing) */
     void (*draw_trust_sigil)(TermWin *, int x, int y);
+    /* Move already-drawn window content between the character rows
+     * topline and botline inclusive vertically by a whole number of
+     * rows, as an optimisation for scrolling: 'lines' is positive if
+     * the content should move up. The front end may decline by
+     * returning false (e.g. if it has no backing store to blit
+     * within), in which case the caller falls back to redrawing the
+     * lines in the usual way. */
+    bool (*draw_scroll)(TermWin *, int topline, int botline, int lines);
     int (*char_width)(TermWin *, int uc);
     void (*free_draw_ctx)(TermWin *);
 
@@ -1456,6 +1478,8 @@ static inline void win_draw_cursor(
 { win->vt->draw_cursor(win, x, y, text, len, attrs, line_attrs, tc); }
 static inline void win_draw_trust_sigil(TermWin *win, int x, int y)
 { win->vt->draw_trust_sigil(win, x, y); }
+static inline bool win_draw_scroll(TermWin *win, int top, int bot, int lines)
+{ return win->vt->draw_scroll(win, top, bot, lines); }
 static inline int win_char_width(TermWin *win, int uc)
 { return win->vt->char_width(win, uc); }
 static inline void win_free_draw_ctx(TermWin *win)
@@ -1520,6 +1544,8 @@ NORETURN void cleanup_exit(int);
     X(INT, NONE, ping_interval) /* in seconds */ \
     X(BOOL, NONE, tcp_nodelay) \
     X(BOOL, NONE, tcp_keepalives) \
+    X(INT, NONE, socket_sndbuf) /* kernel send buffer in bytes; 0 = OS default */ \
+    X(INT, NONE, socket_rcvbuf) /* kernel receive buffer in bytes; 0 = OS default */ \
     X(STR, NONE, loghost) /* logical host being contacted, for host key check */ \
     /* Proxy options */ \
     X(STR, NONE, proxy_exclude_list) \
@@ -1537,6 +1563,9 @@ NORETURN void cleanup_exit(int);
     X(STR, NONE, remote_cmd2) /* fallback if remote_cmd fails; never loaded or saved */ \
     X(BOOL, NONE, nopty) \
     X(BOOL, NONE, compression) \
+    X(INT, NONE, compression_level) /* zlib effort: 1=fast, 2=balanced,
+                                     * 3=best ratio */ \
+    X(FILENAME, NONE, compression_dict) \
     X(INT, INT, ssh_kexlist) \
     X(INT, INT, ssh_hklist) \
     X(BOOL, NONE, ssh_prefer_known_hostkeys) \
@@ -1637,6 +1666,9 @@ NORETURN void cleanup_exit(int);
     X(STR, NONE, wintitle) /* initial window title */ \
     /* Terminal options */ \
     X(INT, NONE, savelines) \
+    X(FILENAME, NONE, scrollback_file) /* optional mmap-backed persistent
+                                        * scrollback store; empty = keep
+                                        * scrollback in memory as usual */ \
     X(BOOL, NONE, dec_om) \
     X(BOOL, NONE, wrap_mode) \
     X(BOOL, NONE, lfhascr) \
@@ -1743,6 +1775,12 @@ NORETURN void cleanup_exit(int);
      * large window in SSH-2.                                         \
      */ \
     X(BOOL, NONE, ssh_simple) \
+    /*                                                                \
+     * Maximum number of files the file transfer tools will keep in   \
+     * flight at once over the SFTP channel during a multiple-file    \
+     * operation.                                                     \
+     */ \
+    X(INT, NONE, sftp_concurrency) \
     X(BOOL, NONE, ssh_connection_sharing) \
     X(BOOL, NONE, ssh_connection_sharing_upstream) \
     X(BOOL, NONE, ssh_connection_sharing_downstream) \
@@ -1837,6 +1875,7 @@ typedef enum NoiseSourceId {
     NOISE_SOURCE_THREADTIME,
     NOISE_SOURCE_PROCTIME,
     NOISE_SOURCE_PERFCOUNT,
+    NOISE_SOURCE_SYSLISTING,
     NOISE_MAX_SOURCES
 } NoiseSourceId;
 void noise_get_heavy(void (*func) (void *, int));
@@ -1897,6 +1936,9 @@ void term_size(Terminal *, int, int, int);
 void term_paint(Terminal *, int, int, int, int, bool);
 void term_scroll(Terminal *, int, int);
 void term_scroll_to_selection(Terminal *, int);
+int term_scrollback_search(Terminal *, const wchar_t *needle,
+                           int start_line, bool backwards);
+bool term_url_at(Terminal *, int x, int y, int *urlstart, int *urlend);
 void term_pwron(Terminal *, bool);
 void term_clrsb(Terminal *);
 void term_mouse(Terminal *, Mouse_Button, Mouse_Button, Mouse_Action,
@@ -1985,6 +2027,18 @@ struct LogPolicyVtable {
      * Ask whether extra verbose log messages are required.
      */
     bool (*verbose)(LogPolicy *lp);
+
+    /*
+     * Optionally, also receive machine-readable events: a small
+     * stable type code (LOGEV_*) plus parallel arrays of key and
+     * value strings. Most LogPolicy implementations leave this NULL
+     * (designated initialisers make that automatic), which causes
+     * logevent_structured_start() to return NULL so that emitting
+     * sites don't format anything at all.
+     */
+    void (*structured_event)(LogPolicy *lp, int type,
+                             const char *const *keys,
+                             const char *const *values, size_t nfields);
 };
 struct LogPolicy {
     const LogPolicyVtable *vt;
@@ -2023,6 +2077,7 @@ LogPolicy *log_get_policy(LogContext *logctx);
 void logevent(LogContext *logctx, const char *event);
 void logeventf(LogContext *logctx, const char *fmt, ...) PRINTF_LIKE(2, 3);
 void logeventvf(LogContext *logctx, const char *fmt, va_list ap);
+void log_startup_phase(LogContext *logctx, const char *phase);
 
 /*
  * Pass a dynamically allocated string to logevent and immediately
@@ -2030,6 +2085,38 @@ void logeventvf(LogContext *logctx, const char *fmt, va_list ap);
  * value of dupprintf straight to this.
  */
 void logevent_and_free(LogContext *logctx, char *event);
+
+/*
+ * Structured events: a machine-readable counterpart to the Event Log,
+ * for front ends whose output is consumed by tooling rather than (or
+ * as well as) read by humans. Each event has a type code from the
+ * enumeration below and any number of key-value string fields.
+ *
+ * logevent_structured_start returns NULL unless the LogPolicy has a
+ * structured_event consumer attached, and the field/emit functions
+ * tolerate a NULL event, so the cost at an emitting site when nobody
+ * is listening is a single pointer test and no formatting:
+ *
+ *     LogStructuredEvent *le = logevent_structured_start(
+ *         logctx, LOGEV_KEX);
+ *     logevent_structured_field(le, "kex", "%s", alg->name);
+ *     logevent_structured_emit(le);
+ */
+enum {
+    LOGEV_KEX,                 /* key exchange completed */
+    LOGEV_AUTH_SUCCESS,        /* server accepted our authentication */
+    LOGEV_AUTH_FAILURE,        /* server rejected an auth attempt */
+};
+typedef struct LogStructuredEvent LogStructuredEvent;
+LogStructuredEvent *logevent_structured_start(LogContext *logctx, int type);
+void logevent_structured_field(LogStructuredEvent *le, const char *key,
+                               const char *fmt, ...) PRINTF_LIKE(3, 4);
+void logevent_structured_emit(LogStructuredEvent *le);
+/* Helper for consumers: append a one-line JSON object describing the
+ * event to a strbuf. */
+void log_structured_event_json(strbuf *out, int type,
+                               const char *const *keys,
+                               const char *const *values, size_t nfields);
 enum { PKT_INCOMING, PKT_OUTGOING };
 enum { PKTLOG_EMIT, PKTLOG_BLANK, PKTLOG_OMIT };
 struct logblank_t {
@@ -2087,6 +2174,7 @@ void ldisc_configure(Ldisc *, Conf *);
 void ldisc_free(Ldisc *);
 void ldisc_send(Ldisc *, const void *buf, int len, bool interactive);
 void ldisc_echoedit_update(Ldisc *);
+size_t ldisc_sendbuffer(Ldisc *);
 typedef struct LdiscInputToken {
     /*
      * Structure that encodes any single item of data that Ldisc can
@@ -2248,6 +2336,33 @@ int wc_match_pl(const char *wildcard, ptrlen target);
 int wc_match(const char *wildcard, const char *target);
 bool wc_unescape(char *output, const char *wildcard);
 
+/*
+ * Compiled form of a wildcard, worth using when one pattern will be
+ * matched against many candidate strings (e.g. a whole directory
+ * listing). wc_compile returns NULL on a syntax error in the
+ * pattern, filling in *error (if non-NULL) with a value suitable for
+ * passing to wc_error.
+ */
+typedef struct WCPattern WCPattern;
+WCPattern *wc_compile(const char *wildcard, int *error);
+bool wc_match_compiled(const WCPattern *wcp, const char *target);
+bool wc_match_compiled_pl(const WCPattern *wcp, ptrlen target);
+void wc_pattern_free(WCPattern *wcp);
+
+/*
+ * A set of patterns, for asking whether any of a whole list matches
+ * a candidate string (e.g. a list of host patterns from
+ * configuration). Patterns without any wildcard syntax are kept in a
+ * sorted table and found in O(log n); only true wildcards are
+ * scanned linearly. wc_pattern_set_add returns false (and ignores
+ * the pattern) on a wildcard syntax error.
+ */
+typedef struct WCPatternSet WCPatternSet;
+WCPatternSet *wc_pattern_set_new(void);
+bool wc_pattern_set_add(WCPatternSet *wcs, const char *pattern);
+bool wc_pattern_set_match(WCPatternSet *wcs, const char *target);
+void wc_pattern_set_free(WCPatternSet *wcs);
+
 /*
  * Exports from frontend (windlg.c etc)
  */
@@ -2400,9 +2515,68 @@ void filename_serialise(BinarySink *bs, const Filename *f);
 Filename *filename_deserialise(BinarySource *src);
 char *get_username(void);              /* return value needs freeing */
 char *get_random_data(int bytes, const char *device); /* used in cmdgen.c */
+/*
+ * Run 'count' independent jobs, calling fn(ctx, index) once for each
+ * index in [0,count). On platforms with thread support the jobs are
+ * distributed across worker threads (at most one per CPU), so fn must
+ * tolerate being called concurrently for _different_ indices; on
+ * platforms without, they just run sequentially. Either way, all the
+ * jobs have completed by the time this function returns. Used by
+ * crypto primitives (e.g. the lanes of Argon2) that are specified to
+ * permit parallel evaluation.
+ */
+void run_in_parallel(size_t count, void (*fn)(void *ctx, size_t index),
+                     void *ctx);
+/*
+ * Run a single expensive job off the main thread. fn(ctx) is run on a
+ * worker thread if the platform can provide one, and completion(ctx)
+ * is called afterwards on the main thread, from its usual event loop.
+ * fn must confine itself to state nothing on the main thread will
+ * touch in the interim, and must not use the PRNG, which is not
+ * thread safe.
+ *
+ * If no thread can be had, fn is called here and now, completion is
+ * deferred via the toplevel callback queue, and NULL is returned.
+ * Otherwise the returned handle remains valid until just before
+ * completion is called; worker_thread_discard() can be used before
+ * then to wait for fn to finish and throw the completion away, e.g.
+ * if the state it would have updated is being freed. Passing NULL to
+ * worker_thread_discard is safe and does nothing.
+ */
+typedef struct WorkerThread WorkerThread;
+WorkerThread *run_in_worker_thread(
+    void (*fn)(void *ctx), void (*completion)(void *ctx), void *ctx);
+void worker_thread_discard(WorkerThread *wt);
 char filename_char_sanitise(char c);   /* rewrite special pathname chars */
 bool open_for_write_would_lose_data(const Filename *fn);
 
+/*
+ * Platform support for backing the terminal's scrollback store with a
+ * memory-mapped file, so that a long-lived session's history survives
+ * a restart and cold history is paged out by the OS instead of
+ * pinning RAM. terminal.c owns the file format; the platform provides
+ * only the mapping primitives. A platform that can't support the
+ * feature returns NULL from sb_file_open, and the terminal silently
+ * falls back to ordinary in-memory scrollback.
+ *
+ * sb_file_map maps [offset, offset+len) read-write and shared,
+ * extending the file first if it's too short; offset must be a
+ * multiple of sb_file_page_size(). sb_file_discard advises that the
+ * given byte range will never be read again, so its backing store can
+ * be released (best-effort; a no-op is legal). sb_file_truncate
+ * empties the file entirely, which happens when the user clears the
+ * scrollback - possibly for privacy reasons, so platforms shouldn't
+ * leave the old contents recoverable through the file.
+ */
+typedef struct ScrollbackFile ScrollbackFile;
+ScrollbackFile *sb_file_open(const Filename *filename, uint64_t *size_out);
+void sb_file_close(ScrollbackFile *sf);
+void *sb_file_map(ScrollbackFile *sf, uint64_t offset, size_t len);
+void sb_file_unmap(void *ptr, size_t len);
+void sb_file_discard(ScrollbackFile *sf, uint64_t offset, uint64_t len);
+void sb_file_truncate(ScrollbackFile *sf);
+size_t sb_file_page_size(void);
+
 /*
  * Exports and imports from timing.c.
  *
@@ -2531,6 +2705,25 @@ bool run_toplevel_callbacks(void);
 bool toplevel_callback_pending(void);
 void delete_callbacks_for_context(void *ctx);
 
+/*
+ * Optional event-loop instrumentation, in loopstats.c. Enabled by
+ * setting PUTTY_LOOPSTATS in the environment; when disabled,
+ * loopstats_active() returns false and the dispatch sites skip the
+ * rest. Each timed dispatch brackets the work with loopstats_now_us()
+ * and loopstats_record(), identifying the source by a category string
+ * and (typically) its function pointer; 'blocking' marks work that's
+ * expected to sit waiting for events, exempting it from the stall
+ * diagnostics (it still gets a histogram). loopstats_request_dump() is
+ * async-signal-safe, and makes the next loopstats_maybe_dump() call
+ * from the event loop write the accumulated histograms to stderr.
+ */
+bool loopstats_active(void);
+uint64_t loopstats_now_us(void);
+void loopstats_record(const char *category, uintptr_t id, uint64_t start_us,
+                      bool blocking);
+void loopstats_request_dump(void);
+void loopstats_maybe_dump(void);
+
 /*
  * Another facility in callback.c deals with 'idempotent' callbacks,
  * defined as those which never need to be scheduled again if they are
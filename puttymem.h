@@ -105,6 +105,29 @@ void *safegrowarray(void *array, size_t *size, size_t eltsize,
 #define sgrowarrayn_nm(a, s, n, m) sgrowarray_general(a, s, n, m, true )
 #define sgrowarray_nm( a, s, n   ) sgrowarray_general(a, s, n, 1, true )
 
+/*
+ * Optional per-subsystem allocation accounting, enabled by setting
+ * PUTTY_MEMSTATS in the environment (and costing one predicted branch
+ * per allocation otherwise). Subsystems bracket their allocations
+ * with memstats_push_tag("name") / memstats_pop_tag(); every block
+ * allocated in such a scope is counted against that tag for as long
+ * as it lives, however it is later resized, and blocks allocated
+ * outside any scope count as "other". memstats_request_dump() is
+ * async-signal-safe and makes the next memstats_maybe_dump() call
+ * from the event loop print the per-tag totals to stderr; the
+ * cli_main_loop front ends trigger it on SIGUSR2.
+ *
+ * Additionally setting PUTTY_MEMSITES records the same figures per
+ * allocation call site, keyed by return address, and the dump ranks
+ * the busiest sites (feed the addresses to addr2line to name them).
+ * Only available with compilers providing __builtin_return_address.
+ */
+bool memstats_active(void);
+void memstats_push_tag(const char *name);
+void memstats_pop_tag(void);
+void memstats_request_dump(void);
+void memstats_maybe_dump(void);
+
 /*
  * This function is called by the innermost safemalloc/saferealloc
  * functions when allocation fails. Usually it's provided by misc.c
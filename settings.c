@@ -569,6 +569,8 @@ void save_open_settings(settings_w *sesskey, Conf *conf)
     write_setting_i(sesskey, "PingIntervalSecs", conf_get_int(conf, CONF_ping_interval) % 60);  /* seconds */
     write_setting_b(sesskey, "TCPNoDelay", conf_get_bool(conf, CONF_tcp_nodelay));
     write_setting_b(sesskey, "TCPKeepalives", conf_get_bool(conf, CONF_tcp_keepalives));
+    write_setting_i(sesskey, "SocketSendBuffer", conf_get_int(conf, CONF_socket_sndbuf));
+    write_setting_i(sesskey, "SocketReceiveBuffer", conf_get_int(conf, CONF_socket_rcvbuf));
     write_setting_s(sesskey, "TerminalType", conf_get_str(conf, CONF_termtype));
     write_setting_s(sesskey, "TerminalSpeed", conf_get_str(conf, CONF_termspeed));
     wmap(sesskey, "TerminalModes", conf, CONF_ttymodes, true);
@@ -593,6 +595,8 @@ void save_open_settings(settings_w *sesskey, Conf *conf)
     write_setting_s(sesskey, "LocalUserName", conf_get_str(conf, CONF_localusername));
     write_setting_b(sesskey, "NoPTY", conf_get_bool(conf, CONF_nopty));
     write_setting_b(sesskey, "Compression", conf_get_bool(conf, CONF_compression));
+    write_setting_filename(sesskey, "CompressionDictFile", conf_get_filename(conf, CONF_compression_dict));
+    write_setting_i(sesskey, "CompressionLevel", conf_get_int(conf, CONF_compression_level));
     write_setting_b(sesskey, "TryAgent", conf_get_bool(conf, CONF_tryagent));
     write_setting_b(sesskey, "AgentFwd", conf_get_bool(conf, CONF_agentfwd));
 #ifndef NO_GSSAPI
@@ -680,6 +684,8 @@ void save_open_settings(settings_w *sesskey, Conf *conf)
 #endif
                     );
     write_setting_i(sesskey, "ScrollbackLines", conf_get_int(conf, CONF_savelines));
+    write_setting_filename(sesskey, "ScrollbackFile",
+                           conf_get_filename(conf, CONF_scrollback_file));
     write_setting_b(sesskey, "DECOriginMode", conf_get_bool(conf, CONF_dec_om));
     write_setting_b(sesskey, "AutoWrapMode", conf_get_bool(conf, CONF_wrap_mode));
     write_setting_b(sesskey, "LFImpliesCR", conf_get_bool(conf, CONF_lfhascr));
@@ -788,6 +794,7 @@ void save_open_settings(settings_w *sesskey, Conf *conf)
     write_setting_b(sesskey, "ConnectionSharing", conf_get_bool(conf, CONF_ssh_connection_sharing));
     write_setting_b(sesskey, "ConnectionSharingUpstream", conf_get_bool(conf, CONF_ssh_connection_sharing_upstream));
     write_setting_b(sesskey, "ConnectionSharingDownstream", conf_get_bool(conf, CONF_ssh_connection_sharing_downstream));
+    write_setting_i(sesskey, "SFTPParallelFiles", conf_get_int(conf, CONF_sftp_concurrency));
     wmap(sesskey, "SSHManualHostKeys", conf, CONF_ssh_manual_hostkeys, false);
 
     /*
@@ -861,6 +868,8 @@ void load_open_settings(settings_r *sesskey, Conf *conf)
     }
     gppb(sesskey, "TCPNoDelay", true, conf, CONF_tcp_nodelay);
     gppb(sesskey, "TCPKeepalives", false, conf, CONF_tcp_keepalives);
+    gppi(sesskey, "SocketSendBuffer", 0, conf, CONF_socket_sndbuf);
+    gppi(sesskey, "SocketReceiveBuffer", 0, conf, CONF_socket_rcvbuf);
     gpps(sesskey, "TerminalType", "xterm", conf, CONF_termtype);
     gpps(sesskey, "TerminalSpeed", "38400,38400", conf, CONF_termspeed);
     if (gppmap(sesskey, "TerminalModes", conf, CONF_ttymodes)) {
@@ -952,6 +961,8 @@ void load_open_settings(settings_r *sesskey, Conf *conf)
     gpps(sesskey, "LocalUserName", "", conf, CONF_localusername);
     gppb(sesskey, "NoPTY", false, conf, CONF_nopty);
     gppb(sesskey, "Compression", false, conf, CONF_compression);
+    gppfile(sesskey, "CompressionDictFile", conf, CONF_compression_dict);
+    gppi(sesskey, "CompressionLevel", 2, conf, CONF_compression_level);
     gppb(sesskey, "TryAgent", true, conf, CONF_tryagent);
     gppb(sesskey, "AgentFwd", false, conf, CONF_agentfwd);
     gppb(sesskey, "ChangeUsername", false, conf, CONF_change_username);
@@ -1118,6 +1129,7 @@ void load_open_settings(settings_r *sesskey, Conf *conf)
 #endif
                  );
     gppi(sesskey, "ScrollbackLines", 2000, conf, CONF_savelines);
+    gppfile(sesskey, "ScrollbackFile", conf, CONF_scrollback_file);
     gppb(sesskey, "DECOriginMode", false, conf, CONF_dec_om);
     gppb(sesskey, "AutoWrapMode", true, conf, CONF_wrap_mode);
     gppb(sesskey, "LFImpliesCR", false, conf, CONF_lfhascr);
@@ -1268,6 +1280,7 @@ void load_open_settings(settings_r *sesskey, Conf *conf)
          conf, CONF_ssh_connection_sharing_upstream);
     gppb(sesskey, "ConnectionSharingDownstream", true,
          conf, CONF_ssh_connection_sharing_downstream);
+    gppi(sesskey, "SFTPParallelFiles", 4, conf, CONF_sftp_concurrency);
     gppmap(sesskey, "SSHManualHostKeys", conf, CONF_ssh_manual_hostkeys);
 
     /*
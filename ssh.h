@@ -40,6 +40,29 @@ struct ssh_channel;
  *  - OUR_V2_PACKETLIMIT is actually the maximum size of SSH
  *    _packet_ we're prepared to cope with.  It must be a multiple
  *    of the cipher block size, and must be at least 35000.
+ *
+ *  - OUR_V2_OUTBUFLIMIT and OUR_V2_BIGOUTBUFLIMIT are the high
+ *    watermarks on the amount of unsent data we'll let build up on
+ *    an outgoing SSH-2 channel before asking the channel's local
+ *    data source to stop reading. The big one applies to the only
+ *    channel in a simple connection, where deep buffering keeps a
+ *    bulk transfer busy across window-adjust round trips; the small
+ *    one applies when channels are multiplexed. Reading resumes
+ *    once the buffer has drained below half the limit, so a source
+ *    hovering near the boundary is paused and resumed in bulk
+ *    rather than toggled on every write.
+ *
+ *  - OUR_V2_INBUFLIMIT is the corresponding high watermark on data
+ *    buffered for a slow local consumer of a simple connection's
+ *    only channel (e.g. plink's stdout feeding a pipe that isn't
+ *    being read fast enough). Previously any backlog at all
+ *    throttled the whole connection and it stayed throttled until
+ *    the backlog reached zero, so a consumer slightly slower than
+ *    the network saw a sawtooth of stop-and-go. Instead we let this
+ *    much data accumulate locally before shutting off the flow, and
+ *    turn it back on once the buffer has drained below half, so
+ *    brief downstream hiccups are absorbed by the buffer and the
+ *    network stays busy.
  */
 
 #define SSH1_BUFFER_LIMIT 32768
@@ -48,6 +71,9 @@ struct ssh_channel;
 #define OUR_V2_BIGWIN 0x7fffffff
 #define OUR_V2_MAXPKT 0x4000UL
 #define OUR_V2_PACKETLIMIT 0x9000UL
+#define OUR_V2_OUTBUFLIMIT 32768
+#define OUR_V2_BIGOUTBUFLIMIT 0x100000
+#define OUR_V2_INBUFLIMIT 0x40000
 
 typedef struct PacketQueueNode PacketQueueNode;
 struct PacketQueueNode {
@@ -68,8 +94,13 @@ typedef struct PktOut {
     size_t length;          /* total bytes, including prefix */
     int type;
     size_t minlen;          /* SSH-2: ensure wire length is at least this */
-    unsigned char *data;    /* allocated storage */
-    size_t maxlen;          /* amount of storage allocated for `data' */
+    unsigned char *data;    /* storage for the packet, points at
+                             * inline_data until the packet outgrows it */
+    size_t maxlen;          /* amount of storage available at `data' */
+    /* Most protocol packets are small, so they're built in this
+     * buffer inside the PktOut itself, and constructing one costs
+     * just the single malloc of the structure. */
+    unsigned char inline_data[256];
 
     /* Extra metadata used in SSH packet logging mode, allowing us to
      * log in the packet header line that the packet came from a
@@ -171,7 +202,8 @@ void ssh_connshare_provide_connlayer(ssh_sharing_state *sharestate,
                                      ConnectionLayer *cl);
 bool ssh_share_test_for_upstream(const char *host, int port, Conf *conf);
 void share_got_pkt_from_server(ssh_sharing_connstate *ctx, int type,
-                               const void *pkt, int pktlen);
+                               const void *pkt, int pktlen,
+                               share_channel **route);
 void share_activate(ssh_sharing_state *sharestate,
                     const char *server_verstring);
 void sharestate_free(ssh_sharing_state *state);
@@ -470,6 +502,7 @@ struct ec_wcurve
 {
     WeierstrassCurve *wc;
     WeierstrassPoint *G;
+    WeierstrassFixedBase *Gfb;  /* precomputed table for multiplying G */
     mp_int *G_order;
 };
 
@@ -486,6 +519,7 @@ struct ec_ecurve
 {
     EdwardsCurve *ec;
     EdwardsPoint *G;
+    EdwardsFixedBase *Gfb;      /* precomputed table for multiplying G */
     mp_int *G_order;
     unsigned log2_cofactor;
 };
@@ -535,6 +569,18 @@ struct eddsa_key {
     const struct ec_curve *curve;
     EdwardsPoint *publicKey;
     mp_int *privateKey;
+    /* Fixed-base comb table for the public key, built lazily the
+     * first time we verify a signature with this key, so that bursts
+     * of verifications with the same key share the precomputation. */
+    EdwardsFixedBase *pkfb;
+    /* Expansion of the private key, filled in lazily by the first
+     * signature: the secret scalar derived from the first half of
+     * the private-key hash, and the second half of that hash, which
+     * seeds the deterministic signature nonces. Both are fixed for
+     * the life of the key, so agents signing repeatedly with the
+     * same key don't rehash the private key every time. */
+    mp_int *sign_exponent;
+    strbuf *sign_nonce_seed;
     ssh_key sshk;
 };
 
@@ -673,7 +719,12 @@ struct ssh_cipheralg {
 };
 
 static inline ssh_cipher *ssh_cipher_new(const ssh_cipheralg *alg)
-{ return alg->new(alg); }
+{
+    memstats_push_tag("crypto");
+    ssh_cipher *c = alg->new(alg);
+    memstats_pop_tag();
+    return c;
+}
 static inline void ssh_cipher_free(ssh_cipher *c)
 { c->vt->free(c); }
 static inline void ssh_cipher_setiv(ssh_cipher *c, const void *iv)
@@ -681,15 +732,47 @@ static inline void ssh_cipher_setiv(ssh_cipher *c, const void *iv)
 static inline void ssh_cipher_setkey(ssh_cipher *c, const void *key)
 { c->vt->setkey(c, key); }
 static inline void ssh_cipher_encrypt(ssh_cipher *c, void *blk, int len)
-{ c->vt->encrypt(c, blk, len); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        c->vt->encrypt(c, blk, len);
+        cryptoprof_record("cipher-encrypt", c->vt->text_name, t, len);
+    } else {
+        c->vt->encrypt(c, blk, len);
+    }
+}
 static inline void ssh_cipher_decrypt(ssh_cipher *c, void *blk, int len)
-{ c->vt->decrypt(c, blk, len); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        c->vt->decrypt(c, blk, len);
+        cryptoprof_record("cipher-decrypt", c->vt->text_name, t, len);
+    } else {
+        c->vt->decrypt(c, blk, len);
+    }
+}
 static inline void ssh_cipher_encrypt_length(
     ssh_cipher *c, void *blk, int len, unsigned long seq)
-{ c->vt->encrypt_length(c, blk, len, seq); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        c->vt->encrypt_length(c, blk, len, seq);
+        cryptoprof_record("cipher-encrypt-length", c->vt->text_name, t, len);
+    } else {
+        c->vt->encrypt_length(c, blk, len, seq);
+    }
+}
 static inline void ssh_cipher_decrypt_length(
     ssh_cipher *c, void *blk, int len, unsigned long seq)
-{ c->vt->decrypt_length(c, blk, len, seq); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        c->vt->decrypt_length(c, blk, len, seq);
+        cryptoprof_record("cipher-decrypt-length", c->vt->text_name, t, len);
+    } else {
+        c->vt->decrypt_length(c, blk, len, seq);
+    }
+}
 static inline const struct ssh_cipheralg *ssh_cipher_alg(ssh_cipher *c)
 { return c->vt; }
 
@@ -710,6 +793,10 @@ struct ssh2_macalg {
     void (*setkey)(ssh2_mac *, ptrlen key);
     void (*start)(ssh2_mac *);
     void (*genresult)(ssh2_mac *, unsigned char *);
+    /* Optional method (may be null): verify the MACs on a whole batch
+     * of packets in one call. See ssh2_mac_multiverify below. */
+    bool (*multiverify)(ssh2_mac *, size_t npkts, const ptrlen *pkts,
+                        const unsigned long *seqs, bool *results);
     const char *(*text_name)(ssh2_mac *);
     const char *name, *etm_name;
     int len, keylen;
@@ -720,7 +807,12 @@ struct ssh2_macalg {
 
 static inline ssh2_mac *ssh2_mac_new(
     const ssh2_macalg *alg, ssh_cipher *cipher)
-{ return alg->new(alg, cipher); }
+{
+    memstats_push_tag("crypto");
+    ssh2_mac *m = alg->new(alg, cipher);
+    memstats_pop_tag();
+    return m;
+}
 static inline void ssh2_mac_free(ssh2_mac *m)
 { m->vt->free(m); }
 static inline void ssh2_mac_setkey(ssh2_mac *m, ptrlen key)
@@ -741,6 +833,32 @@ bool ssh2_mac_verresult(ssh2_mac *, const void *);
 void ssh2_mac_generate(ssh2_mac *, void *, int, unsigned long seq);
 bool ssh2_mac_verify(ssh2_mac *, const void *, int, unsigned long seq);
 
+/* Batched form of ssh2_mac_verify: check the MACs on npkts packets in
+ * one call, filling in results[i] for each. Each pkts[i].len is the
+ * length of the data the MAC covers, with the received MAC expected
+ * to sit immediately after it in memory, as in ssh2_mac_verify.
+ * Returns false without touching 'results' if this MAC has no
+ * multi-buffer implementation, in which case the caller should fall
+ * back to verifying packets one at a time. */
+static inline bool ssh2_mac_multiverify(
+    ssh2_mac *mac, size_t npkts, const ptrlen *pkts,
+    const unsigned long *seqs, bool *results)
+{
+    if (mac->vt->multiverify == NULL)
+        return false;
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        size_t i, bytes = 0;
+        for (i = 0; i < npkts; i++)
+            bytes += pkts[i].len;
+        bool toret = mac->vt->multiverify(mac, npkts, pkts, seqs, results);
+        cryptoprof_record("mac-multiverify", mac->vt->text_name(mac),
+                          t, bytes);
+        return toret;
+    }
+    return mac->vt->multiverify(mac, npkts, pkts, seqs, results);
+}
+
 /* Use a MAC in its raw form, outside SSH-2 context, to MAC a given
  * string with a given key in the most obvious way. */
 void mac_simple(const ssh2_macalg *alg, ptrlen key, ptrlen data, void *output);
@@ -765,7 +883,13 @@ struct ssh_hashalg {
 };
 
 static inline ssh_hash *ssh_hash_new(const ssh_hashalg *alg)
-{ ssh_hash *h = alg->new(alg); if (h) h->vt->reset(h); return h; }
+{
+    memstats_push_tag("crypto");
+    ssh_hash *h = alg->new(alg);
+    memstats_pop_tag();
+    if (h) h->vt->reset(h);
+    return h;
+}
 static inline ssh_hash *ssh_hash_copy(ssh_hash *orig)
 { ssh_hash *h = orig->vt->new(orig->vt); h->vt->copyfrom(h, orig); return h; }
 static inline void ssh_hash_digest(ssh_hash *h, unsigned char *out)
@@ -901,21 +1025,36 @@ struct ssh_compression_alg {
     /* For zlib@openssh.com: if non-NULL, this name will be considered once
      * userauth has completed successfully. */
     const char *delayed_name;
-    ssh_compressor *(*compress_new)(void);
+    /* 'level' is an effort level from CONF_compression_level, or 0
+     * for contexts with no Conf to hand; implementations treat values
+     * they don't understand as their default. */
+    ssh_compressor *(*compress_new)(int level);
     void (*compress_free)(ssh_compressor *);
     void (*compress)(ssh_compressor *, const unsigned char *block, int len,
                      unsigned char **outblock, int *outlen,
                      int minlen);
     ssh_decompressor *(*decompress_new)(void);
     void (*decompress_free)(ssh_decompressor *);
+    /* The block returned in *outblock is owned by the decompressor,
+     * and remains valid only until the next decompress call (or the
+     * decompressor is freed); callers must not free it. */
     bool (*decompress)(ssh_decompressor *, const unsigned char *block, int len,
                        unsigned char **outblock, int *outlen);
+    /* Optional methods (may be null): prime a newly created
+     * compressor or decompressor with a preset dictionary, as if the
+     * dictionary bytes had already passed through the stream without
+     * being transmitted. Both directions of a connection must be
+     * primed with the same data, so algorithms providing these
+     * methods are negotiated under private names that are only
+     * offered when a dictionary is configured. */
+    void (*compress_prime)(ssh_compressor *, ptrlen dict);
+    void (*decompress_prime)(ssh_decompressor *, ptrlen dict);
     const char *text_name;
 };
 
 static inline ssh_compressor *ssh_compressor_new(
-    const ssh_compression_alg *alg)
-{ return alg->compress_new(); }
+    const ssh_compression_alg *alg, int level)
+{ return alg->compress_new(level); }
 static inline ssh_decompressor *ssh_decompressor_new(
     const ssh_compression_alg *alg)
 { return alg->decompress_new(); }
@@ -926,11 +1065,27 @@ static inline void ssh_decompressor_free(ssh_decompressor *d)
 static inline void ssh_compressor_compress(
     ssh_compressor *c, const unsigned char *block, int len,
     unsigned char **outblock, int *outlen, int minlen)
-{ c->vt->compress(c, block, len, outblock, outlen, minlen); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        c->vt->compress(c, block, len, outblock, outlen, minlen);
+        cryptoprof_record("compress", c->vt->name, t, len);
+    } else {
+        c->vt->compress(c, block, len, outblock, outlen, minlen);
+    }
+}
 static inline bool ssh_decompressor_decompress(
     ssh_decompressor *d, const unsigned char *block, int len,
     unsigned char **outblock, int *outlen)
-{ return d->vt->decompress(d, block, len, outblock, outlen); }
+{
+    if (cryptoprof_active()) {
+        uint64_t t = cryptoprof_ticks();
+        bool toret = d->vt->decompress(d, block, len, outblock, outlen);
+        cryptoprof_record("decompress", d->vt->name, t, len);
+        return toret;
+    }
+    return d->vt->decompress(d, block, len, outblock, outlen);
+}
 static inline const ssh_compression_alg *ssh_compressor_alg(
     ssh_compressor *c)
 { return c->vt; }
@@ -965,29 +1120,37 @@ extern const ssh_cipheralg ssh_3des_ssh2;
 extern const ssh_cipheralg ssh_des;
 extern const ssh_cipheralg ssh_des_sshcom_ssh2;
 extern const ssh_cipheralg ssh_aes256_sdctr;
+extern const ssh_cipheralg ssh_aes256_sdctr_vaes;
 extern const ssh_cipheralg ssh_aes256_sdctr_ni;
 extern const ssh_cipheralg ssh_aes256_sdctr_neon;
 extern const ssh_cipheralg ssh_aes256_sdctr_sw;
 extern const ssh_cipheralg ssh_aes256_cbc;
+extern const ssh_cipheralg ssh_aes256_cbc_vaes;
 extern const ssh_cipheralg ssh_aes256_cbc_ni;
 extern const ssh_cipheralg ssh_aes256_cbc_neon;
 extern const ssh_cipheralg ssh_aes256_cbc_sw;
 extern const ssh_cipheralg ssh_aes192_sdctr;
+extern const ssh_cipheralg ssh_aes192_sdctr_vaes;
 extern const ssh_cipheralg ssh_aes192_sdctr_ni;
 extern const ssh_cipheralg ssh_aes192_sdctr_neon;
 extern const ssh_cipheralg ssh_aes192_sdctr_sw;
 extern const ssh_cipheralg ssh_aes192_cbc;
+extern const ssh_cipheralg ssh_aes192_cbc_vaes;
 extern const ssh_cipheralg ssh_aes192_cbc_ni;
 extern const ssh_cipheralg ssh_aes192_cbc_neon;
 extern const ssh_cipheralg ssh_aes192_cbc_sw;
 extern const ssh_cipheralg ssh_aes128_sdctr;
+extern const ssh_cipheralg ssh_aes128_sdctr_vaes;
 extern const ssh_cipheralg ssh_aes128_sdctr_ni;
 extern const ssh_cipheralg ssh_aes128_sdctr_neon;
 extern const ssh_cipheralg ssh_aes128_sdctr_sw;
 extern const ssh_cipheralg ssh_aes128_cbc;
+extern const ssh_cipheralg ssh_aes128_cbc_vaes;
 extern const ssh_cipheralg ssh_aes128_cbc_ni;
 extern const ssh_cipheralg ssh_aes128_cbc_neon;
 extern const ssh_cipheralg ssh_aes128_cbc_sw;
+extern const ssh_cipheralg ssh_aes128_gcm;
+extern const ssh_cipheralg ssh_aes256_gcm;
 extern const ssh_cipheralg ssh_blowfish_ssh2_ctr;
 extern const ssh_cipheralg ssh_blowfish_ssh2;
 extern const ssh_cipheralg ssh_arcfour256_ssh2;
@@ -1009,9 +1172,11 @@ extern const ssh_hashalg ssh_sha256_ni;
 extern const ssh_hashalg ssh_sha256_neon;
 extern const ssh_hashalg ssh_sha256_sw;
 extern const ssh_hashalg ssh_sha384;
+extern const ssh_hashalg ssh_sha384_avx2;
 extern const ssh_hashalg ssh_sha384_neon;
 extern const ssh_hashalg ssh_sha384_sw;
 extern const ssh_hashalg ssh_sha512;
+extern const ssh_hashalg ssh_sha512_avx2;
 extern const ssh_hashalg ssh_sha512_neon;
 extern const ssh_hashalg ssh_sha512_sw;
 extern const ssh_hashalg ssh_sha3_224;
@@ -1020,6 +1185,17 @@ extern const ssh_hashalg ssh_sha3_384;
 extern const ssh_hashalg ssh_sha3_512;
 extern const ssh_hashalg ssh_shake256_114bytes;
 extern const ssh_hashalg ssh_blake2b;
+
+/*
+ * Incremental interface to SHAKE, for squeezing out an arbitrary
+ * amount of output data, rather than being limited to the fixed
+ * output length of one of the ssh_hashalg wrappers above. Absorb the
+ * whole input by constructing a ShakeXOF from it, then call
+ * shake_xof_read as many times as you like.
+ */
+ShakeXOF *shake256_xof_from_input(ptrlen data);
+void shake_xof_read(ShakeXOF *sx, void *output_v, size_t size);
+void shake_xof_free(ShakeXOF *sx);
 extern const ssh_kexes ssh_diffiehellman_group1;
 extern const ssh_kexes ssh_diffiehellman_group14;
 extern const ssh_kexes ssh_diffiehellman_gex;
@@ -1046,8 +1222,13 @@ extern const ssh2_macalg ssh_hmac_sha1_buggy;
 extern const ssh2_macalg ssh_hmac_sha1_96;
 extern const ssh2_macalg ssh_hmac_sha1_96_buggy;
 extern const ssh2_macalg ssh_hmac_sha256;
+extern const ssh2_macalg ssh2_umac64;
+extern const ssh2_macalg ssh2_umac128;
 extern const ssh2_macalg ssh2_poly1305;
+extern const ssh2_macalg ssh2_aesgcm_mac;
 extern const ssh_compression_alg ssh_zlib;
+extern const ssh_compression_alg ssh_zlib_dict;
+extern const ssh_compression_alg ssh_zlib_perchannel;
 
 /* Special constructor: BLAKE2b can be instantiated with any hash
  * length up to 128 bytes */
@@ -1063,6 +1244,7 @@ bool platform_aes_neon_available(void);
 bool platform_sha256_neon_available(void);
 bool platform_sha1_neon_available(void);
 bool platform_sha512_neon_available(void);
+bool platform_crc32_arm_available(void);
 
 /*
  * PuTTY version number formatted as an SSH version string.
@@ -1206,6 +1388,22 @@ char *platform_get_x_display(void);
  */
 void x11_get_auth_from_authfile(struct X11Display *display,
                                 const char *authfilename);
+/*
+ * The three stages of x11_get_auth_from_authfile, for
+ * implementations of platform_get_x11_auth() that want to keep the
+ * parsed contents of the authority file around and look up more than
+ * one display in it without re-reading the file every time:
+ * x11_authfile_load() parses a whole .Xauthority file into an
+ * in-memory structure (returning NULL if the file couldn't be
+ * opened), x11_authfile_lookup() finds the auth record in that
+ * structure matching the display details in "display" and fills in
+ * the localauth fields, and x11_authfile_free() disposes of the
+ * structure.
+ */
+typedef struct X11AuthFile X11AuthFile;
+X11AuthFile *x11_authfile_load(const char *authfilename);
+void x11_authfile_lookup(X11AuthFile *af, struct X11Display *display);
+void x11_authfile_free(X11AuthFile *af);
 void x11_format_auth_for_authfile(
     BinarySink *bs, SockAddr *addr, int display_no,
     ptrlen authproto, ptrlen authdata);
@@ -1221,6 +1419,11 @@ dh_ctx *dh_setup_gex(mp_int *pval, mp_int *gval);
 int dh_modulus_bit_size(const dh_ctx *ctx);
 void dh_cleanup(dh_ctx *);
 mp_int *dh_create_e(dh_ctx *, int nbits);
+/* The two halves of dh_create_e, separable so that the modpow can be
+ * farmed out to a worker thread while the random exponent generation
+ * stays with the PRNG on the main thread */
+void dh_invent_x(dh_ctx *, int nbits);
+mp_int *dh_compute_e(dh_ctx *);
 const char *dh_validate_f(dh_ctx *, mp_int *f);
 mp_int *dh_find_K(dh_ctx *, mp_int *f);
 
@@ -1664,6 +1867,18 @@ const char *ssh1_pkt_type(int type);
 const char *ssh2_pkt_type(Pkt_KCtx pkt_kctx, Pkt_ACtx pkt_actx, int type);
 bool ssh2_pkt_type_code_valid(unsigned type);
 
+/*
+ * Always-on ring buffer of recent packet metadata, in ssh/pkttrace.c.
+ * The BPP records every packet it handles (no payload data, just
+ * type/length/channel/time); a front end can dump the history to a
+ * stdio file post mortem, e.g. from a signal handler, to diagnose
+ * hangs that nobody thought to enable full packet logging for.
+ * 'direction' is PKT_INCOMING or PKT_OUTGOING.
+ */
+void ssh_packet_trace(int direction, int type,
+                      const void *payload, size_t len);
+void ssh_packet_trace_dump(FILE *fp);
+
 /*
  * Need this to warn about support for the original SSH-2 keyfile
  * format.
@@ -1710,7 +1925,8 @@ bool get_commasep_word(ptrlen *list, ptrlen *word);
 int verify_ssh_manual_host_key(Conf *conf, char **fingerprints, ssh_key *key);
 
 typedef struct ssh_transient_hostkey_cache ssh_transient_hostkey_cache;
-ssh_transient_hostkey_cache *ssh_transient_hostkey_cache_new(void);
+ssh_transient_hostkey_cache *ssh_transient_hostkey_cache_new(
+    const char *host, int port);
 void ssh_transient_hostkey_cache_free(ssh_transient_hostkey_cache *thc);
 void ssh_transient_hostkey_cache_add(
     ssh_transient_hostkey_cache *thc, ssh_key *key);
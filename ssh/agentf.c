@@ -15,16 +15,99 @@ typedef struct agentf {
     SshChannel *c;
     bufchain inbuffer;
     agent_pending_query *pending;
+    int pending_reqtype;
     bool input_wanted;
     bool rcvd_eof;
 
     Channel chan;
 } agentf;
 
+/*
+ * Cache of the real agent's latest answer to a list-identities
+ * request. Remote automation (parallel git-over-ssh jobs, for
+ * instance) tends to send SSH2_AGENTC_REQUEST_IDENTITIES over and
+ * over, and the answer rarely changes, so repeated requests can be
+ * answered locally instead of round-tripping to the agent every
+ * time.
+ *
+ * We invalidate the cache whenever we forward any message that might
+ * change the agent's key list. But we can't hear about out-of-band
+ * changes made directly to the agent (a local run of ssh-add, say),
+ * so cached answers also expire after a short time; that bounds the
+ * staleness a remote client can observe, while still absorbing a
+ * burst of probes.
+ */
+#define IDCACHE_SSH1 0
+#define IDCACHE_SSH2 1
+#define IDCACHE_TTL TICKSPERSEC
+
+static struct identities_cache {
+    strbuf *reply;           /* complete reply message; NULL if empty */
+    unsigned long when;      /* GETTICKCOUNT time the reply arrived */
+} id_cache[2];
+
+static int identities_cache_index(int reqtype)
+{
+    switch (reqtype) {
+      case SSH1_AGENTC_REQUEST_RSA_IDENTITIES:
+        return IDCACHE_SSH1;
+      case SSH2_AGENTC_REQUEST_IDENTITIES:
+        return IDCACHE_SSH2;
+      default:
+        return -1;
+    }
+}
+
+static void identities_cache_invalidate(void)
+{
+    for (size_t i = 0; i < lenof(id_cache); i++) {
+        if (id_cache[i].reply) {
+            strbuf_free(id_cache[i].reply);
+            id_cache[i].reply = NULL;
+        }
+    }
+}
+
+static strbuf *identities_cache_lookup(int reqtype)
+{
+    int idx = identities_cache_index(reqtype);
+    if (idx < 0 || !id_cache[idx].reply)
+        return NULL;
+    if (GETTICKCOUNT() - id_cache[idx].when >= IDCACHE_TTL) {
+        strbuf_free(id_cache[idx].reply);
+        id_cache[idx].reply = NULL;
+        return NULL;
+    }
+    return id_cache[idx].reply;
+}
+
+static void identities_cache_store(int reqtype, const void *reply,
+                                   int replylen)
+{
+    int idx = identities_cache_index(reqtype);
+    if (idx < 0 || !reply || replylen < 5)
+        return;
+
+    /* Only cache a proper identities answer, not (say) a transient
+     * SSH_AGENT_FAILURE. */
+    int expected = (idx == IDCACHE_SSH1 ? SSH1_AGENT_RSA_IDENTITIES_ANSWER :
+                    SSH2_AGENT_IDENTITIES_ANSWER);
+    if (((const unsigned char *)reply)[4] != expected)
+        return;
+
+    if (id_cache[idx].reply)
+        strbuf_free(id_cache[idx].reply);
+    id_cache[idx].reply = strbuf_new();
+    put_data(id_cache[idx].reply, reply, replylen);
+    id_cache[idx].when = GETTICKCOUNT();
+}
+
 static void agentf_got_response(agentf *af, void *reply, int replylen)
 {
     af->pending = NULL;
 
+    identities_cache_store(af->pending_reqtype, reply, replylen);
+
     if (!reply) {
         /* The real agent didn't send any kind of reply at all for
          * some reason, so fake an SSH_AGENT_FAILURE. */
@@ -96,6 +179,39 @@ static void agentf_try_forward(agentf *af)
         message = strbuf_new_for_agent_query();
         bufchain_fetch_consume(
             &af->inbuffer, strbuf_append(message, length), length);
+
+        int reqtype = length > 0 ? message->u[4] : -1;
+
+        /*
+         * If this is a list-identities request and we have a fresh
+         * cached answer, respond locally without troubling the real
+         * agent.
+         */
+        strbuf *cached = (length == 1 ?
+                          identities_cache_lookup(reqtype) : NULL);
+        if (cached) {
+            sshfwd_write(af->c, cached->u, cached->len);
+            strbuf_free(message);
+            continue;
+        }
+
+        /*
+         * Conversely, any message that might change the agent's key
+         * list makes our cached answers untrustworthy. List and sign
+         * requests are the only ones we're sure can't.
+         */
+        switch (reqtype) {
+          case SSH1_AGENTC_REQUEST_RSA_IDENTITIES:
+          case SSH2_AGENTC_REQUEST_IDENTITIES:
+          case SSH1_AGENTC_RSA_CHALLENGE:
+          case SSH2_AGENTC_SIGN_REQUEST:
+            break;
+          default:
+            identities_cache_invalidate();
+            break;
+        }
+
+        af->pending_reqtype = reqtype;
         af->pending = agent_query(
             message, &reply, &replylen, agentf_callback, af);
         strbuf_free(message);
@@ -181,6 +297,7 @@ Channel *agentf_new(SshChannel *c)
     af->rcvd_eof = false;
     bufchain_init(&af->inbuffer);
     af->pending = NULL;
+    af->pending_reqtype = -1;
     af->input_wanted = true;
     return &af->chan;
 }
@@ -40,6 +40,8 @@ struct BinaryPacketProtocol {
      * potentially be interested in. */
     int remote_bugs;
     bool ext_info_rsa_sha256_ok, ext_info_rsa_sha512_ok;
+    int compression_level;  /* effort level for any compressor we set
+                             * up, from CONF_compression_level */
 
     /* Set this if remote connection closure should not generate an
      * error message (either because it's not to be treated as an
@@ -144,6 +146,9 @@ void ssh2_bpp_new_incoming_crypto(
     const ssh_cipheralg *cipher, const void *ckey, const void *iv,
     const ssh2_macalg *mac, bool etm_mode, const void *mac_key,
     const ssh_compression_alg *compression, bool delayed_compression);
+/* Supply a preset dictionary with which to prime any subsequently
+ * created compressor or decompressor whose algorithm supports it. */
+void ssh2_bpp_set_compression_dict(BinaryPacketProtocol *bpp, ptrlen dict);
 
 /*
  * A query method specific to the interface between ssh2transport and
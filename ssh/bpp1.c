@@ -111,7 +111,7 @@ void ssh1_bpp_start_compression(BinaryPacketProtocol *bpp)
     assert(!s->compctx);
     assert(!s->decompctx);
 
-    s->compctx = ssh_compressor_new(&ssh_zlib);
+    s->compctx = ssh_compressor_new(&ssh_zlib, bpp->compression_level);
     s->decompctx = ssh_decompressor_new(&ssh_zlib);
 
     bpp_logevent("Started zlib (RFC1950) compression");
@@ -213,7 +213,6 @@ static void ssh1_bpp_handle_input(BinaryPacketProtocol *bpp)
             }
 
             memcpy(s->data + s->pad, decompblk, decomplen);
-            sfree(decompblk);
             s->length = decomplen - 1;
         }
 
@@ -17,6 +17,21 @@ struct ssh2_bpp_direction {
     const ssh_compression_alg *pending_compression;
 };
 
+/* Maximum number of packets whose MACs we'll verify in one batched
+ * call to ssh2_mac_multiverify, and the largest packet length for
+ * which we'll bother: batching pays off for floods of small packets,
+ * and for bulk-sized ones the hashing itself dominates anyway. */
+#define MAC_VERIFY_AHEAD 4
+#define MAC_VERIFY_AHEAD_MAXLEN 512
+
+/* Maximum number of packets we'll decrypt in a single run of the
+ * input coroutine before voluntarily yielding back to the event loop.
+ * When a large backlog of ciphertext has accumulated in in_raw, this
+ * lets the consumers of in_pq (terminal emulation, stdio writes) run
+ * interleaved with decryption instead of only after the whole backlog
+ * has been processed. */
+#define INPUT_PACKETS_PER_CALLBACK 32
+
 struct ssh2_bpp_state {
     int crState;
     long len, pad, payload, packetlen, maclen, length, maxlen;
@@ -28,13 +43,32 @@ struct ssh2_bpp_state {
     struct DataTransferStats *stats;
     bool cbc_ignore_workaround;
 
+    /* MAC verdicts computed ahead of time by a batched verification
+     * in the ETM branch of handle_input, for packets still waiting in
+     * in_raw. Invalidated wholesale whenever the incoming crypto
+     * changes. */
+    struct {
+        unsigned long sequence;
+        long packetlen;
+        bool ok;
+    } mac_verified_ahead[MAC_VERIFY_AHEAD];
+    size_t n_mac_verified_ahead, mac_verified_ahead_pos;
+
     struct ssh2_bpp_direction in, out;
     /* comp and decomp logically belong in the per-direction
      * substructure, except that they have different types */
     ssh_decompressor *in_decomp;
     ssh_compressor *out_comp;
 
+    /* Number of packets pushed to in_pq during the current run of the
+     * input coroutine; reset on every entry to handle_input. */
+    int packets_this_run;
+
     bool is_server;
+    /* Preset compression dictionary, if the transport layer has
+     * supplied one; used to prime any compressor or decompressor
+     * whose algorithm supports it. */
+    strbuf *comp_dict;
     bool pending_newkeys;
     bool pending_compression, seen_userauth_success;
     bool enforce_next_packet_is_userauth_success;
@@ -107,10 +141,42 @@ static void ssh2_bpp_free(BinaryPacketProtocol *bpp)
     sfree(s->buf);
     ssh2_bpp_free_outgoing_crypto(s);
     ssh2_bpp_free_incoming_crypto(s);
+    if (s->comp_dict)
+        strbuf_free(s->comp_dict);
     sfree(s->pktin);
     sfree(s);
 }
 
+void ssh2_bpp_set_compression_dict(BinaryPacketProtocol *bpp, ptrlen dict)
+{
+    struct ssh2_bpp_state *s;
+    assert(bpp->vt == &ssh2_bpp_vtable);
+    s = container_of(bpp, struct ssh2_bpp_state, bpp);
+
+    if (s->comp_dict)
+        strbuf_free(s->comp_dict);
+    s->comp_dict = strbuf_new();
+    put_datapl(s->comp_dict, dict);
+}
+
+static ssh_compressor *ssh2_bpp_compressor_new(
+    struct ssh2_bpp_state *s, const ssh_compression_alg *alg)
+{
+    ssh_compressor *comp = ssh_compressor_new(alg, s->bpp.compression_level);
+    if (comp && alg->compress_prime && s->comp_dict)
+        alg->compress_prime(comp, ptrlen_from_strbuf(s->comp_dict));
+    return comp;
+}
+
+static ssh_decompressor *ssh2_bpp_decompressor_new(
+    struct ssh2_bpp_state *s, const ssh_compression_alg *alg)
+{
+    ssh_decompressor *decomp = ssh_decompressor_new(alg);
+    if (decomp && alg->decompress_prime && s->comp_dict)
+        alg->decompress_prime(decomp, ptrlen_from_strbuf(s->comp_dict));
+    return decomp;
+}
+
 void ssh2_bpp_new_outgoing_crypto(
     BinaryPacketProtocol *bpp,
     const ssh_cipheralg *cipher, const void *ckey, const void *iv,
@@ -165,7 +231,7 @@ void ssh2_bpp_new_outgoing_crypto(
         /* 'compression' is always non-NULL, because no compression is
          * indicated by ssh_comp_none. But this setup call may return a
          * null out_comp. */
-        s->out_comp = ssh_compressor_new(compression);
+        s->out_comp = ssh2_bpp_compressor_new(s, compression);
 
         if (s->out_comp)
             bpp_logevent("Initialised %s compression",
@@ -222,13 +288,20 @@ void ssh2_bpp_new_incoming_crypto(
         /* 'compression' is always non-NULL, because no compression is
          * indicated by ssh_comp_none. But this setup call may return a
          * null in_decomp. */
-        s->in_decomp = ssh_decompressor_new(compression);
+        s->in_decomp = ssh2_bpp_decompressor_new(s, compression);
 
         if (s->in_decomp)
             bpp_logevent("Initialised %s decompression",
                          ssh_decompressor_alg(s->in_decomp)->text_name);
     }
 
+    /* Any MAC verdicts computed ahead of time under the old keys are
+     * now meaningless: in particular, packets beyond a NEWKEYS will
+     * have been speculatively checked against the old MAC and failed.
+     * Drop the lot, and they'll be re-verified against the new MAC as
+     * they're consumed. */
+    s->n_mac_verified_ahead = s->mac_verified_ahead_pos = 0;
+
     /* Clear the pending_newkeys flag, so that handle_input below will
      * start consuming the input data again. */
     s->pending_newkeys = false;
@@ -252,13 +325,13 @@ static void ssh2_bpp_enable_pending_compression(struct ssh2_bpp_state *s)
     BinaryPacketProtocol *bpp = &s->bpp; /* for bpp_logevent */
 
     if (s->in.pending_compression) {
-        s->in_decomp = ssh_decompressor_new(s->in.pending_compression);
+        s->in_decomp = ssh2_bpp_decompressor_new(s, s->in.pending_compression);
         bpp_logevent("Initialised delayed %s decompression",
                      ssh_decompressor_alg(s->in_decomp)->text_name);
         s->in.pending_compression = NULL;
     }
     if (s->out.pending_compression) {
-        s->out_comp = ssh_compressor_new(s->out.pending_compression);
+        s->out_comp = ssh2_bpp_compressor_new(s, s->out.pending_compression);
         bpp_logevent("Initialised delayed %s compression",
                      ssh_compressor_alg(s->out_comp)->text_name);
         s->out.pending_compression = NULL;
@@ -282,6 +355,10 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
 {
     struct ssh2_bpp_state *s = container_of(bpp, struct ssh2_bpp_state, bpp);
 
+    /* This runs on every call, including resumptions of the coroutine
+     * below, so each callback invocation starts with a fresh budget. */
+    s->packets_this_run = 0;
+
     crBegin(s->crState);
 
     while (1) {
@@ -411,8 +488,17 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
 
             /*
              * Allocate the packet to return, now we know its length.
+             * As in the other branches, we allocate exactly the space
+             * this packet needs, rather than a maximum-size buffer:
+             * for bulk transfers, where nearly every packet comes
+             * through this branch, the difference in allocator
+             * traffic is significant. The ciphertext is then read
+             * from the input bufchain straight into this buffer and
+             * decrypted in place, so no further copy happens before
+             * the payload reaches the next layer.
              */
-            s->pktin = snew_plus(PktIn, OUR_V2_PACKETLIMIT + s->maclen);
+            s->maxlen = s->packetlen + s->maclen;
+            s->pktin = snew_plus(PktIn, s->maxlen);
             s->pktin->qnode.prev = s->pktin->qnode.next = NULL;
             s->pktin->type = 0;
             s->pktin->qnode.on_free_queue = false;
@@ -427,10 +513,116 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
             /*
              * Check the MAC.
              */
-            if (s->in.mac && !ssh2_mac_verify(
-                    s->in.mac, s->data, s->len + 4, s->in.sequence)) {
-                ssh_sw_abort(s->bpp.ssh, "Incorrect MAC received on packet");
-                crStopV;
+            if (s->in.mac) {
+                bool ok = false, have_verdict = false;
+
+                /*
+                 * If an earlier batched verification already covered
+                 * this packet, use the stored verdict. The stored
+                 * sequence number and length must line up exactly
+                 * with what we've just read; if not, something has
+                 * reinterpreted the byte stream since we speculated,
+                 * so throw the whole array away.
+                 */
+                if (s->mac_verified_ahead_pos < s->n_mac_verified_ahead) {
+                    if (s->mac_verified_ahead[s->mac_verified_ahead_pos]
+                        .sequence == s->in.sequence &&
+                        s->mac_verified_ahead[s->mac_verified_ahead_pos]
+                        .packetlen == s->packetlen) {
+                        ok = s->mac_verified_ahead[
+                            s->mac_verified_ahead_pos++].ok;
+                        have_verdict = true;
+                    } else {
+                        s->n_mac_verified_ahead = 0;
+                        s->mac_verified_ahead_pos = 0;
+                    }
+                }
+
+                /*
+                 * Otherwise, see whether further complete packets are
+                 * already queued in in_raw, and if so, verify their
+                 * MACs together with this one's in a single
+                 * multi-buffer pass. We only peek at the queued
+                 * packets: they stay in in_raw and are consumed by
+                 * later iterations of this loop in the usual way,
+                 * which is what keeps this safe across a rekey -- if
+                 * one of them turns out to be NEWKEYS, the
+                 * speculative verdicts for its successors are
+                 * invalidated above and they get re-verified under
+                 * the new keys.
+                 */
+                if (!have_verdict &&
+                    s->len <= MAC_VERIFY_AHEAD_MAXLEN &&
+                    !(s->in.cipher &&
+                      (ssh_cipher_alg(s->in.cipher)->flags &
+                       SSH_CIPHER_SEPARATE_LENGTH))) {
+                    ptrlen pkts[MAC_VERIFY_AHEAD];
+                    unsigned long seqs[MAC_VERIFY_AHEAD];
+                    long packetlens[MAC_VERIFY_AHEAD];
+                    bool results[MAC_VERIFY_AHEAD];
+                    size_t npkts = 1, peeked = 0;
+                    size_t avail = bufchain_size(s->bpp.in_raw);
+                    size_t bufneed = (MAC_VERIFY_AHEAD - 1) *
+                        (4 + MAC_VERIFY_AHEAD_MAXLEN + s->maclen);
+
+                    if (s->bufsize < bufneed) {
+                        s->bufsize = bufneed;
+                        s->buf = sresize(s->buf, s->bufsize, unsigned char);
+                    }
+
+                    pkts[0] = make_ptrlen(s->data, s->len + 4);
+                    seqs[0] = s->in.sequence;
+
+                    while (npkts < MAC_VERIFY_AHEAD) {
+                        long len2;
+
+                        if (avail < peeked + 4)
+                            break;
+                        bufchain_fetch(s->bpp.in_raw, s->buf, peeked + 4);
+                        len2 = toint(GET_32BIT_MSB_FIRST(s->buf + peeked));
+                        /* Stop peeking at anything implausible or
+                         * over-large; if it's genuinely garbled, the
+                         * normal path will fault it when it gets
+                         * there. */
+                        if (len2 <= 0 || len2 > MAC_VERIFY_AHEAD_MAXLEN ||
+                            len2 % s->cipherblk != 0)
+                            break;
+                        if (avail < peeked + 4 + len2 + s->maclen)
+                            break;
+                        bufchain_fetch(s->bpp.in_raw, s->buf,
+                                       peeked + 4 + len2 + s->maclen);
+                        pkts[npkts] = make_ptrlen(s->buf + peeked, len2 + 4);
+                        seqs[npkts] = s->in.sequence + npkts;
+                        packetlens[npkts] = len2 + 4;
+                        peeked += 4 + len2 + s->maclen;
+                        npkts++;
+                    }
+
+                    if (npkts > 1 &&
+                        ssh2_mac_multiverify(s->in.mac, npkts,
+                                             pkts, seqs, results)) {
+                        ok = results[0];
+                        have_verdict = true;
+                        for (size_t i = 1; i < npkts; i++) {
+                            s->mac_verified_ahead[i-1].sequence = seqs[i];
+                            s->mac_verified_ahead[i-1].packetlen =
+                                packetlens[i];
+                            s->mac_verified_ahead[i-1].ok = results[i];
+                        }
+                        s->n_mac_verified_ahead = npkts - 1;
+                        s->mac_verified_ahead_pos = 0;
+                    }
+                }
+
+                if (!have_verdict)
+                    ok = ssh2_mac_verify(s->in.mac, s->data, s->len + 4,
+                                         s->in.sequence);
+
+                if (!ok) {
+                    ssh_sw_abort(s->bpp.ssh,
+                                 "Incorrect MAC received on packet");
+                    crStopV;
+                }
             }
 
             /* Decrypt everything between the length field and the MAC. */
@@ -548,7 +740,6 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
                 }
                 s->length = 5 + newlen;
                 memcpy(s->data + 5, newpayload, newlen);
-                sfree(newpayload);
             }
         }
 
@@ -574,6 +765,8 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
         }
         BinarySource_INIT(s->pktin, s->data, s->length);
 
+        ssh_packet_trace(PKT_INCOMING, s->pktin->type, s->data, s->length);
+
         if (s->bpp.logctx) {
             logblank_t blanks[MAX_BLANKS];
             int nblanks = ssh2_censor_packet(
@@ -701,6 +894,19 @@ static void ssh2_bpp_handle_input(BinaryPacketProtocol *bpp)
                 queue_idempotent_callback(&s->bpp.ic_out_pq);
             }
         }
+
+        /*
+         * If a long backlog of input has built up, don't process the
+         * whole of it in this one run: yield after a batch of
+         * packets, rescheduling ourself so that we'll resume after
+         * any other pending callbacks - in particular, the ones that
+         * consume the packets we've just queued - have had a turn.
+         */
+        if (++s->packets_this_run >= INPUT_PACKETS_PER_CALLBACK &&
+            bufchain_size(s->bpp.in_raw) > 0) {
+            queue_idempotent_callback(&s->bpp.ic_in_raw);
+            crReturnV;
+        }
     }
 
   eof:
@@ -735,7 +941,10 @@ static PktOut *ssh2_bpp_new_pktout(int pkt_type)
 
 static void ssh2_bpp_format_packet_inner(struct ssh2_bpp_state *s, PktOut *pkt)
 {
-    int origlen, cipherblk, maclen, padding, unencrypted_prefix, i;
+    int origlen, cipherblk, maclen, padding, unencrypted_prefix;
+
+    ssh_packet_trace(PKT_OUTGOING, pkt->type, pkt->data + pkt->prefix,
+                     pkt->length - pkt->prefix);
 
     if (s->bpp.logctx) {
         ptrlen pktdata = make_ptrlen(pkt->data + pkt->prefix,
@@ -792,9 +1001,7 @@ static void ssh2_bpp_format_packet_inner(struct ssh2_bpp_state *s, PktOut *pkt)
     assert(padding <= 255);
     maclen = s->out.mac ? ssh2_mac_alg(s->out.mac)->len : 0;
     origlen = pkt->length;
-    for (i = 0; i < padding; i++)
-        put_byte(pkt, 0);              /* make space for random padding */
-    random_read(pkt->data + origlen, padding);
+    random_read(put_reserve(pkt, padding), padding);
     pkt->data[4] = padding;
     PUT_32BIT_MSB_FIRST(pkt->data, origlen + padding - 4);
 
@@ -887,10 +1094,7 @@ static void ssh2_bpp_format_packet(struct ssh2_bpp_state *s, PktOut *pkt)
 
             ignore_pkt = ssh2_bpp_new_pktout(SSH2_MSG_IGNORE);
             put_uint32(ignore_pkt, length);
-            size_t origlen = ignore_pkt->length;
-            for (size_t i = 0; i < length; i++)
-                put_byte(ignore_pkt, 0);  /* make space for random padding */
-            random_read(ignore_pkt->data + origlen, length);
+            random_read(put_reserve(ignore_pkt, length), length);
             ssh2_bpp_format_packet_inner(s, ignore_pkt);
             bufchain_add(s->bpp.out_raw, ignore_pkt->data, ignore_pkt->length);
             ssh_free_pktout(ignore_pkt);
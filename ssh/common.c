@@ -240,14 +240,38 @@ void pq_base_concatenate(PacketQueueBase *qdest,
 
 static void ssh_pkt_BinarySink_write(BinarySink *bs,
                                      const void *data, size_t len);
+static void *ssh_pkt_BinarySink_reserve(BinarySink *bs, size_t len);
+
+/*
+ * Spare PktOut structures kept around for reuse. Interactive traffic
+ * constructs and frees a packet per keystroke, plus window
+ * adjustments coming the other way, so rather than going back to the
+ * allocator every time, ssh_free_pktout keeps a bounded free list of
+ * retired packets (linked through their qnode.next pointers) for
+ * ssh_new_packet to draw from.
+ */
+#define MAX_SPARE_PKTOUT 32
+static PktOut *spare_pktout_list = NULL;
+static int n_spare_pktout = 0;
+
 PktOut *ssh_new_packet(void)
 {
-    PktOut *pkt = snew(PktOut);
+    PktOut *pkt;
+
+    if (spare_pktout_list) {
+        pkt = spare_pktout_list;
+        spare_pktout_list = pkt->qnode.next ?
+            container_of(pkt->qnode.next, PktOut, qnode) : NULL;
+        n_spare_pktout--;
+    } else {
+        pkt = snew(PktOut);
+    }
 
-    BinarySink_INIT(pkt, ssh_pkt_BinarySink_write);
-    pkt->data = NULL;
+    BinarySink_INIT_RESERVABLE(pkt, ssh_pkt_BinarySink_write,
+                               ssh_pkt_BinarySink_reserve);
+    pkt->data = pkt->inline_data;
     pkt->length = 0;
-    pkt->maxlen = 0;
+    pkt->maxlen = sizeof(pkt->inline_data);
     pkt->downstream_id = 0;
     pkt->additional_log_text = NULL;
     pkt->qnode.next = pkt->qnode.prev = NULL;
@@ -256,9 +280,34 @@ PktOut *ssh_new_packet(void)
     return pkt;
 }
 
+static void ssh_pkt_ensure(PktOut *pkt, size_t len)
+{
+    if (pkt->data == pkt->inline_data) {
+        if (pkt->length + len > pkt->maxlen) {
+            /*
+             * Spill to separately allocated storage. We can't let
+             * sgrowarrayn pass the inline pointer to realloc, so we
+             * do the copy by hand, and clear the inline copy in case
+             * it contained secrets (matching the _nm growth strategy
+             * used below).
+             */
+            size_t newmax = pkt->maxlen;
+            while (newmax < pkt->length + len)
+                newmax *= 2;
+            unsigned char *newdata = snewn(newmax, unsigned char);
+            memcpy(newdata, pkt->inline_data, pkt->length);
+            smemclr(pkt->inline_data, sizeof(pkt->inline_data));
+            pkt->data = newdata;
+            pkt->maxlen = newmax;
+        }
+    } else {
+        sgrowarrayn_nm(pkt->data, pkt->maxlen, pkt->length, len);
+    }
+}
+
 static void ssh_pkt_adddata(PktOut *pkt, const void *data, int len)
 {
-    sgrowarrayn_nm(pkt->data, pkt->maxlen, pkt->length, len);
+    ssh_pkt_ensure(pkt, len);
     memcpy(pkt->data + pkt->length, data, len);
     pkt->length += len;
     pkt->qnode.formal_size = pkt->length;
@@ -271,10 +320,31 @@ static void ssh_pkt_BinarySink_write(BinarySink *bs,
     ssh_pkt_adddata(pkt, data, len);
 }
 
+static void *ssh_pkt_BinarySink_reserve(BinarySink *bs, size_t len)
+{
+    PktOut *pkt = BinarySink_DOWNCAST(bs, PktOut);
+    ssh_pkt_ensure(pkt, len);
+    void *ret = pkt->data + pkt->length;
+    pkt->length += len;
+    pkt->qnode.formal_size = pkt->length;
+    return ret;
+}
+
 void ssh_free_pktout(PktOut *pkt)
 {
-    sfree(pkt->data);
-    sfree(pkt);
+    if (pkt->data != pkt->inline_data)
+        sfree(pkt->data);
+    if (n_spare_pktout < MAX_SPARE_PKTOUT) {
+        /* Clear the inline buffer in case it contained secrets, since
+         * unlike a freed packet this one will hang around. */
+        smemclr(pkt->inline_data, sizeof(pkt->inline_data));
+        pkt->qnode.next = spare_pktout_list ?
+            &spare_pktout_list->qnode : NULL;
+        spare_pktout_list = pkt;
+        n_spare_pktout++;
+    } else {
+        sfree(pkt);
+    }
 }
 
 /* ----------------------------------------------------------------------
@@ -869,23 +939,19 @@ int verify_ssh_manual_host_key(Conf *conf, char **fingerprints, ssh_key *key)
          * Construct the base64-encoded public key blob and see if
          * that's listed.
          */
-        strbuf *binblob;
-        char *base64blob;
-        int atoms, i;
+        strbuf *binblob, *base64blob;
         binblob = strbuf_new();
         ssh_key_public_blob(key, BinarySink_UPCAST(binblob));
-        atoms = (binblob->len + 2) / 3;
-        base64blob = snewn(atoms * 4 + 1, char);
-        for (i = 0; i < atoms; i++)
-            base64_encode_atom(binblob->u + 3*i,
-                               binblob->len - 3*i, base64blob + 4*i);
-        base64blob[atoms * 4] = '\0';
+        base64blob = strbuf_new();
+        base64_encode_bs(BinarySink_UPCAST(base64blob),
+                         ptrlen_from_strbuf(binblob), 0);
         strbuf_free(binblob);
-        if (conf_get_str_str_opt(conf, CONF_ssh_manual_hostkeys, base64blob)) {
-            sfree(base64blob);
+        if (conf_get_str_str_opt(conf, CONF_ssh_manual_hostkeys,
+                                 base64blob->s)) {
+            strbuf_free(base64blob);
             return 1;                  /* success */
         }
-        sfree(base64blob);
+        strbuf_free(base64blob);
     }
 
     return 0;
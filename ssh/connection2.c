@@ -157,8 +157,10 @@ static const SshChannelVtable ssh2channel_vtable = {
 static void ssh2_channel_check_close(struct ssh2_channel *c);
 static void ssh2_channel_try_eof(struct ssh2_channel *c);
 static void ssh2_set_window(struct ssh2_channel *c, int newwin);
+static void ssh2_channel_tune_window(struct ssh2_channel *c);
 static size_t ssh2_try_send(struct ssh2_channel *c);
 static void ssh2_try_send_and_unthrottle(struct ssh2_channel *c);
+static void ssh2_channel_sched_unlink(struct ssh2_channel *c);
 static void ssh2_channel_check_throttle(struct ssh2_channel *c);
 static void ssh2_channel_close_local(struct ssh2_channel *c,
                                      const char *reason);
@@ -196,15 +198,30 @@ static int ssh2_channelcmp(void *av, void *bv)
     return 0;
 }
 
-static int ssh2_channelfind(void *av, void *bv)
+/*
+ * Constant-time lookup of a channel by local id, so that the demux of
+ * incoming CHANNEL_DATA and friends doesn't pay a tree search per
+ * packet. Entries are maintained by ssh2_channel_init and
+ * ssh2_channel_unregister below.
+ */
+static struct ssh2_channel *ssh2_channel_by_id(
+    struct ssh2_connection_state *s, unsigned localid)
 {
-    const unsigned *a = (const unsigned *) av;
-    const struct ssh2_channel *b = (const struct ssh2_channel *) bv;
-    if (*a < b->localid)
-        return -1;
-    if (*a > b->localid)
-        return +1;
-    return 0;
+    if (localid >= s->channel_index_size)
+        return NULL;
+    return s->channel_index[localid];
+}
+
+/*
+ * Remove a channel from both lookup structures.
+ */
+static void ssh2_channel_unregister(struct ssh2_channel *c)
+{
+    struct ssh2_connection_state *s = c->connlayer;
+
+    del234(s->channels, c);
+    if (c->localid < s->channel_index_size)
+        s->channel_index[c->localid] = NULL;
 }
 
 /*
@@ -219,6 +236,7 @@ struct outstanding_channel_request {
 
 static void ssh2_channel_free(struct ssh2_channel *c)
 {
+    ssh2_channel_sched_unlink(c);
     bufchain_clear(&c->outbuffer);
     bufchain_clear(&c->errbuffer);
     while (c->chanreq_head) {
@@ -297,6 +315,7 @@ static void ssh2_connection_free(PacketProtocolLayer *ppl)
     while ((c = delpos234(s->channels, 0)) != NULL)
         ssh2_channel_free(c);
     freetree234(s->channels);
+    sfree(s->channel_index);
 
     while ((auth = delpos234(s->x11authtree, 0)) != NULL) {
         if (auth->disp)
@@ -399,7 +418,7 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
                 share_got_pkt_from_server(
                     chanopen_result.u.downstream.share_ctx, pktin->type,
                     BinarySource_UPCAST(pktin)->data,
-                    BinarySource_UPCAST(pktin)->len);
+                    BinarySource_UPCAST(pktin)->len, NULL);
                 sfree(c);
                 break;
             }
@@ -458,12 +477,13 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
              * downstream, pass it on.
              */
             localid = get_uint32(pktin);
-            c = find234(s->channels, &localid, ssh2_channelfind);
+            c = ssh2_channel_by_id(s, localid);
 
             if (c && c->sharectx) {
                 share_got_pkt_from_server(c->sharectx, pktin->type,
                                           BinarySource_UPCAST(pktin)->data,
-                                          BinarySource_UPCAST(pktin)->len);
+                                          BinarySource_UPCAST(pktin)->len,
+                                          &c->shareroute);
                 pq_pop(s->ppl.in_pq);
                 break;
             }
@@ -524,7 +544,7 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
                 chan_open_failed(c->chan, err);
                 sfree(err);
 
-                del234(s->channels, c);
+                ssh2_channel_unregister(c);
                 ssh2_channel_free(c);
 
                 break;
@@ -566,6 +586,13 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
                         c->locmaxwin < 0x40000000)
                         c->locmaxwin += OUR_V2_WINSIZE;
 
+                    /*
+                     * Track the arrival rate, and grow the window
+                     * towards the channel's bandwidth-delay product.
+                     */
+                    c->win_mark_bytes += data.len;
+                    ssh2_channel_tune_window(c);
+
                     /*
                      * If we are not buffering too much data, enlarge
                      * the window again at the remote side. If we are
@@ -576,12 +603,16 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
                         ssh2_set_window(c, c->locmaxwin - bufsize);
 
                     /*
-                     * If we're either buffering way too much data, or
-                     * if we're buffering anything at all and we're in
-                     * "simple" mode, throttle the whole channel.
+                     * If we're buffering way too much data, throttle
+                     * the whole channel. In "simple" mode the local
+                     * consumer (e.g. plink's stdout) is the only
+                     * thing the connection is feeding, so we allow a
+                     * generous buffer with a watermark rather than
+                     * reacting to the first byte of backlog: see the
+                     * OUR_V2_INBUFLIMIT comment in ssh.h.
                      */
                     if ((bufsize > c->locmaxwin ||
-                         (s->ssh_is_simple && bufsize>0)) &&
+                         (s->ssh_is_simple && bufsize > OUR_V2_INBUFLIMIT)) &&
                         !c->throttling_conn) {
                         c->throttling_conn = true;
                         ssh_throttle_conn(s->ppl.ssh, +1);
@@ -857,10 +888,15 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
     }
 }
 
+struct winadj_request {
+    unsigned size;
+    unsigned long senttime;
+};
+
 static void ssh2_handle_winadj_response(struct ssh2_channel *c,
                                         PktIn *pktin, void *ctx)
 {
-    unsigned *sizep = ctx;
+    struct winadj_request *wr = ctx;
 
     /*
      * Winadj responses should always be failures. However, at least
@@ -870,8 +906,24 @@ static void ssh2_handle_winadj_response(struct ssh2_channel *c,
      * life, we don't worry about what kind of response we got.
      */
 
-    c->remlocwin += *sizep;
-    sfree(sizep);
+    c->remlocwin += wr->size;
+
+    /*
+     * The round trip of a winadj request gives us a measurement of
+     * the channel's latency, which drives the adaptive window sizing
+     * in ssh2_channel_tune_window. Smooth it in the way TCP smooths
+     * its RTT estimate, so one delayed response doesn't send the
+     * estimate haywire.
+     */
+    if (c->winadj_rtt_valid) {
+        c->winadj_rtt = (c->winadj_rtt * 7 +
+                         (GETTICKCOUNT() - wr->senttime)) / 8;
+    } else {
+        c->winadj_rtt = GETTICKCOUNT() - wr->senttime;
+        c->winadj_rtt_valid = true;
+    }
+
+    sfree(wr);
     /*
      * winadj messages are only sent when the window is fully open, so
      * if we get an ack of one, we know any pending unthrottle is
@@ -920,7 +972,7 @@ static void ssh2_set_window(struct ssh2_channel *c, int newwin)
      */
     if (newwin / 2 >= c->locwindow) {
         PktOut *pktout;
-        unsigned *up;
+        struct winadj_request *wr;
 
         /*
          * In order to keep track of how much window the client
@@ -934,10 +986,11 @@ static void ssh2_set_window(struct ssh2_channel *c, int newwin)
          */
         if (newwin == c->locmaxwin &&
             !(s->ppl.remote_bugs & BUG_CHOKES_ON_WINADJ)) {
-            up = snew(unsigned);
-            *up = newwin - c->locwindow;
+            wr = snew(struct winadj_request);
+            wr->size = newwin - c->locwindow;
+            wr->senttime = GETTICKCOUNT();
             pktout = ssh2_chanreq_init(c, "winadj@putty.projects.tartarus.org",
-                                       ssh2_handle_winadj_response, up);
+                                       ssh2_handle_winadj_response, wr);
             pq_push(s->ppl.out_pq, pktout);
 
             if (c->throttle_state != UNTHROTTLED)
@@ -955,6 +1008,50 @@ static void ssh2_set_window(struct ssh2_channel *c, int newwin)
     }
 }
 
+/*
+ * Reconsider the channel's maximum window size, in the light of the
+ * data arrival rate and the measured winadj round-trip time. This is
+ * the same autotuning approach modern TCP stacks take to their
+ * receive buffers: for the sender never to stall, the window must
+ * cover the bandwidth-delay product, so we aim for twice the amount
+ * of data that arrives per round trip, and grow locmaxwin towards
+ * that. We never shrink: a window bigger than the BDP costs only
+ * memory, whereas one smaller than it caps throughput.
+ */
+static void ssh2_channel_tune_window(struct ssh2_channel *c)
+{
+    unsigned long now = GETTICKCOUNT(), elapsed, period;
+    uint64_t target;
+
+    if (!c->winadj_rtt_valid)
+        return;
+
+    /*
+     * Measure the arrival rate over a period long enough to be
+     * meaningful: at least a round trip, and at least a sizeable
+     * fraction of a second even on very fast links.
+     */
+    elapsed = now - c->win_mark_time;
+    period = TICKSPERSEC / 4;
+    if (period < c->winadj_rtt)
+        period = c->winadj_rtt;
+    if (elapsed < period)
+        return;
+
+    target = c->win_mark_bytes * 2 * (c->winadj_rtt + 1) / elapsed;
+    if (target > 0x40000000)
+        target = 0x40000000;
+    /* Grow by at most a factor of two per measurement period, so a
+     * single anomalous burst can't balloon the window. */
+    if (target > (uint64_t)c->locmaxwin * 2)
+        target = (uint64_t)c->locmaxwin * 2;
+    if (target > (uint64_t)c->locmaxwin)
+        c->locmaxwin = target;
+
+    c->win_mark_time = now;
+    c->win_mark_bytes = 0;
+}
+
 static PktIn *ssh2_connection_pop(struct ssh2_connection_state *s)
 {
     ssh2_connection_filter_queue(s);
@@ -1017,6 +1114,15 @@ static void ssh2_connection_process_queue(PacketProtocolLayer *ppl)
         s->ssh_is_simple, &s->mainchan_sc);
     s->started = true;
 
+    /*
+     * In no-shell mode there's no main channel whose open
+     * confirmation will signal this, but the connection is now as
+     * started as it's ever going to be, and clients like plink's
+     * daemon mode want to know.
+     */
+    if (!s->mainchan)
+        seat_notify_session_started(s->ppl.seat);
+
     /*
      * Transfer data!
      */
@@ -1102,17 +1208,132 @@ static void ssh2_channel_try_eof(struct ssh2_channel *c)
     ssh2_channel_check_close(c);
 }
 
+/*
+ * Construct and queue a single CHANNEL_DATA or CHANNEL_EXTENDED_DATA
+ * packet containing 'data', which must already have been cut down to
+ * fit within both the remote window and the remote maximum packet
+ * size, and debit the remote window accordingly.
+ */
+static void ssh2_channel_send_data(
+    struct ssh2_channel *c, bool is_stderr, ptrlen data)
+{
+    struct ssh2_connection_state *s = c->connlayer;
+    PktOut *pktout;
+
+    if (is_stderr) {
+        pktout = ssh_bpp_new_pktout(
+            s->ppl.bpp, SSH2_MSG_CHANNEL_EXTENDED_DATA);
+        put_uint32(pktout, c->remoteid);
+        put_uint32(pktout, SSH2_EXTENDED_DATA_STDERR);
+    } else {
+        pktout = ssh_bpp_new_pktout(s->ppl.bpp, SSH2_MSG_CHANNEL_DATA);
+        put_uint32(pktout, c->remoteid);
+    }
+    put_stringpl(pktout, data);
+    pq_push(s->ppl.out_pq, pktout);
+    c->remwindow -= data.len;
+}
+
+/*
+ * High watermark on the amount of unsent data we'll accumulate on a
+ * channel before asking its local data source to pause. The
+ * corresponding low watermark, at which reading resumes, is half
+ * this, so that a busy source is paused and resumed in reasonably
+ * large units rather than once per write.
+ */
+static size_t ssh2_channel_outbuf_limit(struct ssh2_channel *c)
+{
+    return c->connlayer->ssh_is_simple ?
+        OUR_V2_BIGOUTBUFLIMIT : OUR_V2_OUTBUFLIMIT;
+}
+
+/*
+ * Largest number of buffered bytes a channel will packetise in one
+ * call to ssh2_try_send. Writes smaller than this (such as
+ * interactive keystrokes) always go straight out; a channel with more
+ * backlog than this joins the round-robin queue below and sends one
+ * quantum per turn, so that the data of several busy channels is
+ * interleaved in the outgoing packet queue rather than whichever
+ * channel got there first having its entire backlog sent ahead of
+ * everyone else's.
+ */
+#define SCHED_QUANTUM 32768
+
+static void ssh2_channel_sched_callback(void *vctx)
+{
+    struct ssh2_connection_state *s = (struct ssh2_connection_state *)vctx;
+    struct ssh2_channel *c = s->sched_head;
+
+    s->sched_callback_queued = false;
+    if (!c)
+        return;
+
+    s->sched_head = c->sched_next;
+    if (!s->sched_head)
+        s->sched_tail = NULL;
+    c->sched_queued = false;
+    c->sched_next = NULL;
+
+    /* This may re-queue c at the tail, if it still has more than a
+     * quantum left to send. */
+    ssh2_try_send_and_unthrottle(c);
+
+    if (s->sched_head && !s->sched_callback_queued) {
+        s->sched_callback_queued = true;
+        queue_toplevel_callback(ssh2_channel_sched_callback, s);
+    }
+}
+
+static void ssh2_channel_sched_enqueue(struct ssh2_channel *c)
+{
+    struct ssh2_connection_state *s = c->connlayer;
+
+    if (c->sched_queued)
+        return;
+    c->sched_queued = true;
+    c->sched_next = NULL;
+    if (s->sched_tail)
+        s->sched_tail->sched_next = c;
+    else
+        s->sched_head = c;
+    s->sched_tail = c;
+
+    if (!s->sched_callback_queued) {
+        s->sched_callback_queued = true;
+        queue_toplevel_callback(ssh2_channel_sched_callback, s);
+    }
+}
+
+static void ssh2_channel_sched_unlink(struct ssh2_channel *c)
+{
+    struct ssh2_connection_state *s = c->connlayer;
+    struct ssh2_channel **cp, *prev = NULL;
+
+    if (!c->sched_queued)
+        return;
+    for (cp = &s->sched_head; *cp; prev = *cp, cp = &(*cp)->sched_next) {
+        if (*cp == c) {
+            *cp = c->sched_next;
+            if (s->sched_tail == c)
+                s->sched_tail = prev;
+            break;
+        }
+    }
+    c->sched_queued = false;
+    c->sched_next = NULL;
+}
+
 /*
  * Attempt to send data on an SSH-2 channel.
  */
 static size_t ssh2_try_send(struct ssh2_channel *c)
 {
     struct ssh2_connection_state *s = c->connlayer;
-    PktOut *pktout;
     size_t bufsize;
+    size_t budget = SCHED_QUANTUM;
 
     if (!c->halfopen) {
-        while (c->remwindow > 0 &&
+        while (c->remwindow > 0 && budget > 0 &&
                (bufchain_size(&c->outbuffer) > 0 ||
                 bufchain_size(&c->errbuffer) > 0)) {
             bufchain *buf = (bufchain_size(&c->errbuffer) > 0 ?
@@ -1123,20 +1344,23 @@ static size_t ssh2_try_send(struct ssh2_channel *c)
                 data.len = c->remwindow;
             if (data.len > c->remmaxpkt)
                 data.len = c->remmaxpkt;
-            if (buf == &c->errbuffer) {
-                pktout = ssh_bpp_new_pktout(
-                    s->ppl.bpp, SSH2_MSG_CHANNEL_EXTENDED_DATA);
-                put_uint32(pktout, c->remoteid);
-                put_uint32(pktout, SSH2_EXTENDED_DATA_STDERR);
-            } else {
-                pktout = ssh_bpp_new_pktout(s->ppl.bpp, SSH2_MSG_CHANNEL_DATA);
-                put_uint32(pktout, c->remoteid);
-            }
-            put_stringpl(pktout, data);
-            pq_push(s->ppl.out_pq, pktout);
+            if (data.len > budget)
+                data.len = budget;
+            ssh2_channel_send_data(c, buf == &c->errbuffer, data);
             bufchain_consume(buf, data.len);
-            c->remwindow -= data.len;
+            budget -= data.len;
         }
+
+        /*
+         * If we stopped because the quantum ran out, rather than
+         * because of remote window exhaustion (after which a
+         * WINDOW_ADJUST will restart us anyway), take a place in the
+         * round-robin queue for the next quantum.
+         */
+        if (budget == 0 && c->remwindow > 0 &&
+            (bufchain_size(&c->outbuffer) > 0 ||
+             bufchain_size(&c->errbuffer) > 0))
+            ssh2_channel_sched_enqueue(c);
     }
 
     /*
@@ -1145,6 +1369,17 @@ static size_t ssh2_try_send(struct ssh2_channel *c)
      */
     bufsize = bufchain_size(&c->outbuffer) + bufchain_size(&c->errbuffer);
 
+    /*
+     * If that's built up past the high watermark, ask the channel's
+     * local data source to stop reading. It stays paused until
+     * ssh2_try_send_and_unthrottle sees the buffer drain back below
+     * the low watermark.
+     */
+    if (bufsize > ssh2_channel_outbuf_limit(c) && !c->throttled_by_backlog) {
+        c->throttled_by_backlog = true;
+        ssh2_channel_check_throttle(c);
+    }
+
     /*
      * And if there's no data pending but we need to send an EOF, send
      * it.
@@ -1158,11 +1393,12 @@ static size_t ssh2_try_send(struct ssh2_channel *c)
 
 static void ssh2_try_send_and_unthrottle(struct ssh2_channel *c)
 {
-    int bufsize;
+    size_t bufsize;
     if (c->closes & CLOSES_SENT_EOF)
         return;                   /* don't send on channels we've EOFed */
     bufsize = ssh2_try_send(c);
-    if (bufsize == 0) {
+    if (c->throttled_by_backlog &&
+        bufsize <= ssh2_channel_outbuf_limit(c) / 2) {
         c->throttled_by_backlog = false;
         ssh2_channel_check_throttle(c);
     }
@@ -1222,7 +1458,7 @@ static void ssh2_channel_destroy(struct ssh2_channel *c)
     assert(c->chanreq_head == NULL);
 
     ssh2_channel_close_local(c, NULL);
-    del234(s->channels, c);
+    ssh2_channel_unregister(c);
     ssh2_channel_free(c);
 
     /*
@@ -1283,16 +1519,30 @@ void ssh2_channel_init(struct ssh2_channel *c)
     c->throttling_conn = false;
     c->throttled_by_backlog = false;
     c->sharectx = NULL;
+    c->shareroute = NULL;
     c->locwindow = c->locmaxwin = c->remlocwin =
         s->ssh_is_simple ? OUR_V2_BIGWIN : OUR_V2_WINSIZE;
+    c->winadj_rtt = 0;
+    c->winadj_rtt_valid = false;
+    c->win_mark_time = GETTICKCOUNT();
+    c->win_mark_bytes = 0;
     c->chanreq_head = NULL;
     c->throttle_state = UNTHROTTLED;
+    c->sched_queued = false;
+    c->sched_next = NULL;
     bufchain_init(&c->outbuffer);
     bufchain_init(&c->errbuffer);
     c->sc.vt = &ssh2channel_vtable;
     c->sc.cl = &s->cl;
     c->localid = alloc_channel_id(s->channels, struct ssh2_channel);
     add234(s->channels, c);
+    if (c->localid >= s->channel_index_size) {
+        size_t old_size = s->channel_index_size;
+        sgrowarrayn(s->channel_index, s->channel_index_size, c->localid, 1);
+        while (old_size < s->channel_index_size)
+            s->channel_index[old_size++] = NULL;
+    }
+    s->channel_index[c->localid] = c;
 }
 
 /*
@@ -1388,7 +1638,13 @@ static void ssh2channel_unthrottle(SshChannel *sc, size_t bufsize)
     struct ssh2_connection_state *s = c->connlayer;
     size_t buflimit;
 
-    buflimit = s->ssh_is_simple ? 0 : c->locmaxwin;
+    /*
+     * In simple mode, resume the flow only once the consumer's
+     * backlog has drained below half the limit that shut it off, so
+     * that a consumer hovering around the boundary is stopped and
+     * started in bulk instead of once per write.
+     */
+    buflimit = s->ssh_is_simple ? OUR_V2_INBUFLIMIT / 2 : c->locmaxwin;
     if (bufsize < buflimit)
         ssh2_set_window(c, buflimit - bufsize);
 
@@ -1403,7 +1659,34 @@ static size_t ssh2channel_write(
 {
     struct ssh2_channel *c = container_of(sc, struct ssh2_channel, sc);
     assert(!(c->closes & CLOSES_SENT_EOF));
-    bufchain_add(is_stderr ? &c->errbuffer : &c->outbuffer, buf, len);
+
+    /*
+     * Fast path: if nothing is already buffered on this channel and
+     * the remote window is open, packetise the data straight out of
+     * the caller's buffer instead of round-tripping it through the
+     * bufchain. A forwarded TCP segment arriving from a socket reader
+     * is then copied exactly once, into the outgoing packet; only
+     * whatever tail the remote window can't yet accept is buffered.
+     */
+    if (!c->halfopen &&
+        bufchain_size(&c->outbuffer) == 0 &&
+        bufchain_size(&c->errbuffer) == 0) {
+        const char *p = (const char *)buf;
+        while (len > 0 && c->remwindow > 0) {
+            size_t n = len;
+            if (n > c->remwindow)
+                n = c->remwindow;
+            if (n > c->remmaxpkt)
+                n = c->remmaxpkt;
+            ssh2_channel_send_data(c, is_stderr, make_ptrlen(p, n));
+            p += n;
+            len -= n;
+        }
+        buf = p;
+    }
+
+    if (len > 0)
+        bufchain_add(is_stderr ? &c->errbuffer : &c->outbuffer, buf, len);
     return ssh2_try_send(c);
 }
 
@@ -1481,7 +1764,7 @@ static void ssh2_sharing_globreq_response(
     ssh_sharing_connstate *cs = (ssh_sharing_connstate *)ctx;
     share_got_pkt_from_server(cs, pktin->type,
                               BinarySource_UPCAST(pktin)->data,
-                              BinarySource_UPCAST(pktin)->len);
+                              BinarySource_UPCAST(pktin)->len, NULL);
 }
 
 static void ssh2_sharing_queue_global_request(
@@ -1556,7 +1839,7 @@ static void ssh2_delete_sharing_channel(ConnectionLayer *cl, unsigned localid)
 {
     struct ssh2_connection_state *s =
         container_of(cl, struct ssh2_connection_state, cl);
-    struct ssh2_channel *c = find234(s->channels, &localid, ssh2_channelfind);
+    struct ssh2_channel *c = ssh2_channel_by_id(s, localid);
     if (c)
         ssh2_channel_destroy(c);
 }
@@ -25,6 +25,24 @@ struct ssh2_connection_state {
     Conf *conf;
 
     tree234 *channels;                 /* indexed by local id */
+    /*
+     * Round-robin queue of channels that have more output buffered
+     * than one scheduler quantum. Channels on this queue take turns
+     * to packetise a quantum each, so that a bulk transfer sharing
+     * the connection with an interactive session can't put its whole
+     * backlog into the outgoing packet queue ahead of everyone else.
+     */
+    struct ssh2_channel *sched_head, *sched_tail;
+    bool sched_callback_queued;
+    /*
+     * Direct-indexed map from local channel number to channel, for
+     * the per-packet demux lookup. Local channel numbers are
+     * allocated first-fit from a fixed offset, so this array stays
+     * dense; the tree above is kept for ordered iteration and for
+     * that id allocation.
+     */
+    struct ssh2_channel **channel_index;
+    size_t channel_index_size;
     bool all_channels_throttled;
 
     bool X11_fwd_enabled;
@@ -120,8 +138,31 @@ struct ssh2_channel {
 
     enum { THROTTLED, UNTHROTTLING, UNTHROTTLED } throttle_state;
 
+    /*
+     * State for adaptive growth of locmaxwin, so that a single
+     * channel's throughput can scale with the link's bandwidth-delay
+     * product: the smoothed round-trip time of our winadj channel
+     * requests, and a record of how much channel data has arrived
+     * since we last reconsidered the window size.
+     */
+    unsigned long winadj_rtt;
+    bool winadj_rtt_valid;
+    unsigned long win_mark_time;
+    uint64_t win_mark_bytes;
+
+    /*
+     * Links for the connection layer's round-robin output scheduler:
+     * sched_queued is true while this channel is waiting for a turn,
+     * and sched_next is the next channel in the queue.
+     */
+    bool sched_queued;
+    struct ssh2_channel *sched_next;
+
     ssh_sharing_connstate *sharectx; /* sharing context, if this is a
                                       * downstream channel */
+    share_channel *shareroute;  /* cached result of sharing.c's lookup
+                                 * of our local id, so that steady-state
+                                 * data packets skip that tree search */
     Channel *chan;      /* handle the client side of this channel, if not */
     SshChannel sc;      /* entry point for chan to talk back to */
 };
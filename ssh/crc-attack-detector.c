@@ -30,11 +30,8 @@
 #define SSH_BLOCKSIZE   (8)
 
 /* Hashing constants */
-#define HASH_MINSIZE    (8 * 1024)
-#define HASH_ENTRYSIZE  (sizeof(uint16_t))
+#define HASH_MINENTRIES (4 * 1024)
 #define HASH_FACTOR(x)  ((x)*3/2)
-#define HASH_UNUSEDCHAR (0xff)
-#define HASH_UNUSED     (0xffff)
 #define HASH_IV         (0xfffe)
 
 #define HASH_MINBLOCKS  (7*SSH_BLOCKSIZE)
@@ -47,16 +44,27 @@
 static const uint8_t ONE[4] = { 1, 0, 0, 0 };
 static const uint8_t ZERO[4] = { 0, 0, 0, 0 };
 
+/*
+ * Each hash table entry holds a block index (or HASH_IV) in its low
+ * 16 bits, tagged in the high 16 bits with the generation number of
+ * the packet that stored it. Entries from any other generation count
+ * as unused. This lets us invalidate the whole table between packets
+ * by incrementing the generation, instead of clearing the table,
+ * which would cost time proportional to the largest packet ever
+ * seen, for every packet.
+ */
 struct crcda_ctx {
-    uint16_t *h;
+    uint32_t *h;
     uint32_t n;
+    uint32_t gen;
 };
 
 struct crcda_ctx *crcda_make_context(void)
 {
     struct crcda_ctx *ret = snew(struct crcda_ctx);
     ret->h = NULL;
-    ret->n = HASH_MINSIZE / HASH_ENTRYSIZE;
+    ret->n = HASH_MINENTRIES;
+    ret->gen = 0;
     return ret;
 }
 
@@ -115,11 +123,15 @@ bool detect_attack(struct crcda_ctx *ctx,
 
     if (ctx->h == NULL) {
         ctx->n = l;
-        ctx->h = snewn(ctx->n, uint16_t);
+        ctx->h = snewn(ctx->n, uint32_t);
+        memset(ctx->h, 0, ctx->n * sizeof(uint32_t));
+        ctx->gen = 0;
     } else {
         if (l > ctx->n) {
             ctx->n = l;
-            ctx->h = sresize(ctx->h, ctx->n, uint16_t);
+            ctx->h = sresize(ctx->h, ctx->n, uint32_t);
+            memset(ctx->h, 0, ctx->n * sizeof(uint32_t));
+            ctx->gen = 0;
         }
     }
 
@@ -142,30 +154,44 @@ bool detect_attack(struct crcda_ctx *ctx,
         }
         return false;                  /* ok */
     }
-    memset(ctx->h, HASH_UNUSEDCHAR, ctx->n * HASH_ENTRYSIZE);
-
-    if (IV)
-        ctx->h[HASH(IV) & (ctx->n - 1)] = HASH_IV;
+    /*
+     * Move to a fresh generation, invalidating all entries left over
+     * from previous packets. When the 16-bit generation space wraps,
+     * clear the table for real and start again.
+     */
+    if (++ctx->gen > 0xFFFF) {
+        memset(ctx->h, 0, ctx->n * sizeof(uint32_t));
+        ctx->gen = 1;
+    }
 
-    for (c = buf, j = 0; c < (buf + len); c += SSH_BLOCKSIZE, j++) {
-        for (i = HASH(c) & (ctx->n - 1); ctx->h[i] != HASH_UNUSED;
-             i = (i + 1) & (ctx->n - 1)) {
-            if (ctx->h[i] == HASH_IV) {
-                assert(IV); /* or we wouldn't have stored HASH_IV above */
-                if (!CMP(c, IV)) {
+    {
+        uint32_t tag = ctx->gen << 16;
+
+        if (IV)
+            ctx->h[HASH(IV) & (ctx->n - 1)] = tag | HASH_IV;
+
+        for (c = buf, j = 0; c < (buf + len); c += SSH_BLOCKSIZE, j++) {
+            for (i = HASH(c) & (ctx->n - 1);
+                 (ctx->h[i] & 0xFFFF0000) == tag;  /* else entry is unused */
+                 i = (i + 1) & (ctx->n - 1)) {
+                uint32_t entry = ctx->h[i] & 0xFFFF;
+                if (entry == HASH_IV) {
+                    assert(IV); /* or we wouldn't have stored HASH_IV above */
+                    if (!CMP(c, IV)) {
+                        if (check_crc(c, buf, len, IV))
+                            return true;  /* attack detected */
+                        else
+                            break;
+                    }
+                } else if (!CMP(c, buf + entry * SSH_BLOCKSIZE)) {
                     if (check_crc(c, buf, len, IV))
                         return true;      /* attack detected */
                     else
                         break;
                 }
-            } else if (!CMP(c, buf + ctx->h[i] * SSH_BLOCKSIZE)) {
-                if (check_crc(c, buf, len, IV))
-                    return true;          /* attack detected */
-                else
-                    break;
             }
+            ctx->h[i] = tag | j;
         }
-        ctx->h[i] = j;
     }
     return false;                          /* ok */
 }
@@ -19,6 +19,79 @@
  */
 const int deliberate_symbol_clash = 12345;
 
+/*
+ * The slowest steps in a key exchange are the modular exponentiations
+ * that produce our public value and the shared secret in integer
+ * Diffie-Hellman. Where the platform gives us worker threads, we farm
+ * those out via run_in_worker_thread() and suspend the coroutine
+ * until the completion callback resumes it, so that the rest of the
+ * connection (and anything else in the event loop) keeps running in
+ * the meantime. The worker functions must confine themselves to state
+ * the suspended coroutine isn't going to look at before they finish,
+ * and must not use the PRNG, which is not thread safe; so inventing
+ * the private value stays on the main thread. The worker also does
+ * mp_int arithmetic concurrently with whatever the main thread gets
+ * up to in the meantime, so mpint's allocation pool is suspended for
+ * the duration of the offloaded job.
+ *
+ * ECDH is not offloaded: its arithmetic goes through the per-curve
+ * singletons in ecc-ssh.c, whose Montgomery contexts contain mutable
+ * scratch space shared by every connection in the process, so running
+ * it off the main thread would race against any other key exchange
+ * happening at the same time. (It's also far cheaper than a modpow
+ * over a multi-kilobit DH modulus, so there's much less to gain.)
+ */
+static void ssh2_kex_worker_dh_compute_e(void *vs)
+{
+    struct ssh2_transport_state *s = (struct ssh2_transport_state *)vs;
+    s->e = dh_compute_e(s->dh_ctx);
+}
+
+static void ssh2_kex_worker_dh_find_K(void *vs)
+{
+    struct ssh2_transport_state *s = (struct ssh2_transport_state *)vs;
+    s->K = dh_find_K(s->dh_ctx, s->f);
+}
+
+static void ssh2_kex_offload_completion(void *vs)
+{
+    struct ssh2_transport_state *s = (struct ssh2_transport_state *)vs;
+    if (s->kex_worker) {
+        /* A real worker thread existed, so the pool was suspended */
+        mp_pool_resume();
+    }
+    s->kex_worker = NULL;
+    s->kex_worker_done = true;
+    ssh_ppl_process_queue(&s->ppl);
+}
+
+static void ssh2_kex_offload(struct ssh2_transport_state *s,
+                             void (*fn)(void *ctx))
+{
+    s->kex_worker_done = false;
+    mp_pool_suspend();
+    s->kex_worker = run_in_worker_thread(fn, ssh2_kex_offload_completion, s);
+    if (!s->kex_worker) {
+        /* No thread to be had: fn already ran, synchronously, here */
+        mp_pool_resume();
+    }
+}
+
+/*
+ * While the coroutine is suspended, the packet that s->sigdata points
+ * into will be freed by the toplevel callback queue; so before any
+ * suspension between parsing the signature and verifying it, we must
+ * take our own copy.
+ */
+static void ssh2_kex_save_sigdata(struct ssh2_transport_state *s)
+{
+    if (!s->sigblob)
+        s->sigblob = strbuf_new();
+    strbuf_clear(s->sigblob);
+    put_datapl(s->sigblob, s->sigdata);
+    s->sigdata = ptrlen_from_strbuf(s->sigblob);
+}
+
 void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
 {
     PacketProtocolLayer *ppl = &s->ppl; /* for ppl_logevent */
@@ -118,7 +191,9 @@ void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
          * Now generate and send e for Diffie-Hellman.
          */
         seat_set_busy_status(s->ppl.seat, BUSY_CPU);
-        s->e = dh_create_e(s->dh_ctx, s->nbits * 2);
+        dh_invent_x(s->dh_ctx, s->nbits * 2);
+        ssh2_kex_offload(s, ssh2_kex_worker_dh_compute_e);
+        crMaybeWaitUntilV(s->kex_worker_done);
         pktout = ssh_bpp_new_pktout(s->ppl.bpp, s->kex_init_value);
         put_mp_ssh2(pktout, s->e);
         pq_push(s->ppl.out_pq, pktout);
@@ -156,12 +231,11 @@ void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
                 return;
             }
         }
-        s->K = dh_find_K(s->dh_ctx, s->f);
-
-        /* We assume everything from now on will be quick, and it might
-         * involve user interaction. */
-        seat_set_busy_status(s->ppl.seat, BUSY_NOT);
-
+        /*
+         * Absorb everything the exchange hash needs from this packet,
+         * and copy the signature, before the shared-secret
+         * computation suspends us and the packet goes away.
+         */
         put_stringpl(s->exhash, s->hostkeydata);
         if (dh_is_gex(s->kex_alg)) {
             if (!(s->ppl.remote_bugs & BUG_SSH2_OLDGEX))
@@ -174,6 +248,14 @@ void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
         }
         put_mp_ssh2(s->exhash, s->e);
         put_mp_ssh2(s->exhash, s->f);
+        ssh2_kex_save_sigdata(s);
+
+        ssh2_kex_offload(s, ssh2_kex_worker_dh_find_K);
+        crMaybeWaitUntilV(s->kex_worker_done);
+
+        /* We assume everything from now on will be quick, and it might
+         * involve user interaction. */
+        seat_set_busy_status(s->ppl.seat, BUSY_NOT);
 
         dh_cleanup(s->dh_ctx);
         s->dh_ctx = NULL;
@@ -231,12 +313,6 @@ void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
             ptrlen keydata = get_string(pktin);
             put_stringpl(s->exhash, keydata);
             s->K = ssh_ecdhkex_getkey(s->ecdh_key, keydata);
-            if (!get_err(pktin) && !s->K) {
-                ssh_proto_error(s->ppl.ssh, "Received invalid elliptic curve "
-                                "point in ECDH reply");
-                *aborted = true;
-                return;
-            }
         }
 
         s->sigdata = get_string(pktin);
@@ -245,6 +321,14 @@ void ssh2kex_coroutine(struct ssh2_transport_state *s, bool *aborted)
             *aborted = true;
             return;
         }
+        ssh2_kex_save_sigdata(s);
+
+        if (!s->K) {
+            ssh_proto_error(s->ppl.ssh, "Received invalid elliptic curve "
+                            "point in ECDH reply");
+            *aborted = true;
+            return;
+        }
 
         ssh_ecdhkex_freekey(s->ecdh_key);
         s->ecdh_key = NULL;
@@ -129,6 +129,7 @@ static void mainchan_open_confirmation(Channel *chan)
 
     seat_update_specials_menu(mc->ppl->seat);
     ppl_logevent("Opened main channel");
+    log_startup_phase(mc->ppl->logctx, "main channel open");
     seat_notify_session_started(mc->ppl->seat);
 
     if (mc->is_simple)
@@ -321,6 +322,8 @@ static void mainchan_ready(mainchan *mc)
 {
     mc->ready = true;
 
+    log_startup_phase(mc->ppl->logctx, "session ready");
+
     ssh_set_wants_user_input(mc->cl, true);
     ssh_got_user_input(mc->cl); /* in case any is already queued */
 
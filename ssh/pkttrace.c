@@ -0,0 +1,81 @@
+/*
+ * pkttrace.c: always-on ring buffer of recent SSH packet metadata.
+ *
+ * When a session misbehaves in the field - a window stall, a rekey
+ * that never completes - the full packet log in logging.c is no use
+ * unless it was enabled before the trouble started. So the binary
+ * packet protocols record a few bytes of metadata about every packet
+ * they send or receive (type, length, channel id where applicable,
+ * timestamp - never any payload) into a fixed-size ring here, at a
+ * cost of a handful of stores per packet. A front end can then dump
+ * the recent history post mortem, e.g. in response to a signal.
+ */
+
+#include "putty.h"
+#include "ssh.h"
+
+#define PKTTRACE_ENTRIES 256           /* must be a power of two */
+
+typedef struct PktTraceEntry {
+    unsigned long ticks;               /* GETTICKCOUNT at record time */
+    uint32_t length;                   /* payload length */
+    uint32_t channel;                  /* channel id field, or ~0 */
+    uint16_t type;                     /* may be SSH_MSG_NO_TYPE_CODE */
+    uint8_t direction;                 /* PKT_INCOMING or PKT_OUTGOING */
+} PktTraceEntry;
+
+static PktTraceEntry pkttrace_ring[PKTTRACE_ENTRIES];
+static size_t pkttrace_next = 0;
+static size_t pkttrace_total = 0;
+
+void ssh_packet_trace(int direction, int type, const void *payload, size_t len)
+{
+    PktTraceEntry *e = &pkttrace_ring[pkttrace_next];
+
+    pkttrace_next = (pkttrace_next + 1) & (PKTTRACE_ENTRIES - 1);
+    pkttrace_total++;
+
+    e->ticks = GETTICKCOUNT();
+    e->length = len;
+    e->type = type;
+    e->direction = direction;
+
+    /*
+     * For connection-layer messages whose first field is a channel
+     * id, squirrel that away too, since it's the first thing you
+     * want to know when staring at a window stall. (The id is the
+     * recipient's: our local id on incoming packets, the remote's
+     * on outgoing ones.)
+     */
+    e->channel = 0xFFFFFFFFU;
+    if (type >= SSH2_MSG_CHANNEL_OPEN_CONFIRMATION &&
+        type <= SSH2_MSG_CHANNEL_FAILURE && len >= 4)
+        e->channel = GET_32BIT_MSB_FIRST((const unsigned char *)payload);
+}
+
+void ssh_packet_trace_dump(FILE *fp)
+{
+    size_t n = (pkttrace_total < PKTTRACE_ENTRIES ?
+                pkttrace_total : PKTTRACE_ENTRIES);
+    size_t pos = (pkttrace_next + PKTTRACE_ENTRIES - n) &
+        (PKTTRACE_ENTRIES - 1);
+    unsigned long now = GETTICKCOUNT();
+
+    fprintf(fp, "Recent SSH packets (%"SIZEu" of %"SIZEu" seen, "
+            "oldest first):\n", n, pkttrace_total);
+    while (n-- > 0) {
+        PktTraceEntry *e = &pkttrace_ring[pos];
+        pos = (pos + 1) & (PKTTRACE_ENTRIES - 1);
+
+        fprintf(fp, "  %8lums ago %s type %3u (%s) len %u",
+                now - e->ticks,
+                e->direction == PKT_INCOMING ? "<-" : "->",
+                (unsigned)e->type,
+                ssh2_pkt_type(SSH2_PKTCTX_NOKEX, SSH2_PKTCTX_NOAUTH, e->type),
+                (unsigned)e->length);
+        if (e->channel != 0xFFFFFFFFU)
+            fprintf(fp, " chan %u", (unsigned)e->channel);
+        fputc('\n', fp);
+    }
+    fflush(fp);
+}
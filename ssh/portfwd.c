@@ -44,6 +44,16 @@ typedef struct PortForwarding {
     strbuf *socksbuf;
     size_t socksbuf_consumed;
 
+    /*
+     * Counters recording what this forwarding's throughput was
+     * limited by, reported in the close message: the number of times
+     * the SSH channel asked us to pause reading the local socket
+     * (flow-control-bound), and the number of times the local
+     * socket's own send buffer backed up (network-bound at our end).
+     */
+    unsigned long n_ssh_pauses, n_socket_backlogs;
+    bool socket_backlogged;
+
     Plug plug;
     Channel chan;
 } PortForwarding;
@@ -422,6 +432,9 @@ static void pfd_sent(Plug *plug, size_t bufsize)
     struct PortForwarding *pf =
         container_of(plug, struct PortForwarding, plug);
 
+    if (bufsize == 0)
+        pf->socket_backlogged = false;
+
     if (pf->c)
         sshfwd_unthrottle(pf->c, bufsize);
 }
@@ -487,6 +500,9 @@ Channel *portfwd_raw_new(ConnectionLayer *cl, Plug **plug, bool start_ready)
     pf->hostname = NULL;
     pf->port = 0;
 
+    pf->n_ssh_pauses = pf->n_socket_backlogs = 0;
+    pf->socket_backlogged = false;
+
     *plug = &pf->plug;
     return &pf->chan;
 }
@@ -600,6 +616,12 @@ static char *pfl_listen(const char *desthost, int destport,
 
 static char *pfd_log_close_msg(Channel *chan)
 {
+    assert(chan->vt == &PortForwarding_channelvt);
+    PortForwarding *pf = container_of(chan, PortForwarding, chan);
+    if (pf->n_ssh_pauses || pf->n_socket_backlogs)
+        return dupprintf("Forwarded port closed (reads paused %lu times by "
+                         "SSH flow control, local socket backlogged %lu "
+                         "times)", pf->n_ssh_pauses, pf->n_socket_backlogs);
     return dupstr("Forwarded port closed");
 }
 
@@ -628,6 +650,8 @@ static void pfd_set_input_wanted(Channel *chan, bool wanted)
 {
     assert(chan->vt == &PortForwarding_channelvt);
     PortForwarding *pf = container_of(chan, PortForwarding, chan);
+    if (pf->input_wanted && !wanted)
+        pf->n_ssh_pauses++;
     pf->input_wanted = wanted;
     sk_set_frozen(pf->s, !pf->input_wanted);
 }
@@ -647,7 +671,12 @@ static size_t pfd_send(
 {
     assert(chan->vt == &PortForwarding_channelvt);
     PortForwarding *pf = container_of(chan, PortForwarding, chan);
-    return sk_write(pf->s, data, len);
+    size_t backlog = sk_write(pf->s, data, len);
+    if (backlog > 0 && !pf->socket_backlogged) {
+        pf->socket_backlogged = true;
+        pf->n_socket_backlogs++;
+    }
+    return backlog;
 }
 
 static void pfd_send_eof(Channel *chan)
@@ -326,6 +326,25 @@ static void scp_reply_data(SftpReplyBuilder *srb, ptrlen data)
     reply->data.len = data.len;
 }
 
+static char *scp_reply_data_prepare(SftpReplyBuilder *srb, size_t max_length)
+{
+    ScpReplyReceiver *reply = container_of(srb, ScpReplyReceiver, srb);
+    char *p;
+    sfree((void *)reply->data.ptr);
+    reply->data.ptr = p = snewn(max_length, char);
+    reply->data.len = 0;
+    return p;
+}
+
+static void scp_reply_data_finish(SftpReplyBuilder *srb, size_t length)
+{
+    ScpReplyReceiver *reply = container_of(srb, ScpReplyReceiver, srb);
+    if (length == 0)
+        return;                        /* abandoned; expect another reply */
+    reply->err = false;
+    reply->data.len = length;
+}
+
 static void scp_reply_attrs(
     SftpReplyBuilder *srb, struct fxp_attrs attrs)
 {
@@ -342,6 +361,8 @@ static const SftpReplyBuilderVtable ScpReplyReceiver_vt = {
     .reply_full_name = scp_reply_full_name,
     .reply_handle = scp_reply_handle,
     .reply_data = scp_reply_data,
+    .reply_data_prepare = scp_reply_data_prepare,
+    .reply_data_finish = scp_reply_data_finish,
     .reply_attrs = scp_reply_attrs,
 };
 
@@ -365,6 +386,17 @@ static void scp_reply_cleanup(ScpReplyReceiver *reply)
 
 #define SCP_MAX_BACKLOG 65536
 
+/*
+ * File data is read in chunks of this size, and kept in a readahead
+ * queue of up to SCP_READAHEAD_CHUNKS chunks (overridable via the
+ * PUTTY_SCP_READAHEAD environment variable) which we keep topped up
+ * even while the channel can't accept more data, so that when the
+ * client's window reopens we can refill it from memory instead of
+ * waiting for the disk.
+ */
+#define SCP_READ_CHUNK 16384
+#define SCP_READAHEAD_CHUNKS 4
+
 typedef struct ScpSource ScpSource;
 typedef struct ScpSourceStackEntry ScpSourceStackEntry;
 
@@ -382,7 +414,9 @@ struct ScpSource {
     strbuf *pending_commands[3];
     int n_pending_commands;
 
-    uint64_t file_offset, file_size;
+    uint64_t file_offset, file_size, file_read_offset;
+    bufchain readahead;
+    size_t readahead_limit;
 
     ScpReplyReceiver reply;
 
@@ -506,6 +540,17 @@ static ScpSource *scp_source_new(
     scp->sf = sftpsrv_new(sftpserver_vt);
     scp->n_pending_commands = 0;
 
+    bufchain_init(&scp->readahead);
+    scp->readahead_limit = (size_t)SCP_READAHEAD_CHUNKS * SCP_READ_CHUNK;
+    {
+        const char *e = getenv("PUTTY_SCP_READAHEAD");
+        if (e) {
+            int n = atoi(e);
+            if (n > 0 && n <= 1024)
+                scp->readahead_limit = (size_t)n * SCP_READ_CHUNK;
+        }
+    }
+
     scp_source_push(scp, SCP_ROOTPATH, pathname, PTRLEN_LITERAL(""),
                     NULL, NULL);
 
@@ -523,6 +568,7 @@ static void scp_source_free(ScpServer *s)
         scp->head = node->next;
         sfree(node);
     }
+    bufchain_clear(&scp->readahead);
 
     delete_callbacks_for_context(scp);
 
@@ -584,10 +630,53 @@ static void scp_requeue(ScpSource *scp)
     queue_toplevel_callback(scp_source_process_stack_cb, scp);
 }
 
+/*
+ * Top up the readahead queue from the file currently being
+ * transferred, if there is one. Called both from the main transfer
+ * path and while the channel is throttled, so that disk reads overlap
+ * with the wait for the client's window to reopen.
+ */
+static void scp_source_prefetch(ScpSource *scp)
+{
+    if (!scp->head || scp->head->type != SCP_READFILE)
+        return;
+
+    while (scp->file_read_offset < scp->file_size &&
+           bufchain_size(&scp->readahead) < scp->readahead_limit) {
+        uint64_t limit = scp->file_size - scp->file_read_offset;
+        if (limit > SCP_READ_CHUNK)
+            limit = SCP_READ_CHUNK;
+        sftpsrv_read(scp->sf, &scp->reply.srb, scp->head->handle,
+                     scp->file_read_offset, limit);
+        if (scp->reply.err) {
+            scp_source_abort(
+                scp, "%.*s: unable to read: %s",
+                PTRLEN_PRINTF(scp->head->pathname), scp->reply.errmsg);
+            return;
+        }
+        if (scp->reply.data.len == 0) {
+            /* The file turned out shorter than its stat said. We've
+             * already committed to the original size in our C
+             * command, so we can't gracefully recover. */
+            scp_source_abort(
+                scp, "%.*s: file changed size during transfer",
+                PTRLEN_PRINTF(scp->head->pathname));
+            return;
+        }
+        bufchain_add(&scp->readahead, scp->reply.data.ptr,
+                     scp->reply.data.len);
+        scp->file_read_offset += scp->reply.data.len;
+    }
+}
+
 static void scp_source_process_stack(ScpSource *scp)
 {
-    if (scp->throttled)
+    if (scp->throttled) {
+        /* We can't send anything, but we can still get the disk reads
+         * done while we wait. */
+        scp_source_prefetch(scp);
         return;
+    }
 
     while (scp->n_pending_commands > 0) {
         /* Expect an ack, and consume it */
@@ -718,23 +807,27 @@ static void scp_source_process_stack(ScpSource *scp)
         /*
          * Transfer file data if our backlog hasn't filled up.
          */
-        int backlog;
-        uint64_t limit = scp->file_size - scp->file_offset;
-        if (limit > 4096)
-            limit = 4096;
-        if (limit > 0) {
-            sftpsrv_read(scp->sf, &scp->reply.srb, scp->head->handle,
-                         scp->file_offset, limit);
-            if (scp->reply.err) {
-                scp_source_abort(
-                    scp, "%.*s: unable to read: %s",
-                    PTRLEN_PRINTF(scp->head->pathname), scp->reply.errmsg);
+        if (scp->file_offset < scp->file_size) {
+            int backlog = 0;
+
+            scp_source_prefetch(scp);
+            if (scp->finished)
                 return;
+
+            while (bufchain_size(&scp->readahead) > 0 &&
+                   backlog < SCP_MAX_BACKLOG) {
+                ptrlen data = bufchain_prefix(&scp->readahead);
+                backlog = sshfwd_write(scp->sc, data.ptr, data.len);
+                scp->file_offset += data.len;
+                bufchain_consume(&scp->readahead, data.len);
             }
 
-            backlog = sshfwd_write(
-                scp->sc, scp->reply.data.ptr, scp->reply.data.len);
-            scp->file_offset += scp->reply.data.len;
+            /* Refill the queue behind what we just sent, so that when
+             * the backlog clears we can serve the next burst from
+             * memory. */
+            scp_source_prefetch(scp);
+            if (scp->finished)
+                return;
 
             if (backlog < SCP_MAX_BACKLOG)
                 scp_requeue(scp);
@@ -854,7 +947,9 @@ static void scp_source_process_stack(ScpSource *scp)
             return;
         }
         scp->file_offset = 0;
+        scp->file_read_offset = 0;
         scp->file_size = scp->reply.attrs.size;
+        assert(bufchain_size(&scp->readahead) == 0);
         scp_source_send_CD(scp, 'C', node->attrs,
                            scp->file_size, node->pathname);
         scp_source_push(
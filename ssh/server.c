@@ -36,6 +36,7 @@ struct server {
     Plug plug;
     int conn_throttle_count;
     bool frozen;
+    bool throttled_all;
 
     Conf *conf;
     const SshServerConfig *ssc;
@@ -73,7 +74,8 @@ void ssh_connshare_provide_connlayer(ssh_sharing_state *sharestate,
                                      ConnectionLayer *cl) {}
 int share_ndownstreams(ssh_sharing_state *sharestate) { return 0; }
 void share_got_pkt_from_server(ssh_sharing_connstate *cs, int type,
-                               const void *vpkt, int pktlen) {}
+                               const void *vpkt, int pktlen,
+                               share_channel **route) {}
 void share_setup_x11_channel(ssh_sharing_connstate *cs, share_channel *chan,
                              unsigned upstream_id, unsigned server_id,
                              unsigned server_currwin, unsigned server_maxpkt,
@@ -166,9 +168,22 @@ static void server_receive(
         queue_idempotent_callback(&srv->bpp->ic_in_raw);
 }
 
+/*
+ * Throttle or unthrottle all the server's channels, for when sends on
+ * the SSH connection itself back up. (The mirror image of
+ * ssh_throttle_all in ssh.c.)
+ */
+static void srv_throttle_all(server *srv, bool enable)
+{
+    if (enable == srv->throttled_all)
+        return;
+    srv->throttled_all = enable;
+    if (srv->cl)
+        ssh_throttle_all_channels(srv->cl, enable);
+}
+
 static void server_sent(Plug *plug, size_t bufsize)
 {
-#ifdef FIXME
     server *srv = container_of(plug, server, plug);
 
     /*
@@ -178,10 +193,9 @@ static void server_sent(Plug *plug, size_t bufsize)
      * some more data off its bufchain.
      */
     if (bufsize < SSH_MAX_BACKLOG) {
-        srv_throttle_all(srv, 0, bufsize);
+        srv_throttle_all(srv, false);
         queue_idempotent_callback(&srv->ic_out_raw);
     }
-#endif
 }
 
 LogContext *ssh_get_logctx(Ssh *ssh)
@@ -280,6 +294,9 @@ Plug *ssh_server_plug(
     bufchain_init(&srv->in_raw);
     bufchain_init(&srv->out_raw);
     bufchain_init(&srv->dummy_user_input);
+    /* As in ssh.c: bulk-data chains get large granules */
+    bufchain_set_granule_size(&srv->in_raw, 32768);
+    bufchain_set_granule_size(&srv->out_raw, 32768);
 
 #ifndef NO_GSSAPI
     /* FIXME: replace with sensible */
@@ -364,6 +381,8 @@ static void server_connect_bpp(server *srv)
     srv->bpp->pls = &srv->pls;
     srv->bpp->logctx = srv->logctx;
     srv->bpp->remote_bugs = srv->remote_bugs;
+    srv->bpp->compression_level = conf_get_int(srv->conf,
+                                               CONF_compression_level);
     /* Servers don't really have a notion of 'unexpected' connection
      * closure. The client is free to close if it likes. */
     srv->bpp->expect_close = true;
@@ -398,9 +417,18 @@ static void server_bpp_output_raw_data_callback(void *vctx)
         bufchain_consume(&srv->out_raw, data.len);
 
         if (backlog > SSH_MAX_BACKLOG) {
-#ifdef FIXME
-            ssh_throttle_all(ssh, 1, backlog);
-#endif
+            /*
+             * Stop pouring data into the socket's backlog, and pause
+             * the channels that are producing it. server_sent will
+             * restart this callback (and unthrottle the channels)
+             * when the client catches up. Without that resume path,
+             * any data left in out_raw here would be stranded for
+             * ever, permanently stalling the session - which a client
+             * whose own consumer is slow (e.g. plink piping into a
+             * busy process) can trigger just by leaving its end of
+             * the connection unread for a moment too long.
+             */
+            srv_throttle_all(srv, true);
             return;
         }
     }
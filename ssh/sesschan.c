@@ -289,7 +289,20 @@ static char *sesschan_log_close_msg(Channel *chan)
 
 static void sesschan_set_input_wanted(Channel *chan, bool wanted)
 {
-    /* I don't think we need to do anything here */
+    sesschan *sess = container_of(chan, sesschan, chan);
+
+    /*
+     * The connection layer is telling us whether it can currently
+     * cope with more output from the process: either the channel's
+     * own outgoing buffer has passed its high watermark, or the
+     * whole connection's socket has backed up. Pass that on to the
+     * backend as an unthrottle-style backlog report, so that (e.g.)
+     * the pty backend stops reading the process's output instead of
+     * letting it pile up in the channel, where a subsequent channel
+     * close would discard it.
+     */
+    if (sess->backend)
+        backend_unthrottle(sess->backend, wanted ? 0 : (size_t)-1);
 }
 
 static void sesschan_start_backend(sesschan *sess, const char *cmd)
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <limits.h>
 
+#include "putty.h"
 #include "misc.h"
 #include "tree234.h"
 #include "sftp.h"
@@ -15,6 +16,10 @@
 static const char *fxp_error_message;
 static int fxp_errtype;
 
+/* Whether the server announced support for the check-file extension
+ * (with SHA-256) in its FXP_VERSION packet. */
+static bool fxp_remote_check_file;
+
 static void fxp_internal_error(const char *msg);
 
 /* ----------------------------------------------------------------------
@@ -73,6 +78,7 @@ struct sftp_request {
     unsigned id;
     bool registered;
     void *userdata;
+    uint64_t sent_us;        /* when it was registered, for RTT stats */
 };
 
 static int sftp_reqcmp(void *av, void *bv)
@@ -144,6 +150,7 @@ static struct sftp_request *sftp_alloc_request(void)
     r->id = low + 1 + REQUEST_ID_OFFSET;
     r->registered = false;
     r->userdata = NULL;
+    r->sent_us = 0;
     add234(sftp_requests, r);
     return r;
 }
@@ -159,6 +166,8 @@ void sftp_cleanup_request(void)
 void sftp_register(struct sftp_request *req)
 {
     req->registered = true;
+    if (sftpstats_active())
+        req->sent_us = loopstats_now_us();
 }
 
 struct sftp_request *sftp_find_request(struct sftp_packet *pktin)
@@ -185,6 +194,9 @@ struct sftp_request *sftp_find_request(struct sftp_packet *pktin)
 
     del234(sftp_requests, req);
 
+    if (sftpstats_active())
+        sftpstats_rtt_sample(req->sent_us, count234(sftp_requests));
+
     return req;
 }
 
@@ -289,16 +301,33 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * This packet might also contain extension-string pairs. Work
+     * through them and look for any we recognise.
      */
+    fxp_remote_check_file = false;
+    while (get_avail(pktin) > 0) {
+        ptrlen name = get_string(pktin);
+        ptrlen data = get_string(pktin);
+        if (get_err(pktin))
+            break;
+        if (ptrlen_eq_string(name, "check-file")) {
+            /* The extension data is a comma-separated list of the
+             * hash algorithms the server supports. */
+            while (data.len > 0)
+                if (ptrlen_eq_string(ptrlen_get_word(&data, ","), "sha256"))
+                    fxp_remote_check_file = true;
+        }
+    }
     sftp_pkt_free(pktin);
 
     return true;
 }
 
+bool fxp_has_check_file(void)
+{
+    return fxp_remote_check_file;
+}
+
 /*
  * Canonify a pathname.
  */
@@ -664,6 +693,57 @@ bool fxp_fsetstat_recv(struct sftp_packet *pktin, struct sftp_request *req)
     return id == 1;
 }
 
+/*
+ * Hash a range of an open file block by block, via the 'check-file'
+ * protocol extension. Only valid if fxp_has_check_file() returned
+ * true after fxp_init.
+ */
+struct sftp_request *fxp_check_file_send(struct fxp_handle *handle,
+                                         uint64_t offset, uint64_t length,
+                                         unsigned blocksize)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "check-file-handle");
+    put_string(pktout, handle->hstring, handle->hlen);
+    put_stringz(pktout, "sha256");
+    put_uint64(pktout, offset);
+    put_uint64(pktout, length);
+    put_uint32(pktout, blocksize);
+    sftp_send(pktout);
+
+    return req;
+}
+
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         strbuf *hashes)
+{
+    sfree(req);
+
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        ptrlen algorithm, data;
+
+        algorithm = get_string(pktin);
+        data = get_data(pktin, get_avail(pktin));
+        if (get_err(pktin) || !ptrlen_eq_string(algorithm, "sha256") ||
+            data.len % 32 != 0) {
+            fxp_internal_error("received malformed FXP_EXTENDED_REPLY");
+            sftp_pkt_free(pktin);
+            return false;
+        }
+        put_datapl(hashes, data);
+        sftp_pkt_free(pktin);
+        return true;
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return false;
+    }
+}
+
 /*
  * Read from a file. Returns the number of bytes read, or -1 on an
  * error, or possibly 0 if EOF. (I'm not entirely sure whether it
@@ -883,15 +963,37 @@ struct req {
     char *buffer;
     int len, retlen, complete;
     uint64_t offset;
+    unsigned long senttime;
+    struct fxp_xfer *xfer;             /* the transfer we belong to */
     struct req *next, *prev;
 };
 
+/*
+ * Limits on the request window. The minimum is the old fixed window
+ * size, so that a connection where we can't usefully measure anything
+ * (or where the measurements say a small window is plenty) behaves
+ * exactly as it used to; the maximum bounds how much memory we'll
+ * dedicate to read-ahead buffers on a really long fat pipe.
+ */
+#define XFER_WINDOW_MIN 1048576
+#define XFER_WINDOW_MAX (64 * 1048576)
+
 struct fxp_xfer {
     uint64_t offset, furthestdata, filesize;
     int req_totalsize, req_maxsize;
     bool eof, err;
     struct fxp_handle *fh;
     struct req *head, *tail;
+
+    /*
+     * State for adapting req_maxsize to the link: a smoothed
+     * round-trip time estimate, and a count of bytes drained since
+     * the start of the current rate-measurement period.
+     */
+    unsigned long rtt;
+    bool rtt_valid;
+    unsigned long mark_time;
+    uint64_t mark_bytes;
 };
 
 static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
@@ -902,14 +1004,74 @@ static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
     xfer->offset = offset;
     xfer->head = xfer->tail = NULL;
     xfer->req_totalsize = 0;
-    xfer->req_maxsize = 1048576;
+    xfer->req_maxsize = XFER_WINDOW_MIN;
     xfer->err = false;
     xfer->filesize = UINT64_MAX;
     xfer->furthestdata = 0;
+    xfer->rtt = 0;
+    xfer->rtt_valid = false;
+    xfer->mark_time = GETTICKCOUNT();
+    xfer->mark_bytes = 0;
 
     return xfer;
 }
 
+/*
+ * Update the adaptive request window when a read request completes.
+ *
+ * The window we need in order to keep the pipe full is the
+ * bandwidth-delay product: the rate at which data is arriving, times
+ * the round trip time of a request. We estimate the RTT by
+ * timestamping each request when it's sent (with TCP-style smoothing
+ * over the samples, so one queueing glitch doesn't swing it wildly),
+ * and the drain rate by counting the data that arrives over a
+ * measurement period of at least one RTT. Then we aim for twice the
+ * measured product, so that the window stays ahead of a link that's
+ * still speeding up, moving at most a factor of two per measurement
+ * period in either direction to damp the feedback loop.
+ */
+static void xfer_update_window(struct fxp_xfer *xfer, struct req *rr)
+{
+    unsigned long now = GETTICKCOUNT();
+    unsigned long sample = now - rr->senttime;
+    unsigned long elapsed;
+    uint64_t target;
+
+    if (!xfer->rtt_valid) {
+        xfer->rtt = sample;
+        xfer->rtt_valid = true;
+    } else {
+        xfer->rtt = (7 * xfer->rtt + sample) / 8;
+    }
+
+    xfer->mark_bytes += rr->retlen;
+
+    elapsed = now - xfer->mark_time;
+    if (elapsed < TICKSPERSEC / 4 || elapsed < xfer->rtt)
+        return;                /* measurement period not finished yet */
+
+    /* (rtt+1 so that a sub-tick RTT doesn't zero the target) */
+    target = xfer->mark_bytes * 2 * (xfer->rtt + 1) / elapsed;
+
+    if (target > (uint64_t)xfer->req_maxsize * 2)
+        target = (uint64_t)xfer->req_maxsize * 2;
+    if (target < (uint64_t)xfer->req_maxsize / 2)
+        target = (uint64_t)xfer->req_maxsize / 2;
+    if (target < XFER_WINDOW_MIN)
+        target = XFER_WINDOW_MIN;
+    if (target > XFER_WINDOW_MAX)
+        target = XFER_WINDOW_MAX;
+    xfer->req_maxsize = target;
+
+    xfer->mark_time = now;
+    xfer->mark_bytes = 0;
+
+#ifdef DEBUG_DOWNLOAD
+    printf("rtt estimate %lu ticks, request window now %d\n",
+           xfer->rtt, xfer->req_maxsize);
+#endif
+}
+
 bool xfer_done(struct fxp_xfer *xfer)
 {
     /*
@@ -932,6 +1094,7 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         rr = snew(struct req);
         rr->offset = xfer->offset;
         rr->complete = 0;
+        rr->xfer = xfer;
         if (xfer->tail) {
             xfer->tail->next = rr;
             rr->prev = xfer->tail;
@@ -944,6 +1107,7 @@ void xfer_download_queue(struct fxp_xfer *xfer)
 
         rr->len = 32768;
         rr->buffer = snewn(rr->len, char);
+        rr->senttime = GETTICKCOUNT();
         sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
         fxp_set_userdata(req, rr);
 
@@ -966,6 +1130,12 @@ struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
     return xfer;
 }
 
+struct fxp_xfer *xfer_find(struct sftp_request *rreq)
+{
+    struct req *rr = (struct req *)fxp_get_userdata(rreq);
+    return rr ? rr->xfer : NULL;
+}
+
 /*
  * Returns INT_MIN to indicate that it didn't even get as far as
  * fxp_read_recv and hence has not freed pktin.
@@ -973,16 +1143,25 @@ struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
 int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 {
     struct sftp_request *rreq;
-    struct req *rr;
 
     rreq = sftp_find_request(pktin);
     if (!rreq)
         return INT_MIN;            /* this packet doesn't even make sense */
+    return xfer_download_gotreply(pktin, rreq);
+}
+
+int xfer_download_gotreply(struct sftp_packet *pktin,
+                           struct sftp_request *rreq)
+{
+    struct fxp_xfer *xfer;
+    struct req *rr;
+
     rr = (struct req *)fxp_get_userdata(rreq);
     if (!rr) {
         fxp_internal_error("request ID is not part of the current download");
         return INT_MIN;                /* this packet isn't ours */
     }
+    xfer = rr->xfer;
     rr->retlen = fxp_read_recv(pktin, rreq, rr->buffer, rr->len);
 #ifdef DEBUG_DOWNLOAD
     printf("read request %p has returned [%d]\n", rr, rr->retlen);
@@ -1004,6 +1183,9 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 
     rr->complete = 1;
 
+    if (rr->retlen > 0)
+        xfer_update_window(xfer, rr);
+
     /*
      * Special case: if we have received fewer bytes than we
      * actually read, we should do something. For the moment I'll
@@ -1115,6 +1297,11 @@ bool xfer_upload_ready(struct fxp_xfer *xfer)
     return sftp_sendbuffer() == 0;
 }
 
+void xfer_upload_seek(struct fxp_xfer *xfer, uint64_t offset)
+{
+    xfer->offset = offset;
+}
+
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
 {
     struct req *rr;
@@ -1123,6 +1310,7 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
     rr = snew(struct req);
     rr->offset = xfer->offset;
     rr->complete = 0;
+    rr->xfer = xfer;
     if (xfer->tail) {
         xfer->tail->next = rr;
         rr->prev = xfer->tail;
@@ -243,6 +243,21 @@ struct sftp_request *fxp_fsetstat_send(struct fxp_handle *handle,
                                        struct fxp_attrs attrs);
 bool fxp_fsetstat_recv(struct sftp_packet *pktin, struct sftp_request *req);
 
+/*
+ * Hash a range of an open file, using the 'check-file' protocol
+ * extension, which fxp_has_check_file reports whether the server
+ * supports (with SHA-256, the only hash we ask for). The range is
+ * hashed in blocks of 'blocksize' bytes, the last of which may be
+ * short; each block contributes a 32-byte SHA-256 hash, appended to
+ * 'hashes'.
+ */
+bool fxp_has_check_file(void);
+struct sftp_request *fxp_check_file_send(struct fxp_handle *handle,
+                                         uint64_t offset, uint64_t length,
+                                         unsigned blocksize);
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         strbuf *hashes);
+
 /*
  * Read from a file.
  */
@@ -291,6 +306,22 @@ void sftp_register(struct sftp_request *req);
 struct sftp_request *sftp_find_request(struct sftp_packet *pktin);
 struct sftp_packet *sftp_recv(void);
 
+/*
+ * Optional structured transfer statistics, in sftpstats.c, enabled by
+ * the file-transfer tools' -stats-json option. The tools call
+ * sftpstats_file_begin / sftpstats_file_data / sftpstats_file_end
+ * around each file they transfer; the request layer feeds in an RTT
+ * sample (and the current window occupancy) per request/reply pair
+ * via sftpstats_rtt_sample. Records are emitted as one JSON object
+ * per line on stderr.
+ */
+void sftpstats_enable(void);
+bool sftpstats_active(void);
+void sftpstats_file_begin(const char *name, uint64_t size, bool sending);
+void sftpstats_file_data(uint64_t bytes);
+void sftpstats_file_end(bool success);
+void sftpstats_rtt_sample(uint64_t sent_us, int outstanding);
+
 /*
  * A wrapper to go round fxp_read_* and fxp_write_*, which manages
  * the queueing of multiple read/write requests.
@@ -303,8 +334,26 @@ void xfer_download_queue(struct fxp_xfer *xfer);
 int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len);
 
+/*
+ * Alternative entry points for a client running more than one
+ * transfer (or other requests) over the same connection at once. Such
+ * a client must call sftp_find_request itself so that it can tell
+ * which of its requests a reply is for; xfer_find then identifies the
+ * transfer that issued a read request (or returns NULL if no transfer
+ * did), and xfer_download_gotreply is the remainder of
+ * xfer_download_gotpkt after the sftp_find_request stage, with the
+ * same return convention.
+ */
+struct fxp_xfer *xfer_find(struct sftp_request *rreq);
+int xfer_download_gotreply(struct sftp_packet *pktin,
+                           struct sftp_request *rreq);
+
 struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset);
 bool xfer_upload_ready(struct fxp_xfer *xfer);
+/* Change the file offset the next xfer_upload_data will write at, for
+ * callers wanting to skip over parts of the file that don't need
+ * re-sending. */
+void xfer_upload_seek(struct fxp_xfer *xfer, uint64_t offset);
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len);
 int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 
@@ -456,6 +505,19 @@ struct SftpReplyBuilderVtable {
                             ptrlen longname, struct fxp_attrs attrs);
     void (*reply_handle)(SftpReplyBuilder *reply, ptrlen handle);
     void (*reply_data)(SftpReplyBuilder *reply, ptrlen data);
+    /*
+     * Two-stage version of reply_data, which allows file data to be
+     * read directly into the reply without passing through an
+     * intermediate buffer. reply_data_prepare reserves room for up to
+     * max_length bytes of data in the reply and returns a pointer to
+     * write them into; reply_data_finish then commits the number of
+     * bytes actually written, which must be at most max_length.
+     * Finishing with zero bytes abandons the data reply completely,
+     * after which the caller must call some other reply method (e.g.
+     * to return an EOF or error status) instead.
+     */
+    char *(*reply_data_prepare)(SftpReplyBuilder *reply, size_t max_length);
+    void (*reply_data_finish)(SftpReplyBuilder *reply, size_t length);
     void (*reply_attrs)(SftpReplyBuilder *reply, struct fxp_attrs attrs);
 };
 
@@ -476,6 +538,12 @@ static inline void fxp_reply_handle(SftpReplyBuilder *reply, ptrlen handle)
 { reply->vt->reply_handle(reply, handle); }
 static inline void fxp_reply_data(SftpReplyBuilder *reply, ptrlen data)
 { reply->vt->reply_data(reply, data); }
+static inline char *fxp_reply_data_prepare(
+    SftpReplyBuilder *reply, size_t max_length)
+{ return reply->vt->reply_data_prepare(reply, max_length); }
+static inline void fxp_reply_data_finish(
+    SftpReplyBuilder *reply, size_t length)
+{ reply->vt->reply_data_finish(reply, length); }
 static inline void fxp_reply_attrs(
     SftpReplyBuilder *reply, struct fxp_attrs attrs)
 { reply->vt->reply_attrs(reply, attrs); }
@@ -23,6 +23,18 @@ static void sftp_pkt_BinarySink_write(
     pkt->length += length;
 }
 
+static void *sftp_pkt_BinarySink_reserve(BinarySink *bs, size_t length)
+{
+    struct sftp_packet *pkt = BinarySink_DOWNCAST(bs, struct sftp_packet);
+
+    assert(length <= 0xFFFFFFFFU - pkt->length);
+
+    sgrowarrayn_nm(pkt->data, pkt->maxlen, pkt->length, length);
+    void *ret = pkt->data + pkt->length;
+    pkt->length += length;
+    return ret;
+}
+
 struct sftp_packet *sftp_pkt_init(int type)
 {
     struct sftp_packet *pkt;
@@ -32,7 +44,8 @@ struct sftp_packet *sftp_pkt_init(int type)
     pkt->length = 0;
     pkt->maxlen = 0;
     pkt->type = type;
-    BinarySink_INIT(pkt, sftp_pkt_BinarySink_write);
+    BinarySink_INIT_RESERVABLE(pkt, sftp_pkt_BinarySink_write,
+                               sftp_pkt_BinarySink_reserve);
     put_uint32(pkt, 0); /* length field will be filled in later */
     put_byte(pkt, 0); /* so will the type field */
     return pkt;
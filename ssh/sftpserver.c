@@ -10,6 +10,105 @@
 #include "ssh.h"
 #include "sftp.h"
 
+/*
+ * Implement the 'check-file-handle' extension request (from
+ * draft-ietf-secsh-filexfer-extensions-00): hash a range of an open
+ * file block by block, so that a client which also has a copy of the
+ * file can work out which parts differ without transferring them.
+ *
+ * We implement it here, centrally, in terms of the server's ordinary
+ * read method: each block is read via a scratch reply builder and
+ * hashed out of the resulting packet. So individual SftpServer
+ * implementations need not know the extension exists.
+ *
+ * 'reply' is the output packet (whose request id is already written),
+ * and 'rb' the usual reply builder for it, used for error responses.
+ */
+#define CHECKFILE_MAX_BLOCKS 65536
+#define CHECKFILE_MIN_BLOCKSIZE 256    /* lower bound set by the draft */
+
+static void sftp_handle_checkfile(
+    SftpServer *srv, SftpReplyBuilder *rb, struct sftp_packet *reply,
+    ptrlen handle, ptrlen hashlist, uint64_t offset, uint64_t length,
+    unsigned blocksize)
+{
+    strbuf *hashes;
+    uint64_t done = 0;
+    unsigned nblocks = 0;
+    bool supported = false, eof = false, failed = false;
+
+    while (hashlist.len > 0)
+        if (ptrlen_eq_string(ptrlen_get_word(&hashlist, ","), "sha256"))
+            supported = true;
+    if (!supported) {
+        fxp_reply_error(rb, SSH_FX_OP_UNSUPPORTED,
+                        "No supported hash algorithm in list");
+        return;
+    }
+    if (blocksize < CHECKFILE_MIN_BLOCKSIZE) {
+        fxp_reply_error(rb, SSH_FX_BAD_MESSAGE, "Block size too small");
+        return;
+    }
+    if (length != 0 && length / blocksize >= CHECKFILE_MAX_BLOCKS) {
+        fxp_reply_error(rb, SSH_FX_FAILURE, "Too many blocks requested");
+        return;
+    }
+
+    hashes = strbuf_new();
+
+    while (!eof && (length == 0 || done < length) &&
+           nblocks < CHECKFILE_MAX_BLOCKS) {
+        struct sftp_packet *scratch;
+        DefaultSftpReplyBuilder sdsrb;
+        BinarySource src[1];
+        unsigned readlen = blocksize;
+
+        if (length != 0 && length - done < blocksize)
+            readlen = length - done;
+
+        scratch = sftp_pkt_init(0);
+        sdsrb.rb.vt = &DefaultSftpReplyBuilder_vt;
+        sdsrb.pkt = scratch;
+        sftpsrv_read(srv, &sdsrb.rb, handle, offset + done, readlen);
+
+        /* Skip the 5-byte length/type placeholder sftp_pkt_init wrote. */
+        BinarySource_BARE_INIT(src, scratch->data + 5, scratch->length - 5);
+
+        if (scratch->type == SSH_FXP_DATA) {
+            ptrlen data = get_string(src);
+            if (get_err(src) || data.len == 0 || data.len > readlen) {
+                failed = true;
+            } else {
+                ssh_hash *h = ssh_hash_new(&ssh_sha256);
+                put_datapl(h, data);
+                ssh_hash_final(h, strbuf_append(hashes, 32));
+                nblocks++;
+                done += data.len;
+                if (data.len < readlen)
+                    eof = true;    /* short read must mean end of file */
+            }
+        } else if (scratch->type == SSH_FXP_STATUS &&
+                   get_uint32(src) == SSH_FX_EOF && !get_err(src)) {
+            eof = true;
+        } else {
+            failed = true;
+        }
+        sftp_pkt_free(scratch);
+
+        if (failed) {
+            strbuf_free(hashes);
+            fxp_reply_error(rb, SSH_FX_FAILURE,
+                            "Unable to read file data to hash");
+            return;
+        }
+    }
+
+    reply->type = SSH_FXP_EXTENDED_REPLY;
+    put_stringz(reply, "sha256");
+    put_datapl(reply, ptrlen_from_strbuf(hashes));
+    strbuf_free(hashes);
+}
+
 struct sftp_packet *sftp_handle_request(
     SftpServer *srv, struct sftp_packet *req)
 {
@@ -35,6 +134,9 @@ struct sftp_packet *sftp_handle_request(
          * input packet.
          */
         put_uint32(reply, SFTP_PROTO_VERSION);
+        /* Advertise the check-file extension, and the hash we support. */
+        put_stringz(reply, "check-file");
+        put_stringz(reply, "sha256");
         return reply;
     }
 
@@ -184,6 +286,31 @@ struct sftp_packet *sftp_handle_request(
         sftpsrv_write(srv, rb, handle, offset, data);
         break;
 
+      case SSH_FXP_EXTENDED: {
+        ptrlen extname, hashlist;
+        uint64_t cf_length;
+        uint32_t blocksize;
+
+        extname = get_string(req);
+        if (get_err(req))
+            goto decode_error;
+        if (!ptrlen_eq_string(extname, "check-file-handle")) {
+            fxp_reply_error(rb, SSH_FX_OP_UNSUPPORTED,
+                            "Unrecognised extended request");
+            break;
+        }
+        handle = get_string(req);
+        hashlist = get_string(req);
+        offset = get_uint64(req);
+        cf_length = get_uint64(req);
+        blocksize = get_uint32(req);
+        if (get_err(req))
+            goto decode_error;
+        sftp_handle_checkfile(srv, rb, reply, handle, hashlist,
+                              offset, cf_length, blocksize);
+        break;
+      }
+
       default:
         if (get_err(req))
             goto decode_error;
@@ -258,6 +385,40 @@ static void default_reply_data(SftpReplyBuilder *reply, ptrlen data)
     put_stringpl(d->pkt, data);
 }
 
+static char *default_reply_data_prepare(
+    SftpReplyBuilder *reply, size_t max_length)
+{
+    DefaultSftpReplyBuilder *d =
+        container_of(reply, DefaultSftpReplyBuilder, rb);
+    struct sftp_packet *pkt = d->pkt;
+    pkt->type = SSH_FXP_DATA;
+    put_uint32(pkt, 0);     /* length field, filled in at finish time */
+    /*
+     * Can't use put_reserve here, because the space we're making is
+     * _beyond_ pkt->length: the file read may come up short (or
+     * fail), and only the bytes actually read are committed to the
+     * packet, in default_reply_data_finish.
+     */
+    sgrowarrayn_nm(pkt->data, pkt->maxlen, pkt->length, max_length);
+    return pkt->data + pkt->length;
+}
+
+static void default_reply_data_finish(SftpReplyBuilder *reply, size_t length)
+{
+    DefaultSftpReplyBuilder *d =
+        container_of(reply, DefaultSftpReplyBuilder, rb);
+    struct sftp_packet *pkt = d->pkt;
+    if (length == 0) {
+        /* Abandoned reply: remove the unused length field again, so
+         * that whatever reply replaces this one starts in the right
+         * place. */
+        pkt->length -= 4;
+        return;
+    }
+    PUT_32BIT_MSB_FIRST(pkt->data + pkt->length - 4, length);
+    pkt->length += length;
+}
+
 static void default_reply_attrs(
     SftpReplyBuilder *reply, struct fxp_attrs attrs)
 {
@@ -275,5 +436,7 @@ const SftpReplyBuilderVtable DefaultSftpReplyBuilder_vt = {
     .reply_full_name = default_reply_full_name,
     .reply_handle = default_reply_handle,
     .reply_data = default_reply_data,
+    .reply_data_prepare = default_reply_data_prepare,
+    .reply_data_finish = default_reply_data_finish,
     .reply_attrs = default_reply_attrs,
 };
@@ -0,0 +1,182 @@
+/*
+ * Structured transfer statistics for the SFTP file-transfer tools.
+ *
+ * When enabled (PSCP and PSFTP's -stats-json option), this module
+ * collects per-file and aggregate byte counts, round-trip-time
+ * samples measured between each SFTP request going out and its reply
+ * arriving, and the occupancy of the outstanding-request window, and
+ * emits them as one JSON object per line on standard error: a
+ * "start" record as each file transfer begins, a "progress" record
+ * roughly once a second while it runs, and a "done" record when it
+ * finishes. A machine at the far end of the stderr pipe can therefore
+ * watch the link's behaviour mid-transfer instead of learning the
+ * average speed after the fact.
+ *
+ * Timing uses loopstats_now_us, so RTTs are measured in microseconds
+ * where a monotonic clock exists and degrade to milliseconds where
+ * not.
+ */
+
+#include <stdio.h>
+
+#include "putty.h"
+#include "sftp.h"
+
+static bool sftpstats_enabled = false;
+
+static struct {
+    /* Current file. */
+    char *name;
+    bool sending;
+    uint64_t size, done;
+    uint64_t file_start_us;
+
+    /* Aggregate over the whole session. */
+    uint64_t total_bytes;
+    uint64_t session_start_us;
+
+    /* RTT estimation: exponentially weighted moving average (gain
+     * 1/8, like TCP's srtt), plus extremes, over the current file. */
+    uint64_t rtt_ewma_us, rtt_min_us, rtt_max_us, rtt_samples;
+
+    /* Outstanding-request window occupancy. */
+    int window_cur, window_max;
+
+    uint64_t last_emit_us;
+} stats;
+
+void sftpstats_enable(void)
+{
+    sftpstats_enabled = true;
+    stats.session_start_us = loopstats_now_us();
+}
+
+bool sftpstats_active(void)
+{
+    return sftpstats_enabled;
+}
+
+/*
+ * Minimal JSON string escaping: we only ever emit file names, but
+ * those can contain anything.
+ */
+static void json_write_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void emit_record(const char *event, uint64_t now_us)
+{
+    FILE *fp = stderr;
+    uint64_t file_elapsed = now_us - stats.file_start_us;
+    uint64_t session_elapsed = now_us - stats.session_start_us;
+
+    fprintf(fp, "{\"event\":\"%s\",\"file\":", event);
+    json_write_string(fp, stats.name ? stats.name : "");
+    fprintf(fp, ",\"direction\":\"%s\"", stats.sending ? "send" : "receive");
+    fprintf(fp, ",\"size\":%"PRIu64",\"done\":%"PRIu64, stats.size,
+            stats.done);
+    fprintf(fp, ",\"elapsed_us\":%"PRIu64, file_elapsed);
+    if (file_elapsed)
+        fprintf(fp, ",\"bytes_per_sec\":%"PRIu64,
+                stats.done * 1000000 / file_elapsed);
+    if (stats.rtt_samples)
+        fprintf(fp, ",\"rtt_us\":{\"ewma\":%"PRIu64",\"min\":%"PRIu64
+                ",\"max\":%"PRIu64",\"samples\":%"PRIu64"}",
+                stats.rtt_ewma_us, stats.rtt_min_us, stats.rtt_max_us,
+                stats.rtt_samples);
+    fprintf(fp, ",\"window\":{\"cur\":%d,\"max\":%d}",
+            stats.window_cur, stats.window_max);
+    fprintf(fp, ",\"session\":{\"bytes\":%"PRIu64",\"elapsed_us\":%"PRIu64,
+            stats.total_bytes, session_elapsed);
+    if (session_elapsed)
+        fprintf(fp, ",\"bytes_per_sec\":%"PRIu64,
+                stats.total_bytes * 1000000 / session_elapsed);
+    fprintf(fp, "}}\n");
+    fflush(fp);
+
+    stats.last_emit_us = now_us;
+}
+
+void sftpstats_file_begin(const char *name, uint64_t size, bool sending)
+{
+    if (!sftpstats_enabled)
+        return;
+
+    sfree(stats.name);
+    stats.name = dupstr(name);
+    stats.sending = sending;
+    stats.size = size;
+    stats.done = 0;
+    stats.file_start_us = loopstats_now_us();
+    stats.rtt_ewma_us = stats.rtt_min_us = stats.rtt_max_us = 0;
+    stats.rtt_samples = 0;
+    stats.window_max = stats.window_cur;
+
+    emit_record("start", stats.file_start_us);
+}
+
+void sftpstats_file_data(uint64_t bytes)
+{
+    uint64_t now_us;
+
+    if (!sftpstats_enabled)
+        return;
+
+    stats.done += bytes;
+    stats.total_bytes += bytes;
+
+    now_us = loopstats_now_us();
+    if (now_us - stats.last_emit_us >= 1000000)
+        emit_record("progress", now_us);
+}
+
+void sftpstats_file_end(bool success)
+{
+    if (!sftpstats_enabled)
+        return;
+
+    emit_record(success ? "done" : "failed", loopstats_now_us());
+
+    sfree(stats.name);
+    stats.name = NULL;
+}
+
+/*
+ * Called from the request layer in sftp.c: a reply has just arrived
+ * for a request sent at 'sent_us', leaving 'outstanding' further
+ * requests still in flight.
+ */
+void sftpstats_rtt_sample(uint64_t sent_us, int outstanding)
+{
+    uint64_t rtt;
+
+    if (!sftpstats_enabled || !sent_us)
+        return;
+
+    rtt = loopstats_now_us() - sent_us;
+    if (!stats.rtt_samples) {
+        stats.rtt_ewma_us = stats.rtt_min_us = stats.rtt_max_us = rtt;
+    } else {
+        stats.rtt_ewma_us += ((int64_t)rtt - (int64_t)stats.rtt_ewma_us) / 8;
+        if (rtt < stats.rtt_min_us)
+            stats.rtt_min_us = rtt;
+        if (rtt > stats.rtt_max_us)
+            stats.rtt_max_us = rtt;
+    }
+    stats.rtt_samples++;
+
+    stats.window_cur = outstanding;
+    if (outstanding > stats.window_max)
+        stats.window_max = outstanding;
+}
@@ -732,6 +732,15 @@ static PRINTF_LIKE(2, 3) void log_general(struct ssh_sharing_state *sharestate,
     sfree(buf);
 }
 
+/*
+ * Send a packet to a downstream. If 'chan' is non-NULL, the packet is
+ * one of the channel-citing types whose first uint32 is the recipient
+ * channel id, and we substitute chan->downstream_id for that field
+ * while writing out the frame, in place of whatever id 'pkt' itself
+ * contains. (We're constructing a fresh output frame anyway, to
+ * prepend the length header, so doing the channel-number NAT here
+ * saves the caller making a rewritten copy of the packet first.)
+ */
 static void send_packet_to_downstream(struct ssh_sharing_connstate *cs,
                                       int type, const void *pkt, int pktlen,
                                       struct share_channel *chan)
@@ -762,7 +771,8 @@ static void send_packet_to_downstream(struct ssh_sharing_connstate *cs,
         ptrlen data;
 
         BinarySource_BARE_INIT(src, pkt, pktlen);
-        channel = get_uint32(src);
+        get_uint32(src);               /* skip the incoming channel id */
+        channel = chan->downstream_id;
         data = get_string(src);
 
         do {
@@ -783,12 +793,18 @@ static void send_packet_to_downstream(struct ssh_sharing_connstate *cs,
         } while (data.len > 0);
     } else {
         /*
-         * Just do the obvious thing.
+         * Just do the obvious thing, with the channel id substituted
+         * if we were given one.
          */
         packet = strbuf_new_nm();
         put_uint32(packet, 0);     /* placeholder for length field */
         put_byte(packet, type);
-        put_data(packet, pkt, pktlen);
+        if (chan && pktlen >= 4) {
+            put_uint32(packet, chan->downstream_id);
+            put_data(packet, (const char *)pkt + 4, pktlen - 4);
+        } else {
+            put_data(packet, pkt, pktlen);
+        }
         PUT_32BIT_MSB_FIRST(packet->s, packet->len-4);
         sk_write(cs->sock, packet->s, packet->len);
         strbuf_free(packet);
@@ -1052,8 +1068,6 @@ void share_xchannel_confirmation(struct ssh_sharing_connstate *cs,
         struct share_xchannel_message *msg = xc->msghead;
         xc->msghead = msg->next;
 
-        if (msg->datalen >= 4)
-            PUT_32BIT_MSB_FIRST(msg->data, chan->downstream_id);
         send_packet_to_downstream(cs, msg->type,
                                   msg->data, msg->datalen, chan);
 
@@ -1126,8 +1140,11 @@ void share_setup_x11_channel(ssh_sharing_connstate *cs, share_channel *chan,
     put_uint32(packet, 0); /* leave the channel id field unfilled - we
                             * don't know the downstream id yet */
     put_uint32(packet, greeting_len + initial_len);
-    put_data(packet, greeting, greeting_len);
-    put_data(packet, initial_data, initial_len);
+    ptrlen views[] = {
+        make_ptrlen(greeting, greeting_len),
+        make_ptrlen(initial_data, initial_len),
+    };
+    put_datav(packet, views, lenof(views));
     sfree(greeting);
     share_xchannel_add_message(xc, SSH2_MSG_CHANNEL_DATA,
                                packet->s, packet->len);
@@ -1164,11 +1181,11 @@ void share_setup_x11_channel(ssh_sharing_connstate *cs, share_channel *chan,
 }
 
 void share_got_pkt_from_server(ssh_sharing_connstate *cs, int type,
-                               const void *vpkt, int pktlen)
+                               const void *vpkt, int pktlen,
+                               share_channel **route)
 {
     const unsigned char *pkt = (const unsigned char *)vpkt;
     struct share_globreq *globreq;
-    size_t id_pos;
     unsigned upstream_id, server_id;
     struct share_channel *chan;
     struct share_xchannel *xc;
@@ -1232,17 +1249,29 @@ void share_got_pkt_from_server(ssh_sharing_connstate *cs, int type,
          * first uint32 field in the packet. Substitute the downstream
          * channel id for our one and pass the packet downstream.
          */
-        id_pos = src->pos;
         upstream_id = get_uint32(src);
-        if ((chan = share_find_channel_by_upstream(cs, upstream_id)) != NULL) {
+
+        /*
+         * If the caller gave us a cache slot on its own channel
+         * object, use the route resolved by a previous packet rather
+         * than searching the tree again. The cache can't go stale,
+         * because the upstream channel holding it is always deleted
+         * before the share_channel it points at is removed.
+         */
+        chan = route ? *route : NULL;
+        if (!chan)
+            chan = share_find_channel_by_upstream(cs, upstream_id);
+        if (chan != NULL) {
+            assert(chan->upstream_id == upstream_id);
+            if (route)
+                *route = chan;
             /*
              * The normal case: this id refers to an open channel.
+             * send_packet_to_downstream does the channel-number NAT
+             * for us as it writes out the frame, so we can pass the
+             * packet on without making a rewritten copy.
              */
-            unsigned char *rewritten = snewn(pktlen, unsigned char);
-            memcpy(rewritten, pkt, pktlen);
-            PUT_32BIT_MSB_FIRST(rewritten + id_pos, chan->downstream_id);
-            send_packet_to_downstream(cs, type, rewritten, pktlen, chan);
-            sfree(rewritten);
+            send_packet_to_downstream(cs, type, pkt, pktlen, chan);
 
             /*
              * Update the channel state, for messages that need it.
@@ -160,6 +160,8 @@ static void ssh_connect_bpp(Ssh *ssh)
     ssh->bpp->pls = &ssh->pls;
     ssh->bpp->logctx = ssh->logctx;
     ssh->bpp->remote_bugs = ssh->remote_bugs;
+    ssh->bpp->compression_level = conf_get_int(ssh->conf,
+                                               CONF_compression_level);
 }
 
 static void ssh_connect_ppl(Ssh *ssh, PacketProtocolLayer *ppl)
@@ -362,6 +364,7 @@ void ssh_conn_processed_data(Ssh *ssh)
 static void ssh_bpp_output_raw_data_callback(void *vctx)
 {
     Ssh *ssh = (Ssh *)vctx;
+    bool corked = false;
 
     if (!ssh->s)
         return;
@@ -371,6 +374,19 @@ static void ssh_bpp_output_raw_data_callback(void *vctx)
 
         ptrlen data = bufchain_prefix(&ssh->out_raw);
 
+        /*
+         * If this event cycle has generated more data than one
+         * bufchain granule holds - typically a burst of small packets
+         * such as window adjustments and channel data from several
+         * channels - cork the socket, so that the whole burst leaves
+         * as a minimal number of TCP segments rather than one per
+         * sk_write.
+         */
+        if (!corked && data.len < bufchain_size(&ssh->out_raw)) {
+            sk_set_corked(ssh->s, true);
+            corked = true;
+        }
+
         if (ssh->logctx)
             log_packet(ssh->logctx, PKT_OUTGOING, -1, NULL, data.ptr, data.len,
                        0, NULL, NULL, 0, NULL);
@@ -379,11 +395,16 @@ static void ssh_bpp_output_raw_data_callback(void *vctx)
         bufchain_consume(&ssh->out_raw, data.len);
 
         if (backlog > SSH_MAX_BACKLOG) {
+            if (corked)
+                sk_set_corked(ssh->s, false);
             ssh_throttle_all(ssh, true, backlog);
             return;
         }
     }
 
+    if (corked)
+        sk_set_corked(ssh->s, false);
+
     ssh_check_frozen(ssh);
 
     if (ssh->pending_close) {
@@ -600,6 +621,8 @@ static void ssh_socket_log(Plug *plug, PlugLogType type, SockAddr *addr,
                            ssh->session_started);
 
     if (type == PLUGLOG_CONNECT_SUCCESS) {
+        log_startup_phase(ssh->logctx, "network connection established");
+
         if (is_tempseat(ssh->seat)) {
             Seat *ts = ssh->seat;
             tempseat_flush(ts);
@@ -743,6 +766,9 @@ static char *connect_to_host(
     ssh_hostport_setup(host, port, ssh->conf,
                        &ssh->savedhost, &ssh->savedport, &loghost);
 
+    /* Establish the time base for the startup profile */
+    log_startup_phase(ssh->logctx, "setting up connection");
+
     ssh->plug.vt = &Ssh_plugvt;
 
     /*
@@ -806,6 +832,9 @@ static char *connect_to_host(
             seat_notify_remote_disconnect(ssh->seat);
             return dupstr(err);
         }
+        sk_set_buffer_sizes(ssh->s,
+                            conf_get_int(ssh->conf, CONF_socket_sndbuf),
+                            conf_get_int(ssh->conf, CONF_socket_rcvbuf));
     }
 
     /*
@@ -924,6 +953,11 @@ static char *ssh_init(const BackendVtable *vt, Seat *seat,
     bufchain_init(&ssh->in_raw);
     bufchain_init(&ssh->out_raw);
     bufchain_init(&ssh->user_input);
+    /* The raw chains either side of the BPP carry the session's bulk
+     * data, so give them granules big enough for a whole network read
+     * or formatted packet at a time. */
+    bufchain_set_granule_size(&ssh->in_raw, 32768);
+    bufchain_set_granule_size(&ssh->out_raw, 32768);
     ssh->ic_out_raw.fn = ssh_bpp_output_raw_data_callback;
     ssh->ic_out_raw.ctx = ssh;
 
@@ -19,15 +19,37 @@
  * Instead, we maintain an in-memory cache of host keys that have been
  * mentioned in GSS key exchanges within this particular session, and
  * we permit precisely those host keys in non-GSS rekeys.
+ *
+ * As a deliberate and carefully limited exception to the
+ * per-session scoping, the cache is also mirrored in a small locked
+ * file in PuTTY's storage directory, keyed by host and port and with
+ * entries expiring after a few minutes. The point is scripted use:
+ * a batch of short-lived command-line connections to the same host
+ * would otherwise each have to trigger an extra non-GSS rekey at
+ * session startup, purely to re-learn a fallback host key that
+ * another process verified moments earlier. An entry from the mirror
+ * is only ever used for what this cache is for anyway - deciding
+ * which host keys to accept in a non-GSS rekey of a GSS-based
+ * session - so a stale or forged entry can't authenticate a host by
+ * itself; and the short expiry keeps the window close to the
+ * single-session spirit of RFC 4462.
  */
 
 #include <assert.h>
+#include <time.h>
 
 #include "putty.h"
 #include "ssh.h"
+#include "storage.h"
+
+/* How long a mirror-file entry remains usable, in seconds. */
+#define TRANSIENT_HOSTKEY_FILE_LIFETIME 600
 
 struct ssh_transient_hostkey_cache {
     tree234 *cache;
+    char *hostspec;      /* "host:port" key for the mirror file, or
+                          * NULL if we're not mirroring (e.g. server
+                          * side, where no hostname was provided) */
 };
 
 struct ssh_transient_hostkey_cache_entry {
@@ -51,10 +73,97 @@ static int ssh_transient_hostkey_cache_find(void *av, void *bv)
     return strcmp(aalg->ssh_id, b->alg->ssh_id);
 }
 
-ssh_transient_hostkey_cache *ssh_transient_hostkey_cache_new(void)
+/*
+ * Parse one line of the mirror file, of the form
+ *
+ *   <expiry-time> <host:port> <algorithm> <base64 public blob>
+ *
+ * Returns false if the line is malformed. Any of the output
+ * pointers may be NULL if the caller doesn't need that field.
+ */
+static bool thc_file_parse_line(
+    ptrlen line, time_t *expiry, ptrlen *hostspec, ptrlen *alg, ptrlen *blob64)
+{
+    ptrlen expiry_word = ptrlen_get_word(&line, " ");
+    ptrlen hostspec_word = ptrlen_get_word(&line, " ");
+    ptrlen alg_word = ptrlen_get_word(&line, " ");
+    ptrlen blob_word = ptrlen_get_word(&line, " ");
+
+    if (!expiry_word.len || !hostspec_word.len ||
+        !alg_word.len || !blob_word.len || line.len)
+        return false;
+
+    uintmax_t expiry_num = 0;
+    for (size_t i = 0; i < expiry_word.len; i++) {
+        char c = ((const char *)expiry_word.ptr)[i];
+        if (c < '0' || c > '9')
+            return false;
+        expiry_num = expiry_num * 10 + (c - '0');
+    }
+
+    if (expiry)
+        *expiry = (time_t)expiry_num;
+    if (hostspec)
+        *hostspec = hostspec_word;
+    if (alg)
+        *alg = alg_word;
+    if (blob64)
+        *blob64 = blob_word;
+    return true;
+}
+
+ssh_transient_hostkey_cache *ssh_transient_hostkey_cache_new(
+    const char *host, int port)
 {
     ssh_transient_hostkey_cache *thc = snew(ssh_transient_hostkey_cache);
     thc->cache = newtree234(ssh_transient_hostkey_cache_cmp);
+    thc->hostspec = (host && *host) ? dupprintf("%s:%d", host, port) : NULL;
+
+    /*
+     * Preload any still-valid entries for this host from the mirror
+     * file, so that a session which would otherwise have to trigger
+     * a proactive non-GSS rekey to obtain a fallback host key can
+     * skip it.
+     */
+    if (thc->hostspec) {
+        strbuf *contents = strbuf_new();
+        transient_hostkey_cache_file *f =
+            open_transient_hostkey_cache_file(contents);
+        if (f) {
+            time_t now = time(NULL);
+            ptrlen rest = ptrlen_from_strbuf(contents);
+            while (rest.len) {
+                ptrlen line = ptrlen_get_word(&rest, "\n");
+                time_t expiry;
+                ptrlen hostspec, algname, blob64;
+                if (!thc_file_parse_line(
+                        line, &expiry, &hostspec, &algname, &blob64))
+                    continue;
+                if (expiry <= now ||
+                    !ptrlen_eq_string(hostspec, thc->hostspec))
+                    continue;
+
+                const ssh_keyalg *alg = find_pubkey_alg_len(algname);
+                if (!alg ||
+                    find234(thc->cache, (void *)alg,
+                            ssh_transient_hostkey_cache_find))
+                    continue;
+
+                strbuf *blob = base64_decode_sb(blob64);
+                if (!blob)
+                    continue;
+
+                struct ssh_transient_hostkey_cache_entry *ent =
+                    snew(struct ssh_transient_hostkey_cache_entry);
+                ent->alg = alg;
+                ent->pub_blob = blob;
+                add234(thc->cache, ent);
+            }
+            close_transient_hostkey_cache_file(f, NULL);
+        }
+        strbuf_free(contents);
+    }
+
     return thc;
 }
 
@@ -66,6 +175,7 @@ void ssh_transient_hostkey_cache_free(ssh_transient_hostkey_cache *thc)
         sfree(ent);
     }
     freetree234(thc->cache);
+    sfree(thc->hostspec);
     sfree(thc);
 }
 
@@ -87,6 +197,48 @@ void ssh_transient_hostkey_cache_add(
     ssh_key_public_blob(key, BinarySink_UPCAST(ent->pub_blob));
     retd = add234(thc->cache, ent);
     assert(retd == ent);
+
+    /*
+     * Mirror the new entry to the shared file, dropping any expired
+     * lines and any previous entry for the same host and algorithm
+     * while we're rewriting it.
+     */
+    if (thc->hostspec) {
+        strbuf *contents = strbuf_new();
+        transient_hostkey_cache_file *f =
+            open_transient_hostkey_cache_file(contents);
+        if (f) {
+            time_t now = time(NULL);
+            strbuf *newtext = strbuf_new();
+            ptrlen rest = ptrlen_from_strbuf(contents);
+            while (rest.len) {
+                ptrlen line = ptrlen_get_word(&rest, "\n");
+                time_t expiry;
+                ptrlen hostspec, algname;
+                if (!thc_file_parse_line(
+                        line, &expiry, &hostspec, &algname, NULL))
+                    continue;
+                if (expiry <= now)
+                    continue;
+                if (ptrlen_eq_string(hostspec, thc->hostspec) &&
+                    ptrlen_eq_string(algname, ent->alg->ssh_id))
+                    continue;
+                put_datapl(newtext, line);
+                put_byte(newtext, '\n');
+            }
+
+            strbuf_catf(newtext, "%"PRIuMAX" %s %s ",
+                        (uintmax_t)(now + TRANSIENT_HOSTKEY_FILE_LIFETIME),
+                        thc->hostspec, ent->alg->ssh_id);
+            base64_encode_bs(BinarySink_UPCAST(newtext),
+                             ptrlen_from_strbuf(ent->pub_blob), 0);
+            put_byte(newtext, '\n');
+
+            close_transient_hostkey_cache_file(f, newtext->s);
+            strbuf_free(newtext);
+        }
+        strbuf_free(contents);
+    }
 }
 
 bool ssh_transient_hostkey_cache_verify(
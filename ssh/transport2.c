@@ -20,13 +20,14 @@ const struct ssh_signkey_with_user_pref_id ssh2_hostkey_algs[] = {
 };
 
 const static ssh2_macalg *const macs[] = {
+    &ssh2_umac64, &ssh2_umac128,
     &ssh_hmac_sha256, &ssh_hmac_sha1, &ssh_hmac_sha1_96, &ssh_hmac_md5
 };
 const static ssh2_macalg *const buggymacs[] = {
     &ssh_hmac_sha1_buggy, &ssh_hmac_sha1_96_buggy, &ssh_hmac_md5
 };
 
-static ssh_compressor *ssh_comp_none_init(void)
+static ssh_compressor *ssh_comp_none_init(int level)
 {
     return NULL;
 }
@@ -93,6 +94,8 @@ static const PacketProtocolLayerVtable ssh2_transport_vtable = {
 #ifndef NO_GSSAPI
 static void ssh2_transport_gss_update(struct ssh2_transport_state *s,
                                       bool definitely_rekeying);
+static void ssh2_transport_gss_derive_status(struct ssh2_transport_state *s,
+                                             time_t gss_cred_expiry);
 #endif
 
 static bool ssh2_transport_timer_update(struct ssh2_transport_state *s,
@@ -135,6 +138,31 @@ PacketProtocolLayer *ssh2_transport_new(
     s->stats = stats;
     s->hostkeyblob = strbuf_new();
 
+    /*
+     * If the user has supplied a preset compression dictionary, read
+     * it in now, so that we can offer the dictionary-primed zlib
+     * variant in our KEXINIT. Only the last 32kB can matter (that
+     * being zlib's window size), but we don't bother enforcing that
+     * here: the priming functions clamp to the window size anyway.
+     */
+    {
+        Filename *fn = conf_get_filename(s->conf, CONF_compression_dict);
+        if (!filename_is_null(fn)) {
+            FILE *fp = f_open(fn, "rb", false);
+            if (fp) {
+                s->comp_dict = strbuf_new();
+                while (1) {
+                    char buf[4096];
+                    size_t got = fread(buf, 1, sizeof(buf), fp);
+                    if (got == 0)
+                        break;
+                    put_data(s->comp_dict, buf, got);
+                }
+                fclose(fp);
+            }
+        }
+    }
+
     pq_in_init(&s->pq_in_higher);
     pq_out_init(&s->pq_out_higher);
     s->pq_out_higher.pqb.ic = &s->ic_pq_out_higher;
@@ -150,7 +178,7 @@ PacketProtocolLayer *ssh2_transport_new(
     s->shgss->srv_name = GSS_C_NO_NAME;
     s->shgss->ctx = NULL;
 #endif
-    s->thc = ssh_transient_hostkey_cache_new();
+    s->thc = ssh_transient_hostkey_cache_new(host, port);
     s->gss_kex_used = false;
 
     s->outgoing_kexinit = strbuf_new();
@@ -182,6 +210,17 @@ static void ssh2_transport_free(PacketProtocolLayer *ppl)
     struct ssh2_transport_state *s =
         container_of(ppl, struct ssh2_transport_state, ppl);
 
+    /*
+     * If a worker thread is still computing part of a key exchange,
+     * wait for it to finish and discard its result, before we free
+     * any of the state it's working on.
+     */
+    if (s->kex_worker) {
+        worker_thread_discard(s->kex_worker);
+        mp_pool_resume();  /* undo the suspend from ssh2_kex_offload */
+        s->kex_worker = NULL;
+    }
+
     /*
      * As our last act before being freed, move any outgoing packets
      * off our higher layer's output queue on to our own output queue.
@@ -199,6 +238,8 @@ static void ssh2_transport_free(PacketProtocolLayer *ppl)
         pq_concatenate(s->ppl.out_pq, s->ppl.out_pq, &s->pq_out_higher);
 
     conf_free(s->conf);
+    if (s->comp_dict)
+        strbuf_free(s->comp_dict);
 
     ssh_ppl_free(s->higher_layer);
 
@@ -228,6 +269,8 @@ static void ssh2_transport_free(PacketProtocolLayer *ppl)
     }
     if (s->ecdh_key)
         ssh_ecdhkex_freekey(s->ecdh_key);
+    if (s->sigblob)
+        strbuf_free(s->sigblob);
     if (s->exhash)
         ssh_hash_free(s->exhash);
     strbuf_free(s->outgoing_kexinit);
@@ -237,6 +280,7 @@ static void ssh2_transport_free(PacketProtocolLayer *ppl)
     freetree234(s->weak_algorithms_consented_to);
 
     expire_timer_context(s);
+    delete_callbacks_for_context(s);
     sfree(s);
 }
 
@@ -485,6 +529,7 @@ static void ssh2_write_kexinit_lists(
     BinarySink *pktout,
     struct kexinit_algorithm kexlists[NKEXLIST][MAXKEXLIST],
     Conf *conf, const SshServerConfig *ssc, int remote_bugs,
+    bool have_comp_dict,
     const char *hk_host, int hk_port, const ssh_keyalg *hk_prev,
     ssh_transient_hostkey_cache *thc,
     ssh_key *const *our_hostkeys, int our_nhostkeys,
@@ -596,7 +641,7 @@ static void ssh2_write_kexinit_lists(
      * Set up preferred compression.
      */
     if (conf_get_bool(conf, CONF_compression))
-        preferred_comp = &ssh_zlib;
+        preferred_comp = have_comp_dict ? &ssh_zlib_dict : &ssh_zlib_perchannel;
     else
         preferred_comp = &ssh_comp_none;
 
@@ -816,6 +861,27 @@ static void ssh2_write_kexinit_lists(
                 alg->u.comp.delayed = true;
             }
         }
+        /* Private-namespace zlib variants, listed as capabilities
+         * after the standard methods. (If one of them is also the
+         * preferred method, ssh2_kexinit_addalg has already put it at
+         * the front, and won't list it a second time.) */
+        alg = ssh2_kexinit_addalg(kexlists[j], ssh_zlib_perchannel.name);
+        alg->u.comp.comp = &ssh_zlib_perchannel;
+        alg->u.comp.delayed = false;
+        alg = ssh2_kexinit_addalg(kexlists[j],
+                                  ssh_zlib_perchannel.delayed_name);
+        alg->u.comp.comp = &ssh_zlib_perchannel;
+        alg->u.comp.delayed = true;
+        /* The dictionary-primed variant can only be offered at all if
+         * we have a dictionary to prime it with. */
+        if (have_comp_dict) {
+            alg = ssh2_kexinit_addalg(kexlists[j], ssh_zlib_dict.name);
+            alg->u.comp.comp = &ssh_zlib_dict;
+            alg->u.comp.delayed = false;
+            alg = ssh2_kexinit_addalg(kexlists[j], ssh_zlib_dict.delayed_name);
+            alg->u.comp.comp = &ssh_zlib_dict;
+            alg->u.comp.delayed = true;
+        }
     }
 
     /*
@@ -1187,9 +1253,12 @@ static void ssh2_transport_process_queue(PacketProtocolLayer *ppl)
     strbuf_clear(s->client_kexinit);
     put_byte(s->outgoing_kexinit, SSH2_MSG_KEXINIT);
     random_read(strbuf_append(s->outgoing_kexinit, 16), 16);
+    if (s->comp_dict)
+        ssh2_bpp_set_compression_dict(
+            s->ppl.bpp, ptrlen_from_strbuf(s->comp_dict));
     ssh2_write_kexinit_lists(
         BinarySink_UPCAST(s->outgoing_kexinit), s->kexlists,
-        s->conf, s->ssc, s->ppl.remote_bugs,
+        s->conf, s->ssc, s->ppl.remote_bugs, s->comp_dict != NULL,
         s->savedhost, s->savedport, s->hostkey_alg, s->thc,
         s->hostkeys, s->nhostkeys,
         !s->got_session_id, s->can_gssapi_keyex,
@@ -1378,6 +1447,24 @@ static void ssh2_transport_process_queue(PacketProtocolLayer *ppl)
         crReturnV;
     }
 
+    {
+        LogStructuredEvent *le = logevent_structured_start(
+            s->ppl.logctx, LOGEV_KEX);
+        logevent_structured_field(le, "phase", "%s",
+                                  s->got_session_id ? "rekey" : "initial");
+        logevent_structured_field(le, "kex", "%s", s->kex_alg->name);
+        if (s->hostkey_alg)
+            logevent_structured_field(le, "hostkey", "%s",
+                                      s->hostkey_alg->ssh_id);
+        if (s->out.cipher)
+            logevent_structured_field(le, "cscipher", "%s",
+                                      s->out.cipher->ssh2_id);
+        if (s->in.cipher)
+            logevent_structured_field(le, "sccipher", "%s",
+                                      s->in.cipher->ssh2_id);
+        logevent_structured_emit(le);
+    }
+
     /*
      * The exchange hash from the very first key exchange is also
      * the session id, used in session key construction and
@@ -1559,6 +1646,9 @@ static void ssh2_transport_process_queue(PacketProtocolLayer *ppl)
     s->last_rekey = GETTICKCOUNT();
     (void) ssh2_transport_timer_update(s, 0);
 
+    if (!s->higher_layer_ok)
+        log_startup_phase(s->ppl.logctx, "key exchange");
+
     /*
      * Now we're encrypting. Get the next-layer protocol started if it
      * hasn't already, and then sit here waiting for reasons to go
@@ -1842,7 +1932,7 @@ static void ssh2_transport_gss_update(struct ssh2_transport_state *s,
     PacketProtocolLayer *ppl = &s->ppl; /* for ppl_logevent */
     int gss_stat;
     time_t gss_cred_expiry;
-    unsigned long mins;
+    time_t now;
     Ssh_gss_buf gss_sndtok;
     Ssh_gss_buf gss_rcvtok;
     Ssh_gss_ctx gss_ctx;
@@ -1874,6 +1964,32 @@ static void ssh2_transport_gss_update(struct ssh2_transport_state *s,
         }
     }
 
+    /*
+     * The probe below costs a credential acquisition and a throwaway
+     * security context, which with Kerberos can mean a round trip to
+     * the KDC - hundreds of milliseconds on a slow link, paid at
+     * every rekey and every cache-check timer tick. Its results only
+     * change when time passes or the user's credential cache is
+     * refreshed, so rather than repeat it each time, reuse a recent
+     * probe's results: age the cached context lifetime and re-derive
+     * the status flags from it. A failed probe is cached too, so that
+     * an unreachable KDC doesn't stall every rekey.
+     */
+    now = time(NULL);
+    if (s->gss_probe_time != 0 &&
+        difftime(now, s->gss_probe_time) < GSS_PROBE_INTERVAL) {
+        if (!s->gss_probe_ok)
+            return;
+        if (s->gss_ctxt_expires_at != GSS_NO_EXPIRATION)
+            s->gss_ctxt_lifetime =
+                (difftime(s->gss_ctxt_expires_at, now) > 0 ?
+                 (unsigned long)difftime(s->gss_ctxt_expires_at, now) : 0);
+        ssh2_transport_gss_derive_status(s, s->gss_probe_cred_expiry);
+        return;
+    }
+    s->gss_probe_time = now;
+    s->gss_probe_ok = false;
+
     /*
      * Do we (still) have credentials? Capture the credential
      * expiration when available
@@ -1919,6 +2035,24 @@ static void ssh2_transport_gss_update(struct ssh2_transport_state *s,
     if (gss_sndtok.length)
         s->shgss->lib->free_tok(s->shgss->lib, &gss_sndtok);
 
+    s->gss_probe_ok = true;
+    s->gss_probe_cred_expiry = gss_cred_expiry;
+    s->gss_ctxt_expires_at =
+        (s->gss_ctxt_lifetime == ULONG_MAX ? GSS_NO_EXPIRATION :
+         time(NULL) + (time_t)s->gss_ctxt_lifetime);
+
+    ssh2_transport_gss_derive_status(s, gss_cred_expiry);
+}
+
+/*
+ * Translate the results of a GSS probe (whether cached or fresh) into
+ * the gss_status flags that the rekey machinery consumes.
+ */
+static void ssh2_transport_gss_derive_status(struct ssh2_transport_state *s,
+                                             time_t gss_cred_expiry)
+{
+    unsigned long mins;
+
     s->gss_status |= GSS_KEX_CAPABLE;
 
     /*
@@ -9,6 +9,7 @@
 #include "gssc.h"
 #include "gss.h"
 #define MIN_CTXT_LIFETIME 5     /* Avoid rekey with short lifetime (seconds) */
+#define GSS_PROBE_INTERVAL 60   /* Reuse a GSS probe's results this long (s) */
 #define GSS_KEX_CAPABLE (1<<0)  /* Can do GSS KEX */
 #define GSS_CRED_UPDATED (1<<1) /* Cred updated since previous delegation */
 #define GSS_CTXT_EXPIRES (1<<2) /* Context expires before next timer */
@@ -18,7 +19,7 @@
 #define DH_MIN_SIZE 1024
 #define DH_MAX_SIZE 8192
 
-#define MAXKEXLIST 16
+#define MAXKEXLIST 24
 struct kexinit_algorithm {
     const char *name;
     union {
@@ -119,6 +120,7 @@ struct ssh2_transport_state {
     IdempotentCallback ic_pq_out_higher;
 
     Conf *conf;
+    strbuf *comp_dict;                 /* preset compression dictionary */
     char *savedhost;
     int savedport;
     const char *rekey_reason;
@@ -160,6 +162,10 @@ struct ssh2_transport_state {
     int gss_status;
     time_t gss_cred_expiry;             /* Re-delegate if newer */
     unsigned long gss_ctxt_lifetime;    /* Re-delegate when short */
+    time_t gss_probe_time;              /* last full GSS probe; 0 = never */
+    bool gss_probe_ok;                  /* whether that probe succeeded */
+    time_t gss_probe_cred_expiry;       /* cred expiry it reported */
+    time_t gss_ctxt_expires_at;         /* absolute form of ctxt lifetime */
 #endif
     ssh_transient_hostkey_cache *thc;
 
@@ -180,6 +186,17 @@ struct ssh2_transport_state {
     RSAKey *rsa_kex_key;             /* for RSA kex */
     bool rsa_kex_key_needs_freeing;
     ecdh_key *ecdh_key;                     /* for ECDH kex */
+    /*
+     * A worker thread running one of the expensive computations in a
+     * key exchange, if the platform can provide one; see
+     * ssh2_kex_offload() in kex2-client.c. kex_worker_done is set by
+     * its completion callback, which also resumes this layer's
+     * coroutine.
+     */
+    WorkerThread *kex_worker;
+    bool kex_worker_done;
+    strbuf *sigblob; /* copy of the server's kex signature, again made
+                      * so that it outlives the packet it arrived in */
     unsigned char exchange_hash[MAX_HASH_LEN];
     bool can_gssapi_keyex;
     bool need_gss_transient_hostkey;
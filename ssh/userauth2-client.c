@@ -77,6 +77,7 @@ struct ssh2_userauth_state {
     size_t agent_keys_len;
     agent_key *agent_keys;
     size_t agent_key_index, agent_key_limit;
+    size_t agent_offers_outstanding;
     ptrlen agent_keyalg;
     unsigned signflags;
     int len;
@@ -106,6 +107,8 @@ static void ssh2_userauth_reconfigure(PacketProtocolLayer *ppl, Conf *conf);
 
 static void ssh2_userauth_agent_query(struct ssh2_userauth_state *, strbuf *);
 static void ssh2_userauth_agent_callback(void *, void *, int);
+static ptrlen ssh2_userauth_agent_keyalg(
+    struct ssh2_userauth_state *s, size_t index, unsigned *signflags);
 static void ssh2_userauth_add_sigblob(
     struct ssh2_userauth_state *s, PktOut *pkt, ptrlen pkblob, ptrlen sigblob);
 static void ssh2_userauth_add_session_id(
@@ -205,6 +208,29 @@ static void ssh2_userauth_free(PacketProtocolLayer *ppl)
     sfree(s);
 }
 
+/*
+ * Name of the authentication method most recently attempted, in the
+ * form used on the wire, for structured log events.
+ */
+static const char *ssh2_userauth_method_name(struct ssh2_userauth_state *s)
+{
+    switch (s->type) {
+      case AUTH_TYPE_PUBLICKEY:
+      case AUTH_TYPE_PUBLICKEY_OFFER_LOUD:
+      case AUTH_TYPE_PUBLICKEY_OFFER_QUIET:
+        return "publickey";
+      case AUTH_TYPE_PASSWORD:
+        return "password";
+      case AUTH_TYPE_GSSAPI:
+        return "gssapi-with-mic";
+      case AUTH_TYPE_KEYBOARD_INTERACTIVE:
+      case AUTH_TYPE_KEYBOARD_INTERACTIVE_QUIET:
+        return "keyboard-interactive";
+      default:
+        return "none";
+    }
+}
+
 static void ssh2_userauth_filter_queue(struct ssh2_userauth_state *s)
 {
     PktIn *pktin;
@@ -247,6 +273,33 @@ static PktIn *ssh2_userauth_pop(struct ssh2_userauth_state *s)
     return pq_pop(s->ppl.in_pq);
 }
 
+/*
+ * Decide what algorithm name to offer an agent key under, upgrading
+ * bare ssh-rsa to one of the rsa-sha2-* family if the server has
+ * announced support for them, and optionally return the matching
+ * agent signing-flags word.
+ */
+static ptrlen ssh2_userauth_agent_keyalg(
+    struct ssh2_userauth_state *s, size_t index, unsigned *signflags)
+{
+    ptrlen keyalg = s->agent_keys[index].algorithm;
+    unsigned flags = 0;
+
+    if (ptrlen_eq_string(keyalg, "ssh-rsa")) {
+        if (s->ppl.bpp->ext_info_rsa_sha512_ok) {
+            keyalg = PTRLEN_LITERAL("rsa-sha2-512");
+            flags = SSH_AGENT_RSA_SHA2_512;
+        } else if (s->ppl.bpp->ext_info_rsa_sha256_ok) {
+            keyalg = PTRLEN_LITERAL("rsa-sha2-256");
+            flags = SSH_AGENT_RSA_SHA2_256;
+        }
+    }
+
+    if (signflags)
+        *signflags = flags;
+    return keyalg;
+}
+
 static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
 {
     struct ssh2_userauth_state *s =
@@ -487,6 +540,7 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
         s->tried_pubkey_config = false;
         s->kbd_inter_refused = false;
         s->done_agent = false;
+        s->agent_offers_outstanding = 0;
 
         while (1) {
             /*
@@ -548,6 +602,16 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
 
             if (pktin && pktin->type == SSH2_MSG_USERAUTH_SUCCESS) {
                 ppl_logevent("Access granted");
+                log_startup_phase(s->ppl.logctx, "user authentication");
+                {
+                    LogStructuredEvent *le = logevent_structured_start(
+                        s->ppl.logctx, LOGEV_AUTH_SUCCESS);
+                    logevent_structured_field(le, "username", "%s",
+                                              s->username);
+                    logevent_structured_field(
+                        le, "method", "%s", ssh2_userauth_method_name(s));
+                    logevent_structured_emit(le);
+                }
                 goto userauth_success;
             }
 
@@ -571,6 +635,23 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
                 ptrlen methods = get_string(pktin);
                 bool partial_success = get_bool(pktin);
 
+                /* The initial no-op "none" attempt is expected to
+                 * fail, so don't report it as a structured event any
+                 * more than the Event Log mentions it. */
+                if (s->type != AUTH_TYPE_NONE) {
+                    LogStructuredEvent *le = logevent_structured_start(
+                        s->ppl.logctx, LOGEV_AUTH_FAILURE);
+                    logevent_structured_field(le, "username", "%s",
+                                              s->username);
+                    logevent_structured_field(
+                        le, "method", "%s", ssh2_userauth_method_name(s));
+                    logevent_structured_field(le, "partial", "%s",
+                                              partial_success ? "yes" : "no");
+                    logevent_structured_field(le, "methods-remaining",
+                                              "%.*s", PTRLEN_PRINTF(methods));
+                    logevent_structured_emit(le);
+                }
+
                 if (!partial_success) {
                     /*
                      * We have received an unequivocal Access
@@ -686,6 +767,26 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
 
             s->ppl.bpp->pls->actx = SSH2_PKTCTX_NOAUTH;
 
+            /*
+             * If we've stopped trying agent keys early (say, because
+             * the server stopped offering the publickey method)
+             * while some of our batched key offers below were still
+             * unanswered, consume those answers now, so that they
+             * can't be mistaken for responses to later requests.
+             */
+            if (s->agent_offers_outstanding &&
+                !(s->can_pubkey && !s->done_agent &&
+                  s->agent_key_index < s->agent_key_limit)) {
+                while (s->agent_offers_outstanding) {
+                    crMaybeWaitUntilV((pktin = ssh2_userauth_pop(s)) != NULL);
+                    if (pktin->type == SSH2_MSG_USERAUTH_SUCCESS) {
+                        pq_push_front(s->ppl.in_pq, pktin);
+                        break;
+                    }
+                    s->agent_offers_outstanding--;
+                }
+            }
+
 #ifndef NO_GSSAPI
             if (s->can_gssapi_keyex_auth && !s->tried_gssapi_keyex_auth) {
 
@@ -712,41 +813,56 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
                 s->agent_key_index < s->agent_key_limit) {
 
                 /*
-                 * Attempt public-key authentication using a key from Pageant.
+                 * Attempt public-key authentication using keys from
+                 * Pageant.
                  */
-                s->agent_keyalg = s->agent_keys[s->agent_key_index].algorithm;
-                s->signflags = 0;
-                if (ptrlen_eq_string(s->agent_keyalg, "ssh-rsa")) {
-                    /* Try to upgrade ssh-rsa to one of the rsa-sha2-* family,
-                     * if the server has announced support for them. */
-                    if (s->ppl.bpp->ext_info_rsa_sha512_ok) {
-                        s->agent_keyalg = PTRLEN_LITERAL("rsa-sha2-512");
-                        s->signflags = SSH_AGENT_RSA_SHA2_512;
-                    } else if (s->ppl.bpp->ext_info_rsa_sha256_ok) {
-                        s->agent_keyalg = PTRLEN_LITERAL("rsa-sha2-256");
-                        s->signflags = SSH_AGENT_RSA_SHA2_256;
-                    }
-                }
-
                 s->ppl.bpp->pls->actx = SSH2_PKTCTX_PUBLICKEY;
 
-                ppl_logevent("Trying Pageant key #%"SIZEu, s->agent_key_index);
+                if (!s->agent_offers_outstanding) {
+                    /*
+                     * Offer all the keys we're prepared to try in a
+                     * single flight, instead of waiting out a full
+                     * network round trip per key before offering the
+                     * next one. RFC 4252 section 4 explicitly
+                     * permits sending further requests without
+                     * waiting for responses to previous ones, and
+                     * requires the server to respond to every
+                     * request in order, so each response we receive
+                     * below refers to the next key we offered.
+                     */
+                    for (size_t i = s->agent_key_index;
+                         i < s->agent_key_limit; i++) {
+                        ptrlen keyalg = ssh2_userauth_agent_keyalg(
+                            s, i, NULL);
+
+                        ppl_logevent("Offering Pageant key #%"SIZEu, i);
+
+                        s->pktout = ssh_bpp_new_pktout(
+                            s->ppl.bpp, SSH2_MSG_USERAUTH_REQUEST);
+                        put_stringz(s->pktout, s->username);
+                        put_stringz(s->pktout, s->successor_layer->vt->name);
+                        put_stringz(s->pktout, "publickey");
+                                                            /* method */
+                        put_bool(s->pktout, false);
+                                            /* no signature included */
+                        put_stringpl(s->pktout, keyalg);
+                        put_stringpl(s->pktout, ptrlen_from_strbuf(
+                                    s->agent_keys[i].blob));
+                        pq_push(s->ppl.out_pq, s->pktout);
+                        s->agent_offers_outstanding++;
+                    }
+                }
 
-                /* See if server will accept it */
-                s->pktout = ssh_bpp_new_pktout(
-                    s->ppl.bpp, SSH2_MSG_USERAUTH_REQUEST);
-                put_stringz(s->pktout, s->username);
-                put_stringz(s->pktout, s->successor_layer->vt->name);
-                put_stringz(s->pktout, "publickey");
-                                                    /* method */
-                put_bool(s->pktout, false); /* no signature included */
-                put_stringpl(s->pktout, s->agent_keyalg);
-                put_stringpl(s->pktout, ptrlen_from_strbuf(
-                            s->agent_keys[s->agent_key_index].blob));
-                pq_push(s->ppl.out_pq, s->pktout);
+                /* The response we're about to receive refers to the
+                 * current key, so recompute that key's algorithm
+                 * name and signing flags, ready for use if the key
+                 * is accepted. */
+                s->agent_keyalg = ssh2_userauth_agent_keyalg(
+                    s, s->agent_key_index, &s->signflags);
                 s->type = AUTH_TYPE_PUBLICKEY_OFFER_QUIET;
 
                 crMaybeWaitUntilV((pktin = ssh2_userauth_pop(s)) != NULL);
+                s->agent_offers_outstanding--;
                 if (pktin->type != SSH2_MSG_USERAUTH_PK_OK) {
 
                     /* Offer of key refused, presumably via
@@ -827,6 +943,34 @@ static void ssh2_userauth_process_queue(PacketProtocolLayer *ppl)
                         s->suppress_wait_for_response_packet = true;
                         ssh_free_pktout(s->pktout);
                     }
+
+                    /*
+                     * If we'd offered further keys beyond this one,
+                     * the server will still respond to those offers
+                     * before it answers the signed request we've
+                     * just sent, because it answers requests
+                     * strictly in order. Drain those responses now,
+                     * so that the next packet the main loop sees is
+                     * the one for the signature. (If Pageant failed
+                     * to sign, we instead leave the outstanding
+                     * responses where they are: they'll be consumed
+                     * as the responses to the remaining keys' offers
+                     * on subsequent iterations.)
+                     */
+                    while (s->type == AUTH_TYPE_PUBLICKEY &&
+                           s->agent_offers_outstanding) {
+                        crMaybeWaitUntilV(
+                            (pktin = ssh2_userauth_pop(s)) != NULL);
+                        if (pktin->type == SSH2_MSG_USERAUTH_SUCCESS) {
+                            /* Shouldn't happen in response to an
+                             * unsigned offer, but if a server does
+                             * something that strange, don't lose the
+                             * message. */
+                            pq_push_front(s->ppl.in_pq, pktin);
+                            break;
+                        }
+                        s->agent_offers_outstanding--;
+                    }
                 }
 
                 /* Do we have any keys left to try? */
@@ -380,6 +380,7 @@ void ssh_verstring_handle_input(BinaryPacketProtocol *bpp)
     }
 
     bpp_logevent("Using SSH protocol version %d", s->major_protoversion);
+    log_startup_phase(s->bpp.logctx, "version exchange");
 
     if (!s->send_early) {
         /*
@@ -17,6 +17,16 @@ struct XDMSeen {
     unsigned char clientid[6];
 };
 
+/*
+ * Chatty X11 clients and servers produce floods of tiny messages, so
+ * instead of paying SSH packet framing and crypto per socket read, we
+ * coalesce the data read from the X server and flush it down the SSH
+ * channel once a decent amount has accumulated, or after a short
+ * bounded delay, whichever comes first.
+ */
+#define X11_COALESCE_LIMIT 4096
+#define X11_COALESCE_DELAY (TICKSPERSEC / 200)   /* 5ms */
+
 typedef struct X11Connection {
     unsigned char firstpkt[12];        /* first X data packet */
     tree234 *authtree;
@@ -32,6 +42,11 @@ typedef struct X11Connection {
     SshChannel *c;               /* channel structure held by SSH backend */
     Socket *s;
 
+    /* Data read from the X server but not yet sent on the channel. */
+    bufchain to_channel;
+    bool flush_pending;
+    unsigned long flush_time;
+
     Plug plug;
     Channel chan;
 } X11Connection;
@@ -266,6 +281,7 @@ static void x11_log(Plug *p, PlugLogType type, SockAddr *addr, int port,
 
 static void x11_send_init_error(struct X11Connection *conn,
                                 const char *err_message);
+static void x11_flush(struct X11Connection *xconn);
 
 static void x11_closing(Plug *plug, const char *error_msg, int error_code,
                         bool calling_back)
@@ -287,17 +303,39 @@ static void x11_closing(Plug *plug, const char *error_msg, int error_code,
 
         /*
          * Whether we did that or not, now we slam the connection
-         * shut.
+         * shut. (Flushing first, so that anything the X server said
+         * just before the error isn't lost.)
          */
+        x11_flush(xconn);
         sshfwd_initiate_close(xconn->c, error_msg);
     } else {
         /*
          * Ordinary EOF received on socket. Send an EOF on the SSH
          * channel.
          */
-        if (xconn->c)
+        if (xconn->c) {
+            x11_flush(xconn);
             sshfwd_write_eof(xconn->c);
+        }
+    }
+}
+
+static void x11_flush(struct X11Connection *xconn)
+{
+    while (bufchain_size(&xconn->to_channel) > 0) {
+        ptrlen data = bufchain_prefix(&xconn->to_channel);
+        sshfwd_write(xconn->c, data.ptr, data.len);
+        bufchain_consume(&xconn->to_channel, data.len);
     }
+    xconn->flush_pending = false;
+}
+
+static void x11_flush_timer(void *ctx, unsigned long now)
+{
+    struct X11Connection *xconn = (struct X11Connection *)ctx;
+
+    if (xconn->flush_pending && now == xconn->flush_time)
+        x11_flush(xconn);
 }
 
 static void x11_receive(Plug *plug, int urgent, const char *data, size_t len)
@@ -306,7 +344,14 @@ static void x11_receive(Plug *plug, int urgent, const char *data, size_t len)
         plug, struct X11Connection, plug);
 
     xconn->no_data_sent_to_x_client = false;
-    sshfwd_write(xconn->c, data, len);
+    bufchain_add(&xconn->to_channel, data, len);
+    if (bufchain_size(&xconn->to_channel) >= X11_COALESCE_LIMIT) {
+        x11_flush(xconn);
+    } else if (!xconn->flush_pending) {
+        xconn->flush_pending = true;
+        xconn->flush_time = schedule_timer(X11_COALESCE_DELAY,
+                                           x11_flush_timer, xconn);
+    }
 }
 
 static void x11_sent(Plug *plug, size_t bufsize)
@@ -381,6 +426,8 @@ Channel *x11_new_channel(tree234 *authtree, SshChannel *c,
     xconn->input_wanted = true;
     xconn->no_data_sent_to_x_client = true;
     xconn->c = c;
+    bufchain_init(&xconn->to_channel);
+    xconn->flush_pending = false;
 
     /*
      * We don't actually open a local socket to the X server just yet,
@@ -415,6 +462,9 @@ static void x11_chan_free(Channel *chan)
     if (xconn->s)
         sk_close(xconn->s);
 
+    bufchain_clear(&xconn->to_channel);
+    expire_timer_context(xconn);
+
     sfree(xconn->peer_addr);
     sfree(xconn);
 }
@@ -628,8 +678,10 @@ static void x11_send_eof(Channel *chan)
          * should send an EOF back to the client so that the
          * forwarded channel will be terminated.
          */
-        if (xconn->c)
+        if (xconn->c) {
+            x11_flush(xconn);
             sshfwd_write_eof(xconn->c);
+        }
     }
 }
 
@@ -56,6 +56,16 @@ struct LZ77Context {
     void *userdata;
     void (*literal) (struct LZ77Context * ctx, unsigned char c);
     void (*match) (struct LZ77Context * ctx, int distance, int len);
+
+    /*
+     * Effort controls, also set up by the user. 'maxchain' limits how
+     * many hash chain entries we'll examine at each position; 'lazy'
+     * selects whether a match can be deferred for one byte in the
+     * hope of finding a longer one starting there (as gzip's lazy
+     * matching does), or is always emitted as soon as it's found.
+     */
+    int maxchain;
+    bool lazy;
 };
 
 /*
@@ -78,7 +88,6 @@ static void lz77_compress(struct LZ77Context *ctx,
  */
 #define WINSIZE 32768                  /* window size. Must be power of 2! */
 #define HASHMAX 2039                   /* one more than max hash value */
-#define MAXMATCH 32                    /* how many matches we track */
 #define HASHCHARS 3                    /* how many chars make a hash */
 
 /*
@@ -175,12 +184,60 @@ static void lz77_advance(struct LZ77InternalContext *st,
 
 #define CHARAT(k) ( (k)<0 ? st->data[(st->winpos+k)&(WINSIZE-1)] : data[k] )
 
+/*
+ * Find the length of the match between the incoming data and the text
+ * starting 'distance' bytes behind the current position, up to a
+ * maximum of 'len'. (We never need a match longer than the input we
+ * currently have to encode.)
+ */
+static int lz77_match_length(struct LZ77InternalContext *st,
+                             const unsigned char *data, int len,
+                             int distance)
+{
+    int i = 0;
+
+    /*
+     * For the first 'distance' bytes of the match, the text we're
+     * comparing against lives in the stored window, so fetch it a
+     * byte at a time (it may wrap round the circular buffer).
+     */
+    while (i < len && i < distance &&
+           data[i] == st->data[(st->winpos + i - distance) & (WINSIZE - 1)])
+        i++;
+    if (i < distance || i == len)
+        return i;
+
+    /*
+     * If the match has survived for 'distance' bytes, then from here
+     * on we're comparing the input data against itself, so we can
+     * compare a word at a time. (The two ranges overlap whenever the
+     * match outruns its own distance - the traditional LZ77 way to
+     * encode a repeating run - but that doesn't need any special
+     * handling, because we load both words afresh from memory each
+     * time round this loop.)
+     */
+    while (i + 8 <= len) {
+        uint64_t a = GET_64BIT_LSB_FIRST(data + i);
+        uint64_t b = GET_64BIT_LSB_FIRST(data + i - distance);
+        if (a != b) {
+            /* Count how many low-order bytes of the words agreed. */
+            for (uint64_t diff = a ^ b; !(diff & 0xFF); diff >>= 8)
+                i++;
+            return i;
+        }
+        i += 8;
+    }
+    while (i < len && data[i] == data[i - distance])
+        i++;
+    return i;
+}
+
 static void lz77_compress(struct LZ77Context *ctx,
                           const unsigned char *data, int len)
 {
     struct LZ77InternalContext *st = ctx->ictx;
-    int i, distance, off, nmatch, matchlen, advance;
-    struct Match defermatch, matches[MAXMATCH];
+    int i, distance, off, matchlen, advance;
+    struct Match defermatch, bestmatch;
     int deferchr;
 
     assert(st->npending <= HASHCHARS);
@@ -222,64 +279,65 @@ static void lz77_compress(struct LZ77Context *ctx,
             int hash = lz77_hash(data);
 
             /*
-             * Look the hash up in the corresponding hash chain and see
-             * what we can find.
+             * Look the hash up in the corresponding hash chain, and
+             * find the longest match among the positions on it (up to
+             * the configured chain-length limit). Chain entries
+             * nearer the head are more recent, so by insisting on a
+             * strict improvement before switching candidate, we
+             * favour the shortest distance among equally long
+             * matches.
              */
-            nmatch = 0;
+            int chainlen = ctx->maxchain;
+            bestmatch.distance = 0;
+            bestmatch.len = 0;
             for (off = st->hashtab[hash].first;
-                 off != INVALID; off = st->win[off].next) {
+                 off != INVALID && chainlen-- > 0;
+                 off = st->win[off].next) {
                 /* distance = 1       if off == st->winpos-1 */
                 /* distance = WINSIZE if off == st->winpos   */
                 distance =
                     WINSIZE - (off + WINSIZE - st->winpos) % WINSIZE;
-                for (i = 0; i < HASHCHARS; i++)
-                    if (CHARAT(i) != CHARAT(i - distance))
-                        break;
-                if (i == HASHCHARS) {
-                    matches[nmatch].distance = distance;
-                    matches[nmatch].len = 3;
-                    if (++nmatch >= MAXMATCH)
-                        break;
+
+                /*
+                 * For this candidate to be an improvement, it must
+                 * match at least one byte more than the current best,
+                 * so check the byte in that critical position first,
+                 * which rejects most losing candidates with a single
+                 * comparison.
+                 */
+                if (bestmatch.len > 0 &&
+                    CHARAT(bestmatch.len) != CHARAT(bestmatch.len - distance))
+                    continue;
+
+                matchlen = lz77_match_length(st, data, len, distance);
+                if (matchlen >= HASHCHARS && matchlen > bestmatch.len) {
+                    bestmatch.distance = distance;
+                    bestmatch.len = matchlen;
+                    if (bestmatch.len == len)
+                        break;         /* no point looking further */
                 }
             }
         } else {
-            nmatch = 0;
+            bestmatch.len = 0;
         }
 
-        if (nmatch > 0) {
+        if (bestmatch.len > 0) {
             /*
-             * We've now filled up matches[] with nmatch potential
-             * matches. Follow them down to find the longest. (We
-             * assume here that it's always worth favouring a
-             * longer match over a shorter one.)
+             * We've got a match. See if we want to emit, defer or
+             * throw it away. (We assume here that it's always worth
+             * favouring a longer match over a shorter one.)
              */
-            matchlen = HASHCHARS;
-            while (matchlen < len) {
-                int j;
-                for (i = j = 0; i < nmatch; i++) {
-                    if (CHARAT(matchlen) ==
-                        CHARAT(matchlen - matches[i].distance)) {
-                        matches[j++] = matches[i];
-                    }
-                }
-                if (j == 0)
-                    break;
-                matchlen++;
-                nmatch = j;
-            }
-
-            /*
-             * We've now got all the longest matches. We favour the
-             * shorter distances, which means we go with matches[0].
-             * So see if we want to defer it or throw it away.
-             */
-            matches[0].len = matchlen;
-            if (defermatch.len > 0) {
-                if (matches[0].len > defermatch.len + 1) {
+            if (!ctx->lazy) {
+                /* In greedy mode, emit every match as soon as it's
+                 * found. */
+                ctx->match(ctx, bestmatch.distance, bestmatch.len);
+                advance = bestmatch.len;
+            } else if (defermatch.len > 0) {
+                if (bestmatch.len > defermatch.len + 1) {
                     /* We have a better match. Emit the deferred char,
                      * and defer this match. */
                     ctx->literal(ctx, (unsigned char) deferchr);
-                    defermatch = matches[0];
+                    defermatch = bestmatch;
                     deferchr = data[0];
                     advance = 1;
                 } else {
@@ -290,7 +348,7 @@ static void lz77_compress(struct LZ77Context *ctx,
                 }
             } else {
                 /* There was no deferred match. Defer this one. */
-                defermatch = matches[0];
+                defermatch = bestmatch;
                 deferchr = data[0];
                 advance = 1;
             }
@@ -327,6 +385,38 @@ static void lz77_compress(struct LZ77Context *ctx,
     }
 }
 
+static void lz77_literal_discard(struct LZ77Context *ctx, unsigned char c)
+{
+}
+
+static void lz77_match_discard(struct LZ77Context *ctx, int distance, int len)
+{
+}
+
+/*
+ * Prime the compressor's sliding window with a preset dictionary:
+ * feed the data through the ordinary compression machinery with the
+ * output callbacks swapped for no-ops, so the window contents and
+ * hash chains end up exactly as if the dictionary had been
+ * compressed, but nothing is emitted. (Matches are only ever
+ * searched for once any pending bytes from a previous call have been
+ * flushed into the window, so distances computed for real data after
+ * priming agree with a decompressor whose window holds the same
+ * dictionary.)
+ */
+static void lz77_prime(struct LZ77Context *ctx,
+                       const unsigned char *data, int len)
+{
+    void (*literal)(struct LZ77Context *ctx, unsigned char c) = ctx->literal;
+    void (*match)(struct LZ77Context *ctx, int distance, int len) = ctx->match;
+
+    ctx->literal = lz77_literal_discard;
+    ctx->match = lz77_match_discard;
+    lz77_compress(ctx, data, len);
+    ctx->literal = literal;
+    ctx->match = match;
+}
+
 /* ----------------------------------------------------------------------
  * Zlib compression. We always use the static Huffman tree option.
  * Mostly this is because it's hard to scan a block in advance to
@@ -573,7 +663,7 @@ struct ssh_zlib_compressor {
     ssh_compressor sc;
 };
 
-ssh_compressor *zlib_compress_init(void)
+ssh_compressor *zlib_compress_init(int level)
 {
     struct Outbuf *out;
     struct ssh_zlib_compressor *comp = snew(struct ssh_zlib_compressor);
@@ -583,6 +673,28 @@ ssh_compressor *zlib_compress_init(void)
     comp->ectx.literal = zlib_literal;
     comp->ectx.match = zlib_match;
 
+    /*
+     * Translate the configured effort level into LZ77 search
+     * parameters. Level 2 matches this compressor's historical
+     * behaviour, and is what any unrecognised value falls back to;
+     * level 1 trades compression ratio for speed, and level 3 the
+     * other way round.
+     */
+    switch (level) {
+      case 1:
+        comp->ectx.maxchain = 8;
+        comp->ectx.lazy = false;
+        break;
+      case 3:
+        comp->ectx.maxchain = 256;
+        comp->ectx.lazy = true;
+        break;
+      default:
+        comp->ectx.maxchain = 32;
+        comp->ectx.lazy = true;
+        break;
+    }
+
     out = snew(struct Outbuf);
     out->outbuf = NULL;
     out->outbits = out->noutbits = 0;
@@ -592,6 +704,19 @@ ssh_compressor *zlib_compress_init(void)
     return &comp->sc;
 }
 
+static void zlib_compress_prime(ssh_compressor *sc, ptrlen dict)
+{
+    struct ssh_zlib_compressor *comp =
+        container_of(sc, struct ssh_zlib_compressor, sc);
+
+    /* Only the last window's worth of the dictionary can ever be
+     * referenced, so skip anything before that. */
+    if (dict.len > WINSIZE)
+        dict = make_ptrlen((const char *)dict.ptr + (dict.len - WINSIZE),
+                           WINSIZE);
+    lz77_prime(&comp->ectx, dict.ptr, dict.len);
+}
+
 void zlib_compress_cleanup(ssh_compressor *sc)
 {
     struct ssh_zlib_compressor *comp =
@@ -899,6 +1024,11 @@ struct zlib_decompress_ctx {
     int nbits;
     unsigned char window[WINSIZE];
     int winpos;
+    /*
+     * Persistent output buffer, reused (retaining its allocation)
+     * for every packet this decompressor inflates. The caller
+     * borrows its contents until the next decompress call.
+     */
     strbuf *outblk;
 
     ssh_decompressor dc;
@@ -921,12 +1051,34 @@ ssh_decompressor *zlib_decompress_init(void)
     dctx->bits = 0;
     dctx->nbits = 0;
     dctx->winpos = 0;
-    dctx->outblk = NULL;
+    dctx->outblk = strbuf_new_nm();
 
     dctx->dc.vt = &ssh_zlib;
     return &dctx->dc;
 }
 
+static void zlib_decompress_prime(ssh_decompressor *dc, ptrlen dict)
+{
+    struct zlib_decompress_ctx *dctx =
+        container_of(dc, struct zlib_decompress_ctx, dc);
+    const unsigned char *p = (const unsigned char *)dict.ptr;
+    size_t len = dict.len;
+
+    /* Fill the window with the tail of the dictionary, as if those
+     * bytes had been emitted, but without adding them to the output
+     * block. This mirrors what zlib_compress_prime does to the
+     * compressor's window, so match distances referring back into
+     * the dictionary resolve to the same bytes at both ends. */
+    if (len > WINSIZE) {
+        p += len - WINSIZE;
+        len = WINSIZE;
+    }
+    while (len-- > 0) {
+        dctx->window[dctx->winpos] = *p++;
+        dctx->winpos = (dctx->winpos + 1) & (WINSIZE - 1);
+    }
+}
+
 void zlib_decompress_cleanup(ssh_decompressor *dc)
 {
     struct zlib_decompress_ctx *dctx =
@@ -940,8 +1092,7 @@ void zlib_decompress_cleanup(ssh_decompressor *dc)
         zlib_freetable(&dctx->lenlentable);
     zlib_freetable(&dctx->staticlentable);
     zlib_freetable(&dctx->staticdisttable);
-    if (dctx->outblk)
-        strbuf_free(dctx->outblk);
+    strbuf_free(dctx->outblk);
     sfree(dctx);
 }
 
@@ -984,6 +1135,33 @@ static void zlib_emit_char(struct zlib_decompress_ctx *dctx, int c)
     put_byte(dctx->outblk, c);
 }
 
+/*
+ * Emit a whole LZ77 match run, copying it within the circular window
+ * in the largest contiguous chunks possible rather than a byte at a
+ * time. Each chunk is capped at 'dist' bytes so that an overlapped
+ * match (dist < len) replicates its source progressively, just as
+ * the byte loop would; memmove covers the remaining case where the
+ * chunk's source and destination ranges abut around the window
+ * boundary.
+ */
+static void zlib_emit_run(struct zlib_decompress_ctx *dctx, int dist, int len)
+{
+    while (len > 0) {
+        int srcpos = (dctx->winpos - dist) & (WINSIZE - 1);
+        int n = len;
+        if (n > dist)
+            n = dist;
+        if (n > WINSIZE - srcpos)
+            n = WINSIZE - srcpos;
+        if (n > WINSIZE - dctx->winpos)
+            n = WINSIZE - dctx->winpos;
+        memmove(dctx->window + dctx->winpos, dctx->window + srcpos, n);
+        put_data(dctx->outblk, dctx->window + dctx->winpos, n);
+        dctx->winpos = (dctx->winpos + n) & (WINSIZE - 1);
+        len -= n;
+    }
+}
+
 #define EATBITS(n) ( dctx->nbits -= (n), dctx->bits >>= (n) )
 
 bool zlib_decompress_block(ssh_decompressor *dc,
@@ -998,8 +1176,7 @@ bool zlib_decompress_block(ssh_decompressor *dc,
         16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
     };
 
-    assert(!dctx->outblk);
-    dctx->outblk = strbuf_new_nm();
+    strbuf_clear(dctx->outblk);
 
     while (len > 0 || dctx->nbits > 0) {
         while (dctx->nbits < 24 && len > 0) {
@@ -1186,9 +1363,7 @@ bool zlib_decompress_block(ssh_decompressor *dc,
             dist = rec->min + (dctx->bits & ((1 << rec->extrabits) - 1));
             EATBITS(rec->extrabits);
             dctx->state = INBLK;
-            while (dctx->len--)
-                zlib_emit_char(dctx, dctx->window[(dctx->winpos - dist) &
-                                                  (WINSIZE - 1)]);
+            zlib_emit_run(dctx, dist, dctx->len);
             break;
           case UNCOMP_LEN:
             /*
@@ -1230,8 +1405,7 @@ bool zlib_decompress_block(ssh_decompressor *dc,
 
   finished:
     *outlen = dctx->outblk->len;
-    *outblock = (unsigned char *)strbuf_to_str(dctx->outblk);
-    dctx->outblk = NULL;
+    *outblock = dctx->outblk->u;
     return true;
 
   decode_error:
@@ -1251,3 +1425,260 @@ const ssh_compression_alg ssh_zlib = {
     .decompress = zlib_decompress_block,
     .text_name = "zlib (RFC1950)",
 };
+
+/*
+ * Variant of the same compressor whose streams start with both ends'
+ * windows primed with a preset dictionary, so that repetitive
+ * session content matches against the dictionary from the first
+ * packet. The wire format is ordinary zlib; what differs is the
+ * initial window state, which is why this lives under a private
+ * algorithm name that each side only offers when it has a dictionary
+ * configured - the dictionary itself is never transmitted or
+ * verified, so both ends must be set up with the same one.
+ */
+static ssh_compressor *zlib_dict_compress_init(int level)
+{
+    ssh_compressor *c = zlib_compress_init(level);
+    c->vt = &ssh_zlib_dict;
+    return c;
+}
+
+static ssh_decompressor *zlib_dict_decompress_init(void)
+{
+    ssh_decompressor *d = zlib_decompress_init();
+    d->vt = &ssh_zlib_dict;
+    return d;
+}
+
+const ssh_compression_alg ssh_zlib_dict = {
+    .name = "zlib-dict@putty.projects.tartarus.org",
+    .delayed_name = "zlib-dict-delayed@putty.projects.tartarus.org",
+    .compress_new = zlib_dict_compress_init,
+    .compress_free = zlib_compress_cleanup,
+    .compress = zlib_compress_block,
+    .decompress_new = zlib_dict_decompress_init,
+    .decompress_free = zlib_decompress_cleanup,
+    .decompress = zlib_decompress_block,
+    .compress_prime = zlib_compress_prime,
+    .decompress_prime = zlib_decompress_prime,
+    .text_name = "zlib (RFC1950) with preset dictionary",
+};
+
+/* ----------------------------------------------------------------------
+ * Further variant which gives each SSH-2 channel its own independent
+ * zlib stream. Ordinary SSH compression is connection-wide, so a
+ * burst of incompressible bulk data (an SFTP upload, say) evicts from
+ * the 32kB window all the repetitive content that an interactive
+ * channel on the same connection was benefiting from. Here the
+ * compressor inspects each outgoing packet: channel data is routed to
+ * a per-channel zlib context (identified on the wire by a one-byte
+ * selector prefixed to the compressed payload), and everything else
+ * to context 0, so each channel's dictionary reflects only its own
+ * traffic. The selector also has an escape value meaning the payload
+ * follows uncompressed, which the compressor switches a channel to
+ * for a while once its data has proved incompressible, saving the CPU
+ * cost of deflating it to no purpose.
+ *
+ * Each context's byte stream, reassembled across the packets carrying
+ * its selector, is an ordinary zlib stream, and the compressor's
+ * choices are all communicated in band, so the two sides can't
+ * disagree about state; but the framing differs from standard SSH
+ * zlib, so like the preset-dictionary variant this lives under a
+ * private algorithm name.
+ */
+
+#define PERCHAN_NCTX 8                 /* context 0 = non-channel packets */
+#define PERCHAN_SELECTOR_RAW 0xFF      /* payload is not compressed */
+
+/* Review a channel's compression ratio after this much input, and if
+ * it's saving us less than 1/16, pass the next PERCHAN_RAW_BYTES of
+ * that channel through uncompressed before probing again. */
+#define PERCHAN_PROBE_BYTES 32768
+#define PERCHAN_RAW_BYTES 262144
+
+struct zlib_perchannel_stream {
+    unsigned chan;                     /* channel id this context serves */
+    bool chan_valid;
+    unsigned long last_used;           /* for LRU reassignment */
+    uint64_t bytes_in, bytes_out;      /* since the last ratio decision */
+    size_t raw_left;                   /* bytes still to pass through raw */
+};
+
+struct zlib_perchannel_compressor {
+    ssh_compressor *ctx[PERCHAN_NCTX]; /* created lazily */
+    struct zlib_perchannel_stream stream[PERCHAN_NCTX];
+    unsigned long use_counter;
+    int level;
+    ssh_compressor sc;
+};
+
+static int zlib_perchannel_index(struct zlib_perchannel_compressor *comp,
+                                 const unsigned char *block, int len)
+{
+    unsigned chan;
+    int i, lru;
+
+    if (len < 5 || (block[0] != SSH2_MSG_CHANNEL_DATA &&
+                    block[0] != SSH2_MSG_CHANNEL_EXTENDED_DATA))
+        return 0;
+    chan = GET_32BIT_MSB_FIRST(block + 1);
+
+    for (i = 1; i < PERCHAN_NCTX; i++)
+        if (comp->stream[i].chan_valid && comp->stream[i].chan == chan)
+            return i;
+
+    /*
+     * No context for this channel yet: take a free one, or reassign
+     * the least recently used. Reassignment deliberately doesn't
+     * reset the underlying zlib context - the decompressor has no way
+     * to know it happened, and carrying the previous channel's window
+     * over is harmless, since both sides carry the same window.
+     */
+    lru = 1;
+    for (i = 1; i < PERCHAN_NCTX; i++) {
+        if (!comp->stream[i].chan_valid) {
+            lru = i;
+            break;
+        }
+        if (comp->stream[i].last_used < comp->stream[lru].last_used)
+            lru = i;
+    }
+    comp->stream[lru].chan_valid = true;
+    comp->stream[lru].chan = chan;
+    comp->stream[lru].bytes_in = comp->stream[lru].bytes_out = 0;
+    comp->stream[lru].raw_left = 0;
+    return lru;
+}
+
+static ssh_compressor *zlib_perchannel_compress_init(int level)
+{
+    struct zlib_perchannel_compressor *comp =
+        snew(struct zlib_perchannel_compressor);
+    memset(comp, 0, sizeof(*comp));
+    comp->level = level;
+    comp->sc.vt = &ssh_zlib_perchannel;
+    return &comp->sc;
+}
+
+static void zlib_perchannel_compress_cleanup(ssh_compressor *sc)
+{
+    struct zlib_perchannel_compressor *comp =
+        container_of(sc, struct zlib_perchannel_compressor, sc);
+    int i;
+    for (i = 0; i < PERCHAN_NCTX; i++)
+        if (comp->ctx[i])
+            zlib_compress_cleanup(comp->ctx[i]);
+    sfree(comp);
+}
+
+static void zlib_perchannel_compress_block(ssh_compressor *sc,
+                                           const unsigned char *block, int len,
+                                           unsigned char **outblock,
+                                           int *outlen, int minlen)
+{
+    struct zlib_perchannel_compressor *comp =
+        container_of(sc, struct zlib_perchannel_compressor, sc);
+    int i = zlib_perchannel_index(comp, block, len);
+    struct zlib_perchannel_stream *st = &comp->stream[i];
+    unsigned char *inner;
+    int innerlen;
+
+    st->last_used = ++comp->use_counter;
+
+    if (st->raw_left > 0 && len + 1 >= minlen) {
+        /* This channel's data has proved incompressible: pass it
+         * through. Raw packets bypass the zlib context entirely, on
+         * both sides, so the channel's dictionary stays intact for
+         * when we next probe. */
+        *outblock = snewn(len + 1, unsigned char);
+        (*outblock)[0] = PERCHAN_SELECTOR_RAW;
+        memcpy(*outblock + 1, block, len);
+        *outlen = len + 1;
+        st->raw_left -= ((size_t)len < st->raw_left ?
+                         (size_t)len : st->raw_left);
+        return;
+    }
+
+    if (!comp->ctx[i])
+        comp->ctx[i] = zlib_compress_init(comp->level);
+    zlib_compress_block(comp->ctx[i], block, len, &inner, &innerlen,
+                        minlen > 0 ? minlen - 1 : 0);
+    *outblock = snewn(innerlen + 1, unsigned char);
+    (*outblock)[0] = i;
+    memcpy(*outblock + 1, inner, innerlen);
+    *outlen = innerlen + 1;
+    sfree(inner);
+
+    st->bytes_in += len;
+    st->bytes_out += innerlen;
+    if (st->bytes_in >= PERCHAN_PROBE_BYTES) {
+        if (st->bytes_out * 16 > st->bytes_in * 15)
+            st->raw_left = PERCHAN_RAW_BYTES;
+        st->bytes_in = st->bytes_out = 0;
+    }
+}
+
+struct zlib_perchannel_decompressor {
+    ssh_decompressor *ctx[PERCHAN_NCTX]; /* created lazily */
+    ssh_decompressor dc;
+};
+
+static ssh_decompressor *zlib_perchannel_decompress_init(void)
+{
+    struct zlib_perchannel_decompressor *d =
+        snew(struct zlib_perchannel_decompressor);
+    memset(d, 0, sizeof(*d));
+    d->dc.vt = &ssh_zlib_perchannel;
+    return &d->dc;
+}
+
+static void zlib_perchannel_decompress_cleanup(ssh_decompressor *dc)
+{
+    struct zlib_perchannel_decompressor *d =
+        container_of(dc, struct zlib_perchannel_decompressor, dc);
+    int i;
+    for (i = 0; i < PERCHAN_NCTX; i++)
+        if (d->ctx[i])
+            zlib_decompress_cleanup(d->ctx[i]);
+    sfree(d);
+}
+
+static bool zlib_perchannel_decompress_block(ssh_decompressor *dc,
+                                             const unsigned char *block,
+                                             int len, unsigned char **outblock,
+                                             int *outlen)
+{
+    struct zlib_perchannel_decompressor *d =
+        container_of(dc, struct zlib_perchannel_decompressor, dc);
+    unsigned sel;
+
+    if (len < 1)
+        return false;
+    sel = block[0];
+
+    if (sel == PERCHAN_SELECTOR_RAW) {
+        *outlen = len - 1;
+        *outblock = snewn(*outlen ? *outlen : 1, unsigned char);
+        memcpy(*outblock, block + 1, *outlen);
+        return true;
+    }
+
+    if (sel >= PERCHAN_NCTX)
+        return false;
+    if (!d->ctx[sel])
+        d->ctx[sel] = zlib_decompress_init();
+    return zlib_decompress_block(d->ctx[sel], block + 1, len - 1,
+                                 outblock, outlen);
+}
+
+const ssh_compression_alg ssh_zlib_perchannel = {
+    .name = "zlib-perchannel@putty.projects.tartarus.org",
+    .delayed_name = "zlib-perchannel-delayed@putty.projects.tartarus.org",
+    .compress_new = zlib_perchannel_compress_init,
+    .compress_free = zlib_perchannel_compress_cleanup,
+    .compress = zlib_perchannel_compress_block,
+    .decompress_new = zlib_perchannel_decompress_init,
+    .decompress_free = zlib_perchannel_decompress_cleanup,
+    .decompress = zlib_perchannel_decompress_block,
+    .text_name = "zlib (RFC1950), per-channel contexts",
+};
@@ -105,6 +105,13 @@ struct mr_result miller_rabin_test(MillerRabin *mr, mp_int *w);
 /* Perform a single Miller-Rabin test, using a random witness value. */
 bool miller_rabin_test_random(MillerRabin *mr);
 
+/* Perform several Miller-Rabin tests at once, with random witness
+ * values, interleaving their exponentiation ladders through a single
+ * pass over the bits of p-1. Cheaper than the same number of separate
+ * calls to miller_rabin_test_random, but with no early exit, so it's
+ * best saved for candidates that have already passed one test. */
+bool miller_rabin_test_random_batch(MillerRabin *mr, unsigned nwitnesses);
+
 /* Suggest how many tests are needed to make it sufficiently unlikely
  * that a composite number will pass them all */
 unsigned miller_rabin_checks_needed(unsigned bits);
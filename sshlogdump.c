@@ -0,0 +1,256 @@
+/*
+ * sshlogdump.c: render the binary SSH packet log format written by
+ * the LGTYP_SSHBIN logging mode (see logging.c for the format
+ * definition) back into the textual form that ordinary SSH packet
+ * logging would have produced, with a timestamp on each record.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "putty.h"
+#include "misc.h"
+#include "marshal.h"
+
+static NORETURN PRINTF_LIKE(1, 2) void fatal_error(const char *p, ...)
+{
+    va_list ap;
+    fprintf(stderr, "sshlogdump: ");
+    va_start(ap, p);
+    vfprintf(stderr, p, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+void out_of_memory(void) { fatal_error("out of memory"); }
+
+/*
+ * Sanity limit on the size of a single record, so that a corrupted
+ * length field fails cleanly instead of trying to allocate the rest
+ * of the address space. Even a maximum-size SSH packet logged with
+ * all its metadata comes to well under a megabyte.
+ */
+#define MAX_RECORD_SIZE (16*1024*1024)
+
+static void format_time(uint64_t t, char *buf, size_t bufsize)
+{
+    time_t tt = (time_t)t;
+    struct tm tm = *localtime(&tt);
+    strftime(buf, bufsize, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+/*
+ * Print the hex/ASCII dump of a packet body, in the same layout that
+ * log_packet uses for text logs. The body arrives as a pair of
+ * parallel arrays: a blanking type per byte (one of the BINLOG_SPAN_*
+ * constants) and the byte's value where that type is BINLOG_SPAN_DATA.
+ */
+static void dump_body(const unsigned char *vals, const unsigned char *types,
+                      size_t len)
+{
+    char dumpdata[128], smalldata[5];
+    size_t p = 0, omitted = 0;
+    int output_pos = 0;
+
+    while (p < len) {
+        int blktype = types[p];
+
+        if (blktype != BINLOG_SPAN_OMITTED && omitted) {
+            printf("  (%"SIZEu" byte%s omitted)\r\n",
+                   omitted, (omitted == 1 ? "" : "s"));
+            omitted = 0;
+        }
+
+        if (!output_pos && !omitted)
+            sprintf(dumpdata, "  %08"SIZEx"%*s\r\n",
+                    p-(p%16), 1+3*16+2+16, "");
+
+        if (blktype == BINLOG_SPAN_OMITTED) {
+            omitted++;
+        } else {
+            int c;
+            if (blktype == BINLOG_SPAN_BLANKED) {
+                c = 'X';
+                sprintf(smalldata, "XX");
+            } else {
+                c = vals[p];
+                sprintf(smalldata, "%02x", c);
+            }
+            dumpdata[10+2+3*(p%16)] = smalldata[0];
+            dumpdata[10+2+3*(p%16)+1] = smalldata[1];
+            dumpdata[10+1+3*16+2+(p%16)] = (c >= 0x20 && c < 0x7F ? c : '.');
+            output_pos = (p%16) + 1;
+        }
+
+        p++;
+
+        if (((p % 16) == 0) || (p == len) || omitted) {
+            if (output_pos) {
+                strcpy(dumpdata + 10+1+3*16+2+output_pos, "\r\n");
+                fputs(dumpdata, stdout);
+                output_pos = 0;
+            }
+        }
+    }
+
+    if (omitted)
+        printf("  (%"SIZEu" byte%s omitted)\r\n",
+               omitted, (omitted == 1 ? "" : "s"));
+}
+
+static void dump_packet_record(BinarySource *src, int rectype, uint64_t rtime)
+{
+    char timebuf[32];
+    unsigned long seq = get_uint32(src);
+    unsigned pkttype = get_byte(src);
+    ptrlen texttype = get_string(src);
+    unsigned downstream_id = get_uint32(src);
+    ptrlen additional = get_string(src);
+    unsigned char *vals, *types;
+    size_t len = 0, p;
+
+    if (get_err(src))
+        fatal_error("malformed packet record header");
+
+    format_time(rtime, timebuf, sizeof(timebuf));
+    printf("%s packet #0x%lx, type %u / 0x%02x (%.*s)",
+           rectype == BINLOG_REC_PKT_INCOMING ? "Incoming" : "Outgoing",
+           seq, pkttype, pkttype, PTRLEN_PRINTF(texttype));
+    if (downstream_id) {
+        printf(" on behalf of downstream #%u", downstream_id);
+        if (additional.len)
+            printf(" (%.*s)", PTRLEN_PRINTF(additional));
+    }
+    printf(", at %s\r\n", timebuf);
+
+    /*
+     * Two passes over the spans: one to find the total body length,
+     * and one to expand them into parallel per-byte arrays of
+     * blanking type and value for dump_body.
+     */
+    BinarySource body[1];
+    BinarySource_BARE_INIT_PL(body, get_data(src, get_avail(src)));
+    while (get_avail(body) > 0) {
+        unsigned spantype = get_byte(body);
+        size_t spanlen = get_uint32(body);
+        if (get_err(body))
+            fatal_error("malformed span header in packet record");
+        if (spantype == BINLOG_SPAN_DATA)
+            get_data(body, spanlen);
+        len += spanlen;
+    }
+
+    vals = snewn(len ? len : 1, unsigned char);
+    types = snewn(len ? len : 1, unsigned char);
+    BinarySource_REWIND(body);
+    p = 0;
+    while (get_avail(body) > 0) {
+        unsigned spantype = get_byte(body);
+        size_t spanlen = get_uint32(body);
+        if (spantype == BINLOG_SPAN_DATA) {
+            ptrlen data = get_data(body, spanlen);
+            if (get_err(body))
+                fatal_error("truncated data span in packet record");
+            memcpy(vals + p, data.ptr, spanlen);
+        } else if (spantype != BINLOG_SPAN_BLANKED &&
+                   spantype != BINLOG_SPAN_OMITTED) {
+            fatal_error("unknown span type %u in packet record", spantype);
+        }
+        memset(types + p, spantype, spanlen);
+        p += spanlen;
+    }
+
+    dump_body(vals, types, len);
+    sfree(vals);
+    sfree(types);
+}
+
+static void dump_file(FILE *fp, const char *filename)
+{
+    unsigned char lenbuf[4];
+    char magicbuf[sizeof(BINLOG_MAGIC)-1];
+    unsigned char *recbuf = NULL;
+    size_t recbufsize = 0;
+    bool seen_magic = false;
+
+    while (1) {
+        size_t got = fread(lenbuf, 1, 4, fp);
+        if (got == 0 && feof(fp))
+            break;
+        if (got < 4)
+            fatal_error("%s: truncated record length", filename);
+
+        /*
+         * The magic string recurs mid-file if a log was appended to
+         * an existing one, so accept it at any record boundary. Its
+         * first four bytes can't be mistaken for a sane record
+         * length.
+         */
+        if (!memcmp(lenbuf, BINLOG_MAGIC, 4)) {
+            if (fread(magicbuf, 1, sizeof(magicbuf)-4, fp) !=
+                sizeof(magicbuf)-4 ||
+                memcmp(magicbuf, BINLOG_MAGIC+4, sizeof(magicbuf)-4))
+                fatal_error("%s: malformed magic string", filename);
+            seen_magic = true;
+            continue;
+        }
+        if (!seen_magic)
+            fatal_error("%s: not a PuTTY binary packet log", filename);
+
+        size_t reclen = GET_32BIT_MSB_FIRST(lenbuf);
+        if (reclen < 9 || reclen > MAX_RECORD_SIZE)
+            fatal_error("%s: implausible record length %"SIZEu,
+                        filename, reclen);
+        if (recbufsize < reclen) {
+            recbufsize = reclen;
+            recbuf = sresize(recbuf, recbufsize, unsigned char);
+        }
+        if (fread(recbuf, 1, reclen, fp) != reclen)
+            fatal_error("%s: truncated record", filename);
+
+        BinarySource src[1];
+        BinarySource_BARE_INIT(src, recbuf, reclen);
+        unsigned rectype = get_byte(src);
+        uint64_t rtime = get_uint64(src);
+
+        switch (rectype) {
+          case BINLOG_REC_PKT_INCOMING:
+          case BINLOG_REC_PKT_OUTGOING:
+            dump_packet_record(src, rectype, rtime);
+            break;
+          case BINLOG_REC_EVENT: {
+            char timebuf[32];
+            ptrlen text = get_data(src, get_avail(src));
+            format_time(rtime, timebuf, sizeof(timebuf));
+            printf("Event Log: %.*s, at %s\r\n",
+                   PTRLEN_PRINTF(text), timebuf);
+            break;
+          }
+          default:
+            fatal_error("%s: unknown record type %u", filename, rectype);
+        }
+    }
+
+    sfree(recbuf);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        dump_file(stdin, "<standard input>");
+    } else {
+        for (int i = 1; i < argc; i++) {
+            FILE *fp = fopen(argv[i], "rb");
+            if (!fp)
+                fatal_error("%s: unable to open", argv[i]);
+            dump_file(fp, argv[i]);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
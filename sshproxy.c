@@ -568,14 +568,22 @@ Socket *sshproxy_new_connection(SockAddr *addr, const char *hostname,
            "Backend provides NC_HOST without SESSION_START!");
 
     /*
-     * Turn off SSH features we definitely don't want. It would be
-     * awkward and counterintuitive to have the proxy SSH connection
-     * become a connection-sharing upstream (but it's fine to have it
-     * be a downstream, if that's configured). And we don't want to
-     * open X forwardings, agent forwardings or (other) port
+     * Turn off SSH features we definitely don't want. We don't want
+     * to open X forwardings, agent forwardings or (other) port
      * forwardings as a side effect of this one operation.
+     *
+     * Connection sharing, on the other hand, we leave alone, in
+     * whatever roles the proxy session's configuration enables. In
+     * particular, we no longer veto the upstream role here: if the
+     * user has turned sharing on for the jump-host session, then the
+     * first proxied connection through it becomes the upstream and
+     * every subsequent one (from this process or another) attaches
+     * as a downstream, so only the first pays for the inner
+     * connection's key exchange and authentication. A user who finds
+     * that surprising can still switch it off in the jump host's
+     * saved session, and with sharing not configured at all nothing
+     * has changed.
      */
-    conf_set_bool(sp->conf, CONF_ssh_connection_sharing_upstream, false);
     conf_set_bool(sp->conf, CONF_x11_forward, false);
     conf_set_bool(sp->conf, CONF_agentfwd, false);
     for (const char *subkey;
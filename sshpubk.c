@@ -517,40 +517,25 @@ static char *read_body(BinarySource *src)
 
 static bool read_blob(BinarySource *src, int nlines, BinarySink *bs)
 {
-    unsigned char *blob;
     char *line;
-    int linelen;
-    int i, j, k;
+    size_t linelen;
+    int i;
 
     /* We expect at most 64 base64 characters, ie 48 real bytes, per line. */
     assert(nlines < MAX_KEY_BLOB_LINES);
-    blob = snewn(48 * nlines, unsigned char);
 
     for (i = 0; i < nlines; i++) {
         line = read_body(src);
-        if (!line) {
-            sfree(blob);
+        if (!line)
             return false;
-        }
         linelen = strlen(line);
-        if (linelen % 4 != 0 || linelen > 64) {
-            sfree(blob);
+        if (linelen % 4 != 0 || linelen > 64 ||
+            !base64_decode_bs(bs, make_ptrlen(line, linelen))) {
             sfree(line);
             return false;
         }
-        for (j = 0; j < linelen; j += 4) {
-            unsigned char decoded[3];
-            k = base64_decode_atom(line + j, decoded);
-            if (!k) {
-                sfree(line);
-                sfree(blob);
-                return false;
-            }
-            put_data(bs, decoded, k);
-        }
         sfree(line);
     }
-    sfree(blob);
     return true;
 }
 
@@ -1138,8 +1123,8 @@ static bool openssh_loadpub(BinarySource *src, char **algorithm,
     const char *error;
     char *line, *base64;
     char *comment = NULL;
-    unsigned char *pubblob = NULL;
-    int pubbloblen, pubblobsize;
+    strbuf *pubblob = NULL;
+    size_t base64len;
     int alglen;
 
     line = mkstr(get_chomped_line(src));
@@ -1157,19 +1142,16 @@ static bool openssh_loadpub(BinarySource *src, char **algorithm,
         comment = dupstr(comment);
     }
 
-    pubblobsize = strlen(base64) / 4 * 3;
-    pubblob = snewn(pubblobsize, unsigned char);
-    pubbloblen = 0;
-
-    while (!memchr(base64, '\0', 4)) {
-        assert(pubbloblen + 3 <= pubblobsize);
-        pubbloblen += base64_decode_atom(base64, pubblob + pubbloblen);
-        base64 += 4;
-    }
-    if (*base64) {
+    base64len = strlen(base64);
+    if (base64len % 4 != 0) {
         error = "invalid length for base64 data in OpenSSH public key file";
         goto error;
     }
+    pubblob = base64_decode_sb(make_ptrlen(base64, base64len));
+    if (!pubblob) {
+        error = "invalid base64 data in OpenSSH public key file";
+        goto error;
+    }
 
     /*
      * Sanity check: the first word on the line should be the key
@@ -1177,9 +1159,9 @@ static bool openssh_loadpub(BinarySource *src, char **algorithm,
      * the public blob.
      */
     alglen = strlen(line);
-    if (pubbloblen < alglen + 4 ||
-        GET_32BIT_MSB_FIRST(pubblob) != alglen ||
-        0 != memcmp(pubblob + 4, line, alglen)) {
+    if (pubblob->len < alglen + 4 ||
+        GET_32BIT_MSB_FIRST(pubblob->u) != alglen ||
+        0 != memcmp(pubblob->u + 4, line, alglen)) {
         error = "key algorithms do not match in OpenSSH public key file";
         goto error;
     }
@@ -1194,14 +1176,15 @@ static bool openssh_loadpub(BinarySource *src, char **algorithm,
     else
         sfree(comment);
     sfree(line);
-    put_data(bs, pubblob, pubbloblen);
-    sfree(pubblob);
+    put_datapl(bs, ptrlen_from_strbuf(pubblob));
+    strbuf_free(pubblob);
     return true;
 
   error:
     sfree(line);
     sfree(comment);
-    sfree(pubblob);
+    if (pubblob)
+        strbuf_free(pubblob);
     if (errorstr)
         *errorstr = error;
     return false;
@@ -1380,37 +1363,6 @@ int base64_lines(int datalen)
     return (datalen + 47) / 48;
 }
 
-static void base64_encode_s(BinarySink *bs, const unsigned char *data,
-                            int datalen, int cpl)
-{
-    int linelen = 0;
-    char out[4];
-    int n, i;
-
-    while (datalen > 0) {
-        n = (datalen < 3 ? datalen : 3);
-        base64_encode_atom(data, n, out);
-        data += n;
-        datalen -= n;
-        for (i = 0; i < 4; i++) {
-            if (linelen >= cpl) {
-                linelen = 0;
-                put_byte(bs, '\n');
-            }
-            put_byte(bs, out[i]);
-            linelen++;
-        }
-    }
-    put_byte(bs, '\n');
-}
-
-void base64_encode(FILE *fp, const unsigned char *data, int datalen, int cpl)
-{
-    stdio_sink ss;
-    stdio_sink_init(&ss, fp);
-    base64_encode_s(BinarySink_UPCAST(&ss), data, datalen, cpl);
-}
-
 const ppk_save_parameters ppk_save_default_parameters = {
     .fmt_version = 3,
 
@@ -1555,7 +1507,7 @@ strbuf *ppk_save_sb(ssh2_userkey *key, const char *passphrase,
     strbuf_catf(out, "Encryption: %s\n", cipherstr);
     strbuf_catf(out, "Comment: %s\n", key->comment);
     strbuf_catf(out, "Public-Lines: %d\n", base64_lines(pub_blob->len));
-    base64_encode_s(BinarySink_UPCAST(out), pub_blob->u, pub_blob->len, 64);
+    base64_encode_bs(BinarySink_UPCAST(out), ptrlen_from_strbuf(pub_blob), 64);
     if (params.fmt_version == 3 && ciphertype->keylen != 0) {
         strbuf_catf(out, "Key-Derivation: %s\n",
                     params.argon2_flavour == Argon2d ? "Argon2d" :
@@ -1571,8 +1523,8 @@ strbuf *ppk_save_sb(ssh2_userkey *key, const char *passphrase,
         strbuf_catf(out, "\n");
     }
     strbuf_catf(out, "Private-Lines: %d\n", base64_lines(priv_encrypted_len));
-    base64_encode_s(BinarySink_UPCAST(out),
-                    priv_blob_encrypted, priv_encrypted_len, 64);
+    base64_encode_bs(BinarySink_UPCAST(out),
+                     make_ptrlen(priv_blob_encrypted, priv_encrypted_len), 64);
     strbuf_catf(out, "Private-MAC: ");
     for (i = 0; i < macalg->len; i++)
         strbuf_catf(out, "%02x", priv_mac[i]);
@@ -1633,8 +1585,7 @@ static char *ssh2_pubkey_openssh_str_internal(const char *comment,
 {
     const unsigned char *ssh2blob = (const unsigned char *)v_pub_blob;
     ptrlen alg;
-    char *buffer, *p;
-    int i;
+    strbuf *buf;
 
     {
         BinarySource src[1];
@@ -1647,24 +1598,14 @@ static char *ssh2_pubkey_openssh_str_internal(const char *comment,
         }
     }
 
-    buffer = snewn(alg.len +
-                   4 * ((pub_len+2) / 3) +
-                   (comment ? strlen(comment) : 0) + 3, char);
-    p = buffer + sprintf(buffer, "%.*s ", PTRLEN_PRINTF(alg));
-    i = 0;
-    while (i < pub_len) {
-        int n = (pub_len - i < 3 ? pub_len - i : 3);
-        base64_encode_atom(ssh2blob + i, n, p);
-        i += n;
-        p += 4;
-    }
-    if (comment) {
-        *p++ = ' ';
-        strcpy(p, comment);
-    } else
-        *p++ = '\0';
+    buf = strbuf_new();
+    strbuf_catf(buf, "%.*s ", PTRLEN_PRINTF(alg));
+    base64_encode_bs(BinarySink_UPCAST(buf),
+                     make_ptrlen(ssh2blob, pub_len), 0);
+    if (comment)
+        strbuf_catf(buf, " %s", comment);
 
-    return buffer;
+    return strbuf_to_str(buf);
 }
 
 char *ssh2_pubkey_openssh_str(ssh2_userkey *key)
@@ -1689,7 +1630,6 @@ void ssh2_write_pubkey(FILE *fp, const char *comment,
 
     if (keytype == SSH_KEYTYPE_SSH2_PUBLIC_RFC4716) {
         const char *p;
-        int i, column;
 
         fprintf(fp, "---- BEGIN SSH2 PUBLIC KEY ----\n");
 
@@ -1703,22 +1643,7 @@ void ssh2_write_pubkey(FILE *fp, const char *comment,
             fprintf(fp, "\"\n");
         }
 
-        i = 0;
-        column = 0;
-        while (i < pub_len) {
-            char buf[5];
-            int n = (pub_len - i < 3 ? pub_len - i : 3);
-            base64_encode_atom(pub_blob + i, n, buf);
-            i += n;
-            buf[4] = '\0';
-            fputs(buf, fp);
-            if (++column >= 16) {
-                fputc('\n', fp);
-                column = 0;
-            }
-        }
-        if (column > 0)
-            fputc('\n', fp);
+        base64_encode(fp, pub_blob, pub_len, 64);
 
         fprintf(fp, "---- END SSH2 PUBLIC KEY ----\n");
     } else if (keytype == SSH_KEYTYPE_SSH2_PUBLIC_OPENSSH) {
@@ -1761,7 +1686,8 @@ static void ssh2_fingerprint_blob_sha256(ptrlen blob, strbuf *sb)
     strbuf_chomp(sb, '=');
 }
 
-char *ssh2_fingerprint_blob(ptrlen blob, FingerprintType fptype)
+static char *ssh2_fingerprint_blob_uncached(ptrlen blob,
+                                            FingerprintType fptype)
 {
     strbuf *sb = strbuf_new();
 
@@ -1796,6 +1722,71 @@ char *ssh2_fingerprint_blob(ptrlen blob, FingerprintType fptype)
     return strbuf_to_str(sb);
 }
 
+/*
+ * Process-wide cache of formatted fingerprint strings, keyed by
+ * public key blob. The same key's fingerprint tends to be wanted
+ * repeatedly - at every rekey when we log the host key we're checking
+ * against, and in Pageant for every logged agent request - and each
+ * computation redoes the hash and the base64 or hex formatting from
+ * scratch. Entries are kept in MRU order and trimmed from the tail
+ * beyond a small limit, in the same style as the RSA prime-context
+ * cache in crypto/rsa.c; everything cached here is derived from
+ * public keys, so there's nothing secret to worry about.
+ */
+struct fp_cache_entry {
+    strbuf *blob;
+    char *fps[SSH_N_FPTYPES];      /* computed on demand; NULL until then */
+    struct fp_cache_entry *next;
+};
+
+#define MAX_CACHED_FP_KEYS 4
+
+static struct fp_cache_entry *fp_cache = NULL;
+
+static struct fp_cache_entry *fp_cache_entry_get(ptrlen blob)
+{
+    struct fp_cache_entry **entp, *ent;
+    int pos = 0;
+
+    for (entp = &fp_cache; (ent = *entp) != NULL;
+         entp = &ent->next, pos++) {
+        if (ptrlen_eq_ptrlen(ptrlen_from_strbuf(ent->blob), blob)) {
+            /* Move to the front, to keep the list in MRU order */
+            *entp = ent->next;
+            ent->next = fp_cache;
+            fp_cache = ent;
+            return ent;
+        }
+        if (pos >= MAX_CACHED_FP_KEYS - 1 && !ent->next) {
+            /* We're at the size limit and about to add an entry, so
+             * evict the least recently used one. */
+            *entp = NULL;
+            strbuf_free(ent->blob);
+            for (unsigned i = 0; i < SSH_N_FPTYPES; i++)
+                sfree(ent->fps[i]);
+            sfree(ent);
+            break;
+        }
+    }
+
+    ent = snew(struct fp_cache_entry);
+    ent->blob = strbuf_new();
+    put_datapl(ent->blob, blob);
+    for (unsigned i = 0; i < SSH_N_FPTYPES; i++)
+        ent->fps[i] = NULL;
+    ent->next = fp_cache;
+    fp_cache = ent;
+    return ent;
+}
+
+char *ssh2_fingerprint_blob(ptrlen blob, FingerprintType fptype)
+{
+    struct fp_cache_entry *ent = fp_cache_entry_get(blob);
+    if (!ent->fps[fptype])
+        ent->fps[fptype] = ssh2_fingerprint_blob_uncached(blob, fptype);
+    return dupstr(ent->fps[fptype]);
+}
+
 char **ssh2_all_fingerprints_for_blob(ptrlen blob)
 {
     char **fps = snewn(SSH_N_FPTYPES, char *);
@@ -108,6 +108,28 @@ void read_random_seed(noise_consumer_t consumer);
  */
 void write_random_seed(void *data, int len);
 
+/* ----------------------------------------------------------------------
+ * Functions to access the cross-process mirror of the transient host
+ * key cache used by GSSAPI-based sessions (see
+ * ssh/transient-hostkey-cache.c for what it's for and what may
+ * safely be kept in it). The mirror is a small text file in PuTTY's
+ * storage directory, accessed under an exclusive lock so that
+ * concurrent short-lived processes can read and update it without
+ * trampling each other.
+ *
+ * open_transient_hostkey_cache_file takes the lock and appends the
+ * file's current contents to 'contents'; it returns NULL if the
+ * platform doesn't provide the mirror file at all, or if the file
+ * can't be opened or locked. The handle holds the lock until the
+ * matching close call, which first replaces the file's contents with
+ * 'new_contents' if that is non-NULL.
+ */
+typedef struct transient_hostkey_cache_file transient_hostkey_cache_file;
+transient_hostkey_cache_file *open_transient_hostkey_cache_file(
+    strbuf *contents);
+void close_transient_hostkey_cache_file(
+    transient_hostkey_cache_file *f, const char *new_contents);
+
 /* ----------------------------------------------------------------------
  * Cleanup function: remove all of PuTTY's persistent state.
  */
@@ -0,0 +1,293 @@
+/*
+ * termbench.c: measure terminal emulator throughput.
+ *
+ * Replays captured byte streams (e.g. test/vt100.txt, or logs of real
+ * sessions) through a headless Terminal instance, in the same way
+ * fuzzterm.c does for fuzzing, and reports how fast term_out can
+ * consume them. This gives us a repeatable number for the terminal's
+ * hot paths, so that regressions show up before release.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "putty.h"
+#include "dialog.h"
+#include "terminal.h"
+
+static const TermWinVtable bench_termwin_vt;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: termbench [options] file [file...]\n"
+            "options: -r ROWS    terminal height (default 24)\n"
+            "         -c COLS    terminal width (default 80)\n"
+            "         -s LINES   scrollback size (default 10000)\n"
+            "         -n COUNT   replay the input COUNT times (default 1)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    Terminal *term;
+    Conf *conf;
+    struct unicode_data ucsdata;
+    TermWin termwin;
+    int rows = 24, cols = 80, savelines = 10000, repeats = 1;
+    char *data = NULL;
+    size_t datalen = 0, datasize = 0;
+    size_t nlines = 0, i;
+    int rep, nfiles = 0;
+    double t0, t1, elapsed;
+
+    while (--argc > 0) {
+        const char *arg = *++argv;
+        if (!strcmp(arg, "-r") && argc > 1) {
+            rows = atoi((--argc, *++argv));
+        } else if (!strcmp(arg, "-c") && argc > 1) {
+            cols = atoi((--argc, *++argv));
+        } else if (!strcmp(arg, "-s") && argc > 1) {
+            savelines = atoi((--argc, *++argv));
+        } else if (!strcmp(arg, "-n") && argc > 1) {
+            repeats = atoi((--argc, *++argv));
+        } else if (arg[0] == '-') {
+            usage();
+        } else {
+            FILE *fp = fopen(arg, "rb");
+            size_t got;
+            if (!fp) {
+                fprintf(stderr, "termbench: unable to open '%s'\n", arg);
+                return 1;
+            }
+            do {
+                sgrowarrayn(data, datasize, datalen, 65536);
+                got = fread(data + datalen, 1, 65536, fp);
+                datalen += got;
+            } while (got > 0);
+            fclose(fp);
+            nfiles++;
+        }
+    }
+
+    if (nfiles == 0 || rows < 1 || cols < 1 || repeats < 1)
+        usage();
+
+    for (i = 0; i < datalen; i++)
+        if (data[i] == '\n')
+            nlines++;
+
+    termwin.vt = &bench_termwin_vt;
+
+    conf = conf_new();
+    do_defaults(NULL, conf);
+    init_ucs(&ucsdata, conf_get_str(conf, CONF_line_codepage),
+             conf_get_bool(conf, CONF_utf8_override),
+             CS_NONE, conf_get_int(conf, CONF_vtmode));
+
+    term = term_init(conf, &ucsdata, &termwin);
+    term_size(term, rows, cols, savelines);
+    term->ldisc = NULL;
+
+    t0 = now();
+    for (rep = 0; rep < repeats; rep++) {
+        size_t pos;
+        for (pos = 0; pos < datalen; pos += 65536) {
+            size_t chunk = datalen - pos;
+            if (chunk > 65536)
+                chunk = 65536;
+            term_data(term, data + pos, chunk);
+            run_toplevel_callbacks();
+        }
+        term_update(term);
+        run_toplevel_callbacks();
+    }
+    t1 = now();
+
+    elapsed = t1 - t0;
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    printf("termbench: %dx%d, %d lines of scrollback, %d repeat(s)\n",
+           rows, cols, savelines, repeats);
+    printf("  %zu bytes, %zu lines per repeat\n", datalen, nlines);
+    printf("  %.3f s elapsed\n", elapsed);
+    printf("  %.2f MB/s\n",
+           (double)datalen * repeats / elapsed / (1024.0 * 1024.0));
+    printf("  %.0f lines/s\n", (double)nlines * repeats / elapsed);
+
+    term_free(term);
+    conf_free(conf);
+    sfree(data);
+
+    return 0;
+}
+
+/* functions required by terminal.c: all rendering is discarded */
+static bool bench_setup_draw_ctx(TermWin *tw) { return true; }
+static void bench_draw_text(
+    TermWin *tw, int x, int y, wchar_t *text, int len,
+    unsigned long attr, int lattr, truecolour tc) {}
+static void bench_draw_cursor(
+    TermWin *tw, int x, int y, wchar_t *text, int len,
+    unsigned long attr, int lattr, truecolour tc) {}
+static void bench_draw_trust_sigil(TermWin *tw, int x, int y) {}
+static int bench_char_width(TermWin *tw, int uc) { return 1; }
+static void bench_free_draw_ctx(TermWin *tw) {}
+static void bench_set_cursor_pos(TermWin *tw, int x, int y) {}
+static void bench_set_raw_mouse_mode(TermWin *tw, bool enable) {}
+static void bench_set_scrollbar(TermWin *tw, int total, int start, int page) {}
+static void bench_bell(TermWin *tw, int mode) {}
+static bool bench_draw_scroll(
+    TermWin *tw, int topline, int botline, int lines) { return false; }
+static void bench_clip_write(
+    TermWin *tw, int clipboard, wchar_t *text, int *attrs,
+    truecolour *colours, int len, bool must_deselect) {}
+static void bench_clip_request_paste(TermWin *tw, int clipboard) {}
+static void bench_refresh(TermWin *tw) {}
+static void bench_request_resize(TermWin *tw, int w, int h) {}
+static void bench_set_title(TermWin *tw, const char *title) {}
+static void bench_set_icon_title(TermWin *tw, const char *icontitle) {}
+static void bench_set_minimised(TermWin *tw, bool minimised) {}
+static void bench_set_maximised(TermWin *tw, bool maximised) {}
+static void bench_move(TermWin *tw, int x, int y) {}
+static void bench_set_zorder(TermWin *tw, bool top) {}
+static void bench_palette_set(TermWin *tw, unsigned start, unsigned ncolours,
+                              const rgb *colours) {}
+static void bench_palette_get_overrides(TermWin *tw, Terminal *term) {}
+
+static const TermWinVtable bench_termwin_vt = {
+    .setup_draw_ctx = bench_setup_draw_ctx,
+    .draw_text = bench_draw_text,
+    .draw_cursor = bench_draw_cursor,
+    .draw_trust_sigil = bench_draw_trust_sigil,
+    .draw_scroll = bench_draw_scroll,
+    .char_width = bench_char_width,
+    .free_draw_ctx = bench_free_draw_ctx,
+    .set_cursor_pos = bench_set_cursor_pos,
+    .set_raw_mouse_mode = bench_set_raw_mouse_mode,
+    .set_scrollbar = bench_set_scrollbar,
+    .bell = bench_bell,
+    .clip_write = bench_clip_write,
+    .clip_request_paste = bench_clip_request_paste,
+    .refresh = bench_refresh,
+    .request_resize = bench_request_resize,
+    .set_title = bench_set_title,
+    .set_icon_title = bench_set_icon_title,
+    .set_minimised = bench_set_minimised,
+    .set_maximised = bench_set_maximised,
+    .move = bench_move,
+    .set_zorder = bench_set_zorder,
+    .palette_set = bench_palette_set,
+    .palette_get_overrides = bench_palette_get_overrides,
+};
+
+void ldisc_send(Ldisc *ldisc, const void *buf, int len, bool interactive) {}
+void ldisc_echoedit_update(Ldisc *ldisc) {}
+size_t ldisc_sendbuffer(Ldisc *ldisc) { return 0; }
+bool ldisc_has_input_buffered(Ldisc *ldisc) { return false; }
+LdiscInputToken ldisc_get_input_token(Ldisc *ldisc)
+{ unreachable("This fake ldisc never has any buffered input"); }
+void ldisc_enable_prompt_callback(Ldisc *ldisc, prompts_t *p)
+{ unreachable("This fake ldisc should never be used for user/pass prompts"); }
+void modalfatalbox(const char *fmt, ...) { exit(1); }
+void nonfatal(const char *fmt, ...) { }
+
+/* needed by timing.c */
+void timer_change_notify(unsigned long next) { }
+
+/* needed by config.c and sercfg.c */
+
+void dlg_radiobutton_set(union control *ctrl, dlgparam *dp, int whichbutton) { }
+int dlg_radiobutton_get(union control *ctrl, dlgparam *dp) { return 0; }
+void dlg_checkbox_set(union control *ctrl, dlgparam *dp, bool checked) { }
+bool dlg_checkbox_get(union control *ctrl, dlgparam *dp) { return false; }
+void dlg_editbox_set(union control *ctrl, dlgparam *dp, char const *text) { }
+char *dlg_editbox_get(union control *ctrl, dlgparam *dp)
+{ return dupstr("moo"); }
+void dlg_listbox_clear(union control *ctrl, dlgparam *dp) { }
+void dlg_listbox_del(union control *ctrl, dlgparam *dp, int index) { }
+void dlg_listbox_add(union control *ctrl, dlgparam *dp, char const *text) { }
+void dlg_listbox_addwithid(union control *ctrl, dlgparam *dp,
+                           char const *text, int id) { }
+int dlg_listbox_getid(union control *ctrl, dlgparam *dp, int index)
+{ return 0; }
+int dlg_listbox_index(union control *ctrl, dlgparam *dp) { return -1; }
+bool dlg_listbox_issel(union control *ctrl, dlgparam *dp, int index)
+{ return false; }
+void dlg_listbox_select(union control *ctrl, dlgparam *dp, int index) { }
+void dlg_text_set(union control *ctrl, dlgparam *dp, char const *text) { }
+void dlg_filesel_set(union control *ctrl, dlgparam *dp, Filename *fn) { }
+Filename *dlg_filesel_get(union control *ctrl, dlgparam *dp) { return NULL; }
+void dlg_fontsel_set(union control *ctrl, dlgparam *dp, FontSpec *fn) { }
+FontSpec *dlg_fontsel_get(union control *ctrl, dlgparam *dp) { return NULL; }
+void dlg_update_start(union control *ctrl, dlgparam *dp) { }
+void dlg_update_done(union control *ctrl, dlgparam *dp) { }
+void dlg_set_focus(union control *ctrl, dlgparam *dp) { }
+void dlg_label_change(union control *ctrl, dlgparam *dp, char const *text) { }
+union control *dlg_last_focused(union control *ctrl, dlgparam *dp)
+{ return NULL; }
+void dlg_beep(dlgparam *dp) { }
+void dlg_error_msg(dlgparam *dp, const char *msg) { }
+void dlg_end(dlgparam *dp, int value) { }
+void dlg_coloursel_start(union control *ctrl, dlgparam *dp,
+                         int r, int g, int b) { }
+bool dlg_coloursel_results(union control *ctrl, dlgparam *dp,
+                           int *r, int *g, int *b) { return false; }
+void dlg_refresh(union control *ctrl, dlgparam *dp) { }
+bool dlg_is_visible(union control *ctrl, dlgparam *dp) { return false; }
+
+const char *const appname = "termbench";
+const int ngsslibs = 0;
+const char *const gsslibnames[0] = { };
+const struct keyvalwhere gsslibkeywords[0] = { };
+
+/*
+ * Default settings that are specific to Unix plink.
+ */
+char *platform_default_s(const char *name)
+{
+    if (!strcmp(name, "TermType"))
+        return dupstr(getenv("TERM"));
+    if (!strcmp(name, "SerialLine"))
+        return dupstr("/dev/ttyS0");
+    return NULL;
+}
+
+bool platform_default_b(const char *name, bool def)
+{
+    return def;
+}
+
+int platform_default_i(const char *name, int def)
+{
+    return def;
+}
+
+FontSpec *platform_default_fontspec(const char *name)
+{
+    return fontspec_new("");
+}
+
+Filename *platform_default_filename(const char *name)
+{
+    if (!strcmp(name, "LogFileName"))
+        return filename_from_str("putty.log");
+    else
+        return filename_from_str("");
+}
+
+char *x_get_default(const char *key)
+{
+    return NULL;                       /* this is a stub */
+}
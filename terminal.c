@@ -37,7 +37,8 @@
 
 #define TM_PUTTY        (0xFFFF)
 
-#define UPDATE_DELAY    ((TICKSPERSEC+49)/50)/* ticks to defer window update */
+#define UPDATE_DELAY    ((TICKSPERSEC+59)/60)/* ticks to defer window update */
+#define UPDATE_DELAY_MAX (TICKSPERSEC/5) /* longest deferral we'll adapt to */
 #define TBLINK_DELAY    ((TICKSPERSEC*9+19)/20)/* ticks between text blinks*/
 #define CBLINK_DELAY    (CURSORBLINK) /* ticks between cursor blinks */
 #define VBELL_DELAY     (VBELL_TIMEOUT) /* visual bell timeout in ticks */
@@ -82,12 +83,15 @@ static const wchar_t sel_nl[] = SEL_NL;
  */
 #define CSET_OF(chr) (DIRECT_CHAR(chr)||DIRECT_FONT(chr) ? (chr)&CSET_MASK : 0)
 
+/* Number of slots in the content-keyed bidi/shaping cache. */
+#define BIDI_SHARED_CACHE_SIZE 64
+
 /*
  * Internal prototypes.
  */
 static void resizeline(Terminal *, termline *, int);
 static termline *lineptr(Terminal *, int, int, int);
-static void unlineptr(termline *);
+static void unlineptr(Terminal *, termline *);
 static void check_line_size(Terminal *, termline *);
 static void do_paint(Terminal *);
 static void erase_lots(Terminal *, bool, bool, bool);
@@ -97,20 +101,115 @@ static void update_sbar(Terminal *);
 static void deselect(Terminal *);
 static void term_print_finish(Terminal *);
 static void scroll(Terminal *, int, int, int, bool);
+static void reset_display_scroll(Terminal *);
 static void parse_optionalrgb(optionalrgb *out, unsigned *values);
 static void term_added_data(Terminal *term);
 static void term_update_raw_mouse_mode(Terminal *term);
+static void term_paste_callback(void *vterm);
 
-static termline *newtermline(Terminal *term, int cols, bool bce)
+static void freetermline(termline *line)
+{
+    if (line) {
+        sfree(line->chars);
+        sfree(line->urls);
+        sfree(line);
+    }
+}
+
+/*
+ * Pool of spare termline structures. Scrolling and scrollback
+ * decompression free and reallocate lines of the same width over and
+ * over, so instead of returning each one to the allocator we keep a
+ * bounded per-terminal stack of them for reuse. A pooled line whose
+ * width doesn't match the next request is simply resized, which is no
+ * worse than allocating afresh.
+ *
+ * termline_alloc() tolerates term==NULL (used by self-test code that
+ * has no terminal to hand) by falling back to a plain allocation.
+ */
+#define TERMLINE_POOL_MAX 256
+
+static termline *termline_alloc(Terminal *term, int cols)
 {
     termline *line;
-    int j;
 
-    line = snew(termline);
-    line->chars = snewn(cols, termchar);
-    for (j = 0; j < cols; j++)
-        line->chars[j] = (bce ? term->erase_char : term->basic_erase_char);
+    if (term && term->line_pool_len > 0) {
+        line = term->line_pool[--term->line_pool_len];
+        if (line->size != cols)
+            line->chars = sresize(line->chars, cols, termchar);
+    } else {
+        memstats_push_tag("terminal");
+        line = snew(termline);
+        line->chars = snewn(cols, termchar);
+        line->urls = NULL;
+        line->urlsize = 0;
+        memstats_pop_tag();
+    }
     line->cols = line->size = cols;
+    line->nurls = 0;
+    return line;
+}
+
+static void termline_release(Terminal *term, termline *line)
+{
+    if (!line)
+        return;
+    if (term && term->line_pool_len < TERMLINE_POOL_MAX) {
+        sgrowarray(term->line_pool, term->line_pool_size,
+                   term->line_pool_len);
+        term->line_pool[term->line_pool_len++] = line;
+    } else {
+        freetermline(line);
+    }
+}
+
+static void termline_pool_flush(Terminal *term)
+{
+    while (term->line_pool_len > 0)
+        freetermline(term->line_pool[--term->line_pool_len]);
+    sfree(term->line_pool);
+    term->line_pool = NULL;
+    term->line_pool_size = 0;
+}
+
+/*
+ * Fill a run of character cells with copies of a single cell that has
+ * no combining-character list (true of the erase characters used by
+ * all the clearing operations). Rather than assigning cell by cell, we
+ * write the first cell and then repeatedly duplicate the prefix we've
+ * built so far with memcpy, so that blanking a whole line or screen is
+ * bounded by memory bandwidth rather than per-cell loop overhead.
+ *
+ * This works on a bare termchar array and doesn't know about cc lists
+ * at all; it's shared between fill_termchars below and the
+ * line-construction code, which fills brand new cell arrays whose
+ * existing contents aren't yet meaningful.
+ */
+static void fill_blank_run(termchar *chars, int n, const termchar *src)
+{
+    int done;
+
+    assert(!src->cc_next);
+
+    if (n <= 0)
+        return;
+
+    chars[0] = *src;
+    done = 1;
+    while (done < n) {
+        int chunk = min(done, n - done);
+        memcpy(chars + done, chars, chunk * TSIZE);
+        done += chunk;
+    }
+}
+
+static termline *newtermline(Terminal *term, int cols, bool bce)
+{
+    termline *line;
+
+    line = termline_alloc(term, cols);
+    fill_blank_run(line->chars, cols,
+                   bce ? &term->erase_char : &term->basic_erase_char);
     line->lattr = LATTR_NORM;
     line->trusted = false;
     line->temporary = false;
@@ -119,18 +218,10 @@ static termline *newtermline(Terminal *term, int cols, bool bce)
     return line;
 }
 
-static void freetermline(termline *line)
-{
-    if (line) {
-        sfree(line->chars);
-        sfree(line);
-    }
-}
-
-static void unlineptr(termline *line)
+static void unlineptr(Terminal *term, termline *line)
 {
     if (line->temporary)
-        freetermline(line);
+        termline_release(term, line);
 }
 
 const int colour_indices_conf_to_oscp[CONF_NCOLOURS] = {
@@ -376,6 +467,34 @@ static void copy_termchar(termline *destline, int x, termchar *src)
 #endif
 }
 
+/*
+ * Fill a contiguous run of cells in a termline with copies of the same
+ * source cell: equivalent to calling copy_termchar on each cell in
+ * turn, but cheap enough for bulk clearing operations, which otherwise
+ * dominate full-screen redraws in TUI applications.
+ */
+static void fill_termchars(termline *line, int x, int n, termchar *src)
+{
+    int i;
+
+    if (src->cc_next) {
+        /* No single cell image to replicate, so do it the slow way.
+         * This shouldn't arise for any of the erase characters that
+         * clearing operations use, but cope anyway. */
+        for (i = 0; i < n; i++)
+            copy_termchar(line, x + i, src);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        clear_cc(line, x + i);
+    fill_blank_run(line->chars + x, n, src);
+
+#ifdef TERM_CC_DIAGS
+    cc_check(line);
+#endif
+}
+
 /*
  * Move a character cell within its termline.
  */
@@ -689,10 +808,731 @@ typedef struct compressed_scrollback_line {
     size_t len;
 } compressed_scrollback_line;
 
-static termline *decompressline(compressed_scrollback_line *line);
+static termline *decompressline(Terminal *term, compressed_scrollback_line *line);
+static void sb_stage_flush(Terminal *term);
+
+/*
+ * The scrollback itself is stored as a sequence of large contiguous
+ * blocks, each packing many compressed lines end to end together with
+ * an index of their start offsets. Compared to allocating every
+ * compressed line separately and keeping them all in a tree234, this
+ * saves both the per-allocation overhead (malloc headers plus tree
+ * nodes, which for short compressed lines can easily double the
+ * memory cost) and keeps the data contiguous, which is kinder to the
+ * cache and to swap when the scrollback limit is set very large.
+ *
+ * The operations the terminal needs are all at the ends of the
+ * sequence - append a line at the newest end, discard or reclaim a
+ * line at either end - plus random-access read of a line by index. So
+ * a flat array of block pointers with a start offset in the oldest
+ * block is sufficient; no tree structure is needed.
+ *
+ * Discarding a line at the oldest end doesn't immediately reclaim its
+ * bytes: they're freed when the whole block containing it is
+ * exhausted. With blocks this size, that lag is negligible compared
+ * to the total scrollback.
+ */
+
+#define SB_BLOCK_DATA_SIZE 65536
+
+/*
+ * Alongside the compressed storage we keep a small cache of recently
+ * decompressed termlines, keyed by scrollback index. While the user
+ * is scrolled back, every repaint re-reads the same window of lines,
+ * and without the cache each scroll step would re-run the RLE decoder
+ * on every visible line. Cached lines are handed out with temporary
+ * set to false, so unlineptr() leaves them alone; the cache owns them
+ * and frees them on eviction. Any modification of the scrollback
+ * flushes the whole cache, since it renumbers the line indices.
+ */
+#define SB_LINE_CACHE_SIZE 64
+
+typedef struct sb_cache_entry {
+    size_t index;
+    unsigned last_used;
+    termline *line;                    /* NULL if this slot is empty */
+} sb_cache_entry;
+
+/*
+ * Each block also carries a Bloom-style filter of the character
+ * trigrams occurring in its lines, maintained as lines are pushed.
+ * Searching the scrollback for a string of three or more characters
+ * can then skip whole blocks whose filter rules the string out,
+ * instead of decompressing and scanning every line. The filter is
+ * never rebuilt when lines are discarded from a block (stale bits
+ * only cause false positives, i.e. wasted scanning, never missed
+ * matches).
+ */
+#define SB_TRIGRAM_FILTER_BYTES 8192
+#define SB_TRIGRAM_FILTER_BITS (SB_TRIGRAM_FILTER_BYTES * 8)
+
+/*
+ * Optionally (CONF_scrollback_file), the whole store can be backed by
+ * a memory-mapped file, so that a long-lived session's history
+ * survives a restart and cold history is paged out by the OS instead
+ * of pinning RAM. The file format mirrors the in-memory structure: a
+ * one-page superblock recording the live range of the file, followed
+ * by a sequence of page-aligned blocks, each a fixed header (which
+ * includes the trigram filter, so searches don't lose it across a
+ * restart) followed by its data area. The compressed line records
+ * within a block are self-describing - each starts with its size_t
+ * length - so the per-block offset index isn't stored; it's rebuilt
+ * by a cheap walk over the records at load time.
+ *
+ * Everything is written through the mapping as it happens, so there's
+ * no explicit save step: whatever had reached the mapping at the
+ * moment of a crash is what the next session reloads. Discarded
+ * history is hole-punched out of the file (where the platform
+ * supports that), so the file's disk footprint tracks the live
+ * scrollback even though its offsets only ever grow.
+ */
+
+#define SB_FILE_MAGIC    0x53625375706231ULL /* "SbSupb1" */
+#define SB_FILE_BLKMAGIC 0x5362426c6f636bULL /* "SbBlock" */
+#define SB_FILE_VERSION 1
+/* Sanity cap on a stored block's data size, so that a corrupted
+ * header can't make us try to map something enormous. */
+#define SB_FILE_MAX_BLOCK (1 << 28)
+
+struct sb_file_super {
+    uint64_t magic, version;
+    uint64_t first_off;                /* offset of the oldest live block */
+    uint64_t next_off;                 /* offset just past the newest one */
+};
+
+struct sb_file_blkhdr {
+    uint64_t magic;
+    uint64_t datasize, datalen;        /* of the data area that follows */
+    uint64_t ndiscarded;               /* lines dropped from the front */
+    unsigned char trigrams[SB_TRIGRAM_FILTER_BYTES];
+};
+
+typedef struct scrollback_block {
+    char *data;
+    size_t datalen, datasize;
+    size_t *offsets;                   /* offset in data of each line */
+    size_t nlines, linesize;
+    size_t start;                      /* first line not yet discarded */
+    unsigned char *trigrams;           /* SB_TRIGRAM_FILTER_BYTES of filter */
+
+    /*
+     * For a file-backed block, 'hdr' is the mapping of its extent in
+     * the file: 'data' and 'trigrams' point into the mapping, and
+     * datalen and start are mirrored into the header whenever they
+     * change so the block can be reloaded after a restart. NULL for
+     * an in-memory block (including every block when no backing file
+     * is configured).
+     */
+    struct sb_file_blkhdr *hdr;
+    size_t maplen;                     /* length of the mapped extent */
+    uint64_t fileoff;                  /* its offset within the file */
+} scrollback_block;
+
+struct scrollback {
+    scrollback_block **blocks;
+    size_t nblocks, blocksize;
+    size_t nlines;                     /* total lines in all blocks */
+    /* Cache of the most recent lookup, so that scanning consecutive
+     * lines (the common access pattern during repaints) doesn't
+     * re-walk the block list from the start each time. */
+    size_t cache_block, cache_base;
+    /* Cache of recently decompressed lines. */
+    sb_cache_entry lines[SB_LINE_CACHE_SIZE];
+    unsigned line_cache_counter;
+    /* Optional persistent backing file. */
+    ScrollbackFile *file;              /* NULL if not file-backed */
+    struct sb_file_super *super;       /* mapping of the first page */
+    size_t pagesize;
+};
+
+/* Rounded-up length of the file extent holding a block of a given
+ * data size. Block extents are page-aligned so they can be mapped
+ * individually. */
+static size_t sb_file_extent(struct scrollback *sb, size_t datasize)
+{
+    size_t total = sizeof(struct sb_file_blkhdr) + datasize;
+    return (total + sb->pagesize - 1) & ~(sb->pagesize - 1);
+}
+
+/*
+ * Try to attach a backing file to a freshly created scrollback,
+ * reloading whatever live blocks it contains (unless 'reset', in
+ * which case any previous contents are destroyed first). On any
+ * failure sb->file is left NULL and the scrollback stays purely in
+ * memory.
+ */
+static void sb_attach_file(struct scrollback *sb, const Filename *fn,
+                           bool reset)
+{
+    uint64_t size, off;
+
+    sb->pagesize = sb_file_page_size();
+    sb->file = sb_file_open(fn, &size);
+    if (!sb->file)
+        return;
+    if (reset) {
+        sb_file_truncate(sb->file);
+        size = 0;
+    }
+
+    sb->super = (struct sb_file_super *)sb_file_map(
+        sb->file, 0, sb->pagesize);
+    if (!sb->super) {
+        sb_file_close(sb->file);
+        sb->file = NULL;
+        return;
+    }
+
+    if (size < sb->pagesize ||
+        sb->super->magic != SB_FILE_MAGIC ||
+        sb->super->version != SB_FILE_VERSION ||
+        sb->super->first_off > sb->super->next_off) {
+        /*
+         * A fresh file, or one we can't make sense of. Reinitialise
+         * the superblock and start storing from scratch; anything
+         * beyond it will be overwritten or ignored.
+         */
+        sb->super->magic = SB_FILE_MAGIC;
+        sb->super->version = SB_FILE_VERSION;
+        sb->super->first_off = sb->super->next_off = sb->pagesize;
+        return;
+    }
+
+    off = sb->super->first_off;
+    while (off < sb->super->next_off) {
+        struct sb_file_blkhdr *hdr;
+        scrollback_block *blk;
+        size_t hdrmap = sb_file_extent(sb, 0), extent, o;
+        bool ok = true;
+
+        /* Map just the header first, to learn the block's extent. */
+        hdr = (struct sb_file_blkhdr *)sb_file_map(sb->file, off, hdrmap);
+        if (!hdr || hdr->magic != SB_FILE_BLKMAGIC ||
+            hdr->datasize > SB_FILE_MAX_BLOCK ||
+            hdr->datalen > hdr->datasize) {
+            if (hdr)
+                sb_file_unmap(hdr, hdrmap);
+            break;
+        }
+        extent = sb_file_extent(sb, hdr->datasize);
+        sb_file_unmap(hdr, hdrmap);
+        hdr = (struct sb_file_blkhdr *)sb_file_map(sb->file, off, extent);
+        if (!hdr)
+            break;
+
+        blk = snew(scrollback_block);
+        blk->hdr = hdr;
+        blk->maplen = extent;
+        blk->fileoff = off;
+        blk->data = (char *)(hdr + 1);
+        blk->datasize = hdr->datasize;
+        blk->datalen = hdr->datalen;
+        blk->trigrams = hdr->trigrams;
+        blk->offsets = NULL;
+        blk->nlines = blk->linesize = 0;
+        blk->start = hdr->ndiscarded;
+
+        /* Rebuild the offset index by walking the records. */
+        o = 0;
+        while (o < blk->datalen) {
+            compressed_scrollback_line *rec =
+                (compressed_scrollback_line *)(blk->data + o);
+            size_t recordlen;
+            if (rec->len > blk->datalen - o) {
+                ok = false;
+                break;
+            }
+            recordlen = sizeof(compressed_scrollback_line) + rec->len;
+            sgrowarray(blk->offsets, blk->linesize, blk->nlines);
+            blk->offsets[blk->nlines++] = o;
+            o += (recordlen + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+        }
+
+        if (!ok || blk->start > blk->nlines) {
+            sfree(blk->offsets);
+            sb_file_unmap(hdr, extent);
+            sfree(blk);
+            break;
+        }
+
+        off += extent;
+
+        if (blk->start == blk->nlines) {
+            /* Every line in this block had already been discarded
+             * (which can happen if the last session ended between
+             * discarding the final line and freeing the block). */
+            sfree(blk->offsets);
+            sb_file_unmap(hdr, extent);
+            sfree(blk);
+            continue;
+        }
+
+        sgrowarray(sb->blocks, sb->blocksize, sb->nblocks);
+        sb->blocks[sb->nblocks++] = blk;
+        sb->nlines += blk->nlines - blk->start;
+    }
+
+    /* If we stopped at a block we couldn't make sense of, anything
+     * from there on is unreachable; forget it. */
+    sb->super->next_off = off;
+    if (sb->nblocks > 0)
+        sb->super->first_off = sb->blocks[0]->fileoff;
+    else
+        sb->super->first_off = off;
+}
+
+/*
+ * Create a scrollback store. If the configuration asks for a backing
+ * file, attach it; 'reset' additionally destroys any contents the
+ * file had (used when the user clears the scrollback, where reloading
+ * the old history would defeat the point).
+ */
+static struct scrollback *sb_new(Terminal *term, bool reset)
+{
+    struct scrollback *sb = snew(struct scrollback);
+    size_t i;
+    sb->blocks = NULL;
+    sb->nblocks = sb->blocksize = 0;
+    sb->nlines = 0;
+    sb->cache_block = sb->cache_base = 0;
+    for (i = 0; i < SB_LINE_CACHE_SIZE; i++)
+        sb->lines[i].line = NULL;
+    sb->line_cache_counter = 0;
+    sb->file = NULL;
+    sb->super = NULL;
+    sb->pagesize = 0;
+
+    if (term) {
+        Filename *fn = conf_get_filename(term->conf, CONF_scrollback_file);
+        if (fn && !filename_is_null(fn))
+            sb_attach_file(sb, fn, reset);
+    }
+
+    return sb;
+}
+
+static void sb_line_cache_flush(struct scrollback *sb)
+{
+    size_t i;
+    for (i = 0; i < SB_LINE_CACHE_SIZE; i++) {
+        if (sb->lines[i].line) {
+            freetermline(sb->lines[i].line);
+            sb->lines[i].line = NULL;
+        }
+    }
+}
+
+static void sb_free_block(scrollback_block *blk)
+{
+    if (blk->hdr) {
+        sb_file_unmap(blk->hdr, blk->maplen);
+    } else {
+        sfree(blk->data);
+        sfree(blk->trigrams);
+    }
+    sfree(blk->offsets);
+    sfree(blk);
+}
+
+static void sb_free(struct scrollback *sb)
+{
+    size_t i;
+    sb_line_cache_flush(sb);
+    for (i = 0; i < sb->nblocks; i++)
+        sb_free_block(sb->blocks[i]);
+    sfree(sb->blocks);
+    if (sb->super)
+        sb_file_unmap(sb->super, sb->pagesize);
+    if (sb->file)
+        sb_file_close(sb->file);
+    sfree(sb);
+}
+
+static int sb_count(struct scrollback *sb)
+{
+    return sb->nlines;
+}
+
+/*
+ * Append a compressed line to the newest end of the scrollback,
+ * taking ownership of (and freeing) the separately allocated record
+ * that compressline() returned.
+ */
+/*
+ * Map a termchar's chr field to the plain Unicode value used for
+ * searching, the same way do_paint() maps it for display.
+ */
+static unsigned long sb_search_char(Terminal *term, unsigned long chr)
+{
+    switch (chr & CSET_MASK) {
+      case CSET_ASCII:
+        chr = term->ucsdata->unitab_line[chr & 0xFF];
+        break;
+      case CSET_LINEDRW:
+        chr = term->ucsdata->unitab_xterm[chr & 0xFF];
+        break;
+      case CSET_SCOACS:
+        chr = term->ucsdata->unitab_scoacs[chr & 0xFF];
+        break;
+    }
+    return chr;
+}
+
+static void sb_trigram_bits(unsigned long a, unsigned long b,
+                            unsigned long c, unsigned *bit1, unsigned *bit2)
+{
+    unsigned h = a;
+    h = h * 0x9E3779B1u + b;
+    h = h * 0x9E3779B1u + c;
+    *bit1 = h % SB_TRIGRAM_FILTER_BITS;
+    *bit2 = (h >> 16) % SB_TRIGRAM_FILTER_BITS;
+}
+
+static void sb_push(Terminal *term, struct scrollback *sb,
+                    compressed_scrollback_line *line, termline *ldata)
+{
+    size_t recordlen = sizeof(compressed_scrollback_line) + line->len;
+    scrollback_block *blk;
+
+    if (sb->nblocks > 0)
+        blk = sb->blocks[sb->nblocks - 1];
+    else
+        blk = NULL;
+
+    if (!blk || blk->datalen + recordlen > blk->datasize) {
+        blk = snew(scrollback_block);
+        blk->datasize = recordlen > SB_BLOCK_DATA_SIZE ?
+            recordlen : SB_BLOCK_DATA_SIZE;
+        blk->hdr = NULL;
+        if (sb->file) {
+            size_t extent = sb_file_extent(sb, blk->datasize);
+            struct sb_file_blkhdr *hdr = (struct sb_file_blkhdr *)
+                sb_file_map(sb->file, sb->super->next_off, extent);
+            if (hdr) {
+                hdr->magic = SB_FILE_BLKMAGIC;
+                hdr->datasize = blk->datasize;
+                hdr->datalen = 0;
+                hdr->ndiscarded = 0;
+                memset(hdr->trigrams, 0, SB_TRIGRAM_FILTER_BYTES);
+                blk->hdr = hdr;
+                blk->maplen = extent;
+                blk->fileoff = sb->super->next_off;
+                blk->data = (char *)(hdr + 1);
+                blk->trigrams = hdr->trigrams;
+                sb->super->next_off += extent;
+            }
+            /* and if the mapping failed, fall back to an in-memory
+             * block: this session's scrollback keeps working, though
+             * the lines in that block won't survive a restart */
+        }
+        if (!blk->hdr) {
+            blk->data = snewn(blk->datasize, char);
+            blk->trigrams = snewn(SB_TRIGRAM_FILTER_BYTES, unsigned char);
+            memset(blk->trigrams, 0, SB_TRIGRAM_FILTER_BYTES);
+        }
+        blk->datalen = 0;
+        blk->offsets = NULL;
+        blk->nlines = blk->linesize = 0;
+        blk->start = 0;
+        sgrowarray(sb->blocks, sb->blocksize, sb->nblocks);
+        sb->blocks[sb->nblocks++] = blk;
+    }
+
+    sgrowarray(blk->offsets, blk->linesize, blk->nlines);
+    blk->offsets[blk->nlines++] = blk->datalen;
+    memcpy(blk->data + blk->datalen, line, recordlen);
+    /* Keep every record aligned well enough for its size_t header.
+     * The padding is only there to position the next record, so if it
+     * would run past the end of the block, clamp: no further record
+     * fits anyway, and letting datalen exceed datasize would make the
+     * mirrored header fail validation when the file is reloaded. */
+    blk->datalen += (recordlen + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    if (blk->datalen > blk->datasize)
+        blk->datalen = blk->datasize;
+    if (blk->hdr)
+        blk->hdr->datalen = blk->datalen;
+    sb->nlines++;
+
+    sfree(line);
+
+    /* Record the line's character trigrams in the block's filter. */
+    if (ldata) {
+        int j;
+        for (j = 0; j + 2 < ldata->cols; j++) {
+            unsigned bit1, bit2;
+            sb_trigram_bits(sb_search_char(term, ldata->chars[j].chr),
+                            sb_search_char(term, ldata->chars[j+1].chr),
+                            sb_search_char(term, ldata->chars[j+2].chr),
+                            &bit1, &bit2);
+            blk->trigrams[bit1 >> 3] |= 1 << (bit1 & 7);
+            blk->trigrams[bit2 >> 3] |= 1 << (bit2 & 7);
+        }
+    }
+
+    sb_line_cache_flush(sb);
+}
+
+/*
+ * Retrieve a line by index (0 = oldest), or NULL if the index is out
+ * of range. The returned pointer is into the block's storage, and
+ * remains valid only until the scrollback is next modified.
+ */
+static compressed_scrollback_line *sb_index(struct scrollback *sb,
+                                            size_t index)
+{
+    size_t bi, base;
+
+    if (index >= sb->nlines)
+        return NULL;
+
+    if (sb->cache_block < sb->nblocks && index >= sb->cache_base) {
+        bi = sb->cache_block;
+        base = sb->cache_base;
+    } else {
+        bi = 0;
+        base = 0;
+    }
+
+    while (index - base >= sb->blocks[bi]->nlines - sb->blocks[bi]->start) {
+        base += sb->blocks[bi]->nlines - sb->blocks[bi]->start;
+        bi++;
+        assert(bi < sb->nblocks);
+    }
+
+    sb->cache_block = bi;
+    sb->cache_base = base;
+
+    {
+        scrollback_block *blk = sb->blocks[bi];
+        size_t offset = blk->offsets[blk->start + (index - base)];
+        return (compressed_scrollback_line *)(blk->data + offset);
+    }
+}
+
+/*
+ * Discard the oldest line. Its bytes are reclaimed once the whole
+ * block containing it has been discarded.
+ */
+static void sb_drop_oldest(struct scrollback *sb)
+{
+    scrollback_block *blk;
+
+    assert(sb->nlines > 0);
+    blk = sb->blocks[0];
+    blk->start++;
+    if (blk->hdr)
+        blk->hdr->ndiscarded = blk->start;
+    sb->nlines--;
+
+    if (blk->start == blk->nlines) {
+        if (blk->hdr) {
+            sb->super->first_off = blk->fileoff + blk->maplen;
+            sb_file_discard(sb->file, blk->fileoff, blk->maplen);
+        }
+        sb_free_block(blk);
+        memmove(sb->blocks, sb->blocks + 1,
+                (--sb->nblocks) * sizeof(*sb->blocks));
+    }
+
+    sb->cache_block = sb->cache_base = 0;
+    sb_line_cache_flush(sb);
+}
+
+/*
+ * Remove and return the newest line, as a separate allocation owned
+ * by the caller (matching what compressline() would have returned).
+ * Used when a window resize pulls lines back on to the screen.
+ */
+static compressed_scrollback_line *sb_pop_latest(struct scrollback *sb)
+{
+    scrollback_block *blk;
+    compressed_scrollback_line *src, *ret;
+    size_t recordlen;
+
+    assert(sb->nlines > 0);
+    blk = sb->blocks[sb->nblocks - 1];
+    src = (compressed_scrollback_line *)
+        (blk->data + blk->offsets[blk->nlines - 1]);
+    recordlen = sizeof(compressed_scrollback_line) + src->len;
+    ret = smalloc(recordlen);
+    memcpy(ret, src, recordlen);
+
+    blk->datalen = blk->offsets[--blk->nlines];
+    if (blk->hdr)
+        blk->hdr->datalen = blk->datalen;
+    sb->nlines--;
+    if (blk->nlines == blk->start) {
+        if (blk->hdr) {
+            sb->super->next_off = blk->fileoff;
+            sb_file_discard(sb->file, blk->fileoff, blk->maplen);
+        }
+        sb_free_block(blk);
+        sb->nblocks--;
+    }
+
+    sb->cache_block = sb->cache_base = 0;
+    sb_line_cache_flush(sb);
+
+    return ret;
+}
+
+/*
+ * Retrieve a line by index in decompressed form, or NULL if the index
+ * is out of range. The returned termline is owned by the cache (so
+ * callers must treat it as read-only, and unlineptr() will correctly
+ * not free it); it remains valid until the scrollback is next
+ * modified.
+ */
+static termline *sb_getline(Terminal *term, struct scrollback *sb,
+                            size_t index)
+{
+    compressed_scrollback_line *cline;
+    termline *line;
+    size_t i, evict;
+
+    if (index >= sb->nlines)
+        return NULL;
+
+    evict = 0;
+    for (i = 0; i < SB_LINE_CACHE_SIZE; i++) {
+        if (!sb->lines[i].line) {
+            evict = i;
+        } else if (sb->lines[i].index == index) {
+            sb->lines[i].last_used = ++sb->line_cache_counter;
+            return sb->lines[i].line;
+        } else if (sb->lines[evict].line &&
+                   sb->lines[i].last_used < sb->lines[evict].last_used) {
+            evict = i;
+        }
+    }
+
+    cline = sb_index(sb, index);
+    line = decompressline(term, cline);
+    line->temporary = false;           /* owned by the cache, not callers */
+
+    if (sb->lines[evict].line)
+        freetermline(sb->lines[evict].line);
+    sb->lines[evict].line = line;
+    sb->lines[evict].index = index;
+    sb->lines[evict].last_used = ++sb->line_cache_counter;
+
+    return line;
+}
+
+/*
+ * Scan one decompressed scrollback line for a needle. Combining
+ * characters are ignored: a match is against the base character in
+ * each cell.
+ */
+static bool sb_line_contains(Terminal *term, termline *ldata,
+                             const wchar_t *needle, size_t needle_len)
+{
+    int j, start;
+
+    if ((size_t)ldata->cols < needle_len)
+        return false;
+
+    for (start = 0; start + (int)needle_len <= ldata->cols; start++) {
+        for (j = 0; j < (int)needle_len; j++) {
+            if (sb_search_char(term, ldata->chars[start+j].chr) !=
+                (unsigned long)needle[j])
+                break;
+        }
+        if (j == (int)needle_len)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Search the scrollback for a string, using the per-block trigram
+ * filters to avoid decompressing blocks that cannot contain it.
+ *
+ * 'start_line' is a scrollback line index (0 = oldest line); the
+ * search begins there and proceeds towards newer lines, or towards
+ * older ones if 'backwards' is set. Returns the index of the first
+ * matching line, or -1 if there is no match. Matches are confined to
+ * a single line; a string spanning a wrap boundary is not found.
+ */
+int term_scrollback_search(Terminal *term, const wchar_t *needle,
+                           int start_line, bool backwards)
+{
+    struct scrollback *sb = term->scrollback;
+    size_t needle_len = 0;
+    int step = backwards ? -1 : +1;
+    size_t bi, base;
+
+    sb_stage_flush(term);
+
+    while (needle[needle_len])
+        needle_len++;
+    if (needle_len == 0 || sb->nlines == 0)
+        return -1;
+
+    if (start_line < 0)
+        start_line = backwards ? (int)sb->nlines - 1 : 0;
+    if (start_line >= (int)sb->nlines)
+        start_line = (int)sb->nlines - 1;
+
+    /*
+     * Work out the index of each block's first live line, then walk
+     * the blocks in search order, testing the trigram filter once per
+     * block and only decompressing lines in blocks that pass.
+     */
+    size_t *firsts = snewn(sb->nblocks, size_t);
+    base = 0;
+    for (bi = 0; bi < sb->nblocks; bi++) {
+        firsts[bi] = base;
+        base += sb->blocks[bi]->nlines - sb->blocks[bi]->start;
+    }
+
+    for (bi = 0; bi < sb->nblocks; bi++) {
+        size_t blkidx = backwards ? sb->nblocks - 1 - bi : bi;
+        scrollback_block *blk = sb->blocks[blkidx];
+        size_t blklines = blk->nlines - blk->start;
+        size_t first = firsts[blkidx], last = first + blklines - 1;
+        int line;
+
+        if (backwards ? (size_t)start_line < first
+                      : (size_t)start_line > last)
+            continue;
+
+        if (needle_len >= 3) {
+            bool possible = true;
+            size_t i;
+            for (i = 0; i + 2 < needle_len && possible; i++) {
+                unsigned bit1, bit2;
+                sb_trigram_bits(needle[i], needle[i+1], needle[i+2],
+                                &bit1, &bit2);
+                if (!(blk->trigrams[bit1 >> 3] & (1 << (bit1 & 7))) ||
+                    !(blk->trigrams[bit2 >> 3] & (1 << (bit2 & 7))))
+                    possible = false;
+            }
+            if (!possible)
+                continue;
+        }
+
+        for (line = ((size_t)start_line > last ? (int)last :
+                     (size_t)start_line < first ? (int)first : start_line);
+             line >= (int)first && line <= (int)last; line += step) {
+            compressed_scrollback_line *cline = sb_index(sb, line);
+            termline *ldata = decompressline(term, cline);
+            bool found = sb_line_contains(term, ldata, needle, needle_len);
+            termline_release(term, ldata);
+            if (found) {
+                sfree(firsts);
+                return line;
+            }
+        }
+    }
+
+    sfree(firsts);
+    return -1;
+}
 
 static compressed_scrollback_line *compressline(termline *ldata)
 {
+    memstats_push_tag("scrollback");
     strbuf *b = strbuf_new();
 
     /* Leave space for the header structure */
@@ -767,7 +1607,7 @@ static compressed_scrollback_line *compressline(termline *ldata)
         printf("\n");
 #endif
 
-        dcl = decompressline(line);
+        dcl = decompressline(NULL, line);
         assert(ldata->cols == dcl->cols);
         assert(ldata->lattr == dcl->lattr);
         for (i = 0; i < ldata->cols; i++)
@@ -784,9 +1624,66 @@ static compressed_scrollback_line *compressline(termline *ldata)
 #endif
 #endif /* TERM_CC_DIAGS */
 
+    memstats_pop_tag();
     return line;
 }
 
+/*
+ * Deferred scrollback compression. Lines scrolled off the top of the
+ * screen are copied into a staging queue, and the RLE encoder runs
+ * over the whole batch in a toplevel callback once the current
+ * processing cycle is over, instead of sitting directly on the
+ * term_out output path. Anything that reads or restructures the
+ * scrollback flushes the queue first, so the deferral is never
+ * observable; the queue is also bounded, so a sustained burst of
+ * output compresses in batches rather than accumulating raw lines.
+ */
+#define SB_STAGE_MAX 1024
+
+static void sb_stage_flush(Terminal *term)
+{
+    size_t i;
+    for (i = 0; i < term->sb_stage_len; i++) {
+        termline *line = term->sb_stage[i];
+        sb_push(term, term->scrollback, compressline(line), line);
+        termline_release(term, line);
+    }
+    term->sb_stage_len = 0;
+}
+
+static void sb_stage_flush_callback(void *ctx)
+{
+    Terminal *term = (Terminal *)ctx;
+    sb_stage_flush(term);
+}
+
+static void sb_stage_line(Terminal *term, termline *line)
+{
+    termline *copy = termline_alloc(term, line->size);
+    memcpy(copy->chars, line->chars, line->size * sizeof(termchar));
+    copy->cols = line->cols;
+    copy->lattr = line->lattr;
+    copy->trusted = line->trusted;
+    copy->temporary = false;
+    copy->cc_free = line->cc_free;
+
+    if (term->sb_stage_len == 0)
+        queue_toplevel_callback(sb_stage_flush_callback, term);
+    sgrowarray(term->sb_stage, term->sb_stage_size, term->sb_stage_len);
+    term->sb_stage[term->sb_stage_len++] = copy;
+
+    if (term->sb_stage_len >= SB_STAGE_MAX)
+        sb_stage_flush(term);
+}
+
+/* Drop the oldest staged line without compressing it. */
+static void sb_stage_drop_oldest(Terminal *term)
+{
+    termline_release(term, term->sb_stage[0]);
+    memmove(term->sb_stage, term->sb_stage + 1,
+            (--term->sb_stage_len) * sizeof(*term->sb_stage));
+}
+
 static void readrle(BinarySource *bs, termline *ldata,
                     void (*readliteral)(BinarySource *bs, termchar *c,
                                         termline *ldata, unsigned long *state))
@@ -920,7 +1817,7 @@ static void readliteral_cc(BinarySource *bs, termchar *c, termline *ldata,
     }
 }
 
-static termline *decompressline(compressed_scrollback_line *line)
+static termline *decompressline(Terminal *term, compressed_scrollback_line *line)
 {
     int ncols, byte, shift;
     BinarySource bs[1];
@@ -941,9 +1838,7 @@ static termline *decompressline(compressed_scrollback_line *line)
     /*
      * Now create the output termline.
      */
-    ldata = snew(termline);
-    ldata->chars = snewn(ncols, termchar);
-    ldata->cols = ldata->size = ncols;
+    ldata = termline_alloc(term, ncols);
     ldata->temporary = true;
     ldata->cc_free = 0;
 
@@ -1055,8 +1950,8 @@ static void resizeline(Terminal *term, termline *line, int cols)
          * don't have to worry about cc lists here, because we
          * _know_ the erase char doesn't have one.)
          */
-        for (i = oldcols; i < cols; i++)
-            line->chars[i] = term->basic_erase_char;
+        fill_blank_run(line->chars + oldcols, cols - oldcols,
+                       &term->basic_erase_char);
 
 #ifdef TERM_CC_DIAGS
         cc_check(line);
@@ -1064,12 +1959,38 @@ static void resizeline(Terminal *term, termline *line, int cols)
     }
 }
 
+/*
+ * Give back the storage for a line's trailing run of default blank
+ * cells, by shrinking the line to end at its last interesting cell.
+ *
+ * This is only safe for lines that every future reader will fetch
+ * through lineptr(), which re-expands them to the full terminal width
+ * on access; resizeline() fills the reconstructed tail with
+ * basic_erase_char, which is exactly what we removed. So we use it on
+ * whichever screen has just been swapped out, where a mostly-blank
+ * screen (the usual state of the primary screen while a full-screen
+ * app runs, or of a sparse dashboard's saved image) shrinks to a
+ * small fraction of its dense size, and a huge window stops costing
+ * two full dense screens of termchars.
+ */
+static void sparsify_line(Terminal *term, termline *line)
+{
+    int cols = line->cols;
+    while (cols > 0 &&
+           termchars_equal(&line->chars[cols-1], &term->basic_erase_char))
+        cols--;
+    if (cols < line->cols)
+        resizeline(term, line, cols);
+}
+
 /*
  * Get the number of lines in the scrollback.
  */
 static int sblines(Terminal *term)
 {
-    int sblines = count234(term->scrollback);
+    int sblines;
+    sb_stage_flush(term);
+    sblines = sb_count(term->scrollback);
     if (term->erase_to_scrollback &&
         term->alt_which && term->alt_screen) {
             sblines += term->alt_sblines;
@@ -1077,8 +1998,145 @@ static int sblines(Terminal *term)
     return sblines;
 }
 
+/* ----------------------------------------------------------------------
+ * Incremental URL detection.
+ *
+ * We keep a per-line list of the character ranges that look like
+ * URLs, so that a front end wanting clickable links can hit-test a
+ * mouse position with term_url_at() without any scanning at paint
+ * time. Rescans are driven by the same conservative damage signal as
+ * the paint optimisation (any fetch of a live screen line marks its
+ * row), and run in a deferred top-level callback, so the scanning
+ * cost stays off the term_out hot path however fast output arrives.
+ */
+
+/*
+ * Extract the ASCII value of a character cell, or -1 if the cell
+ * doesn't hold a printable non-space ASCII character. URLs containing
+ * non-ASCII characters are out of scope for this scanner.
+ */
+static int url_char(const termchar *tc)
+{
+    unsigned long c = tc->chr;
+    if ((c & CSET_MASK) == CSET_ASCII)
+        c &= ~CSET_MASK;
+    if (c > 0x20 && c < 0x7F)
+        return (int)c;
+    return -1;
+}
+
+static bool url_scheme_char(int c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.');
+}
+
+static bool url_body_char(int c)
+{
+    return (c > 0 &&
+            ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+             (c >= '0' && c <= '9') ||
+             strchr("-._~:/?#[]@!$&'()*+,;=%", c) != NULL));
+}
+
+/*
+ * Recompute the URL spans of a single termline.
+ */
+static void term_url_scan_line(termline *line)
+{
+    int i = 0;
+
+    line->nurls = 0;
+
+    while (i + 2 < line->cols) {
+        /*
+         * Look for "://", and then recover the scheme name by walking
+         * backwards from it, so that we don't have to hardcode a list
+         * of interesting schemes.
+         */
+        if (!(url_char(&line->chars[i]) == ':' &&
+              url_char(&line->chars[i+1]) == '/' &&
+              url_char(&line->chars[i+2]) == '/')) {
+            i++;
+            continue;
+        }
+
+        int start = i;
+        while (start > 0 && url_scheme_char(url_char(&line->chars[start-1])))
+            start--;
+        /*
+         * Require a scheme of at least two characters starting with a
+         * letter, which matches every scheme in the IANA registry and
+         * avoids firing on things like 'x://' in shell noise.
+         */
+        int c0 = url_char(&line->chars[start]);
+        bool have_scheme = (start < i - 1 &&
+                            ((c0 >= 'a' && c0 <= 'z') ||
+                             (c0 >= 'A' && c0 <= 'Z')));
+
+        int end = i + 3;
+        while (end < line->cols && url_body_char(url_char(&line->chars[end])))
+            end++;
+
+        /*
+         * Trailing punctuation is more likely to belong to the
+         * surrounding prose than to the URL itself, as in 'see
+         * https://host.example, which explains it'.
+         */
+        while (end > i + 3 &&
+               strchr(".,;:!?'\")]", url_char(&line->chars[end-1])))
+            end--;
+
+        if (have_scheme && end > i + 3) {
+            size_t tmpsize = line->urlsize;
+            sgrowarrayn(line->urls, tmpsize, line->nurls * 2, 2);
+            line->urlsize = tmpsize;
+            line->urls[line->nurls * 2] = start;
+            line->urls[line->nurls * 2 + 1] = end;
+            line->nurls++;
+        }
+
+        i = end;
+    }
+}
+
+static void term_url_scan_callback(void *vterm)
+{
+    Terminal *term = (Terminal *)vterm;
+    int i;
+
+    term->url_scan_queued = false;
+    if (!term->url_dirty)
+        return;
+    for (i = 0; i < term->rows; i++) {
+        if (term->url_dirty[i]) {
+            /* Fetch the line directly rather than via lineptr, which
+             * would re-mark the row as damaged for the next paint. */
+            termline *line = index234(term->screen, i);
+            term->url_dirty[i] = false;
+            if (line)
+                term_url_scan_line(line);
+        }
+    }
+}
+
+/*
+ * Note that a screen row's content may have changed, so that its
+ * line's URL spans want recomputing in due course.
+ */
+static void term_url_mark_dirty(Terminal *term, int row)
+{
+    if (!term->url_dirty || row < 0 || row >= term->rows)
+        return;
+    term->url_dirty[row] = true;
+    if (!term->url_scan_queued) {
+        term->url_scan_queued = true;
+        queue_toplevel_callback(term_url_scan_callback, term);
+    }
+}
+
 static void null_line_error(Terminal *term, int y, int lineno,
-                            tree234 *whichtree, int treeindex,
+                            void *whichtree, int treeindex,
                             const char *varname)
 {
     modalfatalbox("%s==NULL in terminal.c\n"
@@ -1091,7 +2149,7 @@ static void null_line_error(Terminal *term, int y, int lineno,
                   "Please contact <putty@projects.tartarus.org> "
                   "and pass on the above information.",
                   varname, lineno, y, term->cols, term->rows,
-                  term->scrollback, count234(term->scrollback),
+                  term->scrollback, sb_count(term->scrollback),
                   term->screen, count234(term->screen),
                   term->alt_screen, count234(term->alt_screen),
                   term->alt_sblines, whichtree, treeindex, commitid);
@@ -1111,6 +2169,15 @@ static termline *lineptr(Terminal *term, int y, int lineno, int screen)
     if (y >= 0) {
         whichtree = term->screen;
         treeindex = y;
+        /*
+         * Conservatively assume that whoever is fetching a live
+         * screen line may modify it, for damage-tracking purposes.
+         * (Read-only accesses overmark, but only cost an extra line
+         * scan at the next paint.)
+         */
+        if (term->scrdirty && y < term->rows)
+            term->scrdirty[y] = true;
+        term_url_mark_dirty(term, y);
     } else {
         int altlines = 0;
 
@@ -1121,19 +2188,20 @@ static termline *lineptr(Terminal *term, int y, int lineno, int screen)
             altlines = term->alt_sblines;
         }
         if (y < -altlines) {
-            whichtree = term->scrollback;
-            treeindex = y + altlines + count234(term->scrollback);
+            whichtree = NULL;          /* the scrollback, not a tree */
+            sb_stage_flush(term);
+            treeindex = y + altlines + sb_count(term->scrollback);
         } else {
             whichtree = term->alt_screen;
             treeindex = y + term->alt_sblines;
             /* treeindex = y + count234(term->alt_screen); */
         }
     }
-    if (whichtree == term->scrollback) {
-        compressed_scrollback_line *cline = index234(whichtree, treeindex);
-        if (!cline)
-            null_line_error(term, y, lineno, whichtree, treeindex, "cline");
-        line = decompressline(cline);
+    if (!whichtree) {
+        line = sb_getline(term, term->scrollback, treeindex);
+        if (!line)
+            null_line_error(term, y, lineno, term->scrollback, treeindex,
+                            "line");
     } else {
         line = index234(whichtree, treeindex);
     }
@@ -1217,6 +2285,11 @@ static void term_timer(void *ctx, unsigned long now)
         term->window_update_cooldown = false;
     }
 
+    if (term->paste_throttled && now == term->paste_throttle_end) {
+        term->paste_throttled = false;
+        queue_toplevel_callback(term_paste_callback, term);
+    }
+
     if (term->window_update_pending)
         term_update_callback(term);
 }
@@ -1227,10 +2300,31 @@ static void term_update_callback(void *ctx)
     if (!term->window_update_pending)
         return;
     if (!term->window_update_cooldown) {
+        unsigned long start = GETTICKCOUNT();
         term_update(term);
+
+        /*
+         * Adapt the cooldown period to the cost of the redraw we've
+         * just done. If redraws are cheap, we repaint at full rate;
+         * if one takes longer than the nominal frame interval (a
+         * large window on a slow display connection, say), we extend
+         * the cooldown to match, so that painting never consumes
+         * more than about half our time and the terminal emulator
+         * keeps up with its input instead of queueing thousands of
+         * partial repaints. The cap keeps a single anomalously slow
+         * paint (or a clock hiccup) from locking updates out for too
+         * long.
+         */
+        unsigned long elapsed = GETTICKCOUNT() - start;
+        unsigned long delay = UPDATE_DELAY;
+        if (delay < elapsed)
+            delay = elapsed;
+        if (delay > UPDATE_DELAY_MAX)
+            delay = UPDATE_DELAY_MAX;
+
         term->window_update_cooldown = true;
         term->window_update_cooldown_end = schedule_timer(
-            UPDATE_DELAY, term_timer, term);
+            delay, term_timer, term);
     }
 }
 
@@ -1242,6 +2336,49 @@ static void term_schedule_update(Terminal *term)
     }
 }
 
+/*
+ * Deferred scrollback truncation. When the scrollback limit shrinks
+ * below the number of lines we currently hold - typically from a
+ * mid-session reconfiguration - dropping the excess can mean freeing
+ * hundreds of thousands of compressed lines, so rather than stalling
+ * term_size for the whole job we drop a bounded slice per toplevel
+ * callback. Everything else measures the scrollback extent with
+ * sb_count() on demand, so the surplus lines remain fully usable
+ * until their slice comes round; and if the limit is raised again
+ * before trimming finishes, whatever still survives is simply kept.
+ */
+#define SB_TRIM_SLICE 4096
+
+static void sb_trim_callback(void *ctx)
+{
+    Terminal *term = (Terminal *)ctx;
+    int n = SB_TRIM_SLICE;
+
+    while (n-- > 0 && sb_count(term->scrollback) > term->savelines)
+        sb_drop_oldest(term->scrollback);
+
+    if (sb_count(term->scrollback) > term->savelines)
+        queue_toplevel_callback(sb_trim_callback, term);
+    else
+        term->sb_trim_pending = false;
+
+    if (sb_count(term->scrollback) < term->tempsblines)
+        term->tempsblines = sb_count(term->scrollback);
+    if (term->disptop < -sblines(term))
+        term->disptop = -sblines(term);
+
+    term->win_scrollbar_update_pending = true;
+    term_schedule_update(term);
+}
+
+static void sb_trim_schedule(Terminal *term)
+{
+    if (!term->sb_trim_pending) {
+        term->sb_trim_pending = true;
+        queue_toplevel_callback(sb_trim_callback, term);
+    }
+}
+
 /*
  * Call this whenever the terminal window state changes, to queue
  * an update.
@@ -1255,10 +2392,16 @@ static void seen_disp_event(Terminal *term)
 /*
  * Call when the terminal's blinking-text settings change, or when
  * a text blink has just occurred.
+ *
+ * While the window is minimised, neither text nor cursor blinking
+ * reschedules its timer: there's nothing to see, and an idle
+ * minimised window shouldn't be waking the process up twice a
+ * second. term_notify_minimised restarts blinking when the window
+ * reappears.
  */
 static void term_schedule_tblink(Terminal *term)
 {
-    if (term->blink_is_real) {
+    if (term->blink_is_real && !term->minimised) {
         if (!term->tblink_pending)
             term->next_tblink = schedule_timer(TBLINK_DELAY, term_timer, term);
         term->tblink_pending = true;
@@ -1273,7 +2416,7 @@ static void term_schedule_tblink(Terminal *term)
  */
 static void term_schedule_cblink(Terminal *term)
 {
-    if (term->blink_cur && term->has_focus) {
+    if (term->blink_cur && term->has_focus && !term->minimised) {
         if (!term->cblink_pending)
             term->next_cblink = schedule_timer(CBLINK_DELAY, term_timer, term);
         term->cblink_pending = true;
@@ -1568,6 +2711,7 @@ void term_copy_stuff_from_conf(Terminal *term)
     term->no_remote_wintitle = conf_get_bool(term->conf, CONF_no_remote_wintitle);
     term->no_remote_clearscroll = conf_get_bool(term->conf, CONF_no_remote_clearscroll);
     term->rawcnp = conf_get_bool(term->conf, CONF_rawcnp);
+    term->rtf_paste = conf_get_bool(term->conf, CONF_rtf_paste);
     term->utf8linedraw = conf_get_bool(term->conf, CONF_utf8linedraw);
     term->rect_select = conf_get_bool(term->conf, CONF_rect_select);
     term->remote_qtitle_action = conf_get_int(term->conf, CONF_remote_qtitle_action);
@@ -1732,6 +2876,10 @@ void term_reconfig(Terminal *term, Conf *conf)
     term_schedule_cblink(term);
     term_copy_stuff_from_conf(term);
     term_update_raw_mouse_mode(term);
+
+    /* Several of those options affect rendering, so don't trust any
+     * damage-tracking state from before the reconfigure. */
+    term->paint_forced = true;
 }
 
 /*
@@ -1739,7 +2887,6 @@ void term_reconfig(Terminal *term, Conf *conf)
  */
 void term_clrsb(Terminal *term)
 {
-    unsigned char *line;
     int i;
 
     /*
@@ -1749,11 +2896,19 @@ void term_clrsb(Terminal *term)
     term->disptop = 0;
 
     /*
-     * Clear the actual scrollback.
+     * Clear the actual scrollback, including any lines still awaiting
+     * compression.
      */
-    while ((line = delpos234(term->scrollback, 0)) != NULL) {
-        sfree(line);            /* this is compressed data, not a termline */
-    }
+    while (term->sb_stage_len > 0)
+        termline_release(term, term->sb_stage[--term->sb_stage_len]);
+    sb_free(term->scrollback);
+    term->scrollback = sb_new(term, true);
+
+    /*
+     * This is a natural point to return the spare-line pool's memory
+     * too, since the user has just asked us to shed stored data.
+     */
+    termline_pool_flush(term);
 
     /*
      * When clearing the scrollback, we also truncate any termlines on
@@ -1958,7 +3113,9 @@ Terminal *term_init(Conf *myconf, struct unicode_data *ucsdata, TermWin *win)
     term->cblink_pending = term->tblink_pending = false;
     term->paste_buffer = NULL;
     term->paste_len = 0;
+    term->paste_throttled = false;
     bufchain_init(&term->inbuf);
+    term->reply_buf = strbuf_new();
     bufchain_init(&term->printer_buf);
     term->printing = term->only_printing = false;
     term->print_job = NULL;
@@ -1977,12 +3134,25 @@ Terminal *term_init(Conf *myconf, struct unicode_data *ucsdata, TermWin *win)
 
     term_copy_stuff_from_conf(term);
 
-    term->screen = term->alt_screen = term->scrollback = NULL;
+    term->screen = term->alt_screen = NULL;
+    term->scrollback = NULL;
     term->tempsblines = 0;
     term->alt_sblines = 0;
     term->disptop = 0;
     term->disptext = NULL;
     term->dispcursx = term->dispcursy = -1;
+    term->scrdirty = NULL;
+    term->url_dirty = NULL;
+    term->url_scan_queued = false;
+    term->paint_forced = true;
+    term->dispscroll_top = term->dispscroll_size = 0;
+    term->dispscroll_lines = 0;
+    term->dispscroll_unusable = false;
+    term->line_pool = NULL;
+    term->line_pool_len = term->line_pool_size = 0;
+    term->sb_stage = NULL;
+    term->sb_stage_len = term->sb_stage_size = 0;
+    term->sb_trim_pending = false;
     term->tabs = NULL;
     deselect(term);
     term->rows = term->cols = -1;
@@ -2005,6 +3175,7 @@ Terminal *term_init(Conf *myconf, struct unicode_data *ucsdata, TermWin *win)
 
     term->bidi_cache_size = 0;
     term->pre_bidi_cache = term->post_bidi_cache = NULL;
+    term->bidi_shared_cache = NULL;
 
     /* FULL-TERMCHAR */
     term->basic_erase_char.chr = CSET_ASCII | ' ';
@@ -2059,9 +3230,7 @@ void term_free(Terminal *term)
     struct beeptime *beep;
     int i;
 
-    while ((line = delpos234(term->scrollback, 0)) != NULL)
-        sfree(line);                   /* compressed data, not a termline */
-    freetree234(term->scrollback);
+    sb_free(term->scrollback);
     while ((line = delpos234(term->screen, 0)) != NULL)
         freetermline(line);
     freetree234(term->screen);
@@ -2073,12 +3242,19 @@ void term_free(Terminal *term)
             freetermline(term->disptext[i]);
     }
     sfree(term->disptext);
+    sfree(term->scrdirty);
+    sfree(term->url_dirty);
+    while (term->sb_stage_len > 0)
+        freetermline(term->sb_stage[--term->sb_stage_len]);
+    sfree(term->sb_stage);
+    termline_pool_flush(term);
     while (term->beephead) {
         beep = term->beephead;
         term->beephead = beep->next;
         sfree(beep);
     }
     bufchain_clear(&term->inbuf);
+    strbuf_free(term->reply_buf);
     if(term->print_job)
         printer_finish_job(term->print_job);
     bufchain_clear(&term->printer_buf);
@@ -2097,6 +3273,16 @@ void term_free(Terminal *term)
     sfree(term->pre_bidi_cache);
     sfree(term->post_bidi_cache);
 
+    if (term->bidi_shared_cache) {
+        for (i = 0; i < BIDI_SHARED_CACHE_SIZE; i++) {
+            sfree(term->bidi_shared_cache[i].pre_chars);
+            sfree(term->bidi_shared_cache[i].post_chars);
+            sfree(term->bidi_shared_cache[i].forward);
+            sfree(term->bidi_shared_cache[i].backward);
+        }
+        sfree(term->bidi_shared_cache);
+    }
+
     sfree(term->tabs);
 
     expire_timer_context(term);
@@ -2148,7 +3334,7 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
     term->alt_b = term->marg_b = newrows - 1;
 
     if (term->rows == -1) {
-        term->scrollback = newtree234(NULL);
+        term->scrollback = sb_new(term, false);
         term->screen = newtree234(NULL);
         term->tempsblines = 0;
         term->rows = 0;
@@ -2173,7 +3359,8 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
      *    amount of scrollback we actually have, we must throw some
      *    away.
      */
-    sblen = count234(term->scrollback);
+    sb_stage_flush(term);
+    sblen = sb_count(term->scrollback);
     /* Do this loop to expand the screen if newrows > rows */
     assert(term->rows == count234(term->screen));
     while (term->rows < newrows) {
@@ -2181,8 +3368,9 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
             compressed_scrollback_line *cline;
             /* Insert a line from the scrollback at the top of the screen. */
             assert(sblen >= term->tempsblines);
-            cline = delpos234(term->scrollback, --sblen);
-            line = decompressline(cline);
+            cline = sb_pop_latest(term->scrollback);
+            sblen--;
+            line = decompressline(term, cline);
             sfree(cline);
             line->temporary = false;   /* reconstituted line is now real */
             term->tempsblines -= 1;
@@ -2203,12 +3391,13 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
         if (term->curs.y < term->rows - 1) {
             /* delete bottom row, unless it contains the cursor */
             line = delpos234(term->screen, term->rows - 1);
-            freetermline(line);
+            termline_release(term, line);
         } else {
             /* push top row to scrollback */
             line = delpos234(term->screen, 0);
-            addpos234(term->scrollback, compressline(line), sblen++);
-            freetermline(line);
+            sb_push(term, term->scrollback, compressline(line), line);
+            sblen++;
+            termline_release(term, line);
             term->tempsblines += 1;
             term->curs.y -= 1;
             term->savecurs.y -= 1;
@@ -2220,16 +3409,16 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
     assert(term->rows == newrows);
     assert(count234(term->screen) == newrows);
 
-    /* Delete any excess lines from the scrollback. */
-    while (sblen > newsavelines) {
-        line = delpos234(term->scrollback, 0);
-        sfree(line);
-        sblen--;
-    }
+    /*
+     * If the scrollback limit has shrunk below what we currently
+     * hold, the excess lines are dropped lazily, a slice per toplevel
+     * callback, rather than all at once here: see sb_trim_callback().
+     */
+    if (sblen > newsavelines)
+        sb_trim_schedule(term);
     if (sblen < term->tempsblines)
         term->tempsblines = sblen;
-    assert(count234(term->scrollback) <= newsavelines);
-    assert(count234(term->scrollback) >= term->tempsblines);
+    assert(sb_count(term->scrollback) >= term->tempsblines);
     term->disptop = 0;
 
     /* Make a new displayed text buffer. */
@@ -2247,15 +3436,35 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
     term->disptext = newdisp;
     term->dispcursx = term->dispcursy = -1;
 
-    /* Make a new alternate screen. */
-    newalt = newtree234(NULL);
-    for (i = 0; i < newrows; i++) {
-        line = newtermline(term, newcols, true);
-        addpos234(newalt, line, i);
+    sfree(term->scrdirty);
+    term->scrdirty = snewn(newrows, bool);
+    memset(term->scrdirty, 0, newrows * sizeof(bool));
+    sfree(term->url_dirty);
+    term->url_dirty = snewn(newrows, bool);
+    memset(term->url_dirty, 0, newrows * sizeof(bool));
+    term->paint_forced = true;
+    reset_display_scroll(term);        /* any recorded region is stale now */
+
+    /*
+     * Make a new alternate screen, building its line index in one
+     * pass. When the current erase char is the default blank we build
+     * the lines zero-width - lineptr materialises the blank cells on
+     * first access - so an alt screen that never gets used costs
+     * almost nothing even on a huge window.
+     */
+    {
+        bool plain = termchars_equal(&term->erase_char,
+                                     &term->basic_erase_char);
+        termline **altlines = snewn(newrows, termline *);
+        for (i = 0; i < newrows; i++)
+            altlines[i] = (plain ? newtermline(term, 0, false) :
+                           newtermline(term, newcols, true));
+        newalt = newtree234_from_array(NULL, (void **)altlines, newrows);
+        sfree(altlines);
     }
     if (term->alt_screen) {
         while (NULL != (line = delpos234(term->alt_screen, 0)))
-            freetermline(line);
+            termline_release(term, line);
         freetree234(term->alt_screen);
     }
     term->alt_screen = newalt;
@@ -2329,6 +3538,14 @@ static int find_last_nonempty_line(Terminal * term, tree234 * screen)
     for (i = count234(screen) - 1; i >= 0; i--) {
         termline *line = index234(screen, i);
         int j;
+        /*
+         * A sparsified line has an implicit tail of default blanks
+         * beyond line->cols, which only counts as empty if the
+         * current erase char is the default blank too.
+         */
+        if (line->cols < term->cols &&
+            !termchars_equal(&term->erase_char, &term->basic_erase_char))
+            break;
         for (j = 0; j < line->cols; j++)
             if (!termchars_equal(&line->chars[j], &term->erase_char))
                 break;
@@ -2356,6 +3573,9 @@ static void swap_screen(Terminal *term, int which,
     if (!which)
         reset = false;                 /* do no weird resetting if which==0 */
 
+    if (which != term->alt_which || reset)
+        term->paint_forced = true;     /* the whole display changes */
+
     if (which != term->alt_which) {
         if (term->erase_to_scrollback && term->alt_screen &&
             term->alt_which && term->disptop < 0) {
@@ -2380,6 +3600,20 @@ static void swap_screen(Terminal *term, int which,
         term->alt_sblines = (
             term->alt_screen ?
             find_last_nonempty_line(term, term->alt_screen) + 1 : 0);
+
+        /*
+         * The screen we've just swapped out is dormant until the next
+         * swap (or is read back via lineptr, which undoes this), so
+         * this is the moment to drop the storage for its blank
+         * regions.
+         */
+        if (term->alt_screen) {
+            termline *aline;
+            for (t = 0;
+                 (aline = index234(term->alt_screen, t)) != NULL; t++)
+                sparsify_line(term, aline);
+        }
+
         t = term->curs.x;
         if (!reset && !keep_cur_pos)
             term->curs.x = term->alt_x;
@@ -2501,8 +3735,7 @@ static void check_selection(Terminal *term, pos from, pos to)
 static void clear_line(Terminal *term, termline *line)
 {
     resizeline(term, line, term->cols);
-    for (int i = 0; i < term->cols; i++)
-        copy_termchar(line, i, &term->erase_char);
+    fill_termchars(line, 0, term->cols, &term->erase_char);
     line->lattr = LATTR_NORM;
 }
 
@@ -2520,6 +3753,38 @@ static void check_trust_status(Terminal *term, termline *line)
     }
 }
 
+/*
+ * Note that the lines between topline and botline inclusive of the
+ * displayed screen have just moved vertically ('lines' positive for
+ * upward movement), so that do_paint can ask the front end to blit
+ * the already-drawn pixels rather than redrawing them. Successive
+ * movements of the same region accumulate; anything more complicated
+ * marks the record unusable, and do_paint falls back to an ordinary
+ * repaint.
+ */
+static void record_display_scroll(Terminal *term, int topline, int botline,
+                                  int lines)
+{
+    if (term->dispscroll_unusable)
+        return;
+    if (term->dispscroll_lines == 0) {
+        term->dispscroll_top = topline;
+        term->dispscroll_size = botline - topline + 1;
+        term->dispscroll_lines = lines;
+    } else if (term->dispscroll_top == topline &&
+               term->dispscroll_size == botline - topline + 1) {
+        term->dispscroll_lines += lines;
+    } else {
+        term->dispscroll_unusable = true;
+    }
+}
+
+static void reset_display_scroll(Terminal *term)
+{
+    term->dispscroll_lines = 0;
+    term->dispscroll_unusable = false;
+}
+
 /*
  * Scroll the screen. (`lines' is +ve for scrolling forward, -ve
  * for backward.) `sb' is true if the scrolling is permitted to
@@ -2536,6 +3801,30 @@ static void scroll(Terminal *term, int topline, int botline,
 
     scrollwinsize = botline - topline + 1;
 
+    /* Every line in the scrolled region changes appearance. */
+    if (term->scrdirty) {
+        int y;
+        for (y = topline; y <= botline && y < term->rows; y++) {
+            term->scrdirty[y] = true;
+            term_url_mark_dirty(term, y);
+        }
+    }
+
+    if (!term->disptop) {
+        int l = lines < -scrollwinsize ? -scrollwinsize :
+            lines > scrollwinsize ? scrollwinsize : lines;
+        record_display_scroll(term, topline, botline, l);
+    }
+
+    /*
+     * If the user is scrolled back, the scrollback content under the
+     * current view position may shift even without disptop changing
+     * (e.g. when the scrollback is full and the oldest line is
+     * dropped), so don't trust per-line damage state at all.
+     */
+    if (term->disptop)
+        term->paint_forced = true;
+
     if (lines < 0) {
         lines = -lines;
         if (lines > scrollwinsize)
@@ -2570,22 +3859,23 @@ static void scroll(Terminal *term, int topline, int botline,
             cc_check(line);
 #endif
             if (sb && term->savelines > 0) {
-                int sblen = count234(term->scrollback);
+                int sblen = sb_count(term->scrollback) +
+                    (int)term->sb_stage_len;
                 /*
                  * We must add this line to the scrollback. We'll
                  * remove a line from the top of the scrollback if
-                 * the scrollback is full.
+                 * the scrollback is full (or over-full, while a
+                 * deferred trim is still catching up).
                  */
-                if (sblen == term->savelines) {
-                    unsigned char *cline;
-
-                    sblen--;
-                    cline = delpos234(term->scrollback, 0);
-                    sfree(cline);
+                if (sblen >= term->savelines) {
+                    if (sb_count(term->scrollback) > 0)
+                        sb_drop_oldest(term->scrollback);
+                    else
+                        sb_stage_drop_oldest(term);
                 } else
                     term->tempsblines += 1;
 
-                addpos234(term->scrollback, compressline(line), sblen);
+                sb_stage_line(term, line);
 
                 /* now `line' itself can be reused as the bottom line */
 
@@ -2856,14 +4146,24 @@ static void erase_lots(Terminal *term,
         check_trust_status(term, ldata);
         while (poslt(start, end)) {
             check_line_size(term, ldata);
-            if (start.x == term->cols) {
-                if (!erase_lattr)
-                    ldata->lattr &= ~(LATTR_WRAPPED | LATTR_WRAPPED2);
-                else
-                    ldata->lattr = LATTR_NORM;
-            } else {
-                copy_termchar(ldata, start.x, &term->erase_char);
+
+            /* Blank all the cells we're erasing on this line in one
+             * go, rather than cell by cell. */
+            int endx = (start.y == end.y ? end.x : term->cols);
+            if (endx > start.x) {
+                fill_termchars(ldata, start.x, endx - start.x,
+                               &term->erase_char);
+                start.x = endx;
             }
+            if (!poslt(start, end))
+                break;
+
+            /* Now start.x == term->cols, the notional position beyond
+             * the last column, where we adjust the line attributes. */
+            if (!erase_lattr)
+                ldata->lattr &= ~(LATTR_WRAPPED | LATTR_WRAPPED2);
+            else
+                ldata->lattr = LATTR_NORM;
             if (incpos(start) && start.y < term->rows) {
                 ldata = scrlineptr(start.y);
                 check_trust_status(term, ldata);
@@ -2941,15 +4241,13 @@ static void insch(Terminal *term, int n)
             move_termchar(ldata,
                           ldata->chars + term->curs.x + j,
                           ldata->chars + term->curs.x + j + n);
-        while (n--)
-            copy_termchar(ldata, term->curs.x + m++, &term->erase_char);
+        fill_termchars(ldata, term->curs.x + m, n, &term->erase_char);
     } else {
         for (j = m; j-- ;)
             move_termchar(ldata,
                           ldata->chars + term->curs.x + j + n,
                           ldata->chars + term->curs.x + j);
-        while (n--)
-            copy_termchar(ldata, term->curs.x + n, &term->erase_char);
+        fill_termchars(ldata, term->curs.x, n, &term->erase_char);
     }
 }
 
@@ -3099,6 +4397,32 @@ static void toggle_mode(Terminal *term, int mode, int query, bool state)
 /*
  * Process an OSC sequence: set window title or icon name.
  */
+/*
+ * Queue a response to a terminal query sequence, to be sent back to
+ * the server as session input.
+ *
+ * Responses generated while processing a single buffer of session
+ * output are accumulated and sent to the ldisc in one go when
+ * term_out finishes. A full-screen application probing the terminal's
+ * capabilities at startup typically sends a burst of queries in one
+ * packet; answering each one with its own ldisc_send would turn that
+ * into an equal burst of tiny backend writes.
+ */
+static void term_queue_reply(Terminal *term, const void *data, size_t len)
+{
+    put_data(term->reply_buf, data, len);
+}
+
+static void term_flush_replies(Terminal *term)
+{
+    if (term->reply_buf->len) {
+        if (term->ldisc)
+            ldisc_send(term->ldisc, term->reply_buf->s,
+                       term->reply_buf->len, false);
+        strbuf_clear(term->reply_buf);
+    }
+}
+
 static void do_osc(Terminal *term)
 {
     if (term->osc_w) {
@@ -3138,8 +4462,7 @@ static void do_osc(Terminal *term)
                         (unsigned)colour.r * 0x0101,
                         (unsigned)colour.g * 0x0101,
                         (unsigned)colour.b * 0x0101);
-                    ldisc_send(term->ldisc, reply_buf, strlen(reply_buf),
-                               false);
+                    term_queue_reply(term, reply_buf, strlen(reply_buf));
                     sfree(reply_buf);
                 }
             }
@@ -3598,6 +4921,51 @@ unsigned long term_translate(
     return c;
 }
 
+/*
+ * Return true if the current character-set state is one in which
+ * term_translate() maps every printable ASCII byte (other than those
+ * remapped by unitab_ctrl) to itself with CSET_ASCII. This enables
+ * the fast path in term_out() for runs of plain text.
+ */
+static bool term_plain_ascii_state(Terminal *term)
+{
+    if (in_utf(term))
+        return term->utf8.state == 0 &&
+            !(term->utf8linedraw &&
+              term->cset_attr[term->cset] == CSET_LINEDRW);
+    return !term->sco_acs && term->cset_attr[term->cset] == CSET_ASCII;
+}
+
+/*
+ * Count the leading run of printable ASCII (0x20..0x7E) in a buffer,
+ * examining a word at a time. Each 8-byte chunk is tested in parallel
+ * for bytes with the top bit set (part of a multibyte UTF-8 sequence,
+ * or a high-half character), bytes below 0x20 and DEL, using the
+ * standard carry-propagation bit tricks; only the chunk containing
+ * the first such byte is rescanned one byte at a time. This is the
+ * portable equivalent of an SSE2/NEON range test, and makes bulk
+ * ASCII-dominated output cheap without any per-platform code.
+ */
+static size_t scan_plain_ascii(const unsigned char *p, size_t len)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = ones << 7;
+    size_t n = 0;
+
+    while (n + 8 <= len) {
+        uint64_t x, ctrls, dels;
+        memcpy(&x, p + n, 8);
+        ctrls = (x - 0x20 * ones) & ~x;    /* top bit set where byte < 0x20 */
+        dels = (x ^ (0x7F * ones)) - ones; /* top bit set where byte == 7F */
+        if ((x | ctrls | dels) & highs)
+            break;
+        n += 8;
+    }
+    while (n < len && p[n] - 0x20U < 0x5FU)
+        n++;
+    return n;
+}
+
 /*
  * Remove everything currently in `inbuf' and stick it up on the
  * in-memory display. There's a big state machine in here to
@@ -3609,6 +4977,34 @@ static void term_out(Terminal *term)
     int unget;
     unsigned char localbuf[256], *chars;
     size_t nchars = 0;
+    unsigned long plain_trans[256];
+    bool ascii_unmapped = true;
+    int uc;
+
+    /*
+     * Build a direct translation table for the stateless 'plain text'
+     * character-set state: each entry is either the value
+     * term_translate() would return for that byte in that state
+     * (always a graphic character, which the state machine below
+     * passes straight to term_display_graphic_char), or 0 if the byte
+     * needs the full state machine (C0 controls, DEL, and anything
+     * remapped by unitab_ctrl). This reduces byte -> character
+     * conversion in the fast path below to a single array load, and
+     * covers the high half of single-byte codepages, which the
+     * ASCII-only word scan cannot accept. While we're at it, note
+     * whether unitab_ctrl remaps any printable ASCII byte: almost
+     * always it doesn't, and then the word-at-a-time scan is safe.
+     */
+    for (uc = 0; uc < 256; uc++) {
+        if (uc < 0x20 || uc == 0x7F ||
+            term->ucsdata->unitab_ctrl[uc] != 0xFF) {
+            plain_trans[uc] = 0;
+            if (uc >= 0x20 && uc < 0x7F)
+                ascii_unmapped = false;
+        } else {
+            plain_trans[uc] = uc | CSET_ASCII;
+        }
+    }
 
     unget = -1;
 
@@ -3626,6 +5022,116 @@ static void term_out(Terminal *term)
                 assert(chars != NULL);
                 assert(nchars > 0);
             }
+            /*
+             * Fast path: if the terminal is in its ground state and
+             * the next bytes are a run of plain printable ASCII that
+             * the current character-set state maps straight through,
+             * display them without running the full state machine on
+             * each byte. This is by far the hottest path when large
+             * amounts of ordinary text are written to the terminal,
+             * e.g. cat-ing a big file.
+             *
+             * The scan below accepts exactly the bytes for which
+             * term_translate() in the current state would return a
+             * plain graphic character and the subsequent C1/DEL/C0
+             * checks would all fall through to
+             * term_display_graphic_char(). In UTF-8 mode that's
+             * printable ASCII only (high bytes are stateful); in a
+             * single-byte codepage, plain_trans[] also lets through
+             * the high half, so e.g. accented Latin text gets the
+             * same treatment.
+             */
+            if (term->termstate == TOPLEVEL && !term->printing &&
+                !(term->logtype == LGTYP_DEBUG && term->logctx) &&
+                term_plain_ascii_state(term)) {
+                size_t n;
+                n = ascii_unmapped ? scan_plain_ascii(chars, nchars) : 0;
+                if (in_utf(term)) {
+                    while (n < nchars && chars[n] < 0x80 &&
+                           plain_trans[chars[n]] != 0)
+                        n++;
+                } else {
+                    while (n < nchars && plain_trans[chars[n]] != 0)
+                        n++;
+                }
+                if (n > 0) {
+                    size_t i;
+                    for (i = 0; i < n; i++)
+                        term_display_graphic_char(term, plain_trans[chars[i]]);
+                    term->last_graphic_char = plain_trans[chars[n-1]];
+                    chars += n;
+                    nchars -= n;
+                    continue;
+                }
+
+                /*
+                 * Companion fast path for UTF-8 multibyte sequences,
+                 * so that CJK-heavy output doesn't fall back to the
+                 * big state machine for every continuation byte.
+                 * Decode whole well-formed 2- to 4-byte sequences
+                 * straight from the buffer, accepting only characters
+                 * that term_translate() would return unchanged and
+                 * that the C1/DEL/C0 checks below would pass straight
+                 * to term_display_graphic_char(): anything from U+00A0
+                 * up that isn't one of term_translate's special cases.
+                 * The first overlong, truncated, special or
+                 * buffer-straddling sequence stops the scan and is
+                 * left for the state machine, which will reproduce
+                 * its error handling exactly.
+                 */
+                if (in_utf(term) && nchars > 0 && chars[0] >= 0x80) {
+                    static const unsigned long utf8_min[5] =
+                        { 0, 0, 0x80, 0x800, 0x10000 };
+                    size_t pos = 0;
+                    unsigned long ch = 0;
+
+                    while (pos < nchars) {
+                        unsigned char b = chars[pos];
+                        unsigned long t;
+                        size_t seqlen, i;
+
+                        if ((b & 0xe0) == 0xc0)
+                            seqlen = 2;
+                        else if ((b & 0xf0) == 0xe0)
+                            seqlen = 3;
+                        else if ((b & 0xf8) == 0xf0)
+                            seqlen = 4;
+                        else
+                            break;     /* ASCII, stray continuation,
+                                        * or 5-/6-byte prefix */
+                        if (pos + seqlen > nchars)
+                            break;     /* sequence straddles the buffer */
+
+                        t = b & (0x7F >> seqlen);
+                        for (i = 1; i < seqlen; i++) {
+                            if ((chars[pos + i] & 0xC0) != 0x80)
+                                goto utf8_bulk_done;
+                            t = (t << 6) | (chars[pos + i] & 0x3F);
+                        }
+
+                        if (t < utf8_min[seqlen] ||    /* overlong */
+                            t < 0xA0 ||
+                            t == 0x2028 || t == 0x2029 ||
+                            (t >= 0xD800 && t < 0xE000) ||
+                            (t >= 0xE0000 && t <= 0xE007F) ||
+                            t == 0xFEFF || t == 0xFFFE || t == 0xFFFF ||
+                            t > 0x10FFFF)
+                            break;
+
+                        term_display_graphic_char(term, t);
+                        ch = t;
+                        pos += seqlen;
+                    }
+                  utf8_bulk_done:
+                    if (pos > 0) {
+                        term->last_graphic_char = ch;
+                        chars += pos;
+                        nchars -= pos;
+                        continue;
+                    }
+                }
+            }
+
             c = *chars++;
             nchars--;
 
@@ -3739,7 +5245,7 @@ static void term_out(Terminal *term)
                     strbuf *buf = term_input_data_from_charset(
                         term, DEFAULT_CODEPAGE,
                         term->answerback, term->answerbacklen);
-                    ldisc_send(term->ldisc, buf->s, buf->len, false);
+                    term_queue_reply(term, buf->s, buf->len);
                     strbuf_free(buf);
                 }
                 break;
@@ -3987,8 +5493,8 @@ static void term_out(Terminal *term)
                   case 'Z':            /* DECID: terminal type query */
                     compatibility(VT100);
                     if (term->ldisc)
-                        ldisc_send(term->ldisc, term->id_string,
-                                   strlen(term->id_string), false);
+                        term_queue_reply(term, term->id_string,
+                                         strlen(term->id_string));
                     break;
                   case 'c':            /* RIS: restore power-on settings */
                     compatibility(VT100);
@@ -4016,17 +5522,16 @@ static void term_out(Terminal *term)
                   case ANSI('8', '#'): { /* DECALN: fills screen with Es :-) */
                     compatibility(VT100);
                     termline *ldata;
-                    int i, j;
+                    termchar efill;
+                    int i;
                     pos scrtop, scrbot;
 
+                    efill = term->basic_erase_char;
+                    efill.chr = 'E';
                     for (i = 0; i < term->rows; i++) {
                         ldata = scrlineptr(i);
                         check_line_size(term, ldata);
-                        for (j = 0; j < term->cols; j++) {
-                            copy_termchar(ldata, j,
-                                          &term->basic_erase_char);
-                            ldata->chars[j].chr = 'E';
-                        }
+                        fill_termchars(ldata, 0, term->cols, &efill);
                         ldata->lattr = LATTR_NORM;
                     }
                     if (term->scroll_on_disp)
@@ -4184,8 +5689,7 @@ static void term_out(Terminal *term)
                         /* this reports xterm version 136 so that VIM can
                            use the drag messages from the mouse reporting */
                         if (term->ldisc)
-                            ldisc_send(term->ldisc, "\033[>0;136;0c", 11,
-                                       false);
+                            term_queue_reply(term, "\033[>0;136;0c", 11);
                         break;
                       case 'a':         /* HPR: move right N cols */
                         compatibility(ANSI);
@@ -4305,8 +5809,8 @@ static void term_out(Terminal *term)
                         compatibility(VT100);
                         /* This is the response for a VT102 */
                         if (term->ldisc)
-                            ldisc_send(term->ldisc, term->id_string,
-                                       strlen(term->id_string), false);
+                            term_queue_reply(term, term->id_string,
+                                             strlen(term->id_string));
                         break;
                       case 'n':       /* DSR: cursor position query */
                         if (term->ldisc) {
@@ -4314,10 +5818,9 @@ static void term_out(Terminal *term)
                                 char buf[32];
                                 sprintf(buf, "\033[%d;%dR", term->curs.y + 1,
                                         term->curs.x + 1);
-                                ldisc_send(term->ldisc, buf, strlen(buf),
-                                           false);
+                                term_queue_reply(term, buf, strlen(buf));
                             } else if (term->esc_args[0] == 5) {
-                                ldisc_send(term->ldisc, "\033[0n", 4, false);
+                                term_queue_reply(term, "\033[0n", 4);
                             }
                         }
                         break;
@@ -4720,16 +6223,15 @@ static void term_out(Terminal *term)
                                 break;
                               case 11:
                                 if (term->ldisc)
-                                    ldisc_send(term->ldisc, term->minimised ?
-                                               "\033[2t" : "\033[1t", 4,
-                                               false);
+                                    term_queue_reply(term, term->minimised ?
+                                                     "\033[2t" : "\033[1t", 4);
                                 break;
                               case 13:
                                 if (term->ldisc) {
                                     len = sprintf(buf, "\033[3;%u;%ut",
                                                   term->winpos_x,
                                                   term->winpos_y);
-                                    ldisc_send(term->ldisc, buf, len, false);
+                                    term_queue_reply(term, buf, len);
                                 }
                                 break;
                               case 14:
@@ -4737,14 +6239,14 @@ static void term_out(Terminal *term)
                                     len = sprintf(buf, "\033[4;%u;%ut",
                                                   term->winpixsize_y,
                                                   term->winpixsize_x);
-                                    ldisc_send(term->ldisc, buf, len, false);
+                                    term_queue_reply(term, buf, len);
                                 }
                                 break;
                               case 18:
                                 if (term->ldisc) {
                                     len = sprintf(buf, "\033[8;%d;%dt",
                                                   term->rows, term->cols);
-                                    ldisc_send(term->ldisc, buf, len, false);
+                                    term_queue_reply(term, buf, len);
                                 }
                                 break;
                               case 19:
@@ -4772,11 +6274,9 @@ static void term_out(Terminal *term)
                                     else
                                         p = EMPTY_WINDOW_TITLE;
                                     len = strlen(p);
-                                    ldisc_send(term->ldisc, "\033]L", 3,
-                                               false);
-                                    ldisc_send(term->ldisc, p, len, false);
-                                    ldisc_send(term->ldisc, "\033\\", 2,
-                                               false);
+                                    term_queue_reply(term, "\033]L", 3);
+                                    term_queue_reply(term, p, len);
+                                    term_queue_reply(term, "\033\\", 2);
                                 }
                                 break;
                               case 21:
@@ -4787,11 +6287,9 @@ static void term_out(Terminal *term)
                                     else
                                         p = EMPTY_WINDOW_TITLE;
                                     len = strlen(p);
-                                    ldisc_send(term->ldisc, "\033]l", 3,
-                                               false);
-                                    ldisc_send(term->ldisc, p, len, false);
-                                    ldisc_send(term->ldisc, "\033\\", 2,
-                                               false);
+                                    term_queue_reply(term, "\033]l", 3);
+                                    term_queue_reply(term, p, len);
+                                    term_queue_reply(term, "\033\\", 2);
                                 }
                                 break;
                             }
@@ -4868,9 +6366,7 @@ static void term_out(Terminal *term)
                         check_boundary(term, term->curs.x, term->curs.y);
                         check_boundary(term, term->curs.x+n, term->curs.y);
                         check_selection(term, term->curs, cursplus);
-                        while (n--)
-                            copy_termchar(cline, p++,
-                                          &term->erase_char);
+                        fill_termchars(cline, p, n, &term->erase_char);
                         seen_disp_event(term);
                         break;
                       }
@@ -4882,7 +6378,7 @@ static void term_out(Terminal *term)
                             if (i == 0 || i == 1) {
                                 strcpy(buf, "\033[2;1;1;112;112;1;0x");
                                 buf[2] += i;
-                                ldisc_send(term->ldisc, buf, 20, false);
+                                term_queue_reply(term, buf, 20);
                             }
                         }
                         break;
@@ -5306,7 +6802,7 @@ static void term_out(Terminal *term)
                     break;
                   case 'Z':
                     if (term->ldisc)
-                        ldisc_send(term->ldisc, "\033/Z", 3, false);
+                        term_queue_reply(term, "\033/Z", 3);
                     break;
                   case '=':
                     term->app_keypad_keys = true;
@@ -5467,6 +6963,7 @@ static void term_out(Terminal *term)
         }
     }
 
+    term_flush_replies(term);
     term_print_flush(term);
     if (term->logflush && term->logctx)
         logflush(term->logctx);
@@ -5577,6 +7074,177 @@ static void term_bidi_cache_store(Terminal *term, int line, termchar *lbefore,
     }
 }
 
+/*
+ * In addition to the per-row cache above, we keep a small
+ * direct-mapped cache keyed by a hash of the line's content, so that
+ * identical lines appearing on many display rows (a common pattern in
+ * logs and full-screen TUIs) run the bidi and shaping algorithms only
+ * once between them. Hash collisions are resolved by a full
+ * comparison of the stored source line, so a hit is always exact.
+ */
+static unsigned term_bidi_hash(termchar *lbefore, int width, bool trusted)
+{
+    unsigned h = 2166136261u + (trusted ? 1 : 0);
+    int i;
+    for (i = 0; i < width; i++) {
+        h = (h ^ (unsigned)lbefore[i].chr) * 16777619u;
+        h = (h ^ (unsigned)lbefore[i].attr) * 16777619u;
+    }
+    return h;
+}
+
+static struct bidi_shared_cache_entry *term_bidi_shared_lookup(
+    Terminal *term, unsigned hash, termchar *lbefore, int width,
+    bool trusted)
+{
+    struct bidi_shared_cache_entry *e;
+    int i;
+
+    if (!term->bidi_shared_cache)
+        return NULL;
+    e = &term->bidi_shared_cache[hash % BIDI_SHARED_CACHE_SIZE];
+    if (!e->pre_chars || e->hash != hash || e->width != width ||
+        e->trusted != trusted)
+        return NULL;
+    for (i = 0; i < width; i++)
+        if (!termchars_equal(e->pre_chars + i, lbefore + i))
+            return NULL;
+    return e;
+}
+
+static void term_bidi_shared_store(Terminal *term, unsigned hash,
+                                   termchar *lbefore, termchar *lafter,
+                                   int *forward, int *backward,
+                                   int width, int size, bool trusted)
+{
+    struct bidi_shared_cache_entry *e;
+
+    if (!term->bidi_shared_cache) {
+        int i;
+        term->bidi_shared_cache = snewn(BIDI_SHARED_CACHE_SIZE,
+                                        struct bidi_shared_cache_entry);
+        for (i = 0; i < BIDI_SHARED_CACHE_SIZE; i++) {
+            term->bidi_shared_cache[i].pre_chars = NULL;
+            term->bidi_shared_cache[i].post_chars = NULL;
+            term->bidi_shared_cache[i].forward = NULL;
+            term->bidi_shared_cache[i].backward = NULL;
+        }
+    }
+
+    e = &term->bidi_shared_cache[hash % BIDI_SHARED_CACHE_SIZE];
+    sfree(e->pre_chars);
+    sfree(e->post_chars);
+    sfree(e->forward);
+    sfree(e->backward);
+
+    e->hash = hash;
+    e->width = width;
+    e->size = size;
+    e->trusted = trusted;
+    e->pre_chars = snewn(size, termchar);
+    e->post_chars = snewn(size, termchar);
+    e->forward = snewn(width, int);
+    e->backward = snewn(width, int);
+    memcpy(e->pre_chars, lbefore, size * TSIZE);
+    memcpy(e->post_chars, lafter, size * TSIZE);
+    memcpy(e->forward, forward, width * sizeof(int));
+    memcpy(e->backward, backward, width * sizeof(int));
+}
+
+/*
+ * Install a precomputed transformation (from the shared cache) into
+ * the per-row cache, the same way term_bidi_cache_store() would have
+ * after running the algorithms.
+ */
+static void term_bidi_cache_install(Terminal *term, int line,
+                                    struct bidi_shared_cache_entry *e)
+{
+    size_t j;
+
+    if (!term->pre_bidi_cache || term->bidi_cache_size <= (size_t)line) {
+        j = term->bidi_cache_size;
+        sgrowarray(term->pre_bidi_cache, term->bidi_cache_size, line);
+        term->post_bidi_cache = sresize(term->post_bidi_cache,
+                                        term->bidi_cache_size,
+                                        struct bidi_cache_entry);
+        while (j < term->bidi_cache_size) {
+            term->pre_bidi_cache[j].chars =
+                term->post_bidi_cache[j].chars = NULL;
+            term->pre_bidi_cache[j].width =
+                term->post_bidi_cache[j].width = -1;
+            term->pre_bidi_cache[j].trusted = false;
+            term->post_bidi_cache[j].trusted = false;
+            term->pre_bidi_cache[j].forward =
+                term->post_bidi_cache[j].forward = NULL;
+            term->pre_bidi_cache[j].backward =
+                term->post_bidi_cache[j].backward = NULL;
+            j++;
+        }
+    }
+
+    sfree(term->pre_bidi_cache[line].chars);
+    sfree(term->post_bidi_cache[line].chars);
+    sfree(term->post_bidi_cache[line].forward);
+    sfree(term->post_bidi_cache[line].backward);
+
+    term->pre_bidi_cache[line].width = e->width;
+    term->pre_bidi_cache[line].trusted = e->trusted;
+    term->pre_bidi_cache[line].chars = snewn(e->size, termchar);
+    term->post_bidi_cache[line].width = e->width;
+    term->post_bidi_cache[line].trusted = e->trusted;
+    term->post_bidi_cache[line].chars = snewn(e->size, termchar);
+    term->post_bidi_cache[line].forward = snewn(e->width, int);
+    term->post_bidi_cache[line].backward = snewn(e->width, int);
+
+    memcpy(term->pre_bidi_cache[line].chars, e->pre_chars, e->size * TSIZE);
+    memcpy(term->post_bidi_cache[line].chars, e->post_chars, e->size * TSIZE);
+    memcpy(term->post_bidi_cache[line].forward, e->forward,
+           e->width * sizeof(int));
+    memcpy(term->post_bidi_cache[line].backward, e->backward,
+           e->width * sizeof(int));
+}
+
+/*
+ * Return true if a line consists entirely of characters on which both
+ * the bidi algorithm and Arabic shaping are guaranteed to be the
+ * identity: no RTL or shaping-class characters, no wide-character
+ * cells, nothing left in a magic character set. For such lines (the
+ * overwhelming majority in LTR sessions) term_bidi_line() can skip
+ * the algorithms entirely.
+ */
+static bool term_line_is_pure_ltr(Terminal *term, struct termline *ldata)
+{
+    int it;
+
+    for (it = 0; it < term->cols; it++) {
+        unsigned long uc = ldata->chars[it].chr;
+
+        switch (uc & CSET_MASK) {
+          case CSET_LINEDRW:
+            if (!term->rawcnp) {
+                uc = term->ucsdata->unitab_xterm[uc & 0xFF];
+                break;
+            }
+          case CSET_ASCII:
+            uc = term->ucsdata->unitab_line[uc & 0xFF];
+            break;
+          case CSET_SCOACS:
+            uc = term->ucsdata->unitab_scoacs[uc & 0xFF];
+            break;
+        }
+
+        /*
+         * U+0590 is the start of the Hebrew block, below which there
+         * are no RTL or shaping-relevant characters; anything still
+         * carrying character-set bits (including UCSWIDE) fails this
+         * test and takes the full path.
+         */
+        if (uc >= 0x0590)
+            return false;
+    }
+    return true;
+}
+
 /*
  * Prepare the bidi information for a screen line. Returns the
  * transformed list of termchars, or NULL if no transformation at
@@ -5595,9 +7263,28 @@ static termchar *term_bidi_line(Terminal *term, struct termline *ldata,
     if (!term->no_bidi || !term->no_arabicshaping ||
         (ldata->trusted && term->cols > TRUST_SIGIL_WIDTH)) {
 
+        /*
+         * Early out: if the line contains nothing bidi or shaping
+         * could act on, the transformation is the identity, which is
+         * exactly what returning NULL means.
+         */
+        if (!(ldata->trusted && term->cols > TRUST_SIGIL_WIDTH) &&
+            term_line_is_pure_ltr(term, ldata))
+            return NULL;
+
         if (!term_bidi_cache_hit(term, scr_y, ldata->chars, term->cols,
                                  ldata->trusted)) {
 
+            unsigned hash = term_bidi_hash(ldata->chars, term->cols,
+                                           ldata->trusted);
+            struct bidi_shared_cache_entry *shared =
+                term_bidi_shared_lookup(term, hash, ldata->chars,
+                                        term->cols, ldata->trusted);
+            if (shared) {
+                term_bidi_cache_install(term, scr_y, shared);
+                return term->post_bidi_cache[scr_y].chars;
+            }
+
             if (term->wcFromTo_size < term->cols) {
                 term->wcFromTo_size = term->cols;
                 term->wcFrom = sresize(term->wcFrom, term->wcFromTo_size,
@@ -5705,6 +7392,10 @@ static termchar *term_bidi_line(Terminal *term, struct termline *ldata,
             term_bidi_cache_store(term, scr_y, ldata->chars,
                                   term->ltemp, term->wcTo,
                                   term->cols, ldata->size, ldata->trusted);
+            term_bidi_shared_store(term, hash, ldata->chars, term->ltemp,
+                                   term->post_bidi_cache[scr_y].forward,
+                                   term->post_bidi_cache[scr_y].backward,
+                                   term->cols, ldata->size, ldata->trusted);
 
             lchars = term->ltemp;
         } else {
@@ -5748,15 +7439,122 @@ static void do_paint(Terminal *term)
     pos scrpos;
     wchar_t *ch;
     size_t chlen;
-    termchar *newline;
+    unsigned long *newchr, *newattr;
+    truecolour *newtc;
+    int old_dispcursy;
+    bool selected_now, can_skip_clean_lines;
 
     chlen = 1024;
     ch = snewn(chlen, wchar_t);
 
-    newline = snewn(term->cols, termchar);
+    /*
+     * Scratch copy of the row we're working towards displaying,
+     * stored as separate per-field arrays rather than an array of
+     * termchars. The scans below mostly want to sweep one or two
+     * fields across the whole row, so splitting the fields out keeps
+     * those sweeps dense in cache, and leaves the character and
+     * attribute data as flat word arrays. (Combining characters are
+     * read from lchars, so no cc_next column is needed.)
+     */
+    newchr = snewn(term->cols, unsigned long);
+    newattr = snewn(term->cols, unsigned long);
+    newtc = snewn(term->cols, truecolour);
 
     rv = (!term->rvideo ^ !term->in_vbell ? ATTR_REVERSE : 0);
 
+    /*
+     * If the displayed content has moved vertically since the last
+     * paint - the screen scrolled, or the user moved the scrollback
+     * view - ask the front end to blit the already-drawn pixels into
+     * their new position, and rearrange disptext to match, so that
+     * the per-cell comparison below only redraws the newly exposed
+     * lines. The blit is purely an optimisation: disptext is
+     * permuted in exactly the same way as the pixels, so whatever
+     * doesn't really match the intended display still gets repainted.
+     */
+    {
+        int shift = term->dispscroll_lines;
+        int top = term->dispscroll_top, size = term->dispscroll_size;
+        bool usable = !term->dispscroll_unusable;
+        int view_delta = term->disptop - term->paint_last_disptop;
+
+        if (view_delta) {
+            /*
+             * A change of view position shifts the entire window, so
+             * it can only combine with a recorded scroll of the whole
+             * screen.
+             */
+            if (shift == 0 || (top == 0 && size == term->rows)) {
+                shift += view_delta;
+                top = 0;
+                size = term->rows;
+            } else {
+                usable = false;
+            }
+        }
+
+        if (usable && shift != 0 && abs(shift) < size &&
+            top >= 0 && top + size <= term->rows && !term->paint_forced &&
+            win_draw_scroll(term->win, top, top + size - 1, shift)) {
+            int n = abs(shift), keep = size - n, k;
+            termline **tmp = snewn(n, termline *);
+
+            if (shift > 0) {
+                /* Content moved up; the top n lines cycle round to
+                 * the bottom of the region and become invalid. */
+                memcpy(tmp, term->disptext + top, n * sizeof(termline *));
+                memmove(term->disptext + top, term->disptext + top + n,
+                        keep * sizeof(termline *));
+                memcpy(term->disptext + top + keep, tmp,
+                       n * sizeof(termline *));
+            } else {
+                memcpy(tmp, term->disptext + top + keep,
+                       n * sizeof(termline *));
+                memmove(term->disptext + top + n, term->disptext + top,
+                        keep * sizeof(termline *));
+                memcpy(term->disptext + top, tmp, n * sizeof(termline *));
+            }
+
+            for (k = 0; k < n; k++) {
+                termline *l = term->disptext[
+                    shift > 0 ? top + keep + k : top + k];
+                for (j = 0; j < l->cols; j++)
+                    l->chars[j].attr |= ATTR_INVALID;
+            }
+            sfree(tmp);
+
+            /* The last-drawn cursor image moved with the blit. */
+            if (term->dispcursy >= top && term->dispcursy < top + size) {
+                term->dispcursy -= shift;
+                if (term->dispcursy < top || term->dispcursy >= top + size)
+                    term->dispcursx = term->dispcursy = -1;
+            }
+        }
+        reset_display_scroll(term);
+    }
+
+    /*
+     * Decide whether lines whose backing termline hasn't been touched
+     * since the last paint can skip the per-cell comparison scan
+     * entirely. This is only sound if nothing _global_ that feeds
+     * into a cell's displayed appearance has changed either: the
+     * scroll position, global reverse video, an active or
+     * just-dismissed selection, or the phase of text blinking. Lines
+     * containing the cursor (old or new position) are always
+     * rescanned.
+     */
+    selected_now = (term->selstate == DRAGGING ||
+                    term->selstate == SELECTED);
+    can_skip_clean_lines =
+        !term->paint_forced &&
+        term->scrdirty != NULL &&
+        term->disptop == term->paint_last_disptop &&
+        rv == term->paint_last_rv &&
+        !selected_now && !term->paint_last_selected &&
+        !(term->blink_is_real &&
+          term->tblinker != term->paint_last_tblinker);
+    old_dispcursy = term->dispcursy;
+
     /* Depends on:
      * screen array, disptop, scrtop,
      * selection, rv,
@@ -5802,7 +7600,7 @@ static void do_paint(Terminal *term)
             lchars[our_curs_x].chr == UCSWIDE)
             our_curs_x--;
 
-        unlineptr(ldata);
+        unlineptr(term, ldata);
     }
 
     /*
@@ -5839,9 +7637,16 @@ static void do_paint(Terminal *term)
         int laststart;
         bool dirtyrect;
         int *backward;
+        int work_start, work_end;
         truecolour tc;
 
         scrpos.y = i + term->disptop;
+
+        if (can_skip_clean_lines && i != our_curs_y && i != old_dispcursy &&
+            !(scrpos.y >= 0 && scrpos.y < term->rows &&
+              term->scrdirty[scrpos.y]))
+            continue;
+
         ldata = lineptr(scrpos.y);
 
         /* Do Arabic shaping and bidi. */
@@ -5941,11 +7746,40 @@ static void do_paint(Terminal *term)
             }
 
             /* FULL-TERMCHAR */
-            newline[j].attr = tattr;
-            newline[j].chr = tchar;
-            newline[j].truecolour = tc;
+            newattr[j] = tattr;
+            newchr[j] = tchar;
+            newtc[j] = tc;
             /* Combining characters are still read from lchars */
-            newline[j].cc_next = 0;
+        }
+
+        /*
+         * Quick scan: if every cell already matches what we want -
+         * same character, same attributes apart from the
+         * display-internal DATTR bits, same colours, and no combining
+         * characters on either side - then the change-marking and
+         * run-splitting loops below have nothing at all to do, and we
+         * can move straight on to the next line. The DATTR bits have
+         * to be masked out cell by cell, which is why this can't be a
+         * flat memcmp of the two arrays, but a comparison this simple
+         * still costs far less than the logic it skips. A cell the
+         * cursor has just arrived on fails the comparison (newattr[]
+         * carries the cursor attribute and disptext's copy is masked
+         * off), so cursor movement still repaints the line.
+         */
+        if (!term->ucsdata->dbcs_screenfont &&
+            ldata->lattr == term->disptext[i]->lattr) {
+            const termchar *dispc = term->disptext[i]->chars;
+            for (j = 0; j < term->cols; j++) {
+                if (dispc[j].chr != newchr[j] ||
+                    (dispc[j].attr &~ DATTR_MASK) != newattr[j] ||
+                    !truecolour_equal(dispc[j].truecolour, newtc[j]) ||
+                    dispc[j].cc_next != 0 || lchars[j].cc_next != 0)
+                    break;
+            }
+            if (j == term->cols) {
+                unlineptr(term, ldata);
+                continue;
+            }
         }
 
         /*
@@ -5970,9 +7804,9 @@ static void do_paint(Terminal *term)
                 dirtyrect = false;
             }
 
-            if (term->disptext[i]->chars[j].chr != newline[j].chr ||
+            if (term->disptext[i]->chars[j].chr != newchr[j] ||
                 (term->disptext[i]->chars[j].attr &~ DATTR_MASK)
-                != newline[j].attr) {
+                != newattr[j]) {
                 int k;
 
                 if (!dirtyrect) {
@@ -5994,28 +7828,91 @@ static void do_paint(Terminal *term)
                                   term->disptext[i]->lattr);
         term->disptext[i]->lattr = ldata->lattr;
 
+        /*
+         * Find the span of cells the drawing loop below actually has
+         * work in: cells differing from the display copy (including
+         * everything invalidated above) or involved with combining
+         * characters. Cells outside the span are already displayed
+         * correctly, and since a clean cell always starts a fresh
+         * run, the loop can enter at the span's start with fresh run
+         * state, and stop once it has flushed the last dirty run,
+         * instead of rediscovering run boundaries across the whole
+         * width of the window. Not valid when the whole line must be
+         * redrawn, nor for DBCS fonts, whose run accounting needs
+         * the full line.
+         */
+        work_start = 0;
+        work_end = term->cols - 1;
+        if (!term->ucsdata->dbcs_screenfont && !dirty_line) {
+            const termchar *dispc = term->disptext[i]->chars;
+            while (work_start < term->cols &&
+                   dispc[work_start].chr == newchr[work_start] &&
+                   (dispc[work_start].attr &~ DATTR_MASK) ==
+                   newattr[work_start] &&
+                   truecolour_equal(dispc[work_start].truecolour,
+                                    newtc[work_start]) &&
+                   dispc[work_start].cc_next == 0 &&
+                   lchars[work_start].cc_next == 0)
+                work_start++;
+            while (work_end > work_start &&
+                   dispc[work_end].chr == newchr[work_end] &&
+                   (dispc[work_end].attr &~ DATTR_MASK) ==
+                   newattr[work_end] &&
+                   truecolour_equal(dispc[work_end].truecolour,
+                                    newtc[work_end]) &&
+                   dispc[work_end].cc_next == 0 &&
+                   lchars[work_end].cc_next == 0)
+                work_end--;
+
+            if (work_start > 0) {
+                /* Don't enter on the right-hand half of a wide
+                 * character. */
+                if (newchr[work_start] == UCSWIDE)
+                    work_start--;
+                /*
+                 * If the preceding clean cell would occupy more than
+                 * one wchar_t, the full scan would not have broken
+                 * the run at work_start; enter at that cell instead,
+                 * which as a clean cell is always a run boundary.
+                 */
+                if (work_start > 0) {
+                    int p = work_start - 1;
+                    if (p > 0 && newchr[p] == UCSWIDE)
+                        p--;
+                    if (newchr[p] > 0xFFFF)
+                        work_start = p;
+                }
+            }
+        }
+
         tc = term->erase_char.truecolour;
-        for (j = 0; j < term->cols; j++) {
+        if (work_start > 0) {
+            start = work_start;
+            attr = newattr[work_start];
+            tc = newtc[work_start];
+            cset = CSET_OF(newchr[work_start]);
+        }
+        for (j = work_start; j < term->cols; j++) {
             unsigned long tattr, tchar;
             bool break_run, do_copy;
             termchar *d = lchars + j;
 
-            tattr = newline[j].attr;
-            tchar = newline[j].chr;
+            tattr = newattr[j];
+            tchar = newchr[j];
 
             if ((term->disptext[i]->chars[j].attr ^ tattr) & ATTR_WIDE)
                 dirty_line = true;
 
             break_run = ((tattr ^ attr) & term->attr_mask) != 0;
 
-            if (!truecolour_equal(newline[j].truecolour, tc))
+            if (!truecolour_equal(newtc[j], tc))
                 break_run = true;
 
 #ifdef USES_VTLINE_HACK
             /* Special hack for VT100 Linedraw glyphs */
             if ((tchar >= 0x23BA && tchar <= 0x23BD) ||
-                (j > 0 && (newline[j-1].chr >= 0x23BA &&
-                           newline[j-1].chr <= 0x23BD)))
+                (j > 0 && (newchr[j-1] >= 0x23BA &&
+                           newchr[j-1] <= 0x23BD)))
                 break_run = true;
 #endif
 
@@ -6057,13 +7954,21 @@ static void do_paint(Terminal *term)
                 start = j;
                 ccount = 0;
                 attr = tattr;
-                tc = newline[j].truecolour;
+                tc = newtc[j];
                 cset = CSET_OF(tchar);
                 if (term->ucsdata->dbcs_screenfont)
                     last_run_dirty = dirty_run;
                 dirty_run = dirty_line;
             }
 
+            /*
+             * Past the end of the work span, the first clean cell
+             * breaks the run and flushes any final dirty one, after
+             * which nothing on the line can generate more drawing.
+             */
+            if (j > work_end && !dirty_run)
+                break;
+
             do_copy = false;
             if (!termchars_equal_override(&term->disptext[i]->chars[j],
                                           d, tchar, tattr)) {
@@ -6144,10 +8049,21 @@ static void do_paint(Terminal *term)
         if (dirty_run && ccount > 0)
             do_paint_draw(term, ldata, start, i, ch, ccount, attr, tc);
 
-        unlineptr(ldata);
+        unlineptr(term, ldata);
     }
 
-    sfree(newline);
+    /* The screen now matches its backing data: reset damage state. */
+    if (term->scrdirty)
+        memset(term->scrdirty, 0, term->rows * sizeof(bool));
+    term->paint_forced = false;
+    term->paint_last_disptop = term->disptop;
+    term->paint_last_rv = rv;
+    term->paint_last_selected = selected_now;
+    term->paint_last_tblinker = term->tblinker;
+
+    sfree(newchr);
+    sfree(newattr);
+    sfree(newtc);
     sfree(ch);
 }
 
@@ -6162,6 +8078,8 @@ void term_invalidate(Terminal *term)
         for (j = 0; j < term->cols; j++)
             term->disptext[i]->chars[j].attr |= ATTR_INVALID;
 
+    term->paint_forced = true;
+
     term_schedule_update(term);
 }
 
@@ -6186,6 +8104,8 @@ void term_paint(Terminal *term,
                 term->disptext[i]->chars[j].attr |= ATTR_INVALID;
     }
 
+    term->paint_forced = true;
+
     if (immediately) {
         do_paint(term);
     } else {
@@ -6239,16 +8159,71 @@ void term_scroll_to_selection(Terminal *term, int which_end)
 }
 
 /*
- * Helper routine for clipme(): growing buffer.
+ * Hit-test a display position (x, y in character cells, y relative to
+ * the current scroll position) against the detected URLs. Returns
+ * true if the cell lies within a URL span, filling in its start and
+ * end (exclusive) columns on that display line. Intended for front
+ * ends implementing clickable links: for live screen lines this is a
+ * lookup of precomputed spans (revalidated first if the row has
+ * changed since the background scan last visited it), and only for
+ * scrollback lines - whose termlines are decompressed temporaries
+ * with nowhere to cache spans - do we scan on demand, which happens
+ * at mouse-event rate rather than output rate.
+ */
+bool term_url_at(Terminal *term, int x, int y, int *urlstart, int *urlend)
+{
+    termline *line;
+    bool ret = false;
+    int scry = y + term->disptop;
+    int i;
+
+    if (y < 0 || y >= term->rows)
+        return false;
+
+    if (scry >= 0) {
+        line = index234(term->screen, scry);
+        if (!line)
+            return false;
+        if (term->url_dirty && term->url_dirty[scry]) {
+            term->url_dirty[scry] = false;
+            term_url_scan_line(line);
+        }
+    } else {
+        line = lineptr(scry);
+        term_url_scan_line(line);
+    }
+
+    for (i = 0; i < line->nurls; i++) {
+        int start = line->urls[2*i], end = line->urls[2*i+1];
+        if (x >= start && x < end && end <= line->cols) {
+            *urlstart = start;
+            *urlend = end;
+            ret = true;
+            break;
+        }
+    }
+
+    if (scry < 0)
+        unlineptr(term, line);
+    return ret;
+}
+
+/*
+ * Helper routine for clipme(): growing buffer. The attribute and
+ * colour buffers may be NULL, if no consumer of this copy is going to
+ * want formatting information: every wchar of text costs three or
+ * four times its own size in attributes and truecolours, so for a
+ * huge copy (select-all on a deep scrollback) it's worth not
+ * materialising data that will simply be thrown away.
  */
 typedef struct {
     size_t bufsize;         /* amount of allocated space in textbuf/attrbuf */
     size_t bufpos;          /* amount of actual data */
     wchar_t *textbuf;       /* buffer for copied text */
     wchar_t *textptr;       /* = textbuf + bufpos (current insertion point) */
-    int *attrbuf;           /* buffer for copied attributes */
+    int *attrbuf;           /* buffer for copied attributes, or NULL */
     int *attrptr;           /* = attrbuf + bufpos */
-    truecolour *tcbuf;      /* buffer for copied colours */
+    truecolour *tcbuf;      /* buffer for copied colours, or NULL */
     truecolour *tcptr;      /* = tcbuf + bufpos */
 } clip_workbuf;
 
@@ -6257,14 +8232,20 @@ static void clip_addchar(clip_workbuf *b, wchar_t chr, int attr, truecolour tc)
     if (b->bufpos >= b->bufsize) {
         sgrowarray(b->textbuf, b->bufsize, b->bufpos);
         b->textptr = b->textbuf + b->bufpos;
-        b->attrbuf = sresize(b->attrbuf, b->bufsize, int);
-        b->attrptr = b->attrbuf + b->bufpos;
-        b->tcbuf = sresize(b->tcbuf, b->bufsize, truecolour);
-        b->tcptr = b->tcbuf + b->bufpos;
+        if (b->attrbuf) {
+            b->attrbuf = sresize(b->attrbuf, b->bufsize, int);
+            b->attrptr = b->attrbuf + b->bufpos;
+        }
+        if (b->tcbuf) {
+            b->tcbuf = sresize(b->tcbuf, b->bufsize, truecolour);
+            b->tcptr = b->tcbuf + b->bufpos;
+        }
     }
     *b->textptr++ = chr;
-    *b->attrptr++ = attr;
-    *b->tcptr++ = tc;
+    if (b->attrbuf)
+        *b->attrptr++ = attr;
+    if (b->tcbuf)
+        *b->tcptr++ = tc;
     b->bufpos++;
 }
 
@@ -6279,8 +8260,18 @@ static void clipme(Terminal *term, pos top, pos bottom, bool rect, bool desel,
     buf.bufsize = 5120;
     buf.bufpos = 0;
     buf.textptr = buf.textbuf = snewn(buf.bufsize, wchar_t);
-    buf.attrptr = buf.attrbuf = snewn(buf.bufsize, int);
-    buf.tcptr = buf.tcbuf = snewn(buf.bufsize, truecolour);
+    /*
+     * Only the Windows RTF export looks at the attributes and
+     * colours of a copy, so unless that's enabled, plain text is all
+     * we need to collect.
+     */
+    if (term->rtf_paste) {
+        buf.attrptr = buf.attrbuf = snewn(buf.bufsize, int);
+        buf.tcptr = buf.tcbuf = snewn(buf.bufsize, truecolour);
+    } else {
+        buf.attrptr = buf.attrbuf = NULL;
+        buf.tcptr = buf.tcbuf = NULL;
+    }
 
     old_top_x = top.x;                 /* needed for rect==1 */
 
@@ -6432,7 +8423,7 @@ static void clipme(Terminal *term, pos top, pos bottom, bool rect, bool desel,
         top.y++;
         top.x = rect ? old_top_x : 0;
 
-        unlineptr(ldata);
+        unlineptr(term, ldata);
     }
 #if SELECTION_NUL_TERMINATED
     clip_addchar(&buf, 0, 0, term->basic_erase_char.truecolour);
@@ -6690,10 +8681,10 @@ static pos sel_spread_half(Terminal *term, pos p, int dir)
                             == wvalue) {
                             p.x = 0;
                             p.y++;
-                            unlineptr(ldata);
+                            unlineptr(term, ldata);
                             ldata = ldata2;
                         } else {
-                            unlineptr(ldata2);
+                            unlineptr(term, ldata2);
                             break;
                         }
                     } else
@@ -6719,10 +8710,10 @@ static pos sel_spread_half(Terminal *term, pos p, int dir)
                             == wvalue) {
                             p.x = maxcols-1;
                             p.y--;
-                            unlineptr(ldata);
+                            unlineptr(term, ldata);
                             ldata = ldata2;
                         } else {
-                            unlineptr(ldata2);
+                            unlineptr(term, ldata2);
                             break;
                         }
                     } else
@@ -6739,7 +8730,7 @@ static pos sel_spread_half(Terminal *term, pos p, int dir)
         break;
     }
 
-    unlineptr(ldata);
+    unlineptr(term, ldata);
     return p;
 }
 
@@ -6753,13 +8744,48 @@ static void sel_spread(Terminal *term)
     }
 }
 
+/*
+ * How much of the paste buffer we're prepared to push through the
+ * line discipline in one toplevel callback. The ldisc batches
+ * everything sent within one event cycle into a single backend send,
+ * so this is also roughly the size of the data blocks the backend
+ * sees during a large paste; pausing between blocks keeps the UI
+ * responsive and lets a keypress interrupt the paste.
+ */
+#define PASTE_CYCLE_LIMIT 16384
+
+/*
+ * How much data we'll allow to pile up between us and the network
+ * before pausing a paste, and how long we wait before checking the
+ * buffer level again.
+ */
+#define PASTE_BUFFER_LIMIT 32768
+#define PASTE_THROTTLE_DELAY (TICKSPERSEC / 50)
+
 static void term_paste_callback(void *vterm)
 {
     Terminal *term = (Terminal *)vterm;
+    int budget = PASTE_CYCLE_LIMIT;
 
     if (term->paste_len == 0)
         return;
 
+    /*
+     * Flow control: if the connection hasn't yet drained what we've
+     * already handed over, don't shovel in more; leave the rest of
+     * the paste where it is and retry on a timer. This keeps a
+     * multi-megabyte paste into a slow connection from ballooning
+     * the send buffer, and means a keypress interrupting the paste
+     * still abandons everything not yet sent.
+     */
+    if (term->ldisc &&
+        ldisc_sendbuffer(term->ldisc) >= PASTE_BUFFER_LIMIT) {
+        term->paste_throttled = true;
+        term->paste_throttle_end = schedule_timer(
+            PASTE_THROTTLE_DELAY, term_timer, term);
+        return;
+    }
+
     while (term->paste_pos < term->paste_len) {
         int n = 0;
         while (n + term->paste_pos < term->paste_len) {
@@ -6773,8 +8799,9 @@ static void term_paste_callback(void *vterm)
             strbuf_free(buf);
         }
         term->paste_pos += n;
+        budget -= n;
 
-        if (term->paste_pos < term->paste_len) {
+        if (term->paste_pos < term->paste_len && budget <= 0) {
             queue_toplevel_callback(term_paste_callback, term);
             return;
         }
@@ -6939,7 +8966,7 @@ void term_mouse(Terminal *term, Mouse_Button braw, Mouse_Button bcooked,
     }
 
     selpoint.x = x;
-    unlineptr(ldata);
+    unlineptr(term, ldata);
 
     /*
      * If we're in the middle of a selection operation, we ignore raw
@@ -7678,7 +9705,19 @@ int term_get_userpass_input(Terminal *term, prompts_t *p)
 
 void term_notify_minimised(Terminal *term, bool minimised)
 {
+    if (term->minimised == minimised)
+        return;
     term->minimised = minimised;
+    if (!minimised) {
+        /*
+         * Restart the blink timers suspended while we were
+         * minimised, and refresh the window in case blinking state
+         * was frozen mid-phase.
+         */
+        term_schedule_tblink(term);
+        term_schedule_cblink(term);
+        term_schedule_update(term);
+    }
 }
 
 void term_notify_palette_changed(Terminal *term)
@@ -59,6 +59,17 @@ struct termline {
     int cc_free;                       /* offset to first cc in free list */
     struct termchar *chars;
     bool trusted;
+
+    /*
+     * Detected URL spans within this line, stored flat as (start,
+     * end-exclusive) column pairs: span i occupies urls[2*i] and
+     * urls[2*i+1]. Maintained lazily by the incremental URL scan in
+     * terminal.c, so they may be stale until the line's screen row
+     * has been rescanned; term_url_at() revalidates before use.
+     */
+    unsigned short *urls;
+    int nurls;                         /* number of (start,end) pairs */
+    int urlsize;                       /* allocated shorts in 'urls' */
 };
 
 struct bidi_cache_entry {
@@ -68,6 +79,20 @@ struct bidi_cache_entry {
     int *forward, *backward;           /* the permutations of line positions */
 };
 
+/*
+ * An entry in the shared (cross-row) bidi cache, which is keyed by a
+ * hash of the line's content rather than by display row, so that
+ * identical lines appearing on many rows (common in logs and TUIs)
+ * share one shaping computation.
+ */
+struct bidi_shared_cache_entry {
+    unsigned hash;
+    int width, size;
+    bool trusted;
+    struct termchar *pre_chars, *post_chars;
+    int *forward, *backward;
+};
+
 struct term_utf8_decode {
     int state;                         /* Is there a pending UTF-8 character */
     int chr;                           /* and what is it so far? */
@@ -78,7 +103,7 @@ struct terminal_tag {
 
     int compatibility_level;
 
-    tree234 *scrollback;               /* lines scrolled off top of screen */
+    struct scrollback *scrollback;     /* lines scrolled off top of screen */
     tree234 *screen;                   /* lines on primary screen */
     tree234 *alt_screen;               /* lines on alternate screen */
     int disptop;                       /* distance scrolled back (0 or -ve) */
@@ -88,8 +113,61 @@ struct terminal_tag {
 
     termline **disptext;               /* buffer of text on real screen */
     int dispcursx, dispcursy;          /* location of cursor on real screen */
+
+    /*
+     * Damage tracking, so that do_paint() can skip its per-cell
+     * comparison scan for lines that cannot have changed appearance
+     * since the previous paint.
+     */
+    bool *scrdirty;                    /* per screen line: possibly modified
+                                        * since the last paint */
+
+    /*
+     * Incremental URL detection: per screen row, whether the line's
+     * content may have changed since its URL spans were last
+     * computed. Rescans run in a deferred top-level callback, so the
+     * scanning cost never lands on the output or paint hot paths.
+     */
+    bool *url_dirty;
+    bool url_scan_queued;
+
+    /*
+     * Pool of spare termline structures, kept to cut allocator
+     * traffic on the scrolling and scrollback-decompression hot
+     * paths, where lines of the same width are freed and reallocated
+     * constantly.
+     */
+    termline **line_pool;
+    size_t line_pool_len, line_pool_size;
+
+    /*
+     * Staging queue of lines that have been scrolled off the top of
+     * the screen but not yet compressed into the scrollback, so that
+     * the RLE encoder runs in a deferred callback (or one bulk flush
+     * per event cycle) rather than on the term_out hot path.
+     */
+    termline **sb_stage;
+    size_t sb_stage_len, sb_stage_size;
+    bool sb_trim_pending;
+    bool paint_forced;                 /* next paint must examine all lines */
+    int paint_last_disptop;            /* disptop at the last paint */
+    int paint_last_rv;                 /* global reverse-video attr then */
+    bool paint_last_selected;          /* was a selection displayed then? */
+    bool paint_last_tblinker;          /* text-blink phase then */
     int curstype;                      /* type of cursor on real screen */
 
+    /*
+     * Record of how the displayed content has scrolled since the last
+     * paint, so that do_paint can ask the front end to blit the
+     * already-drawn pixels into their new position instead of
+     * redrawing every line. dispscroll_lines is positive if the
+     * content moved up; dispscroll_unusable is set when successive
+     * movements can't be described as one vertical shift of one
+     * region, in which case we just repaint as usual.
+     */
+    int dispscroll_top, dispscroll_size, dispscroll_lines;
+    bool dispscroll_unusable;
+
 #define VBELL_TIMEOUT (TICKSPERSEC/10) /* visual bell lasts 1/10 sec */
 
     struct beeptime *beephead, *beeptail;
@@ -226,11 +304,23 @@ struct terminal_tag {
 
     wchar_t *paste_buffer;
     int paste_len, paste_pos;
+    /* Set while a paste is stalled waiting for the connection to
+     * drain; a timer retries it. */
+    bool paste_throttled;
+    unsigned long paste_throttle_end;
 
     Backend *backend;
 
     Ldisc *ldisc;
 
+    /*
+     * Buffer of responses to terminal query sequences (ENQ, DA, DSR,
+     * window operations and so on), accumulated while processing one
+     * buffer of session output and flushed to the ldisc in a single
+     * write at the end of term_out.
+     */
+    strbuf *reply_buf;
+
     TermWin *win;
 
     LogContext *logctx;
@@ -262,8 +352,11 @@ struct terminal_tag {
      * We don't permit window updates too close together, to avoid CPU
      * churn pointlessly redrawing the window faster than the user can
      * read. So after an update, we set window_update_cooldown = true
-     * and schedule a timer to reset it to false. In between those
-     * times, window updates are not performed, and instead we set
+     * and schedule a timer to reset it to false. The cooldown period
+     * adapts to how long the redraw itself took, so that a window
+     * that's slow to repaint doesn't spend all its time painting. In
+     * between those times, window updates are not performed, and
+     * instead we set
      * window_update_pending = true, which will remind us to perform
      * the deferred redraw when the cooldown period ends and
      * window_update_cooldown is reset to false.
@@ -286,6 +379,7 @@ struct terminal_tag {
     int wcFromTo_size;
     struct bidi_cache_entry *pre_bidi_cache, *post_bidi_cache;
     size_t bidi_cache_size;
+    struct bidi_shared_cache_entry *bidi_shared_cache; /* content-keyed */
 
     /*
      * Current trust state, used to annotate every line of the
@@ -333,6 +427,7 @@ struct terminal_tag {
     bool no_remote_wintitle;
     bool no_remote_clearscroll;
     bool rawcnp;
+    bool rtf_paste;
     bool utf8linedraw;
     bool rect_select;
     int remote_qtitle_action;
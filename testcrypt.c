@@ -95,6 +95,7 @@ uint64_t prng_reseed_time_ms(void)
     X(pgc, PrimeGenerationContext *, primegen_free_context(v))          \
     X(pockle, Pockle *, pockle_free(v))                                 \
     X(millerrabin, MillerRabin *, miller_rabin_free(v))                 \
+    X(shakexof, ShakeXOF *, shake_xof_free(v))                          \
     /* end of list */
 
 typedef struct Value Value;
@@ -225,6 +226,10 @@ static const ssh_hashalg *get_hashalg(BinarySource *in)
 #if HAVE_NEON_SHA512
         {"sha384_neon", &ssh_sha384_neon},
         {"sha512_neon", &ssh_sha512_neon},
+#endif
+#if HAVE_SHA512_AVX2
+        {"sha384_avx2", &ssh_sha384_avx2},
+        {"sha512_avx2", &ssh_sha512_avx2},
 #endif
         {"sha3_224", &ssh_sha3_224},
         {"sha3_256", &ssh_sha3_256},
@@ -255,6 +260,9 @@ static const ssh2_macalg *get_macalg(BinarySource *in)
         {"hmac_sha1_96_buggy", &ssh_hmac_sha1_96_buggy},
         {"hmac_sha256", &ssh_hmac_sha256},
         {"poly1305", &ssh2_poly1305},
+        {"aesgcm", &ssh2_aesgcm_mac},
+        {"umac64", &ssh2_umac64},
+        {"umac128", &ssh2_umac128},
     };
 
     ptrlen name = get_word(in);
@@ -332,6 +340,8 @@ static const ssh_cipheralg *get_cipheralg(BinarySource *in)
         {"arcfour256", &ssh_arcfour256_ssh2},
         {"arcfour128", &ssh_arcfour128_ssh2},
         {"chacha20_poly1305", &ssh2_chacha20_poly1305},
+        {"aes256_gcm", &ssh_aes256_gcm},
+        {"aes128_gcm", &ssh_aes128_gcm},
     };
 
     ptrlen name = get_word(in);
@@ -960,6 +970,44 @@ strbuf *ssh_cipher_decrypt_length_wrapper(ssh_cipher *c, ptrlen input,
 #undef ssh_cipher_decrypt_length
 #define ssh_cipher_decrypt_length ssh_cipher_decrypt_length_wrapper
 
+strbuf *ssh2_mac_multiverify_wrapper(ssh2_mac *m, BinarySource *src)
+{
+    /*
+     * The input source contains a uint32 packet count, followed by
+     * that many records of (uint32 sequence number, string of MACed
+     * data with the received MAC appended), matching the memory
+     * layout ssh2_mac_multiverify expects. Returns one byte per
+     * packet, 1 for a good MAC and 0 for a bad one, or NULL if the
+     * MAC has no multi-buffer implementation.
+     */
+    size_t npkts = get_uint32(src);
+    ptrlen *pkts = snewn(npkts, ptrlen);
+    unsigned long *seqs = snewn(npkts, unsigned long);
+    bool *results = snewn(npkts, bool);
+    size_t maclen = ssh2_mac_alg(m)->len;
+
+    for (size_t i = 0; i < npkts; i++) {
+        seqs[i] = get_uint32(src);
+        pkts[i] = get_string(src);
+        if (get_err(src) || pkts[i].len < maclen)
+            fatal_error("ssh2_mac_multiverify: bad packet list");
+        pkts[i].len -= maclen;
+    }
+
+    strbuf *sb = NULL;
+    if (ssh2_mac_multiverify(m, npkts, pkts, seqs, results)) {
+        sb = strbuf_new();
+        for (size_t i = 0; i < npkts; i++)
+            put_byte(sb, results[i] ? 1 : 0);
+    }
+
+    sfree(pkts);
+    sfree(seqs);
+    sfree(results);
+    return sb;
+}
+#define ssh2_mac_multiverify ssh2_mac_multiverify_wrapper
+
 strbuf *ssh2_mac_genresult_wrapper(ssh2_mac *m)
 {
     strbuf *sb = strbuf_new();
@@ -1130,6 +1178,14 @@ strbuf *aes256_decrypt_pubkey_wrapper(ptrlen key, ptrlen iv, ptrlen data)
 }
 #define aes256_decrypt_pubkey aes256_decrypt_pubkey_wrapper
 
+strbuf *shake_xof_read_wrapper(ShakeXOF *sx, size_t size)
+{
+    strbuf *sb = strbuf_new();
+    shake_xof_read(sx, strbuf_append(sb, size), size);
+    return sb;
+}
+#define shake_xof_read shake_xof_read_wrapper
+
 strbuf *prng_read_wrapper(prng *pr, size_t size)
 {
     strbuf *sb = strbuf_new();
@@ -1336,10 +1392,14 @@ strbuf *get_implementations_commasep(ptrlen alg)
 #if HAVE_NEON_CRYPTO
         strbuf_catf(out, ",%.*s_neon", PTRLEN_PRINTF(alg));
 #endif
-    } else if (ptrlen_startswith(alg, PTRLEN_LITERAL("sha512"), NULL)) {
+    } else if (ptrlen_startswith(alg, PTRLEN_LITERAL("sha512"), NULL) ||
+               ptrlen_startswith(alg, PTRLEN_LITERAL("sha384"), NULL)) {
         strbuf_catf(out, ",%.*s_sw", PTRLEN_PRINTF(alg));
 #if HAVE_NEON_SHA512
         strbuf_catf(out, ",%.*s_neon", PTRLEN_PRINTF(alg));
+#endif
+#if HAVE_SHA512_AVX2
+        strbuf_catf(out, ",%.*s_avx2", PTRLEN_PRINTF(alg));
 #endif
     }
 
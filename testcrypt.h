@@ -138,6 +138,12 @@ FUNC2(void, ssh_hash_update, val_hash, val_string_ptrlen)
 
 FUNC1(opt_val_hash, blake2b_new_general, uint)
 
+/*
+ * The SHAKE extendable-output interface.
+ */
+FUNC1(val_shakexof, shake256_xof_from_input, val_string_ptrlen)
+FUNC2(val_string, shake_xof_read, val_shakexof, uint)
+
 /*
  * The ssh2_mac abstraction. Note the optional ssh_cipher parameter
  * to ssh2_mac_new. Also, again, I've invented an ssh2_mac_update so
@@ -148,6 +154,7 @@ FUNC2(void, ssh2_mac_setkey, val_mac, val_string_ptrlen)
 FUNC1(void, ssh2_mac_start, val_mac)
 FUNC2(void, ssh2_mac_update, val_mac, val_string_ptrlen)
 FUNC1(val_string, ssh2_mac_genresult, val_mac)
+FUNC2(opt_val_string, ssh2_mac_multiverify, val_mac, val_string_binarysource)
 FUNC1(val_string_asciz_const, ssh2_mac_text_name, val_mac)
 
 /*
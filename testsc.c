@@ -193,13 +193,34 @@ char *log_filename(const char *basename, size_t index)
 static char *last_filename;
 static const char *test_basename;
 static size_t test_index = 0;
+
+/*
+ * In benchmark mode (--bench), each logged region is also bracketed
+ * with reads of the CPU cycle counter, so that one run reports the
+ * speed of each primitive alongside its side-channel verdict. The
+ * numbers are only meaningful in a native run: under DynamoRIO the
+ * instrumentation dominates the cost of the code under test.
+ */
+static bool benchmarking = false;
+static uint64_t bench_start_ticks, bench_total_ticks, bench_min_ticks;
+static size_t bench_iterations;
+
 void log_start(void)
 {
     last_filename = log_filename(test_basename, test_index++);
     log_to_file(last_filename);
+    if (benchmarking)
+        bench_start_ticks = cryptoprof_ticks();
 }
 void log_end(void)
 {
+    if (benchmarking) {
+        uint64_t ticks = cryptoprof_ticks() - bench_start_ticks;
+        bench_total_ticks += ticks;
+        if (!bench_iterations || ticks < bench_min_ticks)
+            bench_min_ticks = ticks;
+        bench_iterations++;
+    }
     log_to_file(NULL);
     sfree(last_filename);
 }
@@ -320,6 +341,11 @@ VOLATILE_WRAPPED_DEFN(static, size_t, looplimit, (size_t x))
 #else
 #define HASH_SHA512_NEON(X, Y)
 #endif
+#if HAVE_SHA512_AVX2
+#define HASH_SHA512_AVX2(X, Y) X(Y, ssh_sha384_avx2) X(Y, ssh_sha512_avx2)
+#else
+#define HASH_SHA512_AVX2(X, Y)
+#endif
 
 #define HASHES(X, Y)                            \
     X(Y, ssh_md5)                               \
@@ -334,6 +360,7 @@ VOLATILE_WRAPPED_DEFN(static, size_t, looplimit, (size_t x))
     HASH_SHA_NI(X, Y)                           \
     HASH_SHA_NEON(X, Y)                         \
     HASH_SHA512_NEON(X, Y)                      \
+    HASH_SHA512_AVX2(X, Y)                      \
     X(Y, ssh_sha3_224)                          \
     X(Y, ssh_sha3_256)                          \
     X(Y, ssh_sha3_384)                          \
@@ -374,6 +401,7 @@ VOLATILE_WRAPPED_DEFN(static, size_t, looplimit, (size_t x))
     X(ecc_weierstrass_double)                   \
     X(ecc_weierstrass_add_general)              \
     X(ecc_weierstrass_multiply)                 \
+    X(ecc_weierstrass_fixed_base_multiply)      \
     X(ecc_weierstrass_is_identity)              \
     X(ecc_weierstrass_get_affine)               \
     X(ecc_weierstrass_decompress)               \
@@ -383,6 +411,7 @@ VOLATILE_WRAPPED_DEFN(static, size_t, looplimit, (size_t x))
     X(ecc_montgomery_get_affine)                \
     X(ecc_edwards_add)                          \
     X(ecc_edwards_multiply)                     \
+    X(ecc_edwards_fixed_base_multiply)          \
     X(ecc_edwards_eq)                           \
     X(ecc_edwards_get_affine)                   \
     X(ecc_edwards_decompress)                   \
@@ -907,6 +936,28 @@ static void test_ecc_weierstrass_multiply(void)
     mp_free(exponent);
 }
 
+static void test_ecc_weierstrass_fixed_base_multiply(void)
+{
+    WeierstrassCurve *wc = wcurve();
+    mp_int *exponent = mp_new(56);
+    for (size_t i = 1; i < looplimit(5); i++) {
+        WeierstrassPoint *a = wpoint(wc, i);
+        WeierstrassFixedBase *fb = ecc_weierstrass_fixed_base_new(a, 56);
+        ecc_weierstrass_point_free(a);
+        mp_random_fill(exponent);
+
+        log_start();
+        WeierstrassPoint *r = ecc_weierstrass_fixed_base_multiply(
+            fb, exponent);
+        log_end();
+
+        ecc_weierstrass_point_free(r);
+        ecc_weierstrass_fixed_base_free(fb);
+    }
+    ecc_weierstrass_curve_free(wc);
+    mp_free(exponent);
+}
+
 static void test_ecc_weierstrass_is_identity(void)
 {
     WeierstrassCurve *wc = wcurve();
@@ -1239,6 +1290,27 @@ static void test_ecc_edwards_multiply(void)
     mp_free(exponent);
 }
 
+static void test_ecc_edwards_fixed_base_multiply(void)
+{
+    EdwardsCurve *ec = ecurve();
+    mp_int *exponent = mp_new(56);
+    for (size_t i = 1; i < looplimit(5); i++) {
+        EdwardsPoint *a = epoint(ec, i);
+        EdwardsFixedBase *fb = ecc_edwards_fixed_base_new(a, 56);
+        ecc_edwards_point_free(a);
+        mp_random_fill(exponent);
+
+        log_start();
+        EdwardsPoint *r = ecc_edwards_fixed_base_multiply(fb, exponent);
+        log_end();
+
+        ecc_edwards_point_free(r);
+        ecc_edwards_fixed_base_free(fb);
+    }
+    ecc_edwards_curve_free(ec);
+    mp_free(exponent);
+}
+
 static void test_ecc_edwards_eq(void)
 {
     EdwardsCurve *ec = ecurve();
@@ -1585,6 +1657,8 @@ int main(int argc, char **argv)
                 outdir = *++argv;
             } else if (!strcmp(p, "-k") || !strcmp(p, "--keep")) {
                 keep_outfiles = true;
+            } else if (!strcmp(p, "--bench")) {
+                benchmarking = true;
             } else if (!strcmp(p, "--")) {
                 doing_opts = false;
             } else if (!strcmp(p, "--help")) {
@@ -1594,6 +1668,8 @@ int main(int argc, char **argv)
                        "put log files in the specified directory\n");
                 printf("         -k, --keep            "
                        "do not delete log files for tests that passed\n");
+                printf("         --bench               "
+                       "also report cycles per logged operation\n");
                 printf("   also: --help                "
                        "display this text\n");
                 return 0;
@@ -1656,9 +1732,16 @@ int main(int argc, char **argv)
         random_seed(test->testname);
         test_basename = test->testname;
         test_index = 0;
+        bench_total_ticks = bench_min_ticks = 0;
+        bench_iterations = 0;
 
         test->testfn();
 
+        if (benchmarking && bench_iterations)
+            printf("[n=%"SIZEu" mean=%"PRIu64" min=%"PRIu64" ticks/op] ",
+                   bench_iterations,
+                   bench_total_ticks / bench_iterations, bench_min_ticks);
+
         if (test_skipped) {
             /* Used for e.g. tests of hardware-accelerated crypto when
              * the hardware acceleration isn't available */
@@ -97,7 +97,6 @@ int main(int argc, char **argv)
         if (outbuf) {
             if (outlen)
                 fwrite(outbuf, 1, outlen, stdout);
-            sfree(outbuf);
         } else {
             fprintf(stderr, "decoding error\n");
             fclose(fp);
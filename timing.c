@@ -2,11 +2,12 @@
  * timing.c
  *
  * This module tracks any timers set up by schedule_timer(). It
- * keeps all the currently active timers in a list; it informs the
- * front end of when the next timer is due to go off if that
- * changes; and, very importantly, it tracks the context pointers
- * passed to schedule_timer(), so that if a context is freed all
- * the timers associated with it can be immediately annulled.
+ * keeps all the currently active timers in a hierarchical timer
+ * wheel; it informs the front end of when the next timer is due to
+ * go off if that changes; and, very importantly, it tracks the
+ * context pointers passed to schedule_timer(), so that if a context
+ * is freed all the timers associated with it can be immediately
+ * annulled.
  *
  *
  * The problem is that computer clocks aren't perfectly accurate.
@@ -34,57 +35,50 @@
 #include "tree234.h"
 
 struct timer {
+    struct timer *next;                /* link in its wheel slot */
     timer_fn_t fn;
     void *ctx;
     unsigned long now;
     unsigned long when_set;
 };
 
-static tree234 *timers = NULL;
-static tree234 *timer_contexts = NULL;
-static unsigned long now = 0L;
-
-static int compare_timers(void *av, void *bv)
-{
-    struct timer *a = (struct timer *)av;
-    struct timer *b = (struct timer *)bv;
-    long at = a->now - now;
-    long bt = b->now - now;
+/*
+ * The timers live in a hierarchical timer wheel: an array of levels,
+ * each an array of slots holding linked lists of timers. Level 0 has
+ * one slot per tick and covers the next WHEEL_SLOTS ticks; each
+ * higher level has slots WHEEL_SLOTS times coarser than the one
+ * below, so that four 8-bit levels between them cover the full 2^32
+ * tick space that a 'ticks' argument to schedule_timer can reach.
+ * Scheduling a timer and firing one are both constant-time, instead
+ * of paying a tree operation per event, which matters to sessions
+ * that schedule thousands of timers a second.
+ *
+ * wheel_base is the tick that level 0 slot (wheel_base & WHEEL_MASK)
+ * corresponds to; every timer still in the wheel expires at or after
+ * it. As run_timers advances wheel_base past the end of one level-0
+ * revolution, the next slot of level 1 is cascaded down into level 0
+ * (and likewise up the hierarchy), so a timer always reaches a
+ * level-0 slot before its expiry time.
+ */
+#define WHEEL_LEVEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_LEVEL_BITS)
+#define WHEEL_MASK ((unsigned long)WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
 
-    if (at < bt)
-        return -1;
-    else if (at > bt)
-        return +1;
+static struct timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static size_t wheel_count[WHEEL_LEVELS];
+static unsigned long wheel_base;
 
-    /*
-     * Failing that, compare on the other two fields, just so that
-     * we don't get unwanted equality.
-     */
-#if defined(__LCC__) || defined(__clang__)
-    /* lcc won't let us compare function pointers. Legal, but annoying. */
-    {
-        int c = memcmp(&a->fn, &b->fn, sizeof(a->fn));
-        if (c)
-            return c;
-    }
-#else
-    if (a->fn < b->fn)
-        return -1;
-    else if (a->fn > b->fn)
-        return +1;
-#endif
-
-    if (a->ctx < b->ctx)
-        return -1;
-    else if (a->ctx > b->ctx)
-        return +1;
+static tree234 *timer_contexts = NULL;
+static unsigned long now = 0L;
 
-    /*
-     * Failing _that_, the two entries genuinely are equal, and we
-     * never have a need to store them separately in the tree.
-     */
-    return 0;
-}
+/*
+ * The earliest wakeup time we've most recently promised the front
+ * end (or computed for it in run_timers), so that schedule_timer
+ * knows whether a new timer needs a fresh timer_change_notify.
+ */
+static bool next_valid = false;
+static unsigned long next_time;
 
 static int compare_timer_contexts(void *av, void *bv)
 {
@@ -99,17 +93,206 @@ static int compare_timer_contexts(void *av, void *bv)
 
 static void init_timers(void)
 {
-    if (!timers) {
-        timers = newtree234(compare_timers);
+    if (!timer_contexts) {
         timer_contexts = newtree234(compare_timer_contexts);
         now = GETTICKCOUNT();
+        wheel_base = now;
+    }
+}
+
+/*
+ * File a timer in the wheel. If check_dup, an identical timer (same
+ * expiry, function and context) already in the destination slot
+ * suppresses the new one, and we return false; this preserves the
+ * deduplication the old tree-based store did on every insertion. (A
+ * duplicate whose original has already cascaded to a lower level can
+ * escape the check, but the only consequence is the same function
+ * being called twice in the same tick, and in practice duplicates
+ * only arise from two identical schedule_timer calls in one tick.)
+ */
+static bool wheel_insert(struct timer *t, bool check_dup)
+{
+    int level;
+    unsigned long slot, delta = t->now - wheel_base;
+
+    if ((long)delta <= 0) {
+        /*
+         * Already due (the clock must have done something strange):
+         * file it in the slot the wheel will process next, so it
+         * fires as soon as the clock moves on at all.
+         */
+        level = 0;
+        slot = wheel_base & WHEEL_MASK;
+    } else {
+        for (level = 0; level < WHEEL_LEVELS - 1; level++)
+            if (delta < (unsigned long)WHEEL_SLOTS <<
+                (WHEEL_LEVEL_BITS * level))
+                break;
+        slot = (t->now >> (WHEEL_LEVEL_BITS * level)) & WHEEL_MASK;
+    }
+
+    if (check_dup) {
+        struct timer *u;
+        for (u = wheel[level][slot]; u; u = u->next)
+            if (u->now == t->now && u->fn == t->fn && u->ctx == t->ctx)
+                return false;
+    }
+
+    t->next = wheel[level][slot];
+    wheel[level][slot] = t;
+    wheel_count[level]++;
+    return true;
+}
+
+/*
+ * Move every timer out of a higher-level slot and re-file it, which
+ * will land it at a lower level now that its expiry is nearer.
+ */
+static void wheel_cascade(int level, unsigned long slot)
+{
+    struct timer *t = wheel[level][slot], *next;
+
+    wheel[level][slot] = NULL;
+    while (t) {
+        next = t->next;
+        wheel_count[level]--;
+        wheel_insert(t, false);
+        t = next;
     }
 }
 
+/*
+ * Called whenever wheel_base takes a new value: if it has reached a
+ * revolution boundary of any level, cascade the newly current slot of
+ * the level above down into this one.
+ */
+static void wheel_base_moved(void)
+{
+    if ((wheel_base & WHEEL_MASK) != 0)
+        return;
+    wheel_cascade(1, (wheel_base >> WHEEL_LEVEL_BITS) & WHEEL_MASK);
+    if (((wheel_base >> WHEEL_LEVEL_BITS) & WHEEL_MASK) != 0)
+        return;
+    wheel_cascade(2, (wheel_base >> (2*WHEEL_LEVEL_BITS)) & WHEEL_MASK);
+    if (((wheel_base >> (2*WHEEL_LEVEL_BITS)) & WHEEL_MASK) != 0)
+        return;
+    wheel_cascade(3, (wheel_base >> (3*WHEEL_LEVEL_BITS)) & WHEEL_MASK);
+}
+
+/*
+ * Run (or discard, if its context has been expired) every timer in a
+ * level-0 slot whose time has come.
+ */
+static void wheel_fire_slot(unsigned long slot)
+{
+    struct timer *t;
+
+    while ((t = wheel[0][slot]) != NULL) {
+        wheel[0][slot] = t->next;
+        wheel_count[0]--;
+        if (find234(timer_contexts, t->ctx, NULL) != NULL) {
+            if (loopstats_active()) {
+                uint64_t start = loopstats_now_us();
+                t->fn(t->ctx, t->now);
+                loopstats_record("timer", (uintptr_t)t->fn, start, false);
+            } else {
+                t->fn(t->ctx, t->now);
+            }
+        }
+        sfree(t);
+    }
+}
+
+/*
+ * The clock has jumped backwards, which the wheel's forward-only
+ * advance can't absorb. Collect every timer and re-file it relative
+ * to the new, earlier, base; anything whose set time the jump has
+ * carried us back past is re-filed as due, the same as the old code's
+ * per-timer check would have treated it. Backward jumps are rare, so
+ * visiting every timer here is fine.
+ */
+static void wheel_clock_jumped_back(void)
+{
+    struct timer *all = NULL, *t;
+    int level;
+    unsigned long slot;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            while ((t = wheel[level][slot]) != NULL) {
+                wheel[level][slot] = t->next;
+                t->next = all;
+                all = t;
+            }
+        }
+        wheel_count[level] = 0;
+    }
+
+    wheel_base = now;
+
+    while (all) {
+        t = all;
+        all = t->next;
+        if (now - (t->when_set - 10) > t->now - (t->when_set - 10)) {
+            /* Due: put it straight in the wheel's next slot. */
+            t->next = wheel[0][wheel_base & WHEEL_MASK];
+            wheel[0][wheel_base & WHEEL_MASK] = t;
+            wheel_count[0]++;
+        } else {
+            wheel_insert(t, false);
+        }
+    }
+}
+
+/*
+ * Find the next time the front end should call run_timers. For a
+ * level-0 timer that's its exact expiry time; for a timer still at a
+ * higher level it's the time its slot will cascade downwards, which
+ * is an acceptable conservative wakeup (the resulting run_timers call
+ * computes the exact time once the timer reaches level 0).
+ */
+static bool wheel_next_timer(unsigned long *next)
+{
+    unsigned long best = 0;
+    bool found = false;
+    int level;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        unsigned long shift = WHEEL_LEVEL_BITS * level;
+        unsigned long pos = (wheel_base >> shift) & WHEEL_MASK;
+        unsigned long d, dstart = (level == 0 ? 0 : 1);
+
+        if (!wheel_count[level])
+            continue;
+
+        /*
+         * Scan circularly ahead from the wheel's current position at
+         * this level. (At levels above 0 the current slot is scanned
+         * last, not first: it has already been cascaded, so anything
+         * still in it is all but a full revolution away.)
+         */
+        for (d = dstart; d < dstart + WHEEL_SLOTS; d++) {
+            unsigned long slot = (pos + d) & WHEEL_MASK;
+            if (wheel[level][slot]) {
+                unsigned long when = ((wheel_base >> shift) + d) << shift;
+                if (!found || (long)(when - best) < 0) {
+                    best = when;
+                    found = true;
+                }
+                break;
+            }
+        }
+    }
+
+    if (found)
+        *next = best;
+    return found;
+}
+
 unsigned long schedule_timer(int ticks, timer_fn_t fn, void *ctx)
 {
     unsigned long when;
-    struct timer *t, *first;
+    struct timer *t;
 
     init_timers();
 
@@ -130,19 +313,20 @@ unsigned long schedule_timer(int ticks, timer_fn_t fn, void *ctx)
     t->now = when;
     t->when_set = now;
 
-    if (t != add234(timers, t)) {
+    if (!wheel_insert(t, true)) {
         sfree(t);                      /* identical timer already exists */
     } else {
         add234(timer_contexts, t->ctx);/* don't care if this fails */
     }
 
-    first = (struct timer *)index234(timers, 0);
-    if (first == t) {
+    if (!next_valid || (long)(when - next_time) < 0) {
         /*
-         * This timer is the very first on the list, so we must
-         * notify the front end.
+         * This timer is due before anything we've previously told
+         * the front end about, so we must notify it.
          */
-        timer_change_notify(first->now);
+        next_valid = true;
+        next_time = when;
+        timer_change_notify(when);
     }
 
     return when;
@@ -166,43 +350,47 @@ unsigned long timing_last_clock(void)
  */
 bool run_timers(unsigned long anow, unsigned long *next)
 {
-    struct timer *first;
+    bool found;
 
     init_timers();
 
     now = GETTICKCOUNT();
 
-    while (1) {
-        first = (struct timer *)index234(timers, 0);
-
-        if (!first)
-            return false;              /* no timers remaining */
+    if ((long)(now - wheel_base) < 0)
+        wheel_clock_jumped_back();
 
-        if (find234(timer_contexts, first->ctx, NULL) == NULL) {
+    while ((long)(now - wheel_base) > 0) {
+        if (wheel_count[0] == 0) {
             /*
-             * This timer belongs to a context that has been
-             * expired. Delete it without running.
+             * Nothing at level 0 at all, so advance in bulk: jump to
+             * the next revolution boundary that could cascade some
+             * timers down (of the lowest non-empty level), or to the
+             * present, whichever comes first.
              */
-            delpos234(timers, 0);
-            sfree(first);
-        } else if (now - (first->when_set - 10) >
-                   first->now - (first->when_set - 10)) {
-            /*
-             * This timer is active and has reached its running
-             * time. Run it.
-             */
-            delpos234(timers, 0);
-            first->fn(first->ctx, first->now);
-            sfree(first);
+            unsigned long target;
+            if (wheel_count[1] == 0 && wheel_count[2] == 0)
+                target = (wheel_base |
+                          ((1UL << (3*WHEEL_LEVEL_BITS)) - 1)) + 1;
+            else if (wheel_count[1] == 0)
+                target = (wheel_base |
+                          ((1UL << (2*WHEEL_LEVEL_BITS)) - 1)) + 1;
+            else
+                target = (wheel_base | WHEEL_MASK) + 1;
+            if ((long)(target - now) > 0)
+                target = now;
+            wheel_base = target;
         } else {
-            /*
-             * This is the first still-active timer that is in the
-             * future. Return how long it has yet to go.
-             */
-            *next = first->now;
-            return true;
+            wheel_fire_slot(wheel_base & WHEEL_MASK);
+            wheel_base++;
         }
+        wheel_base_moved();
     }
+
+    found = wheel_next_timer(next);
+    next_valid = found;
+    if (found)
+        next_time = *next;
+    return found;
 }
 
 /*
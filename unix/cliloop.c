@@ -1,7 +1,188 @@
 #include <errno.h>
+#include <signal.h>
 
 #include "putty.h"
 
+#if HAVE_EPOLL
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/*
+ * Where the system provides it, we keep the uxsel fds registered in a
+ * persistent epoll set, and hand only the epoll fd itself to poll()
+ * in the main loop below. That way, readiness dispatch costs time
+ * proportional to the number of _ready_ fds, instead of rebuilding
+ * and scanning the entire fd list on every iteration, which matters
+ * when e.g. an Uppity or psusan instance is carrying hundreds of
+ * forwarded sockets. uxsel tells us about changes of interest through
+ * uxsel_input_add and uxsel_input_remove, so each registration
+ * persists for as long as the fd's interest does. (A kqueue-based
+ * equivalent for the BSDs could slot in behind the same two hooks;
+ * systems with neither facility use the plain poll() code below.)
+ */
+
+struct uxsel_id {
+    int fd;
+};
+
+static int epoll_fd = -1;
+static bool epoll_broken = false;
+static pid_t epoll_owner_pid = -1;
+
+static void epoll_fallback(void)
+{
+    /*
+     * If epoll turns out not to work - at startup, or because some fd
+     * type can't be registered with it - close the epoll fd and fall
+     * back to scanning the full uxsel list with poll() each time
+     * round the loop, which handles every fd still in uxsel's tree
+     * whether or not we'd previously registered it here.
+     */
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    epoll_broken = true;
+}
+
+static bool epoll_register(int fd, int rwx)
+{
+    struct epoll_event ev;
+
+    ev.events = 0;
+    if (rwx & SELECT_R)
+        ev.events |= EPOLLIN;
+    if (rwx & SELECT_W)
+        ev.events |= EPOLLOUT;
+    if (rwx & SELECT_X)
+        ev.events |= EPOLLPRI;
+    /*
+     * Pack the wanted rwx flags in alongside the fd, so that dispatch
+     * can gate EPOLLERR and EPOLLHUP (which epoll reports whether you
+     * asked or not) on the direction of interest, the same way
+     * pollwrap_get_fd_rwx gates POLLERR and POLLHUP.
+     */
+    ev.data.u64 = (uint64_t)(unsigned)fd | ((uint64_t)(unsigned)rwx << 32);
+
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void epoll_ensure_ours(void)
+{
+    /*
+     * An epoll set is a kernel object shared with any process we fork
+     * (e.g. psusan --fork, or psocks worker processes), so if we went
+     * on using the inherited epoll fd we'd be deregistering our
+     * relative's fds and stealing its events, and vice versa. If the
+     * pid has changed since the set was created, abandon it and build
+     * a fresh one of our own from uxsel's current list of interests.
+     */
+    if (epoll_fd < 0 || epoll_owner_pid == getpid())
+        return;
+
+    close(epoll_fd);
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        epoll_fallback();
+        return;
+    }
+    epoll_owner_pid = getpid();
+
+    int fdstate, rwx;
+    for (int fd = first_fd(&fdstate, &rwx); fd >= 0;
+         fd = next_fd(&fdstate, &rwx)) {
+        if (!epoll_register(fd, rwx)) {
+            epoll_fallback();
+            return;
+        }
+    }
+}
+
+uxsel_id *uxsel_input_add(int fd, int rwx)
+{
+    uxsel_id *id;
+
+    epoll_ensure_ours();
+
+    if (epoll_fd < 0) {
+        if (epoll_broken ||
+            (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            epoll_fallback();
+            return NULL;
+        }
+        epoll_owner_pid = getpid();
+    }
+
+    if (!epoll_register(fd, rwx)) {
+        epoll_fallback();
+        return NULL;
+    }
+
+    id = snew(uxsel_id);
+    id->fd = fd;
+    return id;
+}
+
+void uxsel_input_remove(uxsel_id *id)
+{
+    epoll_ensure_ours();
+    if (epoll_fd >= 0)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, id->fd, NULL);
+    sfree(id);
+}
+
+static void epoll_dispatch(void)
+{
+    struct epoll_event evs[64];
+    int nev, i;
+
+    /*
+     * Any ready fds beyond the size of this batch stay pending in the
+     * (level-triggered) epoll set, and will come straight back on the
+     * next iteration of the main loop.
+     */
+    nev = epoll_wait(epoll_fd, evs, lenof(evs), 0);
+    for (i = 0; i < nev; i++) {
+        int fd = (int)(evs[i].data.u64 & 0xFFFFFFFFU);
+        int rwx = (int)(evs[i].data.u64 >> 32);
+        unsigned events = evs[i].events;
+
+        /*
+         * We must process exceptional notifications before ordinary
+         * readability ones, or we may go straight past the urgent
+         * marker.
+         */
+        if ((rwx & SELECT_X) && (events & EPOLLPRI))
+            select_result(fd, SELECT_X);
+        if ((rwx & SELECT_R) && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            select_result(fd, SELECT_R);
+        if ((rwx & SELECT_W) && (events & (EPOLLOUT | EPOLLERR)))
+            select_result(fd, SELECT_W);
+    }
+}
+
+#else /* !HAVE_EPOLL */
+
+/*
+ * Without epoll, we don't need to do anything when uxsel adds or
+ * removes an fd, because we synchronously re-check the current list
+ * every time we go round the main loop below.
+ */
+uxsel_id *uxsel_input_add(int fd, int rwx) { return NULL; }
+void uxsel_input_remove(uxsel_id *id) { }
+
+#endif /* HAVE_EPOLL */
+
+static void cliloop_loopstats_signal(int sig)
+{
+    loopstats_request_dump();          /* async-signal-safe: sets a flag */
+}
+
+static void cliloop_memstats_signal(int sig)
+{
+    memstats_request_dump();           /* likewise */
+}
+
 void cli_main_loop(cliloop_pw_setup_t pw_setup,
                    cliloop_pw_check_t pw_check,
                    cliloop_continue_t cont, void *ctx)
@@ -13,6 +194,12 @@ void cli_main_loop(cliloop_pw_setup_t pw_setup,
 
     pollwrapper *pw = pollwrap_new();
 
+    bool stats = loopstats_active();
+    if (stats)
+        putty_signal(SIGUSR1, cliloop_loopstats_signal);
+    if (memstats_active())
+        putty_signal(SIGUSR2, cliloop_memstats_signal);
+
     while (true) {
         int rwx;
         int ret;
@@ -24,26 +211,41 @@ void cli_main_loop(cliloop_pw_setup_t pw_setup,
         if (!pw_setup(ctx, pw))
             break; /* our client signalled emergency exit */
 
-        /* Count the currently active fds. */
-        size_t nfds = 0;
-        for (int fd = first_fd(&fdstate, &rwx); fd >= 0;
-             fd = next_fd(&fdstate, &rwx))
-            nfds++;
+        size_t fdcount = 0;
+#if HAVE_EPOLL
+        epoll_ensure_ours();
+        if (epoll_fd >= 0) {
+            /*
+             * The uxsel fds are all registered with epoll already, so
+             * the only one poll() itself needs to watch is the epoll
+             * fd, which reads as ready when any of them is.
+             */
+            pollwrap_add_fd_rwx(pw, epoll_fd, SELECT_R);
+        } else
+#endif
+        {
+            /* Count the currently active fds. */
+            size_t nfds = 0;
+            for (int fd = first_fd(&fdstate, &rwx); fd >= 0;
+                 fd = next_fd(&fdstate, &rwx))
+                nfds++;
 
-        /* Expand the fdlist buffer if necessary. */
-        sgrowarray(fdlist, fdsize, nfds);
+            /* Expand the fdlist buffer if necessary. */
+            sgrowarray(fdlist, fdsize, nfds);
 
-        /*
-         * Add all currently open uxsel fds to pw, and store them in
-         * fdlist as well.
-         */
-        size_t fdcount = 0;
-        for (int fd = first_fd(&fdstate, &rwx); fd >= 0;
-             fd = next_fd(&fdstate, &rwx)) {
-            fdlist[fdcount++] = fd;
-            pollwrap_add_fd_rwx(pw, fd, rwx);
+            /*
+             * Add all currently open uxsel fds to pw, and store them
+             * in fdlist as well.
+             */
+            for (int fd = first_fd(&fdstate, &rwx); fd >= 0;
+                 fd = next_fd(&fdstate, &rwx)) {
+                fdlist[fdcount++] = fd;
+                pollwrap_add_fd_rwx(pw, fd, rwx);
+            }
         }
 
+        uint64_t dwell_start = stats ? loopstats_now_us() : 0;
+
         if (toplevel_callback_pending()) {
             ret = pollwrap_poll_instant(pw);
         } else if (run_timers(now, &next)) {
@@ -74,6 +276,16 @@ void cli_main_loop(cliloop_pw_setup_t pw_setup,
             ret = pollwrap_poll_endless(pw);
         }
 
+        if (stats) {
+            /* The dwell histogram includes time intentionally spent
+             * blocked waiting for events, so a long tail here is
+             * normal; what it diagnoses is the opposite problem, a
+             * loop spinning with near-zero dwell times. */
+            loopstats_record("poll-dwell", 0, dwell_start, true);
+            loopstats_maybe_dump();
+        }
+        memstats_maybe_dump();
+
         if (ret < 0 && errno == EINTR)
             continue;
 
@@ -84,6 +296,12 @@ void cli_main_loop(cliloop_pw_setup_t pw_setup,
 
         bool found_fd = (ret > 0);
 
+#if HAVE_EPOLL
+        if (epoll_fd >= 0) {
+            if (pollwrap_check_fd_rwx(pw, epoll_fd, SELECT_R))
+                epoll_dispatch();
+        } else
+#endif
         for (size_t i = 0; i < fdcount; i++) {
             int fd = fdlist[i];
             int rwx = pollwrap_get_fd_rwx(pw, fd);
@@ -115,11 +333,3 @@ void cli_main_loop(cliloop_pw_setup_t pw_setup,
 bool cliloop_no_pw_setup(void *ctx, pollwrapper *pw) { return true; }
 void cliloop_no_pw_check(void *ctx, pollwrapper *pw) {}
 bool cliloop_always_continue(void *ctx, bool fd, bool cb) { return true; }
-
-/*
- * Any application using this main loop doesn't need to do anything
- * when uxsel adds or removes an fd, because we synchronously re-check
- * the current list every time we go round the main loop above.
- */
-uxsel_id *uxsel_input_add(int fd, int rwx) { return NULL; }
-void uxsel_input_remove(uxsel_id *id) { }
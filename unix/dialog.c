@@ -2535,6 +2535,28 @@ struct selparam {
     struct Shortcuts shortcuts;
 };
 
+/*
+ * Refresh only the controls on one notebook panel, plus the
+ * panel-independent controls along the bottom of the box (which have
+ * no selparam). Used on tree navigation: re-running EVENT_REFRESH on
+ * every control in the whole dialog for each click is noticeable work
+ * in a box with hundreds of controls, and controls on other panels
+ * will be refreshed in their turn when their own panel is selected -
+ * which is before they can next become visible.
+ */
+static void dlg_refresh_panel(struct dlgparam *dp, struct selparam *sp)
+{
+    struct uctrl *uc;
+    int i;
+
+    for (i = 0; (uc = index234(dp->byctrl, i)) != NULL; i++) {
+        assert(uc->ctrl != NULL);
+        if ((uc->sp == NULL || uc->sp == sp) &&
+            uc->ctrl->generic.handler != NULL)
+            uc->ctrl->generic.handler(uc->ctrl, dp, dp->data, EVENT_REFRESH);
+    }
+}
+
 #if GTK_CHECK_VERSION(2,0,0)
 static void treeselection_changed(GtkTreeSelection *treeselection,
                                   gpointer data)
@@ -2555,7 +2577,7 @@ static void treeselection_changed(GtkTreeSelection *treeselection,
     gtk_notebook_set_current_page(sp->panels, page_num);
 
     sp->dp->curr_panel = sp;
-    dlg_refresh(NULL, sp->dp);
+    dlg_refresh_panel(sp->dp, sp);
 
     sp->dp->shortcuts = &sp->shortcuts;
 }
@@ -2569,7 +2591,7 @@ static void treeitem_sel(GtkItem *item, gpointer data)
     gtk_notebook_set_page(sp->panels, page_num);
 
     sp->dp->curr_panel = sp;
-    dlg_refresh(NULL, sp->dp);
+    dlg_refresh_panel(sp->dp, sp);
 
     sp->dp->shortcuts = &sp->shortcuts;
     sp->dp->currtreeitem = sp->treeitem;
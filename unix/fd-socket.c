@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #include "tree234.h"
 #include "putty.h"
@@ -169,8 +170,19 @@ static int fdsocket_try_send(FdSocket *fds)
     while (bufchain_size(&fds->pending_output_data) > 0) {
         ssize_t ret;
 
-        ptrlen data = bufchain_prefix(&fds->pending_output_data);
-        ret = write(fds->outfd, data.ptr, data.len);
+        /*
+         * Gather multiple granules of the bufchain into a single
+         * writev, rather than paying a system call per granule.
+         */
+        ptrlen prefixes[16];
+        struct iovec iov[lenof(prefixes)];
+        size_t i, niov = bufchain_prefixes(
+            &fds->pending_output_data, prefixes, lenof(prefixes));
+        for (i = 0; i < niov; i++) {
+            iov[i].iov_base = (void *)prefixes[i].ptr;
+            iov[i].iov_len = prefixes[i].len;
+        }
+        ret = writev(fds->outfd, iov, niov);
         noise_ultralight(NOISE_SOURCE_IOID, ret);
         if (ret < 0 && errno != EWOULDBLOCK) {
             if (!fds->pending_error) {
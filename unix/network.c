@@ -11,11 +11,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
 #include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <pwd.h>
 #include <grp.h>
 
@@ -59,6 +62,7 @@ struct SockAddrStep_tag {
 };
 
 typedef struct NetSocket NetSocket;
+typedef struct NetSocketAttempt NetSocketAttempt;
 struct NetSocket {
     const char *error;
     int s;
@@ -77,10 +81,15 @@ struct NetSocket {
     int pending_error;                 /* in case send() returns error */
     bool listener;
     bool nodelay, keepalive;           /* for connect()-type sockets */
+    int sndbuf, rcvbuf;  /* requested kernel buffer sizes; 0 = OS default */
+    bool corked;                       /* batch small writes via TCP_CORK */
     bool privport;
     int port;                          /* and again */
     SockAddr *addr;
-    SockAddrStep step;
+    SockAddrStep step; /* next candidate address not yet attempted, if
+                        * connecting; the connected address, once we are */
+    bool more_addrs;   /* is 'step' a valid candidate at all? */
+    NetSocketAttempt *attempts;        /* in-flight connection attempts */
     /*
      * We sometimes need pairs of Socket structures to be linked:
      * if we are listening on the same IPv6 and v4 port, for
@@ -92,17 +101,50 @@ struct NetSocket {
     Socket sock;
 };
 
+/*
+ * An in-flight connection attempt to one candidate address out of a
+ * NetSocket's SockAddr, made while the NetSocket doesn't yet have a
+ * file descriptor of its own. Following the 'Happy Eyeballs'
+ * algorithm of RFC 8305, several of these can be racing on behalf of
+ * the same NetSocket, with staggered starts: the first one to
+ * complete its connection donates its fd to the NetSocket, and the
+ * rest are abandoned. That way, one unresponsive address early in the
+ * candidate list (a dead IPv6 route, classically) costs only
+ * CONNECTION_ATTEMPT_DELAY before the next address gets a chance,
+ * instead of a full connect timeout.
+ */
+struct NetSocketAttempt {
+    NetSocket *parent;
+    int s;                             /* fd of the pending connect */
+    SockAddrStep step;                 /* the address being tried */
+    NetSocketAttempt *next;            /* in parent->attempts list */
+};
+
+/*
+ * How long to give one connection attempt a head start before also
+ * starting the next candidate address racing in parallel (the
+ * 'Connection Attempt Delay' of RFC 8305).
+ */
+#define CONNECTION_ATTEMPT_DELAY (TICKSPERSEC / 4)
+
 struct SockAddr {
     int refcount;
     const char *error;
     enum { UNRESOLVED, UNIX, IP } superfamily;
 #ifndef NO_IPV6
     struct addrinfo *ais;              /* Addresses IPv6 style. */
+    bool ais_synthetic;                /* 'ais' was built by hand from an
+                                        * async lookup's results, rather
+                                        * than by getaddrinfo, so it must
+                                        * be freed field by field */
 #else
     unsigned long *addresses;          /* Addresses IPv4 style. */
     int naddresses;
 #endif
     char hostname[512];                /* Store an unresolved host name. */
+    char *errmsg;                      /* dynamically allocated string that
+                                        * 'error' points at, if the error
+                                        * didn't come from static storage */
 };
 
 /*
@@ -137,7 +179,29 @@ struct SockAddr {
     ((step).curraddr = 0)
 #endif
 
+/*
+ * An asynchronous name lookup in progress. The lookup itself happens
+ * in a forked subprocess (getaddrinfo provides no portable
+ * non-blocking interface, and this code base has no threads), which
+ * writes its results down a pipe in a simple wire format and exits;
+ * we watch the reading end of the pipe via uxsel, and deliver the
+ * reconstructed SockAddr to the caller's callback when it's all
+ * arrived.
+ */
+struct pending_lookup {
+    int fd;                            /* read end of the result pipe */
+    pid_t pid;                         /* the resolver subprocess */
+    strbuf *data;                      /* wire data accumulated so far */
+    SockAddr *addr;                    /* ready-made result, if fd < 0 */
+    char *canonicalname;               /* likewise */
+    char *host;                        /* saved copy of the query */
+    sk_namelookup_fn_t callback;
+    void *vctx;
+};
+
 static tree234 *sktree;
+static tree234 *conntree;              /* NetSocketAttempts, indexed by fd */
+static tree234 *lookuptree;            /* pending_lookups, indexed by fd */
 
 static void uxsel_tell(NetSocket *s);
 
@@ -167,14 +231,61 @@ static int cmpforsearch(void *av, void *bv)
     return 0;
 }
 
+static int attempt_cmpfortree(void *av, void *bv)
+{
+    NetSocketAttempt *a = (NetSocketAttempt *) av;
+    NetSocketAttempt *b = (NetSocketAttempt *) bv;
+    if (a->s < b->s)
+        return -1;
+    if (a->s > b->s)
+        return +1;
+    return 0;
+}
+
+static int attempt_cmpforsearch(void *av, void *bv)
+{
+    NetSocketAttempt *b = (NetSocketAttempt *) bv;
+    int as = *(int *)av, bs = b->s;
+    if (as < bs)
+        return -1;
+    if (as > bs)
+        return +1;
+    return 0;
+}
+
+static int lookup_cmpfortree(void *av, void *bv)
+{
+    pending_lookup *a = (pending_lookup *) av;
+    pending_lookup *b = (pending_lookup *) bv;
+    if (a->fd < b->fd)
+        return -1;
+    if (a->fd > b->fd)
+        return +1;
+    return 0;
+}
+
+static int lookup_cmpforsearch(void *av, void *bv)
+{
+    pending_lookup *b = (pending_lookup *) bv;
+    int as = *(int *)av, bs = b->fd;
+    if (as < bs)
+        return -1;
+    if (as > bs)
+        return +1;
+    return 0;
+}
+
 void sk_init(void)
 {
     sktree = newtree234(cmpfortree);
+    conntree = newtree234(attempt_cmpfortree);
+    lookuptree = newtree234(lookup_cmpfortree);
 }
 
 void sk_cleanup(void)
 {
     NetSocket *s;
+    NetSocketAttempt *attempt;
     int i;
 
     if (sktree) {
@@ -182,6 +293,12 @@ void sk_cleanup(void)
             close(s->s);
         }
     }
+
+    if (conntree) {
+        for (i = 0; (attempt = index234(conntree, i)) != NULL; i++) {
+            close(attempt->s);
+        }
+    }
 }
 
 SockAddr *sk_namelookup(const char *host, char **canonicalname, int address_family)
@@ -286,6 +403,7 @@ SockAddr *sk_namelookup(const char *host, char **canonicalname, int address_fami
 SockAddr *sk_nonamelookup(const char *host)
 {
     SockAddr *ret = snew(SockAddr);
+    memset(ret, 0, sizeof(SockAddr));
     ret->error = NULL;
     ret->superfamily = UNRESOLVED;
     strncpy(ret->hostname, host, lenof(ret->hostname));
@@ -299,6 +417,245 @@ SockAddr *sk_nonamelookup(const char *host)
     return ret;
 }
 
+/*
+ * The resolver subprocess: do the lookup with the ordinary blocking
+ * sk_namelookup (blocking is fine, because this process has nothing
+ * else to do), serialise the result down the pipe, and exit. Wire
+ * format: a status byte (0 = error, 1 = resolved addresses, 2 = Unix
+ * socket path), then an asciz error message / canonical name / path,
+ * then (in the resolved case) the raw sockaddrs, each preceded by its
+ * length.
+ */
+static void namelookup_subprocess(int wfd, const char *host,
+                                  int address_family)
+{
+    char *canonicalname;
+    SockAddr *addr = sk_namelookup(host, &canonicalname, address_family);
+    strbuf *sb = strbuf_new();
+
+    if (addr->error) {
+        put_byte(sb, 0);
+        put_asciz(sb, addr->error);
+    } else if (addr->superfamily == UNIX) {
+        put_byte(sb, 2);
+        put_asciz(sb, addr->hostname);
+    } else {
+        put_byte(sb, 1);
+        put_asciz(sb, canonicalname);
+#ifndef NO_IPV6
+        for (struct addrinfo *ai = addr->ais; ai; ai = ai->ai_next) {
+            put_uint32(sb, ai->ai_addrlen);
+            put_data(sb, ai->ai_addr, ai->ai_addrlen);
+        }
+#else
+        for (int i = 0; i < addr->naddresses; i++)
+            put_uint32(sb, addr->addresses[i]);
+#endif
+    }
+
+    for (size_t done = 0; done < sb->len ;) {
+        ssize_t ret = write(wfd, sb->s + done, sb->len - done);
+        if (ret <= 0)
+            break;                     /* can't do much about it */
+        done += ret;
+    }
+    /* no cleanup: we're about to exit anyway */
+}
+
+/*
+ * Reconstruct a SockAddr from the wire data a resolver subprocess
+ * sent us.
+ */
+static void namelookup_parse(pending_lookup *pl, SockAddr **addr_out,
+                             char **canonicalname_out)
+{
+    BinarySource src[1];
+    BinarySource_BARE_INIT(src, pl->data->u, pl->data->len);
+
+    SockAddr *addr = snew(SockAddr);
+    memset(addr, 0, sizeof(SockAddr));
+    addr->refcount = 1;
+    addr->superfamily = UNRESOLVED;
+    strncpy(addr->hostname, pl->host, lenof(addr->hostname));
+    addr->hostname[lenof(addr->hostname)-1] = '\0';
+
+    char *canonicalname = NULL;
+
+    int status = get_avail(src) ? get_byte(src) : -1;
+    if (status == 2) {
+        addr->superfamily = UNIX;
+        const char *path = get_asciz(src);
+        int n = snprintf(addr->hostname, sizeof addr->hostname, "%s", path);
+        if (n < 0 || n >= sizeof addr->hostname)
+            addr->error = "socket pathname too long";
+        canonicalname = dupstr(path);
+    } else if (status == 1) {
+        canonicalname = dupstr(get_asciz(src));
+        addr->superfamily = IP;
+#ifndef NO_IPV6
+        addr->ais_synthetic = true;
+        struct addrinfo **tail = &addr->ais;
+        while (get_avail(src) > 0) {
+            size_t salen = get_uint32(src);
+            ptrlen sa = get_data(src, salen);
+            if (get_err(src) || sa.len < sizeof(sa_family_t))
+                break;
+            struct addrinfo *ai = snew(struct addrinfo);
+            memset(ai, 0, sizeof(*ai));
+            ai->ai_addr = (struct sockaddr *)snewn(salen, char);
+            memcpy(ai->ai_addr, sa.ptr, salen);
+            ai->ai_addrlen = salen;
+            ai->ai_family = ai->ai_addr->sa_family;
+            ai->ai_socktype = SOCK_STREAM;
+            *tail = ai;
+            tail = &ai->ai_next;
+        }
+        if (!addr->ais)
+            addr->error = "Name lookup failure";
+#else
+        size_t n = get_avail(src) / 4;
+        addr->addresses = snewn(n, unsigned long);
+        addr->naddresses = 0;
+        while (get_avail(src) >= 4)
+            addr->addresses[addr->naddresses++] = get_uint32(src);
+        if (!addr->naddresses)
+            addr->error = "Name lookup failure";
+#endif
+    } else if (status == 0) {
+        addr->errmsg = dupstr(get_asciz(src));
+        addr->error = addr->errmsg;
+    } else {
+        /* Truncated or malformed data, e.g. because the subprocess
+         * died before writing anything useful. */
+        addr->error = "Name lookup failure";
+    }
+
+    if (!canonicalname)
+        canonicalname = dupstr(pl->host);
+
+    *addr_out = addr;
+    *canonicalname_out = canonicalname;
+}
+
+static void namelookup_pl_free(pending_lookup *pl)
+{
+    if (pl->fd >= 0) {
+        uxsel_del(pl->fd);
+        del234(lookuptree, pl);
+        close(pl->fd);
+    }
+    strbuf_free(pl->data);
+    sfree(pl->host);
+    sfree(pl);
+}
+
+/*
+ * Toplevel callback used to deliver a result that was available
+ * immediately, so that the caller sees the same shape of behaviour
+ * (callback from the top level, strictly after sk_namelookup_async
+ * returned) whether the lookup really was asynchronous or not.
+ */
+static void namelookup_deliver_ready(void *vctx)
+{
+    pending_lookup *pl = (pending_lookup *)vctx;
+    sk_namelookup_fn_t callback = pl->callback;
+    void *cctx = pl->vctx;
+    SockAddr *addr = pl->addr;
+    char *canonicalname = pl->canonicalname;
+
+    namelookup_pl_free(pl);
+    callback(addr, canonicalname, cctx);
+}
+
+static void namelookup_select_result(int fd, int event)
+{
+    pending_lookup *pl = find234(lookuptree, &fd, lookup_cmpforsearch);
+    if (!pl)
+        return;                        /* boggle */
+
+    char buf[4096];
+    ssize_t ret = read(fd, buf, sizeof(buf));
+    if (ret > 0) {
+        put_data(pl->data, buf, ret);
+        return;
+    }
+
+    /*
+     * EOF (or a read error): the answer is as complete as it's going
+     * to get. The subprocess holding the other end of the pipe has
+     * exited, so reap it, then parse what it sent and hand the
+     * result to the caller.
+     */
+    while (waitpid(pl->pid, NULL, 0) < 0 && errno == EINTR);
+
+    SockAddr *addr;
+    char *canonicalname;
+    namelookup_parse(pl, &addr, &canonicalname);
+
+    sk_namelookup_fn_t callback = pl->callback;
+    void *cctx = pl->vctx;
+    namelookup_pl_free(pl);
+    callback(addr, canonicalname, cctx);
+}
+
+pending_lookup *sk_namelookup_async(const char *host, int address_family,
+                                    sk_namelookup_fn_t callback, void *vctx)
+{
+    pending_lookup *pl = snew(pending_lookup);
+    pl->fd = -1;
+    pl->pid = -1;
+    pl->data = strbuf_new();
+    pl->addr = NULL;
+    pl->canonicalname = NULL;
+    pl->host = dupstr(host);
+    pl->callback = callback;
+    pl->vctx = vctx;
+
+    int pipefd[2];
+    if (host[0] != '/' && pipe(pipefd) == 0) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(pipefd[0]);
+            namelookup_subprocess(pipefd[1], host, address_family);
+            _exit(0);
+        } else if (pid > 0) {
+            close(pipefd[1]);
+            cloexec(pipefd[0]);
+            pl->fd = pipefd[0];
+            pl->pid = pid;
+            add234(lookuptree, pl);
+            uxsel_set(pl->fd, SELECT_R, namelookup_select_result);
+            return pl;
+        }
+        /* fork failed: fall through to the synchronous fallback */
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+
+    /*
+     * Unix socket paths don't need a subprocess (there's no real
+     * lookup to do), and if fork or pipe failed we can still get the
+     * job done by blocking. Either way, do the lookup here and
+     * deliver the result via a toplevel callback.
+     */
+    pl->addr = sk_namelookup(host, &pl->canonicalname, address_family);
+    queue_toplevel_callback(namelookup_deliver_ready, pl);
+    return pl;
+}
+
+void sk_namelookup_cancel(pending_lookup *pl)
+{
+    if (pl->fd >= 0) {
+        kill(pl->pid, SIGKILL);
+        while (waitpid(pl->pid, NULL, 0) < 0 && errno == EINTR);
+    } else {
+        delete_callbacks_for_context(pl);
+        sk_addr_free(pl->addr);
+        sfree(pl->canonicalname);
+    }
+    namelookup_pl_free(pl);
+}
+
 static bool sk_nextaddr(SockAddr *addr, SockAddrStep *step)
 {
 #ifndef NO_IPV6
@@ -474,11 +831,23 @@ void sk_addr_free(SockAddr *addr)
     if (--addr->refcount > 0)
         return;
 #ifndef NO_IPV6
-    if (addr->ais != NULL)
-        freeaddrinfo(addr->ais);
+    if (addr->ais != NULL) {
+        if (addr->ais_synthetic) {
+            struct addrinfo *ai = addr->ais;
+            while (ai) {
+                struct addrinfo *next = ai->ai_next;
+                sfree(ai->ai_addr);
+                sfree(ai);
+                ai = next;
+            }
+        } else {
+            freeaddrinfo(addr->ais);
+        }
+    }
 #else
     sfree(addr->addresses);
 #endif
+    sfree(addr->errmsg);
     sfree(addr);
 }
 
@@ -502,6 +871,10 @@ static size_t sk_net_write(Socket *s, const void *data, size_t len);
 static size_t sk_net_write_oob(Socket *s, const void *data, size_t len);
 static void sk_net_write_eof(Socket *s);
 static void sk_net_set_frozen(Socket *s, bool is_frozen);
+static void sk_net_set_buffer_sizes(Socket *s, int sndbuf, int rcvbuf);
+static void sk_net_apply_buffer_sizes(NetSocket *s);
+static void sk_net_set_corked(Socket *s, bool corked);
+static void sk_net_apply_corked(NetSocket *s);
 static SocketPeerInfo *sk_net_peer_info(Socket *s);
 static const char *sk_net_socket_error(Socket *s);
 
@@ -512,6 +885,8 @@ static const SocketVtable NetSocket_sockvt = {
     .write_oob = sk_net_write_oob,
     .write_eof = sk_net_write_eof,
     .set_frozen = sk_net_set_frozen,
+    .set_buffer_sizes = sk_net_set_buffer_sizes,
+    .set_corked = sk_net_set_corked,
     .socket_error = sk_net_socket_error,
     .peer_info = sk_net_peer_info,
 };
@@ -540,6 +915,10 @@ static Socket *sk_net_accept(accept_ctx_t ctx, Plug *plug)
     ret->listener = false;
     ret->parent = ret->child = NULL;
     ret->addr = NULL;
+    ret->more_addrs = false;
+    ret->attempts = NULL;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
     ret->connected = true;
 
     ret->s = sockfd;
@@ -557,25 +936,84 @@ static Socket *sk_net_accept(accept_ctx_t ctx, Plug *plug)
     return &ret->sock;
 }
 
-static int try_connect(NetSocket *sock)
+static void net_attempt_select_result(int fd, int event);
+static void net_attempt_timer(void *ctx, unsigned long now);
+
+/*
+ * Take a connection attempt off its parent's list and out of the
+ * attempt tree, and free it, closing its fd unless told otherwise
+ * (because it's just become the parent's own fd).
+ */
+static void net_attempt_free(NetSocketAttempt *attempt, bool close_fd)
 {
-    int s;
-    union sockaddr_union u;
-    const union sockaddr_union *sa;
-    int err = 0;
-    short localport;
-    int salen, family;
+    NetSocketAttempt **p = &attempt->parent->attempts;
+    while (*p != attempt)
+        p = &(*p)->next;
+    *p = attempt->next;
+
+    uxsel_del(attempt->s);
+    del234(conntree, attempt);
+    if (close_fd)
+        close(attempt->s);
+    sfree(attempt);
+}
+
+/*
+ * Throw away all of a socket's in-flight connection attempts, and any
+ * timer that was going to start another one.
+ */
+static void net_attempts_cleanup(NetSocket *sock)
+{
+    while (sock->attempts)
+        net_attempt_free(sock->attempts, true);
+    expire_timer_context(sock);
+}
+
+/*
+ * A connection attempt to the given address has succeeded: install
+ * its fd as the NetSocket's own file descriptor, and abandon any
+ * other attempts still racing.
+ */
+static void net_socket_connected(NetSocket *sock, int fd, SockAddrStep step)
+{
+    net_attempts_cleanup(sock);
 
     /*
      * Remove the socket from the tree before we overwrite its
      * internal socket id, because that forms part of the tree's
-     * sorting criterion. We'll add it back before exiting this
-     * function, whether we changed anything or not.
+     * sorting criterion.
      */
     del234(sktree, sock);
+    sock->s = fd;
+    sock->step = step;
+    sock->connected = true;
+    sock->writable = true;
+    add234(sktree, sock);
+
+    sk_net_apply_buffer_sizes(sock);
+    if (sock->corked)
+        sk_net_apply_corked(sock);
+
+    SockAddr thisaddr = sk_extractaddr_tmp(sock->addr, &sock->step);
+    plug_log(sock->plug, PLUGLOG_CONNECT_SUCCESS,
+             &thisaddr, sock->port, NULL, 0);
+
+    uxsel_tell(sock);
+}
 
-    if (sock->s >= 0)
-        close(sock->s);
+/*
+ * Start a connection attempt to the candidate address that sock->step
+ * currently points at. Returns an errno value if the attempt failed
+ * immediately, and 0 if it either succeeded or is still in progress.
+ */
+static int net_attempt_start(NetSocket *sock)
+{
+    int s;
+    union sockaddr_union u;
+    const union sockaddr_union *sa;
+    int err = 0;
+    short localport;
+    int salen, family;
 
     {
         SockAddr thisaddr = sk_extractaddr_tmp(
@@ -590,7 +1028,6 @@ static int try_connect(NetSocket *sock)
     family = SOCKADDR_FAMILY(sock->addr, sock->step);
     assert(family != AF_UNSPEC);
     s = socket(family, SOCK_STREAM, 0);
-    sock->s = s;
 
     if (s < 0) {
         err = errno;
@@ -728,30 +1165,33 @@ static int try_connect(NetSocket *sock)
     if ((connect(s, &(sa->sa), salen)) < 0) {
         if ( errno != EINPROGRESS ) {
             err = errno;
+            close(s);
             goto ret;
         }
+
+        /*
+         * The connect is still in progress: make a NetSocketAttempt
+         * record, and watch the fd for writability, which is how
+         * poll reports the attempt's eventual success or failure.
+         */
+        NetSocketAttempt *attempt = snew(NetSocketAttempt);
+        attempt->parent = sock;
+        attempt->s = s;
+        attempt->step = sock->step;
+        attempt->next = sock->attempts;
+        sock->attempts = attempt;
+        add234(conntree, attempt);
+        uxsel_set(s, SELECT_W, net_attempt_select_result);
     } else {
         /*
          * If we _don't_ get EWOULDBLOCK, the connect has completed
-         * and we should set the socket as connected and writable.
+         * and we can make this fd the socket's own straight away.
          */
-        sock->connected = true;
-        sock->writable = true;
-
-        SockAddr thisaddr = sk_extractaddr_tmp(sock->addr, &sock->step);
-        plug_log(sock->plug, PLUGLOG_CONNECT_SUCCESS,
-                 &thisaddr, sock->port, NULL, 0);
+        net_socket_connected(sock, s, sock->step);
     }
 
-    uxsel_tell(sock);
-
     ret:
 
-    /*
-     * No matter what happened, put the socket back in the tree.
-     */
-    add234(sktree, sock);
-
     if (err) {
         SockAddr thisaddr = sk_extractaddr_tmp(
             sock->addr, &sock->step);
@@ -761,6 +1201,94 @@ static int try_connect(NetSocket *sock)
     return err;
 }
 
+/*
+ * Launch connection attempts at successive candidate addresses until
+ * one of them at least gets off the ground, and if there are further
+ * candidates after that, set a timer to start the next one racing in
+ * parallel in case this one turns out to be unresponsive.
+ *
+ * Returns an errno value if every candidate we tried failed
+ * immediately; the caller must decide whether that's fatal (it isn't
+ * if previous attempts are still in flight).
+ */
+static int net_attempts_go(NetSocket *sock)
+{
+    int err = 0;
+
+    while (!sock->connected && sock->more_addrs) {
+        err = net_attempt_start(sock);
+        sock->more_addrs = sk_nextaddr(sock->addr, &sock->step);
+        if (!err) {
+            if (!sock->connected && sock->more_addrs)
+                schedule_timer(CONNECTION_ATTEMPT_DELAY,
+                               net_attempt_timer, sock);
+            break;
+        }
+        /* That one failed immediately: go straight on to the next. */
+    }
+
+    return err;
+}
+
+static void net_attempt_timer(void *ctx, unsigned long now)
+{
+    NetSocket *sock = (NetSocket *)ctx;
+
+    /*
+     * The head-start period has elapsed without the previous attempt
+     * either succeeding (which would have cancelled this timer) or
+     * failing (which would have started the next attempt already). So
+     * start another candidate address racing alongside it.
+     */
+    net_attempts_go(sock);
+}
+
+static void net_attempt_select_result(int fd, int event)
+{
+    NetSocketAttempt *attempt = find234(conntree, &fd, attempt_cmpforsearch);
+    if (!attempt)
+        return;                        /* boggle */
+    NetSocket *s = attempt->parent;
+
+    /*
+     * poll reports a socket as writable when an asynchronous
+     * connect() attempt either completes or fails, so first we must
+     * find out which.
+     */
+    int err = 0;
+    socklen_t errlen = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0)
+        err = errno;
+
+    if (!err) {
+        int winner = attempt->s;
+        SockAddrStep step = attempt->step;
+        net_attempt_free(attempt, false);
+        net_socket_connected(s, winner, step);
+        return;
+    }
+
+    /*
+     * This attempt failed. Report the problem via plug_log, discard
+     * it, and move straight on to the next candidate address, if any.
+     */
+    {
+        SockAddr thisaddr = sk_extractaddr_tmp(s->addr, &attempt->step);
+        plug_log(s->plug, PLUGLOG_CONNECT_FAILED,
+                 &thisaddr, s->port, strerror(err), err);
+    }
+    net_attempt_free(attempt, true);
+
+    int err2 = net_attempts_go(s);
+    if (err2)
+        err = err2;
+
+    if (!s->connected && !s->attempts) {
+        plug_closing(s->plug, strerror(err), err, 0);
+        return;                  /* socket is now presumably defunct */
+    }
+}
+
 Socket *sk_new(SockAddr *addr, int port, bool privport, bool oobinline,
                bool nodelay, bool keepalive, Plug *plug)
 {
@@ -788,18 +1316,21 @@ Socket *sk_new(SockAddr *addr, int port, bool privport, bool oobinline,
     ret->listener = false;
     ret->addr = addr;
     START_STEP(ret->addr, ret->step);
+    ret->more_addrs = true;
+    ret->attempts = NULL;
     ret->s = -1;
     ret->oobinline = oobinline;
     ret->nodelay = nodelay;
     ret->keepalive = keepalive;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
     ret->privport = privport;
     ret->port = port;
 
-    do {
-        err = try_connect(ret);
-    } while (err && sk_nextaddr(ret->addr, &ret->step));
+    add234(sktree, ret);
 
-    if (err)
+    err = net_attempts_go(ret);
+    if (err && !ret->connected && !ret->attempts)
         ret->error = strerror(err);
 
     return &ret->sock;
@@ -840,6 +1371,10 @@ Socket *sk_newlistener(const char *srcaddr, int port, Plug *plug,
     ret->incomingeof = false;
     ret->listener = true;
     ret->addr = NULL;
+    ret->more_addrs = false;
+    ret->attempts = NULL;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
     ret->s = -1;
 
     /*
@@ -974,6 +1509,14 @@ Socket *sk_newlistener(const char *srcaddr, int port, Plug *plug,
         return &ret->sock;
     }
 
+    /*
+     * Make the listening socket non-blocking, so that if several
+     * processes share it (as psocks's worker mode arranges) and
+     * another process wins the race for a connection, our accept
+     * returns EAGAIN instead of blocking the event loop.
+     */
+    nonblock(s);
+
 #ifndef NO_IPV6
     /*
      * If we were given ADDRTYPE_UNSPEC, we must also create an
@@ -1019,6 +1562,8 @@ static void sk_net_close(Socket *sock)
 
     bufchain_clear(&s->output_data);
 
+    net_attempts_cleanup(s);
+
     del234(sktree, s);
     if (s->s >= 0) {
         uxsel_del(s->s);
@@ -1111,23 +1656,29 @@ static void socket_error_callback(void *vs)
 void try_send(NetSocket *s)
 {
     while (s->sending_oob || bufchain_size(&s->output_data) > 0) {
-        int nsent;
+        ssize_t nsent;
         int err;
-        const void *data;
-        size_t len;
-        int urgentflag;
 
         if (s->sending_oob) {
-            urgentflag = MSG_OOB;
-            len = s->sending_oob;
-            data = &s->oobdata;
+            nsent = send(s->s, &s->oobdata, s->sending_oob, MSG_OOB);
         } else {
-            urgentflag = 0;
-            ptrlen bufdata = bufchain_prefix(&s->output_data);
-            data = bufdata.ptr;
-            len = bufdata.len;
+            /*
+             * Gather as many granules of the output bufchain as we
+             * can into one writev call, instead of making a system
+             * call per granule. A partial write is fine:
+             * bufchain_consume below will take care of however much
+             * of the chain actually went out.
+             */
+            ptrlen prefixes[16];
+            struct iovec iov[lenof(prefixes)];
+            size_t i, niov = bufchain_prefixes(
+                &s->output_data, prefixes, lenof(prefixes));
+            for (i = 0; i < niov; i++) {
+                iov[i].iov_base = (void *)prefixes[i].ptr;
+                iov[i].iov_len = prefixes[i].len;
+            }
+            nsent = writev(s->s, iov, niov);
         }
-        nsent = send(s->s, data, len, urgentflag);
         noise_ultralight(NOISE_SOURCE_IOLEN, nsent);
         if (nsent <= 0) {
             err = (nsent < 0 ? errno : 0);
@@ -1163,9 +1714,10 @@ void try_send(NetSocket *s)
             }
         } else {
             if (s->sending_oob) {
-                if (nsent < len) {
-                    memmove(s->oobdata, s->oobdata+nsent, len-nsent);
-                    s->sending_oob = len - nsent;
+                if ((size_t)nsent < s->sending_oob) {
+                    memmove(s->oobdata, s->oobdata+nsent,
+                            s->sending_oob - nsent);
+                    s->sending_oob -= nsent;
                 } else {
                     s->sending_oob = 0;
                 }
@@ -1403,67 +1955,12 @@ static void net_select_result(int fd, int event)
         }
         break;
       case SELECT_W:                   /* writable */
-        if (!s->connected) {
-            /*
-             * select/poll reports a socket as _writable_ when an
-             * asynchronous connect() attempt either completes or
-             * fails. So first we must find out which.
-             */
-            {
-                int err;
-                socklen_t errlen = sizeof(err);
-                char *errmsg = NULL;
-                if (getsockopt(s->s, SOL_SOCKET, SO_ERROR, &err, &errlen)<0) {
-                    errmsg = dupprintf("getsockopt(SO_ERROR): %s",
-                                       strerror(errno));
-                    err = errno;       /* got to put something in here */
-                } else if (err != 0) {
-                    errmsg = dupstr(strerror(err));
-                }
-                if (errmsg) {
-                    /*
-                     * The asynchronous connection attempt failed.
-                     * Report the problem via plug_log, and try again
-                     * with the next candidate address, if we have
-                     * more than one.
-                     */
-                    SockAddr thisaddr;
-                    assert(s->addr);
-
-                    thisaddr = sk_extractaddr_tmp(s->addr, &s->step);
-                    plug_log(s->plug, PLUGLOG_CONNECT_FAILED,
-                             &thisaddr, s->port, errmsg, err);
-
-                    while (err && s->addr && sk_nextaddr(s->addr, &s->step)) {
-                        err = try_connect(s);
-                    }
-                    if (err) {
-                        plug_closing(s->plug, strerror(err), err, 0);
-                        return;      /* socket is now presumably defunct */
-                    }
-                    if (!s->connected)
-                        return;      /* another async attempt in progress */
-                } else {
-                    /*
-                     * The connection attempt succeeded.
-                     */
-                    SockAddr thisaddr = sk_extractaddr_tmp(s->addr, &s->step);
-                    plug_log(s->plug, PLUGLOG_CONNECT_SUCCESS,
-                             &thisaddr, s->port, NULL, 0);
-                }
-            }
-
+        {
             /*
-             * If we get here, we've managed to make a connection.
+             * (Asynchronous connects never get here: they're handled
+             * by net_attempt_select_result, and the fd isn't
+             * installed in the NetSocket until it's fully connected.)
              */
-            if (s->addr) {
-                sk_addr_free(s->addr);
-                s->addr = NULL;
-            }
-            s->connected = true;
-            s->writable = true;
-            uxsel_tell(s);
-        } else {
             size_t bufsize_before, bufsize_after;
             s->writable = true;
             bufsize_before = s->sending_oob + bufchain_size(&s->output_data);
@@ -1500,6 +1997,70 @@ static void sk_net_set_frozen(Socket *sock, bool is_frozen)
     uxsel_tell(s);
 }
 
+/*
+ * Apply any configured kernel buffer sizes to a socket's fd. This is
+ * best-effort: failure just leaves the buffer at its previous size,
+ * and the kernel is free to clamp the values we ask for in any case.
+ */
+static void sk_net_apply_buffer_sizes(NetSocket *s)
+{
+    if (s->s < 0)
+        return;
+    if (s->sndbuf > 0)
+        setsockopt(s->s, SOL_SOCKET, SO_SNDBUF,
+                   (void *)&s->sndbuf, sizeof(s->sndbuf));
+    if (s->rcvbuf > 0)
+        setsockopt(s->s, SOL_SOCKET, SO_RCVBUF,
+                   (void *)&s->rcvbuf, sizeof(s->rcvbuf));
+}
+
+/*
+ * Apply the current cork state to a socket's fd. On Linux this uses
+ * TCP_CORK, which holds back partial segments until uncorked (or
+ * until the kernel's 200ms cork timeout, which bounds the damage if a
+ * caller forgets to uncork). Elsewhere we approximate it by disabling
+ * TCP_NODELAY while corked, so that Nagle does the coalescing, and
+ * restoring the configured Nagle setting on uncork.
+ */
+static void sk_net_apply_corked(NetSocket *s)
+{
+    if (s->s < 0)
+        return;
+#ifdef TCP_CORK
+    {
+        int b = s->corked ? 1 : 0;
+        setsockopt(s->s, IPPROTO_TCP, TCP_CORK, (void *)&b, sizeof(b));
+    }
+#else
+    {
+        int b = (!s->corked && s->nodelay) ? 1 : 0;
+        setsockopt(s->s, IPPROTO_TCP, TCP_NODELAY, (void *)&b, sizeof(b));
+    }
+#endif
+}
+
+static void sk_net_set_corked(Socket *sock, bool corked)
+{
+    NetSocket *s = container_of(sock, NetSocket, sock);
+    if (s->corked == corked)
+        return;
+    s->corked = corked;
+    sk_net_apply_corked(s);
+}
+
+static void sk_net_set_buffer_sizes(Socket *sock, int sndbuf, int rcvbuf)
+{
+    NetSocket *s = container_of(sock, NetSocket, sock);
+    s->sndbuf = sndbuf;
+    s->rcvbuf = rcvbuf;
+    /*
+     * If we don't have a file descriptor yet (because connection
+     * attempts are still racing), the sizes are applied when the
+     * winning attempt's fd is installed, in net_socket_connected.
+     */
+    sk_net_apply_buffer_sizes(s);
+}
+
 static SocketPeerInfo *sk_net_peer_info(Socket *sock)
 {
     NetSocket *s = container_of(sock, NetSocket, sock);
@@ -1576,6 +2137,8 @@ int sk_net_get_fd(Socket *sock)
 static void uxsel_tell(NetSocket *s)
 {
     int rwx = 0;
+    if (s->s < 0)
+        return;      /* still connecting: no fd of our own to select on */
     if (!s->pending_error) {
         if (s->listener) {
             rwx |= SELECT_R;           /* read == accept */
@@ -1703,6 +2266,8 @@ Socket *new_unix_listener(SockAddr *listenaddr, Plug *plug)
     ret->incomingeof = false;
     ret->listener = true;
     ret->addr = listenaddr;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
     ret->s = -1;
 
     assert(listenaddr->superfamily == UNIX);
@@ -1718,6 +2283,13 @@ Socket *new_unix_listener(SockAddr *listenaddr, Plug *plug)
 
     cloexec(s);
 
+    /*
+     * As in sk_newlistener: if several processes share this listening
+     * socket and another one wins the race for a connection, our
+     * accept should return EAGAIN instead of blocking the event loop.
+     */
+    nonblock(s);
+
     ret->oobinline = false;
 
     memset(&u, '\0', sizeof(u));
@@ -16,6 +16,10 @@
 #include "ssh.h"
 #include "storage.h"
 
+#if HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
 static bool read_dev_urandom(char *buf, int len)
 {
     int fd;
@@ -40,31 +44,47 @@ static bool read_dev_urandom(char *buf, int len)
     return true;
 }
 
+static bool read_system_entropy(char *buf, int len)
+{
+#if HAVE_GETRANDOM
+    /*
+     * Where the system provides it, prefer getrandom(): one syscall
+     * with no fd juggling, and it works even in a chroot with no
+     * /dev. Fall through to /dev/urandom if it unexpectedly fails.
+     */
+    int ngot = 0;
+    while (ngot < len) {
+        ssize_t ret = getrandom(buf + ngot, len - ngot, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        ngot += ret;
+    }
+    if (ngot == len)
+        return true;
+#endif
+    return read_dev_urandom(buf, len);
+}
+
 /*
- * This function is called once, at PuTTY startup. It will do some
- * slightly silly things such as fetching an entire process listing
- * and scanning /tmp, load the saved random seed from disk, and
- * also read 32 bytes out of /dev/urandom.
+ * The traditional fallback entropy sources: fetch an entire process
+ * listing and scan /tmp, feeding whatever comes back to the given
+ * output function. Slow, because of the two subprocess invocations.
  */
-
-void noise_get_heavy(void (*func) (void *, int))
+static void listing_harvest(void (*func) (void *, int), bool required)
 {
     char buf[512];
     FILE *fp;
     int ret;
-    bool got_dev_urandom = false;
-
-    if (read_dev_urandom(buf, 32)) {
-        got_dev_urandom = true;
-        func(buf, 32);
-    }
 
     fp = popen("ps -axu 2>/dev/null", "r");
     if (fp) {
         while ( (ret = fread(buf, 1, sizeof(buf), fp)) > 0)
             func(buf, ret);
         pclose(fp);
-    } else if (!got_dev_urandom) {
+    } else if (required) {
         fprintf(stderr, "popen: %s\n"
                 "Unable to access fallback entropy source\n", strerror(errno));
         exit(1);
@@ -75,11 +95,41 @@ void noise_get_heavy(void (*func) (void *, int))
         while ( (ret = fread(buf, 1, sizeof(buf), fp)) > 0)
             func(buf, ret);
         pclose(fp);
-    } else if (!got_dev_urandom) {
+    } else if (required) {
         fprintf(stderr, "popen: %s\n"
                 "Unable to access fallback entropy source\n", strerror(errno));
         exit(1);
     }
+}
+
+static bool listing_harvest_deferred = false;
+
+static void listing_harvest_to_pool(void *noise, int length)
+{
+    random_add_noise(NOISE_SOURCE_SYSLISTING, noise, length);
+}
+
+/*
+ * This function is called once, at PuTTY startup. It reads a batch of
+ * randomness from the kernel and loads the saved random seed from
+ * disk; for a short-lived tool like plink or pscp that's all the
+ * startup cost there is. The traditional subprocess-based harvesting
+ * is only run here - synchronously, as a required source - if the
+ * kernel can't supply us; otherwise it's deferred to the first
+ * regular noise collection, by which time the connection is long
+ * since up and running.
+ */
+
+void noise_get_heavy(void (*func) (void *, int))
+{
+    char buf[32];
+
+    if (read_system_entropy(buf, sizeof(buf))) {
+        func(buf, sizeof(buf));
+        listing_harvest_deferred = true;
+    } else {
+        listing_harvest(func, true);
+    }
 
     read_random_seed(func);
 }
@@ -95,6 +145,11 @@ void noise_regular(void)
     char buf[512];
     struct rusage rusage;
 
+    if (listing_harvest_deferred) {
+        listing_harvest_deferred = false;
+        listing_harvest(listing_harvest_to_pool, false);
+    }
+
     if ((fd = open("/proc/meminfo", O_RDONLY)) >= 0) {
         while ( (ret = read(fd, buf, sizeof(buf))) > 0)
             random_add_noise(NOISE_SOURCE_MEMINFO, buf, ret);
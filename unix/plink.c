@@ -380,6 +380,8 @@ static int plink_get_userpass_input(Seat *seat, prompts_t *p)
     return ret;
 }
 
+static void plink_notify_session_started(Seat *seat);
+
 static bool plink_seat_interactive(Seat *seat)
 {
     return (!*conf_get_str(conf, CONF_remote_cmd) &&
@@ -392,7 +394,7 @@ static const SeatVtable plink_seat_vt = {
     .eof = plink_eof,
     .sent = nullseat_sent,
     .get_userpass_input = plink_get_userpass_input,
-    .notify_session_started = nullseat_notify_session_started,
+    .notify_session_started = plink_notify_session_started,
     .notify_remote_exit = nullseat_notify_remote_exit,
     .notify_remote_disconnect = nullseat_notify_remote_disconnect,
     .connection_fatal = console_connection_fatal,
@@ -490,6 +492,22 @@ void sigwinch(int signum)
         /* not much we can do about it */;
 }
 
+/*
+ * SIGUSR1 dumps the recent SSH packet trace to standard error, for
+ * diagnosing a session that's hung with no packet log enabled. The
+ * handler just sets a flag and pokes the signal pipe so that the main
+ * loop completes an iteration and notices it; the dump itself happens
+ * back in the main loop.
+ */
+static volatile sig_atomic_t pkttrace_dump_pending = false;
+
+static void sigusr1(int signum)
+{
+    pkttrace_dump_pending = true;
+    if (write(signalpipe[1], "x", 1) <= 0)
+        /* not much we can do about it */;
+}
+
 /*
  * Short description of parameters.
  */
@@ -557,6 +575,8 @@ static void usage(void)
     printf("            control what happens when a log file already exists\n");
     printf("  -shareexists\n");
     printf("            test whether a connection-sharing upstream exists\n");
+    printf("  -daemon   hold an authenticated connection open in the\n");
+    printf("            background as a connection-sharing upstream\n");
     exit(1);
 }
 
@@ -583,6 +603,49 @@ const unsigned cmdline_tooltype =
 
 static bool seen_stdin_eof = false;
 
+/*
+ * Connection-holding daemon mode (the -daemon option): once the
+ * connection is up, fork into the background and sit there as a
+ * connection-sharing upstream, running no session of our own, so that
+ * subsequent plink invocations with sharing enabled can dispatch
+ * commands over the Unix-domain socket without paying for another
+ * connect + kex + auth.
+ */
+static bool daemon_mode = false, daemonised = false;
+
+static void daemonise(void)
+{
+    pid_t pid;
+    int fd;
+
+    daemonised = true;      /* don't try again even if something fails */
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return;                        /* carry on in the foreground */
+    }
+    if (pid > 0) {
+        /*
+         * Parent. Exiting here tells the caller that the connection
+         * is up and authenticated, so downstreams can now connect.
+         * _exit rather than exit, because the child now owns the
+         * termios state protected by our atexit handler.
+         */
+        _exit(0);
+    }
+
+    setsid();
+    fd = open("/dev/null", O_RDWR);
+    if (fd >= 0) {
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        if (fd > 2)
+            close(fd);
+    }
+}
+
 static bool plink_pw_setup(void *vctx, pollwrapper *pw)
 {
     pollwrap_add_fd_rwx(pw, signalpipe[0], SELECT_R);
@@ -651,9 +714,24 @@ static void plink_pw_check(void *vctx, pollwrapper *pw)
     }
 }
 
+/*
+ * In daemon mode, drop into the background as soon as the connection
+ * is ready for use, like ssh -f. Until then we stay in the foreground
+ * so that auth prompts can reach the console.
+ */
+static void plink_notify_session_started(Seat *seat)
+{
+    if (daemon_mode && !daemonised)
+        daemonise();
+}
+
 static bool plink_continue(void *vctx, bool found_any_fd,
                            bool ran_any_callback)
 {
+    if (pkttrace_dump_pending) {
+        pkttrace_dump_pending = false;
+        ssh_packet_trace_dump(stderr);
+    }
     if (!backend_connected(backend) &&
         bufchain_size(&stdout_data) == 0 && bufchain_size(&stderr_data) == 0)
         return false;                  /* terminate main loop */
@@ -749,6 +827,8 @@ int main(int argc, char **argv)
             }
         } else if (!strcmp(p, "-shareexists")) {
             just_test_share_exists = true;
+        } else if (!strcmp(p, "-daemon")) {
+            daemon_mode = true;
         } else if (!strcmp(p, "-fuzznet")) {
             conf_set_int(conf, CONF_proxy_type, PROXY_FUZZ);
             conf_set_str(conf, CONF_proxy_telnet_command, "%host");
@@ -858,6 +938,7 @@ int main(int argc, char **argv)
     cloexec(signalpipe[0]);
     cloexec(signalpipe[1]);
     putty_signal(SIGWINCH, sigwinch);
+    putty_signal(SIGUSR1, sigusr1);
 
     /*
      * Now that we've got the SIGWINCH handler installed, try to find
@@ -909,6 +990,26 @@ int main(int argc, char **argv)
         !conf_get_str_nthstrkey(conf, CONF_portfwd, 0))
         conf_set_bool(conf, CONF_ssh_simple, true);
 
+    if (daemon_mode) {
+        /*
+         * A daemon exists only to hold the connection open for
+         * sharing downstreams: force sharing on, and don't start a
+         * shell or command of our own. If an upstream for this
+         * destination already exists, there's nothing to do.
+         */
+        conf_set_bool(conf, CONF_ssh_connection_sharing, true);
+        conf_set_bool(conf, CONF_ssh_no_shell, true);
+        if (backvt->test_for_upstream &&
+            backvt->test_for_upstream(conf_get_str(conf, CONF_host),
+                                      conf_get_int(conf, CONF_port), conf)) {
+            fprintf(stderr, "plink: connection-sharing upstream already "
+                    "exists for this destination\n");
+            return 0;
+        }
+        /* The daemon has no stdin of its own to forward. */
+        seen_stdin_eof = true;
+    }
+
     if (just_test_share_exists) {
         if (!backvt->test_for_upstream) {
             fprintf(stderr, "Connection sharing not supported for this "
@@ -127,15 +127,60 @@ static void start_subcommand(strbuf *args)
     }
 }
 
+/*
+ * Read end of a pipe whose write end is held open for the lifetime of
+ * the original process. Each worker polls it in its event loop; EOF
+ * tells the worker that the original process has gone, at which point
+ * the worker should stop too.
+ */
+static int worker_pipe_rd = -1;
+
+static unsigned start_workers(int nworkers)
+{
+    int pipefd[2];
+
+    if (pipe(pipefd) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    for (int i = 1; i < nworkers; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            /*
+             * We're a worker. The listening socket is already set up,
+             * and we've inherited a copy of its fd, so the kernel
+             * will share incoming connections out between all the
+             * workers' accept calls. Return our worker index at once,
+             * so we don't fall through and fork workers of our own.
+             */
+            close(pipefd[1]);
+            worker_pipe_rd = pipefd[0];
+            return i;
+        }
+    }
+
+    /* The original process keeps the write end open (and never writes
+     * to it), so that its termination is visible to the workers. */
+    close(pipefd[0]);
+    return 0;
+}
+
 static const PsocksPlatform platform = {
     open_pipes,
     start_subcommand,
+    start_workers,
 };
 
 static bool psocks_pw_setup(void *ctx, pollwrapper *pw)
 {
     if (signalpipe[0] >= 0)
         pollwrap_add_fd_rwx(pw, signalpipe[0], SELECT_R);
+    if (worker_pipe_rd >= 0)
+        pollwrap_add_fd_rwx(pw, worker_pipe_rd, SELECT_R);
     return true;
 }
 
@@ -152,6 +197,13 @@ static void psocks_pw_check(void *ctx, pollwrapper *pw)
                 still_running = false;
         }
     }
+
+    if (worker_pipe_rd >= 0 &&
+        pollwrap_check_fd_rwx(pw, worker_pipe_rd, SELECT_R)) {
+        char buf[1];
+        if (read(worker_pipe_rd, buf, 1) <= 0)
+            still_running = false;     /* the original process has gone */
+    }
 }
 
 static bool psocks_continue(void *ctx, bool found_any_fd,
@@ -163,6 +163,8 @@ static void show_help(FILE *fp)
     fputs("usage:   psusan [options]\n"
           "options: --listen SOCKETPATH  listen for connections on a Unix-domain socket\n"
           "         --listen-once        (with --listen) stop after one connection\n"
+          "         --fork               (with --listen) serve each connection in a\n"
+          "                                forked subprocess\n"
           "         --verbose            print log messages to standard error\n"
           "         --sessiondir DIR     cwd for session subprocess (default $HOME)\n"
           "         --sshlog FILE        write ssh-connection packet log to FILE\n"
@@ -181,7 +183,7 @@ static void show_version_and_exit(void)
 
 const bool buildinfo_gtk_relevant = false;
 
-static bool listening = false, listen_once = false;
+static bool listening = false, listen_once = false, fork_per_connection = false;
 static bool finished = false;
 void server_instance_terminated(LogPolicy *lp)
 {
@@ -295,6 +297,40 @@ static int server_accepting(Plug *p, accept_fn_t constructor, accept_ctx_t ctx)
         cfg->listening_socket = NULL;
     }
 
+    if (fork_per_connection) {
+        /*
+         * Serve this connection in a subprocess, forked from the
+         * already fully initialised parent, so that the parent can go
+         * straight back to accepting and each session is isolated
+         * from the others.
+         */
+        pid_t pid = fork();
+        if (pid > 0) {
+            /* Parent: the child owns the connection now. Keep our
+             * copy of next_id in step with the id the child will
+             * allocate itself, so that log messages stay distinct. */
+            cfg->next_id++;
+            close(ctx.i);
+            return 0;
+        } else if (pid < 0) {
+            /* Refuse the connection rather than serve it in-process:
+             * a later fork's child would inherit its fds. */
+            char *msg = dupprintf("fork failed: %s", strerror(errno));
+            log_to_stderr(-1, msg);
+            sfree(msg);
+            return 1;
+        } else {
+            /* Child: drop the listening socket, and arrange that when
+             * this one session terminates, so do we. */
+            putty_signal(SIGCHLD, SIG_DFL);
+            if (cfg->listening_socket) {
+                sk_close(cfg->listening_socket);
+                cfg->listening_socket = NULL;
+            }
+            listening = false;
+        }
+    }
+
     Plug *plug = server_conn_plug(cfg, &inst);
     s = constructor(ctx, plug);
     if ((err = sk_socket_error(s)) != NULL)
@@ -386,6 +422,8 @@ int main(int argc, char **argv)
             listen_socket = val;
         } else if (!strcmp(arg, "--listen-once")) {
             listen_once = true;
+        } else if (longoptnoarg(arg, "--fork")) {
+            fork_per_connection = true;
         } else {
             fprintf(stderr, "%s: unrecognised option '%s'\n", appname, arg);
             exit(1);
@@ -402,6 +440,11 @@ int main(int argc, char **argv)
 
     if (listen_socket) {
         listening = true;
+        if (fork_per_connection) {
+            /* Let the kernel reap the per-connection subprocesses;
+             * each child restores SIGCHLD for its own use. */
+            putty_signal(SIGCHLD, SIG_IGN);
+        }
         scfg.listening_plug.vt = &server_plugvt;
         SockAddr *addr = unix_sock_addr(listen_socket);
         scfg.listening_socket = new_unix_listener(addr, &scfg.listening_plug);
@@ -80,9 +80,29 @@ struct Pty {
     int exit_code;
     bufchain output_data;
     bool pending_eof;
+    char *readbuf;
+    size_t readbuf_size;
+    bool output_throttled;
     Backend backend;
 };
 
+/*
+ * Bounds for the adaptive buffer used to read output from the child
+ * process. It grows while the child is producing enough data to fill
+ * it in one event-loop cycle (bulk output such as build logs), and
+ * shrinks back when the flow subsides.
+ */
+#define PTY_READBUF_MIN 4096
+#define PTY_READBUF_MAX 262144
+
+/*
+ * Once the seat reports this much data buffered downstream of us, we
+ * stop reading from the child for the current event-loop cycle.
+ * (Same value as SSH_MAX_BACKLOG, since an SSH server session is the
+ * case where the downstream buffer really can back up.)
+ */
+#define PTY_MAX_BACKLOG 32768
+
 /*
  * We store all the (active) PtyFd structures in a tree sorted by fd,
  * so that when we get an uxsel notification we know which backend
@@ -416,6 +436,9 @@ static Pty *new_pty_struct(void)
     Pty *pty = snew(Pty);
     pty->conf = NULL;
     pty->pending_eof = false;
+    pty->readbuf = NULL;
+    pty->readbuf_size = 0;
+    pty->output_throttled = false;
     bufchain_init(&pty->output_data);
     return pty;
 }
@@ -591,7 +614,6 @@ static void pty_try_wait(void);
 
 static void pty_real_select_result(Pty *pty, int fd, int event, int status)
 {
-    char buf[4096];
     int ret;
     bool finished = false;
 
@@ -626,19 +648,87 @@ static void pty_real_select_result(Pty *pty, int fd, int event, int status)
     } else {
         if (event == SELECT_R) {
             bool is_stdout = (fd == pty->master_o);
+            size_t total = 0, backlog = 0;
+            bool seen_eof = false;
 
-            ret = read(fd, buf, sizeof(buf));
+            if (!pty->readbuf) {
+                pty->readbuf_size = PTY_READBUF_MIN;
+                pty->readbuf = snewn(pty->readbuf_size, char);
+            }
 
             /*
-             * Treat EIO on a pty master as equivalent to EOF (because
-             * that's how the kernel seems to report the event where
-             * the last process connected to the other end of the pty
-             * went away).
+             * Read as much as the child has ready, up to the size of
+             * our buffer, so that a process blasting bulk output
+             * costs us a few large reads per event-loop cycle rather
+             * than one 4K read per cycle. But honour the backpressure
+             * signal the seat returns: once it reports a backlog,
+             * stop reading and leave the rest in the kernel's buffer.
+             * The fd stays selected, so we'll pick the data up again
+             * on a later cycle once the seat has had a chance to
+             * drain; meanwhile the child is paced by the pty buffer
+             * filling, just as it was when we read one block per
+             * cycle. In particular this stops us racing ahead to the
+             * child's EOF while megabytes are still queued in an SSH
+             * server session's channel, which would make the channel
+             * close discard them.
              */
-            if (fd == pty->master_fd && ret < 0 && errno == EIO)
-                ret = 0;
+            while (total < pty->readbuf_size) {
+                ret = read(fd, pty->readbuf + total,
+                           pty->readbuf_size - total);
 
-            if (ret == 0) {
+                /*
+                 * Treat EIO on a pty master as equivalent to EOF
+                 * (because that's how the kernel seems to report the
+                 * event where the last process connected to the other
+                 * end of the pty went away).
+                 */
+                if (fd == pty->master_fd && ret < 0 && errno == EIO)
+                    ret = 0;
+
+                if (ret == 0) {
+                    seen_eof = true;
+                    break;
+                } else if (ret < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        break;
+                    if (errno == EINTR)
+                        continue;
+                    perror("read pty master");
+                    exit(1);
+                }
+
+                backlog = seat_output(pty->seat, !is_stdout,
+                                      pty->readbuf + total, ret);
+                total += ret;
+
+                /*
+                 * The seat may also have called pty_unthrottle with a
+                 * large backlog from within that seat_output call, in
+                 * which case output_throttled is now set and the fd
+                 * is already deselected for reading.
+                 */
+                if (backlog > PTY_MAX_BACKLOG || pty->output_throttled)
+                    break;
+            }
+
+            /*
+             * Let the buffer track recent throughput: grow it if the
+             * child filled it completely this cycle (and the seat
+             * kept up), and shrink it again once it's going mostly
+             * unused.
+             */
+            if (total == pty->readbuf_size &&
+                backlog <= PTY_MAX_BACKLOG &&
+                pty->readbuf_size < PTY_READBUF_MAX) {
+                pty->readbuf_size *= 2;
+                pty->readbuf = sresize(pty->readbuf, pty->readbuf_size, char);
+            } else if (total < pty->readbuf_size / 4 &&
+                       pty->readbuf_size > PTY_READBUF_MIN) {
+                pty->readbuf_size /= 2;
+                pty->readbuf = sresize(pty->readbuf, pty->readbuf_size, char);
+            }
+
+            if (seen_eof) {
                 /*
                  * EOF on this input fd, so to begin with, we may as
                  * well close it, and remove all references to it in
@@ -668,11 +758,6 @@ static void pty_real_select_result(Pty *pty, int fd, int event, int status)
                     if (!pty->child_dead)
                         pty->exit_code = 0;
                 }
-            } else if (ret < 0) {
-                perror("read pty master");
-                exit(1);
-            } else if (ret > 0) {
-                seat_output(pty->seat, !is_stdout, buf, ret);
             }
         } else if (event == SELECT_W) {
             /*
@@ -774,8 +859,10 @@ static void pty_uxsel_setup_fd(Pty *pty, int fd)
     if (fd < 0)
         return;
 
-    /* read from standard output and standard error pipes */
-    if (pty->master_o == fd || pty->master_e == fd)
+    /* read from standard output and standard error pipes, unless
+     * the consumer of our output has asked us to pause */
+    if ((pty->master_o == fd || pty->master_e == fd) &&
+        !pty->output_throttled)
         rwx |= SELECT_R;
     /* write to standard input pipe if we have any data */
     if (pty->master_i == fd && bufchain_size(&pty->output_data))
@@ -928,6 +1015,11 @@ Backend *pty_backend_create(
         pty->fds[1].fd = pty->master_o = pty->pipefds[2];
         pty->fds[2].fd = pty->master_e = pty->pipefds[4];
 
+        /* The read loop in pty_real_select_result expects to be able
+         * to read until EAGAIN, as it can on the pty master. */
+        nonblock(pty->master_o);
+        nonblock(pty->master_e);
+
         add234(ptyfds, &pty->fds[0]);
         add234(ptyfds, &pty->fds[1]);
         add234(ptyfds, &pty->fds[2]);
@@ -1314,6 +1406,11 @@ static void pty_free(Backend *be)
 
     bufchain_clear(&pty->output_data);
 
+    sfree(pty->readbuf);
+    pty->readbuf = NULL;
+    pty->readbuf_size = 0;
+    pty->output_throttled = false;
+
     conf_free(pty->conf);
     pty->conf = NULL;
 
@@ -1513,8 +1610,13 @@ static bool pty_sendok(Backend *be)
 
 static void pty_unthrottle(Backend *be, size_t backlog)
 {
-    /* Pty *pty = container_of(be, Pty, backend); */
-    /* do nothing */
+    Pty *pty = container_of(be, Pty, backend);
+    bool throttled = backlog > PTY_MAX_BACKLOG;
+
+    if (throttled != pty->output_throttled) {
+        pty->output_throttled = throttled;
+        pty_uxsel_setup(pty);
+    }
 }
 
 static bool pty_ldisc(Backend *be, int option)
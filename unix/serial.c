@@ -17,6 +17,15 @@
 
 #define SERIAL_MAX_BACKLOG 4096
 
+/*
+ * Adaptive read buffer bounds, as for the pty backend: a high-speed
+ * USB serial console can deliver megabytes per second, and reading it
+ * 4K at a time per event-loop cycle wastes most of a core on syscall
+ * and wakeup overhead.
+ */
+#define SERIAL_READBUF_MIN 4096
+#define SERIAL_READBUF_MAX 262144
+
 typedef struct Serial Serial;
 struct Serial {
     Seat *seat;
@@ -24,6 +33,8 @@ struct Serial {
     int fd;
     bool finished;
     size_t inbufsize;
+    char *readbuf;
+    size_t readbuf_size;
     bufchain output_data;
     Backend backend;
 };
@@ -301,6 +312,8 @@ static char *serial_init(const BackendVtable *vt, Seat *seat,
     serial->logctx = logctx;
     serial->finished = false;
     serial->inbufsize = 0;
+    serial->readbuf = NULL;
+    serial->readbuf_size = 0;
     bufchain_init(&serial->output_data);
 
     line = conf_get_str(conf, CONF_serline);
@@ -350,6 +363,7 @@ static void serial_free(Backend *be)
 
     bufchain_clear(&serial->output_data);
 
+    sfree(serial->readbuf);
     sfree(serial);
 }
 
@@ -370,7 +384,6 @@ static void serial_reconfig(Backend *be, Conf *conf)
 static void serial_select_result(int fd, int event)
 {
     Serial *serial;
-    char buf[4096];
     int ret;
     bool finished = false;
 
@@ -380,30 +393,72 @@ static void serial_select_result(int fd, int event)
         return;                /* spurious event; keep going */
 
     if (event == 1) {
-        ret = read(serial->fd, buf, sizeof(buf));
+        size_t total = 0;
 
-        if (ret == 0) {
-            /*
-             * Shouldn't happen on a real serial port, but I'm open
-             * to the idea that there might be two-way devices we
-             * can treat _like_ serial ports which can return EOF.
-             */
-            finished = true;
-        } else if (ret < 0) {
+        if (!serial->readbuf) {
+            serial->readbuf_size = SERIAL_READBUF_MIN;
+            serial->readbuf = snewn(serial->readbuf_size, char);
+        }
+
+        /*
+         * The port is non-blocking, so drain whatever has
+         * accumulated, up to the size of our buffer: one
+         * seat_stdout call per event-loop cycle rather than one
+         * per 4K read.
+         */
+        while (total < serial->readbuf_size) {
+            ret = read(serial->fd, serial->readbuf + total,
+                       serial->readbuf_size - total);
+
+            if (ret == 0) {
+                /*
+                 * Shouldn't happen on a real serial port, but I'm
+                 * open to the idea that there might be two-way
+                 * devices we can treat _like_ serial ports which can
+                 * return EOF.
+                 */
+                finished = true;
+                break;
+            } else if (ret < 0) {
 #ifdef EAGAIN
-            if (errno == EAGAIN)
-                return;        /* spurious */
+                if (errno == EAGAIN)
+                    break;
 #endif
 #ifdef EWOULDBLOCK
-            if (errno == EWOULDBLOCK)
-                return;        /* spurious */
+                if (errno == EWOULDBLOCK)
+                    break;
 #endif
-            perror("read serial port");
-            exit(1);
-        } else if (ret > 0) {
-            serial->inbufsize = seat_stdout(serial->seat, buf, ret);
+                if (errno == EINTR)
+                    continue;
+                perror("read serial port");
+                exit(1);
+            }
+
+            total += ret;
+        }
+
+        if (total) {
+            serial->inbufsize = seat_stdout(serial->seat,
+                                            serial->readbuf, total);
             serial_uxsel_setup(serial); /* might acquire backlog and freeze */
         }
+
+        /*
+         * Let the buffer track recent throughput: grow it if the
+         * device filled it completely this cycle, and shrink it
+         * again once it's going mostly unused.
+         */
+        if (total == serial->readbuf_size &&
+            serial->readbuf_size < SERIAL_READBUF_MAX) {
+            serial->readbuf_size *= 2;
+            serial->readbuf = sresize(serial->readbuf,
+                                      serial->readbuf_size, char);
+        } else if (total < serial->readbuf_size / 4 &&
+                   serial->readbuf_size > SERIAL_READBUF_MIN) {
+            serial->readbuf_size /= 2;
+            serial->readbuf = sresize(serial->readbuf,
+                                      serial->readbuf_size, char);
+        }
     } else if (event == 2) {
         /*
          * Attempt to send data down the pty.
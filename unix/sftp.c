@@ -4,6 +4,7 @@
 
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -156,6 +157,16 @@ int read_from_file(RFile *f, void *buffer, int length)
     return read(f->fd, buffer, length);
 }
 
+int map_from_file(RFile *f, const void **data, int length)
+{
+    /*
+     * No mapped read path here: read(2) on a sequentially-scanned
+     * file is already about as cheap as a page fault on a mapping
+     * would be, so the callers just use their fallback path.
+     */
+    return -1;
+}
+
 void close_rfile(RFile *f)
 {
     close(f->fd);
@@ -167,6 +178,22 @@ struct WFile {
     char *name;
 };
 
+WFile *open_wfile_for_update(const char *name)
+{
+    int fd;
+    WFile *ret;
+
+    fd = open(name, O_WRONLY);
+    if (fd < 0)
+        return NULL;
+
+    ret = snew(WFile);
+    ret->fd = fd;
+    ret->name = dupstr(name);
+
+    return ret;
+}
+
 WFile *open_new_file(const char *name, long perms)
 {
     int fd;
@@ -561,6 +588,44 @@ char *ssh_sftp_get_cmdline(const char *prompt, bool no_fds_ok)
     }
 }
 
+/*
+ * Spawn parallel worker subprocesses for PSCP's -stripe mode. On Unix
+ * this is a simple fork(): each child inherits a copy of the process
+ * state from before any connection was set up, runs its callback and
+ * exits with its return value.
+ */
+int psftp_run_subprocess_workers(int count, int (*fn)(void *ctx, int index),
+                                 void *ctx)
+{
+    pid_t *pids = snewn(count, pid_t);
+    int i, nfailed = 0;
+
+    for (i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "fork: %s\n", strerror(errno));
+            pids[i] = -1;
+            nfailed++;
+        } else if (pid == 0) {
+            _exit(fn(ctx, i));
+        } else {
+            pids[i] = pid;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        int status;
+        if (pids[i] < 0)
+            continue;
+        while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            nfailed++;
+    }
+
+    sfree(pids);
+    return nfailed;
+}
+
 void frontend_net_error_pending(void) {}
 
 void platform_psftp_pre_conn_setup(LogPolicy *lp) {}
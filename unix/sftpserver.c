@@ -497,15 +497,21 @@ static void uss_read(SftpServer *srv, SftpReplyBuilder *reply,
     if ((fd = uss_lookup_fd(uss, reply, handle)) < 0)
         return;
 
-    if ((buf = malloc(length)) == NULL) {
-        /* A rare case in which I bother to check malloc failure,
-         * because in this case we can localise the problem easily by
-         * turning it into a failure response from this one sftp
-         * request */
-        fxp_reply_error(reply, SSH_FX_FAILURE,
-                        "Out of memory for read buffer");
-        return;
-    }
+    /*
+     * Clamp the length to something sensible, in case a client asks
+     * for an enormous read. Returning less data than was asked for is
+     * always legal in SFTP, and this way the reply buffer allocation
+     * below can't be made to fail.
+     */
+    if (length > 1048576)
+        length = 1048576;
+
+    /*
+     * Read the file data directly into the reply packet, so that it
+     * doesn't have to be copied a second time by the marshalling
+     * layer.
+     */
+    buf = fxp_reply_data_prepare(reply, length);
 
     char *p = buf;
 
@@ -534,14 +540,14 @@ static void uss_read(SftpServer *srv, SftpReplyBuilder *reply,
     }
 
     if (status < 0) {
+        fxp_reply_data_finish(reply, 0);
         uss_error(uss, reply);
     } else if (p == buf) {
+        fxp_reply_data_finish(reply, 0);
         fxp_reply_error(reply, SSH_FX_EOF, "End of file");
     } else {
-        fxp_reply_data(reply, make_ptrlen(buf, p - buf));
+        fxp_reply_data_finish(reply, p - buf);
     }
-
-    free(buf);
 }
 
 static void uss_write(SftpServer *srv, SftpReplyBuilder *reply,
@@ -15,6 +15,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <pwd.h>
 #include "putty.h"
 #include "storage.h"
@@ -28,7 +29,7 @@
 
 enum {
     INDEX_DIR, INDEX_HOSTKEYS, INDEX_HOSTKEYS_TMP, INDEX_RANDSEED,
-    INDEX_SESSIONDIR, INDEX_SESSION,
+    INDEX_SESSIONDIR, INDEX_SESSION, INDEX_TRANSIENTHK,
 };
 
 static const char hex[16] = "0123456789ABCDEF";
@@ -202,6 +203,12 @@ static char *make_filename(int index, const char *subname)
         sfree(tmp);
         return ret;
     }
+    if (index == INDEX_TRANSIENTHK) {
+        tmp = make_filename(INDEX_DIR, NULL);
+        ret = dupprintf("%s/transient-hostkeys", tmp);
+        sfree(tmp);
+        return ret;
+    }
     tmp = make_filename(INDEX_DIR, NULL);
     ret = dupprintf("%s/ERROR", tmp);
     sfree(tmp);
@@ -209,13 +216,13 @@ static char *make_filename(int index, const char *subname)
 }
 
 struct settings_w {
-    FILE *fp;
+    strbuf *sb;                        /* accumulated settings text */
+    char *filename;                    /* where to write it on close */
 };
 
 settings_w *open_settings_w(const char *sessionname, char **errmsg)
 {
     char *filename, *err;
-    FILE *fp;
 
     *errmsg = NULL;
 
@@ -242,33 +249,107 @@ settings_w *open_settings_w(const char *sessionname, char **errmsg)
     sfree(filename);
 
     filename = make_filename(INDEX_SESSION, sessionname);
-    fp = fopen(filename, "w");
-    if (!fp) {
-        *errmsg = dupprintf("Unable to save session: open(\"%s\") "
-                            "returned '%s'", filename, strerror(errno));
-        sfree(filename);
-        return NULL;                   /* can't open */
+
+    /*
+     * Create the file now if it didn't already exist, but don't
+     * write anything to it yet: the settings are accumulated in
+     * memory and written out in one go at close_settings_w time, via
+     * a temporary file and an atomic rename, mostly in a detached
+     * child process. Creating the file here means a brand new
+     * session shows up immediately in directory scans (e.g. the
+     * saved-session list refreshing after a Save), even if the
+     * content is still in flight.
+     */
+    {
+        int fd = open(filename, O_WRONLY | O_CREAT, 0600);
+        if (fd < 0) {
+            *errmsg = dupprintf("Unable to save session: open(\"%s\") "
+                                "returned '%s'", filename, strerror(errno));
+            sfree(filename);
+            return NULL;               /* can't open */
+        }
+        close(fd);
     }
-    sfree(filename);
 
     settings_w *toret = snew(settings_w);
-    toret->fp = fp;
+    toret->sb = strbuf_new();
+    toret->filename = filename;
     return toret;
 }
 
 void write_setting_s(settings_w *handle, const char *key, const char *value)
 {
-    fprintf(handle->fp, "%s=%s\n", key, value);
+    strbuf_catf(handle->sb, "%s=%s\n", key, value);
 }
 
 void write_setting_i(settings_w *handle, const char *key, int value)
 {
-    fprintf(handle->fp, "%s=%d\n", key, value);
+    strbuf_catf(handle->sb, "%s=%d\n", key, value);
+}
+
+/*
+ * Write the accumulated settings text to a temporary file beside the
+ * real one and rename it into place. This runs either in a detached
+ * child process (the usual case) or on the main thread if forking
+ * failed, so it sticks to raw syscalls and reports nothing: write
+ * errors at this stage were silently ignored by the old code too.
+ */
+static void settings_write_out(const char *filename, ptrlen data)
+{
+    char *tmpname = dupprintf("%s.tmp.%d", filename, (int)getpid());
+    int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0) {
+        const char *p = data.ptr;
+        size_t remaining = data.len;
+        bool ok = true;
+        while (remaining > 0) {
+            ssize_t ret = write(fd, p, remaining);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                ok = false;
+                break;
+            }
+            p += ret;
+            remaining -= ret;
+        }
+        if (ok && fsync(fd) < 0)
+            ok = false;
+        close(fd);
+        if (!ok || rename(tmpname, filename) < 0)
+            unlink(tmpname);
+    }
+    sfree(tmpname);
 }
 
 void close_settings_w(settings_w *handle)
 {
-    fclose(handle->fp);
+    /*
+     * Hand the actual file I/O to a doubly-forked child, so that a
+     * save in mid-session (e.g. Apply in the reconfiguration dialog)
+     * never stalls the event loop behind a slow filesystem such as
+     * an NFS home directory. The intermediate child exits at once
+     * (so the waitpid below doesn't block and no zombie is left);
+     * the grandchild does the write, fsync and atomic rename and
+     * _exits without touching the parent's state. If fork isn't
+     * working, fall back to doing the job synchronously.
+     */
+    pid_t pid = fork();
+    if (pid == 0) {
+        pid_t pid2 = fork();
+        if (pid2 == 0) {
+            settings_write_out(handle->filename,
+                               ptrlen_from_strbuf(handle->sb));
+        }
+        _exit(0);
+    } else if (pid > 0) {
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR);
+    } else {
+        settings_write_out(handle->filename, ptrlen_from_strbuf(handle->sb));
+    }
+
+    strbuf_free(handle->sb);
+    sfree(handle->filename);
     sfree(handle);
 }
 
@@ -529,19 +610,26 @@ void del_settings(const char *sessionname)
 
 struct settings_e {
     DIR *dp;
+
+    /* The sessions directory path with a trailing '/', so that each
+     * entry's name can be appended in turn without rebuilding the
+     * whole thing for every file. */
+    strbuf *fullpath;
+    size_t baselen;
 };
 
 settings_e *enum_settings_start(void)
 {
-    DIR *dp;
-    char *filename;
-
-    filename = make_filename(INDEX_SESSIONDIR, NULL);
-    dp = opendir(filename);
-    sfree(filename);
+    char *filename = make_filename(INDEX_SESSIONDIR, NULL);
 
     settings_e *toret = snew(settings_e);
-    toret->dp = dp;
+    toret->dp = opendir(filename);
+    toret->fullpath = strbuf_new();
+    put_datapl(toret->fullpath, ptrlen_from_asciz(filename));
+    put_byte(toret->fullpath, '/');
+    toret->baselen = toret->fullpath->len;
+
+    sfree(filename);
     return toret;
 }
 
@@ -549,33 +637,41 @@ bool enum_settings_next(settings_e *handle, strbuf *out)
 {
     struct dirent *de;
     struct stat st;
-    strbuf *fullpath;
 
     if (!handle->dp)
-        return NULL;
-
-    fullpath = strbuf_new();
-
-    char *sessiondir = make_filename(INDEX_SESSIONDIR, NULL);
-    put_datapl(fullpath, ptrlen_from_asciz(sessiondir));
-    sfree(sessiondir);
-    put_byte(fullpath, '/');
-
-    size_t baselen = fullpath->len;
+        return false;
 
     while ( (de = readdir(handle->dp)) != NULL ) {
-        strbuf_shrink_to(fullpath, baselen);
-        put_datapl(fullpath, ptrlen_from_asciz(de->d_name));
+        bool is_regular;
+
+        /*
+         * On file systems that report a file type in the directory
+         * entry itself, we can skip anything that's certainly not a
+         * regular file without making a separate stat call for it.
+         * Anything unknown, or a symlink (which stat would have
+         * followed), still gets the full check.
+         */
+#ifdef DT_REG
+        if (de->d_type == DT_REG) {
+            is_regular = true;
+        } else if (de->d_type != DT_UNKNOWN && de->d_type != DT_LNK) {
+            is_regular = false;
+        } else
+#endif
+        {
+            strbuf_shrink_to(handle->fullpath, handle->baselen);
+            put_datapl(handle->fullpath, ptrlen_from_asciz(de->d_name));
+            is_regular = (stat(handle->fullpath->s, &st) == 0 &&
+                          S_ISREG(st.st_mode));
+        }
 
-        if (stat(fullpath->s, &st) < 0 || !S_ISREG(st.st_mode))
+        if (!is_regular)
             continue;                  /* try another one */
 
         decode_session_filename(de->d_name, out);
-        strbuf_free(fullpath);
         return true;
     }
 
-    strbuf_free(fullpath);
     return false;
 }
 
@@ -583,6 +679,7 @@ void enum_settings_finish(settings_e *handle)
 {
     if (handle->dp)
         closedir(handle->dp);
+    strbuf_free(handle->fullpath);
     sfree(handle);
 }
 
@@ -594,73 +691,188 @@ void enum_settings_finish(settings_e *handle)
  * e.g.
  *
  *   rsa@22:foovax.example.org 0x23,0x293487364395345345....2343
+ *
+ * During SSH algorithm negotiation the file is consulted several
+ * times per connection (once per candidate host key type), and a tool
+ * making many connections multiplies that up further, so rather than
+ * rescanning the file linearly on every query we parse it once into a
+ * tree indexed by the 'type@port:hostname' identifier. The tree is
+ * revalidated against the file's stat information on each lookup, so
+ * a concurrent instance rewriting the file invalidates our copy, and
+ * store_host_key below keeps it in step incrementally.
  */
-int verify_host_key(const char *hostname, int port,
-                    const char *keytype, const char *key)
+
+struct hostkey_index_entry {
+    char *header;                      /* "type@port:hostname" */
+    char *keydata;
+};
+
+static tree234 *hostkey_index = NULL;
+static bool hostkey_index_stat_valid = false;
+static struct stat hostkey_index_stat;
+
+static int hostkey_index_cmp(void *av, void *bv)
+{
+    struct hostkey_index_entry *a = (struct hostkey_index_entry *)av;
+    struct hostkey_index_entry *b = (struct hostkey_index_entry *)bv;
+    return strcmp(a->header, b->header);
+}
+
+static int hostkey_index_find_cmp(void *av, void *bv)
+{
+    char *a = (char *)av;
+    struct hostkey_index_entry *b = (struct hostkey_index_entry *)bv;
+    return strcmp(a, b->header);
+}
+
+static int hostkey_index_ndups, hostkey_index_nmalformed;
+
+static void hostkey_index_add_line(char *line)
+{
+    char *space = strchr(line, ' ');
+    if (!space) {
+        hostkey_index_nmalformed++;    /* malformed line; leave unindexed */
+        return;
+    }
+
+    struct hostkey_index_entry *entry = snew(struct hostkey_index_entry);
+    entry->header = dupprintf("%.*s", (int)(space - line), line);
+    entry->keydata = dupstr(space + 1);
+
+    struct hostkey_index_entry *prev = add234(hostkey_index, entry);
+    if (prev != entry) {
+        /* Duplicate identifier; keep the earlier line, like the old
+         * linear scan did. */
+        hostkey_index_ndups++;
+        sfree(entry->header);
+        sfree(entry->keydata);
+        sfree(entry);
+    }
+}
+
+/*
+ * Rewrite the host keys file from the in-memory index, via the usual
+ * write-new-and-rename dance. Concurrent first-contact appenders can
+ * leave duplicate lines for the same host behind (each one harmless,
+ * since they carry the same key, but they accumulate); this squeezes
+ * them out once we've noticed them at load time.
+ */
+static void hostkey_file_compact(const char *filename)
+{
+    char *tmpfilename = make_filename(INDEX_HOSTKEYS_TMP, NULL);
+    FILE *wfp = fopen(tmpfilename, "w");
+    struct hostkey_index_entry *entry;
+    int i;
+
+    if (wfp) {
+        for (i = 0; (entry = index234(hostkey_index, i)) != NULL; i++)
+            fprintf(wfp, "%s %s\n", entry->header, entry->keydata);
+        fclose(wfp);
+        if (rename(tmpfilename, filename) == 0) {
+            hostkey_index_stat_valid =
+                (stat(filename, &hostkey_index_stat) == 0);
+        }
+    }
+    sfree(tmpfilename);
+}
+
+static void hostkey_index_clear(void)
+{
+    if (hostkey_index) {
+        struct hostkey_index_entry *entry;
+        while ((entry = delpos234(hostkey_index, 0)) != NULL) {
+            sfree(entry->header);
+            sfree(entry->keydata);
+            sfree(entry);
+        }
+    }
+}
+
+static bool hostkey_index_uptodate(const struct stat *st)
+{
+    return (hostkey_index_stat_valid &&
+            st->st_dev == hostkey_index_stat.st_dev &&
+            st->st_ino == hostkey_index_stat.st_ino &&
+            st->st_size == hostkey_index_stat.st_size &&
+            st->st_mtime == hostkey_index_stat.st_mtime);
+}
+
+static void hostkey_index_ensure(void)
 {
-    FILE *fp;
     char *filename;
+    struct stat st;
+    FILE *fp;
     char *line;
-    int ret;
+
+    if (!hostkey_index)
+        hostkey_index = newtree234(hostkey_index_cmp);
 
     filename = make_filename(INDEX_HOSTKEYS, NULL);
+
+    if (stat(filename, &st) < 0) {
+        /* No file: the index is just empty. */
+        hostkey_index_clear();
+        hostkey_index_stat_valid = false;
+        sfree(filename);
+        return;
+    }
+
+    if (hostkey_index_uptodate(&st)) {
+        sfree(filename);
+        return;
+    }
+
+    hostkey_index_clear();
+
     fp = fopen(filename, "r");
-    sfree(filename);
-    if (!fp)
-        return 1;                      /* key does not exist */
+    if (!fp) {
+        sfree(filename);
+        return;
+    }
 
-    ret = 1;
+    hostkey_index_ndups = hostkey_index_nmalformed = 0;
     while ( (line = fgetline(fp)) ) {
-        int i;
-        char *p = line;
-        char porttext[20];
-
         line[strcspn(line, "\n")] = '\0';   /* strip trailing newline */
+        hostkey_index_add_line(line);
+        sfree(line);
+    }
 
-        i = strlen(keytype);
-        if (strncmp(p, keytype, i))
-            goto done;
-        p += i;
+    fclose(fp);
 
-        if (*p != '@')
-            goto done;
-        p++;
+    hostkey_index_stat = st;
+    hostkey_index_stat_valid = true;
 
-        sprintf(porttext, "%d", port);
-        i = strlen(porttext);
-        if (strncmp(p, porttext, i))
-            goto done;
-        p += i;
+    /*
+     * If the file contained duplicate entries, compact it - but only
+     * if every line parsed, since otherwise rewriting from the index
+     * would silently discard whatever we couldn't understand.
+     */
+    if (hostkey_index_ndups > 0 && hostkey_index_nmalformed == 0)
+        hostkey_file_compact(filename);
 
-        if (*p != ':')
-            goto done;
-        p++;
+    sfree(filename);
+}
 
-        i = strlen(hostname);
-        if (strncmp(p, hostname, i))
-            goto done;
-        p += i;
+int verify_host_key(const char *hostname, int port,
+                    const char *keytype, const char *key)
+{
+    char *header;
+    struct hostkey_index_entry *entry;
+    int ret;
 
-        if (*p != ' ')
-            goto done;
-        p++;
+    hostkey_index_ensure();
 
-        /*
-         * Found the key. Now just work out whether it's the right
-         * one or not.
-         */
-        if (!strcmp(p, key))
-            ret = 0;                   /* key matched OK */
-        else
-            ret = 2;                   /* key mismatch */
+    header = dupprintf("%s@%d:%s", keytype, port, hostname);
+    entry = find234(hostkey_index, header, hostkey_index_find_cmp);
+    sfree(header);
 
-        done:
-        sfree(line);
-        if (ret != 1)
-            break;
-    }
+    if (!entry)
+        ret = 1;                       /* key does not exist */
+    else if (!strcmp(entry->keydata, key))
+        ret = 0;                       /* key matched OK */
+    else
+        ret = 2;                       /* key mismatch */
 
-    fclose(fp);
     return ret;
 }
 
@@ -674,6 +886,33 @@ bool have_ssh_host_key(const char *hostname, int port,
     return verify_host_key(hostname, port, keytype, "") != 1;
 }
 
+/*
+ * Enter (or replace) a hostkeys-file line in the in-memory index, and
+ * re-stat the file so that the next lookup knows the index still
+ * reflects it.
+ */
+static void hostkey_index_put(const char *newtext, const char *filename)
+{
+    const char *space = strchr(newtext, ' ');
+    char *header = dupprintf("%.*s", (int)(space - newtext), newtext);
+    struct hostkey_index_entry *entry = find234(
+        hostkey_index, header, hostkey_index_find_cmp);
+    if (entry) {
+        del234(hostkey_index, entry);
+        sfree(entry->header);
+        sfree(entry->keydata);
+        sfree(entry);
+    }
+    entry = snew(struct hostkey_index_entry);
+    entry->header = header;
+    entry->keydata = dupstr(space + 1);
+    entry->keydata[strcspn(entry->keydata, "\n")] = '\0';
+    add234(hostkey_index, entry);
+
+    hostkey_index_stat_valid =
+        (stat(filename, &hostkey_index_stat) == 0);
+}
+
 void store_host_key(const char *hostname, int port,
                     const char *keytype, const char *key)
 {
@@ -682,6 +921,46 @@ void store_host_key(const char *hostname, int port,
     int headerlen;
     char *filename, *tmpfilename;
 
+    filename = make_filename(INDEX_HOSTKEYS, NULL);
+    newtext = dupprintf("%s@%d:%s %s\n", keytype, port, hostname, key);
+    headerlen = 1 + strcspn(newtext, " ");   /* count the space too */
+
+    /*
+     * If the index tells us this host has no existing entry, we can
+     * simply append the new line: nothing else in the file needs to
+     * change, so there's no need to copy the whole thing through a
+     * temporary file. Replacements still take the copy-and-rename
+     * path below, which edits out the superseded line.
+     */
+    hostkey_index_ensure();
+    if (hostkey_index_stat_valid) {
+        char *header = dupprintf("%.*s", headerlen - 1, newtext);
+        bool replacing = (find234(hostkey_index, header,
+                                  hostkey_index_find_cmp) != NULL);
+        sfree(header);
+        if (!replacing) {
+            /*
+             * Append with a single write() on an O_APPEND descriptor,
+             * so that any number of processes first-contacting new
+             * hosts at once can all append concurrently without
+             * interleaving partial lines or clobbering each other's
+             * file positions.
+             */
+            int fd = open(filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
+            if (fd >= 0) {
+                size_t len = strlen(newtext);
+                bool written = (write(fd, newtext, len) == (ssize_t)len);
+                close(fd);
+                if (written) {
+                    hostkey_index_put(newtext, filename);
+                    sfree(filename);
+                    sfree(newtext);
+                    return;
+                }
+            }
+        }
+    }
+
     /*
      * Open both the old file and a new file.
      */
@@ -696,6 +975,8 @@ void store_host_key(const char *hostname, int port,
             sfree(errmsg);
             sfree(dir);
             sfree(tmpfilename);
+            sfree(filename);
+            sfree(newtext);
             return;
         }
         sfree(dir);
@@ -706,14 +987,12 @@ void store_host_key(const char *hostname, int port,
         nonfatal("Unable to store host key: open(\"%s\") "
                  "returned '%s'", tmpfilename, strerror(errno));
         sfree(tmpfilename);
+        sfree(filename);
+        sfree(newtext);
         return;
     }
-    filename = make_filename(INDEX_HOSTKEYS, NULL);
     rfp = fopen(filename, "r");
 
-    newtext = dupprintf("%s@%d:%s %s\n", keytype, port, hostname, key);
-    headerlen = 1 + strcspn(newtext, " ");   /* count the space too */
-
     /*
      * Copy all lines from the old file to the new one that _don't_
      * involve the same host key identifier as the one we're adding.
@@ -738,6 +1017,12 @@ void store_host_key(const char *hostname, int port,
         nonfatal("Unable to store host key: rename(\"%s\",\"%s\")"
                  " returned '%s'", tmpfilename, filename,
                  strerror(errno));
+    } else {
+        /*
+         * Keep the in-memory index in step with the file we've just
+         * written, so the next lookup needn't reparse it.
+         */
+        hostkey_index_put(newtext, filename);
     }
 
     sfree(tmpfilename);
@@ -745,6 +1030,74 @@ void store_host_key(const char *hostname, int port,
     sfree(newtext);
 }
 
+struct transient_hostkey_cache_file {
+    int fd;
+};
+
+transient_hostkey_cache_file *open_transient_hostkey_cache_file(
+    strbuf *contents)
+{
+    char *fname = make_filename(INDEX_TRANSIENTHK, NULL);
+    int fd = open(fname, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 && errno == ENOENT) {
+        char *dir = make_filename(INDEX_DIR, NULL);
+        char *errmsg = make_dir_path(dir, 0700);
+        sfree(dir);
+        if (errmsg) {
+            sfree(errmsg);
+            sfree(fname);
+            return NULL;
+        }
+        fd = open(fname, O_RDWR | O_CREAT, 0600);
+    }
+    sfree(fname);
+    if (fd < 0)
+        return NULL;
+
+    /*
+     * Take an exclusive advisory lock on the whole file, which the
+     * close call will release (implicitly, by closing the fd).
+     */
+    struct flock lk;
+    memset(&lk, 0, sizeof(lk));
+    lk.l_type = F_WRLCK;
+    lk.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lk) < 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    char buf[512];
+    int ret;
+    while ((ret = read(fd, buf, sizeof(buf))) > 0)
+        put_data(contents, buf, ret);
+
+    transient_hostkey_cache_file *f = snew(transient_hostkey_cache_file);
+    f->fd = fd;
+    return f;
+}
+
+void close_transient_hostkey_cache_file(
+    transient_hostkey_cache_file *f, const char *new_contents)
+{
+    if (new_contents) {
+        size_t len = strlen(new_contents);
+        if (lseek(f->fd, 0, SEEK_SET) == 0 && ftruncate(f->fd, 0) == 0) {
+            while (len > 0) {
+                ssize_t ret = write(f->fd, new_contents, len);
+                if (ret <= 0)
+                    break;
+                new_contents += ret;
+                len -= ret;
+            }
+        }
+    }
+    close(f->fd);
+    sfree(f);
+}
+
 void read_random_seed(noise_consumer_t consumer)
 {
     int fd;
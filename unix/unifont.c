@@ -1328,6 +1328,30 @@ static char *pangofont_scale_fontname(GtkWidget *widget, const char *name,
                                       int size);
 static char *pangofont_size_increment(unifont *font, int increment);
 
+/*
+ * An entry in a pangofont's cache of shaped text runs. Each one
+ * holds a PangoLayout with its text already set and shaped, plus the
+ * layout's pixel extents, so that a repeated draw of an identical
+ * string (status bars, box-drawing borders and the like recur on
+ * every terminal redraw) can skip Pango's shaping machinery
+ * completely.
+ */
+struct pango_run {
+    char *utftext;                     /* the run's text, in UTF-8 */
+    int utflen;
+    bool bold;                 /* was the artificially bolded desc used? */
+    PangoLayout *layout;
+    PangoRectangle rect;       /* cached pixel extents of the layout */
+    struct pango_run *newer, *older;   /* LRU list links */
+};
+
+/*
+ * Maximum number of cached runs per font. A full screen of a busy
+ * TUI generates a few hundred distinct runs, so this is enough to
+ * hold a whole frame's worth while still bounding memory use.
+ */
+#define PANGO_RUN_CACHE_SIZE 1024
+
 struct pangofont {
     /*
      * Pango objects.
@@ -1350,10 +1374,38 @@ struct pangofont {
      */
     int *widthcache;
     unsigned nwidthcache;
+    /*
+     * Cache of shaped text runs. The tree is sorted for lookup by
+     * (bold, text); the doubly linked list threaded through the
+     * entries is kept in recency order, so that when the cache fills
+     * up we evict the entry unused for longest.
+     */
+    tree234 *runcache;
+    struct pango_run *newest_run, *oldest_run;
+    /*
+     * Scratch layout used for measuring character widths, so that we
+     * don't have to construct a throwaway PangoLayout on every
+     * drawing call.
+     */
+    PangoLayout *measure_layout;
 
     struct unifont u;
 };
 
+static int pango_run_cmp(void *av, void *bv)
+{
+    struct pango_run *a = (struct pango_run *)av;
+    struct pango_run *b = (struct pango_run *)bv;
+    int cmp;
+
+    if (a->bold != b->bold)
+        return a->bold < b->bold ? -1 : +1;
+    if (a->utflen != b->utflen)
+        return a->utflen < b->utflen ? -1 : +1;
+    cmp = memcmp(a->utftext, b->utftext, a->utflen);
+    return cmp < 0 ? -1 : cmp > 0 ? +1 : 0;
+}
+
 static const UnifontVtable pangofont_vtable = {
     .create = pangofont_create,
     .create_fallback = pangofont_create_fallback,
@@ -1485,6 +1537,9 @@ static unifont *pangofont_create_internal(GtkWidget *widget,
     pfont->shadowalways = shadowalways;
     pfont->widthcache = NULL;
     pfont->nwidthcache = 0;
+    pfont->runcache = newtree234(pango_run_cmp);
+    pfont->newest_run = pfont->oldest_run = NULL;
+    pfont->measure_layout = NULL;
 
     pango_font_metrics_unref(metrics);
 
@@ -1534,16 +1589,119 @@ static unifont *pangofont_create_fallback(GtkWidget *widget, int height,
                                      shadowoffset, shadowalways);
 }
 
+static void pango_run_free(struct pango_run *run)
+{
+    g_object_unref(run->layout);
+    sfree(run->utftext);
+    sfree(run);
+}
+
 static void pangofont_destroy(unifont *font)
 {
     struct pangofont *pfont = container_of(font, struct pangofont, u);
+    struct pango_run *run;
     pango_font_description_free(pfont->desc);
     sfree(pfont->widthcache);
+    while ((run = delpos234(pfont->runcache, 0)) != NULL)
+        pango_run_free(run);
+    freetree234(pfont->runcache);
+    if (pfont->measure_layout)
+        g_object_unref(pfont->measure_layout);
     g_object_unref(pfont->fset);
     sfree(pfont);
 }
 
-static int pangofont_char_width(PangoLayout *layout, struct pangofont *pfont,
+/*
+ * Construct a PangoLayout set up with this font's description,
+ * optionally with the weight forced to bold for fonts that will be
+ * artificially emboldened.
+ */
+static PangoLayout *pangofont_make_layout(struct pangofont *pfont, bool bold)
+{
+    PangoLayout *layout;
+
+    layout = pango_layout_new(gtk_widget_get_pango_context(pfont->widget));
+    if (bold) {
+        PangoFontDescription *desc2 =
+            pango_font_description_copy_static(pfont->desc);
+        pango_font_description_set_weight(desc2, PANGO_WEIGHT_BOLD);
+        pango_layout_set_font_description(layout, desc2);
+        pango_font_description_free(desc2);
+    } else {
+        pango_layout_set_font_description(layout, pfont->desc);
+    }
+    return layout;
+}
+
+/*
+ * Find a shaped run of text in the font's cache, or shape it and
+ * cache it if it's not already there.
+ */
+static struct pango_run *pangofont_shape_run(
+    struct pangofont *pfont, const char *utfptr, int utflen, bool bold)
+{
+    struct pango_run key, *run;
+
+    key.utftext = (char *)utfptr;
+    key.utflen = utflen;
+    key.bold = bold;
+    run = find234(pfont->runcache, &key, NULL);
+    if (run) {
+        /*
+         * Cache hit: move the run to the most-recently-used end of
+         * the list, if it isn't there already.
+         */
+        if (pfont->newest_run != run) {
+            run->newer->older = run->older;
+            if (run->older)
+                run->older->newer = run->newer;
+            else
+                pfont->oldest_run = run->newer;
+            run->newer = NULL;
+            run->older = pfont->newest_run;
+            pfont->newest_run->newer = run;
+            pfont->newest_run = run;
+        }
+        return run;
+    }
+
+    /*
+     * Cache miss. If the cache is full, evict the run that's gone
+     * unused for longest.
+     */
+    if (count234(pfont->runcache) >= PANGO_RUN_CACHE_SIZE) {
+        struct pango_run *victim = pfont->oldest_run;
+        pfont->oldest_run = victim->newer;
+        if (victim->newer)
+            victim->newer->older = NULL;
+        else
+            pfont->newest_run = NULL;
+        del234(pfont->runcache, victim);
+        pango_run_free(victim);
+    }
+
+    run = snew(struct pango_run);
+    run->utftext = snewn(utflen, char);
+    memcpy(run->utftext, utfptr, utflen);
+    run->utflen = utflen;
+    run->bold = bold;
+    run->layout = pangofont_make_layout(pfont, bold);
+    pango_layout_set_text(run->layout, utfptr, utflen);
+    pango_layout_get_pixel_extents(run->layout, NULL, &run->rect);
+
+    add234(pfont->runcache, run);
+    run->newer = NULL;
+    run->older = pfont->newest_run;
+    if (pfont->newest_run)
+        pfont->newest_run->newer = run;
+    else
+        pfont->oldest_run = run;
+    pfont->newest_run = run;
+
+    return run;
+}
+
+static int pangofont_char_width(struct pangofont *pfont,
                                 wchar_t uchr, const char *utfchr, int utflen)
 {
     /*
@@ -1564,8 +1722,10 @@ static int pangofont_char_width(PangoLayout *layout, struct pangofont *pfont,
 
     if (pfont->widthcache[uchr] < 0) {
         PangoRectangle rect;
-        pango_layout_set_text(layout, utfchr, utflen);
-        pango_layout_get_extents(layout, NULL, &rect);
+        if (!pfont->measure_layout)
+            pfont->measure_layout = pangofont_make_layout(pfont, false);
+        pango_layout_set_text(pfont->measure_layout, utfchr, utflen);
+        pango_layout_get_extents(pfont->measure_layout, NULL, &rect);
         pfont->widthcache[uchr] = rect.width;
     }
 
@@ -1601,11 +1761,9 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
                                     int cellwidth, bool combining)
 {
     struct pangofont *pfont = container_of(font, struct pangofont, u);
-    PangoLayout *layout;
-    PangoRectangle rect;
     char *utfstring, *utfptr;
     int utflen;
-    bool shadowbold = false;
+    bool shadowbold = false, boldlayout = false;
     void (*draw_layout)(unifont_drawctx *ctx,
                         gint x, gint y, PangoLayout *layout) = NULL;
 
@@ -1626,17 +1784,11 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
 
     y -= pfont->u.ascent;
 
-    layout = pango_layout_new(gtk_widget_get_pango_context(pfont->widget));
-    pango_layout_set_font_description(layout, pfont->desc);
     if (bold && !pfont->bold) {
         if (pfont->shadowalways)
             shadowbold = true;
-        else {
-            PangoFontDescription *desc2 =
-                pango_font_description_copy_static(pfont->desc);
-            pango_font_description_set_weight(desc2, PANGO_WEIGHT_BOLD);
-            pango_layout_set_font_description(layout, desc2);
-        }
+        else
+            boldlayout = true;
     }
 
     /*
@@ -1697,7 +1849,7 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
             n = 1;
 
             if (is_rtl(string[0]) ||
-                pangofont_char_width(layout, pfont, string[n-1],
+                pangofont_char_width(pfont, string[n-1],
                                      utfptr, clen) != desired) {
                 /*
                  * If this character is a right-to-left one, or has an
@@ -1719,7 +1871,7 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
                         clen++;
                     n++;
                     if (is_rtl(string[n-1]) ||
-                        pangofont_char_width(layout, pfont,
+                        pangofont_char_width(pfont,
                                              string[n-1], utfptr + oldclen,
                                              clen - oldclen) != desired) {
                         clen = oldclen;
@@ -1730,16 +1882,21 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
             }
         }
 
-        pango_layout_set_text(layout, utfptr, clen);
-        pango_layout_get_pixel_extents(layout, NULL, &rect);
+        {
+            struct pango_run *run =
+                pangofont_shape_run(pfont, utfptr, clen, boldlayout);
 
-        draw_layout(ctx,
-                    x + (n*cellwidth - rect.width)/2,
-                    y + (pfont->u.height - rect.height)/2, layout);
-        if (shadowbold)
             draw_layout(ctx,
-                        x + (n*cellwidth - rect.width)/2 + pfont->shadowoffset,
-                        y + (pfont->u.height - rect.height)/2, layout);
+                        x + (n*cellwidth - run->rect.width)/2,
+                        y + (pfont->u.height - run->rect.height)/2,
+                        run->layout);
+            if (shadowbold)
+                draw_layout(ctx,
+                            x + (n*cellwidth - run->rect.width)/2 +
+                            pfont->shadowoffset,
+                            y + (pfont->u.height - run->rect.height)/2,
+                            run->layout);
+        }
 
         utflen -= clen;
         utfptr += clen;
@@ -1748,8 +1905,6 @@ static void pangofont_draw_internal(unifont_drawctx *ctx, unifont *font,
     }
 
     sfree(utfstring);
-
-    g_object_unref(layout);
 }
 
 static void pangofont_draw_text(unifont_drawctx *ctx, unifont *font,
@@ -2193,9 +2348,60 @@ struct multifont {
     unifont *main;
     unifont *fallback;
 
+    /*
+     * Cache bookkeeping: the parameters this font was created with
+     * (so that an identical later request can find it), and how many
+     * clients currently hold a reference to it.
+     */
+    char *cache_name;
+    bool cache_wide, cache_bold, cache_shadowalways;
+    int cache_shadowoffset;
+    void *cache_display;
+    int refcount;
+
     struct unifont u;
 };
 
+/*
+ * Cache of live multifonts, so that opening several terminal windows
+ * with the same font configuration (or the same window's bold / wide
+ * variants coinciding) does the expensive font realisation once per
+ * process rather than once per window. Each multifont_create with the
+ * same parameters returns the same refcounted object, and the font is
+ * really destroyed when the last reference goes.
+ */
+static tree234 *multifont_cache = NULL;
+
+static int multifont_cache_cmp(void *av, void *bv)
+{
+    struct multifont *a = (struct multifont *)av;
+    struct multifont *b = (struct multifont *)bv;
+    int cmp;
+
+    if (a->cache_display != b->cache_display)
+        return a->cache_display < b->cache_display ? -1 : +1;
+    if ((cmp = strcmp(a->cache_name, b->cache_name)) != 0)
+        return cmp;
+    if (a->cache_wide != b->cache_wide)
+        return a->cache_wide < b->cache_wide ? -1 : +1;
+    if (a->cache_bold != b->cache_bold)
+        return a->cache_bold < b->cache_bold ? -1 : +1;
+    if (a->cache_shadowoffset != b->cache_shadowoffset)
+        return a->cache_shadowoffset < b->cache_shadowoffset ? -1 : +1;
+    if (a->cache_shadowalways != b->cache_shadowalways)
+        return a->cache_shadowalways < b->cache_shadowalways ? -1 : +1;
+    return 0;
+}
+
+static void *multifont_display_of(GtkWidget *widget)
+{
+#if GTK_CHECK_VERSION(2,0,0)
+    return gtk_widget_get_display(widget);
+#else
+    return NULL;                       /* GTK1: only one display anyway */
+#endif
+}
+
 static const UnifontVtable multifont_vtable = {
     .create = NULL, /* creation is done specially */
     .create_fallback = NULL,
@@ -2218,6 +2424,26 @@ unifont *multifont_create(GtkWidget *widget, const char *name,
     unifont *font, *fallback;
     struct multifont *mfont;
 
+    /*
+     * See if we've already got this font open.
+     */
+    if (!multifont_cache)
+        multifont_cache = newtree234(multifont_cache_cmp);
+    {
+        struct multifont search;
+        search.cache_name = (char *)name;
+        search.cache_wide = wide;
+        search.cache_bold = bold;
+        search.cache_shadowoffset = shadowoffset;
+        search.cache_shadowalways = shadowalways;
+        search.cache_display = multifont_display_of(widget);
+        mfont = find234(multifont_cache, &search, NULL);
+        if (mfont) {
+            mfont->refcount++;
+            return &mfont->u;
+        }
+    }
+
     font = unifont_create(widget, name, wide, bold,
                           shadowoffset, shadowalways);
     if (!font)
@@ -2253,12 +2479,27 @@ unifont *multifont_create(GtkWidget *widget, const char *name,
     mfont->main = font;
     mfont->fallback = fallback;
 
+    mfont->cache_name = dupstr(name);
+    mfont->cache_wide = wide;
+    mfont->cache_bold = bold;
+    mfont->cache_shadowoffset = shadowoffset;
+    mfont->cache_shadowalways = shadowalways;
+    mfont->cache_display = multifont_display_of(widget);
+    mfont->refcount = 1;
+    add234(multifont_cache, mfont);
+
     return &mfont->u;
 }
 
 static void multifont_destroy(unifont *font)
 {
     struct multifont *mfont = container_of(font, struct multifont, u);
+
+    if (--mfont->refcount > 0)
+        return;
+    del234(multifont_cache, mfont);
+    sfree(mfont->cache_name);
+
     unifont_destroy(mfont->main);
     if (mfont->fallback)
         unifont_destroy(mfont->fallback);
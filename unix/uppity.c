@@ -351,6 +351,8 @@ static void show_help(FILE *fp)
           "options: --listen [PORT|PATH] listen to a port on localhost, or Unix socket\n"
           "         --listen-once        (with --listen) stop after one "
           "connection\n"
+          "         --workers N          (with --listen) serve connections in N "
+          "worker processes\n"
           "         --hostkey KEY        SSH host key (need at least one)\n"
           "         --rsakexkey KEY      key for SSH-2 RSA key exchange "
           "(in SSH-1 format)\n"
@@ -402,6 +404,88 @@ static void show_version_and_exit(void)
 const bool buildinfo_gtk_relevant = false;
 
 static bool listening = false, listen_once = false;
+static int nworkers = 1;
+static bool worker_finished = false;
+static int worker_pipe_rd = -1;
+
+static unsigned start_workers(void)
+{
+    int pipefd[2];
+
+    if (pipe(pipefd) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    for (int i = 1; i < nworkers; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            /*
+             * We're a worker. The listening sockets are already set
+             * up, and we've inherited copies of their fds, so the
+             * kernel will share incoming connections out between all
+             * the workers' accept calls. Return our worker index at
+             * once, so we don't fall through and fork workers of our
+             * own.
+             */
+            close(pipefd[1]);
+            worker_pipe_rd = pipefd[0];
+            return i;
+        }
+    }
+
+    /* The original process keeps the write end open (and never writes
+     * to it), so that its termination is visible to the workers. */
+    close(pipefd[0]);
+    return 0;
+}
+
+static strbuf *worker_seed_buf;
+static void worker_seed_callback(void *noise, int length)
+{
+    put_data(worker_seed_buf, noise, length);
+}
+
+static void worker_reseed_prng(void)
+{
+    /*
+     * A forked worker inherits the primordial process's PRNG state,
+     * so without this, all the workers would generate the same
+     * session keys as each other. Gather a fresh batch of system
+     * noise and reseed.
+     */
+    worker_seed_buf = strbuf_new_nm();
+    noise_get_heavy(worker_seed_callback);
+    random_reseed(ptrlen_from_strbuf(worker_seed_buf));
+    strbuf_free(worker_seed_buf);
+    worker_seed_buf = NULL;
+}
+
+static bool worker_pw_setup(void *ctx, pollwrapper *pw)
+{
+    if (worker_pipe_rd >= 0)
+        pollwrap_add_fd_rwx(pw, worker_pipe_rd, SELECT_R);
+    return true;
+}
+
+static void worker_pw_check(void *ctx, pollwrapper *pw)
+{
+    if (worker_pipe_rd >= 0 &&
+        pollwrap_check_fd_rwx(pw, worker_pipe_rd, SELECT_R)) {
+        char buf[1];
+        if (read(worker_pipe_rd, buf, 1) <= 0)
+            worker_finished = true;    /* the original process has gone */
+    }
+}
+
+static bool worker_continue(void *ctx, bool found_any_fd,
+                            bool ran_any_callback)
+{
+    return !worker_finished;
+}
 static bool finished = false;
 void server_instance_terminated(LogPolicy *lp)
 {
@@ -683,6 +767,13 @@ int main(int argc, char **argv)
             }
         } else if (!strcmp(arg, "--listen-once")) {
             listen_once = true;
+        } else if (longoptarg(arg, "--workers", &val, &argc, &argv)) {
+            nworkers = atoi(val);
+            if (nworkers < 1) {
+                fprintf(stderr, "%s: expected a positive number of workers\n",
+                        appname);
+                exit(1);
+            }
         } else if (longoptarg(arg, "--hostkey", &val, &argc, &argv)) {
             Filename *keyfile;
             int keytype;
@@ -894,6 +985,10 @@ int main(int argc, char **argv)
             ci->ssc.ssh1_cipher_mask = mask;
         } else if (longoptnoarg(arg, "--ssh1-no-compression")) {
             ci->ssc.ssh1_allow_compression = false;
+        } else if (longoptarg(arg, "--compress-dict", &val, &argc, &argv)) {
+            Filename *dictfile = filename_from_str(val);
+            conf_set_filename(ci->conf, CONF_compression_dict, dictfile);
+            filename_free(dictfile);
         } else if (longoptnoarg(arg, "--exitsignum")) {
             ci->ssc.exit_signal_numeric = true;
         } else if (longoptarg(arg, "--sshlog", &val, &argc, &argv) ||
@@ -932,6 +1027,20 @@ int main(int argc, char **argv)
                 "instances\n", appname);
         exit(1);
     }
+    if (nworkers > 1) {
+        if (listen_once) {
+            fprintf(stderr, "%s: cannot use --workers with --listen-once\n",
+                    appname);
+            exit(1);
+        }
+        for (size_t i = 0; i < ninstances; i++) {
+            ci = &instances[i];
+            if (!(ci->listen_port >= 0 || ci->listen_socket)) {
+                fprintf(stderr, "%s: --workers requires --listen\n", appname);
+                exit(1);
+            }
+        }
+    }
     for (size_t i = 0; i < ninstances; i++) {
         ci = &instances[i];
         if (ci->nhostkeys == 0 && !ci->hostkey1) {
@@ -959,8 +1068,20 @@ int main(int argc, char **argv)
     for (size_t i = 0; i < ninstances; i++)
         cmdline_instance_start(&instances[i]);
 
-    cli_main_loop(cliloop_no_pw_setup, cliloop_no_pw_check,
-                  cliloop_always_continue, NULL);
+    if (nworkers > 1) {
+        /*
+         * The expensive startup work - parsing command-line key
+         * files, building policy state, seeding the PRNG - has all
+         * been done once, above. Now fork the extra workers, each of
+         * which accepts its share of connections from the listening
+         * sockets and runs its own event loop.
+         */
+        if (start_workers() > 0)
+            worker_reseed_prng();
+    }
+
+    cli_main_loop(worker_pw_setup, worker_pw_check,
+                  worker_continue, NULL);
 
     return 0;
 }
@@ -67,6 +67,20 @@ bool platform_sha512_neon_available(void)
 #endif
 }
 
+bool platform_crc32_arm_available(void)
+{
+#if defined HWCAP_CRC32
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#elif defined HWCAP2_CRC32
+    return getauxval(AT_HWCAP2) & HWCAP2_CRC32;
+#elif defined __APPLE__
+    /* Assume always present on M1 macOS, similarly to AES */
+    return true;
+#else
+    return false;
+#endif
+}
+
 #else /* defined __arm__ || defined __aarch64__ */
 
 /*
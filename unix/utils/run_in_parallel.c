@@ -0,0 +1,95 @@
+/*
+ * Unix implementation of run_in_parallel(), using POSIX threads if we
+ * have them, and just running the jobs one after another if not.
+ */
+
+#include <unistd.h>
+
+#include "putty.h"
+
+#if HAVE_PTHREAD
+
+#include <pthread.h>
+
+struct parallel_shared {
+    void (*fn)(void *ctx, size_t index);
+    void *ctx;
+    size_t count, nworkers;
+};
+
+struct parallel_worker {
+    struct parallel_shared *shared;
+    size_t tid;
+    bool launched;
+    pthread_t thread;
+};
+
+/* Each worker takes every nworkers'th job, starting from its own id */
+static void run_worker_jobs(struct parallel_shared *shared, size_t tid)
+{
+    for (size_t i = tid; i < shared->count; i += shared->nworkers)
+        shared->fn(shared->ctx, i);
+}
+
+static void *worker_thread_fn(void *vworker)
+{
+    struct parallel_worker *worker = (struct parallel_worker *)vworker;
+    run_worker_jobs(worker->shared, worker->tid);
+    return NULL;
+}
+
+void run_in_parallel(size_t count, void (*fn)(void *ctx, size_t index),
+                     void *ctx)
+{
+    /* No point having more workers than jobs, or than CPUs to run
+     * them on. (The job count is permitted to be under hostile
+     * control, e.g. the parallelism parameter in a downloaded PPK
+     * file, so it mustn't translate directly into a thread count.) */
+    size_t nworkers = count;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus > 0 && (size_t)ncpus < nworkers)
+        nworkers = ncpus;
+
+    if (nworkers <= 1) {
+        for (size_t i = 0; i < count; i++)
+            fn(ctx, i);
+        return;
+    }
+
+    struct parallel_shared shared;
+    shared.fn = fn;
+    shared.ctx = ctx;
+    shared.count = count;
+    shared.nworkers = nworkers;
+
+    struct parallel_worker *workers = snewn(nworkers, struct parallel_worker);
+    for (size_t tid = 1; tid < nworkers; tid++) {
+        workers[tid].shared = &shared;
+        workers[tid].tid = tid;
+        workers[tid].launched = (pthread_create(
+            &workers[tid].thread, NULL, worker_thread_fn, &workers[tid]) == 0);
+    }
+
+    /* This thread acts as worker 0, and also picks up the jobs of any
+     * worker whose thread failed to launch. */
+    run_worker_jobs(&shared, 0);
+    for (size_t tid = 1; tid < nworkers; tid++) {
+        if (workers[tid].launched)
+            pthread_join(workers[tid].thread, NULL);
+        else
+            run_worker_jobs(&shared, tid);
+    }
+
+    sfree(workers);
+}
+
+#else /* !HAVE_PTHREAD */
+
+void run_in_parallel(size_t count, void (*fn)(void *ctx, size_t index),
+                     void *ctx)
+{
+    for (size_t i = 0; i < count; i++)
+        fn(ctx, i);
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Unix implementation of run_in_worker_thread(), using a POSIX thread
+ * per job if we have threads at all. The completion callback is
+ * delivered by the worker writing a byte to a pipe whose read end is
+ * registered with uxsel, so that it arrives on the main thread from
+ * whatever top-level event loop the program is running.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "putty.h"
+
+#if HAVE_PTHREAD
+
+#include <pthread.h>
+
+struct WorkerThread {
+    void (*fn)(void *ctx);
+    void (*completion)(void *ctx);
+    void *ctx;
+    pthread_t thread;
+    WorkerThread *next;
+};
+
+/*
+ * Jobs whose fn has finished but whose completion has not yet been
+ * delivered, protected by done_mutex. Everything else in this file
+ * happens on the main thread only.
+ */
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static WorkerThread *done_head = NULL;
+
+static int signal_pipe[2] = { -1, -1 };
+static bool signal_pipe_broken = false;
+
+static void *worker_thread_real_fn(void *vwt)
+{
+    WorkerThread *wt = (WorkerThread *)vwt;
+    wt->fn(wt->ctx);
+
+    pthread_mutex_lock(&done_mutex);
+    wt->next = done_head;
+    done_head = wt;
+    pthread_mutex_unlock(&done_mutex);
+
+    while (write(signal_pipe[1], "x", 1) < 0 && errno == EINTR);
+    return NULL;
+}
+
+static void worker_done_callback(int fd, int event)
+{
+    char buf[64];
+    while (read(signal_pipe[0], buf, sizeof(buf)) > 0);
+
+    /*
+     * Pop one job at a time, so that a completion callback which
+     * indirectly discards some _other_ outstanding job can still find
+     * that job on the shared list.
+     */
+    while (true) {
+        pthread_mutex_lock(&done_mutex);
+        WorkerThread *wt = done_head;
+        if (wt)
+            done_head = wt->next;
+        pthread_mutex_unlock(&done_mutex);
+        if (!wt)
+            break;
+
+        pthread_join(wt->thread, NULL);
+        void (*completion)(void *ctx) = wt->completion;
+        void *ctx = wt->ctx;
+        sfree(wt);
+        completion(ctx);
+    }
+}
+
+static bool setup_signal_pipe(void)
+{
+    if (signal_pipe[0] >= 0)
+        return true;
+    if (signal_pipe_broken)
+        return false;
+
+    if (pipe(signal_pipe) < 0) {
+        signal_pipe_broken = true;
+        return false;
+    }
+    cloexec(signal_pipe[0]);
+    cloexec(signal_pipe[1]);
+    nonblock(signal_pipe[0]);
+    uxsel_set(signal_pipe[0], SELECT_R, worker_done_callback);
+    return true;
+}
+
+WorkerThread *run_in_worker_thread(
+    void (*fn)(void *ctx), void (*completion)(void *ctx), void *ctx)
+{
+    if (setup_signal_pipe()) {
+        WorkerThread *wt = snew(WorkerThread);
+        wt->fn = fn;
+        wt->completion = completion;
+        wt->ctx = ctx;
+        wt->next = NULL;
+        if (pthread_create(&wt->thread, NULL, worker_thread_real_fn, wt) == 0)
+            return wt;
+        sfree(wt);
+    }
+
+    /*
+     * Fall back to running the job here and now. Completion still
+     * goes via the callback queue, so that the caller sees the same
+     * shape of events in both cases.
+     */
+    fn(ctx);
+    queue_toplevel_callback(completion, ctx);
+    return NULL;
+}
+
+void worker_thread_discard(WorkerThread *wt)
+{
+    if (!wt)
+        return;
+
+    pthread_join(wt->thread, NULL);
+
+    /*
+     * The thread pushed itself on to the done list before
+     * terminating, so after the join it must be there; remove it so
+     * that worker_done_callback won't deliver its completion. (A
+     * stale wakeup byte may be left in the pipe, which the callback
+     * copes with.)
+     */
+    pthread_mutex_lock(&done_mutex);
+    for (WorkerThread **wtp = &done_head; *wtp; wtp = &(*wtp)->next) {
+        if (*wtp == wt) {
+            *wtp = wt->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&done_mutex);
+
+    sfree(wt);
+}
+
+#else /* !HAVE_PTHREAD */
+
+WorkerThread *run_in_worker_thread(
+    void (*fn)(void *ctx), void (*completion)(void *ctx), void *ctx)
+{
+    fn(ctx);
+    queue_toplevel_callback(completion, ctx);
+    return NULL;
+}
+
+void worker_thread_discard(WorkerThread *wt)
+{
+    assert(!wt);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Unix implementation of the scrollback backing-file primitives
+ * declared in putty.h: an ordinary file accessed via mmap(), so that
+ * cold scrollback is paged in and out by the OS on demand, with
+ * fallocate() hole-punching (where the system provides it) to release
+ * the storage underneath discarded history.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "putty.h"
+
+struct ScrollbackFile {
+    int fd;
+};
+
+ScrollbackFile *sb_file_open(const Filename *filename, uint64_t *size_out)
+{
+    int fd;
+    struct stat st;
+    ScrollbackFile *sf;
+
+    fd = open(filename->path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    cloexec(fd);
+
+    sf = snew(ScrollbackFile);
+    sf->fd = fd;
+    *size_out = st.st_size;
+    return sf;
+}
+
+void sb_file_close(ScrollbackFile *sf)
+{
+    if (sf) {
+        close(sf->fd);
+        sfree(sf);
+    }
+}
+
+void *sb_file_map(ScrollbackFile *sf, uint64_t offset, size_t len)
+{
+    struct stat st;
+    void *ptr;
+
+    if (fstat(sf->fd, &st) < 0)
+        return NULL;
+    if ((uint64_t)st.st_size < offset + len &&
+        ftruncate(sf->fd, offset + len) < 0)
+        return NULL;
+
+    ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+               sf->fd, offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void sb_file_unmap(void *ptr, size_t len)
+{
+    munmap(ptr, len);
+}
+
+void sb_file_discard(ScrollbackFile *sf, uint64_t offset, uint64_t len)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    /* Best-effort: if this fails (e.g. the filesystem doesn't support
+     * hole punching), the stale bytes merely keep their disk space. */
+    fallocate(sf->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              offset, len);
+#endif
+}
+
+void sb_file_truncate(ScrollbackFile *sf)
+{
+    if (ftruncate(sf->fd, 0) < 0)
+        /* nothing useful we can do about it */;
+}
+
+size_t sb_file_page_size(void)
+{
+    long ret = sysconf(_SC_PAGESIZE);
+    return ret > 0 ? (size_t)ret : 4096;
+}
@@ -64,6 +64,16 @@ static GdkAtom clipboard_atom
 struct clipboard_data_instance {
     char *pasteout_data_utf8;
     int pasteout_data_utf8_len;
+    /*
+     * While a large selection is still being converted to UTF-8 in
+     * the background, the not-yet-converted source text lives in
+     * 'unconverted' and the output accumulates in 'converted';
+     * pasteout_data_utf8 is only filled in once the conversion
+     * completes.
+     */
+    wchar_t *unconverted;
+    int unconverted_len, unconverted_pos;
+    strbuf *converted;
     struct clipboard_state *state;
     struct clipboard_data_instance *next, *prev;
 };
@@ -110,18 +120,20 @@ struct GtkFrontend {
 #endif
 #ifdef DRAW_TEXT_CAIRO
     /*
-     * If we're drawing using Cairo, we cache the same image on the
-     * client side in a Cairo surface.
+     * If we're drawing using Cairo, we cache the same image in a
+     * Cairo surface.
      *
-     * In GTK2+Cairo, this happens _as well_ as having the server-side
-     * pixmap cache above; in GTK3+Cairo, server-side pixmaps are
-     * deprecated, so we _just_ have this client-side cache. In the
-     * latter case that means we have to transmit a big wodge of
-     * bitmap data over the X connection on every expose event; but
-     * GTK3 apparently deliberately provides no way to avoid that
-     * inefficiency, and at least this way we don't _also_ have to
-     * redo any font rendering just because the window was temporarily
-     * covered.
+     * In GTK2+Cairo, this is a client-side image surface, and exists
+     * _as well_ as the server-side pixmap cache above; in GTK3+Cairo,
+     * server-side pixmaps are deprecated, so this surface is the only
+     * backing store we have. In the latter case we therefore try to
+     * make it a window-'similar' surface (a server-side pixmap on
+     * X11, or whatever the compositor blits from most cheaply on
+     * Wayland), so that expose events don't have to retransmit a big
+     * wodge of bitmap data over the connection; if that's not
+     * possible we fall back to a client-side image surface. Either
+     * way we don't have to redo any font rendering just because the
+     * window was temporarily covered.
      */
     cairo_surface_t *surface;
 #endif
@@ -181,6 +193,18 @@ struct GtkFrontend {
     bool send_raw_mouse;
     bool pointer_indicates_raw_mouse;
     unifont_drawctx uctx;
+    /*
+     * Cache of the last colour we set on the drawing context, so
+     * that consecutive drawing operations in the same colour (the
+     * normal case when painting a line of text) don't each re-set
+     * it. Invalidated whenever a fresh drawing context is set up or
+     * the palette changes.
+     */
+    struct {
+        bool valid, is_rgb, dim;
+        int col;
+        optionalrgb rgb;
+    } last_draw_colour;
 #if GTK_CHECK_VERSION(2,0,0)
     GdkPixbuf *trust_sigil_pb;
 #else
@@ -767,8 +791,34 @@ static void drawing_area_setup(GtkFrontend *inst, int width, int height)
         inst->surface = NULL;
     }
 
-    inst->surface = cairo_image_surface_create(
-        CAIRO_FORMAT_ARGB32, inst->backing_w, inst->backing_h);
+#if GTK_CHECK_VERSION(3,0,0)
+    /*
+     * Under GTK3, where this surface is the only backing store we
+     * have, ask GDK for a surface 'similar' to the window it will be
+     * copied into, rather than unconditionally making a client-side
+     * image surface. On X11 that gets us a server-side pixmap, so
+     * that expose events are serviced by a simple rectangle-copy
+     * within the server instead of retransmitting a big wodge of
+     * bitmap data over the connection every time; on Wayland it gets
+     * us whatever shared-memory or GPU surface the compositor can
+     * blit from most cheaply. Either way, the window system is in a
+     * better position than we are to pick a fast transport.
+     *
+     * This can fail if the drawing area isn't realised yet, in which
+     * case we fall back to the plain image surface below.
+     */
+    {
+        GdkWindow *window = gtk_widget_get_window(inst->area);
+        if (window)
+            inst->surface = gdk_window_create_similar_surface(
+                window, CAIRO_CONTENT_COLOR,
+                inst->backing_w, inst->backing_h);
+    }
+#endif
+
+    if (!inst->surface)
+        inst->surface = cairo_image_surface_create(
+            CAIRO_FORMAT_ARGB32, inst->backing_w, inst->backing_h);
 #endif
 
     draw_backing_rect(inst);
@@ -2574,6 +2624,10 @@ static void gtkwin_palette_set(TermWin *tw, unsigned start, unsigned ncolours,
     assert(start <= OSC4_NCOLOURS);
     assert(ncolours <= OSC4_NCOLOURS - start);
 
+    /* Palette-indexed entries cached against the drawing context may
+     * be about to change meaning. */
+    inst->last_draw_colour.valid = false;
+
 #if !GTK_CHECK_VERSION(3,0,0)
     if (!inst->colmap) {
         inst->colmap = gdk_colormap_get_system();
@@ -2639,6 +2693,28 @@ static struct clipboard_state *clipboard_from_atom(
     return NULL;
 }
 
+/*
+ * Number of wide characters of selection data we convert per pass
+ * when preparing clipboard data. Converting a chunk at a time into a
+ * strbuf means we never have to allocate the worst-case six output
+ * bytes per character for the whole selection at once, which matters
+ * when someone copies a few hundred megabytes of scrollback. (The
+ * INCR-style chunking of the actual selection _transfer_ is GTK's
+ * job, not ours.)
+ */
+#define CLIPBOARD_CONVERT_CHUNK 65536
+
+static void clipboard_utf8_chunk(strbuf *sb, const wchar_t *data, int len)
+{
+    const wchar_t *tmp = data;
+    int tmplen = len;
+    size_t oldlen = sb->len;
+    char *outbuf = strbuf_append(sb, len*6);
+    int outlen = charset_from_unicode(&tmp, &tmplen, outbuf, len*6,
+                                      CS_UTF8, NULL, NULL, 0);
+    strbuf_shrink_to(sb, oldlen + outlen);
+}
+
 #ifdef JUST_USE_GTK_CLIPBOARD_UTF8
 
 /* ----------------------------------------------------------------------
@@ -2672,6 +2748,37 @@ int init_clipboard(GtkFrontend *inst)
     return true;
 }
 
+static void clipboard_convert_chunk(struct clipboard_data_instance *cdi)
+{
+    int chunk = cdi->unconverted_len - cdi->unconverted_pos;
+    if (chunk > CLIPBOARD_CONVERT_CHUNK)
+        chunk = CLIPBOARD_CONVERT_CHUNK;
+
+    clipboard_utf8_chunk(cdi->converted,
+                         cdi->unconverted + cdi->unconverted_pos, chunk);
+    cdi->unconverted_pos += chunk;
+
+    if (cdi->unconverted_pos == cdi->unconverted_len) {
+        cdi->pasteout_data_utf8_len = cdi->converted->len;
+        cdi->pasteout_data_utf8 = strbuf_to_str(cdi->converted);
+        cdi->converted = NULL;
+        sfree(cdi->unconverted);
+        cdi->unconverted = NULL;
+    }
+}
+
+static void clipboard_convert_callback(void *vcdi)
+{
+    struct clipboard_data_instance *cdi =
+        (struct clipboard_data_instance *)vcdi;
+
+    if (!cdi->unconverted)
+        return;          /* a paste request already finished the job */
+    clipboard_convert_chunk(cdi);
+    if (cdi->unconverted)
+        queue_toplevel_callback(clipboard_convert_callback, cdi);
+}
+
 static void clipboard_provide_data(GtkClipboard *clipboard,
                                    GtkSelectionData *selection_data,
                                    guint info, gpointer data)
@@ -2680,6 +2787,13 @@ static void clipboard_provide_data(GtkClipboard *clipboard,
         (struct clipboard_data_instance *)data;
 
     if (cdi->state && cdi->state->current_cdi == cdi) {
+        /*
+         * If someone requests a paste before the background
+         * conversion has finished, we have no choice but to complete
+         * it synchronously here.
+         */
+        while (cdi->unconverted)
+            clipboard_convert_chunk(cdi);
         gtk_selection_data_set_text(selection_data, cdi->pasteout_data_utf8,
                                     cdi->pasteout_data_utf8_len);
     }
@@ -2697,7 +2811,11 @@ static void clipboard_clear(GtkClipboard *clipboard, gpointer data)
         }
         cdi->state->current_cdi = NULL;
     }
+    delete_callbacks_for_context(cdi);
     sfree(cdi->pasteout_data_utf8);
+    sfree(cdi->unconverted);
+    if (cdi->converted)
+        strbuf_free(cdi->converted);
     cdi->next->prev = cdi->prev;
     cdi->prev->next = cdi->next;
     sfree(cdi);
@@ -2726,18 +2844,28 @@ static void gtkwin_clip_write(
     cdi = snew(struct clipboard_data_instance);
     cdi->state = state;
     state->current_cdi = cdi;
-    cdi->pasteout_data_utf8 = snewn(len*6, char);
+    cdi->pasteout_data_utf8 = NULL;
+    cdi->pasteout_data_utf8_len = 0;
     cdi->prev = inst->cdi_headtail.prev;
     cdi->next = &inst->cdi_headtail;
     cdi->next->prev = cdi;
     cdi->prev->next = cdi;
-    {
-        const wchar_t *tmp = data;
-        int tmplen = len;
-        cdi->pasteout_data_utf8_len =
-            charset_from_unicode(&tmp, &tmplen, cdi->pasteout_data_utf8,
-                                 len*6, CS_UTF8, NULL, NULL, 0);
-    }
+
+    /*
+     * Convert the selection to UTF-8 a chunk at a time, so that a
+     * gigantic copy doesn't freeze the window for the duration.
+     * Small selections (the usual case) complete in the first chunk,
+     * converted right here; anything bigger continues from a
+     * callback so the event loop stays live.
+     */
+    cdi->unconverted = snewn(len, wchar_t);
+    memcpy(cdi->unconverted, data, len * sizeof(wchar_t));
+    cdi->unconverted_len = len;
+    cdi->unconverted_pos = 0;
+    cdi->converted = strbuf_new();
+    clipboard_convert_chunk(cdi);
+    if (cdi->unconverted)
+        queue_toplevel_callback(clipboard_convert_callback, cdi);
 
     /*
      * It would be nice to just call gtk_clipboard_set_text() in place
@@ -2867,27 +2995,30 @@ static void gtkwin_clip_write(
      * if we aren't in direct-to-font mode using the D800 hack.
      */
     if (!inst->direct_to_font) {
-        const wchar_t *tmp = data;
-        int tmplen = len;
+        strbuf *sb = strbuf_new();
+        int pos;
 #ifndef NOT_X_WINDOWS
         XTextProperty tp;
         char *list[1];
 #endif
 
-        state->pasteout_data_utf8 = snewn(len*6, char);
-        state->pasteout_data_utf8_len = len*6;
-        state->pasteout_data_utf8_len =
-            charset_from_unicode(&tmp, &tmplen, state->pasteout_data_utf8,
-                                 state->pasteout_data_utf8_len,
-                                 CS_UTF8, NULL, NULL, 0);
+        /*
+         * Convert a chunk at a time into a strbuf, so that we don't
+         * have to allocate six bytes per source character up front
+         * for an enormous selection.
+         */
+        for (pos = 0; pos < len; pos += CLIPBOARD_CONVERT_CHUNK) {
+            int chunk = len - pos;
+            if (chunk > CLIPBOARD_CONVERT_CHUNK)
+                chunk = CLIPBOARD_CONVERT_CHUNK;
+            clipboard_utf8_chunk(sb, data + pos, chunk);
+        }
+        state->pasteout_data_utf8_len = sb->len;
         if (state->pasteout_data_utf8_len == 0) {
-            sfree(state->pasteout_data_utf8);
+            strbuf_free(sb);
             state->pasteout_data_utf8 = NULL;
         } else {
-            state->pasteout_data_utf8 =
-                sresize(state->pasteout_data_utf8,
-                        state->pasteout_data_utf8_len + 1, char);
-            state->pasteout_data_utf8[state->pasteout_data_utf8_len] = '\0';
+            state->pasteout_data_utf8 = strbuf_to_str(sb);
         }
 
         /*
@@ -2914,18 +3045,28 @@ static void gtkwin_clip_write(
         state->pasteout_data_ctext_len = 0;
     }
 
-    state->pasteout_data = snewn(len*6, char);
-    state->pasteout_data_len = len*6;
-    state->pasteout_data_len = wc_to_mb(inst->ucsdata.line_codepage, 0,
-                                       data, len, state->pasteout_data,
-                                       state->pasteout_data_len,
-                                       NULL, NULL);
-    if (state->pasteout_data_len == 0) {
-        sfree(state->pasteout_data);
-        state->pasteout_data = NULL;
-    } else {
-        state->pasteout_data =
-            sresize(state->pasteout_data, state->pasteout_data_len, char);
+    {
+        strbuf *sb = strbuf_new();
+        int pos;
+        for (pos = 0; pos < len; pos += CLIPBOARD_CONVERT_CHUNK) {
+            int chunk = len - pos;
+            size_t oldlen = sb->len;
+            char *outbuf;
+            int outlen;
+            if (chunk > CLIPBOARD_CONVERT_CHUNK)
+                chunk = CLIPBOARD_CONVERT_CHUNK;
+            outbuf = strbuf_append(sb, chunk*6);
+            outlen = wc_to_mb(inst->ucsdata.line_codepage, 0, data + pos,
+                              chunk, outbuf, chunk*6, NULL, NULL);
+            strbuf_shrink_to(sb, oldlen + outlen);
+        }
+        state->pasteout_data_len = sb->len;
+        if (state->pasteout_data_len == 0) {
+            strbuf_free(sb);
+            state->pasteout_data = NULL;
+        } else {
+            state->pasteout_data = strbuf_to_str(sb);
+        }
     }
 
 #ifndef NOT_X_WINDOWS
@@ -3336,6 +3477,7 @@ static bool gtkwin_setup_draw_ctx(TermWin *tw)
         return false;
 
     inst->uctx.type = inst->drawtype;
+    inst->last_draw_colour.valid = false;
 #ifdef DRAW_TEXT_GDK
     if (inst->uctx.type == DRAWTYPE_GDK) {
         /* If we're doing GDK-based drawing, then we also expect
@@ -3403,6 +3545,70 @@ static void draw_update(GtkFrontend *inst, int x, int y, int w, int h)
     gtk_widget_queue_draw_area(inst->area, x, y, w, h);
 }
 
+static bool gtkwin_draw_scroll(TermWin *tw, int topline, int botline,
+                               int lines)
+{
+#ifdef DRAW_TEXT_CAIRO
+    GtkFrontend *inst = container_of(tw, GtkFrontend, termwin);
+    int n = abs(lines), size = botline - topline + 1, keep = size - n;
+    int x, w, h, src_y, dst_y;
+    cairo_surface_t *band;
+    cairo_t *cr;
+
+    if (inst->uctx.type != DRAWTYPE_CAIRO || !inst->surface || keep <= 0)
+        return false;
+
+    /*
+     * Work out the device-pixel rectangle of the retained band, in
+     * its old and new positions. inst->surface is allocated in device
+     * pixels (backing_w / backing_h), hence the multiplications by
+     * inst->scale.
+     */
+    x = inst->window_border * inst->scale;
+    w = inst->width * inst->font_width * inst->scale;
+    h = keep * inst->font_height * inst->scale;
+    if (lines > 0) {
+        src_y = inst->window_border + (topline + n) * inst->font_height;
+        dst_y = inst->window_border + topline * inst->font_height;
+    } else {
+        src_y = inst->window_border + topline * inst->font_height;
+        dst_y = inst->window_border + (topline + n) * inst->font_height;
+    }
+    src_y *= inst->scale;
+    dst_y *= inst->scale;
+
+    /*
+     * Cairo leaves the effect of drawing a surface on to itself
+     * undefined where source and destination overlap, so copy the
+     * retained band out to a scratch surface and back. Still far
+     * cheaper than re-rendering the text.
+     */
+    band = cairo_surface_create_similar(inst->surface,
+                                        CAIRO_CONTENT_COLOR, w, h);
+    cr = cairo_create(band);
+    cairo_set_source_surface(cr, inst->surface, -x, -src_y);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    cr = cairo_create(inst->surface);
+    cairo_set_source_surface(cr, band, x, dst_y);
+    cairo_rectangle(cr, x, dst_y, w, h);
+    cairo_fill(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(band);
+
+    /* draw_update takes logical coordinates, like the draw_text
+     * calls. Update the whole scrolled region: the vacated lines are
+     * about to be redrawn by our caller anyway. */
+    draw_update(inst, inst->window_border,
+                inst->window_border + topline * inst->font_height,
+                inst->width * inst->font_width, size * inst->font_height);
+    return true;
+#else
+    return false;
+#endif
+}
+
 #ifdef DRAW_TEXT_CAIRO
 static void cairo_set_source_rgb_dim(cairo_t *cr, double r, double g, double b,
                                      bool dim)
@@ -3416,6 +3622,14 @@ static void cairo_set_source_rgb_dim(cairo_t *cr, double r, double g, double b,
 
 static void draw_set_colour(GtkFrontend *inst, int col, bool dim)
 {
+    if (inst->last_draw_colour.valid && !inst->last_draw_colour.is_rgb &&
+        inst->last_draw_colour.col == col && inst->last_draw_colour.dim == dim)
+        return;
+    inst->last_draw_colour.valid = true;
+    inst->last_draw_colour.is_rgb = false;
+    inst->last_draw_colour.col = col;
+    inst->last_draw_colour.dim = dim;
+
 #ifdef DRAW_TEXT_GDK
     if (inst->uctx.type == DRAWTYPE_GDK) {
         if (dim) {
@@ -3446,6 +3660,17 @@ static void draw_set_colour(GtkFrontend *inst, int col, bool dim)
 
 static void draw_set_colour_rgb(GtkFrontend *inst, optionalrgb orgb, bool dim)
 {
+    if (inst->last_draw_colour.valid && inst->last_draw_colour.is_rgb &&
+        inst->last_draw_colour.rgb.r == orgb.r &&
+        inst->last_draw_colour.rgb.g == orgb.g &&
+        inst->last_draw_colour.rgb.b == orgb.b &&
+        inst->last_draw_colour.dim == dim)
+        return;
+    inst->last_draw_colour.valid = true;
+    inst->last_draw_colour.is_rgb = true;
+    inst->last_draw_colour.rgb = orgb;
+    inst->last_draw_colour.dim = dim;
+
 #ifdef DRAW_TEXT_GDK
     if (inst->uctx.type == DRAWTYPE_GDK) {
 #if GTK_CHECK_VERSION(2,0,0)
@@ -5038,6 +5263,7 @@ static const TermWinVtable gtk_termwin_vt = {
     .draw_text = gtkwin_draw_text,
     .draw_cursor = gtkwin_draw_cursor,
     .draw_trust_sigil = gtkwin_draw_trust_sigil,
+    .draw_scroll = gtkwin_draw_scroll,
     .char_width = gtkwin_char_width,
     .free_draw_ctx = gtkwin_free_draw_ctx,
     .set_cursor_pos = gtkwin_set_cursor_pos,
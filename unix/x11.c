@@ -14,10 +14,58 @@
 #include "ssh.h"
 #include "network.h"
 
+/*
+ * Cache of the last .Xauthority file we parsed, so that a process
+ * which sets up more than one display doesn't have to re-read and
+ * re-parse the whole file per display. The cache is invalidated
+ * whenever the file's identity or stat details change, so an xauth
+ * run between two lookups will still be honoured.
+ */
+static X11AuthFile *authfile_cache;
+static char *authfile_cache_name;
+static struct stat authfile_cache_st;
+
+static void authfile_cache_discard(void)
+{
+    if (authfile_cache) {
+        x11_authfile_free(authfile_cache);
+        authfile_cache = NULL;
+    }
+    sfree(authfile_cache_name);
+    authfile_cache_name = NULL;
+}
+
+static X11AuthFile *get_cached_authfile(const char *xauthfile)
+{
+    struct stat st;
+
+    if (stat(xauthfile, &st) < 0) {
+        authfile_cache_discard();
+        return NULL;
+    }
+
+    if (authfile_cache &&
+        !strcmp(authfile_cache_name, xauthfile) &&
+        authfile_cache_st.st_dev == st.st_dev &&
+        authfile_cache_st.st_ino == st.st_ino &&
+        authfile_cache_st.st_mtime == st.st_mtime &&
+        authfile_cache_st.st_size == st.st_size)
+        return authfile_cache;
+
+    authfile_cache_discard();
+    authfile_cache = x11_authfile_load(xauthfile);
+    if (authfile_cache) {
+        authfile_cache_name = dupstr(xauthfile);
+        authfile_cache_st = st;
+    }
+    return authfile_cache;
+}
+
 void platform_get_x11_auth(struct X11Display *disp, Conf *conf)
 {
     char *xauthfile;
     bool needs_free;
+    X11AuthFile *af;
 
     /*
      * Find the .Xauthority file.
@@ -33,7 +81,9 @@ void platform_get_x11_auth(struct X11Display *disp, Conf *conf)
     }
 
     if (xauthfile) {
-        x11_get_auth_from_authfile(disp, xauthfile);
+        af = get_cached_authfile(xauthfile);
+        if (af)
+            x11_authfile_lookup(af, disp);
         if (needs_free)
             sfree(xauthfile);
     }
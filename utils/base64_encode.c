@@ -0,0 +1,73 @@
+/*
+ * Encode a whole buffer of binary data as base64 in one call.
+ *
+ * Output is identical to repeatedly calling base64_encode_atom, with
+ * a newline after every cpl characters and one more at the very end
+ * if cpl > 0 (matching the layout of the base64 sections of key file
+ * formats). Passing cpl <= 0 suppresses newlines entirely. The point
+ * of doing it here rather than atom by atom at the call site is that
+ * we encode straight out of the input buffer and hand the sink large
+ * chunks, instead of one write per output character.
+ */
+
+#include <stdio.h>
+
+#include "defs.h"
+#include "misc.h"
+
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void base64_encode_bs(BinarySink *bs, ptrlen input, int cpl)
+{
+    const unsigned char *p = (const unsigned char *)input.ptr;
+    size_t n = input.len;
+    char outbuf[512];
+    size_t outused = 0;
+    int linelen = 0;
+
+    while (n > 0) {
+        unsigned word;
+        char atom[4];
+        int i;
+
+        word = p[0] << 16;
+        if (n > 1)
+            word |= p[1] << 8;
+        if (n > 2)
+            word |= p[2];
+        atom[0] = base64_chars[(word >> 18) & 0x3F];
+        atom[1] = base64_chars[(word >> 12) & 0x3F];
+        atom[2] = (n > 1 ? base64_chars[(word >> 6) & 0x3F] : '=');
+        atom[3] = (n > 2 ? base64_chars[word & 0x3F] : '=');
+
+        for (i = 0; i < 4; i++) {
+            if (cpl > 0 && linelen >= cpl) {
+                linelen = 0;
+                outbuf[outused++] = '\n';
+            }
+            outbuf[outused++] = atom[i];
+            linelen++;
+        }
+
+        if (outused > sizeof(outbuf) - 8) {
+            put_data(bs, outbuf, outused);
+            outused = 0;
+        }
+
+        i = (n < 3 ? n : 3);
+        p += i;
+        n -= i;
+    }
+
+    if (cpl > 0)
+        outbuf[outused++] = '\n';
+    put_data(bs, outbuf, outused);
+}
+
+void base64_encode(FILE *fp, const unsigned char *data, int datalen, int cpl)
+{
+    stdio_sink ss;
+    stdio_sink_init(&ss, fp);
+    base64_encode_bs(BinarySink_UPCAST(&ss), make_ptrlen(data, datalen), cpl);
+}
@@ -16,6 +16,14 @@
 
 #define BUFFER_MIN_GRANULE  512
 
+/*
+ * Maximum number of standard-sized granules we'll keep on a chain's
+ * spare list rather than freeing. Sixteen bounds the retained memory
+ * at a few KB for a default chain, while still being plenty to make
+ * a steady-state producer/consumer cycle allocation-free.
+ */
+#define BUFFER_MAX_SPARE_GRANULES 16
+
 struct bufchain_granule {
     struct bufchain_granule *next;
     char *bufpos, *bufend, *bufmax;
@@ -29,11 +37,84 @@ static void uninitialised_queue_idempotent_callback(IdempotentCallback *ic)
 void bufchain_init(bufchain *ch)
 {
     ch->head = ch->tail = NULL;
+    ch->spare = NULL;
+    ch->nspare = 0;
+    ch->granule_size = BUFFER_MIN_GRANULE;
     ch->buffersize = 0;
     ch->ic = NULL;
     ch->queue_idempotent_callback = uninitialised_queue_idempotent_callback;
 }
 
+/*
+ * Configure the allocation size of this chain's granules. Chains
+ * carrying bulk data (e.g. the raw SSH byte streams either side of
+ * the BPP) want much larger granules than the default, so that a
+ * whole network read fits in one or two of them; control chains are
+ * fine with the default. 'size' is the payload capacity per granule.
+ *
+ * Any granules already on the spare list are the old size, so they
+ * are freed rather than kept.
+ */
+void bufchain_set_granule_size(bufchain *ch, size_t size)
+{
+    struct bufchain_granule *b;
+
+    ch->granule_size = size + sizeof(struct bufchain_granule);
+    if (ch->granule_size < BUFFER_MIN_GRANULE)
+        ch->granule_size = BUFFER_MIN_GRANULE;
+
+    while (ch->spare) {
+        b = ch->spare;
+        ch->spare = b->next;
+        smemclr(b, sizeof(*b));
+        sfree(b);
+    }
+    ch->nspare = 0;
+}
+
+/*
+ * Retire a granule that has been fully consumed. Standard-sized
+ * granules go on the spare list for reuse by the next bufchain_add,
+ * so that a steady-state transfer through the chain does no
+ * allocation at all; oversized ones (from a single very large add)
+ * and anything beyond the spare-list limit are freed as before.
+ */
+static void bufchain_granule_retire(bufchain *ch, struct bufchain_granule *b)
+{
+    if ((size_t)(b->bufmax - (char *)b) == ch->granule_size &&
+        ch->nspare < BUFFER_MAX_SPARE_GRANULES) {
+        b->bufpos = b->bufend = (char *)b + sizeof(struct bufchain_granule);
+        b->next = ch->spare;
+        ch->spare = b;
+        ch->nspare++;
+    } else {
+        smemclr(b, sizeof(*b));
+        sfree(b);
+    }
+}
+
+static struct bufchain_granule *bufchain_granule_new(bufchain *ch, size_t len)
+{
+    struct bufchain_granule *newbuf;
+
+    if (ch->spare) {
+        newbuf = ch->spare;
+        ch->spare = newbuf->next;
+        ch->nspare--;
+    } else {
+        size_t grainlen =
+            max(sizeof(struct bufchain_granule) + len, ch->granule_size);
+        memstats_push_tag("bufchain");
+        newbuf = smalloc(grainlen);
+        memstats_pop_tag();
+        newbuf->bufpos = newbuf->bufend =
+            (char *)newbuf + sizeof(struct bufchain_granule);
+        newbuf->bufmax = (char *)newbuf + grainlen;
+    }
+    newbuf->next = NULL;
+    return newbuf;
+}
+
 void bufchain_clear(bufchain *ch)
 {
     struct bufchain_granule *b;
@@ -43,6 +124,13 @@ void bufchain_clear(bufchain *ch)
         smemclr(b, sizeof(*b));
         sfree(b);
     }
+    while (ch->spare) {
+        b = ch->spare;
+        ch->spare = b->next;
+        smemclr(b, sizeof(*b));
+        sfree(b);
+    }
+    ch->nspare = 0;
     ch->tail = NULL;
     ch->buffersize = 0;
 }
@@ -77,14 +165,7 @@ void bufchain_add(bufchain *ch, const void *data, size_t len)
             ch->tail->bufend += copylen;
         }
         if (len > 0) {
-            size_t grainlen =
-                max(sizeof(struct bufchain_granule) + len, BUFFER_MIN_GRANULE);
-            struct bufchain_granule *newbuf;
-            newbuf = smalloc(grainlen);
-            newbuf->bufpos = newbuf->bufend =
-                (char *)newbuf + sizeof(struct bufchain_granule);
-            newbuf->bufmax = (char *)newbuf + grainlen;
-            newbuf->next = NULL;
+            struct bufchain_granule *newbuf = bufchain_granule_new(ch, len);
             if (ch->tail)
                 ch->tail->next = newbuf;
             else
@@ -111,8 +192,7 @@ void bufchain_consume(bufchain *ch, size_t len)
             ch->head = tmp->next;
             if (!ch->head)
                 ch->tail = NULL;
-            smemclr(tmp, sizeof(*tmp));
-            sfree(tmp);
+            bufchain_granule_retire(ch, tmp);
         } else
             ch->head->bufpos += remlen;
         ch->buffersize -= remlen;
@@ -125,6 +205,16 @@ ptrlen bufchain_prefix(bufchain *ch)
     return make_ptrlen(ch->head->bufpos, ch->head->bufend - ch->head->bufpos);
 }
 
+size_t bufchain_prefixes(bufchain *ch, ptrlen *prefixes, size_t maxprefixes)
+{
+    struct bufchain_granule *gr;
+    size_t n = 0;
+
+    for (gr = ch->head; gr && n < maxprefixes; gr = gr->next)
+        prefixes[n++] = make_ptrlen(gr->bufpos, gr->bufend - gr->bufpos);
+    return n;
+}
+
 void bufchain_fetch(bufchain *ch, void *data, size_t len)
 {
     struct bufchain_granule *tmp;
@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include "tree234.h"
@@ -66,8 +67,52 @@ struct conf_entry {
     struct value value;
 };
 
+/*
+ * An integer-subkeyed setting is stored as a vector of entries kept
+ * sorted by subkey. The subkeys in practice are small list indices
+ * (preference lists, the colour and wordness tables), written in
+ * ascending order when a session is loaded, so insertions are almost
+ * always appends and lookups are a binary search with no pointer
+ * chasing.
+ */
+struct intkey_entry {
+    int subkey;
+    struct value value;
+};
+struct intkey_vector {
+    struct intkey_entry *entries;
+    size_t nentries, size;
+};
+
+/*
+ * Storage is split by key type. Settings with no subkey - the vast
+ * majority, and the ones that hot paths like terminal output query
+ * over and over - live in a flat array directly indexed by the
+ * primary key enum, so conf_get_bool and friends are a bounds-checked
+ * array load. Integer-subkeyed settings live in the sorted vectors
+ * described above. Only string-subkeyed settings (environment
+ * variables, ttymodes, port forwardings) still live in a tree234,
+ * since their key spaces really are sparse and unbounded.
+ */
+struct conf_data {
+    int refcount;
+    tree234 *tree;                     /* string-subkeyed settings only */
+    struct value values[N_CONFIG_OPTIONS]; /* non-subkeyed settings */
+    bool present[N_CONFIG_OPTIONS];
+    struct intkey_vector intvec[N_CONFIG_OPTIONS]; /* int-subkeyed */
+};
+
+/*
+ * A Conf is just a handle on a reference-counted data block, so that
+ * conf_copy need not copy anything: the new Conf shares the old one's
+ * data and bumps its refcount. The first write through any handle
+ * whose data is shared makes a private deep copy first
+ * (conf_unshare), so the copy cost is deferred until a sharer
+ * actually diverges - which duplicate-session and the nested Confs
+ * created for proxy sessions mostly never do.
+ */
 struct conf_tag {
-    tree234 *tree;
+    struct conf_data *data;
 };
 
 /*
@@ -202,117 +247,297 @@ static void free_entry(struct conf_entry *entry)
     sfree(entry);
 }
 
+static struct conf_data *conf_data_new(void)
+{
+    struct conf_data *data = snew(struct conf_data);
+    int i;
+
+    data->refcount = 1;
+    data->tree = newtree234(conf_cmp);
+    for (i = 0; i < N_CONFIG_OPTIONS; i++)
+        data->present[i] = false;
+    memset(data->intvec, 0, sizeof(data->intvec));
+
+    return data;
+}
+
 Conf *conf_new(void)
 {
+    memstats_push_tag("conf");
     Conf *conf = snew(struct conf_tag);
+    conf->data = conf_data_new();
+    memstats_pop_tag();
+    return conf;
+}
 
-    conf->tree = newtree234(conf_cmp);
+/*
+ * Binary-search an intkey vector for a subkey. Returns the index of
+ * the matching entry if *found comes back true, or the insertion
+ * point for that subkey if not.
+ */
+static size_t intvec_search(struct intkey_vector *v, int subkey, bool *found)
+{
+    size_t lo = 0, hi = v->nentries;
 
-    return conf;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (v->entries[mid].subkey < subkey)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *found = (lo < v->nentries && v->entries[lo].subkey == subkey);
+    return lo;
 }
 
-static void conf_clear(Conf *conf)
+/*
+ * Return the slot for an int-subkeyed setting, about to be written:
+ * any previous value is freed, and a new entry made if necessary.
+ */
+static struct value *intvec_install(Conf *conf, int primary, int secondary)
+{
+    struct intkey_vector *v = &conf->data->intvec[primary];
+    bool found;
+    size_t pos = intvec_search(v, secondary, &found);
+
+    if (!found) {
+        sgrowarray(v->entries, v->size, v->nentries);
+        memmove(v->entries + pos + 1, v->entries + pos,
+                (v->nentries - pos) * sizeof(*v->entries));
+        v->nentries++;
+        v->entries[pos].subkey = secondary;
+    } else {
+        free_value(&v->entries[pos].value, valuetypes[primary]);
+    }
+
+    return &v->entries[pos].value;
+}
+
+static void conf_free_intvecs(struct conf_data *data)
+{
+    int i;
+    size_t j;
+
+    for (i = 0; i < N_CONFIG_OPTIONS; i++) {
+        struct intkey_vector *v = &data->intvec[i];
+        for (j = 0; j < v->nentries; j++)
+            free_value(&v->entries[j].value, valuetypes[i]);
+        sfree(v->entries);
+        v->entries = NULL;
+        v->nentries = v->size = 0;
+    }
+}
+
+/*
+ * Free the entries in a conf's tree, but not the tree itself. We can
+ * walk the tree and free each element in place, and then throw away
+ * the whole tree structure in one go, which is much cheaper than
+ * repeatedly deleting elements from it, because each deletion
+ * rebalances the tree.
+ */
+static void conf_free_tree_contents(tree234 *tree)
 {
     struct conf_entry *entry;
+    int i;
 
-    while ((entry = delpos234(conf->tree, 0)) != NULL)
+    for (i = 0; (entry = index234(tree, i)) != NULL; i++)
         free_entry(entry);
 }
 
+static void conf_data_release(struct conf_data *data)
+{
+    int i;
+
+    if (--data->refcount > 0)
+        return;
+
+    conf_free_tree_contents(data->tree);
+    freetree234(data->tree);
+
+    conf_free_intvecs(data);
+
+    for (i = 0; i < N_CONFIG_OPTIONS; i++) {
+        if (data->present[i])
+            free_value(&data->values[i], valuetypes[i]);
+    }
+
+    sfree(data);
+}
+
+static void conf_clear(Conf *conf)
+{
+    struct conf_data *data = conf->data;
+    int i;
+
+    /*
+     * If the data block is shared, we needn't (and mustn't) free its
+     * contents: just detach from it and start afresh.
+     */
+    if (data->refcount > 1) {
+        data->refcount--;
+        conf->data = conf_data_new();
+        return;
+    }
+
+    conf_free_tree_contents(data->tree);
+    freetree234(data->tree);
+    data->tree = newtree234(conf_cmp);
+
+    conf_free_intvecs(data);
+
+    for (i = 0; i < N_CONFIG_OPTIONS; i++) {
+        if (data->present[i]) {
+            free_value(&data->values[i], valuetypes[i]);
+            data->present[i] = false;
+        }
+    }
+}
+
 void conf_free(Conf *conf)
 {
-    conf_clear(conf);
-    freetree234(conf->tree);
+    conf_data_release(conf->data);
     sfree(conf);
 }
 
+
 static void conf_insert(Conf *conf, struct conf_entry *entry)
 {
-    struct conf_entry *oldentry = add234(conf->tree, entry);
+    struct conf_entry *oldentry = add234(conf->data->tree, entry);
     if (oldentry && oldentry != entry) {
-        del234(conf->tree, oldentry);
+        del234(conf->data->tree, oldentry);
         free_entry(oldentry);
-        oldentry = add234(conf->tree, entry);
+        oldentry = add234(conf->data->tree, entry);
         assert(oldentry == entry);
     }
 }
 
-void conf_copy_into(Conf *newconf, Conf *oldconf)
+/*
+ * Return the slot for a non-subkeyed setting, about to be written:
+ * any previous value is freed, and the slot marked as filled in.
+ */
+static struct value *conf_install_primary(Conf *conf, int primary)
+{
+    assert(primary >= 0 && primary < N_CONFIG_OPTIONS);
+    assert(subkeytypes[primary] == TYPE_NONE);
+    if (conf->data->present[primary])
+        free_value(&conf->data->values[primary], valuetypes[primary]);
+    conf->data->present[primary] = true;
+    return &conf->data->values[primary];
+}
+
+/*
+ * Return the slot for a non-subkeyed setting that must already have
+ * a value.
+ */
+static struct value *conf_lookup_primary(Conf *conf, int primary)
+{
+    assert(primary >= 0 && primary < N_CONFIG_OPTIONS);
+    assert(subkeytypes[primary] == TYPE_NONE);
+    assert(conf->data->present[primary]);
+    return &conf->data->values[primary];
+}
+
+/*
+ * Give a Conf a data block all of its own, deep-copying the one it
+ * was sharing. Called at the start of every mutating operation; the
+ * common case (refcount 1) is a single compare.
+ */
+static void conf_unshare(Conf *conf)
 {
+    struct conf_data *from = conf->data, *to;
     struct conf_entry *entry, *entry2;
     int i;
 
-    conf_clear(newconf);
+    if (from->refcount == 1)
+        return;
+
+    memstats_push_tag("conf");
+    to = conf_data_new();
+
+    for (i = 0; i < N_CONFIG_OPTIONS; i++) {
+        if (from->present[i]) {
+            copy_value(&to->values[i], &from->values[i], valuetypes[i]);
+            to->present[i] = true;
+        }
+    }
+
+    for (i = 0; i < N_CONFIG_OPTIONS; i++) {
+        struct intkey_vector *fromv = &from->intvec[i];
+        struct intkey_vector *tov = &to->intvec[i];
+        if (fromv->nentries) {
+            tov->nentries = tov->size = fromv->nentries;
+            tov->entries = snewn(tov->size, struct intkey_entry);
+            for (size_t j = 0; j < fromv->nentries; j++) {
+                tov->entries[j].subkey = fromv->entries[j].subkey;
+                copy_value(&tov->entries[j].value, &fromv->entries[j].value,
+                           valuetypes[i]);
+            }
+        }
+    }
 
-    for (i = 0; (entry = index234(oldconf->tree, i)) != NULL; i++) {
+    for (i = 0; (entry = index234(from->tree, i)) != NULL; i++) {
         entry2 = snew(struct conf_entry);
         copy_key(&entry2->key, &entry->key);
         copy_value(&entry2->value, &entry->value,
                    valuetypes[entry->key.primary]);
-        add234(newconf->tree, entry2);
+        add234(to->tree, entry2);
     }
+    memstats_pop_tag();
+
+    from->refcount--;
+    conf->data = to;
+}
+
+void conf_copy_into(Conf *newconf, Conf *oldconf)
+{
+    if (newconf->data == oldconf->data)
+        return;
+    conf_data_release(newconf->data);
+    newconf->data = oldconf->data;
+    newconf->data->refcount++;
 }
 
 Conf *conf_copy(Conf *oldconf)
 {
-    Conf *newconf = conf_new();
+    Conf *newconf = snew(struct conf_tag);
 
-    conf_copy_into(newconf, oldconf);
+    newconf->data = oldconf->data;
+    newconf->data->refcount++;
 
     return newconf;
 }
 
 bool conf_get_bool(Conf *conf, int primary)
 {
-    struct key key;
-    struct conf_entry *entry;
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_BOOL);
-    key.primary = primary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.boolval;
+    return conf_lookup_primary(conf, primary)->u.boolval;
 }
 
 int conf_get_int(Conf *conf, int primary)
 {
-    struct key key;
-    struct conf_entry *entry;
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_INT);
-    key.primary = primary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.intval;
+    return conf_lookup_primary(conf, primary)->u.intval;
 }
 
 int conf_get_int_int(Conf *conf, int primary, int secondary)
 {
-    struct key key;
-    struct conf_entry *entry;
+    struct intkey_vector *v;
+    bool found;
+    size_t pos;
 
     assert(subkeytypes[primary] == TYPE_INT);
     assert(valuetypes[primary] == TYPE_INT);
-    key.primary = primary;
-    key.secondary.i = secondary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.intval;
+    v = &conf->data->intvec[primary];
+    pos = intvec_search(v, secondary, &found);
+    assert(found);
+    return v->entries[pos].value.u.intval;
 }
 
 char *conf_get_str(Conf *conf, int primary)
 {
-    struct key key;
-    struct conf_entry *entry;
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_STR);
-    key.primary = primary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.stringval;
+    return conf_lookup_primary(conf, primary)->u.stringval;
 }
 
 char *conf_get_str_str_opt(Conf *conf, int primary, const char *secondary)
@@ -324,7 +549,7 @@ char *conf_get_str_str_opt(Conf *conf, int primary, const char *secondary)
     assert(valuetypes[primary] == TYPE_STR);
     key.primary = primary;
     key.secondary.s = (char *)secondary;
-    entry = find234(conf->tree, &key, NULL);
+    entry = find234(conf->data->tree, &key, NULL);
     return entry ? entry->value.u.stringval : NULL;
 }
 
@@ -346,10 +571,10 @@ char *conf_get_str_strs(Conf *conf, int primary,
     key.primary = primary;
     if (subkeyin) {
         key.secondary.s = subkeyin;
-        entry = findrel234(conf->tree, &key, NULL, REL234_GT);
+        entry = findrel234(conf->data->tree, &key, NULL, REL234_GT);
     } else {
         key.secondary.s = "";
-        entry = findrel234(conf->tree, &key, conf_cmp_constkey, REL234_GE);
+        entry = findrel234(conf->data->tree, &key, conf_cmp_constkey, REL234_GE);
     }
     if (!entry || entry->key.primary != primary)
         return NULL;
@@ -367,11 +592,11 @@ char *conf_get_str_nthstrkey(Conf *conf, int primary, int n)
     assert(valuetypes[primary] == TYPE_STR);
     key.primary = primary;
     key.secondary.s = "";
-    entry = findrelpos234(conf->tree, &key, conf_cmp_constkey,
+    entry = findrelpos234(conf->data->tree, &key, conf_cmp_constkey,
                           REL234_GE, &index);
     if (!entry || entry->key.primary != primary)
         return NULL;
-    entry = index234(conf->tree, index + n);
+    entry = index234(conf->data->tree, index + n);
     if (!entry || entry->key.primary != primary)
         return NULL;
     return entry->key.secondary.s;
@@ -379,87 +604,63 @@ char *conf_get_str_nthstrkey(Conf *conf, int primary, int n)
 
 Filename *conf_get_filename(Conf *conf, int primary)
 {
-    struct key key;
-    struct conf_entry *entry;
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_FILENAME);
-    key.primary = primary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.fileval;
+    return conf_lookup_primary(conf, primary)->u.fileval;
 }
 
 FontSpec *conf_get_fontspec(Conf *conf, int primary)
 {
-    struct key key;
-    struct conf_entry *entry;
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_FONT);
-    key.primary = primary;
-    entry = find234(conf->tree, &key, NULL);
-    assert(entry);
-    return entry->value.u.fontval;
+    return conf_lookup_primary(conf, primary)->u.fontval;
 }
 
 void conf_set_bool(Conf *conf, int primary, bool value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_BOOL);
-    entry->key.primary = primary;
-    entry->value.u.boolval = value;
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    conf_install_primary(conf, primary)->u.boolval = value;
 }
 
 void conf_set_int(Conf *conf, int primary, int value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_INT);
-    entry->key.primary = primary;
-    entry->value.u.intval = value;
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    conf_install_primary(conf, primary)->u.intval = value;
 }
 
 void conf_set_int_int(Conf *conf, int primary,
                       int secondary, int value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
     assert(subkeytypes[primary] == TYPE_INT);
     assert(valuetypes[primary] == TYPE_INT);
-    entry->key.primary = primary;
-    entry->key.secondary.i = secondary;
-    entry->value.u.intval = value;
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    intvec_install(conf, primary, secondary)->u.intval = value;
 }
 
 void conf_set_str(Conf *conf, int primary, const char *value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_STR);
-    entry->key.primary = primary;
-    entry->value.u.stringval = dupstr(value);
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    memstats_push_tag("conf");
+    conf_install_primary(conf, primary)->u.stringval = dupstr(value);
+    memstats_pop_tag();
 }
 
 void conf_set_str_str(Conf *conf, int primary, const char *secondary,
                       const char *value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
+    struct conf_entry *entry;
 
     assert(subkeytypes[primary] == TYPE_STR);
     assert(valuetypes[primary] == TYPE_STR);
+    conf_unshare(conf);
+    memstats_push_tag("conf");
+    entry = snew(struct conf_entry);
     entry->key.primary = primary;
     entry->key.secondary.s = dupstr(secondary);
     entry->value.u.stringval = dupstr(value);
     conf_insert(conf, entry);
+    memstats_pop_tag();
 }
 
 void conf_del_str_str(Conf *conf, int primary, const char *secondary)
@@ -469,68 +670,95 @@ void conf_del_str_str(Conf *conf, int primary, const char *secondary)
 
     assert(subkeytypes[primary] == TYPE_STR);
     assert(valuetypes[primary] == TYPE_STR);
+    conf_unshare(conf);
     key.primary = primary;
     key.secondary.s = (char *)secondary;
-    entry = find234(conf->tree, &key, NULL);
+    entry = find234(conf->data->tree, &key, NULL);
     if (entry) {
-        del234(conf->tree, entry);
+        del234(conf->data->tree, entry);
         free_entry(entry);
     }
  }
 
 void conf_set_filename(Conf *conf, int primary, const Filename *value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_FILENAME);
-    entry->key.primary = primary;
-    entry->value.u.fileval = filename_copy(value);
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    memstats_push_tag("conf");
+    conf_install_primary(conf, primary)->u.fileval = filename_copy(value);
+    memstats_pop_tag();
 }
 
 void conf_set_fontspec(Conf *conf, int primary, const FontSpec *value)
 {
-    struct conf_entry *entry = snew(struct conf_entry);
-
-    assert(subkeytypes[primary] == TYPE_NONE);
     assert(valuetypes[primary] == TYPE_FONT);
-    entry->key.primary = primary;
-    entry->value.u.fontval = fontspec_copy(value);
-    conf_insert(conf, entry);
+    conf_unshare(conf);
+    memstats_push_tag("conf");
+    conf_install_primary(conf, primary)->u.fontval = fontspec_copy(value);
+    memstats_pop_tag();
+}
+
+static void serialise_value(BinarySink *bs, struct value *value, int type)
+{
+    switch (type) {
+      case TYPE_BOOL:
+        put_bool(bs, value->u.boolval);
+        break;
+      case TYPE_INT:
+        put_uint32(bs, value->u.intval);
+        break;
+      case TYPE_STR:
+        put_asciz(bs, value->u.stringval);
+        break;
+      case TYPE_FILENAME:
+        filename_serialise(bs, value->u.fileval);
+        break;
+      case TYPE_FONT:
+        fontspec_serialise(bs, value->u.fontval);
+        break;
+    }
 }
 
 void conf_serialise(BinarySink *bs, Conf *conf)
 {
-    int i;
+    int primary, ti;
     struct conf_entry *entry;
 
-    for (i = 0; (entry = index234(conf->tree, i)) != NULL; i++) {
-        put_uint32(bs, entry->key.primary);
-
-        switch (subkeytypes[entry->key.primary]) {
-          case TYPE_INT:
-            put_uint32(bs, entry->key.secondary.i);
-            break;
-          case TYPE_STR:
-            put_asciz(bs, entry->key.secondary.s);
-            break;
-        }
-        switch (valuetypes[entry->key.primary]) {
-          case TYPE_BOOL:
-            put_bool(bs, entry->value.u.boolval);
+    /*
+     * Interleave the three kinds of storage in primary key order, so
+     * that the output is identical to when everything lived in one
+     * tree. (The tree is sorted with primary as the major key, and
+     * the intkey vectors are sorted by subkey, so one linear walk of
+     * each keeps in step with the loop over primaries.)
+     */
+    ti = 0;
+    for (primary = 0; primary < N_CONFIG_OPTIONS; primary++) {
+        switch (subkeytypes[primary]) {
+          case TYPE_NONE:
+            if (!conf->data->present[primary])
+                continue;
+            put_uint32(bs, primary);
+            serialise_value(bs, &conf->data->values[primary],
+                            valuetypes[primary]);
             break;
-          case TYPE_INT:
-            put_uint32(bs, entry->value.u.intval);
+          case TYPE_INT: {
+            struct intkey_vector *v = &conf->data->intvec[primary];
+            for (size_t j = 0; j < v->nentries; j++) {
+                put_uint32(bs, primary);
+                put_uint32(bs, v->entries[j].subkey);
+                serialise_value(bs, &v->entries[j].value,
+                                valuetypes[primary]);
+            }
             break;
+          }
           case TYPE_STR:
-            put_asciz(bs, entry->value.u.stringval);
-            break;
-          case TYPE_FILENAME:
-            filename_serialise(bs, entry->value.u.fileval);
-            break;
-          case TYPE_FONT:
-            fontspec_serialise(bs, entry->value.u.fontval);
+            while ((entry = index234(conf->data->tree, ti)) != NULL &&
+                   entry->key.primary == primary) {
+                ti++;
+                put_uint32(bs, primary);
+                put_asciz(bs, entry->key.secondary.s);
+                serialise_value(bs, &entry->value, valuetypes[primary]);
+            }
             break;
         }
     }
@@ -538,9 +766,10 @@ void conf_serialise(BinarySink *bs, Conf *conf)
     put_uint32(bs, 0xFFFFFFFFU);
 }
 
-bool conf_deserialise(Conf *conf, BinarySource *src)
+static bool conf_deserialise_inner(Conf *conf, BinarySource *src)
 {
     struct conf_entry *entry;
+    struct value value;
     unsigned primary;
 
     while (1) {
@@ -553,18 +782,68 @@ bool conf_deserialise(Conf *conf, BinarySource *src)
         if (primary >= N_CONFIG_OPTIONS)
             return false;
 
-        entry = snew(struct conf_entry);
-        entry->key.primary = primary;
+        if (subkeytypes[primary] == TYPE_NONE) {
+            switch (valuetypes[primary]) {
+              case TYPE_BOOL:
+                value.u.boolval = get_bool(src);
+                break;
+              case TYPE_INT:
+                value.u.intval = toint(get_uint32(src));
+                break;
+              case TYPE_STR:
+                value.u.stringval = dupstr(get_asciz(src));
+                break;
+              case TYPE_FILENAME:
+                value.u.fileval = filename_deserialise(src);
+                break;
+              case TYPE_FONT:
+                value.u.fontval = fontspec_deserialise(src);
+                break;
+            }
+
+            if (get_err(src)) {
+                free_value(&value, valuetypes[primary]);
+                return false;
+            }
+
+            *conf_install_primary(conf, primary) = value;
+            continue;
+        }
 
-        switch (subkeytypes[entry->key.primary]) {
-          case TYPE_INT:
-            entry->key.secondary.i = toint(get_uint32(src));
-            break;
-          case TYPE_STR:
-            entry->key.secondary.s = dupstr(get_asciz(src));
-            break;
+        if (subkeytypes[primary] == TYPE_INT) {
+            int secondary = toint(get_uint32(src));
+
+            switch (valuetypes[primary]) {
+              case TYPE_BOOL:
+                value.u.boolval = get_bool(src);
+                break;
+              case TYPE_INT:
+                value.u.intval = toint(get_uint32(src));
+                break;
+              case TYPE_STR:
+                value.u.stringval = dupstr(get_asciz(src));
+                break;
+              case TYPE_FILENAME:
+                value.u.fileval = filename_deserialise(src);
+                break;
+              case TYPE_FONT:
+                value.u.fontval = fontspec_deserialise(src);
+                break;
+            }
+
+            if (get_err(src)) {
+                free_value(&value, valuetypes[primary]);
+                return false;
+            }
+
+            *intvec_install(conf, primary, secondary) = value;
+            continue;
         }
 
+        entry = snew(struct conf_entry);
+        entry->key.primary = primary;
+        entry->key.secondary.s = dupstr(get_asciz(src));
+
         switch (valuetypes[entry->key.primary]) {
           case TYPE_BOOL:
             entry->value.u.boolval = get_bool(src);
@@ -591,3 +870,12 @@ bool conf_deserialise(Conf *conf, BinarySource *src)
         conf_insert(conf, entry);
     }
 }
+
+bool conf_deserialise(Conf *conf, BinarySource *src)
+{
+    conf_unshare(conf);
+    memstats_push_tag("conf");
+    bool ret = conf_deserialise_inner(conf, src);
+    memstats_pop_tag();
+    return ret;
+}
@@ -15,8 +15,24 @@ void BinarySink_put_datapl(BinarySink *bs, ptrlen pl)
     BinarySink_put_data(bs, pl.ptr, pl.len);
 }
 
+void BinarySink_put_datav(BinarySink *bs, const ptrlen *views, size_t nviews)
+{
+    for (size_t i = 0; i < nviews; i++)
+        bs->write(bs, views[i].ptr, views[i].len);
+}
+
+void *BinarySink_put_reserve(BinarySink *bs, size_t len)
+{
+    return bs->reserve ? bs->reserve(bs, len) : NULL;
+}
+
 void BinarySink_put_padding(BinarySink *bs, size_t len, unsigned char padbyte)
 {
+    if (bs->reserve) {
+        memset(bs->reserve(bs, len), padbyte, len);
+        return;
+    }
+
     char buf[16];
     memset(buf, padbyte, sizeof(buf));
     while (len > 0) {
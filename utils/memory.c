@@ -3,13 +3,259 @@
  */
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
 
 #include "defs.h"
 #include "puttymem.h"
 #include "misc.h"
 
+/*
+ * Optional per-subsystem allocation accounting, enabled by setting
+ * PUTTY_MEMSTATS in the environment. When active, every allocation
+ * gains a small header recording its usable size and the tag that was
+ * current when it was made, so that frees and reallocs can maintain
+ * exact per-tag totals; subsystems label their allocations by
+ * bracketing them with memstats_push_tag/memstats_pop_tag, and
+ * anything allocated outside any bracket counts as "other". The
+ * enablement decision is taken once, at the first allocation, so
+ * headers are either present on every block or on none of them.
+ *
+ * Reallocation keeps a block's original tag, whatever tag scope the
+ * resize happens to occur in: the block still belongs to whoever
+ * created it.
+ */
+
+/*
+ * Additionally setting PUTTY_MEMSITES records the same figures per
+ * allocation call site, keyed by the return address of the
+ * safemalloc/saferealloc call, in a small fixed-size open-addressed
+ * hash table. Each block's header remembers the slot its site was
+ * filed under, so frees and reallocs maintain exact per-site live
+ * totals too. Sites beyond the table's capacity, and all sites on
+ * compilers without __builtin_return_address, are lumped into a
+ * catch-all slot.
+ */
+
+#define MEMSTATS_MAX_TAGS 16
+#define MEMSTATS_MAX_DEPTH 8
+#define MEMSITES_TABLE_SIZE 1024       /* must be a power of 2 */
+#define MEMSITES_DUMP_MAX 32
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MEMSITES_RETURN_ADDRESS() __builtin_return_address(0)
+#else
+#define MEMSITES_RETURN_ADDRESS() NULL
+#endif
+
+struct memstat {
+    const char *name;
+    uint64_t cur_bytes, peak_bytes, cur_blocks, total_allocs;
+};
+
+static struct memstat memstats[MEMSTATS_MAX_TAGS] = { { "other" } };
+static unsigned memstats_ntags = 1;
+
+struct memsite {
+    void *site;                        /* NULL = free slot */
+    uint64_t cur_bytes, peak_bytes, cur_blocks, total_allocs, total_bytes;
+};
+
+/* Slot 0 is the catch-all for a full table or an unknown site, so
+ * the probe loop below never hands it out for a real address. */
+static struct memsite memsites[MEMSITES_TABLE_SIZE];
+static int memsites_state = -1;        /* -1 = not yet looked up */
+
+static bool memsites_active(void)
+{
+    if (memsites_state < 0)
+        memsites_state = (getenv("PUTTY_MEMSITES") != NULL);
+    return memsites_state > 0;
+}
+
+static unsigned memsites_lookup(void *site)
+{
+    unsigned i, h;
+
+    if (!site)
+        return 0;
+
+    h = ((unsigned)((uintptr_t)site >> 4)) * 0x9E3779B9u;
+    for (i = 0; i < MEMSITES_TABLE_SIZE; i++) {
+        unsigned slot = (h + i) & (MEMSITES_TABLE_SIZE - 1);
+        if (slot == 0)
+            continue;
+        if (memsites[slot].site == site)
+            return slot;
+        if (!memsites[slot].site) {
+            memsites[slot].site = site;
+            return slot;
+        }
+    }
+    return 0;                          /* table full */
+}
+static unsigned memstats_tag_stack[MEMSTATS_MAX_DEPTH];
+static unsigned memstats_tag_depth = 0;
+static int memstats_state = -1;        /* -1 = not yet looked up */
+static volatile int memstats_dump_flag = 0;
+
+bool memstats_active(void)
+{
+    if (memstats_state < 0)
+        memstats_state = (getenv("PUTTY_MEMSTATS") != NULL ||
+                          getenv("PUTTY_MEMSITES") != NULL);
+    return memstats_state > 0;
+}
+
+typedef union memstats_header {
+    struct {
+        size_t size;                   /* usable size, excluding header */
+        unsigned tag;
+        unsigned site;                 /* memsites[] slot, or 0 */
+    } h;
+    double align[2];     /* keep the caller's block as aligned as malloc's */
+} memstats_header;
+
+static unsigned memstats_current_tag(void)
+{
+    unsigned d = memstats_tag_depth;
+    if (d == 0)
+        return 0;
+    if (d > MEMSTATS_MAX_DEPTH)
+        d = MEMSTATS_MAX_DEPTH;
+    return memstats_tag_stack[d - 1];
+}
+
+void memstats_push_tag(const char *name)
+{
+    unsigned i;
+
+    if (!memstats_active())
+        return;
+
+    for (i = 0; i < memstats_ntags; i++)
+        if (!strcmp(memstats[i].name, name))
+            break;
+    if (i == memstats_ntags) {
+        if (memstats_ntags < MEMSTATS_MAX_TAGS)
+            memstats[memstats_ntags++].name = name;
+        else
+            i = 0;              /* too many distinct tags: file as other */
+    }
+
+    /* Pushes beyond the stack's capacity still count for balance with
+     * the matching pops, but deeper tags are simply not recorded. */
+    if (memstats_tag_depth < MEMSTATS_MAX_DEPTH)
+        memstats_tag_stack[memstats_tag_depth] = i;
+    memstats_tag_depth++;
+}
+
+void memstats_pop_tag(void)
+{
+    if (!memstats_active())
+        return;
+    assert(memstats_tag_depth > 0);
+    memstats_tag_depth--;
+}
+
+static void memstats_account_alloc(memstats_header *hdr, size_t size,
+                                   unsigned tag, unsigned site)
+{
+    struct memstat *ms = &memstats[tag];
+    hdr->h.size = size;
+    hdr->h.tag = tag;
+    hdr->h.site = site;
+    ms->cur_bytes += size;
+    ms->cur_blocks++;
+    ms->total_allocs++;
+    if (ms->cur_bytes > ms->peak_bytes)
+        ms->peak_bytes = ms->cur_bytes;
+
+    if (site) {
+        struct memsite *msite = &memsites[site];
+        msite->cur_bytes += size;
+        msite->cur_blocks++;
+        msite->total_allocs++;
+        msite->total_bytes += size;
+        if (msite->cur_bytes > msite->peak_bytes)
+            msite->peak_bytes = msite->cur_bytes;
+    }
+}
+
+static void memstats_account_free(memstats_header *hdr)
+{
+    struct memstat *ms = &memstats[hdr->h.tag];
+    ms->cur_bytes -= hdr->h.size;
+    ms->cur_blocks--;
+
+    if (hdr->h.site) {
+        struct memsite *msite = &memsites[hdr->h.site];
+        msite->cur_bytes -= hdr->h.size;
+        msite->cur_blocks--;
+    }
+}
+
+void memstats_request_dump(void)
+{
+    memstats_dump_flag = 1;            /* async-signal-safe */
+}
+
+void memstats_maybe_dump(void)
+{
+    unsigned i;
+
+    if (!memstats_dump_flag)
+        return;
+    memstats_dump_flag = 0;
+
+    fprintf(stderr, "memstats: ---- dump begins ----\n");
+    for (i = 0; i < memstats_ntags; i++) {
+        struct memstat *ms = &memstats[i];
+        fprintf(stderr, "memstats: %-12s cur=%"PRIu64" bytes in %"PRIu64
+                " blocks, peak=%"PRIu64" bytes, lifetime allocs=%"PRIu64"\n",
+                ms->name, ms->cur_bytes, ms->cur_blocks, ms->peak_bytes,
+                ms->total_allocs);
+    }
+    if (memsites_active()) {
+        struct memsite *top[MEMSITES_DUMP_MAX];
+        unsigned ntop = 0, j;
+
+        /* Insertion-select the top sites by lifetime bytes: the
+         * table is small enough not to bother with anything
+         * cleverer. */
+        for (i = 0; i < MEMSITES_TABLE_SIZE; i++) {
+            struct memsite *ms = &memsites[i];
+            if (!ms->total_allocs)
+                continue;
+            for (j = ntop < MEMSITES_DUMP_MAX ? ntop : MEMSITES_DUMP_MAX - 1;
+                 j > 0 && top[j-1]->total_bytes < ms->total_bytes; j--)
+                top[j] = top[j-1];
+            if (j < MEMSITES_DUMP_MAX &&
+                (j < ntop || ntop < MEMSITES_DUMP_MAX)) {
+                top[j] = ms;
+                if (ntop < MEMSITES_DUMP_MAX)
+                    ntop++;
+            }
+        }
+
+        fprintf(stderr, "memsites: ---- top sites by lifetime bytes ----\n");
+        for (j = 0; j < ntop; j++) {
+            struct memsite *ms = top[j];
+            fprintf(stderr, "memsites: %-14p total=%"PRIu64" bytes in %"
+                    PRIu64" allocs, cur=%"PRIu64" bytes in %"PRIu64
+                    " blocks, peak=%"PRIu64" bytes%s\n",
+                    ms->site, ms->total_bytes, ms->total_allocs,
+                    ms->cur_bytes, ms->cur_blocks, ms->peak_bytes,
+                    ms == &memsites[0] ? " (overflow/unknown)" : "");
+        }
+        fprintf(stderr, "memsites: ---- dump ends ----\n");
+    }
+
+    fprintf(stderr, "memstats: ---- dump ends ----\n");
+}
+
 void *safemalloc(size_t factor1, size_t factor2, size_t addend)
 {
     if (factor1 > SIZE_MAX / factor2)
@@ -25,6 +271,13 @@ void *safemalloc(size_t factor1, size_t factor2, size_t addend)
     if (size == 0)
         size = 1;
 
+    bool stats = memstats_active();
+    if (stats) {
+        if (size > SIZE_MAX - sizeof(memstats_header))
+            goto fail;
+        size += sizeof(memstats_header);
+    }
+
     void *p;
 #ifdef MINEFIELD
     p = minefield_c_malloc(size);
@@ -35,6 +288,15 @@ void *safemalloc(size_t factor1, size_t factor2, size_t addend)
     if (!p)
         goto fail;
 
+    if (stats) {
+        memstats_header *hdr = (memstats_header *)p;
+        unsigned site = memsites_active() ?
+            memsites_lookup(MEMSITES_RETURN_ADDRESS()) : 0;
+        memstats_account_alloc(hdr, size - sizeof(memstats_header),
+                               memstats_current_tag(), site);
+        p = hdr + 1;
+    }
+
     return p;
 
   fail:
@@ -44,11 +306,34 @@ void *safemalloc(size_t factor1, size_t factor2, size_t addend)
 void *saferealloc(void *ptr, size_t n, size_t size)
 {
     void *p;
+    bool stats = memstats_active();
+    unsigned tag = 0, site = 0;
 
     if (n > INT_MAX / size) {
         p = NULL;
     } else {
         size *= n;
+
+        if (size == 0)
+            size = 1;
+
+        if (stats) {
+            if (size > SIZE_MAX - sizeof(memstats_header))
+                out_of_memory();
+            size += sizeof(memstats_header);
+            if (ptr) {
+                memstats_header *hdr = ((memstats_header *)ptr) - 1;
+                tag = hdr->h.tag;
+                site = hdr->h.site;
+                memstats_account_free(hdr);
+                ptr = hdr;
+            } else {
+                tag = memstats_current_tag();
+                if (memsites_active())
+                    site = memsites_lookup(MEMSITES_RETURN_ADDRESS());
+            }
+        }
+
         if (!ptr) {
 #ifdef MINEFIELD
             p = minefield_c_malloc(size);
@@ -67,12 +352,23 @@ void *saferealloc(void *ptr, size_t n, size_t size)
     if (!p)
         out_of_memory();
 
+    if (stats) {
+        memstats_header *hdr = (memstats_header *)p;
+        memstats_account_alloc(hdr, size - sizeof(memstats_header), tag, site);
+        p = hdr + 1;
+    }
+
     return p;
 }
 
 void safefree(void *ptr)
 {
     if (ptr) {
+        if (memstats_active()) {
+            memstats_header *hdr = ((memstats_header *)ptr) - 1;
+            memstats_account_free(hdr);
+            ptr = hdr;
+        }
 #ifdef MINEFIELD
         minefield_c_free(ptr);
 #else
@@ -12,11 +12,36 @@ bool smemeq(const void *av, const void *bv, size_t len)
 {
     const unsigned char *a = (const unsigned char *)av;
     const unsigned char *b = (const unsigned char *)bv;
-    unsigned val = 0;
+    uint64_t diff = 0;
+    unsigned val;
 
-    while (len-- > 0) {
-        val |= *a++ ^ *b++;
+    /*
+     * Accumulate the bulk of the comparison a word at a time, via
+     * memcpy so as not to depend on alignment. This is just as
+     * side-channel-free as the byte loop below - every byte of both
+     * regions is still unconditionally loaded and ORed into the
+     * accumulator - but it's an eighth as many iterations.
+     */
+    while (len >= 8) {
+        uint64_t wa, wb;
+        memcpy(&wa, a, 8);
+        memcpy(&wb, b, 8);
+        diff |= wa ^ wb;
+        a += 8;
+        b += 8;
+        len -= 8;
     }
+
+    while (len-- > 0)
+        diff |= *a++ ^ *b++;
+
+    /* Fold the accumulated difference down to 8 bits, preserving
+     * whether it's zero. */
+    diff |= diff >> 32;
+    diff |= diff >> 16;
+    diff |= diff >> 8;
+    val = diff & 0xFF;
+
     /* Now val is 0 iff we want to return 1, and in the range
      * 0x01..0xFF iff we want to return 0. So subtracting from 0x100
      * will clear bit 8 iff we want to return 0, and leave it set iff
@@ -6,10 +6,20 @@
 #include "misc.h"
 #include "utils/utils.h"
 
+/*
+ * Small strings are kept in a buffer inside the strbuf_impl itself,
+ * so that constructing a strbuf costs a single malloc and building a
+ * typical short protocol string or message in it costs none at all.
+ * The string spills to a separately allocated buffer the first time
+ * it outgrows the inline space.
+ */
+#define STRBUF_INLINE_SIZE 64
+
 struct strbuf_impl {
     size_t size;
     struct strbuf visible;
     bool nm;          /* true if we insist on non-moving buffer resizes */
+    char inline_buf[STRBUF_INLINE_SIZE];
 };
 
 #define STRBUF_SET_UPTR(buf)                                    \
@@ -17,12 +27,39 @@ struct strbuf_impl {
 #define STRBUF_SET_PTR(buf, ptr)                                \
     ((buf)->visible.s = (ptr), STRBUF_SET_UPTR(buf))
 
+#define STRBUF_IS_INLINE(buf) ((buf)->visible.s == (buf)->inline_buf)
+
+/*
+ * Move an inline string into allocated storage of at least
+ * size_needed bytes, whether or not it has actually run out of
+ * space, e.g. because the string is about to be handed to something
+ * that will realloc it. The inline copy is cleared on the way out,
+ * on the same principle as the _nm resize strategy: it might have
+ * held a secret.
+ */
+static void strbuf_spill(struct strbuf_impl *buf, size_t size_needed)
+{
+    size_t newsize = 512;
+    while (newsize < size_needed)
+        newsize *= 2;
+    char *heapbuf = snewn(newsize, char);
+    memcpy(heapbuf, buf->inline_buf, buf->visible.len + 1);
+    smemclr(buf->inline_buf, STRBUF_INLINE_SIZE);
+    buf->size = newsize;
+    STRBUF_SET_PTR(buf, heapbuf);
+}
+
 void *strbuf_append(strbuf *buf_o, size_t len)
 {
     struct strbuf_impl *buf = container_of(buf_o, struct strbuf_impl, visible);
     char *toret;
-    sgrowarray_general(
-        buf->visible.s, buf->size, buf->visible.len + 1, len, buf->nm);
+    if (STRBUF_IS_INLINE(buf)) {
+        if (buf->visible.len + 1 + len > buf->size)
+            strbuf_spill(buf, buf->visible.len + 1 + len);
+    } else {
+        sgrowarray_general(
+            buf->visible.s, buf->size, buf->visible.len + 1, len, buf->nm);
+    }
     STRBUF_SET_UPTR(buf);
     toret = buf->visible.s + buf->visible.len;
     buf->visible.len += len;
@@ -60,14 +97,21 @@ static void strbuf_BinarySink_write(
     memcpy(strbuf_append(buf_o, len), data, len);
 }
 
+static void *strbuf_BinarySink_reserve(BinarySink *bs, size_t len)
+{
+    strbuf *buf_o = BinarySink_DOWNCAST(bs, strbuf);
+    return strbuf_append(buf_o, len);
+}
+
 static strbuf *strbuf_new_general(bool nm)
 {
     struct strbuf_impl *buf = snew(struct strbuf_impl);
-    BinarySink_INIT(&buf->visible, strbuf_BinarySink_write);
+    BinarySink_INIT_RESERVABLE(&buf->visible, strbuf_BinarySink_write,
+                               strbuf_BinarySink_reserve);
     buf->visible.len = 0;
-    buf->size = 512;
+    buf->size = STRBUF_INLINE_SIZE;
     buf->nm = nm;
-    STRBUF_SET_PTR(buf, snewn(buf->size, char));
+    STRBUF_SET_PTR(buf, buf->inline_buf);
     *buf->visible.s = '\0';
     return &buf->visible;
 }
@@ -78,13 +122,16 @@ void strbuf_free(strbuf *buf_o)
     struct strbuf_impl *buf = container_of(buf_o, struct strbuf_impl, visible);
     if (buf->visible.s) {
         smemclr(buf->visible.s, buf->size);
-        sfree(buf->visible.s);
+        if (!STRBUF_IS_INLINE(buf))
+            sfree(buf->visible.s);
     }
     sfree(buf);
 }
 char *strbuf_to_str(strbuf *buf_o)
 {
     struct strbuf_impl *buf = container_of(buf_o, struct strbuf_impl, visible);
+    if (STRBUF_IS_INLINE(buf))
+        strbuf_spill(buf, buf->visible.len + 1);
     char *ret = buf->visible.s;
     sfree(buf);
     return ret;
@@ -92,6 +139,8 @@ char *strbuf_to_str(strbuf *buf_o)
 void strbuf_catfv(strbuf *buf_o, const char *fmt, va_list ap)
 {
     struct strbuf_impl *buf = container_of(buf_o, struct strbuf_impl, visible);
+    if (STRBUF_IS_INLINE(buf))
+        strbuf_spill(buf, buf->visible.len + 1);
     STRBUF_SET_PTR(buf, dupvprintf_inner(buf->visible.s, buf->visible.len,
                                          &buf->size, fmt, ap));
     buf->visible.len += strlen(buf->visible.s + buf->visible.len);
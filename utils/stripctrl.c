@@ -242,6 +242,59 @@ static inline void stripctrl_term_put_wc(
         put_data(scc->bs_out, outbuf, produced);
 }
 
+/*
+ * Fast path for spans of printable ASCII, to avoid making a multibyte
+ * conversion call and a sink write per character of a large input
+ * (such as a multi-kilobyte SSH auth banner, most of which will be
+ * ordinary text). Returns the length of the initial segment of the
+ * input that consists of characters in the range 0x20..0x7E, which in
+ * any ASCII-superset locale (an assumption made throughout this code
+ * base) are all printable, one byte long and one column wide.
+ */
+static inline size_t stripctrl_ascii_span(const char *p, size_t len)
+{
+    size_t n = 0;
+    while (n < len) {
+        unsigned char c = p[n];
+        if (c < 0x20 || c > 0x7E)
+            break;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Emit a span of printable single-width characters, applying the same
+ * line-limiting transformation as stripctrl_check_line_limit but
+ * accounting for a whole run of characters at a time.
+ */
+static void stripctrl_put_span(
+    StripCtrlCharsImpl *scc, const char *p, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = len;
+
+        if (scc->line_limit) {
+            if (scc->line_start) {
+                put_datapl(scc->bs_out, PTRLEN_LITERAL("| "));
+                scc->line_start = false;
+                scc->line_chars_remaining = LINE_LIMIT;
+            }
+            if (scc->line_chars_remaining == 0) {
+                put_datapl(scc->bs_out, PTRLEN_LITERAL("\r\n> "));
+                scc->line_chars_remaining = LINE_LIMIT;
+            }
+            if (chunk > scc->line_chars_remaining)
+                chunk = scc->line_chars_remaining;
+            scc->line_chars_remaining -= chunk;
+        }
+
+        put_data(scc->bs_out, p, chunk);
+        p += chunk;
+        len -= chunk;
+    }
+}
+
 static inline size_t stripctrl_locale_try_consume(
     StripCtrlCharsImpl *scc, const char *p, size_t len)
 {
@@ -373,6 +426,23 @@ static void stripctrl_locale_BinarySink_write(
      * Now charge along the main string.
      */
     while (len > 0) {
+        /*
+         * If both conversion states are in their initial state (i.e.
+         * we're not part way through a multibyte character or in a
+         * non-default shift state), we can skip over any run of
+         * printable ASCII wholesale, instead of going through the
+         * full mbrtowc / iswprint / wcrtomb rigmarole per character.
+         */
+        if (mbsinit(&scc->mbs_in) && mbsinit(&scc->mbs_out)) {
+            size_t span = stripctrl_ascii_span(p, len);
+            if (span > 0) {
+                stripctrl_put_span(scc, p, span);
+                p += span;
+                len -= span;
+                continue;
+            }
+        }
+
         size_t consumed = stripctrl_locale_try_consume(scc, p, len);
         if (consumed == 0)
             break;
@@ -45,19 +45,70 @@ static int verbose = 0;
 #endif
 
 typedef struct node234_Tag node234;
+typedef struct nodeblock234_Tag nodeblock234;
 
 struct tree234_Tag {
     node234 *root;
     cmpfn234 cmp;
+    node234 *spare;       /* free nodes in the pool, chained via kids[0] */
+    nodeblock234 *blocks; /* all the pool's storage, for bulk free */
 };
 
+/*
+ * The fields consulted during a search (elems for the comparisons,
+ * kids and counts for descending) come first, so that for a 2-node
+ * or 3-node they all sit within the first cache line; parent is only
+ * needed when the tree is restructured, so it goes at the end.
+ */
 struct node234_Tag {
-    node234 *parent;
+    void *elems[3];
     node234 *kids[4];
     int counts[4];
-    void *elems[3];
+    node234 *parent;
 };
 
+/*
+ * Nodes are allocated from a per-tree pool, in blocks of this many,
+ * rather than one malloc apiece: trees like the terminal scrollback
+ * index and the timer queue create and destroy nodes constantly, and
+ * the pool turns that churn into pointer shuffling. Nodes freed
+ * during rebalancing go back on the tree's spare list for reuse, and
+ * freetree234 just frees the blocks without needing to walk the
+ * tree.
+ */
+#define NODES_PER_BLOCK234 32
+
+struct nodeblock234_Tag {
+    nodeblock234 *next;
+    node234 nodes[NODES_PER_BLOCK234];
+};
+
+static node234 *newnode234(tree234 *t)
+{
+    node234 *n;
+
+    if (!t->spare) {
+        nodeblock234 *blk = snew(nodeblock234);
+        size_t i;
+        blk->next = t->blocks;
+        t->blocks = blk;
+        for (i = NODES_PER_BLOCK234; i-- > 0 ;) {
+            blk->nodes[i].kids[0] = t->spare;
+            t->spare = &blk->nodes[i];
+        }
+    }
+
+    n = t->spare;
+    t->spare = n->kids[0];
+    return n;
+}
+
+static void freenode234(tree234 *t, node234 *n)
+{
+    n->kids[0] = t->spare;
+    t->spare = n;
+}
+
 /*
  * Create a 2-3-4 tree.
  */
@@ -67,26 +118,21 @@ tree234 *newtree234(cmpfn234 cmp)
     LOG(("created tree %p\n", ret));
     ret->root = NULL;
     ret->cmp = cmp;
+    ret->spare = NULL;
+    ret->blocks = NULL;
     return ret;
 }
 
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
-static void freenode234(node234 * n)
-{
-    if (!n)
-        return;
-    freenode234(n->kids[0]);
-    freenode234(n->kids[1]);
-    freenode234(n->kids[2]);
-    freenode234(n->kids[3]);
-    sfree(n);
-}
-
 void freetree234(tree234 * t)
 {
-    freenode234(t->root);
+    while (t->blocks) {
+        nodeblock234 *blk = t->blocks;
+        t->blocks = blk->next;
+        sfree(blk);
+    }
     sfree(t);
 }
 
@@ -142,7 +188,7 @@ static void *add234_internal(tree234 * t, void *e, int index)
 
     LOG(("adding node %p to tree %p\n", e, t));
     if (t->root == NULL) {
-        t->root = snew(node234);
+        t->root = newnode234(t);
         t->root->elems[1] = t->root->elems[2] = NULL;
         t->root->kids[0] = t->root->kids[1] = NULL;
         t->root->kids[2] = t->root->kids[3] = NULL;
@@ -315,7 +361,7 @@ static void *add234_internal(tree234 * t, void *e, int index)
             LOG(("  done\n"));
             break;
         } else {
-            node234 *m = snew(node234);
+            node234 *m = newnode234(t);
             m->parent = n->parent;
             LOG(("  splitting a 4-node; created new node %p\n", m));
             /*
@@ -438,7 +484,7 @@ static void *add234_internal(tree234 * t, void *e, int index)
         }
     } else {
         LOG(("  root is overloaded, split into two\n"));
-        t->root = snew(node234);
+        t->root = newnode234(t);
         t->root->kids[0] = left;
         t->root->counts[0] = lcount;
         t->root->elems[0] = e;
@@ -479,6 +525,84 @@ void *addpos234(tree234 * t, void *e, int index)
     return add234_internal(t, e, index);        /* this checks the upper bound */
 }
 
+/*
+ * Helper for newtree234_from_array: construct a subtree of height
+ * 'depth' containing the next 'n' elements from *elems, advancing
+ * the pointer past them. The caller guarantees that n fits within
+ * the minimum and maximum element counts for a tree of that height,
+ * so that every leaf ends up at the same depth.
+ */
+static node234 *buildnode234(tree234 *t, void ***elems, int n, int depth)
+{
+    node234 *node = newnode234(t);
+    int i, k, subcap, remaining;
+
+    if (depth == 0) {
+        assert(1 <= n && n <= 3);
+        for (i = 0; i < 3; i++)
+            node->elems[i] = i < n ? *(*elems)++ : NULL;
+        for (i = 0; i < 4; i++) {
+            node->kids[i] = NULL;
+            node->counts[i] = 0;
+        }
+        return node;
+    }
+
+    /* Maximum number of elements a subtree one level down can hold. */
+    subcap = 3;
+    for (i = 1; i < depth; i++)
+        subcap = subcap * 4 + 3;
+
+    /* Use as few kids as possible, so nodes near the root are full. */
+    for (k = 2; k < 4; k++)
+        if (n <= k * subcap + (k - 1))
+            break;
+
+    /*
+     * Distribute the elements not kept in this node as evenly as
+     * possible among the kids; an even split can't violate the
+     * subtree bounds if n itself was within range.
+     */
+    remaining = n - (k - 1);
+    for (i = 0; i < k; i++) {
+        int sub = (remaining + (k - 1 - i)) / (k - i);
+        node234 *kid = buildnode234(t, elems, sub, depth - 1);
+        kid->parent = node;
+        node->kids[i] = kid;
+        node->counts[i] = sub;
+        remaining -= sub;
+        if (i < k - 1)
+            node->elems[i] = *(*elems)++;
+    }
+    for (i = k; i < 4; i++) {
+        node->kids[i] = NULL;
+        node->counts[i] = 0;
+    }
+    for (i = k - 1; i < 3; i++)
+        node->elems[i] = NULL;
+
+    return node;
+}
+
+tree234 *newtree234_from_array(cmpfn234 cmp, void **elems, int n)
+{
+    tree234 *t = newtree234(cmp);
+
+    if (n > 0) {
+        int depth = 0, cap = 3;
+        void **p = elems;
+        while (cap < n) {
+            cap = cap * 4 + 3;
+            depth++;
+        }
+        t->root = buildnode234(t, &p, n, depth);
+        t->root->parent = NULL;
+        assert(p == elems + n);
+    }
+
+    return t;
+}
+
 /*
  * Look up the element at a given numeric index in a 2-3-4 tree.
  * Returns NULL if the index is out of range.
@@ -851,7 +975,7 @@ static void *delpos234_internal(tree234 * t, int index)
 
                     n->counts[ki + 1] = countnode234(sub);
 
-                    sfree(sib);
+                    freenode234(t, sib);
 
                     /*
                      * That's built the big node in sub. Now we
@@ -876,7 +1000,7 @@ static void *delpos234_internal(tree234 * t, int index)
                         LOG(("  shifting root!\n"));
                         t->root = sub;
                         sub->parent = NULL;
-                        sfree(n);
+                        freenode234(t, n);
                     }
                 }
             }
@@ -895,7 +1019,7 @@ static void *delpos234_internal(tree234 * t, int index)
          */
         if (!n->parent && !n->elems[1] && !n->kids[0]) {
             LOG(("  removed last element in tree\n"));
-            sfree(n);
+            freenode234(t, n);
             t->root = NULL;
             return retval;
         }
@@ -990,7 +1114,7 @@ static void *delpos234_internal(tree234 * t, int index)
             a->counts[3] = b->counts[1];
             if (a->kids[3])
                 a->kids[3]->parent = a;
-            sfree(b);
+            freenode234(t, b);
             n->counts[ei] = countnode234(a);
             /*
              * That's built the big node in a, and destroyed b. Now
@@ -1013,7 +1137,7 @@ static void *delpos234_internal(tree234 * t, int index)
                 LOG(("  shifting root!\n"));
                 t->root = a;
                 a->parent = NULL;
-                sfree(n);
+                freenode234(t, n);
             }
             /*
              * Now go round the deletion process again, with n
@@ -1631,6 +1755,26 @@ int main(int argc, char **argv)
         delpostest(j);
     }
 
+    /*
+     * Bulk construction: build an unsorted tree of every size up to
+     * several levels' worth from an array in one go, and check the
+     * result has valid structure and the right contents.
+     */
+    for (i = 0; i <= 3 * NSTR; i++) {
+        if (verbose)
+            printf("bulk build: %d elements\n", i);
+        if (arraysize < i) {
+            arraysize = i + 256;
+            array = sresize(array, arraysize, void *);
+        }
+        arraylen = i;
+        for (j = 0; j < i; j++)
+            array[j] = (void *)strings[j % NSTR];
+        tree = newtree234_from_array(NULL, array, i);
+        verify();
+        freetree234(tree);
+    }
+
     printf("%d errors found\n", n_errors);
     return (n_errors != 0);
 }
@@ -121,7 +121,7 @@ static bool bisearch(unsigned int ucs, const struct interval *table, int max) {
  * in ISO 10646.
  */
 
-int mk_wcwidth(unsigned int ucs)
+static int mk_wcwidth_uncached(unsigned int ucs)
 {
   /* sorted list of non-overlapping intervals of non-spacing characters */
   /* generated by "uniset +cat=Me +cat=Mn +cat=Cf -00AD +1160-11FF +200B c" */
@@ -323,6 +323,50 @@ int mk_wcwidth(unsigned int ucs)
 }
 
 
+
+/*
+ * Public entry points: two-level (page/offset) lookup tables in front
+ * of the interval data above, so that the innermost character loop of
+ * the terminal does an O(1) array lookup instead of a binary search
+ * per cell. Pages of 256 widths are built on demand from the interval
+ * tables, which therefore remain the single source of Unicode truth;
+ * only the handful of pages a session actually uses get built.
+ */
+#define WCWIDTH_NPAGES (0x110000 / 256)
+
+static int mk_wcwidth_cjk_uncached(unsigned int ucs);
+
+static int width_page_lookup(signed char **pages, unsigned int ucs,
+                             int (*fallback)(unsigned int))
+{
+  signed char *page;
+
+  if (ucs >= 0x110000)
+    return fallback(ucs);
+
+  page = pages[ucs >> 8];
+  if (!page) {
+    unsigned int base = ucs & ~0xFFu, i;
+    page = snewn(256, signed char);
+    for (i = 0; i < 256; i++)
+      page[i] = fallback(base + i);
+    pages[ucs >> 8] = page;
+  }
+  return page[ucs & 0xFF];
+}
+
+int mk_wcwidth(unsigned int ucs)
+{
+  static signed char *pages[WCWIDTH_NPAGES];
+  return width_page_lookup(pages, ucs, mk_wcwidth_uncached);
+}
+
+int mk_wcwidth_cjk(unsigned int ucs)
+{
+  static signed char *pages[WCWIDTH_NPAGES];
+  return width_page_lookup(pages, ucs, mk_wcwidth_cjk_uncached);
+}
+
 int mk_wcswidth(const unsigned int *pwcs, size_t n)
 {
   int w, width = 0;
@@ -346,7 +390,7 @@ int mk_wcswidth(const unsigned int *pwcs, size_t n)
  * the traditional terminal character-width behaviour. It is not
  * otherwise recommended for general use.
  */
-int mk_wcwidth_cjk(unsigned int ucs)
+static int mk_wcwidth_cjk_uncached(unsigned int ucs)
 {
   /* A sorted list of intervals of ambiguous width characters generated by:
    * https://raw.githubusercontent.com/GNOME/glib/37d4c2941bd0326b8b6e6bb22c81bd424fcc040b/glib/gen-unicode-tables.pl
@@ -26,19 +26,62 @@ void BinarySink_put_stringpl_xauth(BinarySink *bs, ptrlen pl)
 #define put_stringpl_xauth(bs, ptrlen) \
     BinarySink_put_stringpl_xauth(BinarySink_UPCAST(bs),ptrlen)
 
-void x11_get_auth_from_authfile(struct X11Display *disp,
-                                const char *authfilename)
+/*
+ * One parsed record from a .Xauthority file, with the fields decoded
+ * as far as we can do without reference to any particular display
+ * we're trying to match it against.
+ *
+ * The interpretation of the fields is as follows:
+ *
+ *  - 'family' is the network address family used to connect to the
+ *    display. 0 means IPv4; 6 means IPv6; 256 means Unix-domain
+ *    sockets.
+ *
+ *  - 'addr' is the network address itself. For IPv4 and IPv6, this
+ *    is a string of binary data of the appropriate length
+ *    (respectively 4 and 16 bytes) representing the address in
+ *    big-endian format, e.g. 7F 00 00 01 means IPv4 localhost. For
+ *    Unix-domain sockets, this is the host name of the machine on
+ *    which the Unix-domain display resides (so that an .Xauthority
+ *    file on a shared file system can contain authority entries for
+ *    Unix-domain displays on several machines without them
+ *    clashing).
+ *
+ *  - 'displaynum' is the display number. An empty display number in
+ *    the file is a wildcard for any display number, which we encode
+ *    as -1.
+ *
+ *  - 'protocol' is the authorisation protocol, which in the file is
+ *    encoded as its canonical string name (i.e. "MIT-MAGIC-COOKIE-1",
+ *    "XDM-AUTHORIZATION-1" or something we don't recognise), and
+ *    here has already been translated into an index into
+ *    x11_authnames. Records whose protocol we don't recognise at all
+ *    are not stored.
+ *
+ *  - 'data' is the actual authorisation data, stored in binary form.
+ *
+ * The string fields point at the auxiliary space of the record's own
+ * allocation.
+ */
+struct x11_authfile_record {
+    unsigned short family;
+    int displaynum;
+    int protocol;
+    ptrlen addr, data;
+};
+
+struct X11AuthFile {
+    struct x11_authfile_record **records;
+    size_t nrecords, recordsize;
+};
+
+X11AuthFile *x11_authfile_load(const char *authfilename)
 {
     FILE *authfp;
     char *buf;
     int size;
     BinarySource src[1];
-    int family, protocol;
-    ptrlen addr, protoname, data;
-    char *displaynum_string;
-    int displaynum;
-    bool ideal_match = false;
-    char *ourhostname;
+    X11AuthFile *af;
 
     /* A maximally sized (wildly implausible) .Xauthority record
      * consists of a 16-bit integer to start with, then four strings,
@@ -49,34 +92,13 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
     /* We'll want a buffer of twice that size (see below). */
     const size_t BUF_SIZE = 2 * MAX_RECORD_SIZE;
 
-    /*
-     * Normally we should look for precisely the details specified in
-     * `disp'. However, there's an oddity when the display is local:
-     * displays like "localhost:0" usually have their details stored
-     * in a Unix-domain-socket record (even if there isn't actually a
-     * real Unix-domain socket available, as with OpenSSH's proxy X11
-     * server).
-     *
-     * This is apparently a fudge to get round the meaninglessness of
-     * "localhost" in a shared-home-directory context -- xauth entries
-     * for Unix-domain sockets already disambiguate this by storing
-     * the *local* hostname in the conveniently-blank hostname field,
-     * but IP "localhost" records couldn't do this. So, typically, an
-     * IP "localhost" entry in the auth database isn't present and if
-     * it were it would be ignored.
-     *
-     * However, we don't entirely trust that (say) Windows X servers
-     * won't rely on a straight "localhost" entry, bad idea though
-     * that is; so if we can't find a Unix-domain-socket entry we'll
-     * fall back to an IP-based entry if we can find one.
-     */
-    bool localhost = !disp->unixdomain && sk_address_is_local(disp->addr);
-
     authfp = fopen(authfilename, "rb");
     if (!authfp)
-        return;
+        return NULL;
 
-    ourhostname = get_hostname();
+    af = snew(X11AuthFile);
+    af->records = NULL;
+    af->nrecords = af->recordsize = 0;
 
     /*
      * Allocate enough space to hold two maximally sized records, so
@@ -94,8 +116,13 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
     size = fread(buf, 1, BUF_SIZE, authfp);
     BinarySource_BARE_INIT(src, buf, size);
 
-    while (!ideal_match) {
-        bool match = false;
+    while (true) {
+        int family, protocol;
+        ptrlen addr, protoname, data;
+        char *displaynum_string;
+        int displaynum;
+        struct x11_authfile_record *record;
+        char *aux;
 
         if (src->pos >= MAX_RECORD_SIZE) {
             size -= src->pos;
@@ -114,57 +141,96 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
         if (get_err(src))
             break;
 
+        for (protocol = 1; protocol < lenof(x11_authnames); protocol++)
+            if (ptrlen_eq_string(protoname, x11_authnames[protocol]))
+                break;
+        if (protocol == lenof(x11_authnames))
+            continue;  /* don't recognise this protocol, ignore the record */
+
         /*
-         * Now we have a full X authority record in memory. See
-         * whether it matches the display we're trying to
-         * authenticate to.
-         *
-         * The details we've just read should be interpreted as
-         * follows:
-         *
-         *  - 'family' is the network address family used to
-         *    connect to the display. 0 means IPv4; 6 means IPv6;
-         *    256 means Unix-domain sockets.
-         *
-         *  - 'addr' is the network address itself. For IPv4 and
-         *    IPv6, this is a string of binary data of the
-         *    appropriate length (respectively 4 and 16 bytes)
-         *    representing the address in big-endian format, e.g.
-         *    7F 00 00 01 means IPv4 localhost. For Unix-domain
-         *    sockets, this is the host name of the machine on
-         *    which the Unix-domain display resides (so that an
-         *    .Xauthority file on a shared file system can contain
-         *    authority entries for Unix-domain displays on
-         *    several machines without them clashing).
-         *
-         *  - 'displaynum' is the display number. An empty display
-         *    number is a wildcard for any display number.
-         *
-         *  - 'protoname' is the authorisation protocol, encoded as
-         *    its canonical string name (i.e. "MIT-MAGIC-COOKIE-1",
-         *    "XDM-AUTHORIZATION-1" or something we don't recognise).
-         *
-         *  - 'data' is the actual authorisation data, stored in
-         *    binary form.
+         * Store the record, putting the two variable-length strings
+         * in the auxiliary space of the same allocation.
          */
+        record = snew_plus(struct x11_authfile_record, addr.len + data.len);
+        aux = snew_plus_get_aux(record);
+        record->family = family;
+        record->displaynum = displaynum;
+        record->protocol = protocol;
+        memcpy(aux, addr.ptr, addr.len);
+        record->addr = make_ptrlen(aux, addr.len);
+        memcpy(aux + addr.len, data.ptr, data.len);
+        record->data = make_ptrlen(aux + addr.len, data.len);
+
+        sgrowarray(af->records, af->recordsize, af->nrecords);
+        af->records[af->nrecords++] = record;
+    }
+
+    fclose(authfp);
+    smemclr(buf, BUF_SIZE);
+    sfree(buf);
+
+    return af;
+}
+
+void x11_authfile_free(X11AuthFile *af)
+{
+    for (size_t i = 0; i < af->nrecords; i++) {
+        struct x11_authfile_record *record = af->records[i];
+        smemclr(snew_plus_get_aux(record),
+                record->addr.len + record->data.len);
+        sfree(record);
+    }
+    sfree(af->records);
+    sfree(af);
+}
+
+void x11_authfile_lookup(X11AuthFile *af, struct X11Display *disp)
+{
+    bool ideal_match = false;
+    char *ourhostname;
+
+    /*
+     * Normally we should look for precisely the details specified in
+     * `disp'. However, there's an oddity when the display is local:
+     * displays like "localhost:0" usually have their details stored
+     * in a Unix-domain-socket record (even if there isn't actually a
+     * real Unix-domain socket available, as with OpenSSH's proxy X11
+     * server).
+     *
+     * This is apparently a fudge to get round the meaninglessness of
+     * "localhost" in a shared-home-directory context -- xauth entries
+     * for Unix-domain sockets already disambiguate this by storing
+     * the *local* hostname in the conveniently-blank hostname field,
+     * but IP "localhost" records couldn't do this. So, typically, an
+     * IP "localhost" entry in the auth database isn't present and if
+     * it were it would be ignored.
+     *
+     * However, we don't entirely trust that (say) Windows X servers
+     * won't rely on a straight "localhost" entry, bad idea though
+     * that is; so if we can't find a Unix-domain-socket entry we'll
+     * fall back to an IP-based entry if we can find one.
+     */
+    bool localhost = !disp->unixdomain && sk_address_is_local(disp->addr);
+
+    ourhostname = get_hostname();
+
+    for (size_t i = 0; i < af->nrecords && !ideal_match; i++) {
+        struct x11_authfile_record *record = af->records[i];
+        bool match = false;
 
         if (disp->displaynum < 0 ||
-            (displaynum >= 0 && disp->displaynum != displaynum))
+            (record->displaynum >= 0 &&
+             disp->displaynum != record->displaynum))
             continue;                  /* not the one */
 
-        for (protocol = 1; protocol < lenof(x11_authnames); protocol++)
-            if (ptrlen_eq_string(protoname, x11_authnames[protocol]))
-                break;
-        if (protocol == lenof(x11_authnames))
-            continue;  /* don't recognise this protocol, look for another */
-
-        switch (family) {
+        switch (record->family) {
           case 0:   /* IPv4 */
             if (!disp->unixdomain &&
                 sk_addrtype(disp->addr) == ADDRTYPE_IPV4) {
                 char buf[4];
                 sk_addrcopy(disp->addr, buf);
-                if (addr.len == 4 && !memcmp(addr.ptr, buf, 4)) {
+                if (record->addr.len == 4 &&
+                    !memcmp(record->addr.ptr, buf, 4)) {
                     match = true;
                     /* If this is a "localhost" entry, note it down
                      * but carry on looking for a Unix-domain entry. */
@@ -177,7 +243,8 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
                 sk_addrtype(disp->addr) == ADDRTYPE_IPV6) {
                 char buf[16];
                 sk_addrcopy(disp->addr, buf);
-                if (addr.len == 16 && !memcmp(addr.ptr, buf, 16)) {
+                if (record->addr.len == 16 &&
+                    !memcmp(record->addr.ptr, buf, 16)) {
                     match = true;
                     ideal_match = !localhost;
                 }
@@ -185,7 +252,8 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
             break;
           case 256: /* Unix-domain / localhost */
             if ((disp->unixdomain || localhost)
-                && ourhostname && ptrlen_eq_string(addr, ourhostname)) {
+                && ourhostname &&
+                ptrlen_eq_string(record->addr, ourhostname)) {
                 /* A matching Unix-domain socket is always the best
                  * match. */
                 match = true;
@@ -196,20 +264,27 @@ void x11_get_auth_from_authfile(struct X11Display *disp,
 
         if (match) {
             /* Current best guess -- may be overridden if !ideal_match */
-            disp->localauthproto = protocol;
+            disp->localauthproto = record->protocol;
             sfree(disp->localauthdata); /* free previous guess, if any */
-            disp->localauthdata = snewn(data.len, unsigned char);
-            memcpy(disp->localauthdata, data.ptr, data.len);
-            disp->localauthdatalen = data.len;
+            disp->localauthdata = snewn(record->data.len, unsigned char);
+            memcpy(disp->localauthdata, record->data.ptr, record->data.len);
+            disp->localauthdatalen = record->data.len;
         }
     }
 
-    fclose(authfp);
-    smemclr(buf, 2 * MAX_RECORD_SIZE);
-    sfree(buf);
     sfree(ourhostname);
 }
 
+void x11_get_auth_from_authfile(struct X11Display *disp,
+                                const char *authfilename)
+{
+    X11AuthFile *af = x11_authfile_load(authfilename);
+    if (!af)
+        return;
+    x11_authfile_lookup(af, disp);
+    x11_authfile_free(af);
+}
+
 void x11_format_auth_for_authfile(
     BinarySink *bs, SockAddr *addr, int display_no,
     ptrlen authproto, ptrlen authdata)
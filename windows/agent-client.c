@@ -127,13 +127,26 @@ static void wm_copydata_agent_query(strbuf *query, void **out, int *outlen)
 
 char *agent_named_pipe_name(void)
 {
-    char *username, *suffix, *pipename;
-    username = get_username();
-    suffix = capi_obfuscate_string("Pageant");
-    pipename = dupprintf("\\\\.\\pipe\\pageant.%s.%s", username, suffix);
-    sfree(username);
-    sfree(suffix);
-    return pipename;
+    /*
+     * The pipe name never changes within a process (it's derived
+     * from our username), and computing it involves a pass of
+     * cryptographic hashing in capi_obfuscate_string, so work it out
+     * once and cache it rather than redoing that for every agent
+     * query.
+     */
+    static char *cached_pipename = NULL;
+
+    if (!cached_pipename) {
+        char *username, *suffix;
+        username = get_username();
+        suffix = capi_obfuscate_string("Pageant");
+        cached_pipename = dupprintf("\\\\.\\pipe\\pageant.%s.%s",
+                                    username, suffix);
+        sfree(username);
+        sfree(suffix);
+    }
+
+    return dupstr(cached_pipename);
 }
 
 Socket *agent_connect(Plug *plug)
@@ -162,7 +175,7 @@ bool agent_exists(void)
 }
 
 struct agent_pending_query {
-    struct handle *handle;
+    struct handle *handle, *hout;
     HANDLE os_handle;
     strbuf *response;
     void (*callback)(void *, void *, int);
@@ -186,6 +199,17 @@ static int named_pipe_agent_accumulate_response(
     return 0; /* not done yet */
 }
 
+static void named_pipe_agent_sentdata(struct handle *h, size_t new_backlog,
+                                      int err)
+{
+    agent_pending_query *pq = handle_get_privdata(h);
+
+    if (err) {
+        pq->callback(pq->callback_ctx, NULL, 0);
+        agent_cancel_query(pq);
+    }
+}
+
 static size_t named_pipe_agent_gotdata(
     struct handle *h, const void *data, size_t len, int err)
 {
@@ -226,19 +250,23 @@ static agent_pending_query *named_pipe_agent_query(
 
     strbuf_finalise_agent_query(query);
 
-    for (DWORD done = 0; done < query->len ;) {
-        DWORD nwritten;
-        bool ret = WriteFile(pipehandle, query->s + done, query->len - done,
-                             &nwritten, NULL);
-        if (!ret)
-            goto failure;
-
-        done += nwritten;
-    }
-
     if (!callback) {
         int status;
 
+        /*
+         * Synchronous query: write the request with plain blocking
+         * WriteFile, and read the reply the same way below.
+         */
+        for (DWORD done = 0; done < query->len ;) {
+            DWORD nwritten;
+            bool ret = WriteFile(pipehandle, query->s + done,
+                                 query->len - done, &nwritten, NULL);
+            if (!ret)
+                goto failure;
+
+            done += nwritten;
+        }
+
         sb = strbuf_new_nm();
         do {
             char buf[1024];
@@ -259,13 +287,23 @@ static agent_pending_query *named_pipe_agent_query(
         goto out;
     }
 
+    /*
+     * Asynchronous query: hand the request to a writer handle, so
+     * that we never block the main thread on the pipe even if its
+     * buffer is full. Each query gets its own connection to the
+     * pipe, so any number of them can be outstanding at once, with
+     * each reply arriving on the connection that sent the matching
+     * request.
+     */
     pq = snew(agent_pending_query);
     pq->handle = handle_input_new(pipehandle, named_pipe_agent_gotdata, pq, 0);
+    pq->hout = handle_output_new(pipehandle, named_pipe_agent_sentdata, pq, 0);
     pq->os_handle = pipehandle;
     pipehandle = INVALID_HANDLE_VALUE;  /* prevent it being closed below */
     pq->response = strbuf_new_nm();
     pq->callback = callback;
     pq->callback_ctx = callback_ctx;
+    handle_write(pq->hout, query->s, query->len);
     goto out;
 
   failure:
@@ -286,6 +324,7 @@ static agent_pending_query *named_pipe_agent_query(
 void agent_cancel_query(agent_pending_query *pq)
 {
     handle_free(pq->handle);
+    handle_free(pq->hout);
     CloseHandle(pq->os_handle);
     if (pq->response)
         strbuf_free(pq->response);
@@ -7,6 +7,8 @@ void cli_main_loop(cliloop_pre_t pre, cliloop_post_t post, void *ctx)
     unsigned long now, next, then;
     now = GETTICKCOUNT();
 
+    bool stats = loopstats_active();
+
     while (true) {
         DWORD n;
         DWORD ticks;
@@ -45,8 +47,18 @@ void cli_main_loop(cliloop_pre_t pre, cliloop_post_t post, void *ctx)
         for (size_t i = 0; i < n_extra_handles; i++)
             hwl->handles[extra_base + i] = extra_handles[i];
 
+        uint64_t dwell_start = stats ? loopstats_now_us() : 0;
+
         n = WaitForMultipleObjects(total_handles, hwl->handles, false, ticks);
 
+        if (stats) {
+            /* Includes time intentionally spent blocked waiting for
+             * events; the interesting signal is a loop spinning with
+             * near-zero dwell times. */
+            loopstats_record("wait-dwell", 0, dwell_start, true);
+            loopstats_maybe_dump();
+        }
+
         size_t extra_handle_index = n_extra_handles;
 
         if ((unsigned)(n - WAIT_OBJECT_0) < (unsigned)hwl->nhandles) {
@@ -237,7 +237,10 @@ static char *conpty_init(const BackendVtable *vt, Seat *seat,
     conpty->out = handle_output_new(in_w, conpty_sentdata, conpty, 0);
     in_w = INVALID_HANDLE_VALUE;
     conpty->inpipe = out_r;
-    conpty->in = handle_input_new(out_r, conpty_gotdata, conpty, 0);
+    /* Large read buffer: a local shell blasting output (e.g. listing
+     * a huge directory tree) easily outruns 4K-at-a-time reads. */
+    conpty->in = handle_input_new(out_r, conpty_gotdata, conpty,
+                                  HANDLE_FLAG_LARGEBUFFER);
     out_r = INVALID_HANDLE_VALUE;
     conpty->subprocess = add_handle_wait(
         pi.hProcess, conpty_process_wait_callback, conpty);
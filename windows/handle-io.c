@@ -43,6 +43,12 @@ struct handle_list_node {
 };
 static void add_to_ready_list(handle_list_node *node);
 
+struct handle_input;
+struct handle_output;
+static bool iocp_attach(HANDLE handle, int flags);
+static void iocp_issue_read(struct handle_input *ctx);
+static void iocp_issue_write(struct handle_output *ctx);
+
 /*
  * Maximum amount of backlog we will allow to build up on an input
  * handle before we stop reading from it.
@@ -68,6 +74,11 @@ struct handle_generic {
     bool done;                         /* request subthread to terminate */
     bool defunct;                      /* has the subthread already gone? */
     bool busy;                         /* operation currently in progress? */
+    bool use_iocp;                     /* does the I/O completion port
+                                        * service this handle, in place
+                                        * of a subthread? */
+    OVERLAPPED iocp_ovl;               /* state of the current IOCP-based
+                                        * I/O operation, if so */
     void *privdata;                    /* for client to remember who they are */
 };
 
@@ -91,6 +102,11 @@ struct handle_input {
     bool done;                         /* request subthread to terminate */
     bool defunct;                      /* has the subthread already gone? */
     bool busy;                         /* operation currently in progress? */
+    bool use_iocp;                     /* does the I/O completion port
+                                        * service this handle, in place
+                                        * of a subthread? */
+    OVERLAPPED iocp_ovl;               /* state of the current IOCP-based
+                                        * I/O operation, if so */
     void *privdata;                    /* for client to remember who they are */
 
     /*
@@ -102,7 +118,8 @@ struct handle_input {
      * Data set by the input thread before marking the handle ready,
      * and read by the main thread after receiving that signal.
      */
-    char buffer[4096];                 /* the data read from the handle */
+    char *buffer;                      /* the data read from the handle */
+    size_t bufsize;                    /* space allocated in 'buffer' */
     DWORD len;                         /* how much data that was */
     int readerr;                       /* lets us know about read errors */
 
@@ -134,7 +151,7 @@ static DWORD WINAPI handle_input_threadfunc(void *param)
     if (ctx->flags & HANDLE_FLAG_UNITBUFFER)
         readlen = 1;
     else
-        readlen = sizeof(ctx->buffer);
+        readlen = ctx->bufsize;
 
     while (1) {
         if (povl) {
@@ -229,8 +246,11 @@ static void handle_throttle(struct handle_input *ctx, int backlog)
      * on the size of the backlog.
      */
     if (backlog < MAX_BACKLOG) {
-        SetEvent(ctx->ev_from_main);
         ctx->busy = true;
+        if (ctx->use_iocp)
+            iocp_issue_read(ctx);
+        else
+            SetEvent(ctx->ev_from_main);
     }
 }
 
@@ -252,6 +272,11 @@ struct handle_output {
     bool done;                         /* request subthread to terminate */
     bool defunct;                      /* has the subthread already gone? */
     bool busy;                         /* operation currently in progress? */
+    bool use_iocp;                     /* does the I/O completion port
+                                        * service this handle, in place
+                                        * of a subthread? */
+    OVERLAPPED iocp_ovl;               /* state of the current IOCP-based
+                                        * I/O operation, if so */
     void *privdata;                    /* for client to remember who they are */
 
     /*
@@ -357,8 +382,11 @@ static void handle_try_output(struct handle_output *ctx)
         ptrlen data = bufchain_prefix(&ctx->queued_data);
         ctx->buffer = data.ptr;
         ctx->len = min(data.len, ~(DWORD)0);
-        SetEvent(ctx->ev_from_main);
         ctx->busy = true;
+        if (ctx->use_iocp)
+            iocp_issue_write(ctx);
+        else
+            SetEvent(ctx->ev_from_main);
     } else if (!ctx->busy && bufchain_size(&ctx->queued_data) == 0 &&
                ctx->outgoingeof == EOF_PENDING) {
         CloseHandle(ctx->h);
@@ -425,6 +453,187 @@ static void remove_from_ready_list(handle_list_node *node)
     LeaveCriticalSection(ready_critsec);
 }
 
+/* ----------------------------------------------------------------------
+ * I/O completion port engine.
+ *
+ * Where a handle was opened for overlapped I/O - which includes all
+ * our named pipes, and hence every Pageant or connection-sharing
+ * client - we don't need the pair of subthreads at all. Instead, the
+ * main thread issues overlapped ReadFile/WriteFile calls directly,
+ * and their completions are delivered to a single I/O completion
+ * port shared between all such handles. One marshalling thread
+ * services the port and does nothing with each completion except
+ * store its results and put the handle on the ready list, exactly as
+ * the subthreads would have; the real work still happens on the main
+ * thread via handle_ready. So the per-handle cost is one port
+ * registration instead of two threads, and a server juggling
+ * hundreds of clients needs only this one extra thread in total.
+ *
+ * Handles that can't do overlapped I/O (anonymous pipes, consoles)
+ * fall back to the subthread mechanism below, which remains
+ * authoritative for them.
+ */
+
+static HANDLE iocp_port = INVALID_HANDLE_VALUE;
+static bool iocp_broken = false;
+
+static HMODULE iocp_kernel32_module;
+DECL_WINDOWS_FUNCTION(static, BOOL, CancelIoEx, (HANDLE, LPOVERLAPPED));
+
+static void iocp_issue_read(struct handle_input *ctx)
+{
+    DWORD readlen = (ctx->flags & HANDLE_FLAG_UNITBUFFER ?
+                     1 : ctx->bufsize);
+
+    memset(&ctx->iocp_ovl, 0, sizeof(ctx->iocp_ovl));
+    if (!ReadFile(ctx->h, ctx->buffer, readlen, NULL, &ctx->iocp_ovl) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        /*
+         * The read failed immediately, so no completion will ever
+         * arrive at the port. Report the result to the main thread
+         * ourselves, translating ERROR_BROKEN_PIPE into a clean EOF
+         * just as the input-thread version does.
+         */
+        ctx->readerr = GetLastError();
+        if (ctx->readerr == ERROR_BROKEN_PIPE)
+            ctx->readerr = 0;
+        ctx->len = 0;
+        add_to_ready_list(&ctx->ready_node);
+    }
+
+    /*
+     * In all other cases, even an immediate synchronous success, a
+     * completion packet is queued to the port, so the marshalling
+     * thread will deal with it.
+     */
+}
+
+static void iocp_issue_write(struct handle_output *ctx)
+{
+    memset(&ctx->iocp_ovl, 0, sizeof(ctx->iocp_ovl));
+    if (!WriteFile(ctx->h, ctx->buffer, ctx->len, NULL, &ctx->iocp_ovl) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        /* As above: no completion is coming, so report the failure
+         * ourselves. */
+        ctx->writeerr = GetLastError();
+        ctx->lenwritten = 0;
+        add_to_ready_list(&ctx->ready_node);
+    }
+}
+
+static DWORD WINAPI iocp_threadfunc(void *param)
+{
+    while (true) {
+        DWORD bytes;
+        ULONG_PTR key;
+        OVERLAPPED *ovl;
+        BOOL ok = GetQueuedCompletionStatus(
+            iocp_port, &bytes, &key, &ovl, INFINITE);
+        DWORD err = ok ? 0 : GetLastError();
+
+        if (!ovl) {
+            /*
+             * A failure with no OVERLAPPED pointer means the wait on
+             * the port itself went wrong, rather than any I/O
+             * operation; there's nothing useful we can do in
+             * response.
+             */
+            continue;
+        }
+
+        /*
+         * The OVERLAPPED structure lives inside the handle_input or
+         * handle_output it belongs to, within the common prefix of
+         * fields shared with handle_generic, so we can recover the
+         * owning struct handle from it.
+         */
+        struct handle_generic *g = container_of(
+            ovl, struct handle_generic, iocp_ovl);
+        struct handle *h = container_of(g, struct handle, u.g);
+
+        switch (h->type) {
+          case HT_INPUT: {
+            struct handle_input *ctx = &h->u.i;
+            ctx->readerr = err;
+            if (!ok) {
+                if (ctx->readerr == ERROR_BROKEN_PIPE)
+                    ctx->readerr = 0;    /* EOF in disguise, as above */
+                bytes = 0;
+            }
+            ctx->len = bytes;
+
+            if (ok && ctx->len == 0 && (ctx->flags & HANDLE_FLAG_IGNOREEOF)) {
+                iocp_issue_read(ctx);
+                break;
+            }
+
+            add_to_ready_list(&ctx->ready_node);
+            break;
+          }
+          case HT_OUTPUT: {
+            struct handle_output *ctx = &h->u.o;
+            ctx->writeerr = err;
+            ctx->lenwritten = ok ? bytes : 0;
+            add_to_ready_list(&ctx->ready_node);
+            break;
+          }
+        }
+    }
+
+    return 0;
+}
+
+static bool iocp_attach(HANDLE handle, int flags)
+{
+    if (!(flags & HANDLE_FLAG_OVERLAPPED))
+        return false;  /* this handle can't do overlapped I/O at all */
+
+    if (iocp_broken)
+        return false;
+
+    if (iocp_port == INVALID_HANDLE_VALUE) {
+        HANDLE port = CreateIoCompletionPort(
+            INVALID_HANDLE_VALUE, NULL, 0, 0);
+        if (!port) {
+            iocp_broken = true;
+            return false;
+        }
+
+        DWORD threadid; /* required for Win9x */
+        iocp_port = port;
+        HANDLE hThread = CreateThread(NULL, 0, iocp_threadfunc,
+                                      NULL, 0, &threadid);
+        if (!hThread) {
+            CloseHandle(iocp_port);
+            iocp_port = INVALID_HANDLE_VALUE;
+            iocp_broken = true;
+            return false;
+        }
+        CloseHandle(hThread);          /* we don't need the thread handle */
+
+        iocp_kernel32_module = load_system32_dll("kernel32.dll");
+        /* Not present in all the header sets we build against, so
+         * don't try to type-check it */
+        GET_WINDOWS_FUNCTION_NO_TYPECHECK(iocp_kernel32_module, CancelIoEx);
+    }
+
+    if (!CreateIoCompletionPort(handle, iocp_port, 0, 0)) {
+        /*
+         * ERROR_INVALID_PARAMETER is what we get back for a handle
+         * that is already associated with the port, which happens
+         * when a bidirectional handle such as a serial port comes
+         * through here once for each direction. That's fine: the
+         * association we made the first time is still in force.
+         * Anything else means this handle can't use the port, and
+         * must fall back to a subthread.
+         */
+        if (GetLastError() != ERROR_INVALID_PARAMETER)
+            return false;
+    }
+
+    return true;
+}
+
 static void handle_ready(struct handle *h); /* process one handle (below) */
 
 static void handle_ready_callback(void *vctx)
@@ -472,20 +681,35 @@ struct handle *handle_input_new(HANDLE handle, handle_inputfn_t gotdata,
 
     h->type = HT_INPUT;
     h->u.i.h = handle;
-    h->u.i.ev_from_main = CreateEvent(NULL, false, false, NULL);
+    /* Start with the list node linked to itself, so that it's safe to
+     * remove_from_ready_list a handle that was never put on the list
+     * (which can happen in the IOCP case, where nothing is listed
+     * until an I/O operation completes) */
+    h->u.i.ready_node.next = h->u.i.ready_node.prev = &h->u.i.ready_node;
     h->u.i.gotdata = gotdata;
     h->u.i.defunct = false;
     h->u.i.moribund = false;
     h->u.i.done = false;
     h->u.i.privdata = privdata;
     h->u.i.flags = flags;
+    h->u.i.bufsize = (flags & HANDLE_FLAG_LARGEBUFFER ? 65536 : 4096);
+    h->u.i.buffer = snewn(h->u.i.bufsize, char);
 
     ensure_ready_event_setup();
-    HANDLE hThread = CreateThread(NULL, 0, handle_input_threadfunc,
-                                  &h->u.i, 0, &in_threadid);
-    if (hThread)
-        CloseHandle(hThread);          /* we don't need the thread handle */
-    h->u.i.busy = true;
+    if (iocp_attach(handle, flags)) {
+        h->u.i.use_iocp = true;
+        h->u.i.ev_from_main = INVALID_HANDLE_VALUE;
+        h->u.i.busy = true;
+        iocp_issue_read(&h->u.i);
+    } else {
+        h->u.i.use_iocp = false;
+        h->u.i.ev_from_main = CreateEvent(NULL, false, false, NULL);
+        HANDLE hThread = CreateThread(NULL, 0, handle_input_threadfunc,
+                                      &h->u.i, 0, &in_threadid);
+        if (hThread)
+            CloseHandle(hThread);      /* we don't need the thread handle */
+        h->u.i.busy = true;
+    }
 
     return h;
 }
@@ -498,7 +722,7 @@ struct handle *handle_output_new(HANDLE handle, handle_outputfn_t sentdata,
 
     h->type = HT_OUTPUT;
     h->u.o.h = handle;
-    h->u.o.ev_from_main = CreateEvent(NULL, false, false, NULL);
+    h->u.o.ready_node.next = h->u.o.ready_node.prev = &h->u.o.ready_node;
     h->u.o.busy = false;
     h->u.o.defunct = false;
     h->u.o.moribund = false;
@@ -510,10 +734,17 @@ struct handle *handle_output_new(HANDLE handle, handle_outputfn_t sentdata,
     h->u.o.flags = flags;
 
     ensure_ready_event_setup();
-    HANDLE hThread = CreateThread(NULL, 0, handle_output_threadfunc,
-                                  &h->u.o, 0, &out_threadid);
-    if (hThread)
-        CloseHandle(hThread);          /* we don't need the thread handle */
+    if (iocp_attach(handle, flags)) {
+        h->u.o.use_iocp = true;
+        h->u.o.ev_from_main = INVALID_HANDLE_VALUE;
+    } else {
+        h->u.o.use_iocp = false;
+        h->u.o.ev_from_main = CreateEvent(NULL, false, false, NULL);
+        HANDLE hThread = CreateThread(NULL, 0, handle_output_threadfunc,
+                                      &h->u.o, 0, &out_threadid);
+        if (hThread)
+            CloseHandle(hThread);      /* we don't need the thread handle */
+    }
 
     return h;
 }
@@ -545,9 +776,12 @@ void handle_write_eof(struct handle *h)
 
 static void handle_destroy(struct handle *h)
 {
+    if (h->type == HT_INPUT)
+        sfree(h->u.i.buffer);
     if (h->type == HT_OUTPUT)
         bufchain_clear(&h->u.o.queued_data);
-    CloseHandle(h->u.g.ev_from_main);
+    if (h->u.g.ev_from_main != INVALID_HANDLE_VALUE)
+        CloseHandle(h->u.g.ev_from_main);
     remove_from_ready_list(&h->u.g.ready_node);
     sfree(h);
 }
@@ -558,8 +792,10 @@ void handle_free(struct handle *h)
     if (h->u.g.busy) {
         /*
          * If the handle is currently busy, we cannot immediately free
-         * it, because its subthread is in the middle of something.
-         * (Exception: foreign handles don't have a subthread.)
+         * it, because either its subthread is in the middle of
+         * something, or (for an IOCP handle) an overlapped operation
+         * is outstanding whose completion will write into the
+         * structure.
          *
          * Instead we must wait until it's finished its current
          * operation, because otherwise the subthread will write to
@@ -568,10 +804,20 @@ void handle_free(struct handle *h)
          * an operation completes.
          */
         h->u.g.moribund = true;
-    } else if (h->u.g.defunct) {
+        if (h->u.g.use_iocp && p_CancelIoEx) {
+            /*
+             * Where the system lets us, abandon the outstanding
+             * operation, so that the completion which permits us to
+             * free the structure arrives promptly rather than
+             * whenever the next data would have.
+             */
+            p_CancelIoEx(h->u.g.h, &h->u.g.iocp_ovl);
+        }
+    } else if (h->u.g.defunct || h->u.g.use_iocp) {
         /*
-         * There isn't even a subthread; we can go straight to
-         * handle_destroy.
+         * There isn't a subthread (either there never was one, for an
+         * idle IOCP handle, or it's already terminated); we can go
+         * straight to handle_destroy.
          */
         handle_destroy(h);
     } else {
@@ -597,8 +843,11 @@ static void handle_ready(struct handle *h)
          * dead from the external user's point of view, so we ignore
          * the actual I/O result. We just signal the thread to die if
          * we haven't yet done so, or destroy the handle if not.
+         * (IOCP handles have no thread, so for them the completion
+         * we were waiting for has now happened and we can destroy
+         * immediately.)
          */
-        if (h->u.g.done) {
+        if (h->u.g.use_iocp || h->u.g.done) {
             handle_destroy(h);
         } else {
             h->u.g.done = true;
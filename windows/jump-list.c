@@ -21,6 +21,7 @@
 
 #include "putty.h"
 #include "storage.h"
+#include "tree234.h"
 
 #define MAX_JUMPLIST_ITEMS 30 /* PuTTY will never show more items in
                                * the jumplist than this, regardless of
@@ -362,6 +363,71 @@ static const PROPERTYKEY PKEY_Title = {
 
 static char putty_path[2048];
 
+/*
+ * Cache of constructed IShellLink objects, so that rebuilding the
+ * jump list after each session launch doesn't redo a registry probe
+ * (open_settings_r, to check the session still exists) and a round of
+ * COM object construction for every entry already on the list. Keys
+ * are "S:" + session name or "A:" + application name, since the two
+ * namespaces could otherwise collide. The cache holds its own COM
+ * reference to each link; entries are dropped when the corresponding
+ * session is removed from the jump list, which PuTTY's own
+ * session-deletion path always does.
+ */
+struct cached_shell_link {
+    char *key;
+    IShellLink *link;
+};
+static tree234 *shell_link_cache = NULL;
+
+static int shell_link_cmp(void *av, void *bv)
+{
+    struct cached_shell_link *a = (struct cached_shell_link *)av;
+    struct cached_shell_link *b = (struct cached_shell_link *)bv;
+    return strcmp(a->key, b->key);
+}
+
+static IShellLink *shell_link_cache_lookup(const char *key)
+{
+    struct cached_shell_link search, *entry;
+
+    if (!shell_link_cache)
+        return NULL;
+    search.key = (char *)key;
+    entry = find234(shell_link_cache, &search, NULL);
+    if (!entry)
+        return NULL;
+    entry->link->lpVtbl->AddRef(entry->link);
+    return entry->link;
+}
+
+static void shell_link_cache_store(const char *key, IShellLink *link)
+{
+    struct cached_shell_link *entry = snew(struct cached_shell_link);
+
+    if (!shell_link_cache)
+        shell_link_cache = newtree234(shell_link_cmp);
+    entry->key = dupstr(key);
+    entry->link = link;
+    link->lpVtbl->AddRef(link);
+    add234(shell_link_cache, entry);
+}
+
+static void shell_link_cache_remove(const char *key)
+{
+    struct cached_shell_link search, *entry;
+
+    if (!shell_link_cache)
+        return;
+    search.key = (char *)key;
+    entry = del234(shell_link_cache, &search);
+    if (entry) {
+        entry->link->lpVtbl->Release(entry->link);
+        sfree(entry->key);
+        sfree(entry);
+    }
+}
+
 /*
  * Function to make an IShellLink describing a particular PuTTY
  * command. If 'appname' is null, the command run will be the one
@@ -382,10 +448,19 @@ static IShellLink *make_shell_link(const char *appname,
                                    const char *sessionname)
 {
     IShellLink *ret;
-    char *app_path, *param_string, *desc_string;
+    char *app_path, *param_string, *desc_string, *cache_key;
     IPropertyStore *pPS;
     PROPVARIANT pv;
 
+    /* If we've built this link before, reuse it. */
+    cache_key = sessionname ?
+        dupcat("S:", sessionname) : dupcat("A:", appname);
+    ret = shell_link_cache_lookup(cache_key);
+    if (ret) {
+        sfree(cache_key);
+        return ret;
+    }
+
     /* Retrieve path to executable. */
     if (!putty_path[0])
         GetModuleFileName(NULL, putty_path, sizeof(putty_path) - 1);
@@ -399,6 +474,7 @@ static IShellLink *make_shell_link(const char *appname,
                              appname);
         if ((fp = fopen(app_path, "r")) == NULL) {
             sfree(app_path);
+            sfree(cache_key);
             return NULL;
         }
         fclose(fp);
@@ -411,6 +487,7 @@ static IShellLink *make_shell_link(const char *appname,
         settings_r *psettings_tmp = open_settings_r(sessionname);
         if (!psettings_tmp) {
             sfree(app_path);
+            sfree(cache_key);
             return NULL;
         }
         close_settings_r(psettings_tmp);
@@ -421,6 +498,7 @@ static IShellLink *make_shell_link(const char *appname,
                                     CLSCTX_INPROC_SERVER,
                                     COMPTR(IShellLink, &ret)))) {
         sfree(app_path);
+        sfree(cache_key);
         return NULL;
     }
 
@@ -469,6 +547,9 @@ static IShellLink *make_shell_link(const char *appname,
         pPS->lpVtbl->Release(pPS);
     }
 
+    shell_link_cache_store(cache_key, ret);
+    sfree(cache_key);
+
     sfree(app_path);
 
     return ret;
@@ -703,6 +784,15 @@ void remove_session_from_jumplist(const char * const sessionname)
     if ((osMajorVersion < 6) || (osMajorVersion == 6 && osMinorVersion < 1))
         return;                        /* do nothing on pre-Win7 systems */
 
+    /* The session may be being removed because it's been deleted, so
+     * the cached link (whose validity we checked at build time) must
+     * go too. */
+    {
+        char *cache_key = dupcat("S:", sessionname);
+        shell_link_cache_remove(cache_key);
+        sfree(cache_key);
+    }
+
     if (remove_from_jumplist_registry(sessionname) == JUMPLISTREG_OK) {
         update_jumplist_from_registry();
     } else {
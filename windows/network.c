@@ -63,6 +63,8 @@ struct NetSocket {
     char oobdata[1];
     size_t sending_oob;
     bool oobinline, nodelay, keepalive, privport;
+    int sndbuf, rcvbuf;  /* requested kernel buffer sizes; 0 = OS default */
+    bool corked;                       /* batch small writes via Nagle */
     enum { EOF_NO, EOF_PENDING, EOF_SENT } outgoingeof;
     SockAddr *addr;
     SockAddrStep step;
@@ -561,6 +563,52 @@ SockAddr *sk_nonamelookup(const char *host)
     return ret;
 }
 
+/*
+ * 'Asynchronous' name lookup. This implementation still resolves
+ * synchronously (the lookup machinery here has no non-blocking
+ * backend yet), but it delivers the answer via a toplevel callback
+ * after sk_namelookup_async has returned, so that callers see the
+ * same shape of behaviour as on platforms where the lookup really
+ * does happen in the background.
+ */
+struct pending_lookup {
+    SockAddr *addr;
+    char *canonicalname;
+    sk_namelookup_fn_t callback;
+    void *vctx;
+};
+
+static void namelookup_deliver_ready(void *vctx)
+{
+    pending_lookup *pl = (pending_lookup *)vctx;
+    sk_namelookup_fn_t callback = pl->callback;
+    void *cctx = pl->vctx;
+    SockAddr *addr = pl->addr;
+    char *canonicalname = pl->canonicalname;
+
+    sfree(pl);
+    callback(addr, canonicalname, cctx);
+}
+
+pending_lookup *sk_namelookup_async(const char *host, int address_family,
+                                    sk_namelookup_fn_t callback, void *vctx)
+{
+    pending_lookup *pl = snew(pending_lookup);
+    pl->addr = sk_namelookup(host, &pl->canonicalname, address_family);
+    pl->callback = callback;
+    pl->vctx = vctx;
+    queue_toplevel_callback(namelookup_deliver_ready, pl);
+    return pl;
+}
+
+void sk_namelookup_cancel(pending_lookup *pl)
+{
+    delete_callbacks_for_context(pl);
+    sk_addr_free(pl->addr);
+    sfree(pl->canonicalname);
+    sfree(pl);
+}
+
 SockAddr *sk_namedpipe_addr(const char *pipename)
 {
     SockAddr *ret = snew(SockAddr);
@@ -816,6 +864,10 @@ static size_t sk_net_write(Socket *s, const void *data, size_t len);
 static size_t sk_net_write_oob(Socket *s, const void *data, size_t len);
 static void sk_net_write_eof(Socket *s);
 static void sk_net_set_frozen(Socket *s, bool is_frozen);
+static void sk_net_set_buffer_sizes(Socket *s, int sndbuf, int rcvbuf);
+static void sk_net_apply_buffer_sizes(NetSocket *s);
+static void sk_net_set_corked(Socket *s, bool corked);
+static void sk_net_apply_corked(NetSocket *s);
 static const char *sk_net_socket_error(Socket *s);
 static SocketPeerInfo *sk_net_peer_info(Socket *s);
 
@@ -826,6 +878,8 @@ static const SocketVtable NetSocket_sockvt = {
     .write_oob = sk_net_write_oob,
     .write_eof = sk_net_write_eof,
     .set_frozen = sk_net_set_frozen,
+    .set_buffer_sizes = sk_net_set_buffer_sizes,
+    .set_corked = sk_net_set_corked,
     .socket_error = sk_net_socket_error,
     .peer_info = sk_net_peer_info,
 };
@@ -853,6 +907,8 @@ static Socket *sk_net_accept(accept_ctx_t ctx, Plug *plug)
     ret->pending_error = 0;
     ret->parent = ret->child = NULL;
     ret->addr = NULL;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
 
     ret->s = (SOCKET)ctx.p;
 
@@ -940,6 +996,12 @@ static DWORD try_connect(NetSocket *sock)
         p_setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, (void *) &b, sizeof(b));
     }
 
+    /* Reapply any buffer sizes or cork state requested before this
+     * connection attempt, since each attempt makes a fresh socket. */
+    sk_net_apply_buffer_sizes(sock);
+    if (sock->corked)
+        sk_net_apply_corked(sock);
+
     /*
      * Bind to local address.
      */
@@ -1106,6 +1168,8 @@ Socket *sk_new(SockAddr *addr, int port, bool privport, bool oobinline,
     ret->oobinline = oobinline;
     ret->nodelay = nodelay;
     ret->keepalive = keepalive;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
     ret->privport = privport;
     ret->port = port;
     ret->addr = addr;
@@ -1153,6 +1217,8 @@ Socket *sk_newlistener(const char *srcaddr, int port, Plug *plug,
     ret->pending_error = 0;
     ret->parent = ret->child = NULL;
     ret->addr = NULL;
+    ret->sndbuf = ret->rcvbuf = 0;
+    ret->corked = false;
 
     /*
      * Translate address_family from platform-independent constants
@@ -1759,6 +1825,54 @@ static void sk_net_set_frozen(Socket *sock, bool is_frozen)
     s->frozen_readable = false;
 }
 
+/*
+ * Apply any configured kernel buffer sizes to a socket. This is
+ * best-effort: failure just leaves the buffer at its previous size,
+ * and winsock is free to clamp the values we ask for in any case.
+ */
+static void sk_net_apply_buffer_sizes(NetSocket *s)
+{
+    if (s->s == INVALID_SOCKET)
+        return;
+    if (s->sndbuf > 0)
+        p_setsockopt(s->s, SOL_SOCKET, SO_SNDBUF,
+                     (void *)&s->sndbuf, sizeof(s->sndbuf));
+    if (s->rcvbuf > 0)
+        p_setsockopt(s->s, SOL_SOCKET, SO_RCVBUF,
+                     (void *)&s->rcvbuf, sizeof(s->rcvbuf));
+}
+
+static void sk_net_set_buffer_sizes(Socket *sock, int sndbuf, int rcvbuf)
+{
+    NetSocket *s = container_of(sock, NetSocket, sock);
+    s->sndbuf = sndbuf;
+    s->rcvbuf = rcvbuf;
+    sk_net_apply_buffer_sizes(s);
+}
+
+/*
+ * Winsock has no TCP_CORK, so we approximate corking by disabling
+ * TCP_NODELAY while corked, letting Nagle coalesce the burst of small
+ * writes, and restoring the configured Nagle setting on uncork.
+ */
+static void sk_net_apply_corked(NetSocket *s)
+{
+    int b;
+    if (s->s == INVALID_SOCKET)
+        return;
+    b = (!s->corked && s->nodelay) ? 1 : 0;
+    p_setsockopt(s->s, IPPROTO_TCP, TCP_NODELAY, (void *)&b, sizeof(b));
+}
+
+static void sk_net_set_corked(Socket *sock, bool corked)
+{
+    NetSocket *s = container_of(sock, NetSocket, sock);
+    if (s->corked == corked)
+        return;
+    s->corked = corked;
+    sk_net_apply_corked(s);
+}
+
 void socket_reselect_all(void)
 {
     NetSocket *s;
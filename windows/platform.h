@@ -611,6 +611,11 @@ void init_ucs(Conf *, struct unicode_data *);
 #define HANDLE_FLAG_OVERLAPPED 1
 #define HANDLE_FLAG_IGNOREEOF 2
 #define HANDLE_FLAG_UNITBUFFER 4
+/* Use a 64K read buffer instead of the default 4K, for handles
+ * carrying bulk data (e.g. the ConPTY output pipe), so that a
+ * fast-producing source costs one thread or IOCP round trip per
+ * buffer rather than sixteen. */
+#define HANDLE_FLAG_LARGEBUFFER 8
 struct handle;
 typedef size_t (*handle_inputfn_t)(
     struct handle *h, const void *data, size_t len, int err);
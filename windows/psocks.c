@@ -9,6 +9,7 @@
 static const PsocksPlatform platform = {
     NULL /* open_pipes */,
     NULL /* start_subcommand */,
+    NULL /* start_workers */,
 };
 
 int main(int argc, char **argv)
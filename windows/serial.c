@@ -19,6 +19,7 @@ struct Serial {
     int bufsize;
     long clearbreak_time;
     bool break_in_progress;
+    bool batched_reads;
     Backend backend;
 };
 
@@ -184,6 +185,19 @@ static char *serial_configure(Serial *serial, HANDLE serport, Conf *conf)
         if (!SetCommTimeouts(serport, &timeouts))
             return dupprintf("Configuring serial timeouts: %s",
                              win_strerror(GetLastError()));
+
+        /*
+         * With the interval timeout in force, a full-buffer ReadFile
+         * returns as soon as a 1ms gap follows whatever data has
+         * arrived, so the input thread can safely issue large reads
+         * and deliver coalesced spans: at high baud rates that's the
+         * difference between one thread round trip per byte and one
+         * per buffer. Without it (e.g. a device that didn't even
+         * answer GetCommState), a large read might block until the
+         * buffer is completely full, so we stick to single-byte
+         * reads in that case.
+         */
+        serial->batched_reads = true;
     }
 
     return NULL;
@@ -215,6 +229,7 @@ static char *serial_init(const BackendVtable *vt, Seat *seat,
     serial->out = serial->in = NULL;
     serial->bufsize = 0;
     serial->break_in_progress = false;
+    serial->batched_reads = false;
     serial->backend.vt = vt;
     *backend_handle = &serial->backend;
 
@@ -270,7 +285,8 @@ static char *serial_init(const BackendVtable *vt, Seat *seat,
     serial->in = handle_input_new(serport, serial_gotdata, serial,
                                   HANDLE_FLAG_OVERLAPPED |
                                   HANDLE_FLAG_IGNOREEOF |
-                                  HANDLE_FLAG_UNITBUFFER);
+                                  (serial->batched_reads ?
+                                   0 : HANDLE_FLAG_UNITBUFFER));
 
     *realhost = dupstr(serline);
 
@@ -267,6 +267,12 @@ void del_settings(const char *sessionname)
 struct settings_e {
     HKEY key;
     int i;
+
+    /* Scratch buffer for reading key names into, retained across
+     * calls so that enumerating a long session list doesn't make an
+     * allocation per key. */
+    char *regbuf;
+    size_t regbuf_size;
 };
 
 settings_e *enum_settings_start(void)
@@ -281,6 +287,8 @@ settings_e *enum_settings_start(void)
     if (ret) {
         ret->key = key;
         ret->i = 0;
+        ret->regbuf_size = MAX_PATH + 1;
+        ret->regbuf = snewn(ret->regbuf_size, char);
     }
 
     return ret;
@@ -288,30 +296,28 @@ settings_e *enum_settings_start(void)
 
 bool enum_settings_next(settings_e *e, strbuf *sb)
 {
-    size_t regbuf_size = MAX_PATH + 1;
-    char *regbuf = snewn(regbuf_size, char);
     bool success;
 
     while (1) {
-        DWORD retd = RegEnumKey(e->key, e->i, regbuf, regbuf_size);
+        DWORD retd = RegEnumKey(e->key, e->i, e->regbuf, e->regbuf_size);
         if (retd != ERROR_MORE_DATA) {
             success = (retd == ERROR_SUCCESS);
             break;
         }
-        sgrowarray(regbuf, regbuf_size, regbuf_size);
+        sgrowarray(e->regbuf, e->regbuf_size, e->regbuf_size);
     }
 
     if (success)
-        unescape_registry_key(regbuf, sb);
+        unescape_registry_key(e->regbuf, sb);
 
     e->i++;
-    sfree(regbuf);
     return success;
 }
 
 void enum_settings_finish(settings_e *e)
 {
     RegCloseKey(e->key);
+    sfree(e->regbuf);
     sfree(e);
 }
 
@@ -447,17 +453,26 @@ void store_host_key(const char *hostname, int port,
                     const char *keytype, const char *key)
 {
     strbuf *regname;
-    HKEY rkey;
+
+    /*
+     * Keep the SshHostKeys key open between calls: a tool
+     * first-contacting many hosts stores many keys, and each store is
+     * then just a single value write rather than a key open + write +
+     * close round trip.
+     */
+    static HKEY rkey = NULL;
 
     regname = strbuf_new();
     hostkey_regname(regname, hostname, port, keytype);
 
-    if (RegCreateKey(HKEY_CURRENT_USER, PUTTY_REG_POS "\\SshHostKeys",
+    if (rkey != NULL ||
+        RegCreateKey(HKEY_CURRENT_USER, PUTTY_REG_POS "\\SshHostKeys",
                      &rkey) == ERROR_SUCCESS) {
         RegSetValueEx(rkey, regname->s, 0, REG_SZ,
                       (BYTE *)key, strlen(key) + 1);
-        RegCloseKey(rkey);
-    } /* else key does not exist in registry */
+    } else {
+        rkey = NULL;  /* key could not be created in registry */
+    }
 
     strbuf_free(regname);
 }
@@ -602,6 +617,26 @@ static HANDLE access_random_seed(int action)
     return INVALID_HANDLE_VALUE;
 }
 
+/*
+ * The cross-process transient host key cache mirror isn't provided
+ * on Windows: host keys live in the Registry here, which has no
+ * convenient locking primitive for a read-modify-write cycle, and
+ * the mirror's main beneficiary is scripted runs of short-lived
+ * command-line processes, which is much more a Unix usage pattern.
+ * Returning NULL makes the SSH code quietly keep its cache
+ * per-process, as before.
+ */
+transient_hostkey_cache_file *open_transient_hostkey_cache_file(
+    strbuf *contents)
+{
+    return NULL;
+}
+
+void close_transient_hostkey_cache_file(
+    transient_hostkey_cache_file *f, const char *new_contents)
+{
+}
+
 void read_random_seed(noise_consumer_t consumer)
 {
     HANDLE seedf = access_random_seed(OPEN_R);
@@ -30,6 +30,11 @@ bool platform_sha1_neon_available(void)
     return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
 }
 
+bool platform_crc32_arm_available(void)
+{
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+}
+
 bool platform_sha512_neon_available(void)
 {
     /* As of 2020-12-24, as far as I can tell from docs.microsoft.com,
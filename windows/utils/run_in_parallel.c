@@ -0,0 +1,81 @@
+/*
+ * Windows implementation of run_in_parallel(), distributing the jobs
+ * across one worker thread per CPU.
+ */
+
+#include "putty.h"
+
+struct parallel_shared {
+    void (*fn)(void *ctx, size_t index);
+    void *ctx;
+    size_t count, nworkers;
+};
+
+struct parallel_worker {
+    struct parallel_shared *shared;
+    size_t tid;
+    HANDLE thread;
+};
+
+/* Each worker takes every nworkers'th job, starting from its own id */
+static void run_worker_jobs(struct parallel_shared *shared, size_t tid)
+{
+    for (size_t i = tid; i < shared->count; i += shared->nworkers)
+        shared->fn(shared->ctx, i);
+}
+
+static DWORD WINAPI worker_thread_fn(void *vworker)
+{
+    struct parallel_worker *worker = (struct parallel_worker *)vworker;
+    run_worker_jobs(worker->shared, worker->tid);
+    return 0;
+}
+
+void run_in_parallel(size_t count, void (*fn)(void *ctx, size_t index),
+                     void *ctx)
+{
+    /* No point having more workers than jobs, or than CPUs to run
+     * them on. (The job count is permitted to be under hostile
+     * control, e.g. the parallelism parameter in a downloaded PPK
+     * file, so it mustn't translate directly into a thread count.) */
+    size_t nworkers = count;
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors > 0 &&
+        (size_t)si.dwNumberOfProcessors < nworkers)
+        nworkers = si.dwNumberOfProcessors;
+
+    if (nworkers <= 1) {
+        for (size_t i = 0; i < count; i++)
+            fn(ctx, i);
+        return;
+    }
+
+    struct parallel_shared shared;
+    shared.fn = fn;
+    shared.ctx = ctx;
+    shared.count = count;
+    shared.nworkers = nworkers;
+
+    struct parallel_worker *workers = snewn(nworkers, struct parallel_worker);
+    for (size_t tid = 1; tid < nworkers; tid++) {
+        workers[tid].shared = &shared;
+        workers[tid].tid = tid;
+        workers[tid].thread = CreateThread(
+            NULL, 0, worker_thread_fn, &workers[tid], 0, NULL);
+    }
+
+    /* This thread acts as worker 0, and also picks up the jobs of any
+     * worker whose thread failed to launch. */
+    run_worker_jobs(&shared, 0);
+    for (size_t tid = 1; tid < nworkers; tid++) {
+        if (workers[tid].thread) {
+            WaitForSingleObject(workers[tid].thread, INFINITE);
+            CloseHandle(workers[tid].thread);
+        } else {
+            run_worker_jobs(&shared, tid);
+        }
+    }
+
+    sfree(workers);
+}
@@ -0,0 +1,78 @@
+/*
+ * Windows implementation of run_in_worker_thread(), using a thread
+ * per job. The completion callback is delivered via an event object
+ * registered with handle-wait.c, so that it arrives on the main
+ * thread from whatever top-level event loop the program is running.
+ */
+
+#include "putty.h"
+
+struct WorkerThread {
+    void (*fn)(void *ctx);
+    void (*completion)(void *ctx);
+    void *ctx;
+    HANDLE thread, done_event;
+    HandleWait *hw;
+};
+
+static DWORD WINAPI worker_thread_real_fn(void *vwt)
+{
+    WorkerThread *wt = (WorkerThread *)vwt;
+    wt->fn(wt->ctx);
+    SetEvent(wt->done_event);
+    return 0;
+}
+
+static void worker_thread_free(WorkerThread *wt)
+{
+    delete_handle_wait(wt->hw);
+    CloseHandle(wt->thread);
+    CloseHandle(wt->done_event);
+    sfree(wt);
+}
+
+static void worker_done_callback(void *vwt)
+{
+    WorkerThread *wt = (WorkerThread *)vwt;
+    WaitForSingleObject(wt->thread, INFINITE);
+    void (*completion)(void *ctx) = wt->completion;
+    void *ctx = wt->ctx;
+    worker_thread_free(wt);
+    completion(ctx);
+}
+
+WorkerThread *run_in_worker_thread(
+    void (*fn)(void *ctx), void (*completion)(void *ctx), void *ctx)
+{
+    WorkerThread *wt = snew(WorkerThread);
+    wt->fn = fn;
+    wt->completion = completion;
+    wt->ctx = ctx;
+    wt->done_event = CreateEvent(NULL, false, false, NULL);
+    if (wt->done_event) {
+        wt->hw = add_handle_wait(wt->done_event, worker_done_callback, wt);
+        wt->thread = CreateThread(NULL, 0, worker_thread_real_fn, wt, 0, NULL);
+        if (wt->thread)
+            return wt;
+        delete_handle_wait(wt->hw);
+        CloseHandle(wt->done_event);
+    }
+    sfree(wt);
+
+    /*
+     * Fall back to running the job here and now. Completion still
+     * goes via the callback queue, so that the caller sees the same
+     * shape of events in both cases.
+     */
+    fn(ctx);
+    queue_toplevel_callback(completion, ctx);
+    return NULL;
+}
+
+void worker_thread_discard(WorkerThread *wt)
+{
+    if (!wt)
+        return;
+    WaitForSingleObject(wt->thread, INFINITE);
+    worker_thread_free(wt);
+}
@@ -0,0 +1,40 @@
+/*
+ * Windows stubs for the scrollback backing-file primitives declared
+ * in putty.h. No implementation is provided yet (one would use
+ * CreateFileMapping / MapViewOfFile); returning NULL from
+ * sb_file_open makes terminal.c fall back to ordinary in-memory
+ * scrollback, so the rest of these functions are never reached.
+ */
+
+#include "putty.h"
+
+ScrollbackFile *sb_file_open(const Filename *filename, uint64_t *size_out)
+{
+    return NULL;
+}
+
+void sb_file_close(ScrollbackFile *sf)
+{
+}
+
+void *sb_file_map(ScrollbackFile *sf, uint64_t offset, size_t len)
+{
+    return NULL;
+}
+
+void sb_file_unmap(void *ptr, size_t len)
+{
+}
+
+void sb_file_discard(ScrollbackFile *sf, uint64_t offset, uint64_t len)
+{
+}
+
+void sb_file_truncate(ScrollbackFile *sf)
+{
+}
+
+size_t sb_file_page_size(void)
+{
+    return 4096;
+}
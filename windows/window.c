@@ -96,6 +96,7 @@ static int TranslateKey(UINT message, WPARAM wParam, LPARAM lParam,
                         unsigned char *output);
 static void init_palette(void);
 static void init_fonts(int, int);
+static void glyph_atlas_flush(void);
 static void init_dpi_info(void);
 static void another_font(int);
 static void deinit_fonts(void);
@@ -237,6 +238,7 @@ static void wintw_draw_text(TermWin *, int x, int y, wchar_t *text, int len,
 static void wintw_draw_cursor(TermWin *, int x, int y, wchar_t *text, int len,
                               unsigned long attrs, int lattrs, truecolour tc);
 static void wintw_draw_trust_sigil(TermWin *, int x, int y);
+static bool wintw_draw_scroll(TermWin *, int topline, int botline, int lines);
 static int wintw_char_width(TermWin *, int uc);
 static void wintw_free_draw_ctx(TermWin *);
 static void wintw_set_cursor_pos(TermWin *, int x, int y);
@@ -264,6 +266,7 @@ static const TermWinVtable windows_termwin_vt = {
     .draw_text = wintw_draw_text,
     .draw_cursor = wintw_draw_cursor,
     .draw_trust_sigil = wintw_draw_trust_sigil,
+    .draw_scroll = wintw_draw_scroll,
     .char_width = wintw_char_width,
     .free_draw_ctx = wintw_free_draw_ctx,
     .set_cursor_pos = wintw_set_cursor_pos,
@@ -1574,6 +1577,9 @@ static void another_font(int fontno)
 static void deinit_fonts(void)
 {
     int i;
+
+    glyph_atlas_flush();
+
     for (i = 0; i < FONT_MAXNO; i++) {
         if (fonts[i])
             DeleteObject(fonts[i]);
@@ -2724,6 +2730,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
          */
         assert(!wintw_hdc);
         wintw_hdc = hdc;
+        gdi_cache_invalidate();
         term_paint(term,
                    (p.rcPaint.left-offset_width)/font_width,
                    (p.rcPaint.top-offset_height)/font_height,
@@ -3425,6 +3432,162 @@ static void sys_cursor_update(void)
     ImmReleaseContext(wgs.term_hwnd, hIMC);
 }
 
+/*
+ * Cache of the text-related GDI state most recently selected into
+ * wintw_hdc. A screen redraw makes one do_text_internal call per
+ * attribute run, and consecutive runs very often share the same font
+ * and colours (most of a typical screen is in the default
+ * attributes), so remembering what's already selected lets us skip
+ * the great majority of SelectObject / SetTextColor / SetBkColor /
+ * SetBkMode / SetTextAlign calls within a single paint cycle. The
+ * cache must be invalidated whenever wintw_hdc changes, and whenever
+ * anything fiddles with the HDC's text state behind our back.
+ */
+static struct {
+    bool valid;
+    HFONT font;
+    COLORREF fg, bg;
+    int bkmode;
+    UINT align;
+} gdi_cache;
+
+static void gdi_cache_invalidate(void)
+{
+    gdi_cache.valid = false;
+}
+
+static void gdi_cache_set_bkmode(int bkmode)
+{
+    if (!gdi_cache.valid || gdi_cache.bkmode != bkmode) {
+        SetBkMode(wintw_hdc, bkmode);
+        gdi_cache.bkmode = bkmode;
+    }
+}
+
+static void gdi_cache_select(HFONT font, COLORREF fg, COLORREF bg,
+                             int bkmode, UINT align)
+{
+    if (!gdi_cache.valid || gdi_cache.font != font)
+        SelectObject(wintw_hdc, font);
+    if (!gdi_cache.valid || gdi_cache.fg != fg)
+        SetTextColor(wintw_hdc, fg);
+    if (!gdi_cache.valid || gdi_cache.bg != bg)
+        SetBkColor(wintw_hdc, bg);
+    if (!gdi_cache.valid || gdi_cache.bkmode != bkmode)
+        SetBkMode(wintw_hdc, bkmode);
+    if (!gdi_cache.valid || gdi_cache.align != align)
+        SetTextAlign(wintw_hdc, align);
+    gdi_cache.font = font;
+    gdi_cache.fg = fg;
+    gdi_cache.bg = bg;
+    gdi_cache.bkmode = bkmode;
+    gdi_cache.align = align;
+    gdi_cache.valid = true;
+}
+
+/*
+ * Cache of rendered glyph cell images, for the benefit of text that
+ * GDI renders slowly: anything that takes the font-linking fallback
+ * path (very commonly CJK text in a Latin font), where each
+ * ExtTextOutW call re-runs font selection and glyph lookup per
+ * character. We render each (character, font, colours) combination
+ * once into a small compatible bitmap of exactly one character cell,
+ * and satisfy subsequent paints of the same cell content with a
+ * BitBlt, which is cheap and doesn't depend on the complexity of the
+ * glyph. The cache is direct-mapped and a colliding entry is simply
+ * re-rendered, so the memory cost is strictly bounded; repeated
+ * glyphs in a scrolling CJK log stay resident. Entries bake in the
+ * cell size and the VT100 linedraw vertical adjustment, and the whole
+ * cache is flushed whenever the fonts are rebuilt.
+ */
+#define GLYPH_ATLAS_SIZE 2048
+
+struct glyph_atlas_entry {
+    bool valid;
+    wchar_t ch;
+    int nfont;
+    COLORREF fg, bg;
+    int cell_width;
+    int text_adjust;
+    HBITMAP bitmap;
+};
+
+static struct glyph_atlas_entry glyph_atlas[GLYPH_ATLAS_SIZE];
+static HDC glyph_atlas_dc = NULL;
+
+static void glyph_atlas_flush(void)
+{
+    int i;
+
+    if (glyph_atlas_dc) {
+        DeleteDC(glyph_atlas_dc);
+        glyph_atlas_dc = NULL;
+    }
+    for (i = 0; i < GLYPH_ATLAS_SIZE; i++) {
+        if (glyph_atlas[i].valid) {
+            DeleteObject(glyph_atlas[i].bitmap);
+            glyph_atlas[i].valid = false;
+        }
+    }
+}
+
+static struct glyph_atlas_entry *glyph_atlas_get(
+    wchar_t ch, int nfont, COLORREF fg, COLORREF bg,
+    int cell_width, int text_adjust)
+{
+    unsigned hash = ((unsigned)ch * 0x9E3779B9u) ^
+        ((unsigned)nfont << 20) ^ ((unsigned)text_adjust << 12) ^
+        ((unsigned)fg * 3u) ^ ((unsigned)bg * 5u);
+    struct glyph_atlas_entry *ge = &glyph_atlas[hash % GLYPH_ATLAS_SIZE];
+    HBITMAP bitmap, oldbm;
+    RECT cell;
+
+    if (ge->valid && ge->ch == ch && ge->nfont == nfont &&
+        ge->fg == fg && ge->bg == bg && ge->cell_width == cell_width &&
+        ge->text_adjust == text_adjust)
+        return ge;
+
+    if (!glyph_atlas_dc) {
+        glyph_atlas_dc = CreateCompatibleDC(wintw_hdc);
+        if (!glyph_atlas_dc)
+            return NULL;
+    }
+    bitmap = CreateCompatibleBitmap(wintw_hdc, cell_width, font_height);
+    if (!bitmap)
+        return NULL;
+
+    /*
+     * Render the character once into the new bitmap, with the same
+     * GDI state do_text_internal would have used to draw it directly,
+     * so the pixels we blit back are identical.
+     */
+    oldbm = SelectObject(glyph_atlas_dc, bitmap);
+    SelectObject(glyph_atlas_dc, fonts[nfont]);
+    SetTextColor(glyph_atlas_dc, fg);
+    SetBkColor(glyph_atlas_dc, bg);
+    SetBkMode(glyph_atlas_dc, OPAQUE);
+    SetTextAlign(glyph_atlas_dc, TA_TOP | TA_LEFT | TA_NOUPDATECP);
+    cell.left = 0;
+    cell.top = 0;
+    cell.right = cell_width;
+    cell.bottom = font_height;
+    ExtTextOutW(glyph_atlas_dc, 0, text_adjust,
+                ETO_CLIPPED | ETO_OPAQUE, &cell, &ch, 1, NULL);
+    SelectObject(glyph_atlas_dc, oldbm);
+
+    if (ge->valid)
+        DeleteObject(ge->bitmap);
+    ge->valid = true;
+    ge->ch = ch;
+    ge->nfont = nfont;
+    ge->fg = fg;
+    ge->bg = bg;
+    ge->cell_width = cell_width;
+    ge->text_adjust = text_adjust;
+    ge->bitmap = bitmap;
+    return ge;
+}
+
 static void draw_horizontal_line_on_text(int y, int lattr, RECT line_box,
                                          COLORREF colour)
 {
@@ -3462,6 +3625,7 @@ static void do_text_internal(
     int text_adjust = 0;
     int xoffset = 0;
     int maxlen, remaining;
+    UINT align;
     bool opaque;
     bool is_cursor = false;
     static int *lpDx = NULL;
@@ -3602,13 +3766,6 @@ static void do_text_internal(
                  GetBValue(fg) * 2 / 3);
     }
 
-    SelectObject(wintw_hdc, fonts[nfont]);
-    SetTextColor(wintw_hdc, fg);
-    SetBkColor(wintw_hdc, bg);
-    if (attr & TATTR_COMBINING)
-        SetBkMode(wintw_hdc, TRANSPARENT);
-    else
-        SetBkMode(wintw_hdc, OPAQUE);
     line_box.left = x;
     line_box.top = y;
     line_box.right = x + char_width * len;
@@ -3645,7 +3802,7 @@ static void do_text_internal(
          * generally reasonable results.
          */
         xoffset = char_width / 2;
-        SetTextAlign(wintw_hdc, TA_TOP | TA_CENTER | TA_NOUPDATECP);
+        align = TA_TOP | TA_CENTER | TA_NOUPDATECP;
         lpDx_maybe = NULL;
         maxlen = 1;
     } else {
@@ -3654,11 +3811,14 @@ static void do_text_internal(
          * in the normal way.
          */
         xoffset = 0;
-        SetTextAlign(wintw_hdc, TA_TOP | TA_LEFT | TA_NOUPDATECP);
+        align = TA_TOP | TA_LEFT | TA_NOUPDATECP;
         lpDx_maybe = lpDx;
         maxlen = len;
     }
 
+    gdi_cache_select(fonts[nfont], fg, bg,
+                     (attr & TATTR_COMBINING) ? TRANSPARENT : OPAQUE, align);
+
     opaque = true;                     /* start by erasing the rectangle */
     for (remaining = len; remaining > 0;
          text += len, remaining -= len, x += char_width * len2) {
@@ -3745,7 +3905,7 @@ static void do_text_internal(
                         &line_box, uni_buf, nlen,
                         lpDx_maybe);
             if (bold_font_mode == BOLD_SHADOW && (attr & ATTR_BOLD)) {
-                SetBkMode(wintw_hdc, TRANSPARENT);
+                gdi_cache_set_bkmode(TRANSPARENT);
                 ExtTextOutW(wintw_hdc, x + xoffset - 1,
                             y - font_height * (lattr ==
                                                LATTR_BOT) + text_adjust,
@@ -3766,7 +3926,7 @@ static void do_text_internal(
                        ETO_CLIPPED | (opaque ? ETO_OPAQUE : 0),
                        &line_box, directbuf, len, lpDx_maybe);
             if (bold_font_mode == BOLD_SHADOW && (attr & ATTR_BOLD)) {
-                SetBkMode(wintw_hdc, TRANSPARENT);
+                gdi_cache_set_bkmode(TRANSPARENT);
 
                 /* GRR: This draws the character outside its box and
                  * can leave 'droppings' even with the clip box! I
@@ -3797,19 +3957,76 @@ static void do_text_internal(
             for (i = 0; i < len; i++)
                 wbuf[i] = text[i];
 
-            /* print Glyphs as they are, without Windows' Shaping*/
-            general_textout(wintw_hdc, x + xoffset,
-                            y - font_height * (lattr==LATTR_BOT) + text_adjust,
-                            &line_box, wbuf, len, lpDx,
-                            opaque && !(attr & TATTR_COMBINING));
+            /*
+             * See if the whole run can be satisfied from the glyph
+             * atlas: one opaque fixed-pitch cell per character, no
+             * combining overdraw, no bidi, no surrogate pairs or
+             * variation selectors, and none of the drawing-offset
+             * complications of double-height lines or shadow bold.
+             * These conditions also guarantee that general_textout
+             * would have used plain ExtTextOutW. (A glyph overhanging
+             * its cell gets clipped to the cell here, where a direct
+             * draw would only have clipped it to the run; for
+             * fixed-pitch fonts the difference is marginal.)
+             */
+            bool atlas_ok = lpDx_maybe != NULL && opaque &&
+                !(attr & TATTR_COMBINING) &&
+                (lattr == LATTR_NORM || lattr == LATTR_WIDE) &&
+                !(bold_font_mode == BOLD_SHADOW && (attr & ATTR_BOLD));
+            for (i = 0; atlas_ok && i < len; i++) {
+                if (is_rtl(wbuf[i]) || IS_LOW_VARSEL(wbuf[i]) ||
+                    (i+1 < len &&
+                     (IS_SURROGATE_PAIR(wbuf[i], wbuf[i+1]) ||
+                      IS_HIGH_VARSEL(wbuf[i], wbuf[i+1]))))
+                    atlas_ok = false;
+            }
 
-            /* And the shadow bold hack. */
-            if (bold_font_mode == BOLD_SHADOW && (attr & ATTR_BOLD)) {
-                SetBkMode(wintw_hdc, TRANSPARENT);
-                ExtTextOutW(wintw_hdc, x + xoffset - 1,
-                            y - font_height * (lattr ==
-                                               LATTR_BOT) + text_adjust,
-                            ETO_CLIPPED, &line_box, wbuf, len, lpDx_maybe);
+            if (atlas_ok) {
+                int bx = x + xoffset;
+                int by = y - font_height * (lattr == LATTR_BOT);
+                for (i = 0; i < len; i++) {
+                    struct glyph_atlas_entry *ge = glyph_atlas_get(
+                        wbuf[i], nfont, fg, bg, char_width, text_adjust);
+                    int w = char_width;
+                    if (bx + w > line_box.right)
+                        w = line_box.right - bx;
+                    if (w > 0) {
+                        if (ge) {
+                            SelectObject(glyph_atlas_dc, ge->bitmap);
+                            BitBlt(wintw_hdc, bx, by, w, font_height,
+                                   glyph_atlas_dc, 0, 0, SRCCOPY);
+                        } else {
+                            /* Failed to make a cache entry (e.g. out
+                             * of GDI resources): draw this one cell
+                             * directly. */
+                            RECT cell;
+                            cell.left = bx;
+                            cell.top = by;
+                            cell.right = bx + w;
+                            cell.bottom = by + font_height;
+                            ExtTextOutW(wintw_hdc, bx, by + text_adjust,
+                                        ETO_CLIPPED | ETO_OPAQUE, &cell,
+                                        wbuf + i, 1, NULL);
+                        }
+                    }
+                    bx += char_width;
+                }
+            } else {
+                /* print Glyphs as they are, without Windows' Shaping*/
+                general_textout(
+                    wintw_hdc, x + xoffset,
+                    y - font_height * (lattr==LATTR_BOT) + text_adjust,
+                    &line_box, wbuf, len, lpDx,
+                    opaque && !(attr & TATTR_COMBINING));
+
+                /* And the shadow bold hack. */
+                if (bold_font_mode == BOLD_SHADOW && (attr & ATTR_BOLD)) {
+                    gdi_cache_set_bkmode(TRANSPARENT);
+                    ExtTextOutW(wintw_hdc, x + xoffset - 1,
+                                y - font_height * (lattr ==
+                                                   LATTR_BOT) + text_adjust,
+                                ETO_CLIPPED, &line_box, wbuf, len, lpDx_maybe);
+                }
             }
         }
 
@@ -3817,7 +4034,7 @@ static void do_text_internal(
          * If we're looping round again, stop erasing the background
          * rectangle.
          */
-        SetBkMode(wintw_hdc, TRANSPARENT);
+        gdi_cache_set_bkmode(TRANSPARENT);
         opaque = false;
     }
 
@@ -3960,6 +4177,19 @@ static void wintw_draw_trust_sigil(TermWin *tw, int x, int y)
                0, NULL, DI_NORMAL);
 }
 
+static bool wintw_draw_scroll(TermWin *tw, int topline, int botline, int lines)
+{
+    /*
+     * We draw straight to the window rather than to a backing store
+     * of our own, so a blit here would have to be ScrollWindowEx with
+     * all the attendant care over pending update regions and areas
+     * obscured by other windows. Until someone does that work, just
+     * decline, and the terminal will redraw the scrolled lines the
+     * way it always has.
+     */
+    return false;
+}
+
 /* This function gets the actual width of a character in the normal font.
  */
 static int wintw_char_width(TermWin *tw, int uc)
@@ -3971,6 +4201,10 @@ static int wintw_char_width(TermWin *tw, int uc)
      */
     if (!font_dualwidth) return 1;
 
+    /* We select fonts into wintw_hdc directly below, so the cached
+     * text state is no longer trustworthy. */
+    gdi_cache_invalidate();
+
     switch (uc & CSET_MASK) {
       case CSET_ASCII:
         uc = ucsdata.unitab_line[uc & 0xFF];
@@ -4745,6 +4979,7 @@ static bool wintw_setup_draw_ctx(TermWin *tw)
 {
     assert(!wintw_hdc);
     wintw_hdc = make_hdc();
+    gdi_cache_invalidate();
     return wintw_hdc != NULL;
 }
 
@@ -4753,6 +4988,7 @@ static void wintw_free_draw_ctx(TermWin *tw)
     assert(wintw_hdc);
     free_hdc(wintw_hdc);
     wintw_hdc = NULL;
+    gdi_cache_invalidate();
 }
 
 /*